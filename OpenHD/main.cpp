@@ -37,10 +37,15 @@
 
 #include "openhd_buttons.h"
 #include "openhd_global_constants.hpp"
+#include "openhd_memory.h"
+#include "openhd_metrics.h"
 #include "openhd_platform.h"
 #include "openhd_profile.h"
+#include "openhd_settings_persistent.h"
 #include "openhd_spdlog.h"
+#include "openhd_startup_orchestrator.h"
 #include "openhd_temporary_air_or_ground.h"
+#include "openhd_thread_policy.h"
 #include "openhd_config.h"
 #include "config_paths.h"
 
@@ -54,7 +59,7 @@
 
 // A few run time options, only for development. Way more configuration (during
 // development) can be done by using the hardware.config file
-static const char optstr[] = "?:agcwr:h:";
+static const char optstr[] = "?:agcwr:h:t:";
 static const struct option long_options[] = {
     {"air", no_argument, nullptr, 'a'},
     {"ground", no_argument, nullptr, 'g'},
@@ -62,6 +67,7 @@ static const struct option long_options[] = {
     {"no-qt-autostart", no_argument, nullptr, 'w'},
     {"run-time-seconds", required_argument, nullptr, 'r'},
     {"hardware-config-file", required_argument, nullptr, 'h'},
+    {"boot-trace", required_argument, nullptr, 't'},
     {nullptr, 0, nullptr, 0},
 };
     const std::string red = "\033[31m";
@@ -78,6 +84,8 @@ struct OHDRunOptions {
   // the default location (and default values if no file exists at the default
   // location) is used
   std::optional<std::string> hardware_config_file;
+  // Write the startup timing (chrome trace json) to this file
+  std::optional<std::string> boot_trace_file;
 };
 
 static OHDRunOptions parse_run_parameters(int argc, char *argv[]) {
@@ -117,6 +125,9 @@ static OHDRunOptions parse_run_parameters(int argc, char *argv[]) {
       case 'h':
         ret.hardware_config_file = tmp_optarg;
         break;
+      case 't':
+        ret.boot_trace_file = tmp_optarg;
+        break;
       case '?':
       default: {
         std::stringstream ss;
@@ -131,6 +142,8 @@ static OHDRunOptions parse_run_parameters(int argc, char *argv[]) {
               "infinite),for debugging] \n";
         ss << "--hardware-config-file -h [specify path to hardware.config "
               "file]\n";
+        ss << "--boot-trace -t [write startup timing as chrome trace json to "
+              "file]\n";
         ss << "Use hardware.conf for more configuration\n";
         std::cout << ss.str() << std::flush;
       }
@@ -246,6 +259,8 @@ int main(int argc, char *argv[]) {
   // not guaranteed, but better than nothing, check if openhd is already running
   // (kinda) and print warning if yes.
   openhd::check_currently_running_file_and_write();
+  // Before any threads are created
+  openhd::thread::lock_memory_if_enabled();
 
   // Create and link all the OpenHD modules.
   try {
@@ -262,62 +277,115 @@ int main(int argc, char *argv[]) {
     const auto profile = DProfile::discover(options.run_as_air);
     write_profile_manifest(profile);
 
+    // create the global action handler that allows openhd modules to
+    // communicate with each other e.g. when the rf link in ohd_interface needs
+    // to talk to the camera streams to reduce the bitrate
+    openhd::LinkActionHandler::instance();
+    // Optional, for debugging / profiling - serve the internal metrics
+    // (e.g. per stream packet counters) to a local prometheus scraper
+    std::unique_ptr<openhd::metrics::MetricsServer> metrics_server = nullptr;
+    if (const int metrics_port = openhd::load_config().GEN_METRICS_PORT;
+        metrics_port > 0) {
+      metrics_server =
+          std::make_unique<openhd::metrics::MetricsServer>(metrics_port);
+    }
+
+    // The modules are created concurrently, each step only waits for what it
+    // actually needs (e.g. the camera discovery doesn't wait for the wifi
+    // card(s), telemetry can talk to the ground as soon as the link is up)
+    openhd::StartupOrchestrator startup{};
+    std::shared_ptr<OHDTelemetry> ohdTelemetry = nullptr;
+    std::shared_ptr<OHDInterface> ohdInterface = nullptr;
+    // either one is active, depending on air or ground
+    std::unique_ptr<OHDVideoGround> ohd_video_ground = nullptr;
+#ifdef ENABLE_AIR
+    std::unique_ptr<OHDVideoAir> ohd_video_air = nullptr;
+#endif
     // we need to start QOpenHD when we are running as ground, or stop / disable
     // it when we are running as air. can be disabled for development purposes.
     // On x20, we do not have qopenhd installed (we run as air only) so we can
     // skip this step
-    if(!options.no_qopenhd_autostart){
-      if (!openhd::load_config().GEN_NO_QOPENHD_AUTOSTART &&
-          !OHDPlatform::instance().is_x20()) {
-        if (!profile.is_air) {
-          OHDUtil::run_command("systemctl", {"start", "qopenhd"});
-        } else {
-          OHDUtil::run_command("systemctl", {"stop", "qopenhd"});
+    startup.add_step("qopenhd_autostart", {}, [&options, &profile]() {
+      if (!options.no_qopenhd_autostart) {
+        if (!openhd::load_config().GEN_NO_QOPENHD_AUTOSTART &&
+            !OHDPlatform::instance().is_x20()) {
+          if (!profile.is_air) {
+            OHDUtil::run_command("systemctl", {"start", "qopenhd"});
+          } else {
+            OHDUtil::run_command("systemctl", {"stop", "qopenhd"});
+          }
         }
       }
-    }
-
-    // create the global action handler that allows openhd modules to
-    // communicate with each other e.g. when the rf link in ohd_interface needs
-    // to talk to the camera streams to reduce the bitrate
-    openhd::LinkActionHandler::instance();
-
+    });
     // We start ohd_telemetry as early as possible, since even without a link
     // (transmission) it still picks up local log message(s) and forwards them
     // to any ground station clients (e.g. QOpenHD)
-    auto ohdTelemetry = std::make_shared<OHDTelemetry>(profile);
-
-    // Then start ohdInterface, which discovers detected wifi cards and more.
-    auto ohdInterface = std::make_shared<OHDInterface>( profile);
-
-    // Telemetry allows changing all settings (even from other modules)
-    ohdTelemetry->add_settings_generic(ohdInterface->get_all_settings());
-
-    // either one is active, depending on air or ground
-    std::unique_ptr<OHDVideoGround> ohd_video_ground = nullptr;
+    startup.add_step("telemetry", {}, [&ohdTelemetry, &profile]() {
+      ohdTelemetry = std::make_shared<OHDTelemetry>(profile);
+    });
+    // ohdInterface discovers detected wifi cards and more.
+    startup.add_step("interface", {}, [&ohdInterface, &profile]() {
+      ohdInterface = std::make_shared<OHDInterface>(profile);
+    });
+    // now telemetry can send / receive data via wifibroadcast
+    startup.add_step("telemetry_link", {"telemetry", "interface"},
+                     [&ohdTelemetry, &ohdInterface]() {
+                       ohdTelemetry->set_link_handle(
+                           ohdInterface->get_link_handle());
+                     });
+    std::string video_step;
     if (profile.is_ground()) {
-      ohd_video_ground =
-          std::make_unique<OHDVideoGround>(ohdInterface->get_link_handle());
+      video_step = "video_ground";
+      startup.add_step(video_step, {"interface"},
+                       [&ohd_video_ground, &ohdInterface]() {
+                         ohd_video_ground = std::make_unique<OHDVideoGround>(
+                             ohdInterface->get_link_handle());
+                       });
     }
 #ifdef ENABLE_AIR
-    std::unique_ptr<OHDVideoAir> ohd_video_air = nullptr;
+    std::vector<XCamera> cameras;
     if (profile.is_air) {
-      auto cameras = OHDVideoAir::discover_cameras();
-      ohd_video_air = std::make_unique<OHDVideoAir>(
-          cameras, ohdInterface->get_link_handle());
-      // First add camera specific settings (primary & secondary camera)
-      auto settings_components = ohd_video_air->get_all_camera_settings();
-      ohdTelemetry->add_settings_camera_component(0, settings_components[0]);
-      ohdTelemetry->add_settings_camera_component(1, settings_components[1]);
-      // Then the rest
-      ohdTelemetry->add_settings_generic(ohd_video_air->get_generic_settings());
+      startup.add_step("gstreamer_init", {},
+                       []() { OHDVideoAir::preload_gstreamer(); });
+      startup.add_step("camera_discovery", {}, [&cameras]() {
+        cameras = OHDVideoAir::discover_cameras();
+      });
+      video_step = "video_air";
+      startup.add_step(
+          video_step, {"interface", "camera_discovery", "gstreamer_init"},
+          [&ohd_video_air, &cameras, &ohdInterface]() {
+            ohd_video_air = std::make_unique<OHDVideoAir>(
+                cameras, ohdInterface->get_link_handle());
+          });
     }
 #endif  // ENABLE_AIR
-    // We do not add any more settings to ohd telemetry - the param set(s) are
-    // complete
-    ohdTelemetry->settings_generic_ready();
-    // now telemetry can send / receive data via wifibroadcast
-    ohdTelemetry->set_link_handle(ohdInterface->get_link_handle());
+    // Telemetry allows changing all settings (even from other modules)
+    std::vector<std::string> telemetry_settings_deps{"telemetry_link"};
+    if (!video_step.empty()) telemetry_settings_deps.push_back(video_step);
+    startup.add_step("telemetry_settings", telemetry_settings_deps, [&]() {
+      ohdTelemetry->add_settings_generic(ohdInterface->get_all_settings());
+#ifdef ENABLE_AIR
+      if (ohd_video_air) {
+        // First add camera specific settings (primary & secondary camera)
+        auto settings_components = ohd_video_air->get_all_camera_settings();
+        ohdTelemetry->add_settings_camera_component(0, settings_components[0]);
+        ohdTelemetry->add_settings_camera_component(1, settings_components[1]);
+        // Then the rest
+        ohdTelemetry->add_settings_generic(
+            ohd_video_air->get_generic_settings());
+      }
+#endif  // ENABLE_AIR
+      // We do not add any more settings to ohd telemetry - the param set(s)
+      // are complete
+      ohdTelemetry->settings_generic_ready();
+    });
+    startup.run();
+    startup.log_summary();
+    // Memory budget, rss and (debug builds) allocations per startup step
+    openhd::memory::log_report();
+    if (options.boot_trace_file.has_value()) {
+      startup.write_chrome_trace(options.boot_trace_file.value());
+    }
     std::cout << green << "OpenHD was successfully started." << reset << std::endl;
     openhd::LEDManager::instance().set_status_okay();
     // run forever, everything has its own threads. Note that the only way to
@@ -333,8 +401,16 @@ int main(int argc, char *argv[]) {
       quit = true;
     });
     const auto run_time_begin = std::chrono::steady_clock::now();
+    // Which threads use the cpu - useful when tuning the thread policy
+    openhd::thread::ThreadCpuMonitor thread_cpu_monitor{};
+    thread_cpu_monitor.sample();
+    int n_loops = 0;
     while (!quit) {
       std::this_thread::sleep_for(std::chrono::seconds(2));
+      if (++n_loops % 15 == 0) {
+        m_console->debug("{}", openhd::thread::ThreadCpuMonitor::to_string(
+                                   thread_cpu_monitor.sample()));
+      }
       if (options.run_time_seconds >= 1) {
         if (std::chrono::steady_clock::now() - run_time_begin >=
             std::chrono::seconds(options.run_time_seconds)) {
@@ -392,6 +468,8 @@ int main(int argc, char *argv[]) {
     std::cerr << "Unknown exception occurred" << std::endl;
     exit(1);
   }
+  // Make sure all settings changes made during this run hit the disk
+  openhd::SettingsWriteBack::instance().flush();
   openhd::remove_currently_running_file();
   return 0;
 }
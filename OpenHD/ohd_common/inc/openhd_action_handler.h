@@ -24,6 +24,7 @@
 #ifndef OPENHD_OPENHD_OHD_COMMON_OPENHD_ACTION_HANDLER_HPP_
 #define OPENHD_OPENHD_OHD_COMMON_OPENHD_ACTION_HANDLER_HPP_
 
+#include <array>
 #include <atomic>
 #include <functional>
 #include <map>
@@ -75,8 +76,8 @@ class ArmingStateHelper {
       openhd::log::create_or_get("ArmingStateHelper");
 };
 
-// In (only one) place right now we need to react to changes on the RC channels
-// the FC reports
+// In a few places we need to react to changes on the RC channels the FC
+// reports (mcs index, gpio control)
 class FCRcChannelsHelper {
  public:
   FCRcChannelsHelper() = default;
@@ -90,10 +91,18 @@ class FCRcChannelsHelper {
   // Works well on Ardupilot, which broadcasts the proper telem message by
   // default
   void update_rc_channels(const std::array<int, 18>& rc_channels);
-  void action_on_any_rc_channel_register(ACTION_ON_ANY_RC_CHANNEL_CB cb);
+  /**
+   * Register a listener that is called (from the telemetry thread) with every
+   * rc channels update
+   * @param tag needs to be a unique tag (per all submodules)
+   */
+  void register_listener(const std::string& tag,
+                         ACTION_ON_ANY_RC_CHANNEL_CB cb);
+  void unregister_listener(const std::string& tag);
 
  private:
-  std::shared_ptr<ACTION_ON_ANY_RC_CHANNEL_CB> m_action_rc_channel = nullptr;
+  std::mutex m_cbs_mutex;
+  std::map<std::string, ACTION_ON_ANY_RC_CHANNEL_CB> m_cbs;
 };
 
 class LinkActionHandler {
@@ -236,6 +245,57 @@ class LinkActionHandler {
   CamInfo m_cam_info_cam2{};
   std::mutex m_cam_info_cam1_mutex;
   std::mutex m_cam_info_cam2_mutex;
+  // Per video stream tx feedback. Written by wb_link (air) in regular
+  // intervals, read by ohd_video to split the link bandwidth between primary
+  // and secondary camera
+ public:
+  struct VideoTxFeedback {
+    int measured_encoder_bitrate_kbits = 0;
+    // Highest tx queue fill level seen since the last update
+    int tx_queue_fill_perc = 0;
+    // Monotonically increasing (until the link is re-created)
+    int n_dropped_frames_total = 0;
+  };
+  void set_video_tx_feedback(int stream_index, VideoTxFeedback feedback) {
+    if (stream_index < 0 || stream_index > 1) return;
+    std::lock_guard<std::mutex> lock(m_video_tx_feedback_mutex);
+    m_video_tx_feedback[stream_index] = feedback;
+  }
+  VideoTxFeedback get_video_tx_feedback(int stream_index) {
+    if (stream_index < 0 || stream_index > 1) return {};
+    std::lock_guard<std::mutex> lock(m_video_tx_feedback_mutex);
+    return m_video_tx_feedback[stream_index];
+  }
+
+ private:
+  std::mutex m_video_tx_feedback_mutex;
+  std::array<VideoTxFeedback, 2> m_video_tx_feedback{};
+  // Low latency (opus) audio playout on the ground. Written by the ground
+  // video / audio forwarding in regular intervals, published via mavlink by
+  // telemetry OHDMainComponent.
+ public:
+  struct AudioPlayoutStats {
+    bool active = false;  // Only while we receive batched audio
+    // lost + late packets at playout time, since the last update
+    int loss_perc = 0;
+    // capture on air to playout on ground
+    int mouth_to_ear_avg_us = 0;
+    int mouth_to_ear_max_us = 0;
+    // current (adaptive) jitter margin of the playout buffer
+    int target_margin_us = 0;
+  };
+  void set_audio_playout_stats(AudioPlayoutStats stats) {
+    std::lock_guard<std::mutex> lock(m_audio_playout_stats_mutex);
+    m_audio_playout_stats = stats;
+  }
+  AudioPlayoutStats get_audio_playout_stats() {
+    std::lock_guard<std::mutex> lock(m_audio_playout_stats_mutex);
+    return m_audio_playout_stats;
+  }
+
+ private:
+  std::mutex m_audio_playout_stats_mutex;
+  AudioPlayoutStats m_audio_playout_stats{};
   // LINK STATISTICS
   // Written by wb_link, published via mavlink by telemetry OHDMainComponent
  private:
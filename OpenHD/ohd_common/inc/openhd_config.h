@@ -43,6 +43,9 @@ struct Config {
   bool WIFI_LOCAL_NETWORK_ENABLE = false;
   std::string WIFI_LOCAL_NETWORK_SSID;
   std::string WIFI_LOCAL_NETWORK_PASSWORD;
+  std::string WIFI_PCAP_RECORD_DIRECTORY;
+  int WIFI_PCAP_RECORD_FILE_SIZE_MB = 32;
+  int WIFI_PCAP_RECORD_N_FILES = 8;
 
   // NETWORKING
   std::string NW_ETHERNET_CARD = RPI_ETHERNET_ONLY;
@@ -54,6 +57,8 @@ struct Config {
   std::string AIR_UNIT_IP = "";
   int VIDEO_PORT = 5000;
   int TELEMETRY_PORT = 5600;
+  bool ETH_FEC_ENABLE = false;
+  int ETH_FEC_PERCENTAGE = 20;
 
   // ETHERNET LINK FOR MICROHARD
   bool DISABLE_MICROHARD_DETECTION = false;
@@ -70,6 +75,18 @@ struct Config {
   bool GEN_ENABLE_LAST_KNOWN_POSITION = false;
   int GEN_RF_METRICS_LEVEL = 0;
   bool GEN_NO_QOPENHD_AUTOSTART = false;
+  int GEN_METRICS_PORT = 0;
+  bool GEN_THREAD_POLICY_ENABLE = false;
+  int GEN_THREAD_RT_PRIORITY_VIDEO = 40;
+  int GEN_THREAD_RT_PRIORITY_RC = 50;
+  int GEN_THREAD_MLOCKALL = -1;
+  int GEN_MEMORY_BUDGET_MB = 0;
+  int GEN_THERMAL_GOVERNOR_ENABLE = -1;
+  int GEN_THERMAL_SETPOINT_SOC_C = 80;
+  int GEN_THERMAL_SETPOINT_WIFI_CARD_C = 85;
+  int GEN_VIDEO_TX_MAX_FRAME_AGE_MS = 100;
+  bool GEN_STATS_COMPACT = false;
+  int GEN_TELEMETRY_DOWNLINK_KBITS = 64;
 };
 
 // Otherwise, default location is used
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_HOTPLUG_H
+#define OPENHD_OPENHD_HOTPLUG_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+namespace openhd {
+
+/**
+ * Event-driven hardware / network discovery.
+ * Listens on the kernel netlink sockets (rtnetlink link, ipv4 address and
+ * route changes, and the kobject uevents for net and video4linux devices)
+ * and dispatches typed events to subscribers.
+ * Discovery code (wifi cards, usb cameras, usb tethering, ethernet) uses
+ * wait_for() instead of sleep-polling, such that it reacts as soon as the
+ * hardware is ready instead of on the next poll period.
+ * If the netlink sockets cannot be opened (e.g. in a container), wait_for()
+ * falls back to re-checking its condition periodically.
+ */
+class HotplugMonitor {
+ public:
+  enum class EventType {
+    LINK_NEW,  // Interface appeared or changed its flags (see is_up)
+    LINK_DEL,
+    ADDR_NEW,
+    ADDR_DEL,
+    ROUTE_NEW,
+    ROUTE_DEL,
+    DEVICE_ADD,  // kobject uevent
+    DEVICE_REMOVE,
+    DEVICE_CHANGE
+  };
+  struct Event {
+    EventType type;
+    // rtnetlink events
+    int if_index = 0;
+    // e.g. wlan0 (empty if the index cannot be resolved)
+    std::string interface_name;
+    // LINK_NEW: IFF_UP and IFF_RUNNING
+    bool is_up = false;
+    // ADDR_*: the ipv4 address, ROUTE_*: the gateway (default route only)
+    std::string address;
+    // uevent events, e.g. "net" or "video4linux"
+    std::string subsystem;
+    // e.g. video0
+    std::string devname;
+    std::string devpath;
+  };
+  typedef std::function<void(const Event& event)> EVENT_CALLBACK;
+  // @param open_netlink_sockets: false for testing (only injected events)
+  explicit HotplugMonitor(bool open_netlink_sockets = true);
+  ~HotplugMonitor();
+  HotplugMonitor(const HotplugMonitor&) = delete;
+  HotplugMonitor(const HotplugMonitor&&) = delete;
+  static HotplugMonitor& instance();
+  // Returns an id for unsubscribe. Callbacks are called from the monitor
+  // thread and should not block.
+  int subscribe(EVENT_CALLBACK callback);
+  void unsubscribe(int id);
+  /**
+   * Blocks until @param condition returns true or @param timeout elapsed.
+   * The condition is evaluated once immediately, then again on each event.
+   * Use std::chrono::milliseconds::max() to wait forever.
+   * Returns the last result of condition.
+   */
+  bool wait_for(const std::function<bool()>& condition,
+                std::chrono::milliseconds timeout);
+  /**
+   * Blocks until @param interface_name has a default route (e.g. once dhcp
+   * answered), @param abort returns true or @param timeout elapsed.
+   * Routes that already exist are read once from /proc/net/route, after that
+   * the gateway is taken from the ROUTE_NEW event.
+   * Returns the gateway ip, std::nullopt on abort / timeout.
+   */
+  std::optional<std::string> wait_for_gateway(
+      const std::string& interface_name, const std::function<bool()>& abort,
+      std::chrono::milliseconds timeout);
+  // Re-evaluate the condition of all waiters now, e.g. after setting a
+  // terminate flag the condition checks.
+  void interrupt_waiters();
+  // For testing - parse and dispatch as if it was received from the kernel
+  void inject_rtnetlink_message(const uint8_t* data, int data_len);
+  void inject_uevent_message(const char* data, int data_len);
+  static std::vector<Event> parse_rtnetlink_message(const uint8_t* data,
+                                                    int data_len);
+  // Returns std::nullopt for messages that are not kernel uevents, or uevents
+  // of a subsystem we don't care about
+  static std::optional<Event> parse_uevent_message(const char* data,
+                                                   int data_len);
+  static std::string event_type_to_string(EventType type);
+  // Gateway of the default route of @param interface_name in the
+  // /proc/net/route layout, std::nullopt if there is none
+  static std::optional<std::string> parse_proc_net_route_gateway(
+      const std::string& proc_net_route, const std::string& interface_name);
+
+ private:
+  std::shared_ptr<spdlog::logger> m_console;
+  int m_rtnetlink_fd = -1;
+  int m_uevent_fd = -1;
+  // Written to on destruction to wake up the monitor thread
+  int m_wakeup_fd = -1;
+  std::atomic<bool> m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+  std::mutex m_subscribers_mutex;
+  std::map<int, EVENT_CALLBACK> m_subscribers;
+  int m_next_subscriber_id = 0;
+  // Incremented on each event, waiters re-check their condition on change
+  std::mutex m_wait_mutex;
+  std::condition_variable m_wait_cv;
+  uint64_t m_event_seq = 0;
+  void loop();
+  void dispatch(const Event& event);
+  bool has_netlink() const;
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_HOTPLUG_H
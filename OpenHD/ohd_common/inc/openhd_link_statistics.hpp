@@ -95,6 +95,15 @@ struct Xmavlink_openhd_stats_wb_video_air_t {
   int16_t dummy1;                   /*<  for future use*/
   uint8_t link_index;               /*<  link_index*/
   int8_t dummy0;                    /*<  for future use*/
+  // extra - air thermal protection, not (yet) part of the mavlink message.
+  // Sent in the otherwise unused fields (see pack_vid_air):
+  // dummy0: thermal_protection_level (0 none, 1 rate reduced, 2 video off)
+  // dummy1: thermal_hottest_temp_c
+  // dummy2: thermal_tx_power_perc << 8 | thermal_bitrate_perc
+  uint8_t thermal_protection_level;
+  int16_t thermal_hottest_temp_c;
+  uint8_t thermal_tx_power_perc;  // [0..100] of the configured tx power
+  uint8_t thermal_bitrate_perc;   // [0..100] of the recommended bitrate
 };
 struct Xmavlink_openhd_stats_wb_video_air_fec_performance_t {
   uint32_t curr_fec_encode_time_avg_us; /*<  curr_fec_encode_time_avg_us*/
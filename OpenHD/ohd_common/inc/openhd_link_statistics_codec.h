@@ -0,0 +1,139 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_LINK_STATISTICS_CODEC_H
+#define OPENHD_OPENHD_LINK_STATISTICS_CODEC_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "openhd_link_statistics.hpp"
+
+/**
+ * Compact encoding of the air link statistics for the telemetry downlink.
+ * Instead of one mavlink message per card / video stream / ..., all fields
+ * (the ones the mavlink stats messages carry) are flattened into one list and
+ * sent in a single message:
+ * - A keyframe carries all values (zigzag varint). Sent periodically, and
+ *   whenever the layout (active cards, number of video streams) changes.
+ *   Split into parts if it doesn't fit into one message.
+ * - A delta only carries the fields that differ from the last keyframe, as
+ *   (index gap, value - keyframe value) varint pairs. Since it only depends on
+ *   the keyframe (not on the previous delta), a lost message doesn't break
+ *   the following ones. Nothing is sent if nothing changed since the last
+ *   message (but at least every max_interval).
+ * The send interval adapts to the telemetry bandwidth available for stats.
+ * The ground rebuilds the full stats from it (and packs the regular mavlink
+ * messages for the ground station clients).
+ */
+namespace openhd::link_statistics {
+
+// Payload of one message is never bigger than this
+static constexpr int COMPACT_STATS_MAX_PAYLOAD = 248;
+
+struct StatsEncoderConfig {
+  std::chrono::milliseconds min_interval{200};
+  std::chrono::milliseconds max_interval{2000};
+  std::chrono::milliseconds keyframe_interval{5000};
+  // Added per message when calculating the bandwidth used (mavlink header,
+  // crc, ...)
+  int message_overhead_bytes = 20;
+};
+
+struct StatsCodecCounters {
+  int n_keyframes = 0;
+  int n_deltas = 0;
+  int64_t n_bytes = 0;
+};
+
+class StatsEncoder {
+ public:
+  explicit StatsEncoder(StatsEncoderConfig config = {});
+  // Returns the message payload(s) to send now, empty if it is not yet time /
+  // nothing changed. Only air stats (cards, link, telemetry, video air, air
+  // fec performance) are encoded.
+  std::vector<std::vector<uint8_t>> encode(
+      const StatsAirGround& stats, std::chrono::steady_clock::time_point now =
+                                       std::chrono::steady_clock::now());
+  // Telemetry bandwidth (bits per second) the stats may use, the interval is
+  // chosen such that the average message size fits in.
+  void set_available_bps(int available_bps);
+  std::chrono::milliseconds get_curr_interval() const;
+  // Bits per second the stats currently use
+  int get_curr_bps() const;
+  StatsCodecCounters get_counters() const;
+
+ private:
+  const StatsEncoderConfig m_config;
+  int m_available_bps = 0;
+  std::chrono::milliseconds m_curr_interval;
+  float m_avg_message_bytes = 0;
+  uint8_t m_layout = 0;
+  uint8_t m_keyframe_id = 0;
+  bool m_has_keyframe = false;
+  std::vector<int64_t> m_keyframe;
+  std::vector<int64_t> m_last_sent;
+  std::chrono::steady_clock::time_point m_last_keyframe{};
+  std::chrono::steady_clock::time_point m_last_message{};
+  StatsCodecCounters m_counters{};
+};
+
+class StatsDecoder {
+ public:
+  // Returns the full stats if the message could be decoded (a delta needs the
+  // keyframe it refers to, a keyframe all its parts)
+  std::optional<StatsAirGround> decode(const uint8_t* data, int data_len);
+  StatsCodecCounters get_counters() const;
+
+ private:
+  uint8_t m_layout = 0;
+  uint8_t m_keyframe_id = 0;
+  bool m_has_keyframe = false;
+  std::vector<int64_t> m_keyframe;
+  // Parts of the keyframe currently being received
+  std::vector<int64_t> m_pending;
+  uint8_t m_pending_id = 0;
+  uint8_t m_pending_layout = 0;
+  uint16_t m_pending_parts_mask = 0;
+  StatsCodecCounters m_counters{};
+};
+
+// True if the given message (payload) is (part of) a keyframe
+bool is_keyframe(const std::vector<uint8_t>& message);
+
+// Exposed for testing
+// All encoded fields of the given stats, in the order they are encoded
+std::vector<int64_t> stats_to_values(const StatsAirGround& stats);
+void write_varint(std::vector<uint8_t>& buff, uint64_t value);
+std::optional<uint64_t> read_varint(const uint8_t* data, int data_len,
+                                    int& offset);
+uint64_t zigzag_encode(int64_t value);
+int64_t zigzag_decode(uint64_t value);
+
+}  // namespace openhd::link_statistics
+
+#endif  // OPENHD_OPENHD_LINK_STATISTICS_CODEC_H
@@ -0,0 +1,156 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_MEMORY_H
+#define OPENHD_MEMORY_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Memory budget of OpenHD.
+ * On 512MB boards (e.g. pi zero 2 w) we cannot use the queue / buffer sizes
+ * that are fine on a desktop ground station. All queues, pools and buffers
+ * that scale with the available memory are sized from one budget
+ * (GEN_MEMORY_BUDGET_MB in hardware.config, 0 = derived from the RAM size).
+ *
+ * In debug builds (OPENHD_MEMORY_TRACKING) operator new / delete are replaced
+ * by a tracking allocator that accounts each allocation to the subsystem
+ * (ScopedSubsystem) of the allocating thread, such that the startup report
+ * shows who is using the memory.
+ */
+namespace openhd::memory {
+
+struct Budget {
+  int budget_mb = 0;
+  // Receive buffer of each UDPReceiver / connected TCP client
+  int udp_rx_buffer_bytes = 0;
+  int tcp_rx_buffer_bytes = 0;
+  // Further clients are rejected
+  int tcp_max_clients = 0;
+  // wifibroadcast telemetry rx / tx queue (packets) on the ground, air uses
+  // the inverse (rx half, tx full)
+  int wb_tele_queue_packets = 0;
+  int wb_audio_queue_packets = 0;
+  // Air video frames waiting for the wifibroadcast tx (see VideoTxQueue)
+  int video_tx_queue_frames = 0;
+  // Ethernet link FEC
+  int eth_fec_max_blocks_in_flight = 0;
+  // Video fragment buffers kept for re-use (see BufferPool)
+  int fragment_pool_n_buffers = 0;
+  // wifibroadcast pcap recorder
+  int pcap_file_buffer_bytes = 0;
+  int pcap_socket_rcvbuf_bytes = 0;
+  std::string to_string() const;
+};
+
+// At / below the low budget we use the minimum sizes, at / above the full
+// budget the ones for a desktop ground station. Interpolated in between.
+static constexpr int LOW_BUDGET_MB = 16;
+static constexpr int FULL_BUDGET_MB = 128;
+Budget create_budget(int budget_mb);
+// Default if not set in hardware.config, 1/16 of the RAM
+int budget_mb_for_ram(int64_t ram_bytes);
+// Created on first use
+const Budget& get_budget();
+// Use the given budget instead of hardware.config / RAM size. Only has an
+// effect if called before the first get_budget() (early in main, in tests).
+void set_budget_mb(int budget_mb);
+
+struct ProcessMemory {
+  // VmRSS / VmHWM from /proc/self/status, -1 if not available
+  int64_t rss_kb = -1;
+  int64_t peak_rss_kb = -1;
+};
+ProcessMemory get_process_memory();
+// Resets the peak rss (VmHWM) to the current rss. Returns false if not
+// supported by the kernel.
+bool reset_peak_rss();
+
+// True if operator new / delete are tracked (debug builds)
+bool is_tracking_enabled();
+struct SubsystemUsage {
+  std::string name;
+  int64_t current_bytes;
+  int64_t peak_bytes;
+  uint64_t n_allocations;
+};
+// Empty if tracking is disabled. Highest current usage first.
+std::vector<SubsystemUsage> get_subsystem_usage();
+
+/**
+ * While in scope, all allocations of the calling thread are accounted to the
+ * given subsystem (not the current one, allocations from threads created in
+ * the scope end up in "other"). No-op if tracking is disabled.
+ */
+class ScopedSubsystem {
+ public:
+  explicit ScopedSubsystem(const std::string& name);
+  ~ScopedSubsystem();
+  ScopedSubsystem(const ScopedSubsystem&) = delete;
+  ScopedSubsystem(const ScopedSubsystem&&) = delete;
+
+ private:
+  int m_previous;
+};
+
+// Budget, process rss and (if tracking) per subsystem usage
+std::string create_report();
+void log_report();
+
+/**
+ * Keeps (up to max_n_buffers) packet buffers for re-use instead of
+ * allocating / freeing a new one for each (video) fragment, which fragments
+ * the heap on small boards.
+ * The pool owns its buffers (shared_ptr, created once). A buffer is handed out
+ * again once the pool holds the only reference - re-using one allocates
+ * neither the buffer nor a shared_ptr control block.
+ */
+class BufferPool {
+ public:
+  static std::shared_ptr<BufferPool> create(int max_n_buffers);
+  // Copy of the given data. The buffer can be re-used once the last reference
+  // (other than the pool) is gone - thread safe, the pool can be gone by then.
+  // If all buffers are in use, a non-pooled one is returned.
+  std::shared_ptr<std::vector<uint8_t>> acquire(const uint8_t* data,
+                                                int data_len);
+  int get_n_free_buffers();
+  uint64_t get_n_reused();
+
+ private:
+  explicit BufferPool(int max_n_buffers);
+  const int m_max_n_buffers;
+  std::mutex m_mutex;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> m_buffers;
+  // Buffers are mostly released in the order they were acquired - start
+  // looking for a free one after the last one handed out
+  size_t m_next = 0;
+  uint64_t m_n_reused = 0;
+};
+
+}  // namespace openhd::memory
+
+#endif  // OPENHD_MEMORY_H
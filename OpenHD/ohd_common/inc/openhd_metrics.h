@@ -0,0 +1,221 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_METRICS_H
+#define OPENHD_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Metrics registry (counters, gauges, histograms) that can be scraped in the
+ * Prometheus text format.
+ * Recording is lock- and allocation-free: Counters and histograms are sharded
+ * (one cache line per shard) and only summed up on scrape. Each recording
+ * thread owns a shard exclusively (returned when the thread exits), so it can
+ * record without a (locked) read-modify-write. Only if there are more threads
+ * than shards, the remaining threads share the last shard and use atomic adds.
+ * Registration (looking up a metric by name) takes a lock and allocates, so
+ * look up once and keep the reference - the registry never frees a metric.
+ */
+namespace openhd::metrics {
+
+static constexpr int N_SHARDS = 32;
+static constexpr int SHARED_SHARD = N_SHARDS - 1;
+
+// Owned by the calling thread until it exits
+class ThreadShard {
+ public:
+  ThreadShard();
+  ~ThreadShard();
+  const int index;
+};
+inline int get_thread_shard() {
+  thread_local const ThreadShard shard{};
+  return shard.index;
+}
+
+template <typename T>
+inline void shard_add(std::atomic<T>& value, T n, int shard) {
+  if (shard != SHARED_SHARD) {
+    // We are the only writer
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  } else {
+    value.fetch_add(n, std::memory_order_relaxed);
+  }
+}
+
+// Labels as key-value pairs, e.g. {{"stream","0"}}
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+class Counter {
+ public:
+  void add(uint64_t n = 1) {
+    const int shard = get_thread_shard();
+    shard_add(m_shards[shard].value, n, shard);
+  }
+  uint64_t get() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  std::array<Shard, N_SHARDS> m_shards{};
+};
+
+// Last value wins
+class Gauge {
+ public:
+  void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+  void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> m_value{0};
+};
+
+// Fixed buckets (upper bounds, inclusive) given on creation, integer values
+// (e.g. microseconds, bytes).
+class Histogram {
+ public:
+  static constexpr int MAX_BUCKETS = 24;
+  explicit Histogram(const std::vector<int64_t>& upper_bounds);
+  void record(int64_t value) {
+    // First bucket with value <= upper bound, or the +Inf bucket
+    const int bucket =
+        std::lower_bound(m_bounds.begin(), m_bounds.begin() + m_n_bounds,
+                         value) -
+        m_bounds.begin();
+    const int shard = get_thread_shard();
+    shard_add<uint64_t>(m_shards[shard].buckets[bucket], 1, shard);
+    shard_add(m_shards[shard].sum, value, shard);
+  }
+  struct Snapshot {
+    std::vector<int64_t> upper_bounds;
+    // Not cumulative, last one is +Inf
+    std::vector<uint64_t> bucket_counts;
+    uint64_t count = 0;
+    int64_t sum = 0;
+  };
+  Snapshot get() const;
+
+ private:
+  std::array<int64_t, MAX_BUCKETS> m_bounds{};
+  int m_n_bounds;
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, MAX_BUCKETS + 1> buckets{};
+    std::atomic<int64_t> sum{0};
+  };
+  std::array<Shard, N_SHARDS> m_shards{};
+};
+
+// Default buckets for latencies in microseconds (10us .. 1s)
+std::vector<int64_t> latency_buckets_us();
+
+// Records the lifetime of this object into the given histogram (in us)
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(Histogram& histogram)
+      : m_histogram(histogram), m_begin(std::chrono::steady_clock::now()) {}
+  ~ScopedLatency() {
+    m_histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - m_begin)
+                           .count());
+  }
+
+ private:
+  Histogram& m_histogram;
+  const std::chrono::steady_clock::time_point m_begin;
+};
+
+class Registry {
+ public:
+  static Registry& instance();
+  // Returns the existing metric if name and labels match. Names should
+  // follow the Prometheus conventions (openhd_ prefix, unit suffix).
+  Counter& counter(const std::string& name, const std::string& help,
+                   const Labels& labels = {});
+  Gauge& gauge(const std::string& name, const std::string& help,
+               const Labels& labels = {});
+  Histogram& histogram(const std::string& name, const std::string& help,
+                       const std::vector<int64_t>& upper_bounds,
+                       const Labels& labels = {});
+  // Prometheus text exposition format (version 0.0.4)
+  std::string to_prometheus_text();
+
+ private:
+  enum class Type { COUNTER, GAUGE, HISTOGRAM };
+  struct Family {
+    Type type;
+    std::string help;
+    // label string -> metric
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+  std::mutex m_mutex;
+  std::map<std::string, Family> m_families;
+  Family& get_family(const std::string& name, const std::string& help,
+                     Type type);
+};
+
+/**
+ * Serves the registry in the prometheus text format on localhost via HTTP
+ * (GET of any path) and / or on a unix socket (the response is the same).
+ */
+class MetricsServer {
+ public:
+  // tcp_port: 0 to disable, unix_socket_path: empty to disable
+  explicit MetricsServer(int tcp_port, std::string unix_socket_path = "");
+  ~MetricsServer();
+  MetricsServer(const MetricsServer&) = delete;
+  MetricsServer(const MetricsServer&&) = delete;
+  // For tests, the actual port if tcp_port was -1 (ephemeral)
+  int get_tcp_port() const { return m_tcp_port; }
+
+ private:
+  int m_tcp_port;
+  const std::string m_unix_socket_path;
+  int m_tcp_fd = -1;
+  int m_unix_fd = -1;
+  int m_wakeup_fd = -1;
+  std::atomic<bool> m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+  void loop();
+  static void handle_client(int fd);
+};
+
+}  // namespace openhd::metrics
+
+#endif  // OPENHD_METRICS_H
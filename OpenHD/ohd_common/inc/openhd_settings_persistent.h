@@ -25,8 +25,15 @@
 #define OPENHD_OPENHD_OHD_COMMON_OPENHD_SETTINGS_PERSISTENT_HPP_
 
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <utility>
 
 #include "openhd_spdlog.h"
@@ -38,6 +45,77 @@
  */
 namespace openhd {
 
+/**
+ * Settings are changed from the mavlink param callback(s) - a burst of
+ * parameter changes (e.g. QOpenHD writing many parameters at once) would
+ * otherwise result in dozens of synchronous re-writes of the same file(s) on
+ * the SD card.
+ * This service debounces and coalesces the writes per file (only the latest
+ * content is written), skips writes that wouldn't change the file content, and
+ * writes atomically (temp file + fsync + rename), such that a power cut
+ * mid-write leaves either the old or the new file, but never a torn one.
+ */
+class SettingsWriteBack {
+ public:
+  struct Options {
+    // A write is delayed until there was no change to the same file for this
+    // long
+    std::chrono::milliseconds debounce = std::chrono::milliseconds(200);
+    // But not longer than this after the first pending change
+    std::chrono::milliseconds max_delay = std::chrono::milliseconds(2000);
+  };
+  struct Stats {
+    int n_requests = 0;
+    // Actual writes to the file system
+    int n_writes = 0;
+    // Replaced by a newer request for the same file before being written
+    int n_coalesced = 0;
+    // Content unchanged
+    int n_skipped_unchanged = 0;
+    int n_failed = 0;
+  };
+  explicit SettingsWriteBack(Options options);
+  // Flushes
+  ~SettingsWriteBack();
+  SettingsWriteBack(const SettingsWriteBack&) = delete;
+  SettingsWriteBack(const SettingsWriteBack&&) = delete;
+  static SettingsWriteBack& instance();
+  // Schedule writing @param content to @param path (replaces any pending,
+  // not yet written content for the same path)
+  void write_async(const std::string& path, std::string content);
+  // Blocks until all pending writes are done. Needs to be called before
+  // openhd terminates / the system reboots.
+  void flush();
+  Stats get_stats();
+  // Writes to path.tmp, fsync, then renames to path.
+  // Returns false on failure, in which case the previous file is untouched.
+  static bool write_file_atomic(const std::string& path,
+                                const std::string& content);
+  static uint64_t hash_content(const std::string& content);
+
+ private:
+  struct Pending {
+    std::string content;
+    std::chrono::steady_clock::time_point first_request;
+    std::chrono::steady_clock::time_point last_request;
+  };
+  void loop();
+  // Requires m_mutex to be locked, unlocks it while writing
+  void write_pending(std::unique_lock<std::mutex>& lock, bool only_due);
+  const Options m_options;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  // Signalled once all pending writes are done
+  std::condition_variable m_cv_flushed;
+  std::map<std::string, Pending> m_pending;
+  std::map<std::string, uint64_t> m_last_written_hash;
+  // A write is in progress (outside the lock)
+  bool m_writing = false;
+  Stats m_stats{};
+  bool m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+};
+
 /**
  * Helper class to persist settings during reboots (impl is using most likely
  * json in OpenHD). Properly handles the typical edge cases, e.g. a) No settings
@@ -109,6 +187,9 @@ class PersistentSettings {
     if (!OHDFilesystemUtil::exists(_base_path)) {
       OHDFilesystemUtil::create_directory(_base_path);
     }
+    // Leftover from a write that was interrupted (e.g. power cut) - the
+    // settings file itself is still intact
+    OHDFilesystemUtil::remove_if_existing(get_file_path() + ".tmp");
     const auto last_settings_opt = read_last_settings();
     if (last_settings_opt.has_value()) {
       _settings = std::make_unique<T>(last_settings_opt.value());
@@ -139,13 +220,14 @@ class PersistentSettings {
   }
   /**
    * serialize settings to json and write to file for persistence
+   * The write itself is done (debounced and atomically) by SettingsWriteBack
    */
   void persist_settings() const {
     assert(_settings);
     const auto file_path = get_file_path();
     // Serialize, then write to file
-    const auto content = imp_serialize(*_settings);
-    OHDFilesystemUtil::write_file(file_path, content);
+    auto content = imp_serialize(*_settings);
+    SettingsWriteBack::instance().write_async(file_path, std::move(content));
   }
   /**
    * Try and deserialize the last stored settings (json)
@@ -0,0 +1,230 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_SPDLOG_ASYNC_H
+#define OPENHD_OPENHD_SPDLOG_ASYNC_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "openhd_spdlog.h"
+
+namespace spdlog::details {
+struct log_msg;
+}
+
+/**
+ * Asynchronous logging backend of all openhd loggers (create_or_get).
+ * The logging thread only formats the message (fmt, done by spdlog) and
+ * copies it into a lock-free ring. One writer thread does the (blocking)
+ * I/O: console, /dev/kmsg and the mavlink log buffer. If the ring is full
+ * (e.g. stdout is a pipe nobody reads) messages are dropped (and counted),
+ * logging never blocks. Repeated messages (same logger, same text ignoring
+ * digits) are rate limited.
+ */
+namespace openhd::log {
+
+/**
+ * Bounded lock-free multi producer single consumer ring (D. Vyukov's bounded
+ * queue, each cell has a sequence number). Producers never wait, try_push
+ * fails if the ring is full.
+ */
+template <typename T, size_t N>
+class MpscRing {
+ public:
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N needs to be a power of 2");
+  MpscRing() {
+    for (size_t i = 0; i < N; i++) {
+      m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpscRing(const MpscRing&) = delete;
+  MpscRing(const MpscRing&&) = delete;
+  // fill(T&) is called with the reserved cell, returns false if full
+  template <typename F>
+  bool try_push(F&& fill) {
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = m_cells[pos & (N - 1)];
+      const size_t seq = cell.seq.load(std::memory_order_acquire);
+      const auto diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          fill(cell.data);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  // Consumer only. consume(T&) is called with the oldest cell, returns false
+  // if empty
+  template <typename F>
+  bool try_pop(F&& consume) {
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    Cell& cell = m_cells[head & (N - 1)];
+    if (cell.seq.load(std::memory_order_acquire) != head + 1) return false;
+    consume(cell.data);
+    cell.seq.store(head + N, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  // Approximate if called concurrently
+  size_t size() const {
+    const size_t tail = m_tail.load(std::memory_order_acquire);
+    const size_t head = m_head.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+  }
+  // N of items ever popped (consumer position)
+  size_t get_n_popped() const {
+    return m_head.load(std::memory_order_acquire);
+  }
+  // N of items ever pushed (or reserved for pushing)
+  size_t get_n_pushed() const {
+    return m_tail.load(std::memory_order_acquire);
+  }
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+  Cell m_cells[N];
+  alignas(64) std::atomic<size_t> m_tail{0};
+  alignas(64) std::atomic<size_t> m_head{0};
+};
+
+/**
+ * Allows max_per_second messages with the same key per second, the following
+ * ones are suppressed (counted). Lock-free and approximate (keys can collide
+ * / evict each other, concurrent updates can be off by a few).
+ */
+class RateLimiter {
+ public:
+  // Hash of the logger name and the message without digits - such that
+  // "rx error 3" and "rx error 4" count as the same message
+  static uint64_t create_key(const char* logger_name, size_t logger_name_len,
+                             const char* message, size_t message_len);
+  // -1: suppress this one. Otherwise the n of messages with this key that
+  // were suppressed since the last one that was let through.
+  int64_t check(uint64_t key, int64_t now_ms);
+  // 0 disables rate limiting
+  void set_max_per_second(int max_per_second);
+  bool is_enabled() const {
+    return m_max_per_second.load(std::memory_order_relaxed) > 0;
+  }
+
+ private:
+  static constexpr int N_ENTRIES = 128;
+  struct Entry {
+    std::atomic<uint64_t> key{0};
+    std::atomic<int64_t> window_begin_ms{0};
+    std::atomic<uint32_t> n_in_window{0};
+    std::atomic<uint32_t> n_suppressed{0};
+  };
+  std::atomic<int> m_max_per_second{10};
+  Entry m_entries[N_ENTRIES];
+};
+
+class AsyncLogBackend {
+ public:
+  // Created on first use, never destroyed (loggers might still be used by
+  // other threads during exit). The remaining messages are written at exit.
+  static AsyncLogBackend& instance();
+  // The sink (shared by all loggers) that forwards into the ring
+  std::shared_ptr<spdlog::sinks::sink> get_sink();
+  // Never blocks (except level critical, which is flushed since it usually
+  // comes right before a crash)
+  void log(const spdlog::details::log_msg& msg);
+  // Written to /dev/kmsg (by the writer thread)
+  void log_to_kernel(const std::string& message);
+  // Blocks until everything logged so far has been written (or timeout)
+  void flush(std::chrono::milliseconds timeout = std::chrono::seconds(1));
+  void set_rate_limit(int max_per_second);
+  // Pattern of the console output
+  void set_pattern(const std::string& pattern);
+  struct Stats {
+    // Not suppressed by the rate limit
+    uint64_t n_logged;
+    uint64_t n_dropped_full;
+    uint64_t n_suppressed;
+    uint64_t n_written;
+  };
+  Stats get_stats() const;
+
+ private:
+  AsyncLogBackend();
+  static constexpr size_t INLINE_MESSAGE_SIZE = 216;
+  struct Entry {
+    std::chrono::system_clock::time_point time;
+    size_t thread_id;
+    int level;
+    bool to_kernel;
+    uint32_t n_suppressed;
+    uint16_t message_len;
+    char logger_name[24];
+    char message[INLINE_MESSAGE_SIZE];
+    // Only for messages that don't fit (rare), owned by the entry
+    std::string* long_message;
+  };
+  bool push(const std::chrono::system_clock::time_point& time, size_t thread_id,
+            int level, bool to_kernel, const char* logger_name,
+            size_t logger_name_len, const char* message, size_t message_len,
+            uint32_t n_suppressed);
+  void loop_write();
+  void write_entry(Entry& entry);
+  void write_to_kernel(const std::string& message);
+  MpscRing<Entry, 512> m_ring;
+  RateLimiter m_rate_limiter;
+  std::shared_ptr<spdlog::sinks::sink> m_sink;
+  // Only used by the writer (and set_pattern)
+  std::mutex m_console_mutex;
+  std::unique_ptr<spdlog::sinks::sink> m_console;
+  int m_kmsg_fd = -1;
+  bool m_kmsg_failed = false;
+  std::atomic<uint64_t> m_n_dropped_full{0};
+  std::atomic<uint64_t> m_n_suppressed{0};
+  uint64_t m_n_dropped_reported = 0;
+  std::mutex m_wake_mutex;
+  std::condition_variable m_wake_cv;
+  std::condition_variable m_written_cv;
+  std::thread::id m_writer_thread_id;
+  std::unique_ptr<std::thread> m_writer_thread;
+};
+
+}  // namespace openhd::log
+
+#endif  // OPENHD_OPENHD_SPDLOG_ASYNC_H
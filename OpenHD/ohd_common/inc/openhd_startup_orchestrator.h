@@ -0,0 +1,103 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_STARTUP_ORCHESTRATOR_H
+#define OPENHD_OPENHD_STARTUP_ORCHESTRATOR_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+namespace openhd {
+
+/**
+ * Runs the openhd startup steps (e.g. wifi card discovery, camera discovery,
+ * telemetry creation) concurrently, each one as soon as all the steps it
+ * explicitly depends on are done.
+ * Records the begin / end of each step, such that the critical path can be
+ * logged and a boot trace (chrome://tracing / perfetto json) can be written.
+ */
+class StartupOrchestrator {
+ public:
+  struct StepTiming {
+    std::string name;
+    std::vector<std::string> dependencies;
+    // Relative to the begin of run()
+    std::chrono::microseconds begin{0};
+    std::chrono::microseconds end{0};
+    // Each concurrently running step gets its own lane in the trace
+    int lane = 0;
+    bool failed = false;
+    // Not run, since a dependency failed
+    bool skipped = false;
+  };
+  explicit StartupOrchestrator(std::string tag = "startup");
+  StartupOrchestrator(const StartupOrchestrator&) = delete;
+  StartupOrchestrator(const StartupOrchestrator&&) = delete;
+  /**
+   * @param name unique name of this step
+   * @param dependencies steps that need to be done before this one starts
+   * (need to be added, too)
+   */
+  void add_step(std::string name, std::vector<std::string> dependencies,
+                std::function<void()> runnable);
+  /**
+   * Blocks until all steps are done. Throws std::runtime_error on an invalid
+   * dependency graph (unknown dependency, cycle) before running anything.
+   * If a step throws, steps depending on it are skipped and the first
+   * exception is re-thrown once all running steps are done.
+   */
+  void run();
+  // In order of begin time (valid after run)
+  std::vector<StepTiming> get_timings() const;
+  // The chain of steps that determined the total startup time, first to last
+  std::vector<std::string> get_critical_path() const;
+  std::chrono::microseconds get_total_duration() const;
+  // Chrome trace event format (complete events, one tid per lane)
+  std::string create_chrome_trace_json() const;
+  bool write_chrome_trace(const std::string& filename) const;
+  void log_summary() const;
+
+ private:
+  struct Step {
+    std::function<void()> runnable;
+    StepTiming timing;
+    bool done = false;
+  };
+  std::shared_ptr<spdlog::logger> m_console;
+  const std::string m_tag;
+  mutable std::mutex m_mutex;
+  std::map<std::string, Step> m_steps;
+  std::vector<std::string> m_insertion_order;
+  std::chrono::microseconds m_total_duration{0};
+  void validate() const;
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_STARTUP_ORCHESTRATOR_H
@@ -77,6 +77,9 @@ class TCPServer {
   int server_fd = 0;
   static constexpr const size_t READ_BUFF_SIZE = 65507;
   void loop_accept();
+  // Joins the rx thread / closes the socket of clients that are gone,
+  // returns the n of remaining clients
+  int remove_disconnected_clients();
 
  private:
   struct ConnectedClient {
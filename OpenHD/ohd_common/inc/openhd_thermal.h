@@ -24,9 +24,107 @@
 #ifndef OPENHD_OPENHD_THERMAL_H
 #define OPENHD_OPENHD_THERMAL_H
 
-namespace openhd {
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
-int x20_read_rtl8812au_thermal_sensor_degree();
-}
+/**
+ * Platform independent thermal protection.
+ * Sensors are discovered in sysfs (thermal zones and hwmon devices, the latter
+ * also exposed by wifi card drivers) and classified as SoC or wifi card.
+ * The governor is a proportional controller: for each class, the throttle goes
+ * from 0 to 1 while the (smoothed) temperature goes from setpoint-band to the
+ * setpoint, such that the temperature settles at or below the setpoint where
+ * the throttle balances the heat. The throttle is then mapped to the
+ * actuators - less tx power (wifi card only) and less bitrate, aka using less
+ * of the capacity of the current MCS (both), down to a minimum instead of
+ * disabling video. Only above the critical temperature video is disabled,
+ * until cooled down below setpoint-band.
+ * The governor itself has no I/O, such that it can be tested with a simulated
+ * thermal model.
+ */
+namespace openhd::thermal {
+
+enum class SensorType { SOC, WIFI_CARD, OTHER };
+std::string sensor_type_to_string(SensorType type);
+
+struct Sensor {
+  // e.g. "thermal_zone0:cpu-thermal" or "hwmon3:rtl88x2bu"
+  std::string name;
+  // file with the temperature in milli degree celsius
+  std::string temp_path;
+  SensorType type;
+};
+
+// Searches the thermal zones and hwmon devices under the given sysfs class
+// directory (parameter for testing).
+std::vector<Sensor> discover_sensors(
+    const std::string& sysfs_class_path = "/sys/class");
+std::string sensors_to_string(const std::vector<Sensor>& sensors);
+
+std::optional<int> read_temperature_millidegree(const Sensor& sensor);
+
+struct GovernorConfig {
+  int setpoint_soc_c = 80;
+  int setpoint_wifi_card_c = 85;
+  // Throttle goes from 0 to 1 over that many degrees below the setpoint
+  int proportional_band_c = 10;
+  // Video is disabled at setpoint + this
+  int critical_offset_c = 10;
+  // At full throttle
+  double min_tx_power_factor = 0.25;
+  double min_bitrate_factor = 0.3;
+  // Smoothing of the temperature per update (1 = none)
+  double temperature_smoothing = 0.3;
+  // Going up is immediate, coming down is limited to this per update to not
+  // oscillate
+  double max_throttle_decrease_per_update = 0.05;
+};
+
+struct GovernorState {
+  // Smoothed, of the sensor closest to / furthest above its setpoint
+  int hottest_temp_c = 0;
+  std::string hottest_sensor;
+  double throttle_soc = 0;
+  double throttle_wifi_card = 0;
+  // Multiply the tx power / encoder bitrate with these
+  double tx_power_factor = 1.0;
+  double bitrate_factor = 1.0;
+  bool video_disabled = false;
+};
+std::string governor_state_to_string(const GovernorState& state);
+
+struct SensorReading {
+  std::string name;
+  SensorType type;
+  int temperature_millidegree;
+};
+
+class Governor {
+ public:
+  explicit Governor(GovernorConfig config = {});
+  Governor(const Governor&) = delete;
+  Governor(const Governor&&) = delete;
+  // Call in regular intervals (~1s) with the current readings
+  GovernorState update(const std::vector<SensorReading>& readings);
+  GovernorState get_state();
+  const GovernorConfig& get_config() const { return m_config; }
+
+ private:
+  const GovernorConfig m_config;
+  std::mutex m_mutex;
+  GovernorState m_state{};
+  // Smoothed temperature per sensor
+  std::vector<std::pair<std::string, double>> m_smoothed;
+  double update_smoothed(const std::string& name, double temperature);
+  double update_throttle(double curr, double target) const;
+};
+
+// Reads all sensors
+std::vector<SensorReading> read_sensors(const std::vector<Sensor>& sensors);
+
+}  // namespace openhd::thermal
 
 #endif  // OPENHD_OPENHD_THERMAL_H
@@ -0,0 +1,115 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_THREAD_POLICY_H
+#define OPENHD_THREAD_POLICY_H
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Central place for the scheduling of OpenHD threads.
+ * Each (long running) thread calls set_current_thread() once at the beginning
+ * of its loop. This names the thread (visible in top -H / htop) and, if
+ * enabled in hardware.config (GEN_THREAD_POLICY_ENABLE), applies the
+ * scheduling policy, niceness and cpu affinity of its class. This way the hot
+ * path (video tx, rc) doesn't have to compete with housekeeping on the cpu.
+ */
+namespace openhd::thread {
+
+enum class ThreadClass {
+  // Appsink -> link, latency critical
+  REALTIME_VIDEO_TX,
+  // RC / FC serial, latency critical but little cpu
+  REALTIME_RC,
+  NORMAL,
+  // Housekeeping (LED, settings write back, status, async tasks)
+  BACKGROUND
+};
+std::string thread_class_to_string(ThreadClass thread_class);
+
+struct ClassPolicy {
+  // SCHED_FIFO if > 0, SCHED_OTHER with nice otherwise
+  int rt_priority = 0;
+  int nice = 0;
+  // Empty = all cpus
+  std::vector<int> cpus;
+};
+
+struct Policy {
+  bool enable = false;
+  bool lock_memory = false;
+  std::map<ThreadClass, ClassPolicy> classes;
+  std::string to_string() const;
+};
+
+// Policy for the platform we are running on (n cpus, memory) and the values
+// in hardware.config
+Policy create_policy_for_platform(int n_cpus, int64_t ram_bytes);
+// Created on first use
+const Policy& get_policy();
+
+// Name (max 15 chars, truncated) the calling thread and apply the policy of
+// the given class (if enabled). Failures (e.g. missing CAP_SYS_NICE for
+// SCHED_FIFO) are logged once, the thread continues with the default
+// scheduling.
+void set_current_thread(const std::string& name, ThreadClass thread_class);
+// Same, but for a policy that is not the global one (for testing)
+void set_current_thread(const std::string& name, ThreadClass thread_class,
+                        const Policy& policy);
+
+// mlockall(), if enabled by the policy. Call once, early in main.
+void lock_memory_if_enabled();
+
+struct ThreadCpuUsage {
+  pid_t tid;
+  std::string name;
+  // Since the last sample, 100% = one cpu fully used
+  float cpu_perc;
+};
+
+/**
+ * Per thread cpu usage of this process (including threads we didn't create,
+ * e.g. gstreamer) from /proc/self/task.
+ */
+class ThreadCpuMonitor {
+ public:
+  // Sorted, highest usage first. The first call only sets the reference
+  // (0% for all threads).
+  std::vector<ThreadCpuUsage> sample();
+  static std::string to_string(const std::vector<ThreadCpuUsage>& usage,
+                               int max_n_threads = 10);
+
+ private:
+  // tid -> utime+stime in clock ticks
+  std::map<pid_t, uint64_t> m_last_ticks;
+  int64_t m_last_sample_us = 0;
+};
+
+}  // namespace openhd::thread
+
+#endif  // OPENHD_THREAD_POLICY_H
@@ -33,6 +33,7 @@
 #include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 //
 // openhd UDP helpers
@@ -47,6 +48,10 @@ class UDPForwarder {
   UDPForwarder &operator=(const UDPForwarder &) = delete;
   ~UDPForwarder();
   void forwardPacketViaUDP(const uint8_t *packet, std::size_t packetSize) const;
+  // Same as above, but sends all packets with as few syscalls as possible
+  // (sendmmsg)
+  void forwardPacketsViaUDP(
+      const std::vector<std::shared_ptr<std::vector<uint8_t>>> &packets) const;
 
  private:
   struct sockaddr_in saddr {};
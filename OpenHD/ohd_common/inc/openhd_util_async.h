@@ -24,46 +24,121 @@
 #ifndef OPENHD_OPENHD_UTIL_ASYNC_H
 #define OPENHD_OPENHD_UTIL_ASYNC_H
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace openhd {
 
+/**
+ * Handed out for each async task - cancelling a task that has not started yet
+ * removes it from the queue, a running task can check is_cancelled()
+ * periodically (cooperative cancellation).
+ */
+class CancellationToken {
+ public:
+  void cancel() { m_cancelled = true; }
+  bool is_cancelled() const { return m_cancelled; }
+
+ private:
+  std::atomic<bool> m_cancelled = false;
+};
+
 /**
  * At some points in openhd we just need to fire up a task asynchronously
  * and don't really care for the result. This class helps with that -
  * though make sure to only do this if there are good reasons !
+ * Tasks are executed by a fixed number of worker threads (no thread creation
+ * per task, bounded thread count during e.g. bursts of parameter changes).
+ * Tasks with the same tag never run concurrently, and tasks with the same tag
+ * and priority are executed in the order they were submitted.
  */
 class AsyncHandle {
  public:
-  AsyncHandle();
+  enum class Priority { HIGH = 0, NORMAL = 1, LOW = 2 };
+  // Task is not started (dropped) if it couldn't be started in time
+  static constexpr auto NO_DEADLINE = std::chrono::milliseconds::max();
+  static constexpr int DEFAULT_N_WORKERS = 4;
+  explicit AsyncHandle(int n_workers = DEFAULT_N_WORKERS);
   ~AsyncHandle();
+  AsyncHandle(const AsyncHandle&) = delete;
+  AsyncHandle(const AsyncHandle&&) = delete;
   static AsyncHandle& instance();
-  void execute_async(std::string tag, std::function<void()> runnable);
+  std::shared_ptr<CancellationToken> execute_async(
+      std::string tag, std::function<void()> runnable,
+      Priority priority = Priority::NORMAL,
+      std::chrono::milliseconds deadline = NO_DEADLINE);
+  // Same as above, but the runnable gets the token to check for cancellation
+  std::shared_ptr<CancellationToken> execute_async_cancellable(
+      std::string tag, std::function<void(const CancellationToken&)> runnable,
+      Priority priority = Priority::NORMAL,
+      std::chrono::milliseconds deadline = NO_DEADLINE);
   void execute_command_async(std::string tag, std::string command);
+  // Queued and running tasks
   int get_n_current_tasks();
+  // Blocks until there are no queued or running tasks anymore, or the timeout
+  // elapsed. Returns true if all tasks are done.
+  bool wait_until_all_done(std::chrono::milliseconds timeout);
+  struct TaskStats {
+    int n_executed = 0;
+    int n_cancelled = 0;
+    // Dropped since they could not be started before their deadline
+    int n_expired = 0;
+    int n_exceptions = 0;
+    // Time from submitting until execution begins
+    std::chrono::microseconds queue_latency_total{0};
+    std::chrono::microseconds queue_latency_max{0};
+    std::chrono::microseconds run_time_total{0};
+    std::chrono::microseconds run_time_max{0};
+  };
+  // Per task tag
+  std::map<std::string, TaskStats> get_stats();
+  void log_stats();
 
  private:
-  std::mutex m_threads_mutex;
+  struct Task {
+    std::string tag;
+    std::function<void(const CancellationToken&)> runnable;
+    std::shared_ptr<CancellationToken> token;
+    std::chrono::steady_clock::time_point enqueue_time;
+    std::chrono::steady_clock::time_point deadline;
+  };
   struct RunningTask {
-    std::shared_ptr<std::thread> worker_thread;
-    std::function<void()> runnable;
     std::string tag;
-    bool done = false;
-    std::chrono::steady_clock::time_point start_time =
-        std::chrono::steady_clock::now();
-    std::chrono::steady_clock::time_point last_watchdog_error_log =
-        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_watchdog_error_log;
   };
-  std::deque<std::shared_ptr<RunningTask>> m_tasks;
-  bool m_watchdog_run = true;
-  std::shared_ptr<std::thread> m_watchdog_thread;
+  std::mutex m_mutex;
+  // Signalled on new tasks
+  std::condition_variable m_cv_task;
+  // Signalled whenever a task is done
+  std::condition_variable m_cv_done;
+  // One queue per priority
+  std::array<std::deque<Task>, 3> m_queues;
+  // Indexed by worker
+  std::vector<std::optional<RunningTask>> m_running;
+  std::set<std::string> m_running_tags;
+  std::map<std::string, TaskStats> m_stats;
+  bool m_keep_running = true;
+  std::vector<std::unique_ptr<std::thread>> m_workers;
+  std::unique_ptr<std::thread> m_watchdog_thread;
+  void loop_worker(int worker_idx);
   void check_watchdog();
-  static bool terminate_when_done(const RunningTask& task);
+  // Requires m_mutex to be locked. Returns false if there is no task that can
+  // be executed right now.
+  bool pop_next_task(Task& task);
+  int get_n_current_tasks_locked() const;
 };
 }  // namespace openhd
 
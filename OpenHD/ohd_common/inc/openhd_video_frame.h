@@ -25,6 +25,7 @@
 #define OPENHD_OPENHD_OHD_COMMON_OPENHD_VIDEO_FRAME_H_
 
 #include <chrono>
+#include <functional>
 #include <memory>
 #include <sstream>
 #include <vector>
@@ -54,6 +55,11 @@ struct FragmentedVideoFrame {
   // Set to true if this frame is an IDR frame and therefore we can safely drop
   // previous frame(s) without having complete corruption
   bool is_idr_frame = false;
+  // Set to true if this frame contains codec config data (SPS / PPS / VPS)
+  bool has_codec_config = false;
+  // Set to true if no other frame references this frame (h264 nal_ref_idc 0)
+  // and it can therefore be dropped without breaking the following frames
+  bool is_non_reference_frame = false;
   std::string to_string() const {
     int total_bytes = 0;
     for (auto& fragment : rtp_fragments) total_bytes += fragment->size();
@@ -61,6 +67,8 @@ struct FragmentedVideoFrame {
     std::stringstream ss;
     ss << "Bytes:" << total_bytes << " Fragments:" << rtp_fragments.size();
     ss << " IDR:" << (is_idr_frame ? "Y" : "N");
+    ss << " CFG:" << (has_codec_config ? "Y" : "N");
+    ss << " NREF:" << (is_non_reference_frame ? "Y" : "N");
     return ss.str();
   }
 };
@@ -72,20 +72,25 @@ openhd::FCRcChannelsHelper &openhd::FCRcChannelsHelper::instance() {
 
 void openhd::FCRcChannelsHelper::update_rc_channels(
     const std::array<int, 18> &rc_channels) {
-  auto tmp = m_action_rc_channel;
-  if (tmp) {
-    ACTION_ON_ANY_RC_CHANNEL_CB cb = *tmp;
-    cb(rc_channels);
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  for (auto &element : m_cbs) {
+    element.second(rc_channels);
   }
 }
 
-void openhd::FCRcChannelsHelper::action_on_any_rc_channel_register(
+void openhd::FCRcChannelsHelper::register_listener(
+    const std::string &tag,
     openhd::FCRcChannelsHelper::ACTION_ON_ANY_RC_CHANNEL_CB cb) {
-  if (cb == nullptr) {
-    m_action_rc_channel = nullptr;
-    return;
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  assert(m_cbs.find(tag) == m_cbs.end());
+  m_cbs[tag] = std::move(cb);
+}
+
+void openhd::FCRcChannelsHelper::unregister_listener(const std::string &tag) {
+  std::lock_guard<std::mutex> guard(m_cbs_mutex);
+  if (m_cbs.erase(tag) == 0) {
+    openhd::log::get_default()->warn("Cannot unregister rc listener {}", tag);
   }
-  m_action_rc_channel = std::make_shared<ACTION_ON_ANY_RC_CHANNEL_CB>(cb);
 }
 
 openhd::LinkActionHandler &openhd::LinkActionHandler::instance() {
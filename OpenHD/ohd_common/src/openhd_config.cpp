@@ -68,6 +68,12 @@ static openhd::Config load_or_default() {
         r.Get<std::string>("wifi", "WIFI_LOCAL_NETWORK_SSID", "");
     ret.WIFI_LOCAL_NETWORK_PASSWORD =
         r.Get<std::string>("wifi", "WIFI_LOCAL_NETWORK_PASSWORD", "");
+    ret.WIFI_PCAP_RECORD_DIRECTORY =
+        r.Get<std::string>("wifi", "WIFI_PCAP_RECORD_DIRECTORY", "");
+    ret.WIFI_PCAP_RECORD_FILE_SIZE_MB =
+        r.Get<int>("wifi", "WIFI_PCAP_RECORD_FILE_SIZE_MB", 32);
+    ret.WIFI_PCAP_RECORD_N_FILES =
+        r.Get<int>("wifi", "WIFI_PCAP_RECORD_N_FILES", 8);
 
     // Parse Network configuration
     ret.NW_ETHERNET_CARD =
@@ -87,6 +93,8 @@ static openhd::Config load_or_default() {
     std::cout << "DEBUG: VIDEO_PORT: " << ret.VIDEO_PORT << std::endl;
     ret.TELEMETRY_PORT = r.Get<int>("ethernet", "TELEMETRY_PORT", 5600);
     std::cout << "DEBUG: TELEMETRY_PORT: " << ret.TELEMETRY_PORT << std::endl;
+    ret.ETH_FEC_ENABLE = r.Get<bool>("ethernet", "ETH_FEC_ENABLE", false);
+    ret.ETH_FEC_PERCENTAGE = r.Get<int>("ethernet", "ETH_FEC_PERCENTAGE", 20);
 
     // Parse Ethernet link Microhard configuration
     std::cout << "WARN: Parsing Ethernet link Microhard configuration"
@@ -132,6 +140,27 @@ static openhd::Config load_or_default() {
     ret.GEN_RF_METRICS_LEVEL = r.Get<int>("generic", "GEN_RF_METRICS_LEVEL", 0);
     ret.GEN_NO_QOPENHD_AUTOSTART =
         r.Get<bool>("generic", "GEN_NO_QOPENHD_AUTOSTART", false);
+    ret.GEN_METRICS_PORT = r.Get<int>("generic", "GEN_METRICS_PORT", 0);
+    ret.GEN_THREAD_POLICY_ENABLE =
+        r.Get<bool>("generic", "GEN_THREAD_POLICY_ENABLE", false);
+    ret.GEN_THREAD_RT_PRIORITY_VIDEO =
+        r.Get<int>("generic", "GEN_THREAD_RT_PRIORITY_VIDEO", 40);
+    ret.GEN_THREAD_RT_PRIORITY_RC =
+        r.Get<int>("generic", "GEN_THREAD_RT_PRIORITY_RC", 50);
+    ret.GEN_THREAD_MLOCKALL = r.Get<int>("generic", "GEN_THREAD_MLOCKALL", -1);
+    ret.GEN_MEMORY_BUDGET_MB =
+        r.Get<int>("generic", "GEN_MEMORY_BUDGET_MB", 0);
+    ret.GEN_THERMAL_GOVERNOR_ENABLE =
+        r.Get<int>("generic", "GEN_THERMAL_GOVERNOR_ENABLE", -1);
+    ret.GEN_THERMAL_SETPOINT_SOC_C =
+        r.Get<int>("generic", "GEN_THERMAL_SETPOINT_SOC_C", 80);
+    ret.GEN_THERMAL_SETPOINT_WIFI_CARD_C =
+        r.Get<int>("generic", "GEN_THERMAL_SETPOINT_WIFI_CARD_C", 85);
+    ret.GEN_VIDEO_TX_MAX_FRAME_AGE_MS =
+        r.Get<int>("generic", "GEN_VIDEO_TX_MAX_FRAME_AGE_MS", 100);
+    ret.GEN_STATS_COMPACT = r.Get<bool>("generic", "GEN_STATS_COMPACT", false);
+    ret.GEN_TELEMETRY_DOWNLINK_KBITS =
+        r.Get<int>("generic", "GEN_TELEMETRY_DOWNLINK_KBITS", 64);
 
     return ret;
   } catch (std::exception& exception) {
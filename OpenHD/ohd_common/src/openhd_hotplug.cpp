@@ -0,0 +1,415 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_hotplug.h"
+
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
+#include "openhd_util_filesystem.h"
+
+// If the netlink sockets are available, we only re-check in case we missed an
+// event (e.g. socket buffer overflow) - otherwise, this is the poll interval.
+static constexpr auto RECHECK_INTERVAL_NETLINK = std::chrono::seconds(2);
+static constexpr auto RECHECK_INTERVAL_NO_NETLINK = std::chrono::seconds(1);
+
+static int open_netlink_socket(int protocol, uint32_t groups) {
+  const int fd =
+      socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, protocol);
+  if (fd < 0) return -1;
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = groups;
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+openhd::HotplugMonitor::HotplugMonitor(bool open_netlink_sockets) {
+  m_console = openhd::log::create_or_get("hotplug");
+  if (open_netlink_sockets) {
+    m_rtnetlink_fd = open_netlink_socket(
+        NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE);
+    // Group 1: events sent by the kernel (not re-broadcast by udev)
+    m_uevent_fd = open_netlink_socket(NETLINK_KOBJECT_UEVENT, 1);
+    if (m_rtnetlink_fd < 0 || m_uevent_fd < 0) {
+      m_console->warn("Cannot open netlink socket(s) {}, falling back to poll",
+                      strerror(errno));
+    }
+  }
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  m_keep_running = true;
+  m_thread = std::make_unique<std::thread>(&HotplugMonitor::loop, this);
+}
+
+openhd::HotplugMonitor::~HotplugMonitor() {
+  m_keep_running = false;
+  const uint64_t one = 1;
+  (void)write(m_wakeup_fd, &one, sizeof(one));
+  m_thread->join();
+  m_thread = nullptr;
+  for (const int fd : {m_rtnetlink_fd, m_uevent_fd, m_wakeup_fd}) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+openhd::HotplugMonitor& openhd::HotplugMonitor::instance() {
+  static HotplugMonitor instance{};
+  return instance;
+}
+
+int openhd::HotplugMonitor::subscribe(EVENT_CALLBACK callback) {
+  std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+  const int id = m_next_subscriber_id++;
+  m_subscribers[id] = std::move(callback);
+  return id;
+}
+
+void openhd::HotplugMonitor::unsubscribe(int id) {
+  std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+  m_subscribers.erase(id);
+}
+
+bool openhd::HotplugMonitor::has_netlink() const {
+  return m_rtnetlink_fd >= 0 && m_uevent_fd >= 0;
+}
+
+bool openhd::HotplugMonitor::wait_for(const std::function<bool()>& condition,
+                                      std::chrono::milliseconds timeout) {
+  const auto begin = std::chrono::steady_clock::now();
+  const std::chrono::milliseconds recheck_interval =
+      has_netlink() ? RECHECK_INTERVAL_NETLINK : RECHECK_INTERVAL_NO_NETLINK;
+  std::unique_lock<std::mutex> lock(m_wait_mutex);
+  while (true) {
+    // Events that arrive while we evaluate the condition are not lost
+    const uint64_t seq = m_event_seq;
+    lock.unlock();
+    const bool result = condition();
+    lock.lock();
+    if (result) return true;
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin);
+    if (elapsed >= timeout) return false;
+    // (milliseconds::max() - elapsed doesn't overflow)
+    const auto remaining = timeout - elapsed;
+    m_wait_cv.wait_for(lock, std::min(remaining, recheck_interval),
+                       [this, seq] { return m_event_seq != seq; });
+  }
+}
+
+std::optional<std::string> openhd::HotplugMonitor::wait_for_gateway(
+    const std::string& interface_name, const std::function<bool()>& abort,
+    std::chrono::milliseconds timeout) {
+  std::mutex gateway_mutex;
+  std::optional<std::string> gateway;
+  // Subscribe first, such that a route added meanwhile is not missed
+  const int subscriber_id = subscribe([&](const Event& event) {
+    if (event.type != EventType::ROUTE_NEW || event.address.empty() ||
+        event.interface_name != interface_name) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(gateway_mutex);
+    gateway = event.address;
+  });
+  auto read_proc_net_route = [&]() {
+    const auto opt_content =
+        OHDFilesystemUtil::opt_read_file("/proc/net/route", false);
+    if (!opt_content.has_value()) return;
+    auto opt_gateway =
+        parse_proc_net_route_gateway(opt_content.value(), interface_name);
+    if (!opt_gateway.has_value()) return;
+    std::lock_guard<std::mutex> lock(gateway_mutex);
+    gateway = std::move(opt_gateway);
+  };
+  read_proc_net_route();
+  wait_for(
+      [&]() {
+        if (abort()) return true;
+        // Without netlink there are no events - this is the poll then
+        if (!has_netlink()) read_proc_net_route();
+        std::lock_guard<std::mutex> lock(gateway_mutex);
+        return gateway.has_value();
+      },
+      timeout);
+  unsubscribe(subscriber_id);
+  std::lock_guard<std::mutex> lock(gateway_mutex);
+  return gateway;
+}
+
+void openhd::HotplugMonitor::interrupt_waiters() {
+  {
+    std::lock_guard<std::mutex> lock(m_wait_mutex);
+    m_event_seq++;
+  }
+  m_wait_cv.notify_all();
+}
+
+void openhd::HotplugMonitor::dispatch(const Event& event) {
+  m_console->debug("{} {}{} {}", event_type_to_string(event.type),
+                   event.interface_name, event.devname, event.address);
+  {
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+    for (auto& [id, callback] : m_subscribers) {
+      callback(event);
+    }
+  }
+  interrupt_waiters();
+}
+
+void openhd::HotplugMonitor::inject_rtnetlink_message(const uint8_t* data,
+                                                      int data_len) {
+  for (const auto& event : parse_rtnetlink_message(data, data_len)) {
+    dispatch(event);
+  }
+}
+
+void openhd::HotplugMonitor::inject_uevent_message(const char* data,
+                                                   int data_len) {
+  const auto opt_event = parse_uevent_message(data, data_len);
+  if (opt_event.has_value()) dispatch(opt_event.value());
+}
+
+static std::string interface_name_from_index(int if_index) {
+  char name[IF_NAMESIZE]{};
+  if (if_indextoname(if_index, name) == nullptr) return "";
+  return name;
+}
+
+static std::string ipv4_to_string(const void* data) {
+  char buff[INET_ADDRSTRLEN]{};
+  inet_ntop(AF_INET, data, buff, sizeof(buff));
+  return buff;
+}
+
+std::vector<openhd::HotplugMonitor::Event>
+openhd::HotplugMonitor::parse_rtnetlink_message(const uint8_t* data,
+                                                int data_len) {
+  std::vector<Event> ret;
+  int len = data_len;
+  for (auto* nh = (const nlmsghdr*)data; NLMSG_OK(nh, len);
+       nh = NLMSG_NEXT(nh, len)) {
+    if (nh->nlmsg_type == NLMSG_DONE || nh->nlmsg_type == NLMSG_ERROR) break;
+    Event event{};
+    if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK) {
+      const auto* ifi = (const ifinfomsg*)NLMSG_DATA(nh);
+      event.type = nh->nlmsg_type == RTM_NEWLINK ? EventType::LINK_NEW
+                                                 : EventType::LINK_DEL;
+      event.if_index = ifi->ifi_index;
+      event.is_up = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+      int attr_len = IFLA_PAYLOAD(nh);
+      for (auto* rta = IFLA_RTA(ifi); RTA_OK(rta, attr_len);
+           rta = RTA_NEXT(rta, attr_len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+          event.interface_name = std::string((const char*)RTA_DATA(rta));
+        }
+      }
+    } else if (nh->nlmsg_type == RTM_NEWADDR || nh->nlmsg_type == RTM_DELADDR) {
+      const auto* ifa = (const ifaddrmsg*)NLMSG_DATA(nh);
+      if (ifa->ifa_family != AF_INET) continue;
+      event.type = nh->nlmsg_type == RTM_NEWADDR ? EventType::ADDR_NEW
+                                                 : EventType::ADDR_DEL;
+      event.if_index = (int)ifa->ifa_index;
+      int attr_len = IFA_PAYLOAD(nh);
+      for (auto* rta = IFA_RTA(ifa); RTA_OK(rta, attr_len);
+           rta = RTA_NEXT(rta, attr_len)) {
+        if (rta->rta_type == IFA_LOCAL ||
+            (rta->rta_type == IFA_ADDRESS && event.address.empty())) {
+          event.address = ipv4_to_string(RTA_DATA(rta));
+        } else if (rta->rta_type == IFA_LABEL) {
+          event.interface_name = std::string((const char*)RTA_DATA(rta));
+        }
+      }
+    } else if (nh->nlmsg_type == RTM_NEWROUTE ||
+               nh->nlmsg_type == RTM_DELROUTE) {
+      const auto* rtm = (const rtmsg*)NLMSG_DATA(nh);
+      if (rtm->rtm_family != AF_INET || rtm->rtm_table != RT_TABLE_MAIN) {
+        continue;
+      }
+      event.type = nh->nlmsg_type == RTM_NEWROUTE ? EventType::ROUTE_NEW
+                                                  : EventType::ROUTE_DEL;
+      int attr_len = RTM_PAYLOAD(nh);
+      for (auto* rta = RTM_RTA(rtm); RTA_OK(rta, attr_len);
+           rta = RTA_NEXT(rta, attr_len)) {
+        // Only the gateway of the default route (0.0.0.0/0)
+        if (rta->rta_type == RTA_GATEWAY && rtm->rtm_dst_len == 0) {
+          event.address = ipv4_to_string(RTA_DATA(rta));
+        } else if (rta->rta_type == RTA_OIF) {
+          event.if_index = *(const int*)RTA_DATA(rta);
+        }
+      }
+    } else {
+      continue;
+    }
+    if (event.interface_name.empty() && event.if_index > 0) {
+      event.interface_name = interface_name_from_index(event.if_index);
+    }
+    ret.push_back(event);
+  }
+  return ret;
+}
+
+std::optional<openhd::HotplugMonitor::Event>
+openhd::HotplugMonitor::parse_uevent_message(const char* data, int data_len) {
+  // Layout: "action@devpath\0KEY=VALUE\0KEY=VALUE\0..."
+  // Messages re-broadcast by udev start with "libudev" and are binary
+  std::map<std::string, std::string> env;
+  bool first = true;
+  for (int offset = 0; offset < data_len;) {
+    const char* str = data + offset;
+    const size_t str_len = strnlen(str, data_len - offset);
+    if (first) {
+      if (memchr(str, '@', str_len) == nullptr) return std::nullopt;
+      first = false;
+    } else {
+      const char* separator = (const char*)memchr(str, '=', str_len);
+      if (separator != nullptr) {
+        env[std::string(str, separator - str)] =
+            std::string(separator + 1, str + str_len - (separator + 1));
+      }
+    }
+    offset += str_len + 1;
+  }
+  if (first) return std::nullopt;
+  Event event{};
+  event.subsystem = env["SUBSYSTEM"];
+  if (event.subsystem != "net" && event.subsystem != "video4linux") {
+    return std::nullopt;
+  }
+  const auto& action = env["ACTION"];
+  if (action == "add") {
+    event.type = EventType::DEVICE_ADD;
+  } else if (action == "remove") {
+    event.type = EventType::DEVICE_REMOVE;
+  } else {
+    event.type = EventType::DEVICE_CHANGE;
+  }
+  event.devpath = env["DEVPATH"];
+  event.interface_name = env["INTERFACE"];
+  const auto& devname = env["DEVNAME"];
+  // DEVNAME can be either "video0" or "/dev/video0"
+  const auto last_slash = devname.find_last_of('/');
+  event.devname = last_slash == std::string::npos
+                      ? devname
+                      : devname.substr(last_slash + 1);
+  if (!env["IFINDEX"].empty()) {
+    event.if_index = std::atoi(env["IFINDEX"].c_str());
+  }
+  return event;
+}
+
+std::string openhd::HotplugMonitor::event_type_to_string(EventType type) {
+  switch (type) {
+    case EventType::LINK_NEW:
+      return "LINK_NEW";
+    case EventType::LINK_DEL:
+      return "LINK_DEL";
+    case EventType::ADDR_NEW:
+      return "ADDR_NEW";
+    case EventType::ADDR_DEL:
+      return "ADDR_DEL";
+    case EventType::ROUTE_NEW:
+      return "ROUTE_NEW";
+    case EventType::ROUTE_DEL:
+      return "ROUTE_DEL";
+    case EventType::DEVICE_ADD:
+      return "DEVICE_ADD";
+    case EventType::DEVICE_REMOVE:
+      return "DEVICE_REMOVE";
+    case EventType::DEVICE_CHANGE:
+      return "DEVICE_CHANGE";
+  }
+  return "UNKNOWN";
+}
+
+void openhd::HotplugMonitor::loop() {
+  openhd::thread::set_current_thread(
+      "hotplug", openhd::thread::ThreadClass::BACKGROUND);
+  // Large enough for a burst of rtnetlink messages
+  std::vector<uint8_t> buff(32 * 1024);
+  while (m_keep_running) {
+    pollfd fds[3]{};
+    fds[0] = {m_wakeup_fd, POLLIN, 0};
+    fds[1] = {m_rtnetlink_fd, POLLIN, 0};
+    fds[2] = {m_uevent_fd, POLLIN, 0};
+    const int ret = poll(fds, 3, -1);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      m_console->warn("poll {}", strerror(errno));
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      while (true) {
+        const ssize_t len = recv(m_rtnetlink_fd, buff.data(), buff.size(), 0);
+        if (len <= 0) {
+          // ENOBUFS: we missed events, waiters re-check their condition
+          if (len < 0 && errno == ENOBUFS) interrupt_waiters();
+          break;
+        }
+        inject_rtnetlink_message(buff.data(), (int)len);
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      while (true) {
+        const ssize_t len = recv(m_uevent_fd, buff.data(), buff.size(), 0);
+        if (len <= 0) {
+          if (len < 0 && errno == ENOBUFS) interrupt_waiters();
+          break;
+        }
+        inject_uevent_message((const char*)buff.data(), (int)len);
+      }
+    }
+  }
+}
+
+std::optional<std::string> openhd::HotplugMonitor::parse_proc_net_route_gateway(
+    const std::string& proc_net_route, const std::string& interface_name) {
+  // Iface Destination Gateway Flags ... - one route per line, addresses are
+  // hex in network byte order as read on this host
+  std::istringstream lines(proc_net_route);
+  std::string line;
+  while (std::getline(lines, line)) {
+    std::istringstream fields(line);
+    std::string iface, destination, gateway;
+    if (!(fields >> iface >> destination >> gateway)) continue;
+    if (iface != interface_name || destination != "00000000") continue;
+    in_addr addr{};
+    addr.s_addr = (uint32_t)std::strtoul(gateway.c_str(), nullptr, 16);
+    if (addr.s_addr == 0) continue;
+    return ipv4_to_string(&addr);
+  }
+  return std::nullopt;
+}
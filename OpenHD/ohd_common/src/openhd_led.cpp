@@ -28,6 +28,7 @@
 
 #include "openhd_platform.h"
 #include "openhd_spdlog.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 #include "openhd_util_filesystem.h"
 
@@ -167,6 +168,8 @@ void openhd::LEDManager::stop_loading_thread() {
 }
 
 void openhd::LEDManager::loading_loop() {
+  openhd::thread::set_current_thread(
+      "led", openhd::thread::ThreadClass::BACKGROUND);
   while (m_running) {
     if (m_has_error) {
       blink_error();
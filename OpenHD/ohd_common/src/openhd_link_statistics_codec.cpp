@@ -0,0 +1,358 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_link_statistics_codec.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace openhd::link_statistics {
+
+// The fields the mavlink stats messages carry, in a fixed order. Called with a
+// const struct for reading and a non-const one for writing.
+template <class S, class F>
+static void visit_link(S& s, F&& f) {
+  f(s.curr_tx_bps);
+  f(s.curr_rx_bps);
+  f(s.count_tx_inj_error_hint);
+  f(s.count_tx_dropped_packets);
+  f(s.dummy2);
+  f(s.curr_tx_pps);
+  f(s.curr_rx_pps);
+  f(s.curr_rx_big_gaps_counter);
+  f(s.curr_tx_channel_mhz);
+  f(s.curr_rate_kbits);
+  f(s.dummy1);
+  f(s.curr_rx_packet_loss_perc);
+  f(s.curr_tx_channel_w_mhz);
+  f(s.curr_tx_mcs_index);
+  f(s.curr_n_rate_adjustments);
+  f(s.bitfield);
+  f(s.pollution_perc);
+  f(s.dummy0);
+}
+template <class S, class F>
+static void visit_telemetry(S& s, F&& f) {
+  f(s.curr_tx_bps);
+  f(s.curr_rx_bps);
+  f(s.curr_tx_pps);
+  f(s.curr_rx_pps);
+  f(s.curr_rx_packet_loss_perc);
+}
+template <class S, class F>
+static void visit_card(S& s, F&& f) {
+  f(s.rx_rssi);
+  f(s.rx_rssi_1);
+  f(s.rx_rssi_2);
+  f(s.count_p_received);
+  f(s.count_p_injected);
+  f(s.curr_rx_packet_loss_perc);
+  f(s.card_type);
+  f(s.card_sub_type);
+  f(s.tx_power_current);
+  f(s.tx_power_armed);
+  f(s.tx_power_disarmed);
+  f(s.curr_status);
+  f(s.rx_signal_quality_adapter);
+  f(s.rx_noise_adapter);
+  f(s.tx_active);
+}
+template <class S, class F>
+static void visit_video_air(S& s, F&& f) {
+  f(s.link_index);
+  f(s.curr_recommended_bitrate);
+  f(s.curr_measured_encoder_bitrate);
+  f(s.curr_injected_bitrate);
+  f(s.curr_injected_pps);
+  f(s.curr_dropped_frames);
+  f(s.curr_fec_percentage);
+  f(s.thermal_protection_level);
+  f(s.thermal_hottest_temp_c);
+  f(s.thermal_tx_power_perc);
+  f(s.thermal_bitrate_perc);
+}
+template <class S, class F>
+static void visit_air_fec(S& s, F&& f) {
+  f(s.link_index);
+  f(s.curr_fec_encode_time_avg_us);
+  f(s.curr_fec_encode_time_min_us);
+  f(s.curr_fec_encode_time_max_us);
+  f(s.curr_fec_block_size_avg);
+  f(s.curr_fec_block_size_min);
+  f(s.curr_fec_block_size_max);
+  f(s.curr_tx_delay_min_us);
+  f(s.curr_tx_delay_max_us);
+  f(s.curr_tx_delay_avg_us);
+}
+
+static constexpr uint8_t FLAG_KEYFRAME = 0x01;
+static constexpr int MAX_VIDEO_STREAMS = 3;
+static constexpr int MAX_KEYFRAME_PARTS = 15;
+// Flags, keyframe id, layout
+static constexpr int HEADER_SIZE = 3;
+
+// bits 0-3: active cards, bits 4-5: n video streams, bit 6: air
+static uint8_t get_layout(const StatsAirGround& stats) {
+  uint8_t ret = 0;
+  for (int i = 0; i < 4; i++) {
+    if (stats.cards[i].NON_MAVLINK_CARD_ACTIVE) ret |= (1 << i);
+  }
+  const int n_video =
+      std::min((int)stats.stats_wb_video_air.size(), MAX_VIDEO_STREAMS);
+  ret |= n_video << 4;
+  if (stats.is_air) ret |= 0x40;
+  return ret;
+}
+
+std::vector<int64_t> stats_to_values(const StatsAirGround& stats) {
+  std::vector<int64_t> ret;
+  auto read = [&ret](const auto& field) { ret.push_back((int64_t)field); };
+  visit_link(stats.monitor_mode_link, read);
+  visit_telemetry(stats.telemetry, read);
+  for (const auto& card : stats.cards) {
+    if (card.NON_MAVLINK_CARD_ACTIVE) visit_card(card, read);
+  }
+  const int n_video_streams =
+      std::min((int)stats.stats_wb_video_air.size(), MAX_VIDEO_STREAMS);
+  for (int i = 0; i < n_video_streams; i++) {
+    visit_video_air(stats.stats_wb_video_air[i], read);
+  }
+  visit_air_fec(stats.air_fec_performance, read);
+  return ret;
+}
+
+static StatsAirGround values_to_stats(const std::vector<int64_t>& values,
+                                      uint8_t layout) {
+  StatsAirGround ret{};
+  ret.is_air = (layout & 0x40) != 0;
+  ret.ready = true;
+  size_t idx = 0;
+  auto write = [&values, &idx](auto& field) {
+    using T = std::remove_reference_t<decltype(field)>;
+    field = idx < values.size() ? (T)values[idx] : T{};
+    idx++;
+  };
+  visit_link(ret.monitor_mode_link, write);
+  visit_telemetry(ret.telemetry, write);
+  for (int i = 0; i < 4; i++) {
+    if ((layout & (1 << i)) == 0) continue;
+    ret.cards[i].NON_MAVLINK_CARD_ACTIVE = true;
+    visit_card(ret.cards[i], write);
+  }
+  ret.stats_wb_video_air.resize((layout >> 4) & 0x03);
+  for (auto& video : ret.stats_wb_video_air) visit_video_air(video, write);
+  visit_air_fec(ret.air_fec_performance, write);
+  return ret;
+}
+
+static size_t n_fields_for_layout(uint8_t layout) {
+  // link, telemetry, air fec + per card + per video stream
+  return 18 + 5 + 10 + __builtin_popcount(layout & 0x0F) * 15 +
+         ((layout >> 4) & 0x03) * 11;
+}
+
+void write_varint(std::vector<uint8_t>& buff, uint64_t value) {
+  while (value >= 0x80) {
+    buff.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  buff.push_back((uint8_t)value);
+}
+
+std::optional<uint64_t> read_varint(const uint8_t* data, int data_len,
+                                    int& offset) {
+  uint64_t ret = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (offset >= data_len) return std::nullopt;
+    const uint8_t byte = data[offset++];
+    ret |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return ret;
+  }
+  return std::nullopt;
+}
+
+uint64_t zigzag_encode(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t zigzag_decode(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+bool is_keyframe(const std::vector<uint8_t>& message) {
+  return !message.empty() && (message[0] & FLAG_KEYFRAME) != 0;
+}
+
+StatsEncoder::StatsEncoder(StatsEncoderConfig config)
+    : m_config(config),
+      m_curr_interval(std::clamp(std::chrono::milliseconds(500),
+                                 config.min_interval, config.max_interval)) {}
+
+std::vector<std::vector<uint8_t>> StatsEncoder::encode(
+    const StatsAirGround& stats, std::chrono::steady_clock::time_point now) {
+  const bool first = m_last_message == std::chrono::steady_clock::time_point{};
+  if (!first && now - m_last_message < m_curr_interval) return {};
+  const auto values = stats_to_values(stats);
+  const uint8_t layout = get_layout(stats);
+  bool keyframe = !m_has_keyframe || layout != m_layout ||
+                  now - m_last_keyframe >= m_config.keyframe_interval;
+  std::vector<std::vector<uint8_t>> ret;
+  if (!keyframe) {
+    if (values == m_last_sent && now - m_last_message < m_config.max_interval) {
+      return {};
+    }
+    std::vector<uint8_t> delta{0, m_keyframe_id, layout};
+    int prev_idx = -1;
+    for (int i = 0; i < (int)values.size(); i++) {
+      if (values[i] == m_keyframe[i]) continue;
+      write_varint(delta, i - prev_idx - 1);
+      write_varint(delta, zigzag_encode(values[i] - m_keyframe[i]));
+      prev_idx = i;
+    }
+    if (delta.size() <= COMPACT_STATS_MAX_PAYLOAD) {
+      ret.push_back(std::move(delta));
+      m_counters.n_deltas++;
+    } else {
+      keyframe = true;
+    }
+  }
+  if (keyframe) {
+    m_keyframe_id++;
+    m_keyframe = values;
+    m_layout = layout;
+    m_has_keyframe = true;
+    m_last_keyframe = now;
+    auto begin_part = [this, layout, &ret](int first_field) {
+      ret.push_back({FLAG_KEYFRAME, m_keyframe_id, layout, 0});
+      write_varint(ret.back(), first_field);
+    };
+    begin_part(0);
+    std::vector<uint8_t> tmp;
+    for (int i = 0; i < (int)values.size(); i++) {
+      tmp.clear();
+      write_varint(tmp, zigzag_encode(values[i]));
+      if (ret.back().size() + tmp.size() > COMPACT_STATS_MAX_PAYLOAD &&
+          ret.size() < MAX_KEYFRAME_PARTS) {
+        begin_part(i);
+      }
+      ret.back().insert(ret.back().end(), tmp.begin(), tmp.end());
+    }
+    const int n_parts = (int)ret.size();
+    for (int i = 0; i < n_parts; i++) {
+      ret[i][3] = (uint8_t)((i << 4) | n_parts);
+    }
+    m_counters.n_keyframes++;
+  }
+  int n_bytes = 0;
+  for (const auto& message : ret) n_bytes += (int)message.size();
+  m_counters.n_bytes += n_bytes;
+  n_bytes += (int)ret.size() * m_config.message_overhead_bytes;
+  m_avg_message_bytes = m_avg_message_bytes == 0
+                            ? (float)n_bytes
+                            : 0.8f * m_avg_message_bytes + 0.2f * n_bytes;
+  if (m_available_bps > 0) {
+    const auto wanted = std::chrono::milliseconds(
+        (int64_t)(m_avg_message_bytes * 8 * 1000 / m_available_bps));
+    m_curr_interval =
+        std::clamp(wanted, m_config.min_interval, m_config.max_interval);
+  }
+  m_last_sent = values;
+  m_last_message = now;
+  return ret;
+}
+
+void StatsEncoder::set_available_bps(int available_bps) {
+  m_available_bps = available_bps;
+}
+
+std::chrono::milliseconds StatsEncoder::get_curr_interval() const {
+  return m_curr_interval;
+}
+
+int StatsEncoder::get_curr_bps() const {
+  return (int)(m_avg_message_bytes * 8 * 1000 / m_curr_interval.count());
+}
+
+StatsCodecCounters StatsEncoder::get_counters() const { return m_counters; }
+
+std::optional<StatsAirGround> StatsDecoder::decode(const uint8_t* data,
+                                                   int data_len) {
+  if (data_len < HEADER_SIZE) return std::nullopt;
+  m_counters.n_bytes += data_len;
+  const uint8_t flags = data[0];
+  const uint8_t keyframe_id = data[1];
+  const uint8_t layout = data[2];
+  const size_t n_fields = n_fields_for_layout(layout);
+  int offset = HEADER_SIZE;
+  if (flags & FLAG_KEYFRAME) {
+    if (data_len < HEADER_SIZE + 1) return std::nullopt;
+    const int part = data[offset] >> 4;
+    const int n_parts = data[offset] & 0x0F;
+    offset++;
+    if (n_parts == 0 || part >= n_parts) return std::nullopt;
+    const auto first_field = read_varint(data, data_len, offset);
+    if (!first_field.has_value()) return std::nullopt;
+    if (m_pending.empty() || keyframe_id != m_pending_id ||
+        layout != m_pending_layout) {
+      m_pending.assign(n_fields, 0);
+      m_pending_id = keyframe_id;
+      m_pending_layout = layout;
+      m_pending_parts_mask = 0;
+    }
+    size_t idx = first_field.value();
+    while (offset < data_len) {
+      const auto value = read_varint(data, data_len, offset);
+      if (!value.has_value() || idx >= n_fields) return std::nullopt;
+      m_pending[idx++] = zigzag_decode(value.value());
+    }
+    m_pending_parts_mask |= 1 << part;
+    if (m_pending_parts_mask != (1 << n_parts) - 1) return std::nullopt;
+    m_keyframe = std::move(m_pending);
+    m_pending.clear();
+    m_keyframe_id = keyframe_id;
+    m_layout = layout;
+    m_has_keyframe = true;
+    m_counters.n_keyframes++;
+    return values_to_stats(m_keyframe, m_layout);
+  }
+  if (!m_has_keyframe || keyframe_id != m_keyframe_id || layout != m_layout) {
+    // Need the keyframe it refers to
+    return std::nullopt;
+  }
+  auto values = m_keyframe;
+  int64_t idx = -1;
+  while (offset < data_len) {
+    const auto gap = read_varint(data, data_len, offset);
+    const auto delta = read_varint(data, data_len, offset);
+    if (!gap.has_value() || !delta.has_value()) return std::nullopt;
+    idx += (int64_t)gap.value() + 1;
+    if (idx >= (int64_t)values.size()) return std::nullopt;
+    values[idx] += zigzag_decode(delta.value());
+  }
+  m_counters.n_deltas++;
+  return values_to_stats(values, layout);
+}
+
+StatsCodecCounters StatsDecoder::get_counters() const { return m_counters; }
+
+}  // namespace openhd::link_statistics
@@ -0,0 +1,343 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_memory.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <optional>
+#include <sstream>
+
+#include "openhd_config.h"
+#include "openhd_spdlog.h"
+#include "openhd_spdlog_include.h"
+
+namespace openhd::memory {
+
+static std::shared_ptr<spdlog::logger> get_console() {
+  return openhd::log::create_or_get("memory");
+}
+
+std::string Budget::to_string() const {
+  std::stringstream ss;
+  ss << "Budget{" << budget_mb << "MB udp_rx:" << udp_rx_buffer_bytes
+     << " tcp_rx:" << tcp_rx_buffer_bytes << " tcp_clients:" << tcp_max_clients
+     << " wb_tele_q:" << wb_tele_queue_packets
+     << " wb_audio_q:" << wb_audio_queue_packets
+     << " video_tx_q:" << video_tx_queue_frames
+     << " eth_fec_blocks:" << eth_fec_max_blocks_in_flight
+     << " fragment_pool:" << fragment_pool_n_buffers
+     << " pcap_file_buf:" << pcap_file_buffer_bytes
+     << " pcap_rcvbuf:" << pcap_socket_rcvbuf_bytes << "}";
+  return ss.str();
+}
+
+static int interpolate(const double t, const int low, const int full) {
+  return low + (int)std::lround(t * (full - low));
+}
+
+Budget create_budget(const int budget_mb) {
+  Budget ret{};
+  ret.budget_mb = std::max(1, budget_mb);
+  const double t = std::clamp((double)(ret.budget_mb - LOW_BUDGET_MB) /
+                                  (FULL_BUDGET_MB - LOW_BUDGET_MB),
+                              0.0, 1.0);
+  // Largest packet we receive on a low budget is a MTU sized video fragment
+  ret.udp_rx_buffer_bytes = interpolate(t, 8 * 1024, 65507);
+  ret.tcp_rx_buffer_bytes = interpolate(t, 8 * 1024, 65507);
+  ret.tcp_max_clients = interpolate(t, 2, 8);
+  ret.wb_tele_queue_packets = interpolate(t, 8, 32);
+  ret.wb_audio_queue_packets = interpolate(t, 8, 16);
+  ret.video_tx_queue_frames = interpolate(t, 4, 8);
+  ret.eth_fec_max_blocks_in_flight = interpolate(t, 4, 8);
+  ret.fragment_pool_n_buffers = interpolate(t, 64, 512);
+  ret.pcap_file_buffer_bytes = interpolate(t, 64 * 1024, 256 * 1024);
+  ret.pcap_socket_rcvbuf_bytes = interpolate(t, 1024 * 1024, 4 * 1024 * 1024);
+  return ret;
+}
+
+int budget_mb_for_ram(const int64_t ram_bytes) {
+  return std::max(LOW_BUDGET_MB, (int)(ram_bytes / 16 / (1024 * 1024)));
+}
+
+static std::optional<int> g_budget_mb_override;
+
+void set_budget_mb(const int budget_mb) { g_budget_mb_override = budget_mb; }
+
+const Budget& get_budget() {
+  static const Budget budget = [] {
+    int budget_mb = openhd::load_config().GEN_MEMORY_BUDGET_MB;
+    if (g_budget_mb_override.has_value()) {
+      budget_mb = g_budget_mb_override.value();
+    }
+    if (budget_mb <= 0) {
+      const int64_t ram_bytes =
+          (int64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+      budget_mb = budget_mb_for_ram(ram_bytes);
+    }
+    return create_budget(budget_mb);
+  }();
+  return budget;
+}
+
+ProcessMemory get_process_memory() {
+  ProcessMemory ret{};
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) {
+      ret.rss_kb = std::strtoll(line.c_str() + 6, nullptr, 10);
+    } else if (line.rfind("VmHWM:", 0) == 0) {
+      ret.peak_rss_kb = std::strtoll(line.c_str() + 6, nullptr, 10);
+    }
+  }
+  return ret;
+}
+
+bool reset_peak_rss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (!clear_refs) return false;
+  clear_refs << "5";
+  clear_refs.flush();
+  return clear_refs.good();
+}
+
+#ifdef OPENHD_MEMORY_TRACKING
+namespace {
+constexpr int MAX_N_SUBSYSTEMS = 32;
+constexpr uint32_t HEADER_MAGIC = 0x0BD3E301;
+struct SubsystemSlot {
+  // Written once (under the mutex) before the slot becomes visible
+  char name[32];
+  std::atomic<int64_t> current_bytes{0};
+  std::atomic<int64_t> peak_bytes{0};
+  std::atomic<uint64_t> n_allocations{0};
+};
+// Slot 0 is "other" (everything not in a ScopedSubsystem)
+SubsystemSlot g_subsystems[MAX_N_SUBSYSTEMS];
+std::atomic<int> g_n_subsystems{1};
+std::mutex g_subsystems_mutex;
+thread_local int t_current_subsystem = 0;
+
+// Keeps the returned pointer aligned to __STDCPP_DEFAULT_NEW_ALIGNMENT__
+struct alignas(16) AllocHeader {
+  std::size_t size;
+  uint32_t subsystem;
+  uint32_t magic;
+};
+
+void* tracked_alloc(std::size_t size) {
+  auto* header = (AllocHeader*)std::malloc(sizeof(AllocHeader) + size);
+  if (header == nullptr) return nullptr;
+  const int idx = t_current_subsystem;
+  header->size = size;
+  header->subsystem = idx;
+  header->magic = HEADER_MAGIC;
+  auto& slot = g_subsystems[idx];
+  const int64_t current =
+      slot.current_bytes.fetch_add((int64_t)size, std::memory_order_relaxed) +
+      (int64_t)size;
+  int64_t peak = slot.peak_bytes.load(std::memory_order_relaxed);
+  while (current > peak &&
+         !slot.peak_bytes.compare_exchange_weak(peak, current,
+                                                std::memory_order_relaxed)) {
+  }
+  slot.n_allocations.fetch_add(1, std::memory_order_relaxed);
+  return header + 1;
+}
+
+void tracked_free(void* ptr) {
+  if (ptr == nullptr) return;
+  auto* header = (AllocHeader*)ptr - 1;
+  assert(header->magic == HEADER_MAGIC);
+  g_subsystems[header->subsystem].current_bytes.fetch_sub(
+      (int64_t)header->size, std::memory_order_relaxed);
+  std::free(header);
+}
+
+int get_or_register_subsystem(const std::string& name) {
+  std::lock_guard<std::mutex> lock(g_subsystems_mutex);
+  const int n = g_n_subsystems.load(std::memory_order_relaxed);
+  for (int i = 1; i < n; i++) {
+    if (name == g_subsystems[i].name) return i;
+  }
+  // Out of slots, account to "other"
+  if (n == MAX_N_SUBSYSTEMS) return 0;
+  std::strncpy(g_subsystems[n].name, name.c_str(),
+               sizeof(g_subsystems[n].name) - 1);
+  g_n_subsystems.store(n + 1, std::memory_order_release);
+  return n;
+}
+}  // namespace
+
+bool is_tracking_enabled() { return true; }
+
+std::vector<SubsystemUsage> get_subsystem_usage() {
+  std::vector<SubsystemUsage> ret;
+  const int n = g_n_subsystems.load(std::memory_order_acquire);
+  ret.reserve(n);
+  for (int i = 0; i < n; i++) {
+    const auto& slot = g_subsystems[i];
+    ret.push_back(SubsystemUsage{
+        i == 0 ? "other" : slot.name,
+        slot.current_bytes.load(std::memory_order_relaxed),
+        slot.peak_bytes.load(std::memory_order_relaxed),
+        slot.n_allocations.load(std::memory_order_relaxed)});
+  }
+  std::sort(ret.begin(), ret.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.current_bytes > rhs.current_bytes;
+  });
+  return ret;
+}
+
+ScopedSubsystem::ScopedSubsystem(const std::string& name)
+    : m_previous(t_current_subsystem) {
+  t_current_subsystem = get_or_register_subsystem(name);
+}
+
+ScopedSubsystem::~ScopedSubsystem() { t_current_subsystem = m_previous; }
+#else
+bool is_tracking_enabled() { return false; }
+
+std::vector<SubsystemUsage> get_subsystem_usage() { return {}; }
+
+ScopedSubsystem::ScopedSubsystem(const std::string& /*name*/)
+    : m_previous(0) {}
+
+ScopedSubsystem::~ScopedSubsystem() = default;
+#endif
+
+std::string create_report() {
+  const auto process = get_process_memory();
+  std::stringstream ss;
+  ss << get_budget().to_string() << " rss:" << process.rss_kb
+     << "kB peak:" << process.peak_rss_kb << "kB";
+  for (const auto& usage : get_subsystem_usage()) {
+    ss << "\n  " << usage.name << " current:" << usage.current_bytes / 1024
+       << "kB peak:" << usage.peak_bytes / 1024
+       << "kB n_allocations:" << usage.n_allocations;
+  }
+  return ss.str();
+}
+
+void log_report() { get_console()->info("{}", create_report()); }
+
+std::shared_ptr<BufferPool> BufferPool::create(const int max_n_buffers) {
+  return std::shared_ptr<BufferPool>(new BufferPool(max_n_buffers));
+}
+
+BufferPool::BufferPool(const int max_n_buffers)
+    : m_max_n_buffers(std::max(0, max_n_buffers)) {
+  m_buffers.reserve(m_max_n_buffers);
+}
+
+// Only the pool holds a reference - no other thread can get a new one then.
+static bool is_free(const std::shared_ptr<std::vector<uint8_t>>& buffer) {
+  return buffer.use_count() == 1;
+}
+
+std::shared_ptr<std::vector<uint8_t>> BufferPool::acquire(const uint8_t* data,
+                                                          const int data_len) {
+  std::shared_ptr<std::vector<uint8_t>> buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_buffers.size(); i++) {
+      const size_t idx = (m_next + i) % m_buffers.size();
+      if (is_free(m_buffers[idx])) {
+        // use_count() is a relaxed load - pairs with the release of the last
+        // other reference, such that the writes / reads of its previous user
+        // happen before we overwrite the buffer
+        std::atomic_thread_fence(std::memory_order_acquire);
+        buffer = m_buffers[idx];
+        m_next = idx + 1;
+        m_n_reused++;
+        break;
+      }
+    }
+    if (buffer == nullptr && (int)m_buffers.size() < m_max_n_buffers) {
+      buffer = std::make_shared<std::vector<uint8_t>>();
+      m_buffers.push_back(buffer);
+      m_next = m_buffers.size();
+    }
+  }
+  if (buffer == nullptr) {
+    buffer = std::make_shared<std::vector<uint8_t>>();
+  }
+  buffer->assign(data, data + data_len);
+  return buffer;
+}
+
+int BufferPool::get_n_free_buffers() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return (int)std::count_if(m_buffers.begin(), m_buffers.end(), is_free);
+}
+
+uint64_t BufferPool::get_n_reused() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_n_reused;
+}
+
+}  // namespace openhd::memory
+
+#ifdef OPENHD_MEMORY_TRACKING
+// Replaces the global (non-aligned) operator new / delete. The aligned
+// variants keep using the default implementation (and are not tracked).
+void* operator new(std::size_t size) {
+  void* ret = openhd::memory::tracked_alloc(size);
+  if (ret == nullptr) throw std::bad_alloc();
+  return ret;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return openhd::memory::tracked_alloc(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return openhd::memory::tracked_alloc(size);
+}
+void operator delete(void* ptr) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  openhd::memory::tracked_free(ptr);
+}
+#endif
@@ -0,0 +1,327 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sstream>
+
+#include "openhd_spdlog.h"
+#include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
+
+namespace openhd::metrics {
+
+namespace {
+// Exclusive shards currently owned by a thread. Handing a shard over via the
+// mutex also makes the previous owner's (relaxed) writes visible to the next.
+std::mutex shard_owner_mutex;
+std::array<bool, SHARED_SHARD> shard_owned{};
+
+int acquire_shard() {
+  std::lock_guard<std::mutex> lock(shard_owner_mutex);
+  for (int i = 0; i < SHARED_SHARD; i++) {
+    if (!shard_owned[i]) {
+      shard_owned[i] = true;
+      return i;
+    }
+  }
+  return SHARED_SHARD;
+}
+}  // namespace
+
+ThreadShard::ThreadShard() : index(acquire_shard()) {}
+
+ThreadShard::~ThreadShard() {
+  if (index == SHARED_SHARD) return;
+  std::lock_guard<std::mutex> lock(shard_owner_mutex);
+  shard_owned[index] = false;
+}
+
+uint64_t Counter::get() const {
+  uint64_t ret = 0;
+  for (const auto& shard : m_shards) {
+    ret += shard.value.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+Histogram::Histogram(const std::vector<int64_t>& upper_bounds) {
+  auto bounds = upper_bounds;
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+  m_n_bounds = std::min((int)bounds.size(), MAX_BUCKETS);
+  for (int i = 0; i < m_n_bounds; i++) m_bounds[i] = bounds[i];
+}
+
+Histogram::Snapshot Histogram::get() const {
+  Snapshot ret{};
+  ret.upper_bounds.assign(m_bounds.begin(), m_bounds.begin() + m_n_bounds);
+  ret.bucket_counts.resize(m_n_bounds + 1, 0);
+  for (const auto& shard : m_shards) {
+    for (int i = 0; i <= m_n_bounds; i++) {
+      const auto count = shard.buckets[i].load(std::memory_order_relaxed);
+      ret.bucket_counts[i] += count;
+      ret.count += count;
+    }
+    ret.sum += shard.sum.load(std::memory_order_relaxed);
+  }
+  return ret;
+}
+
+std::vector<int64_t> latency_buckets_us() {
+  return {10,    25,    50,    100,    250,    500,    1000,
+          2500,  5000,  10000, 25000,  50000,  100000, 250000,
+          500000, 1000000};
+}
+
+Registry& Registry::instance() {
+  static Registry instance;
+  return instance;
+}
+
+static std::string labels_to_string(const Labels& labels) {
+  if (labels.empty()) return "";
+  std::stringstream ss;
+  ss << "{";
+  for (std::size_t i = 0; i < labels.size(); i++) {
+    if (i != 0) ss << ",";
+    ss << labels[i].first << "=\"";
+    for (const char c : labels[i].second) {
+      if (c == '"' || c == '\\') ss << '\\';
+      if (c == '\n') {
+        ss << "\\n";
+        continue;
+      }
+      ss << c;
+    }
+    ss << "\"";
+  }
+  ss << "}";
+  return ss.str();
+}
+
+// Adds le="x" to an existing (possibly empty) label string
+static std::string with_le(const std::string& labels, const std::string& le) {
+  if (labels.empty()) return "{le=\"" + le + "\"}";
+  return labels.substr(0, labels.size() - 1) + ",le=\"" + le + "\"}";
+}
+
+Registry::Family& Registry::get_family(const std::string& name,
+                                       const std::string& help,
+                                       Registry::Type type) {
+  auto it = m_families.find(name);
+  if (it == m_families.end()) {
+    it = m_families.emplace(name, Family{type, help, {}, {}, {}}).first;
+  } else if (it->second.type != type) {
+    openhd::log::get_default()->warn("Metric {} registered with another type",
+                                     name);
+  }
+  return it->second;
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help,
+                           const Labels& labels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& family = get_family(name, help, Type::COUNTER);
+  auto& metric = family.counters[labels_to_string(labels)];
+  if (!metric) metric = std::make_unique<Counter>();
+  return *metric;
+}
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help,
+                       const Labels& labels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& family = get_family(name, help, Type::GAUGE);
+  auto& metric = family.gauges[labels_to_string(labels)];
+  if (!metric) metric = std::make_unique<Gauge>();
+  return *metric;
+}
+
+Histogram& Registry::histogram(const std::string& name,
+                               const std::string& help,
+                               const std::vector<int64_t>& upper_bounds,
+                               const Labels& labels) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto& family = get_family(name, help, Type::HISTOGRAM);
+  auto& metric = family.histograms[labels_to_string(labels)];
+  if (!metric) metric = std::make_unique<Histogram>(upper_bounds);
+  return *metric;
+}
+
+std::string Registry::to_prometheus_text() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::stringstream ss;
+  for (const auto& [name, family] : m_families) {
+    ss << "# HELP " << name << " " << family.help << "\n";
+    switch (family.type) {
+      case Type::COUNTER:
+        ss << "# TYPE " << name << " counter\n";
+        for (const auto& [labels, counter] : family.counters) {
+          ss << name << labels << " " << counter->get() << "\n";
+        }
+        break;
+      case Type::GAUGE:
+        ss << "# TYPE " << name << " gauge\n";
+        for (const auto& [labels, gauge] : family.gauges) {
+          ss << name << labels << " " << gauge->get() << "\n";
+        }
+        break;
+      case Type::HISTOGRAM:
+        ss << "# TYPE " << name << " histogram\n";
+        for (const auto& [labels, histogram] : family.histograms) {
+          const auto snapshot = histogram->get();
+          uint64_t cumulative = 0;
+          for (std::size_t i = 0; i < snapshot.bucket_counts.size(); i++) {
+            cumulative += snapshot.bucket_counts[i];
+            const auto le = i < snapshot.upper_bounds.size()
+                                ? std::to_string(snapshot.upper_bounds[i])
+                                : "+Inf";
+            ss << name << "_bucket" << with_le(labels, le) << " " << cumulative
+               << "\n";
+          }
+          ss << name << "_sum" << labels << " " << snapshot.sum << "\n";
+          ss << name << "_count" << labels << " " << snapshot.count << "\n";
+        }
+        break;
+    }
+  }
+  return ss.str();
+}
+
+static std::shared_ptr<spdlog::logger> get_console() {
+  return openhd::log::create_or_get("metrics");
+}
+
+MetricsServer::MetricsServer(int tcp_port, std::string unix_socket_path)
+    : m_tcp_port(tcp_port), m_unix_socket_path(std::move(unix_socket_path)) {
+  if (m_tcp_port != 0) {
+    m_tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(m_tcp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    // Only reachable from this machine
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(m_tcp_port < 0 ? 0 : m_tcp_port);
+    if (bind(m_tcp_fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(m_tcp_fd, 8) < 0) {
+      get_console()->warn("Cannot listen on port {}: {}", m_tcp_port,
+                          strerror(errno));
+      close(m_tcp_fd);
+      m_tcp_fd = -1;
+    } else {
+      socklen_t len = sizeof(addr);
+      getsockname(m_tcp_fd, (sockaddr*)&addr, &len);
+      m_tcp_port = ntohs(addr.sin_port);
+      get_console()->info("Serving metrics on 127.0.0.1:{}", m_tcp_port);
+    }
+  }
+  if (!m_unix_socket_path.empty()) {
+    m_unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, m_unix_socket_path.c_str(),
+                 sizeof(addr.sun_path) - 1);
+    unlink(m_unix_socket_path.c_str());
+    if (bind(m_unix_fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(m_unix_fd, 8) < 0) {
+      get_console()->warn("Cannot listen on {}: {}", m_unix_socket_path,
+                          strerror(errno));
+      close(m_unix_fd);
+      m_unix_fd = -1;
+    } else {
+      get_console()->info("Serving metrics on {}", m_unix_socket_path);
+    }
+  }
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  m_thread = std::make_unique<std::thread>(&MetricsServer::loop, this);
+}
+
+MetricsServer::~MetricsServer() {
+  m_keep_running = false;
+  const uint64_t one = 1;
+  (void)write(m_wakeup_fd, &one, sizeof(one));
+  m_thread->join();
+  if (m_tcp_fd >= 0) close(m_tcp_fd);
+  if (m_unix_fd >= 0) {
+    close(m_unix_fd);
+    unlink(m_unix_socket_path.c_str());
+  }
+  close(m_wakeup_fd);
+}
+
+void MetricsServer::loop() {
+  openhd::thread::set_current_thread(
+      "metrics_server", openhd::thread::ThreadClass::BACKGROUND);
+  while (m_keep_running) {
+    pollfd fds[3] = {{m_wakeup_fd, POLLIN, 0},
+                     {m_tcp_fd, POLLIN, 0},
+                     {m_unix_fd, POLLIN, 0}};
+    if (poll(fds, 3, -1) <= 0) continue;
+    for (int i = 1; i < 3; i++) {
+      if (fds[i].fd < 0 || !(fds[i].revents & POLLIN)) continue;
+      const int client_fd = accept4(fds[i].fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client_fd < 0) continue;
+      handle_client(client_fd);
+      close(client_fd);
+    }
+  }
+}
+
+void MetricsServer::handle_client(int fd) {
+  // Don't let a stuck client block the server
+  timeval timeout{0, 200 * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  // We don't care about the request, but read it such that the client
+  // doesn't get a reset
+  char buff[2048];
+  (void)recv(fd, buff, sizeof(buff), 0);
+  const auto body = Registry::instance().to_prometheus_text();
+  std::stringstream ss;
+  ss << "HTTP/1.0 200 OK\r\n"
+     << "Content-Type: text/plain; version=0.0.4\r\n"
+     << "Content-Length: " << body.size() << "\r\n\r\n"
+     << body;
+  const auto response = ss.str();
+  std::size_t offset = 0;
+  while (offset < response.size()) {
+    const auto ret = send(fd, response.data() + offset,
+                          response.size() - offset, MSG_NOSIGNAL);
+    if (ret <= 0) break;
+    offset += ret;
+  }
+}
+
+}  // namespace openhd::metrics
@@ -26,6 +26,7 @@
 #include <thread>
 
 #include "openhd_platform.h"
+#include "openhd_settings_persistent.h"
 #include "openhd_spdlog.h"
 #include "openhd_util.h"
 #include "openhd_util_async.h"
@@ -45,6 +46,8 @@ static void command_reboot() { OHDUtil::run_command("reboot", {}, true); }
 static void command_shutdown() { OHDUtil::run_command("shutdown", {}, true); }
 
 void openhd::reboot::systemctl_power(bool shutdownOnly) {
+  // Settings writes are debounced - don't lose the latest changes
+  openhd::SettingsWriteBack::instance().flush();
   if (shutdownOnly) {
     // Some Images don't allow soft restarts or reboots when a netork is
     // connected
@@ -71,8 +74,11 @@ void openhd::reboot::systemctl_power(bool shutdownOnly) {
 void openhd::reboot::handle_power_command_async(std::chrono::milliseconds delay,
                                                 bool shutdownOnly) {
   const std::string tag = shutdownOnly ? "SHUTDOWN" : "REBOOT";
-  AsyncHandle::instance().execute_async(tag, [delay, shutdownOnly] {
-    std::this_thread::sleep_for(delay);
-    systemctl_power(shutdownOnly);
-  });
+  AsyncHandle::instance().execute_async(
+      tag,
+      [delay, shutdownOnly] {
+        std::this_thread::sleep_for(delay);
+        systemctl_power(shutdownOnly);
+      },
+      AsyncHandle::Priority::HIGH);
 }
@@ -22,3 +22,196 @@
  ******************************************************************************/
 
 #include "openhd_settings_persistent.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
+
+openhd::SettingsWriteBack::SettingsWriteBack(Options options)
+    : m_options(options) {
+  m_thread = std::make_unique<std::thread>(&SettingsWriteBack::loop, this);
+}
+
+openhd::SettingsWriteBack::~SettingsWriteBack() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keep_running = false;
+  }
+  m_cv.notify_all();
+  m_thread->join();
+  m_thread = nullptr;
+}
+
+openhd::SettingsWriteBack& openhd::SettingsWriteBack::instance() {
+  static SettingsWriteBack instance{Options{}};
+  return instance;
+}
+
+void openhd::SettingsWriteBack::write_async(const std::string& path,
+                                            std::string content) {
+  const auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.n_requests++;
+  auto it = m_pending.find(path);
+  if (it != m_pending.end()) {
+    m_stats.n_coalesced++;
+    it->second.content = std::move(content);
+    it->second.last_request = now;
+  } else {
+    m_pending[path] = Pending{std::move(content), now, now};
+  }
+  m_cv.notify_one();
+}
+
+void openhd::SettingsWriteBack::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  write_pending(lock, false);
+  m_cv_flushed.wait(lock,
+                    [this] { return m_pending.empty() && !m_writing; });
+}
+
+openhd::SettingsWriteBack::Stats openhd::SettingsWriteBack::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void openhd::SettingsWriteBack::loop() {
+  openhd::thread::set_current_thread(
+      "settings_write", openhd::thread::ThreadClass::BACKGROUND);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_keep_running) {
+    if (m_pending.empty()) {
+      m_cv.wait(lock);
+      continue;
+    }
+    auto next_due = std::chrono::steady_clock::time_point::max();
+    for (const auto& [path, pending] : m_pending) {
+      const auto due = std::min(pending.last_request + m_options.debounce,
+                                pending.first_request + m_options.max_delay);
+      next_due = std::min(next_due, due);
+    }
+    if (std::chrono::steady_clock::now() < next_due) {
+      // Returns early on new requests, in which case we re-calculate
+      m_cv.wait_until(lock, next_due);
+      continue;
+    }
+    write_pending(lock, true);
+  }
+}
+
+void openhd::SettingsWriteBack::write_pending(
+    std::unique_lock<std::mutex>& lock, bool only_due) {
+  while (true) {
+    // Writes to the same file must not overtake each other
+    m_cv_flushed.wait(lock, [this] { return !m_writing; });
+    const auto now = std::chrono::steady_clock::now();
+    auto it = m_pending.begin();
+    for (; it != m_pending.end(); ++it) {
+      if (!only_due) break;
+      const auto& pending = it->second;
+      if (now >= pending.last_request + m_options.debounce ||
+          now >= pending.first_request + m_options.max_delay) {
+        break;
+      }
+    }
+    if (it == m_pending.end()) break;
+    const std::string path = it->first;
+    const std::string content = std::move(it->second.content);
+    m_pending.erase(it);
+    const auto it_hash = m_last_written_hash.find(path);
+    std::optional<uint64_t> last_hash = std::nullopt;
+    if (it_hash != m_last_written_hash.end()) last_hash = it_hash->second;
+    m_writing = true;
+    lock.unlock();
+    const uint64_t hash = hash_content(content);
+    if (!last_hash.has_value()) {
+      // First write to this file since openhd started
+      const auto opt_existing = OHDFilesystemUtil::opt_read_file(path, false);
+      if (opt_existing.has_value()) {
+        last_hash = hash_content(opt_existing.value());
+      }
+    }
+    const bool unchanged = last_hash.has_value() && last_hash.value() == hash;
+    const bool success = unchanged || write_file_atomic(path, content);
+    lock.lock();
+    m_writing = false;
+    if (unchanged) {
+      m_stats.n_skipped_unchanged++;
+    } else if (success) {
+      m_stats.n_writes++;
+    } else {
+      m_stats.n_failed++;
+    }
+    if (success) {
+      m_last_written_hash[path] = hash;
+    }
+    m_cv_flushed.notify_all();
+  }
+  m_cv_flushed.notify_all();
+}
+
+bool openhd::SettingsWriteBack::write_file_atomic(const std::string& path,
+                                                  const std::string& content) {
+  const std::string tmp_path = path + ".tmp";
+  const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+  if (fd < 0) {
+    openhd::log::get_default()->warn("Cannot open file [{}] {}", tmp_path,
+                                     strerror(errno));
+    return false;
+  }
+  size_t written = 0;
+  while (written < content.size()) {
+    const ssize_t ret =
+        write(fd, content.data() + written, content.size() - written);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      openhd::log::get_default()->warn("Cannot write file [{}] {}", tmp_path,
+                                       strerror(errno));
+      close(fd);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+    written += ret;
+  }
+  if (fsync(fd) != 0) {
+    openhd::log::get_default()->warn("Cannot fsync file [{}] {}", tmp_path,
+                                     strerror(errno));
+    close(fd);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  close(fd);
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    openhd::log::get_default()->warn("Cannot rename [{}] {}", tmp_path,
+                                     strerror(errno));
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  // Make the rename itself durable
+  const auto last_slash = path.find_last_of('/');
+  const std::string directory =
+      last_slash == std::string::npos ? "." : path.substr(0, last_slash + 1);
+  const int dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return true;
+}
+
+uint64_t openhd::SettingsWriteBack::hash_content(const std::string& content) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : content) {
+    hash ^= (uint8_t)c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
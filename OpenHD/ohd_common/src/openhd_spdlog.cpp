@@ -24,14 +24,14 @@
 #include "openhd_spdlog.h"
 
 #include <spdlog/common.h>
-#include <spdlog/sinks/base_sink.h>
-#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include <cstring>
 #include <iostream>
 #include <mutex>
+#include <unordered_map>
 
-#include "openhd_util.h"
+#include "openhd_spdlog_async.h"
 
 static openhd::log::MavlinkLogMessage safe_create(int level,
                                                   const std::string& message) {
@@ -44,41 +44,6 @@ static openhd::log::MavlinkLogMessage safe_create(int level,
   return lmessage;
 }
 
-// bridge between any logger and telemetry
-// We send logs higher or equal to the warning log level out via udp
-// such that they can be picked up by the telemetry module
-namespace openhd::log::sink {
-
-// Sinks the messages into a buffer
-// For the telemetry thread to fetch
-class MavlinkTelemetrySink : public spdlog::sinks::base_sink<std::mutex> {
- protected:
-  void sink_it_(const spdlog::details::log_msg& msg) override {
-    // log_msg is a struct containing the log entry info like level, timestamp,
-    // thread id etc. msg.raw contains pre formatted log If needed (very likely
-    // but not mandatory), the sink formats the message before sending it to its
-    // final destination:
-    if (msg.level >= spdlog::level::warn) {
-      // We do not use the formatter here, since we are limited by 50 chars (and
-      // the level, for example, is embedded already but not as a string).
-      // spdlog::memory_buf_t formatted;
-      // spdlog::sinks::base_sink<std::mutex>::formatter_->format(msg,
-      // formatted);
-      const auto msg_string = fmt::to_string(msg.payload);
-      const std::string msg_with_tag =
-          fmt::format("{} {}", msg.logger_name, msg_string);
-      const auto level = openhd::log::level_spdlog_to_mavlink(msg.level);
-      auto tmp = safe_create(static_cast<int>(level), msg_with_tag);
-      MavlinkLogMessageBuffer::instance().enqueue_log_message(tmp);
-    }
-  }
-  void flush_() override {
-    // std::cout << std::flush;
-  }
-};
-
-}  // namespace openhd::log::sink
-
 std::vector<openhd::log::MavlinkLogMessage>
 openhd::log::MavlinkLogMessageBuffer::dequeue_log_messages() {
   std::lock_guard<std::mutex> lock(m_mutex);
@@ -104,23 +69,29 @@ openhd::log::MavlinkLogMessageBuffer::instance() {
 
 std::shared_ptr<spdlog::logger> openhd::log::create_or_get(
     const std::string& logger_name) {
+  // Per thread cache, such that repeated lookups (e.g. get_console() helpers)
+  // don't take the global mutex
+  thread_local std::unordered_map<std::string, std::shared_ptr<spdlog::logger>>
+      cache;
+  if (const auto it = cache.find(logger_name); it != cache.end()) {
+    return it->second;
+  }
   static std::mutex logger_mutex2{};
   std::lock_guard<std::mutex> guard(logger_mutex2);
   auto ret = spdlog::get(logger_name);
   if (ret == nullptr) {
-    auto created = spdlog::stdout_color_mt(logger_name);
-    assert(created);
-    created->set_level(spdlog::level::warn);
-    // Add the sink that sends out warning or higher via UDP
-    // created->sinks().push_back(std::make_shared<openhd::log::sink::UdpTelemetrySink>());
-    created->sinks().push_back(
-        std::make_shared<openhd::log::sink::MavlinkTelemetrySink>());
+    // All loggers share the async sink, which writes to the console and
+    // forwards warning or higher via mavlink (see openhd_spdlog_async.h)
+    ret = std::make_shared<spdlog::logger>(
+        logger_name, AsyncLogBackend::instance().get_sink());
+    ret->set_level(spdlog::level::warn);
+    spdlog::register_logger(ret);
     // This is for debugging for "where a fmt exception occurred"
     // spdlog::set_error_handler([](const std::string &msg) {
     //  std::cerr<<msg<<"\n;";
     //});
-    return created;
   }
+  cache.emplace(logger_name, ret);
   return ret;
 }
 
@@ -160,8 +131,7 @@ openhd::log::STATUS_LEVEL openhd::log::level_spdlog_to_mavlink(
 }
 
 void openhd::log::log_to_kernel(const std::string& message) {
-  OHDUtil::run_command(fmt::format("echo \"{}\" > /dev/kmsg", message), {},
-                       false);
+  AsyncLogBackend::instance().log_to_kernel(message);
 }
 
 void openhd::log::debug_log(const std::string& message) {
@@ -0,0 +1,317 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_spdlog_async.h"
+
+#include <fcntl.h>
+#include <spdlog/sinks/sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "openhd_thread_policy.h"
+
+namespace openhd::log {
+
+namespace {
+// Shared by all loggers, forwards into the ring of the backend
+class AsyncSink : public spdlog::sinks::sink {
+ public:
+  explicit AsyncSink(AsyncLogBackend& backend) : m_backend(backend) {}
+  void log(const spdlog::details::log_msg& msg) override {
+    m_backend.log(msg);
+  }
+  void flush() override { m_backend.flush(); }
+  void set_pattern(const std::string& pattern) override {
+    m_backend.set_pattern(pattern);
+  }
+  void set_formatter(
+      std::unique_ptr<spdlog::formatter> /*sink_formatter*/) override {
+    // Not supported, use set_pattern
+  }
+
+ private:
+  AsyncLogBackend& m_backend;
+};
+}  // namespace
+
+uint64_t RateLimiter::create_key(const char* logger_name,
+                                 const size_t logger_name_len,
+                                 const char* message,
+                                 const size_t message_len) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const char c) {
+    hash ^= (uint8_t)c;
+    hash *= 1099511628211ULL;
+  };
+  for (size_t i = 0; i < logger_name_len; i++) add(logger_name[i]);
+  add('\0');
+  for (size_t i = 0; i < message_len; i++) {
+    if (message[i] >= '0' && message[i] <= '9') continue;
+    add(message[i]);
+  }
+  // 0 marks an unused entry
+  return hash == 0 ? 1 : hash;
+}
+
+int64_t RateLimiter::check(const uint64_t key, const int64_t now_ms) {
+  const int max_per_second = m_max_per_second.load(std::memory_order_relaxed);
+  if (max_per_second <= 0) return 0;
+  Entry& entry = m_entries[key % N_ENTRIES];
+  if (entry.key.load(std::memory_order_relaxed) != key) {
+    // New key (or a collision, then the old one starts over)
+    entry.key.store(key, std::memory_order_relaxed);
+    entry.window_begin_ms.store(now_ms, std::memory_order_relaxed);
+    entry.n_in_window.store(1, std::memory_order_relaxed);
+    entry.n_suppressed.store(0, std::memory_order_relaxed);
+    return 0;
+  }
+  if (now_ms - entry.window_begin_ms.load(std::memory_order_relaxed) >=
+      1000) {
+    entry.window_begin_ms.store(now_ms, std::memory_order_relaxed);
+    entry.n_in_window.store(1, std::memory_order_relaxed);
+    return entry.n_suppressed.exchange(0, std::memory_order_relaxed);
+  }
+  if ((int)entry.n_in_window.fetch_add(1, std::memory_order_relaxed) >=
+      max_per_second) {
+    entry.n_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+  }
+  return 0;
+}
+
+void RateLimiter::set_max_per_second(const int max_per_second) {
+  m_max_per_second.store(max_per_second, std::memory_order_relaxed);
+}
+
+AsyncLogBackend& AsyncLogBackend::instance() {
+  static AsyncLogBackend* instance = [] {
+    auto* ret = new AsyncLogBackend();
+    std::atexit([] { AsyncLogBackend::instance().flush(); });
+    return ret;
+  }();
+  return *instance;
+}
+
+AsyncLogBackend::AsyncLogBackend() {
+  m_console = std::make_unique<spdlog::sinks::stdout_color_sink_st>();
+  m_sink = std::make_shared<AsyncSink>(*this);
+  m_writer_thread =
+      std::make_unique<std::thread>(&AsyncLogBackend::loop_write, this);
+}
+
+std::shared_ptr<spdlog::sinks::sink> AsyncLogBackend::get_sink() {
+  return m_sink;
+}
+
+void AsyncLogBackend::log(const spdlog::details::log_msg& msg) {
+  int64_t n_suppressed = 0;
+  if (m_rate_limiter.is_enabled()) {
+    const int64_t now_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            msg.time.time_since_epoch())
+            .count();
+    const uint64_t key = RateLimiter::create_key(
+        msg.logger_name.data(), msg.logger_name.size(), msg.payload.data(),
+        msg.payload.size());
+    n_suppressed = m_rate_limiter.check(key, now_ms);
+    if (n_suppressed < 0) {
+      m_n_suppressed.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  push(msg.time, msg.thread_id, msg.level, false, msg.logger_name.data(),
+       msg.logger_name.size(), msg.payload.data(), msg.payload.size(),
+       (uint32_t)n_suppressed);
+  if (msg.level >= spdlog::level::critical) {
+    flush();
+  }
+}
+
+void AsyncLogBackend::log_to_kernel(const std::string& message) {
+  static constexpr const char* TAG = "kmsg";
+  push(std::chrono::system_clock::now(), 0, spdlog::level::info, true, TAG,
+       std::strlen(TAG), message.data(), message.size(), 0);
+}
+
+bool AsyncLogBackend::push(const std::chrono::system_clock::time_point& time,
+                           const size_t thread_id, const int level,
+                           const bool to_kernel, const char* logger_name,
+                           const size_t logger_name_len, const char* message,
+                           const size_t message_len,
+                           const uint32_t n_suppressed) {
+  const bool pushed = m_ring.try_push([&](Entry& entry) {
+    entry.time = time;
+    entry.thread_id = thread_id;
+    entry.level = level;
+    entry.to_kernel = to_kernel;
+    entry.n_suppressed = n_suppressed;
+    const size_t name_len =
+        std::min(logger_name_len, sizeof(entry.logger_name) - 1);
+    std::memcpy(entry.logger_name, logger_name, name_len);
+    entry.logger_name[name_len] = '\0';
+    if (message_len <= INLINE_MESSAGE_SIZE) {
+      std::memcpy(entry.message, message, message_len);
+      entry.message_len = (uint16_t)message_len;
+      entry.long_message = nullptr;
+    } else {
+      entry.message_len = 0;
+      entry.long_message = new std::string(message, message_len);
+    }
+  });
+  if (!pushed) {
+    m_n_dropped_full.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  // The writer polls anyways, only wake it up (syscall) if it is urgent or
+  // the ring fills up. Not under the mutex (we might miss the writer going to
+  // sleep, in which case it wakes up by the poll timeout).
+  if (level >= spdlog::level::warn || to_kernel ||
+      m_ring.size() >= m_ring.capacity() / 4) {
+    m_wake_cv.notify_one();
+  }
+  return true;
+}
+
+void AsyncLogBackend::loop_write() {
+  openhd::thread::set_current_thread("log_writer",
+                                     openhd::thread::ThreadClass::BACKGROUND);
+  while (true) {
+    bool any = false;
+    {
+      std::lock_guard<std::mutex> lock(m_console_mutex);
+      while (m_ring.try_pop([this](Entry& entry) { write_entry(entry); })) {
+        any = true;
+      }
+      const uint64_t n_dropped =
+          m_n_dropped_full.load(std::memory_order_relaxed);
+      if (n_dropped != m_n_dropped_reported) {
+        const auto message =
+            fmt::format("Dropped {} log messages (writer too slow)",
+                        n_dropped - m_n_dropped_reported);
+        m_console->log(spdlog::details::log_msg("log", spdlog::level::warn,
+                                                message));
+        m_n_dropped_reported = n_dropped;
+      }
+    }
+    if (any) {
+      m_written_cv.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_wake_mutex);
+    m_wake_cv.wait_for(lock, std::chrono::milliseconds(20));
+  }
+}
+
+void AsyncLogBackend::write_entry(Entry& entry) {
+  const std::unique_ptr<std::string> long_message(entry.long_message);
+  entry.long_message = nullptr;
+  spdlog::string_view_t payload =
+      long_message ? spdlog::string_view_t(*long_message)
+                   : spdlog::string_view_t(entry.message, entry.message_len);
+  if (entry.to_kernel) {
+    write_to_kernel(std::string(payload.data(), payload.size()));
+    return;
+  }
+  std::string with_suppressed;
+  if (entry.n_suppressed > 0) {
+    with_suppressed = fmt::format("{} [{} similar suppressed]", payload,
+                                  entry.n_suppressed);
+    payload = with_suppressed;
+  }
+  const auto level = (spdlog::level::level_enum)entry.level;
+  spdlog::details::log_msg msg(entry.time, spdlog::source_loc{},
+                               entry.logger_name, level, payload);
+  msg.thread_id = entry.thread_id;
+  m_console->log(msg);
+  // We send logs higher or equal to the warning log level out via mavlink
+  // (shown in QOpenHD). Not formatted, since we are limited by 50 chars.
+  if (level >= spdlog::level::warn) {
+    log_via_mavlink((int)level_spdlog_to_mavlink(level),
+                    fmt::format("{} {}", entry.logger_name, payload));
+  }
+}
+
+void AsyncLogBackend::write_to_kernel(const std::string& message) {
+  if (m_kmsg_fd < 0 && !m_kmsg_failed) {
+    m_kmsg_fd = open("/dev/kmsg", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (m_kmsg_fd < 0) {
+      m_kmsg_failed = true;
+      m_console->log(spdlog::details::log_msg(
+          "log", spdlog::level::warn,
+          fmt::format("Cannot open /dev/kmsg: {}", strerror(errno))));
+    }
+  }
+  if (m_kmsg_fd < 0) {
+    // At least don't lose the message
+    m_console->log(
+        spdlog::details::log_msg("kmsg", spdlog::level::info, message));
+    return;
+  }
+  // One write() is one record
+  if (write(m_kmsg_fd, message.data(), message.size()) < 0) {
+    m_console->log(
+        spdlog::details::log_msg("kmsg", spdlog::level::info, message));
+  }
+}
+
+void AsyncLogBackend::flush(const std::chrono::milliseconds timeout) {
+  // Would wait for ourselves
+  if (std::this_thread::get_id() == m_writer_thread->get_id()) return;
+  const size_t target = m_ring.get_n_pushed();
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  std::unique_lock<std::mutex> lock(m_wake_mutex);
+  while (m_ring.get_n_popped() < target &&
+         std::chrono::steady_clock::now() < deadline) {
+    m_wake_cv.notify_one();
+    m_written_cv.wait_for(lock, std::chrono::milliseconds(5));
+  }
+  // The messages are popped, but maybe not written yet
+  std::lock_guard<std::mutex> console_lock(m_console_mutex);
+  m_console->flush();
+}
+
+void AsyncLogBackend::set_rate_limit(const int max_per_second) {
+  m_rate_limiter.set_max_per_second(max_per_second);
+}
+
+void AsyncLogBackend::set_pattern(const std::string& pattern) {
+  std::lock_guard<std::mutex> lock(m_console_mutex);
+  m_console->set_pattern(pattern);
+}
+
+AsyncLogBackend::Stats AsyncLogBackend::get_stats() const {
+  Stats ret{};
+  ret.n_dropped_full = m_n_dropped_full.load(std::memory_order_relaxed);
+  ret.n_logged = m_ring.get_n_pushed() + ret.n_dropped_full;
+  ret.n_suppressed = m_n_suppressed.load(std::memory_order_relaxed);
+  ret.n_written = m_ring.get_n_popped();
+  return ret;
+}
+
+}  // namespace openhd::log
@@ -0,0 +1,265 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_startup_orchestrator.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include "include_json.hpp"
+#include "openhd_memory.h"
+#include "openhd_spdlog_include.h"
+#include "openhd_util.h"
+
+openhd::StartupOrchestrator::StartupOrchestrator(std::string tag)
+    : m_tag(std::move(tag)) {
+  m_console = openhd::log::create_or_get(m_tag);
+}
+
+void openhd::StartupOrchestrator::add_step(
+    std::string name, std::vector<std::string> dependencies,
+    std::function<void()> runnable) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_steps.find(name) != m_steps.end()) {
+    throw std::runtime_error("Duplicate startup step " + name);
+  }
+  Step step{};
+  step.runnable = std::move(runnable);
+  step.timing.name = name;
+  step.timing.dependencies = std::move(dependencies);
+  m_steps[name] = std::move(step);
+  m_insertion_order.push_back(name);
+}
+
+void openhd::StartupOrchestrator::validate() const {
+  for (const auto& [name, step] : m_steps) {
+    for (const auto& dependency : step.timing.dependencies) {
+      if (m_steps.find(dependency) == m_steps.end()) {
+        throw std::runtime_error(
+            fmt::format("Step {} depends on unknown {}", name, dependency));
+      }
+    }
+  }
+  // Kahn - if not all steps can be ordered, there is a cycle
+  std::set<std::string> resolved;
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (const auto& [name, step] : m_steps) {
+      if (resolved.count(name)) continue;
+      const auto& deps = step.timing.dependencies;
+      if (std::all_of(deps.begin(), deps.end(), [&resolved](const auto& dep) {
+            return resolved.count(dep) > 0;
+          })) {
+        resolved.insert(name);
+        progress = true;
+      }
+    }
+  }
+  if (resolved.size() != m_steps.size()) {
+    throw std::runtime_error("Startup steps have a dependency cycle");
+  }
+}
+
+void openhd::StartupOrchestrator::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  validate();
+  const auto begin = std::chrono::steady_clock::now();
+  auto elapsed = [begin]() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin);
+  };
+  std::condition_variable cv_step_done;
+  std::vector<std::thread> threads;
+  std::vector<bool> lane_busy;
+  std::set<std::string> started;
+  std::exception_ptr first_exception = nullptr;
+  int n_running = 0;
+  while (true) {
+    bool progress = true;
+    while (progress) {
+      progress = false;
+      for (const auto& name : m_insertion_order) {
+        if (started.count(name)) continue;
+        auto& step = m_steps[name];
+        bool deps_done = true;
+        bool dep_failed = false;
+        for (const auto& dependency : step.timing.dependencies) {
+          const auto& dep = m_steps[dependency];
+          deps_done &= dep.done;
+          dep_failed |= dep.timing.failed || dep.timing.skipped;
+        }
+        if (dep_failed) {
+          m_console->warn("Skipping {}, dependency failed", name);
+          started.insert(name);
+          step.timing.skipped = true;
+          step.timing.begin = step.timing.end = elapsed();
+          step.done = true;
+          progress = true;
+          continue;
+        }
+        if (!deps_done) continue;
+        started.insert(name);
+        auto it_lane = std::find(lane_busy.begin(), lane_busy.end(), false);
+        if (it_lane == lane_busy.end()) {
+          it_lane = lane_busy.insert(lane_busy.end(), false);
+        }
+        *it_lane = true;
+        step.timing.lane = (int)(it_lane - lane_busy.begin());
+        step.timing.begin = elapsed();
+        n_running++;
+        threads.emplace_back([this, &step, &lane_busy, &n_running,
+                              &first_exception, &cv_step_done, &elapsed]() {
+          std::exception_ptr exception = nullptr;
+          try {
+            // Allocations of the step (debug builds) show up in the report
+            openhd::memory::ScopedSubsystem subsystem{step.timing.name};
+            step.runnable();
+          } catch (...) {
+            exception = std::current_exception();
+          }
+          std::lock_guard<std::mutex> lock(m_mutex);
+          step.timing.end = elapsed();
+          step.timing.failed = exception != nullptr;
+          step.done = true;
+          if (exception && !first_exception) first_exception = exception;
+          lane_busy[step.timing.lane] = false;
+          n_running--;
+          cv_step_done.notify_all();
+        });
+      }
+    }
+    // (validated - once nothing is running, everything is done)
+    if (n_running == 0) break;
+    cv_step_done.wait(lock);
+  }
+  lock.unlock();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  lock.lock();
+  m_total_duration = elapsed();
+  if (first_exception) {
+    std::rethrow_exception(first_exception);
+  }
+}
+
+std::vector<openhd::StartupOrchestrator::StepTiming>
+openhd::StartupOrchestrator::get_timings() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<StepTiming> ret;
+  for (const auto& [name, step] : m_steps) {
+    ret.push_back(step.timing);
+  }
+  std::sort(ret.begin(), ret.end(), [](const auto& a, const auto& b) {
+    return a.begin < b.begin;
+  });
+  return ret;
+}
+
+std::vector<std::string> openhd::StartupOrchestrator::get_critical_path()
+    const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::string> ret;
+  const Step* current = nullptr;
+  for (const auto& [name, step] : m_steps) {
+    if (current == nullptr || step.timing.end > current->timing.end) {
+      current = &step;
+    }
+  }
+  while (current != nullptr) {
+    ret.push_back(current->timing.name);
+    // The dependency that finished last held this step back
+    const Step* next = nullptr;
+    for (const auto& dependency : current->timing.dependencies) {
+      const auto& dep = m_steps.at(dependency);
+      if (next == nullptr || dep.timing.end > next->timing.end) {
+        next = &dep;
+      }
+    }
+    current = next;
+  }
+  std::reverse(ret.begin(), ret.end());
+  return ret;
+}
+
+std::chrono::microseconds openhd::StartupOrchestrator::get_total_duration()
+    const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_total_duration;
+}
+
+std::string openhd::StartupOrchestrator::create_chrome_trace_json() const {
+  const auto critical_path = get_critical_path();
+  nlohmann::json events = nlohmann::json::array();
+  for (const auto& timing : get_timings()) {
+    const bool critical =
+        std::find(critical_path.begin(), critical_path.end(), timing.name) !=
+        critical_path.end();
+    nlohmann::json event;
+    event["name"] = timing.name;
+    event["cat"] = critical ? "critical_path" : m_tag;
+    event["ph"] = "X";
+    event["ts"] = timing.begin.count();
+    event["dur"] = (timing.end - timing.begin).count();
+    event["pid"] = 1;
+    event["tid"] = timing.lane;
+    event["args"] = {{"dependencies", timing.dependencies},
+                     {"critical", critical},
+                     {"failed", timing.failed},
+                     {"skipped", timing.skipped}};
+    events.push_back(event);
+  }
+  nlohmann::json trace;
+  trace["traceEvents"] = events;
+  trace["displayTimeUnit"] = "ms";
+  return trace.dump(2);
+}
+
+bool openhd::StartupOrchestrator::write_chrome_trace(
+    const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    m_console->warn("Cannot write trace {}", filename);
+    return false;
+  }
+  file << create_chrome_trace_json();
+  return file.good();
+}
+
+void openhd::StartupOrchestrator::log_summary() const {
+  for (const auto& timing : get_timings()) {
+    m_console->info("{} {}ms..{}ms ({}ms){}", timing.name,
+                    timing.begin.count() / 1000, timing.end.count() / 1000,
+                    (timing.end - timing.begin).count() / 1000,
+                    timing.failed ? " FAILED"
+                                  : (timing.skipped ? " SKIPPED" : ""));
+  }
+  m_console->warn("Startup took {}ms, critical path:{}",
+                  get_total_duration().count() / 1000,
+                  OHDUtil::str_vec_as_string(get_critical_path()));
+}
@@ -26,9 +26,13 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <csignal>
 #include <queue>
 #include <utility>
+#include <vector>
+
+#include "openhd_memory.h"
 
 openhd::TCPServer::TCPServer(const std::string tag,
                              openhd::TCPServer::Config config, bool debug)
@@ -97,6 +101,15 @@ void openhd::TCPServer::loop_accept() {
     }
     const std::string client_ip = inet_ntoa(sockaddr.sin_addr);
     const int client_port = ntohs(sockaddr.sin_port);
+    // Each client has its own thread and rx buffer, limit them by the
+    // memory budget
+    const int n_clients = remove_disconnected_clients();
+    if (n_clients >= openhd::memory::get_budget().tcp_max_clients) {
+      m_console->warn("Rejecting client {}:{}, already {} clients", client_ip,
+                      client_port, n_clients);
+      close(accept_result);
+      continue;
+    }
     m_console->debug("accepted client,sockfd:{}, ip:{}, port:{}", accept_result,
                      client_ip, client_port);
     auto new_client = std::make_shared<ConnectedClient>();
@@ -115,6 +128,33 @@ void openhd::TCPServer::loop_accept() {
   }
 }
 
+int openhd::TCPServer::remove_disconnected_clients() {
+  std::vector<std::shared_ptr<ConnectedClient>> removed;
+  int n_remaining;
+  {
+    std::lock_guard<std::mutex> guard(m_clients_list_mutex);
+    for (auto it = m_clients_list.begin(); it != m_clients_list.end();) {
+      if ((*it)->marked_to_be_removed) {
+        removed.push_back(*it);
+        it = m_clients_list.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    n_remaining = (int)m_clients_list.size();
+  }
+  // Not under the lock, the rx thread might be calling
+  // send_message_to_all_clients()
+  for (auto& client : removed) {
+    client->keep_rx_looping = false;
+    shutdown(client->sock_fd, SHUT_RDWR);
+    client->rx_loop_thread->join();
+    client->rx_loop_thread = nullptr;
+    close(client->sock_fd);
+  }
+  return n_remaining;
+}
+
 void openhd::TCPServer::send_message_to_all_clients(const uint8_t* data,
                                                     int data_len) {
   std::lock_guard<std::mutex> guard(m_clients_list_mutex);
@@ -136,9 +176,10 @@ void openhd::TCPServer::send_message_to_all_clients(const uint8_t* data,
 
 void openhd::TCPServer::ConnectedClient::loop_rx() {
   auto console = openhd::log::create_or_get(fmt::format("TCPClient{}", ip));
-  const auto buff = std::make_unique<std::array<uint8_t, READ_BUFF_SIZE>>();
+  std::vector<uint8_t> buff(std::min(
+      (size_t)openhd::memory::get_budget().tcp_rx_buffer_bytes, READ_BUFF_SIZE));
   while (keep_rx_looping) {
-    const ssize_t message_length = read(sock_fd, buff->data(), buff->size());
+    const ssize_t message_length = read(sock_fd, buff.data(), buff.size());
     if (message_length < 0) {
       console->debug("Read error {} {}", message_length, strerror(errno));
       marked_to_be_removed = true;
@@ -149,7 +190,7 @@ void openhd::TCPServer::ConnectedClient::loop_rx() {
       marked_to_be_removed = true;
       break;
     }
-    parent->on_packet_any_tcp_client(buff->data(), message_length);
+    parent->on_packet_any_tcp_client(buff.data(), message_length);
   }
   parent->on_external_device(ip, port, false);
 }
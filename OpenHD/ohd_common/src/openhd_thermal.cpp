@@ -23,16 +23,229 @@
 
 #include "openhd_thermal.h"
 
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#include "openhd_spdlog.h"
 #include "openhd_util.h"
 #include "openhd_util_filesystem.h"
 
-int openhd::x20_read_rtl8812au_thermal_sensor_degree() {
-  auto temp_file_opt = OHDFilesystemUtil::opt_read_file(
-      "/sys/class/hwmon/hwmon0/temp1_input", false);
-  if (!temp_file_opt.has_value()) {
-    return 0;
+namespace openhd::thermal {
+
+std::string sensor_type_to_string(SensorType type) {
+  switch (type) {
+    case SensorType::SOC:
+      return "SOC";
+    case SensorType::WIFI_CARD:
+      return "WIFI_CARD";
+    case SensorType::OTHER:
+      break;
+  }
+  return "OTHER";
+}
+
+static std::string trim_lowercase(const std::string& value) {
+  std::string ret;
+  for (const char c : value) {
+    if (std::isspace(static_cast<unsigned char>(c))) continue;
+    ret.push_back(
+        static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+  }
+  return ret;
+}
+
+static bool starts_with_any(const std::string& value,
+                            const std::vector<std::string>& prefixes) {
+  return std::any_of(prefixes.begin(), prefixes.end(),
+                     [&value](const std::string& prefix) {
+                       return value.rfind(prefix, 0) == 0;
+                     });
+}
+
+static bool contains_any(const std::string& value,
+                         const std::vector<std::string>& needles) {
+  return std::any_of(needles.begin(), needles.end(),
+                     [&value](const std::string& needle) {
+                       return value.find(needle) != std::string::npos;
+                     });
+}
+
+// By thermal zone type / hwmon name
+static SensorType classify(const std::string& name) {
+  if (starts_with_any(name, {"rtl", "rtw", "88x2", "8812", "mt7", "ath",
+                             "iwlwifi", "brcmf", "phy"})) {
+    return SensorType::WIFI_CARD;
+  }
+  if (contains_any(name, {"cpu", "soc", "x86_pkg_temp", "coretemp", "k10temp",
+                          "zenpower", "acpitz", "bigcore", "littlecore",
+                          "center", "gpu", "npu"})) {
+    return SensorType::SOC;
+  }
+  return SensorType::OTHER;
+}
+
+static std::vector<std::string> sorted_entries_with_prefix(
+    const std::string& directory, const std::string& prefix) {
+  std::vector<std::string> ret;
+  for (const auto& entry :
+       OHDFilesystemUtil::getAllEntriesFilenameOnlyInDirectory(directory)) {
+    if (entry.rfind(prefix, 0) == 0) ret.push_back(entry);
   }
-  auto temp = OHDUtil::string_to_int(temp_file_opt.value());
-  if (!temp.has_value()) return 0;
-  return temp.value() / 1000;
+  std::sort(ret.begin(), ret.end());
+  return ret;
 }
+
+std::vector<Sensor> discover_sensors(const std::string& sysfs_class_path) {
+  std::vector<Sensor> ret;
+  const auto thermal_dir = sysfs_class_path + "/thermal";
+  for (const auto& zone :
+       sorted_entries_with_prefix(thermal_dir, "thermal_zone")) {
+    const auto zone_dir = thermal_dir + "/" + zone;
+    const auto temp_path = zone_dir + "/temp";
+    if (!OHDFilesystemUtil::exists(temp_path)) continue;
+    const auto type =
+        trim_lowercase(OHDFilesystemUtil::read_file(zone_dir + "/type"));
+    ret.push_back(Sensor{zone + ":" + type, temp_path, classify(type)});
+  }
+  const auto hwmon_dir = sysfs_class_path + "/hwmon";
+  for (const auto& hwmon : sorted_entries_with_prefix(hwmon_dir, "hwmon")) {
+    const auto dir = hwmon_dir + "/" + hwmon;
+    std::string temp_path = dir + "/temp1_input";
+    if (!OHDFilesystemUtil::exists(temp_path)) {
+      const auto inputs = sorted_entries_with_prefix(dir, "temp");
+      const auto input = std::find_if(
+          inputs.begin(), inputs.end(), [](const std::string& entry) {
+            return entry.size() > 6 &&
+                   entry.compare(entry.size() - 6, 6, "_input") == 0;
+          });
+      if (input == inputs.end()) continue;
+      temp_path = dir + "/" + *input;
+    }
+    const auto name =
+        trim_lowercase(OHDFilesystemUtil::read_file(dir + "/name"));
+    // hwmon of a wireless device, no matter how the driver calls it
+    const bool is_wifi = OHDFilesystemUtil::exists(dir + "/device/ieee80211") ||
+                         OHDFilesystemUtil::exists(dir + "/device/net");
+    ret.push_back(Sensor{hwmon + ":" + name, temp_path,
+                         is_wifi ? SensorType::WIFI_CARD : classify(name)});
+  }
+  return ret;
+}
+
+std::string sensors_to_string(const std::vector<Sensor>& sensors) {
+  std::stringstream ss;
+  ss << "{";
+  for (const auto& sensor : sensors) {
+    ss << sensor.name << "(" << sensor_type_to_string(sensor.type) << "),";
+  }
+  ss << "}";
+  return ss.str();
+}
+
+std::optional<int> read_temperature_millidegree(const Sensor& sensor) {
+  const auto content =
+      OHDFilesystemUtil::opt_read_file(sensor.temp_path, false);
+  if (!content.has_value()) return std::nullopt;
+  return OHDUtil::string_to_int(content.value());
+}
+
+std::vector<SensorReading> read_sensors(const std::vector<Sensor>& sensors) {
+  std::vector<SensorReading> ret;
+  for (const auto& sensor : sensors) {
+    const auto temp = read_temperature_millidegree(sensor);
+    // Some drivers report 0 / garbage when the sensor is not ready
+    if (!temp.has_value() || temp.value() <= 0 || temp.value() > 200 * 1000) {
+      continue;
+    }
+    ret.push_back(SensorReading{sensor.name, sensor.type, temp.value()});
+  }
+  return ret;
+}
+
+std::string governor_state_to_string(const GovernorState& state) {
+  return fmt::format(
+      "hottest:{}C({}) throttle soc:{:.2f} card:{:.2f} tx_power:{:.2f} "
+      "bitrate:{:.2f}{}",
+      state.hottest_temp_c, state.hottest_sensor, state.throttle_soc,
+      state.throttle_wifi_card, state.tx_power_factor, state.bitrate_factor,
+      state.video_disabled ? " VIDEO DISABLED" : "");
+}
+
+Governor::Governor(GovernorConfig config) : m_config(config) {}
+
+double Governor::update_smoothed(const std::string& name, double temperature) {
+  for (auto& smoothed : m_smoothed) {
+    if (smoothed.first == name) {
+      smoothed.second += m_config.temperature_smoothing *
+                         (temperature - smoothed.second);
+      return smoothed.second;
+    }
+  }
+  m_smoothed.emplace_back(name, temperature);
+  return temperature;
+}
+
+double Governor::update_throttle(double curr, double target) const {
+  if (target >= curr) return target;
+  return std::max(target, curr - m_config.max_throttle_decrease_per_update);
+}
+
+GovernorState Governor::update(const std::vector<SensorReading>& readings) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const double band = std::max(1, m_config.proportional_band_c);
+  double target_soc = 0;
+  double target_wifi_card = 0;
+  double max_margin = -1000;
+  bool any_critical = false;
+  bool all_cooled_down = true;
+  for (const auto& reading : readings) {
+    const double temperature =
+        update_smoothed(reading.name, reading.temperature_millidegree / 1000.0);
+    if (reading.type == SensorType::OTHER) continue;
+    const bool is_soc = reading.type == SensorType::SOC;
+    const double setpoint =
+        is_soc ? m_config.setpoint_soc_c : m_config.setpoint_wifi_card_c;
+    const double throttle =
+        std::clamp((temperature - (setpoint - band)) / band, 0.0, 1.0);
+    if (is_soc) {
+      target_soc = std::max(target_soc, throttle);
+    } else {
+      target_wifi_card = std::max(target_wifi_card, throttle);
+    }
+    if (temperature - setpoint > max_margin) {
+      max_margin = temperature - setpoint;
+      m_state.hottest_temp_c = static_cast<int>(temperature + 0.5);
+      m_state.hottest_sensor = reading.name;
+    }
+    if (temperature >= setpoint + m_config.critical_offset_c) {
+      any_critical = true;
+    }
+    if (temperature >= setpoint - band) {
+      all_cooled_down = false;
+    }
+  }
+  m_state.throttle_soc = update_throttle(m_state.throttle_soc, target_soc);
+  m_state.throttle_wifi_card =
+      update_throttle(m_state.throttle_wifi_card, target_wifi_card);
+  if (any_critical) {
+    m_state.video_disabled = true;
+  } else if (m_state.video_disabled && all_cooled_down) {
+    m_state.video_disabled = false;
+  }
+  // Less tx power only helps the card, less bitrate (less air time and less
+  // encoding work) both
+  m_state.tx_power_factor =
+      1.0 - m_state.throttle_wifi_card * (1.0 - m_config.min_tx_power_factor);
+  m_state.bitrate_factor =
+      1.0 - std::max(m_state.throttle_soc, m_state.throttle_wifi_card) *
+                (1.0 - m_config.min_bitrate_factor);
+  return m_state;
+}
+
+GovernorState Governor::get_state() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_state;
+}
+
+}  // namespace openhd::thermal
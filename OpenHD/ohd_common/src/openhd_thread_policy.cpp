@@ -0,0 +1,275 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "openhd_thread_policy.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#include "openhd_config.h"
+#include "openhd_spdlog.h"
+#include "openhd_spdlog_include.h"
+#include "openhd_util_filesystem.h"
+
+namespace openhd::thread {
+
+static std::shared_ptr<spdlog::logger> get_console() {
+  return openhd::log::create_or_get("thread_policy");
+}
+
+std::string thread_class_to_string(ThreadClass thread_class) {
+  switch (thread_class) {
+    case ThreadClass::REALTIME_VIDEO_TX:
+      return "REALTIME_VIDEO_TX";
+    case ThreadClass::REALTIME_RC:
+      return "REALTIME_RC";
+    case ThreadClass::NORMAL:
+      return "NORMAL";
+    case ThreadClass::BACKGROUND:
+      return "BACKGROUND";
+  }
+  return "UNKNOWN";
+}
+
+static std::string cpus_to_string(const std::vector<int>& cpus) {
+  if (cpus.empty()) return "all";
+  std::stringstream ss;
+  for (std::size_t i = 0; i < cpus.size(); i++) {
+    if (i != 0) ss << ",";
+    ss << cpus[i];
+  }
+  return ss.str();
+}
+
+std::string Policy::to_string() const {
+  std::stringstream ss;
+  ss << "ThreadPolicy{enable:" << (enable ? "Y" : "N")
+     << " mlockall:" << (lock_memory ? "Y" : "N");
+  for (const auto& [thread_class, policy] : classes) {
+    ss << " " << thread_class_to_string(thread_class) << ":{";
+    if (policy.rt_priority > 0) {
+      ss << "fifo:" << policy.rt_priority;
+    } else {
+      ss << "nice:" << policy.nice;
+    }
+    ss << " cpus:" << cpus_to_string(policy.cpus) << "}";
+  }
+  ss << "}";
+  return ss.str();
+}
+
+Policy create_policy_for_platform(const int n_cpus, const int64_t ram_bytes) {
+  const auto config = openhd::load_config();
+  Policy ret{};
+  ret.enable = config.GEN_THREAD_POLICY_ENABLE;
+  if (config.GEN_THREAD_MLOCKALL < 0) {
+    // Auto - on the 512MB boards (e.g. pi zero 2) gstreamer & co already use
+    // a lot of memory, locking everything might get us oom killed.
+    ret.lock_memory = ram_bytes >= 1024LL * 1024 * 1024;
+  } else {
+    ret.lock_memory = config.GEN_THREAD_MLOCKALL > 0;
+  }
+  ClassPolicy video{config.GEN_THREAD_RT_PRIORITY_VIDEO, -10, {}};
+  ClassPolicy rc{config.GEN_THREAD_RT_PRIORITY_RC, -10, {}};
+  ClassPolicy normal{0, 0, {}};
+  ClassPolicy background{0, 10, {}};
+  if (n_cpus >= 4) {
+    // Most IRQs (and on the pi, the usb / wifi ones) are handled by cpu0 -
+    // keep the latency critical threads away from it and move the
+    // housekeeping there instead. Normal threads can use all cpus.
+    for (int i = 1; i < n_cpus; i++) {
+      video.cpus.push_back(i);
+      rc.cpus.push_back(i);
+    }
+    background.cpus.push_back(0);
+  }
+  ret.classes[ThreadClass::REALTIME_VIDEO_TX] = video;
+  ret.classes[ThreadClass::REALTIME_RC] = rc;
+  ret.classes[ThreadClass::NORMAL] = normal;
+  ret.classes[ThreadClass::BACKGROUND] = background;
+  return ret;
+}
+
+const Policy& get_policy() {
+  static const Policy policy = [] {
+    const int n_cpus =
+        std::max(1, (int)std::thread::hardware_concurrency());
+    const int64_t ram_bytes =
+        (int64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    auto ret = create_policy_for_platform(n_cpus, ram_bytes);
+    get_console()->debug("{}", ret.to_string());
+    return ret;
+  }();
+  return policy;
+}
+
+// Don't spam the log if we cannot set the scheduling for all threads
+static void warn_once(const std::string& what) {
+  static std::atomic<bool> warned = false;
+  if (!warned.exchange(true)) {
+    get_console()->warn("{} (further errors not logged)", what);
+  }
+}
+
+void set_current_thread(const std::string& name, ThreadClass thread_class) {
+  set_current_thread(name, thread_class, get_policy());
+}
+
+void set_current_thread(const std::string& name, ThreadClass thread_class,
+                        const Policy& policy) {
+  // Max 16 bytes including the null terminator
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+  if (!policy.enable) return;
+  const auto it = policy.classes.find(thread_class);
+  if (it == policy.classes.end()) return;
+  const auto& class_policy = it->second;
+  const pid_t tid = (pid_t)syscall(SYS_gettid);
+  if (!class_policy.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : class_policy.cpus) CPU_SET(cpu, &set);
+    const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+      warn_once(fmt::format("Cannot set affinity of {}: {}", name,
+                            strerror(ret)));
+    }
+  }
+  if (class_policy.rt_priority > 0) {
+    sched_param param{};
+    param.sched_priority = class_policy.rt_priority;
+    const int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret == 0) return;
+    warn_once(fmt::format("Cannot set SCHED_FIFO {} for {}: {}",
+                          class_policy.rt_priority, name, strerror(ret)));
+    // Fall back to nice
+  }
+  // On linux, the nice value is per thread
+  if (setpriority(PRIO_PROCESS, tid, class_policy.nice) != 0) {
+    warn_once(fmt::format("Cannot set nice {} for {}: {}", class_policy.nice,
+                          name, strerror(errno)));
+  }
+}
+
+void lock_memory_if_enabled() {
+  const auto& policy = get_policy();
+  if (!policy.enable || !policy.lock_memory) return;
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    get_console()->warn("mlockall failed: {}", strerror(errno));
+  } else {
+    get_console()->debug("mlockall success");
+  }
+}
+
+static std::vector<pid_t> get_task_ids() {
+  std::vector<pid_t> ret;
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) return ret;
+  while (auto* entry = readdir(dir)) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+    ret.push_back(std::atoi(entry->d_name));
+  }
+  closedir(dir);
+  return ret;
+}
+
+// utime + stime (in clock ticks) and name of the given thread
+static std::optional<std::pair<uint64_t, std::string>> read_task_stat(
+    pid_t tid) {
+  const auto stat = OHDFilesystemUtil::opt_read_file(
+      "/proc/self/task/" + std::to_string(tid) + "/stat", false);
+  if (!stat.has_value()) return std::nullopt;
+  // The name (comm) is in braces and might contain spaces
+  const auto name_begin = stat->find('(');
+  const auto name_end = stat->rfind(')');
+  if (name_begin == std::string::npos || name_end == std::string::npos) {
+    return std::nullopt;
+  }
+  std::stringstream ss(stat->substr(name_end + 2));
+  // Fields 3..13 (state .. cmajflt), then utime (14) and stime (15)
+  std::string skip;
+  for (int i = 3; i <= 13; i++) ss >> skip;
+  uint64_t utime = 0, stime = 0;
+  ss >> utime >> stime;
+  if (ss.fail()) return std::nullopt;
+  return std::make_pair(
+      utime + stime, stat->substr(name_begin + 1, name_end - name_begin - 1));
+}
+
+std::vector<ThreadCpuUsage> ThreadCpuMonitor::sample() {
+  const int64_t now_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+  const int64_t elapsed_us = now_us - m_last_sample_us;
+  const bool has_reference = m_last_sample_us != 0;
+  m_last_sample_us = now_us;
+  static const long ticks_per_second = sysconf(_SC_CLK_TCK);
+  std::vector<ThreadCpuUsage> ret;
+  std::map<pid_t, uint64_t> ticks;
+  for (const auto tid : get_task_ids()) {
+    const auto stat = read_task_stat(tid);
+    if (!stat.has_value()) continue;  // Thread exited in the meantime
+    ticks[tid] = stat->first;
+    float cpu_perc = 0;
+    const auto last = m_last_ticks.find(tid);
+    if (has_reference && elapsed_us > 0 && last != m_last_ticks.end()) {
+      const double used_us = (double)(stat->first - last->second) * 1000.0 *
+                             1000.0 / ticks_per_second;
+      cpu_perc = (float)(used_us * 100.0 / elapsed_us);
+    }
+    ret.push_back(ThreadCpuUsage{tid, stat->second, cpu_perc});
+  }
+  m_last_ticks = std::move(ticks);
+  std::sort(ret.begin(), ret.end(), [](const auto& a, const auto& b) {
+    return a.cpu_perc > b.cpu_perc;
+  });
+  return ret;
+}
+
+std::string ThreadCpuMonitor::to_string(
+    const std::vector<ThreadCpuUsage>& usage, int max_n_threads) {
+  std::stringstream ss;
+  ss << "ThreadCpu{";
+  for (int i = 0; i < (int)usage.size() && i < max_n_threads; i++) {
+    if (i != 0) ss << ", ";
+    ss << usage[i].name << "(" << usage[i].tid << "):" << (int)usage[i].cpu_perc
+       << "%";
+  }
+  ss << "}";
+  return ss.str();
+}
+
+}  // namespace openhd::thread
@@ -27,13 +27,18 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <sstream>
+#include <vector>
 
+#include "openhd_memory.h"
 #include "openhd_spdlog.h"
+#include "openhd_thread_policy.h"
 
-static std::shared_ptr<spdlog::logger> get_console() {
-  return openhd::log::create_or_get("UDP");
+static const std::shared_ptr<spdlog::logger>& get_console() {
+  static const auto console = openhd::log::create_or_get("UDP");
+  return console;
 }
 
 openhd::UDPForwarder::UDPForwarder(std::string client_addr1,
@@ -70,6 +75,37 @@ void openhd::UDPForwarder::forwardPacketViaUDP(
   }
 }
 
+void openhd::UDPForwarder::forwardPacketsViaUDP(
+    const std::vector<std::shared_ptr<std::vector<uint8_t>>> &packets) const {
+  static constexpr int MAX_BATCH_SIZE = 64;
+  std::array<mmsghdr, MAX_BATCH_SIZE> msgs{};
+  std::array<iovec, MAX_BATCH_SIZE> iovecs{};
+  std::size_t offset = 0;
+  while (offset < packets.size()) {
+    const int n = (int)std::min(packets.size() - offset,
+                                (std::size_t)MAX_BATCH_SIZE);
+    for (int i = 0; i < n; i++) {
+      const auto &packet = *packets[offset + i];
+      iovecs[i].iov_base = (void *)packet.data();
+      iovecs[i].iov_len = packet.size();
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_name = (void *)&saddr;
+      msgs[i].msg_hdr.msg_namelen = sizeof(saddr);
+      msgs[i].msg_hdr.msg_iov = &iovecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    const int ret = sendmmsg(sockfd, msgs.data(), n, 0);
+    if (ret <= 0) {
+      // Don't get stuck on the failing packet
+      get_console()->warn("Error sending {} packets to {}:{} code:{} {}", n,
+                          client_addr, client_udp_port, ret, strerror(errno));
+      offset++;
+    } else {
+      offset += ret;
+    }
+  }
+}
+
 void openhd::UDPMultiForwarder::addForwarder(const std::string &client_addr,
                                              int client_udp_port) {
   std::lock_guard<std::mutex> guard(udpForwardersLock);
@@ -123,18 +159,27 @@ openhd::UDPReceiver::UDPReceiver(std::string client_addr, int client_udp_port,
 openhd::UDPReceiver::~UDPReceiver() { stopBackground(); }
 
 void openhd::UDPReceiver::loopUntilError() {
-  const auto buff =
-      std::make_unique<std::array<uint8_t, UDP_PACKET_MAX_SIZE>>();
+  openhd::thread::set_current_thread(
+      "udp_rx", openhd::thread::ThreadClass::NORMAL);
+  // Sized by the memory budget, UDP_PACKET_MAX_SIZE on desktop ground
+  // stations but much smaller on 512MB boards
+  std::vector<uint8_t> buff(
+      std::min((size_t)openhd::memory::get_budget().udp_rx_buffer_bytes,
+               UDP_PACKET_MAX_SIZE));
   // sockaddr_in source;
   // socklen_t sourceLen= sizeof(sockaddr_in);
   while (receiving) {
     // const ssize_t message_length =
     // recvfrom(mSocket,buff->data(),UDP_PACKET_MAX_SIZE,
     // MSG_WAITALL,(sockaddr*)&source,&sourceLen);
+    // MSG_TRUNC: returns the real size of the datagram, even if it didn't fit
     const ssize_t message_length =
-        recv(mSocket, buff->data(), buff->size(), MSG_WAITALL);
-    if (message_length > 0) {
-      mCb(buff->data(), (size_t)message_length);
+        recv(mSocket, buff.data(), buff.size(), MSG_WAITALL | MSG_TRUNC);
+    if (message_length > (ssize_t)buff.size()) {
+      get_console()->warn("Dropping packet of size {}, buffer size is {}",
+                          message_length, buff.size());
+    } else if (message_length > 0) {
+      mCb(buff.data(), (size_t)message_length);
     } else {
       // this can also come from the shutdown, in which case it is not an error.
       // But this way we break out of the loop.
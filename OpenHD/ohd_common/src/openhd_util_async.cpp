@@ -26,25 +26,36 @@
 #include <utility>
 
 #include "openhd_spdlog.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 
-openhd::AsyncHandle::AsyncHandle() {
-  m_watchdog_run = true;
+openhd::AsyncHandle::AsyncHandle(int n_workers) {
+  m_keep_running = true;
+  m_running.resize(n_workers);
+  for (int i = 0; i < n_workers; i++) {
+    m_workers.push_back(
+        std::make_unique<std::thread>(&AsyncHandle::loop_worker, this, i));
+  }
   m_watchdog_thread =
       std::make_unique<std::thread>(&AsyncHandle::check_watchdog, this);
 }
 
 openhd::AsyncHandle::~AsyncHandle() {
-  m_watchdog_run = false;
-  m_watchdog_thread->join();
-  for (auto& task : m_tasks) {
-    if (!task->done) {
-      openhd::log::get_default()->warn("{} probably dead", task->tag);
-    }
-    if (task->worker_thread->joinable()) {
-      task->worker_thread->join();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keep_running = false;
+    for (const auto& running : m_running) {
+      if (running.has_value()) {
+        openhd::log::get_default()->warn("{} probably dead", running->tag);
+      }
     }
   }
+  m_cv_task.notify_all();
+  // Workers finish all queued tasks before they exit
+  for (auto& worker : m_workers) {
+    worker->join();
+  }
+  m_watchdog_thread->join();
 }
 
 openhd::AsyncHandle& openhd::AsyncHandle::instance() {
@@ -52,27 +63,37 @@ openhd::AsyncHandle& openhd::AsyncHandle::instance() {
   return instance;
 }
 
-void openhd::AsyncHandle::execute_async(const std::string tag,
-                                        std::function<void()> runnable) {
-  auto task = std::make_shared<openhd::AsyncHandle::RunningTask>();
-  task->tag = tag;
-  task->runnable = std::move(runnable);
-  task->done = false;
-  task->worker_thread = std::make_shared<std::thread>([task]() {
-    auto console = openhd::log::get_default();
-    console->debug("{} begin", task->tag);
-    try {
-      task->runnable();
-    } catch (std::exception& ex) {
-      console->warn("Exception on {},{}", task->tag, ex.what());
-    } catch (...) {
-      console->warn("Unknown Exception on {}", task->tag);
-    }
-    console->debug("{} done", task->tag);
-    task->done = true;
-  });
-  std::lock_guard<std::mutex> lock(m_threads_mutex);
-  m_tasks.push_back(task);
+std::shared_ptr<openhd::CancellationToken> openhd::AsyncHandle::execute_async(
+    std::string tag, std::function<void()> runnable, Priority priority,
+    std::chrono::milliseconds deadline) {
+  return execute_async_cancellable(
+      std::move(tag),
+      [runnable = std::move(runnable)](const CancellationToken&) {
+        runnable();
+      },
+      priority, deadline);
+}
+
+std::shared_ptr<openhd::CancellationToken>
+openhd::AsyncHandle::execute_async_cancellable(
+    std::string tag, std::function<void(const CancellationToken&)> runnable,
+    Priority priority, std::chrono::milliseconds deadline) {
+  const auto now = std::chrono::steady_clock::now();
+  Task task;
+  task.tag = std::move(tag);
+  task.runnable = std::move(runnable);
+  task.token = std::make_shared<CancellationToken>();
+  task.enqueue_time = now;
+  task.deadline = deadline == NO_DEADLINE
+                      ? std::chrono::steady_clock::time_point::max()
+                      : now + deadline;
+  auto token = task.token;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queues[static_cast<int>(priority)].push_back(std::move(task));
+  }
+  m_cv_task.notify_one();
+  return token;
 }
 
 void openhd::AsyncHandle::execute_command_async(std::string tag,
@@ -81,44 +102,165 @@ void openhd::AsyncHandle::execute_command_async(std::string tag,
   execute_async(std::move(tag), runnable);
 }
 
-bool openhd::AsyncHandle::terminate_when_done(
-    const openhd::AsyncHandle::RunningTask& task) {
-  if (!task.done) return false;
-  if (task.worker_thread->joinable()) {
-    task.worker_thread->join();
+bool openhd::AsyncHandle::pop_next_task(openhd::AsyncHandle::Task& task) {
+  const auto now = std::chrono::steady_clock::now();
+  bool removed_any = false;
+  bool found = false;
+  for (auto& queue : m_queues) {
+    for (auto it = queue.begin(); it != queue.end();) {
+      if (it->token->is_cancelled()) {
+        m_stats[it->tag].n_cancelled++;
+        it = queue.erase(it);
+        removed_any = true;
+        continue;
+      }
+      if (now > it->deadline) {
+        openhd::log::get_default()->warn("Async Task [{}] expired", it->tag);
+        m_stats[it->tag].n_expired++;
+        it = queue.erase(it);
+        removed_any = true;
+        continue;
+      }
+      if (m_running_tags.count(it->tag) == 0) {
+        task = std::move(*it);
+        queue.erase(it);
+        found = true;
+        break;
+      }
+      ++it;
+    }
+    if (found) break;
+  }
+  if (removed_any) m_cv_done.notify_all();
+  return found;
+}
+
+void openhd::AsyncHandle::loop_worker(const int worker_idx) {
+  openhd::thread::set_current_thread(
+      "async_worker", openhd::thread::ThreadClass::BACKGROUND);
+  auto console = openhd::log::get_default();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    Task task;
+    bool has_task = false;
+    m_cv_task.wait(lock, [this, &task, &has_task] {
+      has_task = pop_next_task(task);
+      return has_task ||
+             (!m_keep_running && get_n_current_tasks_locked() == 0);
+    });
+    if (!has_task) return;
+    const auto start_time = std::chrono::steady_clock::now();
+    m_running[worker_idx] = RunningTask{task.tag, start_time, start_time};
+    m_running_tags.insert(task.tag);
+    lock.unlock();
+    console->debug("{} begin", task.tag);
+    bool exception = false;
+    try {
+      task.runnable(*task.token);
+    } catch (std::exception& ex) {
+      console->warn("Exception on {},{}", task.tag, ex.what());
+      exception = true;
+    } catch (...) {
+      console->warn("Unknown Exception on {}", task.tag);
+      exception = true;
+    }
+    console->debug("{} done", task.tag);
+    const auto end_time = std::chrono::steady_clock::now();
+    lock.lock();
+    const auto queue_latency =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            start_time - task.enqueue_time);
+    const auto run_time = std::chrono::duration_cast<std::chrono::microseconds>(
+        end_time - start_time);
+    auto& stats = m_stats[task.tag];
+    stats.n_executed++;
+    if (exception) stats.n_exceptions++;
+    stats.queue_latency_total += queue_latency;
+    stats.queue_latency_max = std::max(stats.queue_latency_max, queue_latency);
+    stats.run_time_total += run_time;
+    stats.run_time_max = std::max(stats.run_time_max, run_time);
+    m_running[worker_idx] = std::nullopt;
+    m_running_tags.erase(task.tag);
+    // Tasks with the same tag might be waiting for this one
+    m_cv_task.notify_all();
+    m_cv_done.notify_all();
   }
-  return true;
 }
 
 void openhd::AsyncHandle::check_watchdog() {
-  while (m_watchdog_run) {
-    {  // Let the mutex go out of scope before sleeping
-      std::lock_guard<std::mutex> lock(m_threads_mutex);
-      m_tasks.erase(std::remove_if(m_tasks.begin(), m_tasks.end(),
-                                   [](std::shared_ptr<RunningTask>& task) {
-                                     // returns true if task is done
-                                     return terminate_when_done(*task);
-                                   }),
-                    m_tasks.end());
-      for (auto& task : m_tasks) {
-        const auto elapsed_task =
-            std::chrono::steady_clock::now() - task->start_time;
-        if (elapsed_task > std::chrono::seconds(10)) {
-          // Log a warning message every 3 seconds on a (presumably) hanging
-          // task
-          if (std::chrono::steady_clock::now() - task->last_watchdog_error_log >
-              std::chrono::seconds(3)) {
-            openhd::log::get_default()->warn("Async Task [{}] hanging ?",
-                                             task->tag);
-          }
+  openhd::thread::set_current_thread(
+      "async_watchdog", openhd::thread::ThreadClass::BACKGROUND);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_keep_running) {
+    int n_busy = 0;
+    const auto now = std::chrono::steady_clock::now();
+    for (auto& running : m_running) {
+      if (!running.has_value()) continue;
+      n_busy++;
+      const auto elapsed_task = now - running->start_time;
+      if (elapsed_task > std::chrono::seconds(10)) {
+        // Log a warning message every 3 seconds on a (presumably) hanging
+        // task
+        if (now - running->last_watchdog_error_log > std::chrono::seconds(3)) {
+          openhd::log::get_default()->warn("Async Task [{}] hanging ?",
+                                           running->tag);
+          running->last_watchdog_error_log = now;
         }
       }
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const int n_queued = get_n_current_tasks_locked() - n_busy;
+    if (n_busy == (int)m_running.size() && n_queued > 0) {
+      openhd::log::get_default()->debug("All async workers busy, {} queued",
+                                        n_queued);
+    }
+    m_cv_task.wait_for(lock, std::chrono::seconds(1),
+                       [this] { return !m_keep_running; });
+  }
+}
+
+int openhd::AsyncHandle::get_n_current_tasks_locked() const {
+  int ret = 0;
+  for (const auto& queue : m_queues) {
+    for (const auto& task : queue) {
+      if (!task.token->is_cancelled()) ret++;
+    }
+  }
+  for (const auto& running : m_running) {
+    if (running.has_value()) ret++;
   }
+  return ret;
 }
 
 int openhd::AsyncHandle::get_n_current_tasks() {
-  std::lock_guard<std::mutex> lock(m_threads_mutex);
-  return m_tasks.size();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return get_n_current_tasks_locked();
+}
+
+bool openhd::AsyncHandle::wait_until_all_done(
+    std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_cv_done.wait_for(
+      lock, timeout, [this] { return get_n_current_tasks_locked() == 0; });
+}
+
+std::map<std::string, openhd::AsyncHandle::TaskStats>
+openhd::AsyncHandle::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void openhd::AsyncHandle::log_stats() {
+  const auto stats = get_stats();
+  for (const auto& [tag, stat] : stats) {
+    const auto avg = [](std::chrono::microseconds total, int n) {
+      return n == 0 ? 0 : (int)(total.count() / n);
+    };
+    openhd::log::get_default()->info(
+        "Async [{}] executed:{} cancelled:{} expired:{} exceptions:{} queue "
+        "avg/max:{}/{}us run avg/max:{}/{}us",
+        tag, stat.n_executed, stat.n_cancelled, stat.n_expired,
+        stat.n_exceptions, avg(stat.queue_latency_total, stat.n_executed),
+        stat.queue_latency_max.count(),
+        avg(stat.run_time_total, stat.n_executed), stat.run_time_max.count());
+  }
 }
@@ -0,0 +1,258 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the hotplug monitor with synthetic netlink messages, and (if available)
+// print the real events for some seconds.
+//
+
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+
+#include <cstring>
+#include <iostream>
+
+#include "openhd_hotplug.h"
+
+using Event = openhd::HotplugMonitor::Event;
+using EventType = openhd::HotplugMonitor::EventType;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+// Appends a rtattr to the message in buff
+static void add_attr(nlmsghdr* nh, int type, const void* data, int data_len) {
+  auto* rta = (rtattr*)((uint8_t*)nh + NLMSG_ALIGN(nh->nlmsg_len));
+  rta->rta_type = type;
+  rta->rta_len = RTA_LENGTH(data_len);
+  memcpy(RTA_DATA(rta), data, data_len);
+  nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static std::vector<uint8_t> create_link_message(bool add, const char* ifname,
+                                                bool up) {
+  std::vector<uint8_t> buff(1024);
+  auto* nh = (nlmsghdr*)buff.data();
+  nh->nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg));
+  nh->nlmsg_type = add ? RTM_NEWLINK : RTM_DELLINK;
+  auto* ifi = (ifinfomsg*)NLMSG_DATA(nh);
+  ifi->ifi_index = 1000;
+  ifi->ifi_flags = up ? (IFF_UP | IFF_RUNNING) : 0;
+  add_attr(nh, IFLA_IFNAME, ifname, strlen(ifname) + 1);
+  buff.resize(nh->nlmsg_len);
+  return buff;
+}
+
+static std::vector<uint8_t> create_addr_message(const char* ifname,
+                                                const char* ip) {
+  std::vector<uint8_t> buff(1024);
+  auto* nh = (nlmsghdr*)buff.data();
+  nh->nlmsg_len = NLMSG_LENGTH(sizeof(ifaddrmsg));
+  nh->nlmsg_type = RTM_NEWADDR;
+  auto* ifa = (ifaddrmsg*)NLMSG_DATA(nh);
+  ifa->ifa_family = AF_INET;
+  ifa->ifa_index = 1000;
+  in_addr addr{};
+  inet_pton(AF_INET, ip, &addr);
+  add_attr(nh, IFA_LOCAL, &addr, sizeof(addr));
+  add_attr(nh, IFA_LABEL, ifname, strlen(ifname) + 1);
+  buff.resize(nh->nlmsg_len);
+  return buff;
+}
+
+static std::vector<uint8_t> create_route_message(const char* gateway,
+                                                 int oif = 1000,
+                                                 int dst_len = 0) {
+  std::vector<uint8_t> buff(1024);
+  auto* nh = (nlmsghdr*)buff.data();
+  nh->nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+  nh->nlmsg_type = RTM_NEWROUTE;
+  auto* rtm = (rtmsg*)NLMSG_DATA(nh);
+  rtm->rtm_family = AF_INET;
+  rtm->rtm_table = RT_TABLE_MAIN;
+  rtm->rtm_dst_len = dst_len;
+  in_addr addr{};
+  inet_pton(AF_INET, gateway, &addr);
+  add_attr(nh, RTA_GATEWAY, &addr, sizeof(addr));
+  add_attr(nh, RTA_OIF, &oif, sizeof(oif));
+  buff.resize(nh->nlmsg_len);
+  return buff;
+}
+
+static std::string create_uevent(const std::string& action,
+                                 const std::string& subsystem,
+                                 const std::string& devname) {
+  std::string ret = action + "@/devices/platform/usb/" + devname;
+  ret.push_back('\0');
+  for (const auto& kv :
+       {"ACTION=" + action, "DEVPATH=/devices/platform/usb/" + devname,
+        "SUBSYSTEM=" + subsystem, "DEVNAME=" + devname}) {
+    ret += kv;
+    ret.push_back('\0');
+  }
+  return ret;
+}
+
+static void test_parse() {
+  auto link = create_link_message(true, "wlan7", true);
+  // Two messages in one datagram
+  auto link_down = create_link_message(false, "wlan7", false);
+  link.insert(link.end(), link_down.begin(), link_down.end());
+  auto events =
+      openhd::HotplugMonitor::parse_rtnetlink_message(link.data(), link.size());
+  check(events.size() == 2, "2 link events");
+  check(events[0].type == EventType::LINK_NEW, "link new");
+  check(events[0].interface_name == "wlan7", "link name");
+  check(events[0].is_up, "link up");
+  check(events[1].type == EventType::LINK_DEL, "link del");
+
+  const auto addr = create_addr_message("usb0", "192.168.42.129");
+  events =
+      openhd::HotplugMonitor::parse_rtnetlink_message(addr.data(), addr.size());
+  check(events.size() == 1 && events[0].type == EventType::ADDR_NEW, "addr");
+  check(events[0].interface_name == "usb0", "addr name");
+  check(events[0].address == "192.168.42.129", "addr ip");
+
+  const auto route = create_route_message("192.168.42.1");
+  events = openhd::HotplugMonitor::parse_rtnetlink_message(route.data(),
+                                                           route.size());
+  check(events.size() == 1 && events[0].type == EventType::ROUTE_NEW, "route");
+  check(events[0].address == "192.168.42.1", "route gateway");
+  check(events[0].if_index == 1000, "route if index");
+  // e.g. 10.0.0.0/8 via 192.168.42.2 - not the default gateway
+  const auto other_route = create_route_message("192.168.42.2", 1000, 8);
+  events = openhd::HotplugMonitor::parse_rtnetlink_message(
+      other_route.data(), other_route.size());
+  check(events.size() == 1 && events[0].address.empty(),
+        "no gateway of a non-default route");
+
+  const auto uevent = create_uevent("add", "video4linux", "video3");
+  const auto opt_event = openhd::HotplugMonitor::parse_uevent_message(
+      uevent.data(), uevent.size());
+  check(opt_event.has_value(), "uevent");
+  check(opt_event->type == EventType::DEVICE_ADD, "uevent add");
+  check(opt_event->devname == "video3", "uevent devname");
+  const auto ignored = create_uevent("add", "sound", "card1");
+  check(!openhd::HotplugMonitor::parse_uevent_message(ignored.data(),
+                                                      ignored.size()),
+        "uevent other subsystem ignored");
+  const std::string garbage = "libudev\0\0\0garbage";
+  check(!openhd::HotplugMonitor::parse_uevent_message(garbage.data(),
+                                                      garbage.size()),
+        "uevent garbage ignored");
+}
+
+// A waiter reacts to an event immediately, not on the next re-check
+static void test_wait_for_is_event_driven() {
+  openhd::HotplugMonitor monitor{false};
+  std::vector<Event> received;
+  std::mutex received_mutex;
+  monitor.subscribe([&received, &received_mutex](const Event& event) {
+    std::lock_guard<std::mutex> lock(received_mutex);
+    received.push_back(event);
+  });
+  std::atomic<bool> camera_present = false;
+  std::chrono::steady_clock::time_point injected_time;
+  std::thread injector([&monitor, &camera_present, &injected_time]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    camera_present = true;
+    injected_time = std::chrono::steady_clock::now();
+    const auto uevent = create_uevent("add", "video4linux", "video0");
+    monitor.inject_uevent_message(uevent.data(), uevent.size());
+  });
+  const bool found = monitor.wait_for(
+      [&camera_present]() { return camera_present.load(); },
+      std::chrono::seconds(5));
+  const auto latency = std::chrono::steady_clock::now() - injected_time;
+  injector.join();
+  check(found, "wait_for condition");
+  check(latency < std::chrono::milliseconds(50), "wait_for latency");
+  check(received.size() == 1 && received[0].devname == "video0",
+        "subscriber");
+  std::cout << "wait_for latency:"
+            << std::chrono::duration_cast<std::chrono::microseconds>(latency)
+                   .count()
+            << "us\n";
+  // Timeout
+  const auto begin = std::chrono::steady_clock::now();
+  check(!monitor.wait_for([]() { return false; },
+                          std::chrono::milliseconds(100)),
+        "wait_for timeout");
+  check(std::chrono::steady_clock::now() - begin < std::chrono::seconds(1),
+        "wait_for timeout duration");
+}
+
+static void test_gateway() {
+  const std::string proc_net_route =
+      "Iface\tDestination\tGateway \tFlags\tRefCnt\tUse\tMetric\tMask\n"
+      "eth0\t000200C0\t00000000\t0001\t0\t0\t0\t00FFFFFF\n"
+      "usb0\t00000000\t012AA8C0\t0003\t0\t0\t101\t00000000\n";
+  check(openhd::HotplugMonitor::parse_proc_net_route_gateway(proc_net_route,
+                                                             "usb0") ==
+            std::optional<std::string>("192.168.42.1"),
+        "proc net route gateway");
+  check(!openhd::HotplugMonitor::parse_proc_net_route_gateway(proc_net_route,
+                                                              "eth0"),
+        "proc net route no default route");
+  // The gateway is taken from the event
+  openhd::HotplugMonitor monitor{false};
+  const int lo_index = (int)if_nametoindex("lo");
+  std::thread injector([&monitor, lo_index]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto other = create_route_message("10.0.0.1", 1000);
+    monitor.inject_rtnetlink_message(other.data(), other.size());
+    const auto route = create_route_message("127.0.0.2", lo_index);
+    monitor.inject_rtnetlink_message(route.data(), route.size());
+  });
+  const auto gateway = monitor.wait_for_gateway(
+      "lo", []() { return false; }, std::chrono::seconds(5));
+  injector.join();
+  check(gateway == std::optional<std::string>("127.0.0.2"), "event gateway");
+  check(!monitor.wait_for_gateway(
+            "lo", []() { return true; }, std::chrono::seconds(5)),
+        "gateway abort");
+}
+
+int main(int argc, char* argv[]) {
+  test_parse();
+  test_wait_for_is_event_driven();
+  test_gateway();
+  std::cout << "PASSED\n";
+  // Print real events (plug in a camera / wifi card to test)
+  const int listen_s = argc > 1 ? std::atoi(argv[1]) : 0;
+  if (listen_s > 0) {
+    auto& monitor = openhd::HotplugMonitor::instance();
+    monitor.subscribe([](const Event& event) {
+      std::cout << openhd::HotplugMonitor::event_type_to_string(event.type)
+                << " if:" << event.interface_name << " up:" << event.is_up
+                << " addr:" << event.address << " subsystem:" << event.subsystem
+                << " dev:" << event.devname << "\n";
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(listen_s));
+  }
+  return 0;
+}
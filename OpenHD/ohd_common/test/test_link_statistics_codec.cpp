@@ -0,0 +1,422 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Compact link statistics test: varint / zigzag, round trip of keyframes and
+// deltas, robustness against lost messages, keyframes split into parts and
+// a layout change. Then a (synthetic) 10 minute air stats trace, comparing the
+// bytes per second of the regular mavlink stats messages (one per card /
+// video stream / ..., sent every 500ms) against the compact encoding, with
+// plenty and with very little telemetry bandwidth available.
+//
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "openhd_link_statistics_codec.h"
+
+using namespace openhd::link_statistics;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+using Clock = std::chrono::steady_clock;
+
+static void test_varint() {
+  const std::vector<int64_t> values{0,       1,         -1,       63,
+                                    -64,     64,        300,      -300,
+                                    1 << 20, INT32_MAX, INT32_MIN};
+  std::vector<uint8_t> buff;
+  for (auto value : values) write_varint(buff, zigzag_encode(value));
+  check(buff[0] == 0 && buff[1] == 2 && buff[2] == 1, "zigzag small values");
+  int offset = 0;
+  for (auto value : values) {
+    auto read = read_varint(buff.data(), buff.size(), offset);
+    check(read.has_value(), "read varint");
+    check(zigzag_decode(read.value()) == value, "varint round trip");
+  }
+  check(offset == (int)buff.size(), "all consumed");
+  check(!read_varint(buff.data(), buff.size(), offset).has_value(),
+        "no data left");
+  const uint8_t truncated[] = {0x80, 0x80};
+  offset = 0;
+  check(!read_varint(truncated, 2, offset).has_value(), "truncated varint");
+}
+
+// Air stats as wb_link fills them in, with some noise
+class StatsGenerator {
+ public:
+  explicit StatsGenerator(int n_cards = 1, int n_video = 1)
+      : m_n_cards(n_cards), m_n_video(n_video) {}
+  StatsAirGround next() {
+    StatsAirGround ret{};
+    ret.is_air = true;
+    ret.ready = true;
+    auto& link = ret.monitor_mode_link;
+    const int bitrate_kbits = 8000 + noise(400);
+    link.curr_tx_bps = bitrate_kbits * 1250;
+    link.curr_rx_bps = 20000 + noise(2000);
+    m_injection_errors += m_random() % 50 == 0 ? 1 : 0;
+    link.count_tx_inj_error_hint = m_injection_errors;
+    link.curr_tx_pps = (int16_t)(bitrate_kbits * 1250 / 8 / 1400);
+    link.curr_rx_pps = (int16_t)(20 + noise(3));
+    link.curr_tx_channel_mhz = 5745;
+    link.curr_rate_kbits = 13000;
+    link.curr_rx_packet_loss_perc = (int8_t)(m_random() % 3);
+    link.curr_tx_channel_w_mhz = 20;
+    link.curr_tx_mcs_index = 2;
+    link.bitfield = 0x03;
+    auto& tele = ret.telemetry;
+    tele.curr_tx_bps = 24000 + noise(4000);
+    tele.curr_rx_bps = 3000 + noise(500);
+    tele.curr_tx_pps = (int16_t)(30 + noise(5));
+    tele.curr_rx_pps = (int16_t)(8 + noise(2));
+    tele.curr_rx_packet_loss_perc = link.curr_rx_packet_loss_perc;
+    for (int i = 0; i < m_n_cards; i++) {
+      auto& card = ret.cards[i];
+      card.NON_MAVLINK_CARD_ACTIVE = true;
+      card.rx_rssi = (int8_t)(-55 + noise(4));
+      card.rx_rssi_1 = (int8_t)(card.rx_rssi - 2);
+      card.rx_rssi_2 = card.rx_rssi;
+      card.count_p_received = (m_count_received += 10 + noise(2));
+      card.count_p_injected = (m_count_injected += link.curr_tx_pps / 2);
+      card.curr_rx_packet_loss_perc = link.curr_rx_packet_loss_perc;
+      card.card_type = 1;
+      card.card_sub_type = 2;
+      card.tx_power_current = 22;
+      card.tx_power_armed = 22;
+      card.tx_power_disarmed = 10;
+      card.rx_signal_quality_adapter = (int8_t)(80 + noise(5));
+      card.rx_noise_adapter = -90;
+      card.tx_active = 1;
+    }
+    for (int i = 0; i < m_n_video; i++) {
+      Xmavlink_openhd_stats_wb_video_air_t video{};
+      video.link_index = i;
+      video.curr_recommended_bitrate = 8000;
+      video.curr_measured_encoder_bitrate = (bitrate_kbits - 1500) * 1000;
+      video.curr_injected_bitrate = bitrate_kbits * 1000;
+      video.curr_injected_pps = link.curr_tx_pps;
+      video.curr_dropped_frames = m_random() % 20 == 0 ? 1 : 0;
+      video.curr_fec_percentage = 20;
+      ret.stats_wb_video_air.push_back(video);
+    }
+    auto& fec = ret.air_fec_performance;
+    fec.curr_fec_encode_time_avg_us = 900 + noise(100);
+    fec.curr_fec_encode_time_min_us = 400 + noise(50);
+    fec.curr_fec_encode_time_max_us = 2500 + noise(500);
+    fec.curr_fec_block_size_avg = 12;
+    fec.curr_fec_block_size_min = 6;
+    fec.curr_fec_block_size_max = 20 + noise(2);
+    fec.curr_tx_delay_min_us = 100 + noise(20);
+    fec.curr_tx_delay_max_us = 3000 + noise(1000);
+    fec.curr_tx_delay_avg_us = 600 + noise(100);
+    return ret;
+  }
+
+ private:
+  int noise(int max) { return (int)(m_random() % (2 * max + 1)) - max; }
+  const int m_n_cards;
+  const int m_n_video;
+  std::mt19937 m_random{42};
+  uint32_t m_injection_errors = 0;
+  uint32_t m_count_received = 0;
+  uint32_t m_count_injected = 0;
+};
+
+static bool same(const StatsAirGround& a, const StatsAirGround& b) {
+  return a.is_air == b.is_air && stats_to_values(a) == stats_to_values(b) &&
+         a.stats_wb_video_air.size() == b.stats_wb_video_air.size();
+}
+
+// Size of the given mavlink message on the wire (v2, trailing zeros of the
+// payload are not sent)
+static int mavlink_wire_size(const void* payload, size_t payload_len) {
+  const auto* data = (const uint8_t*)payload;
+  while (payload_len > 1 && data[payload_len - 1] == 0) payload_len--;
+  return 12 + (int)payload_len + 2;
+}
+
+// What generate_mav_wb_stats sends on air without the compact encoding
+static int regular_stats_wire_size(const StatsAirGround& stats) {
+  int ret = 0;
+  for (const auto& card : stats.cards) {
+    if (!card.NON_MAVLINK_CARD_ACTIVE) continue;
+    // Only the mavlink fields, not the (first) NON_MAVLINK one
+    Xmavlink_openhd_stats_monitor_mode_wifi_card_t tmp = card;
+    tmp.NON_MAVLINK_CARD_ACTIVE = false;
+    tmp.dummy2 = card.card_sub_type;
+    tmp.card_sub_type = 0;
+    const size_t begin = offsetof(decltype(tmp), count_p_received);
+    ret += mavlink_wire_size((const uint8_t*)&tmp + begin,
+                             offsetof(decltype(tmp), dummy0) + 1 - begin);
+  }
+  ret += mavlink_wire_size(
+      &stats.monitor_mode_link,
+      offsetof(Xmavlink_openhd_stats_monitor_mode_wifi_link_t, dummy0) + 1);
+  ret += mavlink_wire_size(
+      &stats.telemetry,
+      offsetof(Xmavlink_openhd_stats_telemetry_t, dummy0) + 1);
+  for (const auto& video : stats.stats_wb_video_air) {
+    ret += mavlink_wire_size(
+        &video, offsetof(Xmavlink_openhd_stats_wb_video_air_t, dummy0) + 1);
+  }
+  ret += mavlink_wire_size(
+      &stats.air_fec_performance,
+      offsetof(Xmavlink_openhd_stats_wb_video_air_fec_performance_t, dummy0) +
+          1);
+  return ret;
+}
+
+static void test_round_trip() {
+  StatsGenerator generator{2, 2};
+  StatsEncoder encoder;
+  StatsDecoder decoder;
+  auto now = Clock::now();
+  int n_decoded = 0;
+  for (int i = 0; i < 100; i++) {
+    const auto stats = generator.next();
+    for (const auto& message : encoder.encode(stats, now)) {
+      check(message.size() <= COMPACT_STATS_MAX_PAYLOAD, "payload size");
+      auto decoded = decoder.decode(message.data(), message.size());
+      check(decoded.has_value(), "decoded");
+      check(same(decoded.value(), stats), "round trip " + std::to_string(i));
+      n_decoded++;
+    }
+    now += std::chrono::milliseconds(500);
+  }
+  const auto counters = encoder.get_counters();
+  std::cout << "Round trip: " << counters.n_keyframes << " keyframes "
+            << counters.n_deltas << " deltas " << counters.n_bytes
+            << " bytes\n";
+  check(n_decoded == 100, "one message per update");
+  check(counters.n_keyframes == 10, "keyframe every 5 seconds");
+  // The fields end up where they belong
+  StatsAirGround stats = generator.next();
+  stats.cards[1].NON_MAVLINK_CARD_ACTIVE = false;
+  stats.cards[2].NON_MAVLINK_CARD_ACTIVE = true;
+  stats.cards[2].rx_rssi = -33;
+  stats.stats_wb_video_air[1].curr_injected_bitrate = 1234567;
+  stats.air_fec_performance.curr_tx_delay_max_us = 4321;
+  const auto messages = encoder.encode(stats, now);
+  check(messages.size() == 1, "layout change, one keyframe");
+  auto result = decoder.decode(messages[0].data(), messages[0].size());
+  check(result.has_value() && result->is_air, "keyframe decoded");
+  check(!result->cards[1].NON_MAVLINK_CARD_ACTIVE &&
+            result->cards[2].NON_MAVLINK_CARD_ACTIVE &&
+            result->cards[2].rx_rssi == -33,
+        "card slots");
+  check(result->stats_wb_video_air.size() == 2 &&
+            result->stats_wb_video_air[1].curr_injected_bitrate == 1234567,
+        "video stats");
+  check(result->air_fec_performance.curr_tx_delay_max_us == 4321, "fec stats");
+  check(result->monitor_mode_link.curr_tx_channel_mhz == 5745, "link stats");
+  // Nothing changed - nothing to send until max interval
+  now += std::chrono::milliseconds(500);
+  check(encoder.encode(stats, now).empty(), "unchanged stats not sent");
+  now += std::chrono::milliseconds(2000);
+  check(encoder.encode(stats, now).size() == 1, "sent after max interval");
+}
+
+static void test_loss() {
+  StatsGenerator generator;
+  StatsEncoder encoder;
+  StatsDecoder decoder;
+  std::mt19937 random{7};
+  auto now = Clock::now();
+  int n_sent = 0;
+  int n_lost = 0;
+  int n_decoded = 0;
+  for (int i = 0; i < 1000; i++) {
+    const auto stats = generator.next();
+    for (const auto& message : encoder.encode(stats, now)) {
+      n_sent++;
+      if (random() % 100 < 30) {
+        n_lost++;
+        continue;
+      }
+      auto decoded = decoder.decode(message.data(), message.size());
+      if (decoded.has_value()) {
+        // Never wrong, even if the previous delta(s) are lost
+        check(same(decoded.value(), stats), "decoded after loss");
+        n_decoded++;
+      }
+    }
+    now += std::chrono::milliseconds(500);
+  }
+  std::cout << "30% loss: sent " << n_sent << " lost " << n_lost << " decoded "
+            << n_decoded << "\n";
+  // Only the deltas referring to a lost keyframe are not usable
+  check(n_decoded > (n_sent - n_lost) * 0.6, "most decoded");
+  // Garbage is rejected
+  const uint8_t garbage[] = {0x00, 0x55, 0x51, 0x90, 0x90};
+  check(!decoder.decode(garbage, sizeof(garbage)).has_value(), "garbage");
+  const uint8_t garbage_key[] = {0x01, 0x55, 0x51, 0x21, 0x00, 0x10};
+  check(!decoder.decode(garbage_key, sizeof(garbage_key)).has_value(),
+        "invalid part");
+}
+
+static void test_keyframe_parts() {
+  // 4 cards, 3 video streams, large values - does not fit into one message
+  StatsAirGround stats{};
+  stats.is_air = true;
+  std::mt19937 random{3};
+  for (auto& card : stats.cards) {
+    card.NON_MAVLINK_CARD_ACTIVE = true;
+  }
+  stats.stats_wb_video_air.resize(3);
+  for (auto& card : stats.cards) {
+    card.count_p_received = random();
+    card.count_p_injected = random();
+    card.tx_power_current = (int16_t)random();
+    card.tx_power_armed = (int16_t)random();
+    card.tx_power_disarmed = (int16_t)random();
+    card.rx_rssi = (int8_t)random();
+    card.rx_noise_adapter = (int8_t)random();
+  }
+  auto& link = stats.monitor_mode_link;
+  link.curr_tx_bps = (int32_t)random();
+  link.curr_rx_bps = (int32_t)random();
+  link.count_tx_inj_error_hint = random();
+  link.count_tx_dropped_packets = random();
+  for (auto& video : stats.stats_wb_video_air) {
+    video.curr_measured_encoder_bitrate = (int32_t)random();
+    video.curr_injected_bitrate = (int32_t)random();
+    video.curr_injected_pps = (int32_t)random();
+    video.curr_dropped_frames = (int32_t)random();
+    video.curr_recommended_bitrate = (int16_t)random();
+    video.thermal_hottest_temp_c = (int16_t)random();
+    video.thermal_bitrate_perc = (uint8_t)random();
+  }
+  auto& fec = stats.air_fec_performance;
+  fec.curr_fec_encode_time_avg_us = random();
+  fec.curr_fec_encode_time_min_us = random();
+  fec.curr_fec_encode_time_max_us = random();
+  const auto values = stats_to_values(stats);
+  StatsEncoder encoder;
+  auto messages = encoder.encode(stats);
+  std::cout << "Keyframe with " << values.size() << " fields in "
+            << messages.size() << " parts\n";
+  check(messages.size() == 2, "split keyframe");
+  StatsDecoder decoder;
+  // Out of order
+  check(!decoder.decode(messages[1].data(), messages[1].size()).has_value(),
+        "incomplete");
+  auto decoded = decoder.decode(messages[0].data(), messages[0].size());
+  check(decoded.has_value() && same(decoded.value(), stats), "all parts");
+}
+
+struct TraceResult {
+  double regular_bytes_per_second;
+  double compact_bytes_per_second;
+  int n_decoded;
+  int max_interval_ms;
+};
+
+// 10 minutes, stats are updated by wb_link every 500ms, the telemetry loop
+// runs every 100ms
+static TraceResult run_trace(int available_bps, int n_cards, int n_video) {
+  StatsGenerator generator{n_cards, n_video};
+  StatsEncoder encoder;
+  encoder.set_available_bps(available_bps);
+  StatsDecoder decoder;
+  const auto begin = Clock::now();
+  auto now = begin;
+  StatsAirGround stats{};
+  int64_t regular_bytes = 0;
+  int64_t compact_bytes = 0;
+  TraceResult ret{};
+  const auto duration = std::chrono::minutes(10);
+  for (int i = 0; now < begin + duration; i++) {
+    if (i % 5 == 0) {
+      stats = generator.next();
+      regular_bytes += regular_stats_wire_size(stats);
+    }
+    for (const auto& message : encoder.encode(stats, now)) {
+      // V2_EXTENSION: message type, target network, system, component,
+      // length byte
+      compact_bytes += 12 + 2 + 5 + 1 + message.size();
+      if (decoder.decode(message.data(), message.size()).has_value()) {
+        ret.n_decoded++;
+      }
+    }
+    ret.max_interval_ms = std::max(ret.max_interval_ms,
+                                   (int)encoder.get_curr_interval().count());
+    now += std::chrono::milliseconds(100);
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(duration).count();
+  ret.regular_bytes_per_second = regular_bytes / seconds;
+  ret.compact_bytes_per_second = compact_bytes / seconds;
+  return ret;
+}
+
+static void test_trace() {
+  struct Scenario {
+    std::string name;
+    int available_bps;
+    int n_cards;
+    int n_video;
+  };
+  const std::vector<Scenario> scenarios{
+      {"1 card, 1 video, 32kbit/s", 32000, 1, 1},
+      {"1 card, 2 video, 32kbit/s", 32000, 1, 2},
+      {"1 card, 1 video, 1kbit/s", 1000, 1, 1},
+  };
+  for (const auto& scenario : scenarios) {
+    const auto result =
+        run_trace(scenario.available_bps, scenario.n_cards, scenario.n_video);
+    const double saved = 100.0 * (1.0 - result.compact_bytes_per_second /
+                                            result.regular_bytes_per_second);
+    std::cout << scenario.name << ": regular "
+              << (int)result.regular_bytes_per_second << " B/s, compact "
+              << (int)result.compact_bytes_per_second << " B/s (" << (int)saved
+              << "% saved), " << result.n_decoded << " updates, interval <= "
+              << result.max_interval_ms << "ms\n";
+    check(result.compact_bytes_per_second * 8 <= scenario.available_bps * 1.1,
+          "fits into available bandwidth");
+    check(result.compact_bytes_per_second < result.regular_bytes_per_second,
+          "less than regular");
+  }
+  const auto plenty = run_trace(32000, 1, 1);
+  check(plenty.max_interval_ms == 200, "min interval with enough bandwidth");
+  check(plenty.compact_bytes_per_second < plenty.regular_bytes_per_second / 2,
+        "at least 50% saved");
+  check(plenty.n_decoded >= 1200, "every update sent");
+  const auto little = run_trace(1000, 1, 1);
+  check(little.max_interval_ms > 500, "interval increased");
+}
+
+int main(int argc, char* argv[]) {
+  test_varint();
+  test_round_trip();
+  test_loss();
+  test_keyframe_parts();
+  test_trace();
+  std::cout << "All tests passed\n";
+  return 0;
+}
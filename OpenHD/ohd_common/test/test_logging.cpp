@@ -21,11 +21,223 @@
  * © OpenHD, All Rights Reserved.
  ******************************************************************************/
 
+// Logging: the lock-free ring, rate limiting and a benchmark of the async
+// backend (cost of a debug log on the logging thread, also while the console
+// doesn't accept any output).
+// --kmsg additionally writes a test message to /dev/kmsg.
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
 #include "openhd_spdlog.h"
+#include "openhd_spdlog_async.h"
 #include "openhd_spdlog_include.h"
 
-int main(int argc, char *argv[]) {
+using namespace openhd::log;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static void test_ring() {
+  static constexpr int N_PRODUCERS = 4;
+  static constexpr int N_PER_PRODUCER = 200000;
+  auto ring = std::make_unique<MpscRing<uint64_t, 64>>();
+  std::vector<std::thread> producers;
+  for (int p = 0; p < N_PRODUCERS; p++) {
+    producers.emplace_back([&ring, p]() {
+      for (uint64_t i = 0; i < N_PER_PRODUCER; i++) {
+        const uint64_t value = ((uint64_t)p << 32) | i;
+        while (!ring->try_push([value](uint64_t& cell) { cell = value; })) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  // Each producer's values need to arrive complete and in order
+  std::vector<uint64_t> next(N_PRODUCERS, 0);
+  int n_popped = 0;
+  bool in_order = true;
+  while (n_popped < N_PRODUCERS * N_PER_PRODUCER) {
+    const bool popped = ring->try_pop([&](uint64_t& cell) {
+      const int p = (int)(cell >> 32);
+      if ((cell & 0xFFFFFFFF) != next[p]) in_order = false;
+      next[p]++;
+    });
+    if (popped) {
+      n_popped++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  for (auto& producer : producers) producer.join();
+  check(in_order, "ring in order");
+  check(ring->size() == 0 && !ring->try_pop([](uint64_t&) {}), "ring empty");
+  std::cout << "Ring ok" << std::endl;
+}
+
+static void test_rate_limit() {
+  RateLimiter limiter{};
+  limiter.set_max_per_second(10);
+  const std::string name = "test";
+  auto key = [&name](const std::string& message) {
+    return RateLimiter::create_key(name.data(), name.size(), message.data(),
+                                   message.size());
+  };
+  check(key("rx error 3") == key("rx error 42"), "digits ignored");
+  check(key("rx error") != key("tx error"), "different message");
+  int n_passed = 0;
+  for (int i = 0; i < 100; i++) {
+    if (limiter.check(key(fmt::format("rx error {}", i)), 1000 + i) >= 0) {
+      n_passed++;
+    }
+  }
+  check(n_passed == 10, "10 per second");
+  // Next window reports what was suppressed
+  check(limiter.check(key("rx error 0"), 2100) == 90, "n suppressed");
+  check(limiter.check(key("rx error 0"), 2101) == 0, "reset");
+  // And via a logger
+  auto& backend = AsyncLogBackend::instance();
+  const auto before = backend.get_stats();
+  auto console = create_or_get("test_rate");
+  for (int i = 0; i < 100; i++) {
+    console->warn("Repeated warning {}", i);
+  }
+  backend.flush();
+  const auto after = backend.get_stats();
+  check(after.n_suppressed - before.n_suppressed == 90, "logger suppressed");
+  std::cout << "Rate limit ok" << std::endl;
+}
+
+struct BenchResult {
+  double avg_ns;
+  double max_us;
+};
+
+// Not wall time, such that other threads (e.g. the writer) running on the
+// same cpu don't count
+static std::chrono::nanoseconds get_thread_cpu_time() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// n_threads threads each logging n_per_thread debug messages. Returns the
+// average cpu time per message of the logging thread and the max wall time
+// of one call.
+static BenchResult bench_debug_log(int n_threads, int n_per_thread) {
+  auto console = create_or_get("bench");
+  console->set_level(spdlog::level::debug);
+  std::vector<std::thread> threads;
+  std::vector<double> avg_ns(n_threads);
+  std::vector<double> max_us(n_threads);
+  for (int t = 0; t < n_threads; t++) {
+    threads.emplace_back([&, t]() {
+      std::chrono::nanoseconds max_duration{0};
+      const auto begin = get_thread_cpu_time();
+      for (int i = 0; i < n_per_thread; i++) {
+        const auto log_begin = std::chrono::steady_clock::now();
+        console->debug("Frame {} with {} fragments, {} bytes", i, 12,
+                       i * 1400);
+        max_duration = std::max(max_duration,
+                                std::chrono::steady_clock::now() - log_begin);
+      }
+      const auto duration = get_thread_cpu_time() - begin;
+      avg_ns[t] =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+              .count() /
+          (double)n_per_thread;
+      max_us[t] =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(max_duration)
+              .count() /
+          1000.0;
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  console->set_level(spdlog::level::warn);
+  BenchResult ret{};
+  for (int t = 0; t < n_threads; t++) {
+    ret.avg_ns += avg_ns[t] / n_threads;
+    ret.max_us = std::max(ret.max_us, max_us[t]);
+  }
+  return ret;
+}
+
+static void benchmark() {
+  auto& backend = AsyncLogBackend::instance();
+  backend.set_rate_limit(0);
+  const int saved_stdout = dup(STDOUT_FILENO);
+  // 1) Console writes to /dev/null
+  const int dev_null = open("/dev/null", O_WRONLY);
+  dup2(dev_null, STDOUT_FILENO);
+  close(dev_null);
+  const auto stats_begin = backend.get_stats();
+  const auto single = bench_debug_log(1, 100000);
+  const auto multi = bench_debug_log(4, 50000);
+  backend.flush(std::chrono::seconds(5));
+  const auto stats_null = backend.get_stats();
+  // 2) Console is a pipe nobody reads - the writer blocks, the ring fills up
+  int pipe_fds[2];
+  check(pipe(pipe_fds) == 0, "pipe");
+  dup2(pipe_fds[1], STDOUT_FILENO);
+  close(pipe_fds[1]);
+  const auto blocked = bench_debug_log(1, 50000);
+  const auto stats_blocked = backend.get_stats();
+  // Unblock the writer again
+  std::thread drain([fd = pipe_fds[0]]() {
+    char buff[4096];
+    while (read(fd, buff, sizeof(buff)) > 0) {
+    }
+    close(fd);
+  });
+  backend.flush(std::chrono::seconds(5));
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(saved_stdout);
+  drain.join();
+  backend.set_rate_limit(10);
+  std::cout << "Debug log, 1 thread: " << single.avg_ns
+            << "ns avg, max " << single.max_us << "us" << std::endl;
+  std::cout << "Debug log, 4 threads: " << multi.avg_ns
+            << "ns avg, max " << multi.max_us << "us" << std::endl;
+  std::cout << "Debug log, console blocked: " << blocked.avg_ns
+            << "ns avg, max " << blocked.max_us << "us, dropped "
+            << stats_blocked.n_dropped_full - stats_null.n_dropped_full
+            << std::endl;
+  std::cout << "Written " << stats_null.n_written - stats_begin.n_written
+            << " dropped "
+            << stats_null.n_dropped_full - stats_begin.n_dropped_full
+            << std::endl;
+  // Nobody reads the console, so messages have to be dropped instead of
+  // blocking the logging thread
+  check(stats_blocked.n_dropped_full > stats_null.n_dropped_full,
+        "dropped when blocked");
+#ifdef NDEBUG
+  check(single.avg_ns < 1000 && multi.avg_ns < 1000 && blocked.avg_ns < 1000,
+        "debug log < 1us");
+#endif
+}
+
+int main(int argc, char* argv[]) {
   openhd::log::get_default()->debug("Example debug");
   openhd::log::get_default()->warn("Example warn");
+  test_ring();
+  test_rate_limit();
+  benchmark();
+  if (argc > 1 && std::string(argv[1]) == "--kmsg") {
+    openhd::log::log_to_kernel("openhd: test_logging");
+  }
+  openhd::log::get_default()->warn("Done");
+  std::cout << "All tests passed" << std::endl;
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,205 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the metrics registry (exact values under contention, histogram buckets,
+// prometheus text format, scrape via localhost) and benchmark the cost of
+// recording. Optionally keeps serving on the given port for a manual scrape:
+// ./test_metrics 9100 & curl http://127.0.0.1:9100/metrics
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+
+#include "openhd_metrics.h"
+
+using namespace openhd::metrics;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static bool contains(const std::string& text, const std::string& what) {
+  return text.find(what) != std::string::npos;
+}
+
+static void test_counter_concurrent() {
+  auto& counter = Registry::instance().counter("test_concurrent_total",
+                                               "Concurrent increments");
+  auto& histogram = Registry::instance().histogram(
+      "test_concurrent_hist", "Concurrent records", {1, 2, 3});
+  // More threads than shards, some have to share
+  static constexpr int N_THREADS = N_SHARDS + 8;
+  static constexpr int N_PER_THREAD = 200 * 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < N_THREADS; t++) {
+    threads.emplace_back([&counter, &histogram]() {
+      for (int i = 0; i < N_PER_THREAD; i++) {
+        counter.add();
+        histogram.record(i % 5);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  check(counter.get() == (uint64_t)N_THREADS * N_PER_THREAD, "counter sum");
+  const auto snapshot = histogram.get();
+  check(snapshot.count == (uint64_t)N_THREADS * N_PER_THREAD, "hist count");
+  // 0,1 -> le 1; 2 -> le 2; 3 -> le 3; 4 -> +Inf
+  const uint64_t per_value = N_THREADS * N_PER_THREAD / 5;
+  check(snapshot.bucket_counts ==
+            std::vector<uint64_t>{2 * per_value, per_value, per_value,
+                                  per_value},
+        "hist buckets");
+  check(snapshot.sum == (int64_t)per_value * (0 + 1 + 2 + 3 + 4), "hist sum");
+}
+
+// Shards of exited threads are re-used without losing their values
+static void test_shard_reuse() {
+  auto& counter = Registry::instance().counter("test_reuse_total", "Reuse");
+  for (int i = 0; i < 100; i++) {
+    std::thread([&counter]() { counter.add(2); }).join();
+  }
+  check(counter.get() == 200, "reuse sum");
+}
+
+static void test_registry() {
+  auto& registry = Registry::instance();
+  auto& a = registry.counter("test_packets_total", "Packets", {{"stream", "0"}});
+  auto& b = registry.counter("test_packets_total", "Packets", {{"stream", "0"}});
+  auto& c = registry.counter("test_packets_total", "Packets", {{"stream", "1"}});
+  check(&a == &b, "same metric");
+  check(&a != &c, "different labels");
+  a.add(3);
+  c.add(5);
+  registry.gauge("test_fill_percent", "Fill").set(42);
+  auto& hist = registry.histogram("test_latency_us", "Latency", {100, 10},
+                                  {{"path", "a\"b"}});
+  hist.record(5);
+  hist.record(50);
+  hist.record(500);
+  const auto text = registry.to_prometheus_text();
+  check(contains(text, "# TYPE test_packets_total counter\n"), "type");
+  check(contains(text, "test_packets_total{stream=\"0\"} 3\n"), "counter 0");
+  check(contains(text, "test_packets_total{stream=\"1\"} 5\n"), "counter 1");
+  check(contains(text, "test_fill_percent 42\n"), "gauge");
+  check(contains(text, "# TYPE test_latency_us histogram\n"), "hist type");
+  // Bounds are sorted, buckets cumulative, label values escaped
+  check(contains(text, "test_latency_us_bucket{path=\"a\\\"b\",le=\"10\"} 1\n"),
+        "bucket 10");
+  check(contains(text, "test_latency_us_bucket{path=\"a\\\"b\",le=\"100\"} 2\n"),
+        "bucket 100");
+  check(contains(text, "test_latency_us_bucket{path=\"a\\\"b\",le=\"+Inf\"} 3\n"),
+        "bucket inf");
+  check(contains(text, "test_latency_us_sum{path=\"a\\\"b\"} 555\n"), "sum");
+  check(contains(text, "test_latency_us_count{path=\"a\\\"b\"} 3\n"), "count");
+}
+
+static std::string scrape(int port) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  check(connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0, "connect");
+  const std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+  send(fd, request.data(), request.size(), 0);
+  std::string response;
+  char buff[4096];
+  ssize_t ret;
+  while ((ret = recv(fd, buff, sizeof(buff), 0)) > 0) {
+    response.append(buff, ret);
+  }
+  close(fd);
+  return response;
+}
+
+static void test_server() {
+  MetricsServer server{-1};
+  check(server.get_tcp_port() > 0, "port");
+  for (int i = 0; i < 3; i++) {
+    const auto response = scrape(server.get_tcp_port());
+    check(contains(response, "HTTP/1.0 200 OK\r\n"), "status");
+    check(contains(response, "text/plain; version=0.0.4"), "content type");
+    check(contains(response, "test_fill_percent 42\n"), "body");
+  }
+}
+
+// Cost of a single record (single thread and all threads recording into the
+// same metric, which is the worst case for the shards)
+static void benchmark() {
+  auto& counter = Registry::instance().counter("bench_total", "Benchmark");
+  auto& histogram = Registry::instance().histogram(
+      "bench_latency_us", "Benchmark", latency_buckets_us());
+  static constexpr int N = 10 * 1000 * 1000;
+  const int n_threads =
+      std::max(1, std::min(4, (int)std::thread::hardware_concurrency()));
+  auto run = [&](int threads, const std::function<void(int)>& f) {
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+      workers.emplace_back([&f]() {
+        for (int i = 0; i < N; i++) f(i);
+      });
+    }
+    for (auto& worker : workers) worker.join();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - begin)
+               .count() /
+           N;
+  };
+  const double counter_ns = run(1, [&counter](int) { counter.add(); });
+  const double counter_mt_ns = run(n_threads, [&counter](int) { counter.add(); });
+  const double hist_ns =
+      run(1, [&histogram](int i) { histogram.record(i & 0xffff); });
+  const double hist_mt_ns =
+      run(n_threads, [&histogram](int i) { histogram.record(i & 0xffff); });
+  std::cout << "counter: " << counter_ns << "ns/record, " << n_threads
+            << " threads: " << counter_mt_ns << "ns/record\n";
+  std::cout << "histogram: " << hist_ns << "ns/record, " << n_threads
+            << " threads: " << hist_mt_ns << "ns/record\n";
+#ifdef NDEBUG
+  check(counter_ns < 20 && counter_mt_ns < 20, "counter < 20ns");
+  check(hist_ns < 20 && hist_mt_ns < 20, "histogram < 20ns");
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  test_counter_concurrent();
+  test_shard_reuse();
+  test_registry();
+  test_server();
+  benchmark();
+  if (argc > 1) {
+    MetricsServer server{std::stoi(argv[1])};
+    std::cout << "Serving on port " << server.get_tcp_port() << ", ctrl+c to stop\n";
+    while (true) std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+  std::cout << "PASSED\n";
+  return 0;
+}
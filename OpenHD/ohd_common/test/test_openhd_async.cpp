@@ -21,11 +21,167 @@
  * © OpenHD, All Rights Reserved.
  ******************************************************************************/
 
+#include <atomic>
+#include <fstream>
+#include <iostream>
+
 #include "openhd_spdlog.h"
 #include "openhd_util_async.h"
 
+static int get_n_threads_of_process() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("Threads:", 0) == 0) {
+      return std::stoi(line.substr(8));
+    }
+  }
+  return -1;
+}
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+// Burst of many short tasks (like a burst of parameter writes) - compare
+// against one thread per task, and make sure the thread count stays bounded
+static void test_burst() {
+  static constexpr int N_TASKS = 5000;
+  std::atomic<int> n_done = 0;
+  auto work = [&n_done]() {
+    volatile int x = 0;
+    for (int i = 0; i < 1000; i++) x = x + i;
+    n_done++;
+  };
+  const int n_threads_before = get_n_threads_of_process();
+  int n_threads_max = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_TASKS; i++) {
+    openhd::AsyncHandle::instance().execute_async(
+        "BURST_" + std::to_string(i % 16), work);
+    if (i % 100 == 0) {
+      n_threads_max = std::max(n_threads_max, get_n_threads_of_process());
+    }
+  }
+  check(openhd::AsyncHandle::instance().wait_until_all_done(
+            std::chrono::seconds(30)),
+        "burst done");
+  const auto pool_duration = std::chrono::steady_clock::now() - begin;
+  check(n_done == N_TASKS, "all burst tasks executed");
+  check(n_threads_max - n_threads_before <= 0, "bounded thread count");
+
+  n_done = 0;
+  const auto begin_threads = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_TASKS; i++) {
+    std::thread(work).detach();
+  }
+  while (n_done != N_TASKS) {
+    std::this_thread::yield();
+  }
+  const auto threads_duration =
+      std::chrono::steady_clock::now() - begin_threads;
+  const auto to_us = [](auto duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+        .count();
+  };
+  std::cout << "Burst of " << N_TASKS << " tasks: pool " << to_us(pool_duration)
+            << "us, thread per task " << to_us(threads_duration)
+            << "us, threads before:" << n_threads_before
+            << " max:" << n_threads_max << "\n";
+}
+
+// Notification is immediate - no 1 second polling
+static void test_completion_latency() {
+  const auto begin = std::chrono::steady_clock::now();
+  openhd::AsyncHandle::instance().execute_async("QUICK", []() {});
+  check(openhd::AsyncHandle::instance().wait_until_all_done(
+            std::chrono::seconds(5)),
+        "quick done");
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  check(elapsed < std::chrono::milliseconds(50), "completion latency");
+}
+
+static void test_priority_cancel_deadline() {
+  openhd::AsyncHandle handle{1};
+  std::atomic<bool> block = true;
+  std::vector<std::string> order;
+  std::mutex order_mutex;
+  auto record = [&order, &order_mutex](std::string name) {
+    return [&order, &order_mutex, name]() {
+      std::lock_guard<std::mutex> lock(order_mutex);
+      order.push_back(name);
+    };
+  };
+  // Occupy the single worker
+  handle.execute_async("BLOCK", [&block]() {
+    while (block) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  handle.execute_async("LOW", record("LOW"), openhd::AsyncHandle::Priority::LOW);
+  handle.execute_async("HIGH", record("HIGH"),
+                       openhd::AsyncHandle::Priority::HIGH);
+  auto token = handle.execute_async("CANCELLED", record("CANCELLED"));
+  token->cancel();
+  handle.execute_async("EXPIRED", record("EXPIRED"),
+                       openhd::AsyncHandle::Priority::NORMAL,
+                       std::chrono::milliseconds(5));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  block = false;
+  check(handle.wait_until_all_done(std::chrono::seconds(5)), "all done");
+  check(order == std::vector<std::string>{"HIGH", "LOW"}, "priority order");
+  auto stats = handle.get_stats();
+  check(stats["CANCELLED"].n_cancelled == 1, "cancelled");
+  check(stats["EXPIRED"].n_expired == 1, "expired");
+  check(stats["BLOCK"].run_time_max >= std::chrono::milliseconds(30),
+        "run time stats");
+  check(stats["HIGH"].queue_latency_max >= std::chrono::milliseconds(20),
+        "queue latency stats");
+  // A running task can be cancelled cooperatively
+  auto token2 = handle.execute_async_cancellable(
+      "COOPERATIVE", [](const openhd::CancellationToken& token) {
+        while (!token.is_cancelled()) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  token2->cancel();
+  check(handle.wait_until_all_done(std::chrono::seconds(5)),
+        "cooperative cancel");
+  handle.log_stats();
+}
+
+// Tasks with the same tag are serialized and keep their order
+static void test_same_tag_in_order() {
+  openhd::AsyncHandle handle{4};
+  std::vector<int> order;
+  std::atomic<int> n_concurrent = 0;
+  std::atomic<int> n_concurrent_max = 0;
+  for (int i = 0; i < 100; i++) {
+    handle.execute_async("SAME", [i, &order, &n_concurrent,
+                                  &n_concurrent_max]() {
+      const int concurrent = ++n_concurrent;
+      n_concurrent_max = std::max(n_concurrent_max.load(), concurrent);
+      order.push_back(i);
+      n_concurrent--;
+    });
+  }
+  check(handle.wait_until_all_done(std::chrono::seconds(5)), "same tag done");
+  check(n_concurrent_max == 1, "same tag not concurrent");
+  for (int i = 0; i < 100; i++) {
+    check(order[i] == i, "same tag in order");
+  }
+}
+
 int main(int argc, char *argv[]) {
   openhd::AsyncHandle::instance();
+  test_completion_latency();
+  test_priority_cancel_deadline();
+  test_same_tag_in_order();
+  test_burst();
+  openhd::AsyncHandle::instance().log_stats();
+  std::cout << "PASSED\n";
   openhd::AsyncHandle::instance().execute_async("LONG_TASK", []() {
     std::this_thread::sleep_for(std::chrono::seconds(10000));
   });
@@ -37,4 +193,4 @@ int main(int argc, char *argv[]) {
     std::this_thread::sleep_for(std::chrono::seconds(1));
   }
   return 0;
-}
\ No newline at end of file
+}
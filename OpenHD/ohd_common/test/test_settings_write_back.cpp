@@ -0,0 +1,148 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the debounced, atomic settings write-back:
+// 1) A burst of persist() calls results in (almost) a single write
+// 2) Persisting unchanged settings doesn't touch the file
+// 3) Killing a writer at random points never leaves a torn file
+//
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+#include "openhd_settings_persistent.h"
+#include "openhd_util_filesystem.h"
+
+static const std::string TEST_DIR = "/tmp/openhd_test_settings_write_back/";
+
+struct TestSettings {
+  int value = 0;
+};
+
+class TestSettingsHolder : public openhd::PersistentSettings<TestSettings> {
+ public:
+  TestSettingsHolder() : PersistentSettings<TestSettings>(TEST_DIR) { init(); }
+
+ private:
+  [[nodiscard]] std::string get_unique_filename() const override {
+    return "test_settings.txt";
+  }
+  [[nodiscard]] TestSettings create_default() const override {
+    return TestSettings{};
+  }
+  [[nodiscard]] std::optional<TestSettings> impl_deserialize(
+      const std::string& file_as_string) const override {
+    try {
+      return TestSettings{std::stoi(file_as_string)};
+    } catch (...) {
+    }
+    return std::nullopt;
+  }
+  [[nodiscard]] std::string imp_serialize(
+      const TestSettings& data) const override {
+    return std::to_string(data.value);
+  }
+};
+
+static void test_burst_is_coalesced() {
+  auto& write_back = openhd::SettingsWriteBack::instance();
+  TestSettingsHolder holder{};
+  write_back.flush();
+  const auto before = write_back.get_stats();
+  for (int i = 1; i <= 100; i++) {
+    holder.unsafe_get_settings().value = i;
+    holder.persist(false);
+  }
+  write_back.flush();
+  const auto after = write_back.get_stats();
+  const int n_writes = after.n_writes - before.n_writes;
+  std::cout << "Burst: requests:" << after.n_requests - before.n_requests
+            << " writes:" << n_writes
+            << " coalesced:" << after.n_coalesced - before.n_coalesced << "\n";
+  if (n_writes > 2) {
+    throw std::runtime_error("Burst was not coalesced");
+  }
+  const auto content =
+      OHDFilesystemUtil::opt_read_file(TEST_DIR + "test_settings.txt");
+  if (content != "100") {
+    throw std::runtime_error("Latest content was not written");
+  }
+}
+
+static void test_unchanged_is_skipped() {
+  auto& write_back = openhd::SettingsWriteBack::instance();
+  TestSettingsHolder holder{};
+  write_back.flush();
+  const auto before = write_back.get_stats();
+  holder.persist(false);
+  write_back.flush();
+  const auto after = write_back.get_stats();
+  if (after.n_writes != before.n_writes ||
+      after.n_skipped_unchanged != before.n_skipped_unchanged + 1) {
+    throw std::runtime_error("Unchanged content was re-written");
+  }
+}
+
+static void test_no_torn_writes() {
+  const std::string path = TEST_DIR + "torn.txt";
+  // Large enough that a write takes a while, such that we kill the writer
+  // mid-write most of the time
+  const std::string content_a(4 * 1024 * 1024, 'a');
+  const std::string content_b(3 * 1024 * 1024, 'b');
+  openhd::SettingsWriteBack::write_file_atomic(path, content_a);
+  std::mt19937 rng{std::random_device{}()};
+  std::uniform_int_distribution<int> delay_us{0, 100 * 1000};
+  for (int i = 0; i < 50; i++) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      for (int j = 0;; j++) {
+        openhd::SettingsWriteBack::write_file_atomic(
+            path, j % 2 == 0 ? content_b : content_a);
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(delay_us(rng)));
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    const auto content = OHDFilesystemUtil::opt_read_file(path, false);
+    if (!content.has_value() ||
+        (content.value() != content_a && content.value() != content_b)) {
+      throw std::runtime_error("Torn write after kill " + std::to_string(i));
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::filesystem::remove_all(TEST_DIR);
+  test_burst_is_coalesced();
+  test_unchanged_is_skipped();
+  test_no_torn_writes();
+  openhd::SettingsWriteBack::instance().flush();
+  std::filesystem::remove_all(TEST_DIR);
+  std::cout << "PASSED\n";
+  return 0;
+}
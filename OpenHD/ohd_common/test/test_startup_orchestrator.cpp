@@ -0,0 +1,190 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the startup orchestrator with steps modelled after the openhd startup.
+// Optionally, validate a boot trace written by openhd itself, e.g. with
+// WIFI_MONITOR_CARD_EMULATE = true in hardware.config and the (default) dummy
+// camera (videotestsrc):
+// sudo openhd --air --run-time-seconds 10 --boot-trace /tmp/boot_trace.json
+// ./test_startup_orchestrator /tmp/boot_trace.json
+//
+
+#include <iostream>
+#include <thread>
+
+#include "include_json.hpp"
+#include "openhd_startup_orchestrator.h"
+#include "openhd_util.h"
+#include "openhd_util_filesystem.h"
+
+using namespace std::chrono_literals;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static std::function<void()> sleep_ms(int ms) {
+  return [ms]() { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); };
+}
+
+static openhd::StartupOrchestrator::StepTiming get(
+    const std::vector<openhd::StartupOrchestrator::StepTiming>& timings,
+    const std::string& name) {
+  for (const auto& timing : timings) {
+    if (timing.name == name) return timing;
+  }
+  throw std::runtime_error("No step " + name);
+}
+
+static void test_air_like_startup() {
+  openhd::StartupOrchestrator startup{};
+  startup.add_step("telemetry", {}, sleep_ms(50));
+  startup.add_step("interface", {}, sleep_ms(200));
+  startup.add_step("gstreamer_init", {}, sleep_ms(150));
+  startup.add_step("camera_discovery", {}, sleep_ms(100));
+  startup.add_step("telemetry_link", {"telemetry", "interface"}, sleep_ms(1));
+  startup.add_step("video_air",
+                   {"interface", "camera_discovery", "gstreamer_init"},
+                   sleep_ms(50));
+  startup.add_step("telemetry_settings", {"telemetry_link", "video_air"},
+                   sleep_ms(1));
+  startup.run();
+  startup.log_summary();
+  const auto timings = startup.get_timings();
+  // Sequential, this would take > 550ms
+  check(startup.get_total_duration() < 400ms, "steps run concurrently");
+  const auto video = get(timings, "video_air");
+  check(video.begin >= get(timings, "interface").end, "video after interface");
+  check(video.begin >= get(timings, "gstreamer_init").end,
+        "video after gstreamer");
+  // Telemetry can talk to the ground before the video is ready
+  check(get(timings, "telemetry_link").end <= video.end,
+        "telemetry link doesn't wait for video");
+  const auto critical_path = startup.get_critical_path();
+  std::cout << "Critical path:" << OHDUtil::str_vec_as_string(critical_path)
+            << "\n";
+  check(critical_path == std::vector<std::string>{"interface", "video_air",
+                                                  "telemetry_settings"},
+        "critical path");
+  const auto trace = nlohmann::json::parse(startup.create_chrome_trace_json());
+  check(trace["traceEvents"].size() == 7, "trace events");
+  for (const auto& event : trace["traceEvents"]) {
+    check(event["ph"] == "X", "complete events");
+  }
+  check(startup.write_chrome_trace("/tmp/test_startup_trace.json"),
+        "write trace");
+}
+
+static void test_failure() {
+  openhd::StartupOrchestrator startup{};
+  bool independent_ran = false;
+  startup.add_step("a", {},
+                   []() { throw std::runtime_error("Cannot open serial"); });
+  startup.add_step("b", {"a"}, sleep_ms(1));
+  startup.add_step("c", {}, [&independent_ran]() { independent_ran = true; });
+  bool thrown = false;
+  try {
+    startup.run();
+  } catch (std::runtime_error& ex) {
+    thrown = true;
+  }
+  check(thrown, "exception re-thrown");
+  check(independent_ran, "independent step ran");
+  const auto timings = startup.get_timings();
+  check(get(timings, "a").failed, "failed");
+  check(get(timings, "b").skipped, "dependent skipped");
+}
+
+static void test_invalid_graph() {
+  openhd::StartupOrchestrator startup{};
+  startup.add_step("a", {"b"}, sleep_ms(1));
+  startup.add_step("b", {"a"}, sleep_ms(1));
+  bool thrown = false;
+  try {
+    startup.run();
+  } catch (std::runtime_error& ex) {
+    thrown = true;
+  }
+  check(thrown, "cycle detected");
+  openhd::StartupOrchestrator startup2{};
+  startup2.add_step("a", {"does_not_exist"}, sleep_ms(1));
+  thrown = false;
+  try {
+    startup2.run();
+  } catch (std::runtime_error& ex) {
+    thrown = true;
+  }
+  check(thrown, "unknown dependency detected");
+}
+
+// A trace written by openhd (see top)
+static void validate_boot_trace(const std::string& filename) {
+  const auto content = OHDFilesystemUtil::opt_read_file(filename);
+  check(content.has_value(), "boot trace exists");
+  const auto trace = nlohmann::json::parse(content.value());
+  std::map<std::string, nlohmann::json> events;
+  for (const auto& event : trace["traceEvents"]) {
+    events[event["name"]] = event;
+  }
+  auto end = [&events](const std::string& name) -> int64_t {
+    return events.at(name)["ts"].get<int64_t>() +
+           events.at(name)["dur"].get<int64_t>();
+  };
+  for (const auto& [name, event] : events) {
+    check(!event["args"]["failed"].get<bool>(), name + " failed");
+    // Each step starts as soon as its own dependencies are done
+    int64_t deps_end = 0;
+    for (const auto& dep : event["args"]["dependencies"]) {
+      deps_end = std::max(deps_end, end(dep));
+    }
+    check(event["ts"].get<int64_t>() - deps_end < 100 * 1000,
+          name + " started late");
+    std::cout << name << " " << event["ts"].get<int64_t>() / 1000 << "ms.."
+              << end(name) / 1000 << "ms"
+              << (event["args"]["critical"].get<bool>() ? " (critical)" : "")
+              << "\n";
+  }
+  check(events.count("telemetry") && events.count("interface"),
+        "telemetry and interface");
+  const std::string video =
+      events.count("video_air") ? "video_air" : "video_ground";
+  check(events.count(video), "video");
+  // First heartbeat (telemetry link) doesn't wait for the video
+  check(end("telemetry_link") <= end(video) ||
+            events["telemetry_link"]["ts"] < events[video]["ts"],
+        "telemetry link independent of video");
+}
+
+int main(int argc, char* argv[]) {
+  test_air_like_startup();
+  validate_boot_trace("/tmp/test_startup_trace.json");
+  test_failure();
+  test_invalid_graph();
+  if (argc > 1) {
+    validate_boot_trace(argv[1]);
+  }
+  std::cout << "PASSED\n";
+  return 0;
+}
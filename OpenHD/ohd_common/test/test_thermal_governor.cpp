@@ -0,0 +1,318 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Thermal protection test: sensor discovery on a fake sysfs tree, then the
+// governor against a simulated thermal model of a wifi card and a SoC
+// (first order, heat from tx power * air time and from encoding), with a
+// virtual clock. Checks that the temperature is held at the setpoint with
+// video on, that this delivers more bitrate than the previous 3 level X20
+// logic, that video is only disabled when nothing else helps and that the
+// throttle is released (slowly) again once cooled down.
+// Prints the simulated temperature / throttle over time with --verbose.
+//
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+#include "openhd_thermal.h"
+#include "openhd_util_filesystem.h"
+
+using namespace openhd::thermal;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static const std::string TEST_DIR = "/tmp/test_thermal_governor";
+
+static void test_discovery() {
+  OHDFilesystemUtil::safe_delete_directory(TEST_DIR);
+  auto add_file = [](const std::string& path, const std::string& content) {
+    const auto dir = path.substr(0, path.find_last_of('/'));
+    OHDFilesystemUtil::create_directories(dir);
+    OHDFilesystemUtil::write_file(path, content);
+  };
+  const auto root = TEST_DIR + "/class";
+  add_file(root + "/thermal/thermal_zone0/type", "cpu-thermal\n");
+  add_file(root + "/thermal/thermal_zone0/temp", "55123\n");
+  add_file(root + "/thermal/thermal_zone1/type", "nvme\n");
+  add_file(root + "/thermal/thermal_zone1/temp", "40000\n");
+  add_file(root + "/hwmon/hwmon0/name", "rtl88x2bu\n");
+  add_file(root + "/hwmon/hwmon0/temp1_input", "71000\n");
+  // Unknown name, but a network device
+  add_file(root + "/hwmon/hwmon1/name", "someradio\n");
+  add_file(root + "/hwmon/hwmon1/temp1_input", "0\n");
+  OHDFilesystemUtil::create_directories(root + "/hwmon/hwmon1/device/net");
+  add_file(root + "/hwmon/hwmon2/name", "coretemp\n");
+  add_file(root + "/hwmon/hwmon2/temp2_input", "61000\n");
+  // No temperature
+  add_file(root + "/hwmon/hwmon3/name", "fan\n");
+  const auto sensors = discover_sensors(root);
+  std::cout << "Discovered " << sensors_to_string(sensors) << "\n";
+  check(sensors.size() == 5, "5 sensors");
+  check(sensors[0].name == "thermal_zone0:cpu-thermal" &&
+            sensors[0].type == SensorType::SOC,
+        "cpu thermal zone");
+  check(sensors[1].type == SensorType::OTHER, "nvme");
+  check(sensors[2].name == "hwmon0:rtl88x2bu" &&
+            sensors[2].type == SensorType::WIFI_CARD,
+        "card by name");
+  check(sensors[3].type == SensorType::WIFI_CARD, "card by device");
+  check(sensors[4].type == SensorType::SOC &&
+            sensors[4].temp_path == root + "/hwmon/hwmon2/temp2_input",
+        "coretemp");
+  const auto readings = read_sensors(sensors);
+  // The card reporting 0 (not ready) is skipped
+  check(readings.size() == 4, "4 readings");
+  check(readings[0].temperature_millidegree == 55123, "read temperature");
+  OHDFilesystemUtil::safe_delete_directory(TEST_DIR);
+}
+
+// First order model, heat in watt, returns the new temperature
+struct ThermalMass {
+  double temperature_c;
+  // degree per watt and joule per degree
+  double resistance;
+  double capacity;
+  void step(double ambient_c, double heat_w, double dt_s) {
+    const double cooling_w = (temperature_c - ambient_c) / resistance;
+    temperature_c += (heat_w - cooling_w) * dt_s / capacity;
+  }
+};
+
+struct SimulatedUnit {
+  double ambient_c = 45;
+  ThermalMass card{45, 2.0, 30};
+  ThermalMass soc{45, 1.5, 40};
+  // Card: idle + PA (proportional to tx power and air time)
+  double card_idle_w = 5;
+  double card_tx_w = 27.5;
+  // SoC: idle + encoder (proportional to bitrate)
+  double soc_idle_w = 15;
+  double soc_encoder_w = 10;
+  void step(double tx_power_factor, double bitrate_factor, double dt_s) {
+    card.step(ambient_c,
+              card_idle_w + card_tx_w * tx_power_factor * bitrate_factor, dt_s);
+    soc.step(ambient_c, soc_idle_w + soc_encoder_w * bitrate_factor, dt_s);
+  }
+  std::vector<SensorReading> read() const {
+    return {{"card", SensorType::WIFI_CARD,
+             static_cast<int>(card.temperature_c * 1000)},
+            {"soc", SensorType::SOC,
+             static_cast<int>(soc.temperature_c * 1000)}};
+  }
+};
+
+struct SimulationResult {
+  double max_card_c_settled = 0;
+  double max_soc_c_settled = 0;
+  double avg_bitrate_factor_settled = 0;
+  int n_seconds_video_disabled = 0;
+  GovernorState final_state;
+};
+
+// Controller gets the readings once per second, returns tx power and bitrate
+// factor (0 = video disabled)
+using CONTROLLER =
+    std::function<std::pair<double, double>(const std::vector<SensorReading>&)>;
+
+using ON_SECOND = std::function<void(int second, SimulatedUnit& unit)>;
+
+static SimulationResult simulate(SimulatedUnit unit,
+                                 const CONTROLLER& controller, int duration_s,
+                                 bool verbose,
+                                 const ON_SECOND& on_second = nullptr) {
+  SimulationResult result{};
+  // The first half is heating up
+  const int settled_after_s = duration_s / 2;
+  double bitrate_sum = 0;
+  for (int second = 0; second < duration_s; second++) {
+    if (on_second) on_second(second, unit);
+    const auto [tx_power_factor, bitrate_factor] = controller(unit.read());
+    if (bitrate_factor <= 0) result.n_seconds_video_disabled++;
+    for (int i = 0; i < 10; i++) {
+      unit.step(tx_power_factor, bitrate_factor, 0.1);
+    }
+    if (second >= settled_after_s) {
+      result.max_card_c_settled =
+          std::max(result.max_card_c_settled, unit.card.temperature_c);
+      result.max_soc_c_settled =
+          std::max(result.max_soc_c_settled, unit.soc.temperature_c);
+      bitrate_sum += bitrate_factor;
+    }
+    if (verbose && second % 30 == 0) {
+      std::cout << second << "s card:" << unit.card.temperature_c
+                << "C soc:" << unit.soc.temperature_c
+                << "C tx_power:" << tx_power_factor
+                << " bitrate:" << bitrate_factor << "\n";
+    }
+  }
+  result.avg_bitrate_factor_settled =
+      bitrate_sum / (duration_s - settled_after_s);
+  return result;
+}
+
+static CONTROLLER create_governor_controller(Governor& governor) {
+  return [&governor](const std::vector<SensorReading>& readings) {
+    const auto state = governor.update(readings);
+    if (state.video_disabled) return std::make_pair(state.tx_power_factor, 0.0);
+    return std::make_pair(state.tx_power_factor, state.bitrate_factor);
+  };
+}
+
+// What WBLink did before (X20 only): 70% of the rate, 30% above 85 degree,
+// video off above 95 until <= 70, each level held for at least 10s
+static CONTROLLER create_legacy_controller() {
+  struct State {
+    int level = 0;
+    int seconds_in_level = 0;
+  };
+  auto state = std::make_shared<State>();
+  return [state](const std::vector<SensorReading>& readings) {
+    const int temp = readings[0].temperature_millidegree / 1000;
+    int new_level = temp >= 95 ? 2 : (temp >= 85 ? 1 : 0);
+    state->seconds_in_level++;
+    if (new_level > state->level) {
+      state->level = new_level;
+      state->seconds_in_level = 0;
+    } else if (new_level < state->level && state->seconds_in_level >= 10) {
+      if (state->level != 2 || temp <= 70) state->level = new_level;
+    }
+    const double bitrate =
+        state->level == 2 ? 0.0 : (state->level == 1 ? 0.3 / 0.7 : 1.0);
+    return std::make_pair(1.0, bitrate);
+  };
+}
+
+static void test_hold_setpoint(bool verbose) {
+  std::cout << "Hot unit, governor\n";
+  Governor governor{};
+  const auto result = simulate(SimulatedUnit{},
+                               create_governor_controller(governor), 1800,
+                               verbose);
+  std::cout << "Card max " << result.max_card_c_settled << "C SoC max "
+            << result.max_soc_c_settled << "C avg bitrate "
+            << result.avg_bitrate_factor_settled << " "
+            << governor_state_to_string(governor.get_state()) << "\n";
+  // Without protection, the card would settle at 110 degree
+  check(result.max_card_c_settled <= 85.5, "card held at setpoint");
+  check(result.max_soc_c_settled <= 80.5, "soc held at setpoint");
+  check(result.n_seconds_video_disabled == 0, "video never disabled");
+  check(result.avg_bitrate_factor_settled >
+            governor.get_config().min_bitrate_factor,
+        "bitrate above minimum");
+
+  std::cout << "Hot unit, previous logic\n";
+  const auto legacy =
+      simulate(SimulatedUnit{}, create_legacy_controller(), 1800, verbose);
+  std::cout << "Card max " << legacy.max_card_c_settled << "C avg bitrate "
+            << legacy.avg_bitrate_factor_settled * 0.7 << " (of 70%)\n";
+  // The previous logic only used 70% of the rate to begin with
+  check(result.avg_bitrate_factor_settled >
+            legacy.avg_bitrate_factor_settled * 0.7,
+        "more bitrate than before");
+}
+
+static void test_critical(bool verbose) {
+  std::cout << "Unit in the sun, governor\n";
+  Governor governor{};
+  SimulatedUnit unit{};
+  unit.ambient_c = 80;
+  bool was_disabled = false;
+  bool re_enabled = false;
+  auto controller = create_governor_controller(governor);
+  const auto result = simulate(
+      unit,
+      [&](const std::vector<SensorReading>& readings) {
+        const auto ret = controller(readings);
+        if (ret.second <= 0) {
+          was_disabled = true;
+        } else if (was_disabled) {
+          re_enabled = true;
+        }
+        return ret;
+      },
+      1800, verbose, [](int second, SimulatedUnit& unit) {
+        // Back in the shade after 10 minutes
+        if (second == 600) unit.ambient_c = 40;
+      });
+  check(was_disabled, "video disabled when critical");
+  check(re_enabled, "video re-enabled after cool down");
+  const auto state = governor.get_state();
+  std::cout << governor_state_to_string(state) << "\n";
+  check(!state.video_disabled, "video on at the end");
+  check(result.max_card_c_settled <= 85.5, "card held at setpoint");
+  check(state.bitrate_factor > governor.get_config().min_bitrate_factor,
+        "bitrate above minimum");
+}
+
+static void test_release() {
+  Governor governor{};
+  governor.update({{"card", SensorType::WIFI_CARD, 85 * 1000}});
+  check(governor.get_state().throttle_wifi_card == 1.0, "full throttle");
+  check(governor.get_state().tx_power_factor ==
+            governor.get_config().min_tx_power_factor,
+        "min tx power");
+  // Cooled down - the throttle is released slowly, not all at once
+  int n_updates = 0;
+  double prev_throttle = 1.0;
+  while (governor.get_state().throttle_wifi_card > 0 && n_updates < 100) {
+    governor.update({{"card", SensorType::WIFI_CARD, 50 * 1000}});
+    const double throttle = governor.get_state().throttle_wifi_card;
+    check(prev_throttle - throttle <=
+              governor.get_config().max_throttle_decrease_per_update + 1e-9,
+          "slow release");
+    prev_throttle = throttle;
+    n_updates++;
+  }
+  check(n_updates >= 10 && n_updates < 100, "released");
+  const auto state = governor.get_state();
+  check(state.tx_power_factor == 1.0 && state.bitrate_factor == 1.0,
+        "full tx power and bitrate");
+}
+
+static void test_no_sensors() {
+  Governor governor{};
+  const auto state = governor.update({});
+  check(state.bitrate_factor == 1.0 && state.tx_power_factor == 1.0 &&
+            !state.video_disabled,
+        "no sensors, no throttle");
+  // Other sensors (e.g. nvme) are ignored
+  const auto state2 =
+      governor.update({{"nvme", SensorType::OTHER, 120 * 1000}});
+  check(state2.bitrate_factor == 1.0, "other sensor ignored");
+}
+
+int main(int argc, char* argv[]) {
+  const bool verbose = argc > 1 && std::string(argv[1]) == "--verbose";
+  test_discovery();
+  test_no_sensors();
+  test_hold_setpoint(verbose);
+  test_critical(verbose);
+  test_release();
+  std::cout << "Done\n";
+  return 0;
+}
@@ -0,0 +1,157 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the thread policy (names, niceness, affinity, SCHED_FIFO if we have the
+// permissions, e.g. when run as root) and the per thread cpu monitor.
+//
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#include "openhd_thread_policy.h"
+#include "openhd_util_filesystem.h"
+
+using namespace openhd::thread;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static std::string get_name(pid_t tid) {
+  auto name = OHDFilesystemUtil::read_file("/proc/self/task/" +
+                                           std::to_string(tid) + "/comm");
+  if (!name.empty() && name.back() == '\n') name.pop_back();
+  return name;
+}
+
+static void test_platform_policy() {
+  const int64_t MB = 1024 * 1024;
+  // hardware.config defaults (auto mlockall)
+  const auto pi_zero = create_policy_for_platform(4, 512 * MB);
+  check(!pi_zero.lock_memory, "no mlockall with 512MB");
+  check(pi_zero.classes.at(ThreadClass::BACKGROUND).cpus ==
+            std::vector<int>{0},
+        "background on cpu0");
+  check(pi_zero.classes.at(ThreadClass::REALTIME_VIDEO_TX).cpus ==
+            std::vector<int>({1, 2, 3}),
+        "video tx not on cpu0");
+  check(pi_zero.classes.at(ThreadClass::REALTIME_VIDEO_TX).rt_priority > 0,
+        "video tx fifo");
+  check(pi_zero.classes.at(ThreadClass::NORMAL).cpus.empty(), "normal all");
+  const auto single_core = create_policy_for_platform(1, 2048 * MB);
+  check(single_core.lock_memory, "mlockall with 2GB");
+  for (const auto& [thread_class, policy] : single_core.classes) {
+    check(policy.cpus.empty(), "no affinity on single core");
+  }
+  std::cout << pi_zero.to_string() << "\n";
+}
+
+static void test_apply() {
+  const int n_cpus = std::max(1, (int)std::thread::hardware_concurrency());
+  Policy policy{};
+  policy.enable = true;
+  policy.classes[ThreadClass::BACKGROUND] = ClassPolicy{0, 10, {n_cpus - 1}};
+  policy.classes[ThreadClass::REALTIME_VIDEO_TX] = ClassPolicy{10, -10, {}};
+  std::thread([&policy, n_cpus]() {
+    set_current_thread("very_long_background_name", ThreadClass::BACKGROUND,
+                       policy);
+    const pid_t tid = (pid_t)syscall(SYS_gettid);
+    check(get_name(tid) == "very_long_backg", "name truncated");
+    errno = 0;
+    check(getpriority(PRIO_PROCESS, tid) == 10, "background nice");
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    check(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0,
+          "get affinity");
+    check(CPU_COUNT(&set) == 1 && CPU_ISSET(n_cpus - 1, &set), "affinity");
+  }).join();
+  std::thread([&policy]() {
+    set_current_thread("video_tx", ThreadClass::REALTIME_VIDEO_TX, policy);
+    int sched_policy = 0;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &sched_policy, &param);
+    if (sched_policy == SCHED_FIFO) {
+      check(param.sched_priority == 10, "fifo priority");
+      std::cout << "SCHED_FIFO applied\n";
+    } else {
+      // Not root, we fall back to (and probably can't lower) the nice value
+      std::cout << "SCHED_FIFO not permitted, skipped\n";
+    }
+  }).join();
+  // Disabled policy only names the thread
+  std::thread([]() {
+    Policy disabled{};
+    disabled.classes[ThreadClass::BACKGROUND] = ClassPolicy{0, 10, {}};
+    set_current_thread("only_named", ThreadClass::BACKGROUND, disabled);
+    const pid_t tid = (pid_t)syscall(SYS_gettid);
+    check(get_name(tid) == "only_named", "name");
+    check(getpriority(PRIO_PROCESS, tid) == 0, "disabled");
+  }).join();
+}
+
+static void test_cpu_monitor() {
+  std::atomic<bool> run = true;
+  std::thread busy([&run]() {
+    pthread_setname_np(pthread_self(), "test_busy");
+    volatile uint64_t x = 0;
+    while (run) x = x + 1;
+  });
+  std::thread idle([&run]() {
+    pthread_setname_np(pthread_self(), "test_idle");
+    while (run) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ThreadCpuMonitor monitor{};
+  monitor.sample();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  const auto usage = monitor.sample();
+  run = false;
+  busy.join();
+  idle.join();
+  std::cout << ThreadCpuMonitor::to_string(usage) << "\n";
+  float busy_perc = -1, idle_perc = -1;
+  for (const auto& thread : usage) {
+    if (thread.name == "test_busy") busy_perc = thread.cpu_perc;
+    if (thread.name == "test_idle") idle_perc = thread.cpu_perc;
+  }
+  check(busy_perc >= 50, "busy thread usage");
+  check(idle_perc >= 0 && idle_perc < 10, "idle thread usage");
+  check(usage.front().name == "test_busy", "sorted");
+}
+
+int main(int argc, char* argv[]) {
+  test_platform_policy();
+  test_apply();
+  test_cpu_monitor();
+  std::cout << "PASSED\n";
+  return 0;
+}
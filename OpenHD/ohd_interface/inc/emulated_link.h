@@ -0,0 +1,145 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_EMULATED_LINK_H
+#define OPENHD_EMULATED_LINK_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ethernet_fec.h"
+#include "openhd_link.hpp"
+
+/**
+ * Hermetic (no hardware, no root) link for testing and benchmarking the
+ * whole air to ground path in one process. Packets go through an impaired
+ * channel that can drop, delay, reorder and rate limit them.
+ */
+namespace openhd::emulation {
+
+struct ImpairmentParams {
+  // Random (uniform) packet loss
+  double loss_perc = 0;
+  // Packets that get reorder_delay added on top
+  double reorder_perc = 0;
+  std::chrono::microseconds reorder_delay = std::chrono::microseconds(3000);
+  std::chrono::microseconds delay{0};
+  // Uniform in [0, jitter]
+  std::chrono::microseconds jitter{0};
+  // Emulates the air time of each packet, 0 means unlimited
+  int rate_kbits = 0;
+  // Tail drop if the rate limited queue gets longer than that
+  std::chrono::milliseconds max_queue_delay = std::chrono::milliseconds(200);
+  uint32_t seed = 1;
+};
+
+class ImpairedChannel {
+ public:
+  typedef std::function<void(const uint8_t* data, int data_len)> DELIVER_CB;
+  ImpairedChannel(ImpairmentParams params, DELIVER_CB cb);
+  ~ImpairedChannel();
+  ImpairedChannel(const ImpairedChannel&) = delete;
+  ImpairedChannel(const ImpairedChannel&&) = delete;
+  void send(const uint8_t* data, int data_len);
+  void set_params(const ImpairmentParams& params);
+  struct Stats {
+    uint64_t n_sent = 0;
+    uint64_t n_dropped_loss = 0;
+    uint64_t n_dropped_queue = 0;
+    uint64_t n_reordered = 0;
+    uint64_t n_delivered = 0;
+  };
+  Stats get_stats();
+
+ private:
+  struct Item {
+    std::chrono::steady_clock::time_point deliver_at;
+    uint64_t seq;
+    std::vector<uint8_t> data;
+    bool operator>(const Item& other) const {
+      return deliver_at != other.deliver_at ? deliver_at > other.deliver_at
+                                            : seq > other.seq;
+    }
+  };
+  const DELIVER_CB m_cb;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  ImpairmentParams m_params;
+  std::mt19937 m_rng;
+  std::priority_queue<Item, std::vector<Item>, std::greater<>> m_queue;
+  uint64_t m_seq = 0;
+  // When the emulated medium is free again (rate limit)
+  std::chrono::steady_clock::time_point m_medium_free_at{};
+  Stats m_stats{};
+  bool m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+  void loop();
+};
+
+class EmulatedLink : public OHDLink {
+ public:
+  struct Options {
+    ImpairmentParams air_to_ground{};
+    ImpairmentParams ground_to_air{};
+    // Video FEC (see ethernet_fec.h), 0 = disabled
+    int video_fec_percentage = 0;
+  };
+  // Creates an air and a ground instance connected to each other
+  static std::pair<std::shared_ptr<EmulatedLink>, std::shared_ptr<EmulatedLink>>
+  create_pair(const Options& options);
+  explicit EmulatedLink(bool is_air, int video_fec_percentage);
+  ~EmulatedLink();
+  void transmit_telemetry_data(TelemetryTxPacket packet) override;
+  void transmit_video_data(
+      int stream_index,
+      const openhd::FragmentedVideoFrame& fragmented_video_frame) override;
+  void transmit_audio_data(const openhd::AudioPacket& audio_packet) override;
+  // Stats of the channel this instance transmits on
+  ImpairedChannel::Stats get_tx_channel_stats();
+  // Only valid on ground, if FEC is enabled
+  openhd::ethernet::FECDecoder::Stats get_video_fec_rx_stats(int stream_index);
+  void set_tx_impairment(const ImpairmentParams& params);
+
+ private:
+  const bool m_is_air;
+  std::unique_ptr<ImpairedChannel> m_tx_channel;
+  std::array<std::unique_ptr<openhd::ethernet::FECEncoder>, 2> m_video_fec_tx;
+  std::array<std::unique_ptr<openhd::ethernet::FECDecoder>, 2> m_video_fec_rx;
+  void connect_to(const std::shared_ptr<EmulatedLink>& peer,
+                  const ImpairmentParams& params);
+  void on_channel_rx(const uint8_t* data, int data_len);
+};
+
+}  // namespace openhd::emulation
+
+#endif  // OPENHD_EMULATED_LINK_H
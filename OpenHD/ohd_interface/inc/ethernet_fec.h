@@ -0,0 +1,164 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_ETHERNET_FEC_H
+#define OPENHD_ETHERNET_FEC_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/**
+ * Packet level FEC for the ethernet link (and other links that go over plain
+ * UDP). The fragments of one frame are split into blocks of at most
+ * max_block_size primary fragments, for each block n secondary (parity)
+ * fragments are created using a systematic Reed-Solomon (Cauchy) erasure code
+ * over GF(256). Any n_primary of the n_primary+n_secondary fragments of a block
+ * are enough to reconstruct it.
+ */
+namespace openhd::ethernet {
+
+// Prefixed to each (primary or secondary) fragment
+struct FECHeader {
+  uint32_t block_idx;
+  uint8_t fragment_idx;
+  uint8_t n_primary;
+  uint8_t n_secondary;
+  uint8_t flags;
+} __attribute__((packed));
+static_assert(sizeof(FECHeader) == 8);
+
+// A primary fragment is [header][size][data], a secondary fragment is
+// [header][parity over size+data padded to the biggest fragment in the block]
+static constexpr int FEC_PRIMARY_SIZE_PREFIX = 2;
+static constexpr int FEC_MAX_FRAGMENTS_PER_BLOCK = 255;
+static constexpr int FEC_MAX_PAYLOAD_SIZE = 65000;
+
+// GF(256) Cauchy erasure code, exposed for testing
+class FECCode {
+ public:
+  // Calculates secondary fragments from the primary fragments (all primary
+  // fragments need to have the same size).
+  static void encode(const std::vector<const uint8_t*>& primaries,
+                     std::vector<uint8_t*>& secondaries, std::size_t size);
+  // fragments has n_primary+n_secondary entries, nullptr if missing (at least
+  // n_primary need to be valid). Reconstructs the missing primary fragments in
+  // place.
+  static bool decode(std::vector<uint8_t*>& fragments, int n_primary,
+                     std::size_t size);
+};
+
+class FECEncoder {
+ public:
+  // fec_percentage: n_secondary = ceil(n_primary * fec_percentage / 100),
+  // 0 means no secondary fragments (header only)
+  explicit FECEncoder(int fec_percentage, int max_block_size = 64);
+  void set_fec_percentage(int fec_percentage);
+  int get_fec_percentage() const { return m_fec_percentage; }
+  /**
+   * Creates the packets (primary, then secondary fragments) for one frame.
+   * All fragments of the frame are consumed at once, such that the FEC blocks
+   * are aligned to frames (no added latency).
+   */
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> encode_frame(
+      const std::vector<std::shared_ptr<std::vector<uint8_t>>>& fragments);
+  struct Stats {
+    uint64_t n_blocks = 0;
+    uint64_t n_primary = 0;
+    uint64_t n_secondary = 0;
+    std::chrono::nanoseconds encode_time_max{};
+    std::chrono::nanoseconds encode_time_sum{};
+  };
+  Stats get_stats();
+
+ private:
+  int m_fec_percentage;
+  const int m_max_block_size;
+  uint32_t m_block_idx = 0;
+  std::mutex m_stats_mutex;
+  Stats m_stats{};
+  void encode_block(
+      const std::shared_ptr<std::vector<uint8_t>>* fragments, int n_fragments,
+      std::vector<std::shared_ptr<std::vector<uint8_t>>>& out);
+};
+
+/**
+ * Reassembles blocks, forwards the primary fragments (in order within a block)
+ * as soon as possible and recovers missing ones once enough fragments of a
+ * block are there. A block that cannot be recovered is given up once
+ * max_blocks_in_flight newer blocks have been seen.
+ */
+class FECDecoder {
+ public:
+  typedef std::function<void(const uint8_t* data, int data_len)>
+      OUTPUT_DATA_CALLBACK;
+  explicit FECDecoder(OUTPUT_DATA_CALLBACK cb, int max_blocks_in_flight = 8);
+  // Not thread safe (call from the receive thread)
+  void process_packet(const uint8_t* data, int data_len);
+  // Same semantics as the wifibroadcast FEC rx stats
+  struct Stats {
+    uint32_t count_blocks_total = 0;
+    uint32_t count_blocks_lost = 0;
+    uint32_t count_blocks_recovered = 0;
+    uint32_t count_fragments_recovered = 0;
+    uint32_t count_invalid_packets = 0;
+    std::chrono::nanoseconds decode_time_max{};
+  };
+  Stats get_stats();
+
+ private:
+  struct Block {
+    uint32_t block_idx;
+    int n_primary;
+    int n_secondary;
+    std::vector<std::vector<uint8_t>> fragments;
+    std::vector<bool> available;
+    int n_available = 0;
+    int n_available_primary = 0;
+    // all primary fragments before this one have been forwarded / skipped
+    int next_to_forward = 0;
+    bool done = false;
+  };
+  const OUTPUT_DATA_CALLBACK m_cb;
+  const int m_max_blocks_in_flight;
+  std::deque<Block> m_blocks;
+  // All blocks before that are done
+  std::optional<uint32_t> m_first_open_block_idx;
+  std::mutex m_stats_mutex;
+  Stats m_stats{};
+  Block* get_or_create_block(const FECHeader& header);
+  void forward_available(Block& block);
+  void forward_fragment(const std::vector<uint8_t>& fragment);
+  bool try_recover(Block& block);
+  void give_up_oldest_block();
+  void remove_done_blocks();
+};
+
+}  // namespace openhd::ethernet
+
+#endif  // OPENHD_ETHERNET_FEC_H
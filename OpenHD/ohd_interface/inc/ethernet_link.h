@@ -24,9 +24,12 @@
 #ifndef OPENHD_ETHERNET_LINK_H
 #define OPENHD_ETHERNET_LINK_H
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <thread>
 
+#include "ethernet_fec.h"
 #include "openhd_config.h"
 #include "openhd_link.hpp"
 #include "openhd_udp.h"
@@ -59,9 +62,22 @@ class EthernetLink : public OHDLink {
   std::unique_ptr<openhd::UDPForwarder>
       m_telemetry_tx;                                   // Telemetry transmitter
   std::unique_ptr<openhd::UDPReceiver> m_telemetry_rx;  // Telemetry receiver
+  // Optional (ETH_FEC_ENABLE) packet level FEC, null if disabled
+  std::unique_ptr<openhd::ethernet::FECEncoder> m_video_fec_tx;
+  std::unique_ptr<openhd::ethernet::FECEncoder> m_telemetry_fec_tx;
+  std::mutex m_telemetry_fec_tx_mutex;
+  std::unique_ptr<openhd::ethernet::FECDecoder> m_video_fec_rx;
+  std::unique_ptr<openhd::ethernet::FECDecoder> m_telemetry_fec_rx;
+  std::atomic<uint64_t> m_video_rx_bytes = 0;
+  std::atomic<uint64_t> m_video_tx_bytes = 0;
+  std::atomic<uint64_t> m_video_tx_packets = 0;
+  std::unique_ptr<std::thread> m_stats_thread;
+  std::atomic<bool> m_stats_thread_run = true;
 
+  void initialize_fec();
   void initialize_air_unit();
   void initialize_ground_unit();
+  void loop_stats();
 
   void handle_video_data(int stream_index, const uint8_t* data, int data_len);
   void handle_telemetry_data(const uint8_t* data, int data_len);
@@ -0,0 +1,164 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_MICROHARD_AT_CLIENT_H
+#define OPENHD_MICROHARD_AT_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+namespace openhd::microhard {
+
+// Values reported by the modem, std::nullopt if not (yet) known
+struct ModemStats {
+  std::optional<int> rssi_dbm;
+  std::optional<int> noise_floor_dbm;
+  std::optional<int> snr_db;
+  std::optional<int> frequency_mhz;
+  std::optional<int> bandwidth_mhz;
+  std::optional<int> tx_power_dbm;
+  std::optional<int> rate_mode;
+};
+
+/**
+ * Keeps one telnet session to the microhard modem alive and polls it with AT
+ * commands at a configurable rate.
+ * Everything is done by a single thread using non-blocking sockets (epoll) -
+ * login is driven by the prompts the modem sends (no fixed sleeps), the
+ * queries of one poll cycle are written at once (pipelined) and their replies
+ * are matched in order. On error / timeout, the session is re-established with
+ * a backoff.
+ */
+class ATClient {
+ public:
+  struct Options {
+    std::string ip;
+    int port = 23;
+    std::string username = "admin";
+    std::string password;
+    std::chrono::milliseconds poll_interval = std::chrono::milliseconds(500);
+    // Values that rarely change (frequency, tx power, ...) are only queried
+    // every n-th poll
+    int slow_query_divider = 10;
+    // For connecting, each login step and each reply
+    std::chrono::milliseconds timeout = std::chrono::milliseconds(3000);
+    std::chrono::milliseconds max_reconnect_backoff =
+        std::chrono::milliseconds(10000);
+  };
+  enum class State {
+    DISCONNECTED,
+    CONNECTING,
+    WAIT_LOGIN_PROMPT,
+    WAIT_PASSWORD_PROMPT,
+    WAIT_COMMAND_PROMPT,
+    READY
+  };
+  struct Counters {
+    int n_connects = 0;
+    int n_disconnects = 0;
+    int n_poll_cycles = 0;
+    int n_timeouts = 0;
+    int n_parse_errors = 0;
+  };
+  // Called (from the client thread) once per completed poll cycle
+  typedef std::function<void(const ModemStats& stats)> STATS_CALLBACK;
+  ATClient(Options options, STATS_CALLBACK cb);
+  ~ATClient();
+  ATClient(const ATClient&) = delete;
+  ATClient(const ATClient&&) = delete;
+  void set_poll_interval(std::chrono::milliseconds poll_interval);
+  State get_state() const { return m_state; }
+  Counters get_counters();
+  ModemStats get_last_stats();
+  // Parsers, e.g. "-52 dBm" with unit "dBm" -> -52. Case insensitive, the unit
+  // needs to be followed by a non-letter (dB doesn't match dBm).
+  static std::optional<int> parse_value_with_unit(const std::string& response,
+                                                  const std::string& unit);
+  // First standalone number, ignoring the echoed AT command
+  static std::optional<int> parse_first_value(const std::string& response);
+  static std::string state_to_string(State state);
+
+ private:
+  struct Query {
+    std::string command;
+    // Where the parsed value goes
+    std::optional<int> ModemStats::*value;
+    // Empty: parse_first_value
+    std::string unit;
+  };
+  const Options m_options;
+  const STATS_CALLBACK m_cb;
+  std::shared_ptr<spdlog::logger> m_console;
+  std::atomic<State> m_state = State::DISCONNECTED;
+  std::atomic<int64_t> m_poll_interval_ms;
+  int m_epoll_fd = -1;
+  int m_wakeup_fd = -1;
+  int m_socket_fd = -1;
+  std::atomic<bool> m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+  // Only accessed from the client thread
+  std::string m_rx_buffer;
+  std::string m_tx_buffer;
+  // Incomplete telnet command sequence from the last read
+  std::string m_telnet_pending;
+  std::deque<Query> m_pending_queries;
+  std::string m_current_response;
+  ModemStats m_cycle_stats{};
+  int m_n_cycles_since_connect = 0;
+  std::chrono::steady_clock::time_point m_state_deadline;
+  std::chrono::steady_clock::time_point m_next_poll;
+  std::chrono::steady_clock::time_point m_next_connect;
+  std::chrono::milliseconds m_reconnect_backoff{0};
+  std::mutex m_stats_mutex;
+  Counters m_counters{};
+  ModemStats m_last_stats{};
+  void loop();
+  void start_connect();
+  void on_connected();
+  void disconnect(const std::string& reason, bool is_timeout = false);
+  void set_state(State state);
+  bool read_socket();
+  bool write_socket();
+  void send(const std::string& data);
+  void handle_rx();
+  void handle_reply_lines();
+  void send_poll_queries();
+  void check_timeouts();
+  // Removes telnet negotiation from data and refuses all options
+  std::string process_telnet(const std::string& data);
+  void update_epoll_events();
+};
+
+}  // namespace openhd::microhard
+
+#endif  // OPENHD_MICROHARD_AT_CLIENT_H
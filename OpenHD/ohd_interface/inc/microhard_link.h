@@ -24,6 +24,7 @@
 #ifndef OPENHD_MICROHARD_LINK_H
 #define OPENHD_MICROHARD_LINK_H
 
+#include "microhard_at_client.h"
 #include "openhd_link.hpp"
 #include "openhd_settings_imp.h"
 #include "openhd_udp.h"
@@ -34,6 +35,7 @@
 class MicrohardLink : public OHDLink {
  public:
   explicit MicrohardLink(OHDProfile profile);
+  ~MicrohardLink();
   void transmit_telemetry_data(TelemetryTxPacket packet) override;
   void transmit_video_data(
       int stream_index,
@@ -44,7 +46,6 @@ class MicrohardLink : public OHDLink {
    * and/or the used hardware
    */
   std::vector<openhd::Setting> get_all_settings();
-  static void monitor_gateway_signal_strength(const std::string& gateway_ip);
 
  private:
   const OHDProfile m_profile;
@@ -52,6 +53,10 @@ class MicrohardLink : public OHDLink {
   std::unique_ptr<openhd::UDPReceiver> m_video_rx;
   //
   std::unique_ptr<openhd::UDPReceiver> m_telemetry_tx_rx;
+  // Polls rssi / snr / noise from the modem (telnet, AT commands)
+  std::unique_ptr<openhd::microhard::ATClient> m_at_client;
+  int m_stats_interval_ms = 500;
+  void on_modem_stats(const openhd::microhard::ModemStats& modem_stats);
 };
 
 #endif  // OPENHD_MICROHARD_LINK_H
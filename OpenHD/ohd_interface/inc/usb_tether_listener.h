@@ -39,8 +39,8 @@
 /**
  * USB hotspot (USB Tethering).
  * Since the USB tethering is always initiated by the user (when he switches USB
- * Tethering on on his phone/tablet) we don't need any settings or similar, and
- * checking once every second barely uses any CPU resources. This was created by
+ * Tethering on on his phone/tablet) we don't need any settings or similar.
+ * Connect / disconnect is detected via openhd::HotplugMonitor (no polling). This was created by
  * translating the tether_functions.sh script from wifibroadcast-scripts into
  * c++. This class configures and forwards the connect and disconnect event(s)
  * for a USB tethering device, such that we can start/stop forwarding to the
@@ -0,0 +1,200 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_CHANNEL_SWITCH_H
+#define OPENHD_WB_CHANNEL_SWITCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+
+/**
+ * Coordinated, time scheduled channel (frequency / channel width) switch
+ * between air and ground.
+ * Before, the air just started reporting the new channel in its management
+ * frames, waited 2 seconds with video closed and then retuned - the ground
+ * followed once it noticed the air was gone, and if it never got the
+ * management frame, the link was lost until the user scanned for the air.
+ *
+ * Protocol:
+ * 1) Air announces the target channel together with the time left until the
+ * switch (several management frame intervals ahead) in every management frame.
+ * Air and ground don't share a clock, but the announce is relayed in ~1ms, so
+ * "switch in X ms" gives the ground the same switch time point in its own
+ * clock (re-calculated with every announce received).
+ * 2) Ground acknowledges the announce.
+ * 3) Both retune at the switch time point. If the air didn't get an ack, it
+ * postpones the switch (re-announcing) up to max_announce_attempts, then
+ * switches anyways.
+ * 4) During verify_window after the switch, both sides send fast and fall back
+ * to the old channel if no packet from the other side arrives within
+ * fallback_deadline. Since the side that falls back goes silent on the new
+ * channel, the other side then falls back, too.
+ * The classes here contain the protocol logic only, the current time is passed
+ * in by the caller (such that it can be tested with a virtual clock), and the
+ * actual retune is done via callback. They are thread safe (rx callback and
+ * management thread).
+ */
+namespace openhd::wb {
+
+struct ChannelSwitchConfig {
+  // Switch is scheduled this far ahead of the (first) announce, multiple
+  // management frame intervals (20ms during a change)
+  std::chrono::milliseconds lead_time{100};
+  // If the ground doesn't acknowledge, the switch is postponed this often
+  int max_announce_attempts = 3;
+  // Fall back to the previous channel if nothing is received from the other
+  // side for this long after the switch
+  std::chrono::milliseconds fallback_deadline{300};
+  // After this time, the switch is completed (should be > 2x fallback deadline)
+  std::chrono::milliseconds verify_window{1000};
+  // Packets received within this time after the retune might have been
+  // received on the old channel
+  std::chrono::milliseconds guard_time{5};
+};
+
+struct WBChannel {
+  int frequency_mhz;
+  int channel_width_mhz;
+  bool operator==(const WBChannel& other) const {
+    return frequency_mhz == other.frequency_mhz &&
+           channel_width_mhz == other.channel_width_mhz;
+  }
+  bool operator!=(const WBChannel& other) const { return !(*this == other); }
+};
+
+// Air -> ground, in each management frame while a switch is announced
+struct ChannelSwitchAnnounce {
+  uint16_t switch_id;
+  uint32_t target_frequency_mhz;
+  uint8_t target_channel_width_mhz;
+  uint32_t prev_frequency_mhz;
+  uint8_t prev_channel_width_mhz;
+  uint16_t ms_until_switch;
+} __attribute__((packed));
+
+// Ground -> air, when an announce was received and while verifying the switch
+struct ChannelSwitchAck {
+  uint16_t switch_id;
+  // 0 = still on the previous channel, 1 = retuned
+  uint8_t switched;
+} __attribute__((packed));
+
+struct ChannelSwitchStats {
+  int n_switches = 0;
+  int n_fallbacks = 0;
+  // Switches without announce, since the other side was not connected
+  int n_uncoordinated = 0;
+  // Announces that didn't get an ack in time (switch was postponed)
+  int n_postponed = 0;
+};
+
+// Called when it is time to retune to the given channel. is_fallback is true
+// when going back to the previous channel after a failed switch.
+using RETUNE_CB =
+    std::function<void(const WBChannel& channel, bool is_fallback)>;
+
+class ChannelSwitchAir {
+ public:
+  using Clock = std::chrono::steady_clock;
+  explicit ChannelSwitchAir(RETUNE_CB retune_cb,
+                            ChannelSwitchConfig config = {});
+  ChannelSwitchAir(const ChannelSwitchAir&) = delete;
+  ChannelSwitchAir(const ChannelSwitchAir&&) = delete;
+  /**
+   * Schedule a switch from the current to the target channel. If the ground is
+   * not connected, the switch is done right away (callback called before this
+   * returns). Returns false if a switch is already in progress.
+   */
+  bool request_switch(const WBChannel& current, const WBChannel& target,
+                      bool ground_connected, Clock::time_point now);
+  void on_ack(const ChannelSwitchAck& ack, Clock::time_point now);
+  // Any (management) packet from the ground
+  void on_packet_from_ground(Clock::time_point now);
+  // Performs the switch / fallback if due, and returns the announce to
+  // transmit if a switch is currently announced.
+  std::optional<ChannelSwitchAnnounce> update(Clock::time_point now);
+  // Next time point update() has something to do (or Clock::time_point::max())
+  Clock::time_point get_next_deadline();
+  bool is_in_progress();
+  ChannelSwitchStats get_stats();
+
+ private:
+  enum class State { IDLE, ANNOUNCING, VERIFYING };
+  const RETUNE_CB m_retune_cb;
+  const ChannelSwitchConfig m_config;
+  std::mutex m_mutex;
+  State m_state = State::IDLE;
+  uint16_t m_switch_id = 0;
+  WBChannel m_prev{};
+  WBChannel m_target{};
+  bool m_acked = false;
+  int m_n_attempts = 0;
+  Clock::time_point m_switch_tp;
+  Clock::time_point m_last_ground_packet_tp;
+  ChannelSwitchStats m_stats{};
+};
+
+class ChannelSwitchGround {
+ public:
+  using Clock = std::chrono::steady_clock;
+  explicit ChannelSwitchGround(RETUNE_CB retune_cb,
+                               ChannelSwitchConfig config = {});
+  ChannelSwitchGround(const ChannelSwitchGround&) = delete;
+  ChannelSwitchGround(const ChannelSwitchGround&&) = delete;
+  void on_announce(const ChannelSwitchAnnounce& announce,
+                   Clock::time_point now);
+  // Any (management) packet from the air
+  void on_packet_from_air(Clock::time_point now);
+  // Performs the switch / fallback if due, and returns the ack to transmit (if
+  // any)
+  std::optional<ChannelSwitchAck> update(Clock::time_point now);
+  Clock::time_point get_next_deadline();
+  bool is_in_progress();
+  ChannelSwitchStats get_stats();
+
+ private:
+  enum class State { IDLE, SCHEDULED, VERIFYING };
+  const RETUNE_CB m_retune_cb;
+  const ChannelSwitchConfig m_config;
+  std::mutex m_mutex;
+  State m_state = State::IDLE;
+  // Id of the last switch we performed, announces with this id are ignored
+  std::optional<uint16_t> m_last_switch_id;
+  uint16_t m_switch_id = 0;
+  WBChannel m_prev{};
+  WBChannel m_target{};
+  bool m_ack_pending = false;
+  Clock::time_point m_switch_tp;
+  Clock::time_point m_last_air_packet_tp;
+  ChannelSwitchStats m_stats{};
+};
+
+std::string channel_switch_stats_as_string(const ChannelSwitchStats& stats);
+
+}  // namespace openhd::wb
+
+#endif  // OPENHD_WB_CHANNEL_SWITCH_H
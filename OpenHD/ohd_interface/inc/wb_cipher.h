@@ -0,0 +1,72 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_CIPHER_H
+#define OPENHD_WB_CIPHER_H
+
+#include <chrono>
+#include <string>
+
+/**
+ * Micro-benchmark of the authenticated encryption used by wifibroadcast
+ * (ChaCha20-Poly1305, one libsodium call per packet), to find out which video
+ * bitrate can be encrypted in time with ultra secure encryption on. For
+ * comparison, AES-256-GCM can be measured too - with AES instructions
+ * (AES-NI + PCLMUL on x86, the ARMv8 crypto extensions on e.g. the rpi5) it is
+ * several times faster, without them (rpi 4 and older) it is not available.
+ */
+namespace openhd::wb {
+
+enum class CipherType { CHACHA20_POLY1305, AES256_GCM };
+std::string cipher_type_to_string(CipherType type);
+// False if the cpu lacks the instructions (AES-256-GCM)
+bool is_cipher_available(CipherType type);
+// The implementation libsodium uses on this cpu, for logging
+std::string cipher_implementation_to_string(CipherType type);
+
+struct CipherBenchmark {
+  CipherType type;
+  int packet_size;
+  // Throughput of the plain data, in MB/s (1e6 bytes)
+  double mb_per_s;
+  double us_per_packet;
+};
+// Encrypts packets of packet_size, one call (with key setup and a new buffer)
+// per packet like WBStreamTx does, for (about) the given duration on the
+// calling thread.
+CipherBenchmark benchmark_cipher(CipherType type, int packet_size,
+                                 std::chrono::milliseconds duration);
+// The median of n_runs benchmark_cipher() runs - a single short run can be
+// far off if the cpu is busy with something else at the same time.
+CipherBenchmark benchmark_cipher_median(CipherType type, int packet_size,
+                                        int n_runs,
+                                        std::chrono::milliseconds duration);
+// Video bitrate (payload) that can be encrypted using at most the given
+// share of one cpu core
+int max_encrypted_bitrate_kbits(const CipherBenchmark& benchmark,
+                                float cpu_share);
+std::string cipher_benchmark_to_string(const CipherBenchmark& benchmark);
+
+}  // namespace openhd::wb
+
+#endif  // OPENHD_WB_CIPHER_H
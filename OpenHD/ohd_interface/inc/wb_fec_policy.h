@@ -0,0 +1,147 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_FEC_POLICY_H
+#define OPENHD_WB_FEC_POLICY_H
+
+#include <mutex>
+#include <string>
+
+#include "openhd_video_frame.h"
+
+/**
+ * Unequal error protection for video.
+ * Before, every frame was sent with the same wb_video_fec_percentage - but
+ * not all frames are equal: losing a key frame (or the codec config in front
+ * of it) freezes the video until the next key frame, a lost P-frame "only"
+ * breaks the remaining frames of its GOP. And a small frame with its FEC
+ * packet count rounded up is protected quite differently than a large one.
+ * The configured fec percentage is used as the airtime budget instead: on
+ * average (by bytes), the FEC overhead of all frames stays at the budget, but
+ * it is distributed where it avoids the most frozen video.
+ * For each frame, the number of FEC packets is chosen such that
+ * (frames of video lost if this frame can't be recovered) * P(unrecoverable)
+ * + (price of a FEC packet) * (n FEC packets) is minimal. The frames lost
+ * follow from the frame type and the position in the GOP (a key frame takes
+ * the whole GOP with it, the last P-frame only itself), the probability from
+ * the frame size (in fragments) and the current link loss. The price of a FEC
+ * packet is adjusted continuously such that the budget is kept.
+ * Note that this does not simply mean a higher percentage for key frames -
+ * with the same loss, a large block needs a lower percentage than a small
+ * one for the same recovery probability. Key frames get more FEC packets
+ * than P-frames of the same size, P-frames early in the GOP more than late
+ * ones.
+ * Frames never get less than link loss * loss_margin - if that doesn't fit the
+ * budget, the used overhead goes up, which the rate controller then has to
+ * take into account.
+ * Thread safe (called from the camera thread, loss updated from the wb_link
+ * worker thread).
+ */
+namespace openhd::wb {
+
+enum class FecFrameType {
+  // IDR / CRA, including the codec config sent in front of it
+  KEY_FRAME,
+  // Everything else (P- / B-frames, intra refresh, non-rtp data)
+  DELTA_FRAME
+};
+
+FecFrameType classify_frame_for_fec(const openhd::FragmentedVideoFrame& frame);
+
+struct FecPolicyConfig {
+  int min_fec_perc = 5;
+  int max_fec_perc = 100;
+  // The link loss is assumed to be at least this high (in percent)
+  float min_loss_perc = 1.0f;
+  // Frames get at least link loss * loss_margin FEC overhead
+  float loss_margin = 1.5f;
+  // Averages (GOP size, frame size) are calculated over roughly this many
+  // frames, and over / under spent budget is corrected at this time scale.
+  int n_frames_average = 120;
+};
+
+struct FecPolicyStats {
+  // Averaged fec percentage of key / P-frames
+  float key_frame_fec_perc = 0;
+  float delta_frame_fec_perc = 0;
+  // Actually used overhead, averaged (by bytes)
+  float avg_overhead_perc = 0;
+  // Share of the video bytes that are key frames, in percent
+  float key_frame_bytes_perc = 0;
+  float avg_gop_size = 0;
+  int n_key_frames = 0;
+  int n_delta_frames = 0;
+};
+
+class FecPolicy {
+ public:
+  explicit FecPolicy(int budget_perc, FecPolicyConfig config = {});
+  FecPolicy(const FecPolicy&) = delete;
+  FecPolicy(const FecPolicy&&) = delete;
+  // Budget (average fec overhead, in percent), from the
+  // wb_video_fec_percentage setting
+  void set_budget_perc(int budget_perc);
+  // Current link loss in percent, -1 if unknown (keeps the previous value)
+  void set_link_loss_perc(int loss_perc);
+  // Returns the fec percentage to use for this frame (n_fragments primary
+  // fragments, total frame_size_bytes) and accounts its overhead against the
+  // budget, like the FEC encoder does (split into blocks of up to
+  // max_block_size fragments if > 0, n_secondary rounded up).
+  int get_fec_percentage(FecFrameType type, int frame_size_bytes,
+                         int n_fragments, int max_block_size = 0);
+  // The fec overhead the rate controller should assume - the budget, unless
+  // the link loss requires more. Rounded up to 5% steps to not constantly
+  // re-apply the bitrate.
+  int get_overhead_for_rate_control_perc();
+  FecPolicyStats get_stats();
+
+ private:
+  const FecPolicyConfig m_config;
+  std::mutex m_mutex;
+  int m_budget_perc;
+  float m_loss_perc = 0;
+  // Price of one FEC packet, in frames of video (log, adjusted to keep the
+  // budget)
+  double m_log_price = -5.0;
+  int m_n_frames_since_key_frame = 0;
+  float m_avg_gop_size = 0;
+  // Averages (per frame) of all bytes / key frame bytes / fec bytes
+  float m_avg_frame_bytes = 0;
+  float m_avg_key_frame_bytes = 0;
+  float m_avg_fec_bytes = 0;
+  float m_avg_key_perc = 0;
+  float m_avg_delta_perc = 0;
+  int m_n_key_frames = 0;
+  int m_n_delta_frames = 0;
+};
+
+// Probability that a block of n_primary + n_secondary fragments can't be
+// recovered (more than n_secondary lost), with independent loss probability
+// (0..1) per fragment
+double fec_block_loss_probability(int n_primary, int n_secondary, double loss);
+
+std::string fec_policy_stats_as_string(const FecPolicyStats& stats);
+
+}  // namespace openhd::wb
+
+#endif  // OPENHD_WB_FEC_POLICY_H
@@ -35,17 +35,22 @@
 #include "../lib/wifibroadcast/wifibroadcast/src/WBTxRx.h"
 #include "../lib/wifibroadcast/wifibroadcast/src/encryption/EncryptionFsUtils.h"
 #include "openhd_action_handler.h"
+#include "openhd_config.h"
 #include "openhd_link.hpp"
 #include "openhd_link_statistics.hpp"
 #include "openhd_platform.h"
 #include "openhd_profile.h"
 #include "openhd_settings_imp.h"
 #include "openhd_spdlog.h"
+#include "openhd_thermal.h"
 #include "openhd_util_time.h"
+#include "wb_fec_policy.h"
 #include "wb_link_helper.h"
 #include "wb_link_manager.h"
 #include "wb_link_settings.h"
 #include "wb_link_work_item.hpp"
+#include "wb_pcap.h"
+#include "wb_video_tx_queue.h"
 #include "wifi_card.h"
 
 /**
@@ -127,8 +132,9 @@ class WBLink : public OHDLink {
 
   // apply the frequency (wifi channel) and channel with for all wifibroadcast
   // cards r.n uses both iw and modifies the radiotap header
-  bool apply_frequency_and_channel_width(int frequency, int channel_width_rx,
-                                         int channel_width_tx);
+  bool apply_frequency_and_channel_width(
+      int frequency, int channel_width_rx, int channel_width_tx,
+      std::chrono::milliseconds drain_time = RETUNE_DRAIN_TIME);
   bool apply_frequency_and_channel_width_from_settings();
   // set the tx power of all wb cards. For rtl8812au, uses the tx power index
   // for other cards, uses the mW value
@@ -146,14 +152,20 @@ class WBLink : public OHDLink {
   // Do rate adjustments, does nothing if variable bitrate is disabled
   void wt_perform_rate_adjustment();
   void wt_gnd_perform_channel_management();
+  // Write the channel we switched to (ground) / fell back to (air) during a
+  // coordinated channel switch into the settings
+  void wt_persist_switched_channel();
   // this is special, mcs index can not only be changed via mavlink param, but
   // also via RC channel (if enabled)
   void wt_perform_mcs_via_rc_channel_if_enabled();
   void wt_perform_bw_via_rc_channel_if_enabled();
   // Time out to go from wifibroadcast mode to wifi hotspot mode
   void wt_perform_air_hotspot_after_timeout();
-  // X20 only, thermal protection
+  // Thermal protection, see openhd_thermal.h
+  void setup_thermal_protection(const openhd::Config& config);
   void wt_perform_update_thermal_protection();
+  // Feed the current link loss into the video FEC policy (air only)
+  void wt_perform_update_fec_policy();
   // Returns true if the work item queue is currently empty and the item has
   // been added false otherwise. In general, we only suport one item on the work
   // queue - otherwise we reject the param, since the user can just try again
@@ -167,6 +179,12 @@ class WBLink : public OHDLink {
   void transmit_video_data(
       int stream_index,
       const openhd::FragmentedVideoFrame& fragmented_video_frame) override;
+  // Called by the video tx queue - hand the frame to the wb video tx instance
+  // (FEC encoding), returns false if its queue is full.
+  bool send_video_frame(int stream_index,
+                        const openhd::FragmentedVideoFrame& frame);
+  void on_video_frame_dropped(int stream_index,
+                              openhd::wb::VideoDropReason reason);
   void transmit_audio_data(const openhd::AudioPacket& audio_packet) override;
   // How often per second we broadcast the session key -
   // we send the session key ~2 times per second
@@ -198,12 +216,22 @@ class WBLink : public OHDLink {
   // (20Mhz vs 40Mhz)
   std::shared_ptr<RadiotapHeaderTxHolder> m_tx_header_2;
   std::shared_ptr<WBTxRx> m_wb_txrx;
+  // Optional, records all frames of the link (WIFI_PCAP_RECORD_DIRECTORY)
+  std::unique_ptr<openhd::wb::pcap::WBPcapRecorder> m_pcap_recorder;
   // For telemetry, bidirectional in opposite directions
   std::unique_ptr<WBStreamTx> m_wb_tele_tx;
   std::unique_ptr<WBStreamRx> m_wb_tele_rx;
   // For video, on air there are only tx instances, on ground there are only rx
   // instances.
   std::vector<std::unique_ptr<WBStreamTx>> m_wb_video_tx_list;
+  // On air, FEC overhead per frame for each video tx instance, with
+  // wb_video_fec_percentage as budget (see wb_fec_policy.h)
+  std::vector<std::unique_ptr<openhd::wb::FecPolicy>> m_video_fec_policy_list;
+  // On air, frames wait here (not in the wb video tx queue) until the wb tx
+  // can take them, stale frames are dropped (see wb_video_tx_queue.h)
+  std::vector<std::unique_ptr<openhd::wb::VideoTxQueue>> m_video_tx_queue_list;
+  // Logged whenever the video tx queue dropped frame(s) since the last update
+  std::array<uint64_t, 2> m_video_tx_queue_n_dropped{};
   std::vector<std::unique_ptr<WBStreamRx>> m_wb_video_rx_list;
   // For audio or custom data
   std::unique_ptr<WBStreamTx> m_wb_audio_tx;
@@ -224,9 +252,20 @@ class WBLink : public OHDLink {
   std::atomic<int> m_max_total_rate_for_current_wifi_config_kbits = 0;
   std::atomic<int> m_max_video_rate_for_current_wifi_fec_config = 0;
   // Whenever the frequency has been changed, we reset tx errors and start new
-  bool m_rate_adjustment_frequency_changed = false;
+  // (also set by the air retune callback, on the management thread)
+  std::atomic_bool m_rate_adjustment_frequency_changed = false;
   // bitrate we recommend to the encoder / camera(s)
   int m_recommended_video_bitrate_kbits = 0;
+  // Air only: with ultra secure encryption on, all video data is encrypted -
+  // the recommended bitrate is limited to what the cpu can encrypt (measured
+  // the first time ultra secure encryption is used, median of a few runs).
+  std::atomic<bool> m_video_ultra_secure_encryption = false;
+  std::optional<int> m_max_encrypted_video_rate_kbits;
+  // Share of one core the video encryption may use
+  static constexpr float ENCRYPTION_MAX_CPU_SHARE = 0.5f;
+  static constexpr int ENCRYPTION_BENCHMARK_N_RUNS = 5;
+  static constexpr auto ENCRYPTION_BENCHMARK_RUN_DURATION =
+      std::chrono::milliseconds(20);
   std::atomic<int> m_curr_n_rate_adjustments = 0;
   // Set to true when armed, disarmed by default
   // Used to differentiate between different tx power levels when armed /
@@ -250,17 +289,36 @@ class WBLink : public OHDLink {
   // We start on 40Mhz, and go down to 20Mhz if possible
   std::atomic<int> m_gnd_curr_rx_channel_width = 40;
   std::atomic<int> m_gnd_curr_rx_frequency = -1;
-  // Allows temporarily closing the video input
-  std::atomic_bool m_air_close_video_in = false;
+  // Set by the management thread after a coordinated channel switch
+  std::atomic<int> m_persist_switched_frequency = -1;
+  std::atomic<int> m_persist_switched_channel_width = -1;
+  std::mutex m_apply_frequency_mutex;
+  // Before a retune, injection is stopped and we wait this long for the
+  // packets already handed to the driver to go out - retuning with packets
+  // in flight seems to make the (rtl88xx) driver(s) crash more likely.
+  static constexpr auto RETUNE_DRAIN_TIME = std::chrono::milliseconds(100);
+  // During a coordinated (scheduled) switch, video keeps flowing until the
+  // retune, so the full drain would show as a freeze. With qdisc bypass only
+  // the frames in the driver / firmware queue are left (a few packets, below
+  // 10ms even at MCS0 with full size packets) - 20ms leaves 2x margin. The
+  // fallback retune (the other side was lost, nothing to keep smooth) uses
+  // the full RETUNE_DRAIN_TIME.
+  static constexpr auto CHANNEL_SWITCH_DRAIN_TIME =
+      std::chrono::milliseconds(20);
   const int m_recommended_max_fec_blk_size_for_this_platform;
   bool m_wifi_card_error_has_been_handled = false;
-  // We have 3 thermal protection levels - as of now, only on X20
+  // We report 3 thermal protection levels, the hottest temperature and the tx
+  // power / bitrate percentage with the air video stats
   static constexpr uint8_t THERMAL_PROTECTION_NONE = 0;
   static constexpr uint8_t THERMAL_PROTECTION_RATE_REDUCED = 1;
   static constexpr uint8_t THERMAL_PROTECTION_VIDEO_DISABLED = 2;
   std::atomic_uint8_t m_thermal_protection_level = 0;
-  std::chrono::steady_clock::time_point m_thermal_protection_enable_tp =
-      std::chrono::steady_clock::now();
+  std::vector<openhd::thermal::Sensor> m_thermal_sensors;
+  std::unique_ptr<openhd::thermal::Governor> m_thermal_governor;
+  std::chrono::steady_clock::time_point m_thermal_last_update{};
+  std::atomic<int> m_thermal_tx_power_perc = 100;
+  std::atomic<int> m_thermal_bitrate_perc = 100;
+  std::atomic<int> m_thermal_hottest_temp_c = 0;
 
  private:
   openhd::wb::ForeignPacketsHelper m_foreign_p_helper;
@@ -268,6 +326,18 @@ class WBLink : public OHDLink {
   openhd::wb::FrameDropsHelper m_frame_drop_helper;
   std::atomic_int m_primary_total_dropped_frames = 0;
   std::atomic_int m_secondary_total_dropped_frames = 0;
+  // Highest video tx queue fill level since the last stats update
+  std::atomic_int m_primary_tx_queue_fill_max_perc = 0;
+  std::atomic_int m_secondary_tx_queue_fill_max_perc = 0;
+  // Frames wait in the video tx queue instead, where they can be dropped
+  // once they are too old
+  static constexpr int VIDEO_TX_BLOCK_QUEUE_SIZE = 1;
+  // The queue fill reported to the bandwidth arbiter is relative to this many
+  // waiting frames (same meaning as before the video tx queue)
+  static constexpr int VIDEO_TX_QUEUE_FILL_REF_FRAMES = 2;
+  // Only used to estimate the number of fragments of non-rtp frames (FEC
+  // policy), rtp frames are already fragmented (rtp payloader mtu).
+  static constexpr int VIDEO_FRAGMENT_SIZE_ESTIMATE = 1440;
 
  private:
   const bool DIRTY_forward_gapped_fragments = false;
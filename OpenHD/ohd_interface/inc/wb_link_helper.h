@@ -24,6 +24,7 @@
 #ifndef OPENHD_OPENHD_OHD_INTERFACE_INC_WB_LINK_HELPER_H_
 #define OPENHD_OPENHD_OHD_INTERFACE_INC_WB_LINK_HELPER_H_
 
+#include <algorithm>
 #include <mutex>
 #include <optional>
 #include <utility>
@@ -188,11 +189,14 @@ class FrameDropsHelper {
     m_frame_drop_counter += n_dropped;
   }
   // Thread-safe as long as it is called from the thread performing management
-  bool needs_bitrate_reduction() {
+  // The time can be given explicitly for simulation (see wb_replay.h)
+  bool needs_bitrate_reduction(
+      const std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now()) {
     if (m_opt_no_error_delay.has_value()) {
-      if (std::chrono::steady_clock::now() >= m_opt_no_error_delay) {
-        const auto elapsed = std::chrono::steady_clock::now() - m_last_check;
-        m_last_check = std::chrono::steady_clock::now();
+      if (now >= m_opt_no_error_delay) {
+        const auto elapsed = now - m_last_check;
+        m_last_check = now;
         const int dropped_since_last_check = m_frame_drop_counter.exchange(0);
         m_console->debug(
             "Dropped {} frames in {} during adjust period (no bitrate "
@@ -202,9 +206,9 @@ class FrameDropsHelper {
       }
       return false;
     }
-    const auto elapsed = std::chrono::steady_clock::now() - m_last_check;
+    const auto elapsed = now - m_last_check;
     if (elapsed >= std::chrono::seconds(3)) {
-      m_last_check = std::chrono::steady_clock::now();
+      m_last_check = now;
       const int dropped_since_last_check = m_frame_drop_counter.exchange(0);
       static constexpr int MAX_DROPPED_FRAMES_ALLOWED = 3;
       if (dropped_since_last_check > MAX_DROPPED_FRAMES_ALLOWED) {
@@ -224,8 +228,10 @@ class FrameDropsHelper {
   // - this results in dropped frame(s) during this period not being reported as
   // an error (Such that we don't do any rate reduction while the encoder is
   // still reacting to the newly set bitrate)
-  void delay_for(std::chrono::milliseconds delay) {
-    m_opt_no_error_delay = std::chrono::steady_clock::now() + delay;
+  void delay_for(std::chrono::milliseconds delay,
+                 const std::chrono::steady_clock::time_point now =
+                     std::chrono::steady_clock::now()) {
+    m_opt_no_error_delay = now + delay;
   }
 
  private:
@@ -237,6 +243,12 @@ class FrameDropsHelper {
       std::nullopt;
 };
 
+// Bitrate after too many tx errors (dropped frames), reduce by 1MBit/s but
+// not below the minimum - the encoder won't be able to produce an image at
+// some point anyways.
+inline constexpr int MIN_VIDEO_BITRATE_KBITS = 1000 * 2;
+int reduce_bitrate_on_tx_errors(int curr_bitrate_kbits);
+
 class PollutionHelper {
  public:
  private:
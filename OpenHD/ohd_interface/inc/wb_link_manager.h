@@ -24,6 +24,7 @@
 #ifndef OPENHD_WBLINKMANAGER_H
 #define OPENHD_WBLINKMANAGER_H
 
+#include <condition_variable>
 #include <cstdint>
 #include <memory>
 #include <optional>
@@ -33,27 +34,34 @@
 #include <vector>
 
 #include "../lib/wifibroadcast/wifibroadcast/src/WBTxRx.h"
+#include "wb_channel_switch.h"
 
 /**
  * Quite a lot of complicated code to implement 40Mhz without sync of air and
  * ground worth it, though ;) We have public std::atomic members, since the data
  * only needs to be accessed/written atomically from the wb_link worker thread.
+ * Frequency / channel width changes are coordinated between air and ground
+ * (see wb_channel_switch.h), the retune itself is done by the given callback
+ * from the management thread, at the scheduled time.
  */
 
 class ManagementAir {
  public:
   explicit ManagementAir(std::shared_ptr<WBTxRx> wb_tx_rx, int initial_freq_mhz,
-                         int inital_channel_width_mhz);
+                         int inital_channel_width_mhz,
+                         openhd::wb::RETUNE_CB retune_cb);
   ManagementAir(const ManagementAir &) = delete;
   ManagementAir(const ManagementAir &&) = delete;
   ~ManagementAir();
   void start();
   // TODO dirty
   std::shared_ptr<RadiotapHeaderTxHolder> m_tx_header;
-  // Changing the frequency or channel width temporarily increases the interval
-  // at which the management frames are sent
-  void set_frequency(int frequency);
-  void set_channel_width(uint8_t bw);
+  // Announce a switch to the given frequency / channel width to the ground
+  // and retune at the scheduled time (or right away if there is no ground).
+  // Temporarily increases the interval at which the management frames are sent.
+  // Returns false if a switch is already in progress.
+  bool schedule_channel_switch(int frequency, int channel_width);
+  bool is_channel_switch_in_progress();
 
  public:
   std::atomic<uint32_t> m_curr_frequency_mhz;
@@ -63,10 +71,16 @@ class ManagementAir {
  private:
   void loop();
   void on_new_management_packet(const uint8_t *data, int data_len);
+  void inject_management_frame(const std::vector<uint8_t> &data);
+  void wakeup();
   std::shared_ptr<WBTxRx> m_wb_txrx;
   std::shared_ptr<spdlog::logger> m_console;
   std::atomic<bool> m_tx_thread_run = true;
   std::unique_ptr<std::thread> m_tx_thread;
+  std::mutex m_wakeup_mutex;
+  std::condition_variable m_wakeup_cv;
+  bool m_wakeup = false;
+  std::unique_ptr<openhd::wb::ChannelSwitchAir> m_channel_switch;
   std::chrono::steady_clock::time_point m_air_last_management_frame =
       std::chrono::steady_clock::now();
   std::atomic<int> m_last_received_packet_timestamp_ms = 0;
@@ -76,7 +90,8 @@ class ManagementAir {
 
 class ManagementGround {
  public:
-  explicit ManagementGround(std::shared_ptr<WBTxRx> wb_tx_rx);
+  explicit ManagementGround(std::shared_ptr<WBTxRx> wb_tx_rx,
+                            openhd::wb::RETUNE_CB retune_cb);
   void start();
   ManagementGround(const ManagementGround &) = delete;
   ManagementGround(const ManagementGround &&) = delete;
@@ -88,13 +103,22 @@ class ManagementGround {
   std::atomic<int> m_air_reported_curr_frequency = -1;
   std::atomic<int> m_air_reported_curr_channel_width = -1;
   int get_last_received_packet_ts_ms();
+  // While the air announced a switch / we are verifying it, the air reported
+  // frequency / channel width must not be acted upon
+  bool is_channel_switch_in_progress();
 
  private:
   void loop();
+  void inject_management_frame(const std::vector<uint8_t> &data);
+  void wakeup();
   std::shared_ptr<WBTxRx> m_wb_txrx;
   std::shared_ptr<spdlog::logger> m_console;
   std::atomic<bool> m_tx_thread_run = true;
   std::unique_ptr<std::thread> m_tx_thread;
+  std::mutex m_wakeup_mutex;
+  std::condition_variable m_wakeup_cv;
+  bool m_wakeup = false;
+  std::unique_ptr<openhd::wb::ChannelSwitchGround> m_channel_switch;
   std::atomic<int> m_last_received_packet_timestamp_ms = 0;
   // 40Mhz / 20Mhz link management
   void on_new_management_packet(const uint8_t *data, int data_len);
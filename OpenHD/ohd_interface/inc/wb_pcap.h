@@ -0,0 +1,189 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_PCAP_H
+#define OPENHD_WB_PCAP_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+/**
+ * Recording of the raw 802.11 frames (including radiotap) of the wifibroadcast
+ * link to pcapng files, for offline analysis and replay (see wb_replay.h).
+ * The recorder listens with its own packet socket on the monitor mode
+ * interface(s) - this way it sees the frames we receive as well as the frames
+ * we inject (as outgoing), without any changes to the wifibroadcast tx / rx.
+ * NOTE: Injected frames only reach packet taps if they go through the qdisc
+ * layer - the tx socket must not use PACKET_QDISC_BYPASS while recording.
+ * The files can also be opened with wireshark.
+ */
+namespace openhd::wb::pcap {
+
+// pcapng link types
+static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+static constexpr uint16_t LINKTYPE_IEEE802_11_RADIOTAP = 127;
+
+struct CapturedFrame {
+  // Unix time (realtime clock)
+  int64_t timestamp_ns = 0;
+  // Index into the interfaces of the capture
+  int interface_idx = 0;
+  // Injected by us (false: received)
+  bool outbound = false;
+  // Starting with the radiotap header (for LINKTYPE_IEEE802_11_RADIOTAP)
+  std::vector<uint8_t> data;
+};
+
+struct CaptureInterface {
+  std::string name;
+  uint16_t link_type = LINKTYPE_IEEE802_11_RADIOTAP;
+};
+
+struct Capture {
+  std::vector<CaptureInterface> interfaces;
+  // Ordered by time
+  std::vector<CapturedFrame> frames;
+};
+
+class PcapngWriter {
+ public:
+  // Writes the section header and one interface description block per
+  // interface. Check is_open() for errors.
+  PcapngWriter(const std::string& filename,
+               const std::vector<CaptureInterface>& interfaces);
+  ~PcapngWriter();
+  PcapngWriter(const PcapngWriter&) = delete;
+  PcapngWriter(const PcapngWriter&&) = delete;
+  bool is_open() const { return m_file != nullptr; }
+  void write(const CapturedFrame& frame);
+  void flush();
+  int64_t get_n_bytes_written() const { return m_n_bytes_written; }
+
+ private:
+  FILE* m_file = nullptr;
+  int64_t m_n_bytes_written = 0;
+  void write_block(uint32_t type, const std::vector<uint8_t>& body);
+};
+
+/**
+ * Writes to prefix_000000.pcapng, prefix_000001.pcapng, ... in the given
+ * directory. Once a file exceeds max_file_size_bytes, the next one is started
+ * and the oldest one is deleted such that there are never more than
+ * max_n_files. This limits the space used, while still keeping the most
+ * recent part of a (long) flight.
+ */
+class PcapngRingWriter {
+ public:
+  struct Options {
+    std::string directory;
+    std::string prefix = "wb_capture";
+    int64_t max_file_size_bytes = 32 * 1024 * 1024;
+    int max_n_files = 8;
+  };
+  PcapngRingWriter(Options options, std::vector<CaptureInterface> interfaces);
+  void write(const CapturedFrame& frame);
+  void flush();
+  // Oldest first
+  std::vector<std::string> get_files() const;
+
+ private:
+  const Options m_options;
+  const std::vector<CaptureInterface> m_interfaces;
+  std::unique_ptr<PcapngWriter> m_writer;
+  int m_curr_file_idx = 0;
+  void open_next_file();
+};
+
+// Read a pcapng file written by us (or e.g. by wireshark / tcpdump). Returns
+// std::nullopt if the file doesn't exist or is not a (little endian) pcapng
+// file. A truncated last block (e.g. power loss) is ignored.
+std::optional<Capture> read_pcapng(const std::string& filename);
+// Read all files of a ring (oldest first) into one capture
+std::optional<Capture> read_pcapng_ring(const std::string& directory,
+                                        const std::string& prefix);
+// The files of a ring in the given directory, oldest first
+std::vector<std::string> get_ring_files(const std::string& directory,
+                                        const std::string& prefix);
+
+struct RadiotapInfo {
+  // Total length of the radiotap header, the 802.11 frame starts here
+  int header_len = 0;
+  std::optional<uint8_t> flags;
+  std::optional<int> frequency_mhz;
+  // First (combined) signal
+  std::optional<int8_t> rssi_dbm;
+  // Per antenna signal (if reported by the driver)
+  std::vector<int8_t> antenna_rssi_dbm;
+  std::optional<int8_t> noise_dbm;
+  std::optional<int> mcs_index;
+  std::optional<int> rate_500kbps;
+  // Frame includes the FCS (4 bytes at the end)
+  bool has_fcs() const { return flags.has_value() && (*flags & 0x10); }
+  bool bad_fcs() const { return flags.has_value() && (*flags & 0x40); }
+};
+// std::nullopt if the radiotap header is invalid
+std::optional<RadiotapInfo> parse_radiotap(const uint8_t* data, int data_len);
+
+/**
+ * Records all frames on the given (monitor mode) interfaces into a
+ * PcapngRingWriter. Uses its own thread, needs CAP_NET_RAW.
+ */
+class WBPcapRecorder {
+ public:
+  WBPcapRecorder(const std::vector<std::string>& interface_names,
+                 PcapngRingWriter::Options options);
+  ~WBPcapRecorder();
+  WBPcapRecorder(const WBPcapRecorder&) = delete;
+  WBPcapRecorder(const WBPcapRecorder&&) = delete;
+  struct Stats {
+    int64_t n_frames_inbound = 0;
+    int64_t n_frames_outbound = 0;
+    // Dropped by the kernel, since the recorder could not keep up
+    int64_t n_frames_dropped = 0;
+  };
+  Stats get_stats() const;
+
+ private:
+  std::shared_ptr<spdlog::logger> m_console;
+  std::vector<int> m_sockets;
+  int m_wakeup_fd = -1;
+  std::unique_ptr<PcapngRingWriter> m_writer;
+  std::atomic<bool> m_keep_running = true;
+  std::atomic<int64_t> m_n_frames_inbound = 0;
+  std::atomic<int64_t> m_n_frames_outbound = 0;
+  std::atomic<int64_t> m_n_frames_dropped = 0;
+  std::unique_ptr<std::thread> m_thread;
+  void loop();
+};
+
+}  // namespace openhd::wb::pcap
+
+#endif  // OPENHD_WB_PCAP_H
@@ -0,0 +1,123 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_REPLAY_H
+#define OPENHD_WB_REPLAY_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "wb_pcap.h"
+
+/**
+ * Offline tools for the wifibroadcast link, no radio hardware needed:
+ * 1) Replay a recorded capture (see wb_pcap.h) with original or accelerated
+ * timing, either into a callback or injected into a monitor mode interface
+ * (e.g. a mac80211_hwsim radio with the ground unit listening on the other
+ * one), such that the ground rx path sees the frames of a real flight.
+ * 2) Simulate the air video tx queue with a synthetic encoder and a given
+ * link capacity over time (e.g. from a capture) and run the air rate logic
+ * (FrameDropsHelper) against it with a virtual clock - deterministic and
+ * much faster than real time, for tuning the rate control.
+ */
+namespace openhd::wb::replay {
+
+using pcap::Capture;
+using pcap::CapturedFrame;
+
+struct ReplayOptions {
+  // 1 = original timing, 10 = 10x faster, 0 = as fast as possible
+  double speed = 1.0;
+  enum class Direction { ALL, INBOUND, OUTBOUND };
+  Direction direction = Direction::INBOUND;
+  // Only frames of this interface, -1 for all
+  int interface_idx = -1;
+};
+
+using FRAME_CB = std::function<void(const CapturedFrame& frame)>;
+
+// Blocking, returns the n of frames delivered
+int replay(const Capture& capture, const ReplayOptions& options,
+           const FRAME_CB& cb);
+
+// Replaces the (rx) radiotap header of a captured frame with a minimal tx
+// radiotap header and removes the FCS (if present), such that it can be
+// injected again. Empty if the frame is not valid.
+std::vector<uint8_t> make_injectable(const CapturedFrame& frame);
+
+// Injects frames into a monitor mode interface, needs CAP_NET_RAW
+class MonitorInjector {
+ public:
+  explicit MonitorInjector(const std::string& interface_name);
+  ~MonitorInjector();
+  MonitorInjector(const MonitorInjector&) = delete;
+  MonitorInjector(const MonitorInjector&&) = delete;
+  bool is_open() const { return m_fd >= 0; }
+  bool inject(const std::vector<uint8_t>& frame);
+
+ private:
+  int m_fd = -1;
+};
+
+// Throughput (all frames of the given direction) in kbit/s, one value per
+// second since the first frame
+std::vector<int> throughput_kbits_per_second(
+    const Capture& capture, ReplayOptions::Direction direction);
+
+struct TxQueueSimulation {
+  struct Options {
+    // Start bitrate of the synthetic encoder
+    int encoder_bitrate_kbits = 10000;
+    int fps = 60;
+    // Every n-th frame is a key frame of key_frame_factor x the avg size
+    int gop_size = 60;
+    float key_frame_factor = 3.0f;
+    // In frames, like the wb video tx queue
+    int queue_size_frames = 2;
+    std::chrono::milliseconds duration = std::chrono::seconds(60);
+    // Like on the air unit, give the encoder time to adjust on start
+    std::chrono::milliseconds startup_delay = std::chrono::seconds(5);
+    // Apply the bitrate reduction of the rate logic to the encoder
+    bool adapt_bitrate = true;
+  };
+  // Video link capacity at the given time since start
+  using LINK_RATE_KBITS_CB = std::function<int(std::chrono::milliseconds t)>;
+  struct Result {
+    int n_frames = 0;
+    int n_dropped_frames = 0;
+    // (time, new encoder bitrate)
+    std::vector<std::pair<std::chrono::milliseconds, int>> bitrate_changes;
+    int final_bitrate_kbits = 0;
+    // Max time a frame spent in the queue
+    std::chrono::microseconds max_queue_delay{0};
+  };
+  static Result run(const Options& options,
+                    const LINK_RATE_KBITS_CB& link_rate);
+};
+
+}  // namespace openhd::wb::replay
+
+#endif  // OPENHD_WB_REPLAY_H
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_WB_VIDEO_TX_QUEUE_H
+#define OPENHD_WB_VIDEO_TX_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "openhd_video_frame.h"
+
+/**
+ * Deadline-aware video tx queue, in front of the wb video tx instance.
+ * The wb tx queue only takes a frame (or drops it) - it doesn't know how old a
+ * frame is, so under interference (the link can't keep up for a while),
+ * latency creeps up by whole queued frames, and frames nobody wants to see
+ * anymore are still FEC encoded and sent.
+ * Here, frames wait until the wb tx queue (kept at 1 frame) has space, and
+ * frames older than max_frame_age (since their creation_time) are discarded
+ * before they are handed over - latency stays bounded by max_frame_age + the
+ * time for one frame in the wb tx queue.
+ * Non-reference frames (h264 nal_ref_idc == 0) are dropped first, since no
+ * other frame depends on them - when the queue is full, and when they are
+ * older than a fraction of max_frame_age. A key frame (IDR /
+ * codec config) supersedes everything queued before it. If a frame other
+ * frames depend on is dropped, the following frames can't be decoded
+ * correctly until the next key frame anyways - they are dropped, too
+ * (optional, not for intra refresh streams which don't have key frames).
+ * Thread safe, enqueue never blocks. The queue has its own thread, which hands
+ * frames to the link via callback.
+ */
+namespace openhd::wb {
+
+struct VideoTxQueueConfig {
+  // Frames older than this are dropped instead of sent
+  std::chrono::milliseconds max_frame_age{100};
+  int capacity_frames = 8;
+  // Non-reference frames are dropped earlier (in percent of max_frame_age),
+  // such that the link has more time for the frames others depend on
+  int non_reference_max_age_perc = 50;
+  // Drop frames that depend on a dropped frame until the next key frame
+  bool drop_broken_references = true;
+  // While the link can't take a frame, it is polled again after
+  // min_poll_interval, doubling up to max_poll_interval (the link has no
+  // notification for free space). Never past the frame's deadline.
+  std::chrono::microseconds min_poll_interval{250};
+  std::chrono::microseconds max_poll_interval{4000};
+};
+
+enum class VideoDropReason {
+  // Older than max_frame_age
+  TOO_OLD = 0,
+  // Queue full (reference frame)
+  QUEUE_FULL,
+  // Non-reference frame dropped instead of a reference frame (queue full or
+  // older than its share of max_frame_age)
+  NON_REFERENCE,
+  // A newer key frame doesn't need it anymore
+  SUPERSEDED,
+  // Depends on a dropped frame (until the next key frame)
+  BROKEN_REFERENCE
+};
+static constexpr int N_VIDEO_DROP_REASONS = 5;
+std::string video_drop_reason_to_string(VideoDropReason reason);
+
+struct VideoTxQueueStats {
+  uint64_t n_enqueued = 0;
+  uint64_t n_sent = 0;
+  // Indexed by VideoDropReason
+  std::array<uint64_t, N_VIDEO_DROP_REASONS> n_dropped{};
+  uint64_t n_dropped_total() const;
+  // Age (since creation) of the frames handed to the link since the last
+  // get_stats() call, -1 if there were none
+  int age_min_us = -1;
+  int age_max_us = -1;
+  int age_avg_us = -1;
+  int curr_n_queued = 0;
+};
+std::string video_tx_queue_stats_to_string(const VideoTxQueueStats& stats);
+
+class VideoTxQueue {
+ public:
+  // Hand the frame to the link. Return false if the link can't take it right
+  // now (wb tx queue full), it is tried again later (unless too old by then).
+  typedef std::function<bool(const openhd::FragmentedVideoFrame& frame)>
+      TRY_SEND_CB;
+  // Called for each dropped frame, possibly with the queue locked (must not
+  // call back into the queue)
+  typedef std::function<void(VideoDropReason reason)> ON_DROP_CB;
+  explicit VideoTxQueue(VideoTxQueueConfig config, TRY_SEND_CB try_send_cb,
+                        ON_DROP_CB on_drop_cb = nullptr,
+                        std::string thread_name = "video_tx_q");
+  VideoTxQueue(const VideoTxQueue&) = delete;
+  VideoTxQueue(const VideoTxQueue&&) = delete;
+  ~VideoTxQueue();
+  void enqueue(openhd::FragmentedVideoFrame frame);
+  void set_max_frame_age(std::chrono::milliseconds max_frame_age);
+  // Resets the age statistics
+  VideoTxQueueStats get_stats();
+  // Frames waiting (not including the one currently handed over)
+  int get_n_queued();
+
+ private:
+  void loop();
+  // With m_mutex held
+  void drop(VideoDropReason reason, bool is_reference);
+  const VideoTxQueueConfig m_config;
+  const TRY_SEND_CB m_try_send_cb;
+  const ON_DROP_CB m_on_drop_cb;
+  const std::string m_thread_name;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<openhd::FragmentedVideoFrame> m_queue;
+  bool m_run = true;
+  std::atomic<int64_t> m_max_frame_age_us;
+  // The frame the tx thread is currently trying to hand over is not needed
+  // anymore (a key frame came in)
+  bool m_in_flight_superseded = false;
+  // A reference frame was dropped, wait for the next key frame
+  bool m_broken_reference = false;
+  bool m_seen_key_frame = false;
+  VideoTxQueueStats m_stats{};
+  int64_t m_age_sum_us = 0;
+  int m_age_count = 0;
+  std::unique_ptr<std::thread> m_thread;
+};
+
+}  // namespace openhd::wb
+
+#endif  // OPENHD_WB_VIDEO_TX_QUEUE_H
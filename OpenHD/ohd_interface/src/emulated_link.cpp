@@ -0,0 +1,244 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "emulated_link.h"
+
+#include <cstring>
+
+#include "openhd_memory.h"
+
+namespace openhd::emulation {
+
+// First byte of each packet on the channel
+enum PacketType : uint8_t {
+  TELEMETRY = 0,
+  VIDEO_PRIMARY = 1,
+  VIDEO_SECONDARY = 2,
+  AUDIO = 3
+};
+
+ImpairedChannel::ImpairedChannel(ImpairmentParams params, DELIVER_CB cb)
+    : m_cb(std::move(cb)), m_params(params), m_rng(params.seed) {
+  m_thread = std::make_unique<std::thread>(&ImpairedChannel::loop, this);
+}
+
+ImpairedChannel::~ImpairedChannel() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keep_running = false;
+  }
+  m_cv.notify_one();
+  m_thread->join();
+}
+
+void ImpairedChannel::set_params(const ImpairmentParams& params) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_params = params;
+}
+
+ImpairedChannel::Stats ImpairedChannel::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void ImpairedChannel::send(const uint8_t* data, int data_len) {
+  const auto now = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_stats.n_sent++;
+  std::uniform_real_distribution<double> dist_perc(0, 100);
+  if (dist_perc(m_rng) < m_params.loss_perc) {
+    m_stats.n_dropped_loss++;
+    return;
+  }
+  auto deliver_at = now;
+  if (m_params.rate_kbits > 0) {
+    const auto air_time = std::chrono::microseconds(
+        (int64_t)data_len * 8 * 1000 / m_params.rate_kbits);
+    const auto begin = std::max(now, m_medium_free_at);
+    if (begin - now > m_params.max_queue_delay) {
+      m_stats.n_dropped_queue++;
+      return;
+    }
+    m_medium_free_at = begin + air_time;
+    deliver_at = m_medium_free_at;
+  }
+  deliver_at += m_params.delay;
+  if (m_params.jitter.count() > 0) {
+    std::uniform_int_distribution<int64_t> dist_jitter(0,
+                                                       m_params.jitter.count());
+    deliver_at += std::chrono::microseconds(dist_jitter(m_rng));
+  }
+  if (dist_perc(m_rng) < m_params.reorder_perc) {
+    deliver_at += m_params.reorder_delay;
+    m_stats.n_reordered++;
+  }
+  m_queue.push(Item{deliver_at, m_seq++,
+                    std::vector<uint8_t>(data, data + data_len)});
+  lock.unlock();
+  m_cv.notify_one();
+}
+
+void ImpairedChannel::loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_keep_running) {
+    if (m_queue.empty()) {
+      m_cv.wait(lock);
+      continue;
+    }
+    const auto deliver_at = m_queue.top().deliver_at;
+    if (std::chrono::steady_clock::now() < deliver_at) {
+      m_cv.wait_until(lock, deliver_at);
+      continue;
+    }
+    // Copy out (top is const)
+    auto data = std::move(const_cast<Item&>(m_queue.top()).data);
+    m_queue.pop();
+    m_stats.n_delivered++;
+    lock.unlock();
+    m_cb(data.data(), (int)data.size());
+    lock.lock();
+  }
+}
+
+std::pair<std::shared_ptr<EmulatedLink>, std::shared_ptr<EmulatedLink>>
+EmulatedLink::create_pair(const EmulatedLink::Options& options) {
+  auto air = std::make_shared<EmulatedLink>(true, options.video_fec_percentage);
+  auto ground =
+      std::make_shared<EmulatedLink>(false, options.video_fec_percentage);
+  air->connect_to(ground, options.air_to_ground);
+  ground->connect_to(air, options.ground_to_air);
+  return {air, ground};
+}
+
+EmulatedLink::EmulatedLink(bool is_air, int video_fec_percentage)
+    : m_is_air(is_air) {
+  if (video_fec_percentage <= 0) return;
+  for (int i = 0; i < 2; i++) {
+    m_video_fec_tx[i] =
+        std::make_unique<openhd::ethernet::FECEncoder>(video_fec_percentage);
+    m_video_fec_rx[i] = std::make_unique<openhd::ethernet::FECDecoder>(
+        [this, i](const uint8_t* data, int data_len) {
+          on_receive_video_data(i, data, data_len);
+        },
+        openhd::memory::get_budget().eth_fec_max_blocks_in_flight);
+  }
+}
+
+EmulatedLink::~EmulatedLink() {
+  // Stop delivering into the peer first
+  m_tx_channel = nullptr;
+}
+
+void EmulatedLink::connect_to(const std::shared_ptr<EmulatedLink>& peer,
+                              const ImpairmentParams& params) {
+  std::weak_ptr<EmulatedLink> weak_peer = peer;
+  m_tx_channel = std::make_unique<ImpairedChannel>(
+      params, [weak_peer](const uint8_t* data, int data_len) {
+        auto peer = weak_peer.lock();
+        if (peer) peer->on_channel_rx(data, data_len);
+      });
+}
+
+void EmulatedLink::set_tx_impairment(const ImpairmentParams& params) {
+  m_tx_channel->set_params(params);
+}
+
+ImpairedChannel::Stats EmulatedLink::get_tx_channel_stats() {
+  return m_tx_channel->get_stats();
+}
+
+openhd::ethernet::FECDecoder::Stats EmulatedLink::get_video_fec_rx_stats(
+    int stream_index) {
+  if (!m_video_fec_rx[stream_index]) return {};
+  return m_video_fec_rx[stream_index]->get_stats();
+}
+
+static std::vector<uint8_t> with_type(PacketType type, const uint8_t* data,
+                                      std::size_t data_len) {
+  std::vector<uint8_t> ret(data_len + 1);
+  ret[0] = type;
+  std::memcpy(ret.data() + 1, data, data_len);
+  return ret;
+}
+
+void EmulatedLink::transmit_telemetry_data(
+    OHDLink::TelemetryTxPacket packet) {
+  const auto tmp =
+      with_type(TELEMETRY, packet.data->data(), packet.data->size());
+  for (int i = 0; i < packet.n_injections; i++) {
+    m_tx_channel->send(tmp.data(), tmp.size());
+  }
+}
+
+void EmulatedLink::transmit_video_data(
+    int stream_index,
+    const openhd::FragmentedVideoFrame& fragmented_video_frame) {
+  if (!m_is_air || stream_index < 0 || stream_index > 1) return;
+  const auto type = stream_index == 0 ? VIDEO_PRIMARY : VIDEO_SECONDARY;
+  const auto& packets =
+      m_video_fec_tx[stream_index]
+          ? m_video_fec_tx[stream_index]->encode_frame(
+                fragmented_video_frame.rtp_fragments)
+          : fragmented_video_frame.rtp_fragments;
+  for (const auto& packet : packets) {
+    const auto tmp = with_type(type, packet->data(), packet->size());
+    m_tx_channel->send(tmp.data(), tmp.size());
+  }
+}
+
+void EmulatedLink::transmit_audio_data(
+    const openhd::AudioPacket& audio_packet) {
+  const auto tmp =
+      with_type(AUDIO, audio_packet.data->data(), audio_packet.data->size());
+  m_tx_channel->send(tmp.data(), tmp.size());
+}
+
+void EmulatedLink::on_channel_rx(const uint8_t* data, int data_len) {
+  if (data_len < 1) return;
+  const uint8_t* payload = data + 1;
+  const int payload_len = data_len - 1;
+  switch (data[0]) {
+    case TELEMETRY:
+      on_receive_telemetry_data(std::make_shared<std::vector<uint8_t>>(
+          payload, payload + payload_len));
+      break;
+    case VIDEO_PRIMARY:
+    case VIDEO_SECONDARY: {
+      if (m_is_air) return;
+      const int stream_index = data[0] == VIDEO_PRIMARY ? 0 : 1;
+      if (m_video_fec_rx[stream_index]) {
+        m_video_fec_rx[stream_index]->process_packet(payload, payload_len);
+      } else {
+        on_receive_video_data(stream_index, payload, payload_len);
+      }
+      break;
+    }
+    case AUDIO:
+      on_receive_audio_data(payload, payload_len);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace openhd::emulation
@@ -0,0 +1,490 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "ethernet_fec.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "openhd_metrics.h"
+#include "openhd_spdlog.h"
+#include "openhd_spdlog_include.h"
+
+namespace openhd::ethernet {
+
+namespace {
+
+openhd::metrics::Histogram& get_encode_time_histogram() {
+  static auto& histogram = openhd::metrics::Registry::instance().histogram(
+      "openhd_eth_fec_encode_time_us", "Ethernet FEC block encode time",
+      openhd::metrics::latency_buckets_us());
+  return histogram;
+}
+
+openhd::metrics::Histogram& get_decode_time_histogram() {
+  static auto& histogram = openhd::metrics::Registry::instance().histogram(
+      "openhd_eth_fec_decode_time_us",
+      "Ethernet FEC block recovery (decode) time",
+      openhd::metrics::latency_buckets_us());
+  return histogram;
+}
+
+// GF(2^8) with the polynomial x^8+x^4+x^3+x^2+1 (0x11d)
+struct GF256 {
+  std::array<uint8_t, 512> exp{};
+  std::array<uint8_t, 256> log{};
+  // mul[a][b] = a*b, 64kB - one row fits nicely into L1 during a mul_add
+  std::array<std::array<uint8_t, 256>, 256> mul{};
+  GF256() {
+    int x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i] = (uint8_t)x;
+      log[x] = (uint8_t)i;
+      x <<= 1;
+      if (x & 0x100) x ^= 0x11d;
+    }
+    for (int i = 255; i < 512; i++) exp[i] = exp[i - 255];
+    for (int a = 0; a < 256; a++) {
+      for (int b = 0; b < 256; b++) {
+        mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+      }
+    }
+  }
+  uint8_t inv(uint8_t a) const { return exp[255 - log[a]]; }
+};
+
+const GF256& gf() {
+  static const GF256 instance;
+  return instance;
+}
+
+// dst ^= c * src
+void mul_add(uint8_t* dst, const uint8_t* src, uint8_t c, std::size_t size) {
+  if (c == 0) return;
+  if (c == 1) {
+    for (std::size_t i = 0; i < size; i++) dst[i] ^= src[i];
+    return;
+  }
+  const auto& row = gf().mul[c];
+  for (std::size_t i = 0; i < size; i++) dst[i] ^= row[src[i]];
+}
+
+// Cauchy matrix element for secondary row i, primary column j. x_i=i and
+// y_j=255-j are distinct as long as n_primary+n_secondary <= 256, which makes
+// every square sub-matrix invertible.
+uint8_t cauchy(int i, int j) { return gf().inv((uint8_t)(i ^ (255 - j))); }
+
+// Gauss-Jordan, in place. Returns false if singular (which cannot happen for
+// a Cauchy matrix).
+bool invert_matrix(std::vector<uint8_t>& m, int n) {
+  std::vector<uint8_t> inv(n * n, 0);
+  for (int i = 0; i < n; i++) inv[i * n + i] = 1;
+  for (int col = 0; col < n; col++) {
+    int pivot = col;
+    while (pivot < n && m[pivot * n + col] == 0) pivot++;
+    if (pivot == n) return false;
+    if (pivot != col) {
+      for (int k = 0; k < n; k++) {
+        std::swap(m[pivot * n + k], m[col * n + k]);
+        std::swap(inv[pivot * n + k], inv[col * n + k]);
+      }
+    }
+    const uint8_t scale = gf().inv(m[col * n + col]);
+    for (int k = 0; k < n; k++) {
+      m[col * n + k] = gf().mul[scale][m[col * n + k]];
+      inv[col * n + k] = gf().mul[scale][inv[col * n + k]];
+    }
+    for (int row = 0; row < n; row++) {
+      if (row == col) continue;
+      const uint8_t factor = m[row * n + col];
+      if (factor == 0) continue;
+      for (int k = 0; k < n; k++) {
+        m[row * n + k] ^= gf().mul[factor][m[col * n + k]];
+        inv[row * n + k] ^= gf().mul[factor][inv[col * n + k]];
+      }
+    }
+  }
+  m = std::move(inv);
+  return true;
+}
+
+const std::shared_ptr<spdlog::logger>& get_console() {
+  static const auto console = openhd::log::create_or_get("eth_fec");
+  return console;
+}
+
+}  // namespace
+
+void FECCode::encode(const std::vector<const uint8_t*>& primaries,
+                     std::vector<uint8_t*>& secondaries, std::size_t size) {
+  for (int i = 0; i < (int)secondaries.size(); i++) {
+    uint8_t* dst = secondaries[i];
+    std::memset(dst, 0, size);
+    for (int j = 0; j < (int)primaries.size(); j++) {
+      mul_add(dst, primaries[j], cauchy(i, j), size);
+    }
+  }
+}
+
+bool FECCode::decode(std::vector<uint8_t*>& fragments, int n_primary,
+                     std::size_t size) {
+  std::vector<int> missing;
+  for (int j = 0; j < n_primary; j++) {
+    if (fragments[j] == nullptr) missing.push_back(j);
+  }
+  if (missing.empty()) return true;
+  std::vector<int> secondaries;
+  for (int i = n_primary;
+       i < (int)fragments.size() && secondaries.size() < missing.size(); i++) {
+    if (fragments[i] != nullptr) secondaries.push_back(i - n_primary);
+  }
+  if (secondaries.size() < missing.size()) return false;
+  const int n = (int)missing.size();
+  // Remove the contribution of the primary fragments we have from the
+  // secondary fragments we use, what remains only depends on the missing ones.
+  for (int r = 0; r < n; r++) {
+    uint8_t* syndrome = fragments[n_primary + secondaries[r]];
+    for (int j = 0; j < n_primary; j++) {
+      if (fragments[j] == nullptr) continue;
+      mul_add(syndrome, fragments[j], cauchy(secondaries[r], j), size);
+    }
+  }
+  std::vector<uint8_t> matrix(n * n);
+  for (int r = 0; r < n; r++) {
+    for (int c = 0; c < n; c++) {
+      matrix[r * n + c] = cauchy(secondaries[r], missing[c]);
+    }
+  }
+  if (!invert_matrix(matrix, n)) return false;
+  // Each syndrome is needed for every output, so recover into scratch memory
+  // first.
+  std::vector<std::vector<uint8_t>> recovered(n, std::vector<uint8_t>(size, 0));
+  for (int c = 0; c < n; c++) {
+    for (int r = 0; r < n; r++) {
+      mul_add(recovered[c].data(), fragments[n_primary + secondaries[r]],
+              matrix[c * n + r], size);
+    }
+  }
+  for (int c = 0; c < n; c++) {
+    // Reuse the (now consumed) secondary buffers as output
+    uint8_t* out = fragments[n_primary + secondaries[c]];
+    std::memcpy(out, recovered[c].data(), size);
+    fragments[missing[c]] = out;
+    fragments[n_primary + secondaries[c]] = nullptr;
+  }
+  return true;
+}
+
+FECEncoder::FECEncoder(int fec_percentage, int max_block_size)
+    : m_fec_percentage(fec_percentage),
+      m_max_block_size(std::clamp(max_block_size, 1, 128)) {}
+
+void FECEncoder::set_fec_percentage(int fec_percentage) {
+  m_fec_percentage = std::max(0, fec_percentage);
+}
+
+std::vector<std::shared_ptr<std::vector<uint8_t>>> FECEncoder::encode_frame(
+    const std::vector<std::shared_ptr<std::vector<uint8_t>>>& fragments) {
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> ret;
+  const int n_fragments = (int)fragments.size();
+  if (n_fragments == 0) return ret;
+  // Distribute the fragments evenly over the least amount of blocks
+  const int n_blocks = (n_fragments + m_max_block_size - 1) / m_max_block_size;
+  int offset = 0;
+  for (int i = 0; i < n_blocks; i++) {
+    const int block_size =
+        n_fragments / n_blocks + (i < n_fragments % n_blocks ? 1 : 0);
+    encode_block(&fragments[offset], block_size, ret);
+    offset += block_size;
+  }
+  return ret;
+}
+
+void FECEncoder::encode_block(
+    const std::shared_ptr<std::vector<uint8_t>>* fragments, int n_fragments,
+    std::vector<std::shared_ptr<std::vector<uint8_t>>>& out) {
+  const int n_primary = n_fragments;
+  const int n_secondary =
+      std::min((n_primary * m_fec_percentage + 99) / 100,
+               FEC_MAX_FRAGMENTS_PER_BLOCK - n_primary);
+  std::size_t max_size = 0;
+  for (int i = 0; i < n_primary; i++) {
+    max_size = std::max(max_size, fragments[i]->size());
+  }
+  if (max_size > FEC_MAX_PAYLOAD_SIZE) {
+    get_console()->warn("Fragment too big {}, dropping block", max_size);
+    return;
+  }
+  const std::size_t padded_size = max_size + FEC_PRIMARY_SIZE_PREFIX;
+  FECHeader header{};
+  header.block_idx = m_block_idx++;
+  header.n_primary = n_primary;
+  header.n_secondary = n_secondary;
+  const std::size_t out_begin = out.size();
+  for (int i = 0; i < n_primary; i++) {
+    const auto& fragment = *fragments[i];
+    auto packet = std::make_shared<std::vector<uint8_t>>();
+    // Reserve for the zero-padding needed during encode
+    packet->reserve(sizeof(FECHeader) + padded_size);
+    packet->resize(sizeof(FECHeader) + FEC_PRIMARY_SIZE_PREFIX +
+                   fragment.size());
+    header.fragment_idx = i;
+    std::memcpy(packet->data(), &header, sizeof(FECHeader));
+    const uint16_t size = fragment.size();
+    std::memcpy(packet->data() + sizeof(FECHeader), &size, sizeof(size));
+    std::memcpy(packet->data() + sizeof(FECHeader) + FEC_PRIMARY_SIZE_PREFIX,
+                fragment.data(), fragment.size());
+    out.push_back(packet);
+  }
+  if (n_secondary > 0) {
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<const uint8_t*> primaries;
+    for (int i = 0; i < n_primary; i++) {
+      auto& packet = *out[out_begin + i];
+      packet.resize(sizeof(FECHeader) + padded_size, 0);
+      primaries.push_back(packet.data() + sizeof(FECHeader));
+    }
+    std::vector<uint8_t*> secondaries;
+    for (int i = 0; i < n_secondary; i++) {
+      auto packet = std::make_shared<std::vector<uint8_t>>(
+          sizeof(FECHeader) + padded_size);
+      header.fragment_idx = n_primary + i;
+      std::memcpy(packet->data(), &header, sizeof(FECHeader));
+      secondaries.push_back(packet->data() + sizeof(FECHeader));
+      out.push_back(packet);
+    }
+    FECCode::encode(primaries, secondaries, padded_size);
+    // Remove the padding again (no realloc)
+    for (int i = 0; i < n_primary; i++) {
+      out[out_begin + i]->resize(sizeof(FECHeader) + FEC_PRIMARY_SIZE_PREFIX +
+                                 fragments[i]->size());
+    }
+    const auto delta = std::chrono::steady_clock::now() - begin;
+    get_encode_time_histogram().record(
+        std::chrono::duration_cast<std::chrono::microseconds>(delta).count());
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.encode_time_sum += delta;
+    m_stats.encode_time_max = std::max(
+        m_stats.encode_time_max,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(delta));
+  }
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  m_stats.n_blocks++;
+  m_stats.n_primary += n_primary;
+  m_stats.n_secondary += n_secondary;
+}
+
+FECEncoder::Stats FECEncoder::get_stats() {
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  return m_stats;
+}
+
+FECDecoder::FECDecoder(FECDecoder::OUTPUT_DATA_CALLBACK cb,
+                       int max_blocks_in_flight)
+    : m_cb(std::move(cb)),
+      m_max_blocks_in_flight(std::max(1, max_blocks_in_flight)) {}
+
+FECDecoder::Stats FECDecoder::get_stats() {
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  return m_stats;
+}
+
+void FECDecoder::process_packet(const uint8_t* data, int data_len) {
+  if (data_len < (int)sizeof(FECHeader)) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.count_invalid_packets++;
+    return;
+  }
+  FECHeader header{};
+  std::memcpy(&header, data, sizeof(FECHeader));
+  const int payload_len = data_len - (int)sizeof(FECHeader);
+  const bool is_primary = header.fragment_idx < header.n_primary;
+  const bool valid =
+      header.n_primary > 0 &&
+      header.fragment_idx < header.n_primary + header.n_secondary &&
+      header.n_primary + header.n_secondary <= FEC_MAX_FRAGMENTS_PER_BLOCK &&
+      payload_len >= FEC_PRIMARY_SIZE_PREFIX;
+  if (!valid) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.count_invalid_packets++;
+    return;
+  }
+  Block* block = get_or_create_block(header);
+  if (block == nullptr || block->done ||
+      block->available[header.fragment_idx]) {
+    return;  // old, already done or duplicate
+  }
+  if (block->n_primary != header.n_primary ||
+      block->n_secondary != header.n_secondary) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.count_invalid_packets++;
+    return;
+  }
+  block->fragments[header.fragment_idx].assign(data + sizeof(FECHeader),
+                                               data + data_len);
+  block->available[header.fragment_idx] = true;
+  block->n_available++;
+  if (is_primary) block->n_available_primary++;
+  forward_available(*block);
+  if (!block->done && block->n_available >= block->n_primary) {
+    try_recover(*block);
+  }
+  remove_done_blocks();
+}
+
+FECDecoder::Block* FECDecoder::get_or_create_block(const FECHeader& header) {
+  const uint32_t idx = header.block_idx;
+  // Most likely the TX has been restarted: Going back further than the blocks
+  // we can have in flight (a late packet can't be that old), or a big jump
+  // forward.
+  static constexpr uint32_t MAX_JUMP = 1000;
+  if (m_first_open_block_idx.has_value()) {
+    const uint32_t first = m_first_open_block_idx.value();
+    const bool restarted = idx + m_max_blocks_in_flight < first ||
+                           idx > first + MAX_JUMP;
+    if (restarted) {
+      get_console()->debug("Block index jump {}->{}, resetting", first, idx);
+      while (!m_blocks.empty()) give_up_oldest_block();
+      m_first_open_block_idx = std::nullopt;
+    }
+  }
+  if (!m_first_open_block_idx.has_value()) {
+    m_first_open_block_idx = idx;
+  }
+  if (idx < m_first_open_block_idx.value()) return nullptr;
+  // Give up on blocks that are too old
+  while (idx >= m_first_open_block_idx.value() + m_max_blocks_in_flight) {
+    if (!m_blocks.empty() &&
+        m_blocks.front().block_idx == m_first_open_block_idx.value()) {
+      give_up_oldest_block();
+    } else {
+      // Not a single fragment of this block made it
+      std::lock_guard<std::mutex> lock(m_stats_mutex);
+      m_stats.count_blocks_total++;
+      m_stats.count_blocks_lost++;
+    }
+    m_first_open_block_idx = m_first_open_block_idx.value() + 1;
+  }
+  auto it = std::lower_bound(
+      m_blocks.begin(), m_blocks.end(), idx,
+      [](const Block& block, uint32_t idx) { return block.block_idx < idx; });
+  if (it != m_blocks.end() && it->block_idx == idx) return &(*it);
+  Block block{};
+  block.block_idx = idx;
+  block.n_primary = header.n_primary;
+  block.n_secondary = header.n_secondary;
+  block.fragments.resize(header.n_primary + header.n_secondary);
+  block.available.resize(header.n_primary + header.n_secondary, false);
+  it = m_blocks.insert(it, std::move(block));
+  return &(*it);
+}
+
+void FECDecoder::forward_fragment(const std::vector<uint8_t>& fragment) {
+  uint16_t size;
+  std::memcpy(&size, fragment.data(), sizeof(size));
+  if ((std::size_t)size + FEC_PRIMARY_SIZE_PREFIX > fragment.size()) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.count_invalid_packets++;
+    return;
+  }
+  m_cb(fragment.data() + FEC_PRIMARY_SIZE_PREFIX, size);
+}
+
+void FECDecoder::forward_available(FECDecoder::Block& block) {
+  while (block.next_to_forward < block.n_primary &&
+         block.available[block.next_to_forward]) {
+    forward_fragment(block.fragments[block.next_to_forward]);
+    block.next_to_forward++;
+  }
+  if (block.next_to_forward == block.n_primary) block.done = true;
+}
+
+bool FECDecoder::try_recover(FECDecoder::Block& block) {
+  const auto begin = std::chrono::steady_clock::now();
+  std::size_t size = 0;
+  for (int i = block.n_primary; i < block.n_primary + block.n_secondary; i++) {
+    if (!block.available[i]) continue;
+    if (size != 0 && block.fragments[i].size() != size) {
+      std::lock_guard<std::mutex> lock(m_stats_mutex);
+      m_stats.count_invalid_packets++;
+      return false;
+    }
+    size = block.fragments[i].size();
+  }
+  std::vector<uint8_t*> fragments(block.n_primary + block.n_secondary, nullptr);
+  for (int i = 0; i < (int)fragments.size(); i++) {
+    if (!block.available[i]) continue;
+    if (block.fragments[i].size() > size) {
+      std::lock_guard<std::mutex> lock(m_stats_mutex);
+      m_stats.count_invalid_packets++;
+      return false;
+    }
+    block.fragments[i].resize(size, 0);
+    fragments[i] = block.fragments[i].data();
+  }
+  if (!FECCode::decode(fragments, block.n_primary, size)) return false;
+  int n_recovered = 0;
+  for (int i = 0; i < block.n_primary; i++) {
+    if (block.available[i]) continue;
+    block.fragments[i].assign(fragments[i], fragments[i] + size);
+    block.available[i] = true;
+    n_recovered++;
+  }
+  forward_available(block);
+  const auto delta = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin);
+  get_decode_time_histogram().record(
+      std::chrono::duration_cast<std::chrono::microseconds>(delta).count());
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  m_stats.count_blocks_recovered++;
+  m_stats.count_fragments_recovered += n_recovered;
+  m_stats.decode_time_max = std::max(m_stats.decode_time_max, delta);
+  return true;
+}
+
+void FECDecoder::give_up_oldest_block() {
+  auto& block = m_blocks.front();
+  if (!block.done) {
+    // Forward what we have, the rest is lost
+    for (int i = block.next_to_forward; i < block.n_primary; i++) {
+      if (block.available[i]) forward_fragment(block.fragments[i]);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_stats.count_blocks_total++;
+    if (!block.done) m_stats.count_blocks_lost++;
+  }
+  m_blocks.pop_front();
+}
+
+void FECDecoder::remove_done_blocks() {
+  while (!m_blocks.empty() && m_blocks.front().done &&
+         m_blocks.front().block_idx == m_first_open_block_idx.value()) {
+    give_up_oldest_block();
+    m_first_open_block_idx = m_first_open_block_idx.value() + 1;
+  }
+}
+
+}  // namespace openhd::ethernet
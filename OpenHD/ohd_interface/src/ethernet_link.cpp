@@ -30,9 +30,13 @@
 #include <iostream>
 
 #include "config_paths.h"
+#include "openhd_action_handler.h"
 #include "openhd_config.h"
+#include "openhd_memory.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 #include "openhd_util_filesystem.h"
+#include "openhd_util_time.h"
 
 static std::string ETHERNET_FILE_PATH =
     std::string(getConfigBasePath()) + "ethernet.txt";
@@ -67,23 +71,54 @@ EthernetLink::EthernetLink(const openhd::Config& config, OHDProfile profile)
               << std::endl;
   }
 
+  initialize_fec();
   // Initialize either air or ground unit based on the profile
   if (m_profile.is_air) {
     initialize_air_unit();
   } else {
     initialize_ground_unit();
   }
+  m_stats_thread =
+      std::make_unique<std::thread>(&EthernetLink::loop_stats, this);
 }
 
 EthernetLink::EthernetLink(OHDProfile profile)
     : EthernetLink(openhd::load_config(), profile) {}
 
 EthernetLink::~EthernetLink() {
+  m_stats_thread_run = false;
+  if (m_stats_thread) m_stats_thread->join();
   // Stop background receivers
   if (m_video_rx) m_video_rx->stopBackground();
   if (m_telemetry_rx) m_telemetry_rx->stopBackground();
 }
 
+void EthernetLink::initialize_fec() {
+  if (!m_config.ETH_FEC_ENABLE) return;
+  openhd::log::get_default()->info("Ethernet link FEC enabled, {}%",
+                                   m_config.ETH_FEC_PERCENTAGE);
+  m_video_fec_tx = std::make_unique<openhd::ethernet::FECEncoder>(
+      m_config.ETH_FEC_PERCENTAGE);
+  // Each telemetry packet is its own block - any FEC percentage > 0 results
+  // in one secondary fragment, which is the same as sending it twice.
+  m_telemetry_fec_tx = std::make_unique<openhd::ethernet::FECEncoder>(
+      m_config.ETH_FEC_PERCENTAGE);
+  const int max_blocks_in_flight =
+      openhd::memory::get_budget().eth_fec_max_blocks_in_flight;
+  m_video_fec_rx = std::make_unique<openhd::ethernet::FECDecoder>(
+      [this](const uint8_t* data, int data_len) {
+        on_receive_video_data(0, data, data_len);
+      },
+      max_blocks_in_flight);
+  m_telemetry_fec_rx = std::make_unique<openhd::ethernet::FECDecoder>(
+      [this](const uint8_t* data, int data_len) {
+        auto shared =
+            std::make_shared<std::vector<uint8_t>>(data, data + data_len);
+        on_receive_telemetry_data(shared);
+      },
+      max_blocks_in_flight);
+}
+
 void EthernetLink::initialize_air_unit() {
   // Initialize video transmitter for sending video to the ground unit
   m_video_tx =
@@ -123,21 +158,32 @@ void EthernetLink::initialize_ground_unit() {
 
 void EthernetLink::transmit_telemetry_data(TelemetryTxPacket packet) {
   // Send telemetry data to the destination
-  if (m_telemetry_tx) {
-    m_telemetry_tx->forwardPacketViaUDP(packet.data->data(),
-                                        packet.data->size());
+  if (!m_telemetry_tx) return;
+  if (m_telemetry_fec_tx) {
+    std::lock_guard<std::mutex> lock(m_telemetry_fec_tx_mutex);
+    const auto packets = m_telemetry_fec_tx->encode_frame({packet.data});
+    m_telemetry_tx->forwardPacketsViaUDP(packets);
+    return;
   }
+  m_telemetry_tx->forwardPacketViaUDP(packet.data->data(),
+                                      packet.data->size());
 }
 
 void EthernetLink::transmit_video_data(
     int stream_index,
     const openhd::FragmentedVideoFrame& fragmented_video_frame) {
-  // Send video data fragments to the destination
-  if (m_video_tx) {
-    for (const auto& fragment : fragmented_video_frame.rtp_fragments) {
-      m_video_tx->forwardPacketViaUDP(fragment->data(), fragment->size());
-    }
-  }
+  // Send video data fragments to the destination, all fragments of a frame
+  // (and their FEC data) at once
+  if (!m_video_tx) return;
+  const auto packets =
+      m_video_fec_tx
+          ? m_video_fec_tx->encode_frame(fragmented_video_frame.rtp_fragments)
+          : fragmented_video_frame.rtp_fragments;
+  m_video_tx->forwardPacketsViaUDP(packets);
+  uint64_t n_bytes = 0;
+  for (const auto& packet : packets) n_bytes += packet->size();
+  m_video_tx_bytes += n_bytes;
+  m_video_tx_packets += packets.size();
 }
 
 void EthernetLink::transmit_audio_data(
@@ -148,11 +194,74 @@ void EthernetLink::transmit_audio_data(
 void EthernetLink::handle_video_data(int stream_index, const uint8_t* data,
                                      int data_len) {
   // Forward incoming video data to the upper layer
+  m_video_rx_bytes += data_len;
+  if (m_video_fec_rx) {
+    m_video_fec_rx->process_packet(data, data_len);
+    return;
+  }
   on_receive_video_data(stream_index, data, data_len);
 }
 
 void EthernetLink::handle_telemetry_data(const uint8_t* data, int data_len) {
   // Forward incoming telemetry data to the upper layer
+  if (m_telemetry_fec_rx) {
+    m_telemetry_fec_rx->process_packet(data, data_len);
+    return;
+  }
   auto shared = std::make_shared<std::vector<uint8_t>>(data, data + data_len);
   on_receive_telemetry_data(shared);
+}
+
+void EthernetLink::loop_stats() {
+  openhd::thread::set_current_thread(
+      "eth_stats", openhd::thread::ThreadClass::BACKGROUND);
+  static constexpr auto INTERVAL = std::chrono::seconds(1);
+  auto next = std::chrono::steady_clock::now() + INTERVAL;
+  while (m_stats_thread_run) {
+    if (std::chrono::steady_clock::now() < next) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    next += INTERVAL;
+    openhd::link_statistics::StatsAirGround stats{};
+    stats.is_air = m_profile.is_air;
+    stats.ready = true;
+    if (m_profile.is_air) {
+      openhd::link_statistics::Xmavlink_openhd_stats_wb_video_air_t air_video{};
+      air_video.curr_injected_bitrate =
+          (int32_t)(m_video_tx_bytes.exchange(0) * 8);
+      air_video.curr_injected_pps = (int32_t)m_video_tx_packets.exchange(0);
+      if (m_video_fec_tx) {
+        air_video.curr_fec_percentage = m_video_fec_tx->get_fec_percentage();
+        const auto fec_stats = m_video_fec_tx->get_stats();
+        auto& air_fec = stats.air_fec_performance;
+        air_fec.curr_fec_encode_time_max_us =
+            openhd::util::get_micros(fec_stats.encode_time_max);
+        if (fec_stats.n_blocks > 0) {
+          air_fec.curr_fec_encode_time_avg_us = openhd::util::get_micros(
+              fec_stats.encode_time_sum / fec_stats.n_blocks);
+          air_fec.curr_fec_block_size_avg =
+              fec_stats.n_primary / fec_stats.n_blocks;
+        }
+      }
+      stats.stats_wb_video_air.push_back(air_video);
+    } else {
+      openhd::link_statistics::Xmavlink_openhd_stats_wb_video_ground_t
+          ground_video{};
+      ground_video.curr_incoming_bitrate =
+          (int32_t)(m_video_rx_bytes.exchange(0) * 8);
+      if (m_video_fec_rx) {
+        const auto fec_stats = m_video_fec_rx->get_stats();
+        ground_video.count_blocks_total = fec_stats.count_blocks_total;
+        ground_video.count_blocks_lost = fec_stats.count_blocks_lost;
+        ground_video.count_blocks_recovered = fec_stats.count_blocks_recovered;
+        ground_video.count_fragments_recovered =
+            fec_stats.count_fragments_recovered;
+        stats.gnd_fec_performance.curr_fec_decode_time_max_us =
+            openhd::util::get_micros(fec_stats.decode_time_max);
+      }
+      stats.stats_wb_video_ground.push_back(ground_video);
+    }
+    openhd::LinkActionHandler::instance().update_link_stats(stats);
+  }
 }
\ No newline at end of file
@@ -29,6 +29,7 @@
 #include "networking_settings.h"
 #include "openhd_config.h"
 #include "openhd_external_device.h"
+#include "openhd_hotplug.h"
 #include "openhd_platform.h"
 #include "openhd_profile.h"
 #include "openhd_util.h"
@@ -167,15 +168,16 @@ void EthernetManager::loop(int operating_mode) {
     opt_ethernet_card = "eth0";
   }
   if (opt_ethernet_card == std::nullopt) {
-    // We need to figure out the ethernet card ourselves
-    while (!m_terminate) {
-      auto card = find_ethernet_device_name();
-      if (card.has_value()) {
-        opt_ethernet_card = card;
-        break;
-      }
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
+    // We need to figure out the ethernet card ourselves - re-checked whenever
+    // a network interface appears
+    openhd::HotplugMonitor::instance().wait_for(
+        [this, &opt_ethernet_card]() {
+          if (m_terminate) return true;
+          opt_ethernet_card = find_ethernet_device_name();
+          return opt_ethernet_card.has_value();
+        },
+        std::chrono::milliseconds::max());
+    if (m_terminate) return;
   }
   if (opt_ethernet_card) {
     configure(operating_mode, opt_ethernet_card.value());
@@ -185,6 +187,7 @@ void EthernetManager::loop(int operating_mode) {
 void EthernetManager::stop() {
   m_console->warn("stop begin");
   m_terminate = true;
+  openhd::HotplugMonitor::instance().interrupt_waiters();
   if (m_thread) {
     m_thread->join();
     m_thread = nullptr;
@@ -206,26 +209,32 @@ void EthernetManager::configure(int operating_mode,
 
 void EthernetManager::loop_ethernet_external_device_listener(
     const std::string& device_name) {
-  while (!m_terminate) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    if (openhd::ethernet::check_eth_adapter_up(device_name)) {
-      m_console->warn("Eth0 is up");
-      break;
-    }
-  }
-  const auto run_command_result_opt = OHDUtil::run_command_out(
-      fmt::format("ip route list dev {}", device_name));
-  if (run_command_result_opt == std::nullopt) {
-    m_console->warn("run command out no result");
-    return;
-  }
-  const auto& run_command_result = run_command_result_opt.value();
-  const auto ip_external_device =
-      OHDUtil::string_in_between("default via ", " proto", run_command_result);
-  // const auto ip_self_network= OHDUtil::string_in_between("src ","
-  // metric",run_command_result);
+  auto& hotplug = openhd::HotplugMonitor::instance();
+  // Re-checked on each link / address / route change
+  hotplug.wait_for(
+      [this, &device_name]() {
+        if (m_terminate) return true;
+        if (openhd::ethernet::check_eth_adapter_up(device_name)) {
+          m_console->warn("Eth0 is up");
+          return true;
+        }
+        return false;
+      },
+      std::chrono::milliseconds::max());
+  if (m_terminate) return;
   const std::string tag = "ETH_" + device_name;
-  const auto external_device = openhd::ExternalDevice{tag, ip_external_device};
+  auto external_device = openhd::ExternalDevice{tag, ""};
+  // The default route shows up once someone provided dhcp - as long as the
+  // adapter stays up
+  auto opt_gateway = hotplug.wait_for_gateway(
+      device_name,
+      [this, &device_name]() {
+        return m_terminate ||
+               !openhd::ethernet::check_eth_adapter_up(device_name);
+      },
+      std::chrono::milliseconds::max());
+  external_device.external_device_ip = opt_gateway.value_or("");
+  if (m_terminate) return;
   // Check if both are valid IPs (otherwise, perhaps the parsing got fucked up)
   if (!external_device.is_valid()) {
     m_console->warn("{} not valid", external_device.to_string());
@@ -234,15 +243,18 @@ void EthernetManager::loop_ethernet_external_device_listener(
   m_console->info("found device:{}", external_device.to_string());
   openhd::ExternalDeviceManager::instance().on_new_external_device(
       external_device, true);
-  // check in regular intervals if the device disconnects
-  while (!m_terminate) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    // check if the state is still okay
-    if (!openhd::ethernet::check_eth_adapter_up(device_name)) {
-      m_console->warn("Eth0 is not up anymore,removing ext device");
-      break;
-    }
-  }
+  // wait until the device disconnects
+  hotplug.wait_for(
+      [this, &device_name]() {
+        if (m_terminate) return true;
+        // check if the state is still okay
+        if (!openhd::ethernet::check_eth_adapter_up(device_name)) {
+          m_console->warn("Eth0 is not up anymore,removing ext device");
+          return true;
+        }
+        return false;
+      },
+      std::chrono::milliseconds::max());
   openhd::ExternalDeviceManager::instance().on_new_external_device(
       external_device, false);
 }
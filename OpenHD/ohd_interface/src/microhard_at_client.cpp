@@ -0,0 +1,544 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "microhard_at_client.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#include "openhd_spdlog_include.h"
+
+namespace openhd::microhard {
+
+// Telnet protocol (RFC 854)
+static constexpr uint8_t TELNET_IAC = 255;
+static constexpr uint8_t TELNET_DONT = 254;
+static constexpr uint8_t TELNET_DO = 253;
+static constexpr uint8_t TELNET_WONT = 252;
+static constexpr uint8_t TELNET_WILL = 251;
+static constexpr uint8_t TELNET_SB = 250;
+static constexpr uint8_t TELNET_SE = 240;
+
+static std::string to_lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+static std::string trim(const std::string& s) {
+  const auto begin = s.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) return "";
+  const auto end = s.find_last_not_of(" \t\r\n");
+  return s.substr(begin, end - begin + 1);
+}
+
+ATClient::ATClient(Options options, STATS_CALLBACK cb)
+    : m_options(std::move(options)), m_cb(std::move(cb)) {
+  m_console = openhd::log::create_or_get("microhard");
+  m_poll_interval_ms = m_options.poll_interval.count();
+  m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = m_wakeup_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event);
+  m_next_connect = std::chrono::steady_clock::now();
+  m_thread = std::make_unique<std::thread>(&ATClient::loop, this);
+}
+
+ATClient::~ATClient() {
+  m_keep_running = false;
+  const uint64_t one = 1;
+  (void)write(m_wakeup_fd, &one, sizeof(one));
+  m_thread->join();
+  m_thread = nullptr;
+  if (m_socket_fd >= 0) close(m_socket_fd);
+  close(m_wakeup_fd);
+  close(m_epoll_fd);
+}
+
+void ATClient::set_poll_interval(std::chrono::milliseconds poll_interval) {
+  m_poll_interval_ms = poll_interval.count();
+  const uint64_t one = 1;
+  (void)write(m_wakeup_fd, &one, sizeof(one));
+}
+
+ATClient::Counters ATClient::get_counters() {
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  return m_counters;
+}
+
+ModemStats ATClient::get_last_stats() {
+  std::lock_guard<std::mutex> lock(m_stats_mutex);
+  return m_last_stats;
+}
+
+std::optional<int> ATClient::parse_value_with_unit(const std::string& response,
+                                                   const std::string& unit) {
+  const auto lower = to_lower(response);
+  const auto lower_unit = to_lower(unit);
+  size_t pos = 0;
+  while ((pos = lower.find(lower_unit, pos)) != std::string::npos) {
+    const size_t unit_pos = pos;
+    pos += lower_unit.size();
+    // Unit needs to end here (dB vs dBm)
+    if (pos < lower.size() && std::isalpha((unsigned char)lower[pos])) {
+      continue;
+    }
+    // Walk back over whitespace, then over the number
+    size_t end = unit_pos;
+    while (end > 0 && lower[end - 1] == ' ') end--;
+    size_t begin = end;
+    while (begin > 0 && std::isdigit((unsigned char)lower[begin - 1])) begin--;
+    if (begin == end) continue;
+    if (begin > 0 && lower[begin - 1] == '-') begin--;
+    return std::atoi(lower.c_str() + begin);
+  }
+  return std::nullopt;
+}
+
+std::optional<int> ATClient::parse_first_value(const std::string& response) {
+  size_t line_begin = 0;
+  while (line_begin < response.size()) {
+    auto line_end = response.find('\n', line_begin);
+    if (line_end == std::string::npos) line_end = response.size();
+    const auto line = trim(response.substr(line_begin, line_end - line_begin));
+    line_begin = line_end + 1;
+    // The echoed command (might be prefixed by the prompt)
+    if (to_lower(line).find("at+") != std::string::npos) continue;
+    for (size_t i = 0; i < line.size(); i++) {
+      const bool is_start =
+          (i == 0 || !std::isalnum((unsigned char)line[i - 1]));
+      if (!is_start) continue;
+      size_t j = i;
+      if (line[j] == '-') j++;
+      if (j < line.size() && std::isdigit((unsigned char)line[j])) {
+        size_t k = j;
+        while (k < line.size() && std::isdigit((unsigned char)line[k])) k++;
+        if (k == line.size() || !std::isalnum((unsigned char)line[k])) {
+          return std::atoi(line.c_str() + i);
+        }
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+std::string ATClient::state_to_string(State state) {
+  switch (state) {
+    case State::DISCONNECTED:
+      return "DISCONNECTED";
+    case State::CONNECTING:
+      return "CONNECTING";
+    case State::WAIT_LOGIN_PROMPT:
+      return "WAIT_LOGIN_PROMPT";
+    case State::WAIT_PASSWORD_PROMPT:
+      return "WAIT_PASSWORD_PROMPT";
+    case State::WAIT_COMMAND_PROMPT:
+      return "WAIT_COMMAND_PROMPT";
+    case State::READY:
+      return "READY";
+  }
+  return "UNKNOWN";
+}
+
+void ATClient::set_state(State state) {
+  m_console->debug("{} -> {}", state_to_string(m_state),
+                   state_to_string(state));
+  m_state = state;
+  m_state_deadline = std::chrono::steady_clock::now() + m_options.timeout;
+}
+
+void ATClient::update_epoll_events() {
+  if (m_socket_fd < 0) return;
+  epoll_event event{};
+  event.events = EPOLLIN;
+  if (m_state == State::CONNECTING || !m_tx_buffer.empty()) {
+    event.events |= EPOLLOUT;
+  }
+  event.data.fd = m_socket_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, m_socket_fd, &event);
+}
+
+void ATClient::start_connect() {
+  m_socket_fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (m_socket_fd < 0) {
+    disconnect(fmt::format("socket {}", strerror(errno)));
+    return;
+  }
+  const int one = 1;
+  setsockopt(m_socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(m_options.port);
+  if (inet_pton(AF_INET, m_options.ip.c_str(), &addr.sin_addr) != 1) {
+    disconnect(fmt::format("invalid ip [{}]", m_options.ip));
+    return;
+  }
+  epoll_event event{};
+  event.events = EPOLLIN | EPOLLOUT;
+  event.data.fd = m_socket_fd;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_socket_fd, &event);
+  set_state(State::CONNECTING);
+  if (connect(m_socket_fd, (sockaddr*)&addr, sizeof(addr)) < 0 &&
+      errno != EINPROGRESS) {
+    disconnect(fmt::format("connect {}", strerror(errno)));
+  }
+}
+
+void ATClient::on_connected() {
+  {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_counters.n_connects++;
+  }
+  m_console->debug("Connected to {}:{}", m_options.ip, m_options.port);
+  set_state(State::WAIT_LOGIN_PROMPT);
+  update_epoll_events();
+}
+
+void ATClient::disconnect(const std::string& reason, bool is_timeout) {
+  m_console->warn("Microhard session {}:{} closed: {}", m_options.ip,
+                  m_options.port, reason);
+  if (m_socket_fd >= 0) {
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_socket_fd, nullptr);
+    close(m_socket_fd);
+    m_socket_fd = -1;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_counters.n_disconnects++;
+    if (is_timeout) m_counters.n_timeouts++;
+  }
+  m_rx_buffer.clear();
+  m_tx_buffer.clear();
+  m_telnet_pending.clear();
+  m_pending_queries.clear();
+  m_current_response.clear();
+  // Backoff, such that an unreachable / misconfigured modem doesn't result
+  // in a busy loop
+  m_reconnect_backoff = std::min(
+      std::max(m_reconnect_backoff * 2, std::chrono::milliseconds(250)),
+      m_options.max_reconnect_backoff);
+  m_next_connect = std::chrono::steady_clock::now() + m_reconnect_backoff;
+  m_state = State::DISCONNECTED;
+}
+
+std::string ATClient::process_telnet(const std::string& data) {
+  std::string in = m_telnet_pending + data;
+  m_telnet_pending.clear();
+  std::string out;
+  std::string reply;
+  size_t i = 0;
+  while (i < in.size()) {
+    const auto c = (uint8_t)in[i];
+    if (c != TELNET_IAC) {
+      out.push_back(in[i]);
+      i++;
+      continue;
+    }
+    if (i + 1 >= in.size()) break;  // incomplete
+    const auto cmd = (uint8_t)in[i + 1];
+    if (cmd == TELNET_IAC) {  // escaped 255
+      out.push_back(in[i]);
+      i += 2;
+    } else if (cmd == TELNET_DO || cmd == TELNET_DONT || cmd == TELNET_WILL ||
+               cmd == TELNET_WONT) {
+      if (i + 2 >= in.size()) break;  // incomplete
+      const auto option = (uint8_t)in[i + 2];
+      if (cmd == TELNET_DO) {
+        reply += {(char)TELNET_IAC, (char)TELNET_WONT, (char)option};
+      } else if (cmd == TELNET_WILL) {
+        reply += {(char)TELNET_IAC, (char)TELNET_DONT, (char)option};
+      }
+      i += 3;
+    } else if (cmd == TELNET_SB) {
+      // Skip until IAC SE
+      size_t j = i + 2;
+      bool found = false;
+      for (; j + 1 < in.size(); j++) {
+        if ((uint8_t)in[j] == TELNET_IAC && (uint8_t)in[j + 1] == TELNET_SE) {
+          found = true;
+          break;
+        }
+      }
+      if (!found) break;  // incomplete
+      i = j + 2;
+    } else {
+      i += 2;
+    }
+  }
+  m_telnet_pending = in.substr(i);
+  if (!reply.empty()) send(reply);
+  return out;
+}
+
+void ATClient::send(const std::string& data) {
+  m_tx_buffer += data;
+  if (!write_socket()) return;
+  update_epoll_events();
+}
+
+bool ATClient::write_socket() {
+  while (!m_tx_buffer.empty()) {
+    const ssize_t ret = ::send(m_socket_fd, m_tx_buffer.data(),
+                               m_tx_buffer.size(), MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+      if (errno == EINTR) continue;
+      disconnect(fmt::format("send {}", strerror(errno)));
+      return false;
+    }
+    m_tx_buffer.erase(0, ret);
+  }
+  return true;
+}
+
+bool ATClient::read_socket() {
+  char buff[2048];
+  while (true) {
+    const ssize_t ret = recv(m_socket_fd, buff, sizeof(buff), 0);
+    if (ret > 0) {
+      m_rx_buffer += process_telnet(std::string(buff, ret));
+      // process_telnet might have failed sending
+      if (m_socket_fd < 0) return false;
+      continue;
+    }
+    if (ret == 0) {
+      // Process what we got so far first (e.g. "Login incorrect")
+      handle_rx();
+      if (m_socket_fd >= 0) disconnect("closed by modem");
+      return false;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+    if (errno == EINTR) continue;
+    disconnect(fmt::format("recv {}", strerror(errno)));
+    return false;
+  }
+}
+
+void ATClient::handle_rx() {
+  const auto lower = to_lower(m_rx_buffer);
+  switch (m_state) {
+    case State::WAIT_LOGIN_PROMPT:
+      if (lower.find("login:") != std::string::npos) {
+        m_rx_buffer.clear();
+        set_state(State::WAIT_PASSWORD_PROMPT);
+        send(m_options.username + "\n");
+      }
+      break;
+    case State::WAIT_PASSWORD_PROMPT:
+      if (lower.find("password:") != std::string::npos) {
+        m_rx_buffer.clear();
+        set_state(State::WAIT_COMMAND_PROMPT);
+        send(m_options.password + "\n");
+      }
+      break;
+    case State::WAIT_COMMAND_PROMPT: {
+      if (lower.find("incorrect") != std::string::npos ||
+          lower.find("login:") != std::string::npos) {
+        disconnect("login failed");
+        return;
+      }
+      const auto trimmed = trim(m_rx_buffer);
+      if (!trimmed.empty() && trimmed.back() == '>') {
+        m_rx_buffer.clear();
+        set_state(State::READY);
+        m_console->debug("Logged in");
+        m_reconnect_backoff = std::chrono::milliseconds(0);
+        m_n_cycles_since_connect = 0;
+        m_next_poll = std::chrono::steady_clock::now();
+      }
+      break;
+    }
+    case State::READY:
+      handle_reply_lines();
+      break;
+    default:
+      break;
+  }
+}
+
+void ATClient::handle_reply_lines() {
+  size_t line_end;
+  while ((line_end = m_rx_buffer.find('\n')) != std::string::npos) {
+    const auto line = m_rx_buffer.substr(0, line_end + 1);
+    m_rx_buffer.erase(0, line_end + 1);
+    if (m_pending_queries.empty()) continue;  // e.g. prompt, unsolicited
+    m_current_response += line;
+    const auto trimmed = trim(line);
+    const bool is_ok = trimmed == "OK";
+    const bool is_error = trimmed == "ERROR";
+    if (!is_ok && !is_error) continue;
+    const auto query = m_pending_queries.front();
+    m_pending_queries.pop_front();
+    const auto value = query.unit.empty()
+                           ? parse_first_value(m_current_response)
+                           : parse_value_with_unit(m_current_response,
+                                                   query.unit);
+    if (is_error || !value.has_value()) {
+      std::lock_guard<std::mutex> lock(m_stats_mutex);
+      m_counters.n_parse_errors++;
+      m_console->debug("{} no value in [{}]", trim(query.command),
+                       m_current_response);
+    } else {
+      m_cycle_stats.*(query.value) = value;
+    }
+    m_current_response.clear();
+    if (m_pending_queries.empty()) {
+      // Poll cycle complete
+      ModemStats stats;
+      {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_counters.n_poll_cycles++;
+        m_last_stats = m_cycle_stats;
+        stats = m_last_stats;
+      }
+      if (m_cb) m_cb(stats);
+    }
+  }
+}
+
+void ATClient::send_poll_queries() {
+  // The fast changing values are queried on each poll
+  static const std::vector<Query> fast_queries = {
+      {"AT+MWRSSI\n", &ModemStats::rssi_dbm, "dBm"},
+      {"AT+MWSNR\n", &ModemStats::snr_db, "dB"},
+      {"AT+MWNOISEFLOOR\n", &ModemStats::noise_floor_dbm, "dBm"}};
+  static const std::vector<Query> slow_queries = {
+      {"AT+MWFREQ2400\n", &ModemStats::frequency_mhz, "MHz"},
+      {"AT+MWBAND\n", &ModemStats::bandwidth_mhz, "MHz"},
+      {"AT+MWTXPOWER\n", &ModemStats::tx_power_dbm, "dBm"},
+      {"AT+MWVRATE\n", &ModemStats::rate_mode, ""}};
+  std::string commands;
+  for (const auto& query : fast_queries) {
+    m_pending_queries.push_back(query);
+    commands += query.command;
+  }
+  if (m_n_cycles_since_connect % std::max(m_options.slow_query_divider, 1) ==
+      0) {
+    for (const auto& query : slow_queries) {
+      m_pending_queries.push_back(query);
+      commands += query.command;
+    }
+  }
+  m_n_cycles_since_connect++;
+  const auto now = std::chrono::steady_clock::now();
+  m_next_poll = now + std::chrono::milliseconds(m_poll_interval_ms.load());
+  m_state_deadline = now + m_options.timeout;
+  // All queries of this cycle in one write
+  send(commands);
+}
+
+void ATClient::check_timeouts() {
+  const auto now = std::chrono::steady_clock::now();
+  if (m_state == State::DISCONNECTED) return;
+  if (m_state == State::READY) {
+    if (!m_pending_queries.empty() && now > m_state_deadline) {
+      disconnect("reply timeout", true);
+    }
+    return;
+  }
+  if (now > m_state_deadline) {
+    disconnect(fmt::format("timeout in {}", state_to_string(m_state)), true);
+  }
+}
+
+void ATClient::loop() {
+  std::array<epoll_event, 4> events{};
+  while (m_keep_running) {
+    const auto now = std::chrono::steady_clock::now();
+    if (m_state == State::DISCONNECTED && now >= m_next_connect) {
+      start_connect();
+    }
+    if (m_state == State::READY && m_pending_queries.empty() &&
+        now >= m_next_poll) {
+      send_poll_queries();
+    }
+    // Sleep until the next thing we need to do (unless there is data)
+    auto next = m_state_deadline;
+    if (m_state == State::DISCONNECTED) {
+      next = m_next_connect;
+    } else if (m_state == State::READY && m_pending_queries.empty()) {
+      // (interval might have changed)
+      next = std::min(m_next_poll,
+                      now + std::chrono::milliseconds(m_poll_interval_ms));
+      m_next_poll = next;
+    }
+    const auto timeout_ms =
+        std::max((int64_t)0,
+                 (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                     next - std::chrono::steady_clock::now())
+                         .count() +
+                     1);
+    const int n = epoll_wait(m_epoll_fd, events.data(), events.size(),
+                             (int)std::min(timeout_ms, (int64_t)1000));
+    if (n < 0 && errno != EINTR) {
+      m_console->warn("epoll_wait {}", strerror(errno));
+    }
+    for (int i = 0; i < n; i++) {
+      const auto& event = events[i];
+      if (event.data.fd == m_wakeup_fd) {
+        uint64_t value;
+        (void)read(m_wakeup_fd, &value, sizeof(value));
+        continue;
+      }
+      if (event.data.fd != m_socket_fd || m_socket_fd < 0) continue;
+      if (m_state == State::CONNECTING) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(m_socket_fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+          disconnect(fmt::format("connect {}", strerror(error)));
+          continue;
+        }
+        on_connected();
+      }
+      if (event.events & EPOLLIN) {
+        if (!read_socket()) continue;
+        handle_rx();
+        if (m_socket_fd < 0) continue;
+      }
+      if ((event.events & EPOLLOUT) && !m_tx_buffer.empty()) {
+        if (!write_socket()) continue;
+        update_epoll_events();
+      }
+      if ((event.events & (EPOLLERR | EPOLLHUP)) && m_socket_fd >= 0) {
+        disconnect("socket error");
+      }
+    }
+    check_timeouts();
+  }
+}
+
+}  // namespace openhd::microhard
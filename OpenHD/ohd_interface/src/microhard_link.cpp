@@ -23,10 +23,6 @@
 
 #include "microhard_link.h"
 
-#include <Poco/Exception.h>
-#include <Poco/Net/SocketAddress.h>
-#include <Poco/Net/SocketStream.h>
-#include <Poco/Net/StreamSocket.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
@@ -35,30 +31,24 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <memory>
-#include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "openhd_action_handler.h"
 #include "openhd_config.h"
 #include "openhd_temporary_air_or_ground.h"
 
-const std::string command = "AT+MWRSSI\n";
-const std::string command2 = "AT+MWTXPOWER\n";
-const std::string command3 = "AT+MWBAND\n";
-const std::string command4 = "AT+MWFREQ2400\n";
-const std::string command5 = "AT+MWVRATE\n";
-const std::string command6 = "AT+MWNOISEFLOOR\n";
-const std::string command7 = "AT+MWSNR\n";
-
 // Parse hardware.config
 // const auto config = openhd::load_config();
 // static const auto MICROHARD_IP_RANGE = config.MICROHARD_IP_AIR;
@@ -79,8 +69,8 @@ static const int MICROHARD_UDP_PORT_TELEMETRY_AIR_TX = 5000;
 static const int MICROHARD_UDP_PORT_VIDEO_AIR_TX = 5001;
 static const std::string DEFAULT_DEVICE_IP_GND = "";
 static const std::string DEFAULT_DEVICE_IP_AIR = "";
-const std::string username = "admin\n";
-const std::string password = "qwertz1\n";
+const std::string username = "admin";
+const std::string password = "qwertz1";
 
 // Helper function to retrieve IP addresses starting with a specific prefix
 std::vector<std::string> get_ip_addresses(const std::string& prefix) {
@@ -135,169 +125,6 @@ std::vector<std::string> get_ip_addresses(const std::string& prefix) {
   return ip_addresses;
 }
 
-void send_command_and_process_response(Poco::Net::SocketStream& stream,
-                                       const std::string& command,
-                                       const std::regex& regex,
-                                       const std::string& value_name) {
-  stream << command << std::flush;
-
-  std::string response;
-  std::string line;
-  while (std::getline(stream, line)) {
-    response += line + "\n";
-    if (line.find("OK") != std::string::npos) {
-      break;
-    }
-  }
-
-  std::smatch match;
-  if (std::regex_search(response, match, regex)) {
-    std::string value_str = match[1].str();
-    int value = std::stoi(value_str);
-    openhd::log::get_default()->warn(
-        "{} value: {} {}", value_name, value,
-        (value_name == "SNR" || value_name == "NoiseFloor") ? "dBm" : "MHz");
-  } else {
-    openhd::log::get_default()->warn("{} not found in response: '{}'",
-                                     value_name, response);
-  }
-}
-
-void communicate_with_device(const std::string& ip,
-                             const std::string& command) {
-  openhd::log::get_default()->warn(
-      "Starting communication with device at IP: {}", ip);
-
-  try {
-    Poco::Net::SocketAddress address(ip, 23);
-    Poco::Net::StreamSocket socket(address);
-    Poco::Net::SocketStream stream(socket);
-
-    // Login to the device
-    std::this_thread::sleep_for(
-        std::chrono::seconds(1));  // Wait for a second to process username
-    openhd::log::get_default()->debug("Sending username: {}", username);
-    stream << username << std::flush;
-    std::this_thread::sleep_for(
-        std::chrono::seconds(1));  // Wait for a second to process username
-
-    openhd::log::get_default()->debug("Sending password: {}", password);
-    stream << password << std::flush;
-    std::this_thread::sleep_for(
-        std::chrono::seconds(3));  // Wait for a second to process password
-
-    while (
-        true) {  // Infinite loop for sending commands and receiving responses
-      // Send the command to the device
-      stream << command << std::flush;
-
-      // Read the response from the device
-      std::string response;
-      std::string line;
-      while (std::getline(stream, line)) {
-        response += line + "\n";
-        // Break out of the loop if the end of the response is reached
-        if (line.find("OK") != std::string::npos) {
-          break;
-        }
-      }
-
-      // Extract and log the RSSI value
-      std::regex rssi_regex(R"(([-\d]+) dBm)");
-      std::smatch match;
-      if (std::regex_search(response, match, rssi_regex)) {
-        std::string rssi_value_str = match[1].str();
-        int rssi_value = std::stoi(rssi_value_str);
-        openhd::log::get_default()->warn("Extracted RSSI value: {} dBm",
-                                         rssi_value);
-
-        // some_other_function(rssi_value);
-
-      } else {
-        openhd::log::get_default()->warn("RSSI value not found in response");
-      }
-    }
-
-  } catch (const Poco::Exception& e) {
-    openhd::log::get_default()->warn("POCO Exception: {}", e.displayText());
-  } catch (const std::exception& e) {
-    openhd::log::get_default()->warn("Standard Exception: {}", e.what());
-  }
-}
-
-void communicate_with_device_slow(const std::string& ip,
-                                  const std::string& command2) {
-  openhd::log::get_default()->warn(
-      "Starting slower communication with device at IP: {}", ip);
-
-  try {
-    std::this_thread::sleep_for(std::chrono::seconds(5));
-    Poco::Net::SocketAddress address(ip, 23);
-    Poco::Net::StreamSocket socket(address);
-    Poco::Net::SocketStream stream(socket);
-
-    // Login to the device
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    openhd::log::get_default()->debug("Sending username: {}", username);
-    stream << username << std::flush;
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-
-    openhd::log::get_default()->debug("Sending password: {}", password);
-    stream << password << std::flush;
-    std::this_thread::sleep_for(std::chrono::seconds(3));
-
-    const std::vector<std::pair<std::string, std::regex>> commands = {
-        {command2, std::regex(R"(([-\d]+) dBm)", std::regex::icase)},
-        {command3, std::regex(R"(\b(\d+)\s*MHz\b)", std::regex::icase)},
-        {command4, std::regex(R"(\b(\d+)\s*MHz\b)", std::regex::icase)},
-        {command5, std::regex(R"(\b(\d+)\b)", std::regex::icase)},
-        {command6, std::regex(R"((-?\d+)\s*dBm\b)", std::regex::icase)},
-        {command7, std::regex(R"(\b(\d+)\s*dB\b)", std::regex::icase)}};
-
-    const std::vector<std::string> value_names = {
-        "TX-Power", "Bandwidth", "Frequency", "Rate Mode", "NoiseFloor", "SNR"};
-
-    while (true) {
-      for (size_t i = 0; i < commands.size(); ++i) {
-        send_command_and_process_response(stream, commands[i].first,
-                                          commands[i].second, value_names[i]);
-      }
-      std::this_thread::sleep_for(std::chrono::seconds(3));
-    }
-
-  } catch (const Poco::Exception& e) {
-    openhd::log::get_default()->warn("POCO Exception: {}", e.displayText());
-  } catch (const std::exception& e) {
-    openhd::log::get_default()->warn("Standard Exception: {}", e.what());
-  }
-}
-
-void MicrohardLink::monitor_gateway_signal_strength(
-    const std::string& gateway_ip) {
-  if (gateway_ip.empty()) {
-    openhd::log::get_default()->warn(
-        "Gateway IP is empty. Exiting monitoring.");
-
-    return;
-  }
-
-  // Continuously connect, send command, and print output every second
-  while (true) {
-    openhd::log::get_default()->warn("Getting RSSI from gateway IP: {}",
-                                     gateway_ip);
-    try {
-      std::string command2 = "AT+MWRSSI\n";
-      communicate_with_device(gateway_ip, command2);
-      openhd::log::get_default()->warn("RSSI data retrieval complete.");
-    } catch (const std::exception& e) {
-      openhd::log::get_default()->warn(
-          "Exception occurred while getting RSSI data: {}", e.what());
-    }
-    // Wait for 1 second before the next iteration
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-  }
-}
-
 std::string get_gateway_ip() {
   std::string cmd =
       "ip route show default | awk '/default/ {print $3}' | grep "
@@ -461,14 +288,54 @@ MicrohardLink::MicrohardLink(OHDProfile profile) : m_profile(profile) {
     m_video_rx->runInBackground();
   }
 
-  // Start monitoring gateway signal strength
-  std::thread monitor_thread(monitor_gateway_signal_strength, get_gateway_ip());
-  monitor_thread.detach();  // Run in the background
+  const auto gateway_ip = get_gateway_ip();
+  if (gateway_ip.empty()) {
+    openhd::log::get_default()->warn(
+        "Gateway IP is empty, no microhard stats");
+  } else {
+    openhd::microhard::ATClient::Options options{};
+    options.ip = gateway_ip;
+    options.username = username;
+    options.password = password;
+    options.poll_interval = std::chrono::milliseconds(m_stats_interval_ms);
+    m_at_client = std::make_unique<openhd::microhard::ATClient>(
+        options, [this](const openhd::microhard::ModemStats& stats) {
+          on_modem_stats(stats);
+        });
+  }
+}
 
-  // Start the second communication thread
-  std::thread second_thread(communicate_with_device_slow, get_gateway_ip(),
-                            command2);
-  second_thread.detach();  // Run in the background
+MicrohardLink::~MicrohardLink() {
+  // Stop polling before the rest goes away
+  m_at_client = nullptr;
+}
+
+void MicrohardLink::on_modem_stats(
+    const openhd::microhard::ModemStats& modem_stats) {
+  openhd::link_statistics::StatsAirGround stats{};
+  stats.is_air = m_profile.is_air;
+  stats.ready = true;
+  auto& card = stats.cards[0];
+  card.NON_MAVLINK_CARD_ACTIVE = true;
+  card.rx_rssi = (int8_t)modem_stats.rssi_dbm.value_or(-127);
+  card.rx_noise_adapter = (int8_t)modem_stats.noise_floor_dbm.value_or(-127);
+  if (modem_stats.snr_db.has_value()) {
+    // 0..40dB SNR mapped to 0..100%
+    const int snr = std::clamp(modem_stats.snr_db.value(), 0, 40);
+    card.rx_signal_quality_adapter = (int8_t)(snr * 100 / 40);
+  } else {
+    card.rx_signal_quality_adapter = -1;
+  }
+  if (modem_stats.tx_power_dbm.has_value()) {
+    // The modem reports dBm, the link stats are in mW
+    card.tx_power_current = (int16_t)std::lround(
+        std::pow(10.0, modem_stats.tx_power_dbm.value() / 10.0));
+  }
+  stats.monitor_mode_link.curr_tx_channel_mhz =
+      modem_stats.frequency_mhz.value_or(0);
+  stats.monitor_mode_link.curr_tx_channel_w_mhz =
+      modem_stats.bandwidth_mhz.value_or(0);
+  openhd::LinkActionHandler::instance().update_link_stats(stats);
 }
 
 void MicrohardLink::transmit_telemetry_data(OHDLink::TelemetryTxPacket packet) {
@@ -500,6 +367,16 @@ std::vector<openhd::Setting> MicrohardLink::get_all_settings() {
   auto change_dummy =
       IntSetting{0, [this](std::string, int value) { return true; }};
   settings.push_back(Setting{"MICROHARD_DUMMY0", change_dummy});
+  auto change_stats_interval = IntSetting{
+      m_stats_interval_ms, [this](std::string, int value) {
+        if (value < 100 || value > 10000) return false;
+        m_stats_interval_ms = value;
+        if (m_at_client) {
+          m_at_client->set_poll_interval(std::chrono::milliseconds(value));
+        }
+        return true;
+      }};
+  settings.push_back(Setting{"MH_STATS_MS", change_stats_interval});
 
   return settings;
 }
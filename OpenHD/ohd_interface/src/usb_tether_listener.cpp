@@ -28,6 +28,7 @@
 #include <cassert>
 #include <utility>
 
+#include "openhd_hotplug.h"
 #include "openhd_spdlog.h"
 #include "openhd_spdlog_include.h"
 
@@ -41,6 +42,7 @@ USBTetherListener::USBTetherListener() {
 
 USBTetherListener::~USBTetherListener() {
   m_check_connection_thread_stop = true;
+  openhd::HotplugMonitor::instance().interrupt_waiters();
   if (m_check_connection_thread->joinable()) {
     m_check_connection_thread->join();
   }
@@ -73,17 +75,22 @@ static std::vector<std::string> get_usb_tethering_devices() {
 void USBTetherListener::connectOnce() {
   m_console->debug("connectOnce()");
   const std::string connected_devices_directory = "/sys/class/net/";
+  auto& hotplug = openhd::HotplugMonitor::instance();
   std::string connected_device_name;
-  while (!m_check_connection_thread_stop) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    const auto usb_tether_devices = get_usb_tethering_devices();
-    if (!usb_tether_devices.empty()) {
-      m_console->debug("Found {} tethering devices",
-                       OHDUtil::str_vec_as_string(usb_tether_devices));
-      connected_device_name = usb_tether_devices.at(0);
-      break;
-    }
-  }
+  // Re-checked whenever a network interface appears / changes
+  hotplug.wait_for(
+      [this, &connected_device_name]() {
+        if (m_check_connection_thread_stop) return true;
+        const auto usb_tether_devices = get_usb_tethering_devices();
+        if (!usb_tether_devices.empty()) {
+          m_console->debug("Found {} tethering devices",
+                           OHDUtil::str_vec_as_string(usb_tether_devices));
+          connected_device_name = usb_tether_devices.at(0);
+          return true;
+        }
+        return false;
+      },
+      std::chrono::milliseconds::max());
   // We were stopped externally, no reason to continue
   if (connected_device_name.empty()) return;
   m_console->info("Found USB tethering device {}", connected_device_name);
@@ -91,41 +98,35 @@ void USBTetherListener::connectOnce() {
   // to it. example on my Ubuntu pc: ip route list dev usb0 default via
   // 192.168.18.229 proto dhcp metric 101 192.168.18.0/24 proto kernel scope
   // link src 192.168.18.155 metric 101
-  const auto run_command_result_opt = OHDUtil::run_command_out(
-      fmt::format("ip route list dev {}", connected_device_name));
-  if (run_command_result_opt == std::nullopt) {
-    m_console->warn("run command out no result");
-    return;
-  }
-  const auto& run_command_result = run_command_result_opt.value();
-  const auto ip_external_device =
-      OHDUtil::string_in_between("default via ", " proto", run_command_result);
-  // const auto ip_external_device2= OHDUtil::string_in_between("default via ","
-  // proto",run_command_result);
-  const auto ip_self_network =
-      OHDUtil::string_in_between("src ", " metric", run_command_result);
-
-  const auto external_device =
-      openhd::ExternalDevice{connected_device_name, ip_external_device};
+  // The default route shows up once the phone's DHCP server answered.
+  openhd::ExternalDevice external_device{connected_device_name, ""};
+  auto opt_gateway = hotplug.wait_for_gateway(
+      connected_device_name,
+      [this]() { return m_check_connection_thread_stop.load(); },
+      std::chrono::seconds(5));
+  external_device.external_device_ip = opt_gateway.value_or("");
+  if (m_check_connection_thread_stop) return;
   // Check if both are valid IPs (otherwise, perhaps the parsing got fucked up)
   if (!external_device.is_valid()) {
     m_console->warn("{} not valid", external_device.to_string());
-    std::this_thread::sleep_for(std::chrono::seconds(2));  // try again later
     return;
   }
   m_console->info("found device:{}", external_device.to_string());
   openhd::ExternalDeviceManager::instance().on_new_external_device(
       external_device, true);
-  // check in regular intervals if the tethering device disconnects.
-  while (!m_check_connection_thread_stop) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    if (!OHDFilesystemUtil::exists(connected_devices_directory +
-                                   connected_device_name)) {
-      m_console->warn("USB Tether device {} disconnected",
-                      connected_device_name);
-      break;
-    }
-  }
+  // wait until the tethering device disconnects.
+  hotplug.wait_for(
+      [this, &connected_devices_directory, &connected_device_name]() {
+        if (m_check_connection_thread_stop) return true;
+        if (!OHDFilesystemUtil::exists(connected_devices_directory +
+                                       connected_device_name)) {
+          m_console->warn("USB Tether device {} disconnected",
+                          connected_device_name);
+          return true;
+        }
+        return false;
+      },
+      std::chrono::milliseconds::max());
   openhd::ExternalDeviceManager::instance().on_new_external_device(
       external_device, false);
 }
@@ -0,0 +1,294 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_channel_switch.h"
+
+#include <algorithm>
+
+#include "openhd_spdlog.h"
+
+namespace openhd::wb {
+
+static std::shared_ptr<spdlog::logger> get_console() {
+  return openhd::log::create_or_get("wb_channel_switch");
+}
+
+static std::string channel_to_string(const WBChannel& channel) {
+  return fmt::format("{}Mhz@{}Mhz", channel.frequency_mhz,
+                     channel.channel_width_mhz);
+}
+
+static int ms_until(std::chrono::steady_clock::time_point tp,
+                    std::chrono::steady_clock::time_point now) {
+  if (now >= tp) return 0;
+  const auto ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(tp - now).count();
+  return static_cast<int>(std::min<int64_t>(ms, UINT16_MAX));
+}
+
+ChannelSwitchAir::ChannelSwitchAir(RETUNE_CB retune_cb,
+                                   ChannelSwitchConfig config)
+    : m_retune_cb(std::move(retune_cb)), m_config(config) {}
+
+bool ChannelSwitchAir::request_switch(const WBChannel& current,
+                                      const WBChannel& target,
+                                      bool ground_connected,
+                                      Clock::time_point now) {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_state != State::IDLE) {
+      get_console()->warn("Channel switch to {} rejected, switch in progress",
+                          channel_to_string(target));
+      return false;
+    }
+    m_switch_id++;
+    m_prev = current;
+    m_target = target;
+    if (ground_connected) {
+      m_state = State::ANNOUNCING;
+      m_acked = false;
+      m_n_attempts = 1;
+      m_switch_tp = now + m_config.lead_time;
+      get_console()->info("Announcing switch {} {}->{} in {}ms", m_switch_id,
+                          channel_to_string(current), channel_to_string(target),
+                          m_config.lead_time.count());
+      return true;
+    }
+    m_stats.n_uncoordinated++;
+  }
+  get_console()->info("No ground, switching to {} right away",
+                      channel_to_string(target));
+  m_retune_cb(target, false);
+  return true;
+}
+
+void ChannelSwitchAir::on_ack(const ChannelSwitchAck& ack,
+                              Clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_last_ground_packet_tp = now;
+  if (ack.switch_id != m_switch_id) return;
+  if (m_state == State::ANNOUNCING && !m_acked) {
+    m_acked = true;
+    get_console()->debug("Switch {} acknowledged", m_switch_id);
+  }
+}
+
+void ChannelSwitchAir::on_packet_from_ground(Clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_last_ground_packet_tp = now;
+}
+
+std::optional<ChannelSwitchAnnounce> ChannelSwitchAir::update(
+    Clock::time_point now) {
+  std::optional<std::pair<WBChannel, bool>> retune;
+  std::optional<ChannelSwitchAnnounce> ret;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_state == State::ANNOUNCING && now >= m_switch_tp) {
+      if (!m_acked && m_n_attempts < m_config.max_announce_attempts) {
+        m_n_attempts++;
+        m_stats.n_postponed++;
+        m_switch_tp = now + m_config.lead_time;
+        get_console()->warn("Switch {} not acknowledged, postponing ({}/{})",
+                            m_switch_id, m_n_attempts,
+                            m_config.max_announce_attempts);
+      } else {
+        if (!m_acked) {
+          get_console()->warn("Switch {} not acknowledged, switching anyways",
+                              m_switch_id);
+        }
+        m_state = State::VERIFYING;
+        m_switch_tp = now;
+        retune = std::make_pair(m_target, false);
+      }
+    }
+    if (m_state == State::ANNOUNCING) {
+      ret = ChannelSwitchAnnounce{
+          m_switch_id,
+          static_cast<uint32_t>(m_target.frequency_mhz),
+          static_cast<uint8_t>(m_target.channel_width_mhz),
+          static_cast<uint32_t>(m_prev.frequency_mhz),
+          static_cast<uint8_t>(m_prev.channel_width_mhz),
+          static_cast<uint16_t>(ms_until(m_switch_tp, now))};
+    } else if (m_state == State::VERIFYING && !retune.has_value()) {
+      auto last_heard = m_switch_tp;
+      if (m_last_ground_packet_tp >= m_switch_tp + m_config.guard_time) {
+        last_heard = m_last_ground_packet_tp;
+      }
+      if (now - last_heard >= m_config.fallback_deadline) {
+        m_state = State::IDLE;
+        m_stats.n_fallbacks++;
+        get_console()->warn("Switch {} failed, falling back to {}",
+                            m_switch_id, channel_to_string(m_prev));
+        retune = std::make_pair(m_prev, true);
+      } else if (now - m_switch_tp >= m_config.verify_window) {
+        m_state = State::IDLE;
+        m_stats.n_switches++;
+        get_console()->info("Switch {} to {} done", m_switch_id,
+                            channel_to_string(m_target));
+      }
+    }
+  }
+  if (retune.has_value()) {
+    m_retune_cb(retune->first, retune->second);
+  }
+  return ret;
+}
+
+ChannelSwitchAir::Clock::time_point ChannelSwitchAir::get_next_deadline() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_state == State::ANNOUNCING) return m_switch_tp;
+  if (m_state == State::VERIFYING) {
+    auto last_heard = std::max(m_switch_tp, m_last_ground_packet_tp);
+    return std::min(last_heard + m_config.fallback_deadline,
+                    m_switch_tp + m_config.verify_window);
+  }
+  return Clock::time_point::max();
+}
+
+bool ChannelSwitchAir::is_in_progress() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_state != State::IDLE;
+}
+
+ChannelSwitchStats ChannelSwitchAir::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats;
+}
+
+ChannelSwitchGround::ChannelSwitchGround(RETUNE_CB retune_cb,
+                                         ChannelSwitchConfig config)
+    : m_retune_cb(std::move(retune_cb)), m_config(config) {}
+
+void ChannelSwitchGround::on_announce(const ChannelSwitchAnnounce& announce,
+                                      Clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_last_air_packet_tp = now;
+  if (m_state == State::VERIFYING) return;
+  if (m_state == State::IDLE && m_last_switch_id.has_value() &&
+      m_last_switch_id.value() == announce.switch_id) {
+    return;
+  }
+  const WBChannel target{static_cast<int>(announce.target_frequency_mhz),
+                         announce.target_channel_width_mhz};
+  if (target.frequency_mhz < 100 ||
+      (target.channel_width_mhz != 20 && target.channel_width_mhz != 40)) {
+    get_console()->warn("Invalid channel switch announce {}",
+                        channel_to_string(target));
+    return;
+  }
+  if (m_state == State::IDLE || m_switch_id != announce.switch_id) {
+    get_console()->info("Air announced switch {} to {} in {}ms",
+                        announce.switch_id, channel_to_string(target),
+                        announce.ms_until_switch);
+  }
+  m_state = State::SCHEDULED;
+  m_switch_id = announce.switch_id;
+  m_target = target;
+  m_prev = WBChannel{static_cast<int>(announce.prev_frequency_mhz),
+                     announce.prev_channel_width_mhz};
+  // The air might have postponed the switch, always use the latest one
+  m_switch_tp = now + std::chrono::milliseconds(announce.ms_until_switch);
+  m_ack_pending = true;
+}
+
+void ChannelSwitchGround::on_packet_from_air(Clock::time_point now) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_last_air_packet_tp = now;
+}
+
+std::optional<ChannelSwitchAck> ChannelSwitchGround::update(
+    Clock::time_point now) {
+  std::optional<std::pair<WBChannel, bool>> retune;
+  std::optional<ChannelSwitchAck> ret;
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_state == State::SCHEDULED) {
+      if (now >= m_switch_tp) {
+        m_state = State::VERIFYING;
+        m_switch_tp = now;
+        m_last_switch_id = m_switch_id;
+        m_ack_pending = false;
+        retune = std::make_pair(m_target, false);
+        // Let the air know we are on the new channel as soon as possible
+        ret = ChannelSwitchAck{m_switch_id, 1};
+      } else if (m_ack_pending) {
+        m_ack_pending = false;
+        ret = ChannelSwitchAck{m_switch_id, 0};
+      }
+    } else if (m_state == State::VERIFYING) {
+      auto last_heard = m_switch_tp;
+      if (m_last_air_packet_tp >= m_switch_tp + m_config.guard_time) {
+        last_heard = m_last_air_packet_tp;
+      }
+      if (now - last_heard >= m_config.fallback_deadline) {
+        m_state = State::IDLE;
+        m_stats.n_fallbacks++;
+        get_console()->warn("Switch {} failed, falling back to {}",
+                            m_switch_id, channel_to_string(m_prev));
+        retune = std::make_pair(m_prev, true);
+      } else if (now - m_switch_tp >= m_config.verify_window) {
+        m_state = State::IDLE;
+        m_stats.n_switches++;
+        get_console()->info("Switch {} to {} done", m_switch_id,
+                            channel_to_string(m_target));
+      } else {
+        ret = ChannelSwitchAck{m_switch_id, 1};
+      }
+    }
+  }
+  if (retune.has_value()) {
+    m_retune_cb(retune->first, retune->second);
+  }
+  return ret;
+}
+
+ChannelSwitchGround::Clock::time_point
+ChannelSwitchGround::get_next_deadline() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_state == State::SCHEDULED) return m_switch_tp;
+  if (m_state == State::VERIFYING) {
+    auto last_heard = std::max(m_switch_tp, m_last_air_packet_tp);
+    return std::min(last_heard + m_config.fallback_deadline,
+                    m_switch_tp + m_config.verify_window);
+  }
+  return Clock::time_point::max();
+}
+
+bool ChannelSwitchGround::is_in_progress() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_state != State::IDLE;
+}
+
+ChannelSwitchStats ChannelSwitchGround::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_stats;
+}
+
+std::string channel_switch_stats_as_string(const ChannelSwitchStats& stats) {
+  return fmt::format("switches:{} fallbacks:{} uncoordinated:{} postponed:{}",
+                     stats.n_switches, stats.n_fallbacks,
+                     stats.n_uncoordinated, stats.n_postponed);
+}
+
+}  // namespace openhd::wb
@@ -0,0 +1,149 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_cipher.h"
+
+#include <sodium.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace openhd::wb {
+
+std::string cipher_type_to_string(const CipherType type) {
+  switch (type) {
+    case CipherType::CHACHA20_POLY1305:
+      return "ChaCha20-Poly1305";
+    case CipherType::AES256_GCM:
+      return "AES-256-GCM";
+  }
+  return "unknown";
+}
+
+bool is_cipher_available(const CipherType type) {
+  if (sodium_init() < 0) return false;
+  if (type == CipherType::AES256_GCM) {
+    return crypto_aead_aes256gcm_is_available() == 1;
+  }
+  return true;
+}
+
+std::string cipher_implementation_to_string(const CipherType type) {
+  if (sodium_init() < 0) return "none";
+  if (type == CipherType::AES256_GCM) {
+    if (!crypto_aead_aes256gcm_is_available()) return "unavailable";
+#if SODIUM_LIBRARY_VERSION_MAJOR >= 26
+    if (sodium_runtime_has_armcrypto()) return "armv8 crypto";
+#endif
+    return "aes-ni/pclmul";
+  }
+  // libsodium picks the chacha20 implementation at init
+  if (sodium_runtime_has_avx2()) return "avx2";
+  if (sodium_runtime_has_ssse3()) return "ssse3";
+  return "ref";
+}
+
+static constexpr int CIPHER_KEY_BYTES = 32;
+static constexpr int CIPHER_TAG_BYTES = 16;
+static_assert(crypto_aead_aes256gcm_KEYBYTES == CIPHER_KEY_BYTES);
+static_assert(crypto_aead_chacha20poly1305_ietf_KEYBYTES == CIPHER_KEY_BYTES);
+static_assert(crypto_aead_aes256gcm_ABYTES == CIPHER_TAG_BYTES);
+static_assert(crypto_aead_chacha20poly1305_ietf_ABYTES == CIPHER_TAG_BYTES);
+
+// One call per packet, with key setup and a new buffer for the result
+static std::vector<uint8_t> encrypt_packet(
+    CipherType type, const std::array<uint8_t, CIPHER_KEY_BYTES>& key,
+    uint64_t nonce_value, const std::vector<uint8_t>& packet) {
+  std::vector<uint8_t> ret(packet.size() + CIPHER_TAG_BYTES);
+  std::array<uint8_t, 12> nonce{};
+  std::memcpy(nonce.data(), &nonce_value, sizeof(nonce_value));
+  if (type == CipherType::AES256_GCM) {
+    crypto_aead_aes256gcm_encrypt(ret.data(), nullptr, packet.data(),
+                                  packet.size(), nullptr, 0, nullptr,
+                                  nonce.data(), key.data());
+  } else {
+    crypto_aead_chacha20poly1305_ietf_encrypt(
+        ret.data(), nullptr, packet.data(), packet.size(), nullptr, 0,
+        nullptr, nonce.data(), key.data());
+  }
+  return ret;
+}
+
+CipherBenchmark benchmark_cipher(const CipherType type, const int packet_size,
+                                 const std::chrono::milliseconds duration) {
+  CipherBenchmark ret{type, packet_size, 0, 0};
+  if (!is_cipher_available(type)) return ret;
+  std::array<uint8_t, CIPHER_KEY_BYTES> key{};
+  randombytes_buf(key.data(), key.size());
+  std::vector<uint8_t> packet(packet_size);
+  randombytes_buf(packet.data(), packet.size());
+  uint64_t n_packets = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration elapsed{};
+  do {
+    const auto encrypted = encrypt_packet(type, key, n_packets, packet);
+    // Use the result, such that it cannot be optimized away
+    packet[0] ^= encrypted[0];
+    n_packets++;
+    elapsed = std::chrono::steady_clock::now() - begin;
+  } while (elapsed < duration);
+  const double elapsed_us =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() /
+      1000.0;
+  ret.mb_per_s = (double)n_packets * packet_size / elapsed_us;
+  ret.us_per_packet = elapsed_us / (double)n_packets;
+  return ret;
+}
+
+CipherBenchmark benchmark_cipher_median(
+    const CipherType type, const int packet_size, const int n_runs,
+    const std::chrono::milliseconds duration) {
+  std::vector<CipherBenchmark> runs;
+  for (int i = 0; i < std::max(n_runs, 1); i++) {
+    runs.push_back(benchmark_cipher(type, packet_size, duration));
+  }
+  std::sort(runs.begin(), runs.end(), [](const auto& a, const auto& b) {
+    return a.mb_per_s < b.mb_per_s;
+  });
+  return runs[runs.size() / 2];
+}
+
+int max_encrypted_bitrate_kbits(const CipherBenchmark& benchmark,
+                                const float cpu_share) {
+  // MB/s -> kbit/s
+  return (int)(benchmark.mb_per_s * 8000.0 * cpu_share);
+}
+
+std::string cipher_benchmark_to_string(const CipherBenchmark& benchmark) {
+  std::stringstream ss;
+  ss << cipher_type_to_string(benchmark.type) << " ("
+     << cipher_implementation_to_string(benchmark.type) << ") "
+     << benchmark.packet_size << "B: " << (int)benchmark.mb_per_s << "MB/s "
+     << benchmark.us_per_packet << "us/packet";
+  return ss.str();
+}
+
+}  // namespace openhd::wb
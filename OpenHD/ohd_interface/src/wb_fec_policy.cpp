@@ -0,0 +1,204 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_fec_policy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+openhd::wb::FecFrameType openhd::wb::classify_frame_for_fec(
+    const openhd::FragmentedVideoFrame& frame) {
+  if (frame.dirty_frame != nullptr) return FecFrameType::DELTA_FRAME;
+  if (frame.is_idr_frame || frame.has_codec_config) {
+    return FecFrameType::KEY_FRAME;
+  }
+  return FecFrameType::DELTA_FRAME;
+}
+
+double openhd::wb::fec_block_loss_probability(int n_primary, int n_secondary,
+                                              double loss) {
+  if (loss <= 0) return 0;
+  if (loss >= 1) return 1;
+  const int n = n_primary + n_secondary;
+  const int first = n_secondary + 1;
+  if (first > n) return 0;
+  // Binomial tail, P(more than n_secondary of n lost)
+  double pmf = std::exp(std::lgamma(n + 1) - std::lgamma(first + 1) -
+                        std::lgamma(n - first + 1) + first * std::log(loss) +
+                        (n - first) * std::log1p(-loss));
+  double ret = 0;
+  for (int i = first; i <= n; i++) {
+    ret += pmf;
+    pmf *= (double)(n - i) / (double)(i + 1) * loss / (1 - loss);
+  }
+  return std::min(ret, 1.0);
+}
+
+openhd::wb::FecPolicy::FecPolicy(int budget_perc, FecPolicyConfig config)
+    : m_config(config), m_budget_perc(budget_perc) {}
+
+void openhd::wb::FecPolicy::set_budget_perc(int budget_perc) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_budget_perc = budget_perc;
+}
+
+void openhd::wb::FecPolicy::set_link_loss_perc(int loss_perc) {
+  if (loss_perc < 0) return;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_loss_perc = (float)std::min(loss_perc, 100);
+}
+
+int openhd::wb::FecPolicy::get_fec_percentage(FecFrameType type,
+                                              int frame_size_bytes,
+                                              int n_fragments,
+                                              int max_block_size) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  const float size = (float)std::max(frame_size_bytes, 1);
+  const int n_fragments_total = std::max(n_fragments, 1);
+  // Large frames are split into blocks of (about) the same size, the frame is
+  // lost if any of them can't be recovered
+  const int n_blocks =
+      max_block_size > 0
+          ? (n_fragments_total + max_block_size - 1) / max_block_size
+          : 1;
+  const int n_primary = (n_fragments_total + n_blocks - 1) / n_blocks;
+  const bool is_key_frame = type == FecFrameType::KEY_FRAME;
+  const int n_frames = m_n_key_frames + m_n_delta_frames + 1;
+  // Plain average until we have enough frames, then exponential
+  const int n_average = std::max(m_config.n_frames_average, 1);
+  const float alpha = 1.0f / (float)std::min(n_frames, n_average);
+  m_avg_frame_bytes += alpha * (size - m_avg_frame_bytes);
+  m_avg_key_frame_bytes +=
+      alpha * ((is_key_frame ? size : 0.0f) - m_avg_key_frame_bytes);
+  // How many frames of video are lost if this frame can't be recovered.
+  // Without key frames (e.g. intra refresh), all frames are the same.
+  float n_frames_lost = 1;
+  if (is_key_frame) {
+    if (m_n_key_frames > 0) {
+      const float gop_size = (float)m_n_frames_since_key_frame;
+      if (m_avg_gop_size == 0) {
+        m_avg_gop_size = gop_size;
+      } else {
+        m_avg_gop_size += 0.2f * (gop_size - m_avg_gop_size);
+      }
+    }
+    m_n_frames_since_key_frame = 0;
+    // Until we know the GOP size, assume a key frame every second
+    n_frames_lost = m_avg_gop_size > 0 ? m_avg_gop_size : 30;
+  } else if (m_avg_gop_size > 0) {
+    n_frames_lost = std::max(
+        1.0f, m_avg_gop_size - (float)m_n_frames_since_key_frame);
+  }
+  m_n_frames_since_key_frame++;
+  const float loss_perc = std::max(m_loss_perc, m_config.min_loss_perc);
+  const double loss = std::min(loss_perc / 100.0, 0.5);
+  const float min_perc = std::max((float)m_config.min_fec_perc,
+                                  m_loss_perc * m_config.loss_margin);
+  const int min_secondary = (int)std::ceil(n_primary * min_perc / 100.0f);
+  const int max_secondary =
+      std::max(min_secondary, n_primary * m_config.max_fec_perc / 100);
+  const double price = std::exp(m_log_price);
+  int n_secondary = min_secondary;
+  double best_cost = std::numeric_limits<double>::max();
+  for (int i = min_secondary; i <= max_secondary; i++) {
+    const double p_block = fec_block_loss_probability(n_primary, i, loss);
+    const double p_frame =
+        n_blocks == 1 ? p_block : 1.0 - std::pow(1.0 - p_block, n_blocks);
+    const double cost = n_frames_lost * p_frame + price * i * n_blocks;
+    if (cost < best_cost) {
+      best_cost = cost;
+      n_secondary = i;
+    }
+  }
+  // Such that the FEC encoder (rounding up) creates n_secondary packets
+  int ret = n_secondary * 100 / n_primary;
+  ret = std::clamp(ret, 1, std::max(m_config.max_fec_perc, (int)min_perc));
+  n_secondary = (n_primary * ret + 99) / 100;
+  // Account against the budget - spending more (on average) makes FEC packets
+  // more expensive. Using the average, such that the frames following a key
+  // frame don't have to pay for it.
+  const float fec_bytes = size * (float)n_secondary / (float)n_primary;
+  m_avg_fec_bytes += alpha * (fec_bytes - m_avg_fec_bytes);
+  const float used_perc = m_avg_fec_bytes / m_avg_frame_bytes * 100.0f;
+  const float error =
+      (used_perc - (float)m_budget_perc) / (float)std::max(m_budget_perc, 1);
+  m_log_price = std::clamp(m_log_price + 0.005 * error, -14.0, 3.0);
+  if (is_key_frame) {
+    if (m_n_key_frames == 0) {
+      m_avg_key_perc = (float)ret;
+    } else {
+      m_avg_key_perc += 0.2f * ((float)ret - m_avg_key_perc);
+    }
+    m_n_key_frames++;
+  } else {
+    if (m_n_delta_frames == 0) {
+      m_avg_delta_perc = (float)ret;
+    } else {
+      m_avg_delta_perc += 0.05f * ((float)ret - m_avg_delta_perc);
+    }
+    m_n_delta_frames++;
+  }
+  return ret;
+}
+
+int openhd::wb::FecPolicy::get_overhead_for_rate_control_perc() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (m_avg_frame_bytes <= 0) return m_budget_perc;
+  const float used_perc = m_avg_fec_bytes / m_avg_frame_bytes * 100.0f;
+  // Small deviations are normal (key frames, price adjustment)
+  if (used_perc <= (float)m_budget_perc + 2.5f) return m_budget_perc;
+  const int perc = (int)std::ceil(used_perc);
+  return std::min((perc + 4) / 5 * 5, m_config.max_fec_perc);
+}
+
+openhd::wb::FecPolicyStats openhd::wb::FecPolicy::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  FecPolicyStats stats{};
+  stats.key_frame_fec_perc = m_avg_key_perc;
+  stats.delta_frame_fec_perc = m_avg_delta_perc;
+  if (m_avg_frame_bytes > 0) {
+    stats.avg_overhead_perc = m_avg_fec_bytes / m_avg_frame_bytes * 100.0f;
+    stats.key_frame_bytes_perc =
+        m_avg_key_frame_bytes / m_avg_frame_bytes * 100.0f;
+  }
+  stats.avg_gop_size = m_avg_gop_size;
+  stats.n_key_frames = m_n_key_frames;
+  stats.n_delta_frames = m_n_delta_frames;
+  return stats;
+}
+
+std::string openhd::wb::fec_policy_stats_as_string(
+    const FecPolicyStats& stats) {
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1);
+  ss << "FecPolicy[key:" << stats.key_frame_fec_perc
+     << "% delta:" << stats.delta_frame_fec_perc
+     << "% used:" << stats.avg_overhead_perc
+     << "% key_bytes:" << stats.key_frame_bytes_perc
+     << "% gop:" << stats.avg_gop_size << " n_key:" << stats.n_key_frames
+     << " n_delta:" << stats.n_delta_frames << "]";
+  return ss.str();
+}
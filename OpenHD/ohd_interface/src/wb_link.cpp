@@ -26,22 +26,91 @@
 #include "wifi_command_helper.h"
 // #include "wifi_command_helper2.h"
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 #include "config_paths.h"
 #include "openhd_bitrate.h"
 #include "openhd_config.h"
 #include "openhd_global_constants.hpp"
+#include "openhd_memory.h"
+#include "openhd_metrics.h"
 #include "openhd_platform.h"
 #include "openhd_reboot_util.h"
 #include "openhd_spdlog.h"
 #include "openhd_thermal.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util_filesystem.h"
+#include "wb_cipher.h"
 #include "wb_link_helper.h"
 #include "wb_link_rate_helper.hpp"
 #include "wifi_card.h"
 
 static constexpr auto WB_LINK_ARM_CHANGED_TX_POWER_TAG = "wb_link_tx_power";
+static constexpr auto WB_LINK_RC_CHANNELS_TAG = "wb_link_mcs";
+
+namespace {
+// Per video stream (primary / secondary) tx metrics, registered once
+struct VideoTxMetrics {
+  openhd::metrics::Counter& frames;
+  openhd::metrics::Counter& fragments;
+  openhd::metrics::Counter& dropped_frames;
+  openhd::metrics::Gauge& queue_fill_perc;
+  std::array<openhd::metrics::Counter*, openhd::wb::N_VIDEO_DROP_REASONS>
+      dropped_frames_by_reason;
+  // Time from frame creation until it is handed to the wb tx instance
+  openhd::metrics::Histogram& frame_age_us;
+  static VideoTxMetrics create(int stream_index) {
+    auto& registry = openhd::metrics::Registry::instance();
+    const openhd::metrics::Labels labels{
+        {"stream", std::to_string(stream_index)}};
+    return VideoTxMetrics{
+        registry.counter("openhd_wb_video_tx_frames_total",
+                         "Video frames handed to the wb link", labels),
+        registry.counter("openhd_wb_video_tx_fragments_total",
+                         "Video fragments handed to the wb link", labels),
+        registry.counter("openhd_wb_video_tx_dropped_frames_total",
+                         "Video frames dropped by the wb link tx queue",
+                         labels),
+        registry.gauge("openhd_wb_video_tx_queue_fill_percent",
+                       "Fill level of the wb link video tx queue", labels),
+        create_dropped_by_reason(stream_index),
+        registry.histogram("openhd_wb_video_tx_frame_age_us",
+                           "Age of video frames handed to the wb link",
+                           openhd::metrics::latency_buckets_us(), labels)};
+  }
+  static std::array<openhd::metrics::Counter*,
+                    openhd::wb::N_VIDEO_DROP_REASONS>
+  create_dropped_by_reason(int stream_index) {
+    std::array<openhd::metrics::Counter*, openhd::wb::N_VIDEO_DROP_REASONS>
+        ret{};
+    for (int i = 0; i < openhd::wb::N_VIDEO_DROP_REASONS; i++) {
+      const auto reason = openhd::wb::video_drop_reason_to_string(
+          (openhd::wb::VideoDropReason)i);
+      ret[i] = &openhd::metrics::Registry::instance().counter(
+          "openhd_wb_video_tx_dropped_frames_by_reason_total",
+          "Video frames dropped by the video tx queue",
+          {{"stream", std::to_string(stream_index)}, {"reason", reason}});
+    }
+    return ret;
+  }
+};
+// For these cards, the rssi value per adapter is shit, use the max of the
+// antenna(s) instead
+bool use_max_antenna_rssi(const WiFiCardType type) {
+  return type == WiFiCardType::OPENHD_RTL_88X2AU ||
+         type == WiFiCardType::OPENHD_RTL_88X2BU ||
+         type == WiFiCardType::OPENHD_RTL_88X2CU ||
+         type == WiFiCardType::OPENHD_RTL_88X2EU ||
+         type == WiFiCardType::OPENHD_RTL_8852BU;
+}
+VideoTxMetrics& get_video_tx_metrics(int stream_index) {
+  static VideoTxMetrics primary = VideoTxMetrics::create(0);
+  static VideoTxMetrics secondary = VideoTxMetrics::create(1);
+  return stream_index == 0 ? primary : secondary;
+}
+}  // namespace
 
 WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
     : m_profile(std::move(profile)),
@@ -65,17 +134,27 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
   // this fetches the last settings, otherwise creates default ones
   m_settings = std::make_unique<openhd::WBLinkSettingsHolder>(
       m_profile, m_broadcast_cards);
+  const auto config = openhd::load_config();
+  const bool record_pcap =
+      !config.WIFI_PCAP_RECORD_DIRECTORY.empty() &&
+      !(m_broadcast_cards.size() == 1 &&
+        m_broadcast_cards[0].type == WiFiCardType::OPENHD_EMULATED);
   WBTxRx::Options txrx_options{};
   txrx_options.session_key_packet_interval = SESSION_KEY_PACKETS_INTERVAL;
   txrx_options.use_gnd_identifier = m_profile.is_ground();
   txrx_options.debug_rssi = 0;
   txrx_options.debug_multi_rx_packets_variance = false;
   txrx_options.tx_without_pcap = true;
-  txrx_options.set_tx_sock_qdisc_bypass = true;
-  txrx_options.enable_auto_switch_tx_card = false;  // TODO remove me
+  // Frames injected with qdisc bypass never reach packet taps - the pcap
+  // recorder would only see the received frames. Costs a bit of tx latency,
+  // so only while recording.
+  txrx_options.set_tx_sock_qdisc_bypass = !record_pcap;
+  // With more than one card on ground, let WBTxRx inject on the card that
+  // currently receives the air best
+  txrx_options.enable_auto_switch_tx_card =
+      m_profile.is_ground() && m_broadcast_cards.size() > 1;
   txrx_options.max_sane_injection_time = std::chrono::milliseconds(1);
-  txrx_options.rx_radiotap_debug_level =
-      openhd::load_config().GEN_RF_METRICS_LEVEL;
+  txrx_options.rx_radiotap_debug_level = config.GEN_RF_METRICS_LEVEL;
   // txrx_options.advanced_debugging_rx= true;
   // txrx_options.debug_decrypt_time= true;
   // txrx_options.debug_encrypt_time= true;
@@ -179,17 +258,21 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
     options_tele_rx.enable_fec = false;
     options_tele_rx.radio_port = radio_port_rx;
     options_tele_rx.enable_threading = true;
-    // receive queue: On air, up to 16 packets
-    // On ground, up to 32 packets
-    options_tele_rx.packet_queue_size = m_profile.is_air ? 16 : 32;
+    // Queue sizes from the memory budget (up to 32 packets)
+    const auto& budget = openhd::memory::get_budget();
+    // receive queue: On air, half of the ground (we receive less)
+    options_tele_rx.packet_queue_size =
+        m_profile.is_air ? std::max(1, budget.wb_tele_queue_packets / 2)
+                         : budget.wb_tele_queue_packets;
     m_wb_tele_rx = std::make_unique<WBStreamRx>(m_wb_txrx, options_tele_rx);
     m_wb_tele_rx->set_callback(cb_rx);
     WBStreamTx::Options options_tele_tx{};
     options_tele_tx.enable_fec = false;
     options_tele_tx.radio_port = radio_port_tx;
-    // Transmission queue: On air, up to 32 packets
-    // On ground, up to 16 packets
-    options_tele_tx.packet_data_queue_size = m_profile.is_air ? 32 : 16;
+    // Transmission queue: On ground, half of the air
+    options_tele_tx.packet_data_queue_size =
+        m_profile.is_air ? budget.wb_tele_queue_packets
+                         : std::max(1, budget.wb_tele_queue_packets / 2);
     m_wb_tele_tx =
         std::make_unique<WBStreamTx>(m_wb_txrx, options_tele_tx, m_tx_header_1);
     m_wb_tele_tx->set_encryption(true);
@@ -200,11 +283,9 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
       // we transmit video
       WBStreamTx::Options options_video_tx{};
       options_video_tx.enable_fec = true;
-      // For now, have a fifo of X frame(s) to smooth out extreme edge cases of
-      // bitrate overshoot
-      // TODO: In ohd_video,  differentiate between "frame" and NALU (nalu can
-      // also be config data) such that we can make this queue smaller.
-      options_video_tx.block_data_queue_size = 2;
+      // Only one frame, frames wait in the video tx queue (which drops them
+      // once they are too old) until the wb tx can take them.
+      options_video_tx.block_data_queue_size = VIDEO_TX_BLOCK_QUEUE_SIZE;
       options_video_tx.radio_port = openhd::VIDEO_PRIMARY_RADIO_PORT;
       auto primary = std::make_unique<WBStreamTx>(m_wb_txrx, options_video_tx,
                                                   m_tx_header_1);
@@ -215,10 +296,33 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
       secondary->set_encryption(false);
       m_wb_video_tx_list.push_back(std::move(primary));
       m_wb_video_tx_list.push_back(std::move(secondary));
+      for (int i = 0; i < m_wb_video_tx_list.size(); i++) {
+        m_video_fec_policy_list.push_back(
+            std::make_unique<openhd::wb::FecPolicy>(
+                m_settings->get_settings().wb_video_fec_percentage));
+      }
+      openhd::wb::VideoTxQueueConfig queue_config{};
+      queue_config.max_frame_age = std::chrono::milliseconds(
+          openhd::load_config().GEN_VIDEO_TX_MAX_FRAME_AGE_MS);
+      queue_config.capacity_frames =
+          openhd::memory::get_budget().video_tx_queue_frames;
+      for (int i = 0; i < m_wb_video_tx_list.size(); i++) {
+        m_video_tx_queue_list.push_back(
+            std::make_unique<openhd::wb::VideoTxQueue>(
+                queue_config,
+                [this, i](const openhd::FragmentedVideoFrame& frame) {
+                  return send_video_frame(i, frame);
+                },
+                [this, i](openhd::wb::VideoDropReason reason) {
+                  on_video_frame_dropped(i, reason);
+                },
+                i == 0 ? "video_tx_q0" : "video_tx_q1"));
+      }
       WBStreamTx::Options options_audio_tx{};
       options_audio_tx.enable_fec = false;
       options_audio_tx.radio_port = openhd::AUDIO_WIFIBROADCAST_PORT;
-      options_audio_tx.packet_data_queue_size = 16;
+      options_audio_tx.packet_data_queue_size =
+          openhd::memory::get_budget().wb_audio_queue_packets;
       m_wb_audio_tx = std::make_unique<WBStreamTx>(m_wb_txrx, options_audio_tx,
                                                    m_tx_header_1);
     } else {
@@ -270,7 +374,8 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
       options_audio_rx.radio_port = openhd::AUDIO_WIFIBROADCAST_PORT;
       options_audio_rx.enable_fec = false;
       options_audio_rx.enable_threading = true;
-      options_audio_rx.packet_queue_size = 16;
+      options_audio_rx.packet_queue_size =
+          openhd::memory::get_budget().wb_audio_queue_packets;
       m_wb_audio_rx = std::make_unique<WBStreamRx>(m_wb_txrx, options_audio_rx);
       m_wb_audio_rx->set_callback(cb_audio);
     }
@@ -278,19 +383,52 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
   apply_frequency_and_channel_width_from_settings();
   apply_txpower();
   if (m_profile.is_ground()) {
-    m_management_gnd = std::make_unique<ManagementGround>(m_wb_txrx);
+    auto cb_retune = [this](const openhd::wb::WBChannel& channel,
+                            bool is_fallback) {
+      apply_frequency_and_channel_width(
+          channel.frequency_mhz, channel.channel_width_mhz, 20,
+          is_fallback ? RETUNE_DRAIN_TIME : CHANNEL_SWITCH_DRAIN_TIME);
+      m_persist_switched_frequency = channel.frequency_mhz;
+    };
+    m_management_gnd = std::make_unique<ManagementGround>(m_wb_txrx, cb_retune);
     m_management_gnd->m_tx_header = m_tx_header_1;
     m_management_gnd->start();
     m_gnd_curr_rx_frequency =
         static_cast<int>(m_settings->unsafe_get_settings().wb_frequency);
   } else {
+    auto cb_retune = [this](const openhd::wb::WBChannel& channel,
+                            bool is_fallback) {
+      apply_frequency_and_channel_width(
+          channel.frequency_mhz, channel.channel_width_mhz,
+          channel.channel_width_mhz,
+          is_fallback ? RETUNE_DRAIN_TIME : CHANNEL_SWITCH_DRAIN_TIME);
+      m_rate_adjustment_frequency_changed = true;
+      // On ASUS, we have to reduce the TX power when on 40Mhz
+      m_request_apply_tx_power = true;
+      if (is_fallback) {
+        // The new channel has been persisted already
+        m_persist_switched_channel_width = channel.channel_width_mhz;
+        m_persist_switched_frequency = channel.frequency_mhz;
+      }
+    };
     m_management_air = std::make_unique<ManagementAir>(
         m_wb_txrx, m_settings->get_settings().wb_frequency,
-        m_settings->get_settings().wb_air_tx_channel_width);
+        m_settings->get_settings().wb_air_tx_channel_width, cb_retune);
     m_management_air->m_tx_header = m_tx_header_2;
     m_management_air->start();
   }
   m_wb_txrx->start_receiving();
+  setup_thermal_protection(config);
+  if (record_pcap) {
+    openhd::wb::pcap::PcapngRingWriter::Options pcap_options{};
+    pcap_options.directory = config.WIFI_PCAP_RECORD_DIRECTORY;
+    pcap_options.prefix = m_profile.is_air ? "air" : "ground";
+    pcap_options.max_file_size_bytes =
+        (int64_t)config.WIFI_PCAP_RECORD_FILE_SIZE_MB * 1024 * 1024;
+    pcap_options.max_n_files = config.WIFI_PCAP_RECORD_N_FILES;
+    m_pcap_recorder = std::make_unique<openhd::wb::pcap::WBPcapRecorder>(
+        openhd::wb::get_card_names(m_broadcast_cards), pcap_options);
+  }
   m_work_thread_run = true;
   m_work_thread = std::make_unique<std::thread>(&WBLink::loop_do_work, this);
   std::function<bool(openhd::LinkActionHandler::ScanChannelsParam)> cb_scan =
@@ -307,8 +445,8 @@ WBLink::WBLink(OHDProfile profile, std::vector<WiFiCard> broadcast_cards)
     auto cb_channel = [this](const std::array<int, 18>& rc_channels) {
       m_rc_channel_helper.set_rc_channels(rc_channels);
     };
-    openhd::FCRcChannelsHelper::instance().action_on_any_rc_channel_register(
-        cb_channel);
+    openhd::FCRcChannelsHelper::instance().register_listener(
+        WB_LINK_RC_CHANNELS_TAG, cb_channel);
   }
   auto cb_arm = [this](bool armed) { update_arming_state(armed); };
   openhd::ArmingStateHelper::instance().register_listener(
@@ -336,17 +474,22 @@ WBLink::~WBLink() {
   }
   m_management_air = nullptr;
   m_management_gnd = nullptr;
-  openhd::FCRcChannelsHelper::instance().action_on_any_rc_channel_register(
-      nullptr);
+  if (m_profile.is_air) {
+    openhd::FCRcChannelsHelper::instance().unregister_listener(
+        WB_LINK_RC_CHANNELS_TAG);
+  }
   openhd::ArmingStateHelper::instance().unregister_listener(
       WB_LINK_ARM_CHANGED_TX_POWER_TAG);
   openhd::LinkActionHandler::instance().wb_cmd_scan_channels = nullptr;
   openhd::LinkActionHandler::instance().wb_cmd_analyze_channels = nullptr;
+  m_pcap_recorder = nullptr;
   m_wb_txrx->stop_receiving();
   // stop all the receiver/transmitter instances, after that, give card back to
   // network manager
   m_wb_tele_rx.reset();
   m_wb_tele_tx.reset();
+  // Stop the video tx queue(s) first, they hand frames to the wb tx instances
+  m_video_tx_queue_list.resize(0);
   m_wb_video_tx_list.resize(0);
   m_wb_video_rx_list.resize(0);
   m_wb_audio_tx.reset();
@@ -371,19 +514,31 @@ bool WBLink::request_set_frequency(int frequency) {
     m_console->warn("X20 only supports 5G");
     return false;
   }
+  if (m_profile.is_air && m_management_air->is_channel_switch_in_progress()) {
+    m_console->warn("Channel switch in progress");
+    return false;
+  }
   auto work_item = std::make_shared<WorkItem>(
       fmt::format("SET_FREQ:{}", frequency),
       [this, frequency]() {
+        if (m_profile.is_air) {
+          // Announced to the ground, the management thread retunes at the
+          // scheduled time
+          const int channel_width =
+              m_settings->unsafe_get_settings().wb_air_tx_channel_width;
+          if (m_management_air->schedule_channel_switch(frequency,
+                                                        channel_width)) {
+            m_settings->unsafe_get_settings().wb_frequency = frequency;
+            m_settings->persist();
+          }
+          return;
+        }
         m_settings->unsafe_get_settings().wb_frequency = frequency;
         m_settings->persist();
-        if (m_profile.is_air) {
-          // temporarily disable video streaming to free up BW
-          m_air_close_video_in = true;
-          m_management_air->set_frequency(frequency);
-          // We need to delay the change to make sure at least one management
-          // packet goes through ..
-          std::this_thread::sleep_for(std::chrono::seconds(2));
-          m_air_close_video_in = false;
+        if (m_gnd_curr_rx_frequency == frequency) {
+          // Already there, e.g. we followed the air
+          m_console->debug("Already on {}Mhz", frequency);
+          return;
         }
         apply_frequency_and_channel_width_from_settings();
         m_rate_adjustment_frequency_changed = true;
@@ -399,22 +554,22 @@ bool WBLink::request_set_air_tx_channel_width(int channel_width) {
           channel_width, m_broadcast_cards.at(0), m_console)) {
     return false;
   }
+  if (m_management_air->is_channel_switch_in_progress()) {
+    m_console->warn("Channel switch in progress");
+    return false;
+  }
   auto work_item = std::make_shared<WorkItem>(
       fmt::format("SET_CHWIDTH:{}", channel_width),
       [this, channel_width]() {
-        // temporarily disable video streaming to free up BW
-        m_air_close_video_in = true;
-        m_settings->unsafe_get_settings().wb_air_tx_channel_width =
-            channel_width;
-        m_settings->persist();
-        m_management_air->set_channel_width(channel_width);
-        // On ASUS, we have to reduce the TX power when on 40Mhz
-        apply_txpower();
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        // Ground will automatically apply the right channel width once first
-        // (broadcast) management frame is received.
-        apply_frequency_and_channel_width_from_settings();
-        m_air_close_video_in = false;
+        // Same as a frequency change - the ground is told in advance and both
+        // switch at the same time
+        const int frequency = m_settings->unsafe_get_settings().wb_frequency;
+        if (m_management_air->schedule_channel_switch(frequency,
+                                                      channel_width)) {
+          m_settings->unsafe_get_settings().wb_air_tx_channel_width =
+              channel_width;
+          m_settings->persist();
+        }
       },
       std::chrono::steady_clock::now());
   return try_schedule_work_item(work_item);
@@ -549,18 +704,25 @@ bool WBLink::request_start_analyze_channels(int channels_to_scan) {
   return try_schedule_work_item(work_item);
 }
 
-bool WBLink::apply_frequency_and_channel_width(int frequency,
-                                               int channel_width_rx,
-                                               int channel_width_tx) {
+bool WBLink::apply_frequency_and_channel_width(
+    int frequency, int channel_width_rx, int channel_width_tx,
+    std::chrono::milliseconds drain_time) {
+  // Called from the worker and (scheduled channel switch) the management
+  // thread
+  std::lock_guard<std::mutex> guard(m_apply_frequency_mutex);
   m_console->debug("apply_frequency_and_channel_width {}Mhz RX:{}Mhz TX:{}Mhz",
                    frequency, channel_width_rx, channel_width_tx);
   // Weird bug hunting - I hope this makes the driver less likely too crash
   // Temporarily stop injecting packets
   m_wb_txrx->set_passive_mode(true);
-  std::this_thread::sleep_for(std::chrono::milliseconds(
-      100));  // Dirty - wait for any tx packets to drain
+  std::this_thread::sleep_for(
+      drain_time);  // Dirty - wait for any tx packets to drain
   const auto res = openhd::wb::set_frequency_and_channel_width_for_all_cards(
       frequency, channel_width_rx, m_broadcast_cards);
+  if (m_profile.is_ground()) {
+    m_gnd_curr_rx_frequency = frequency;
+    m_gnd_curr_rx_channel_width = channel_width_rx;
+  }
   m_tx_header_1->update_channel_width(channel_width_tx);
   m_wb_txrx->tx_reset_stats();
   m_wb_txrx->rx_reset_stats();
@@ -612,6 +774,16 @@ void WBLink::apply_txpower() {
       pwr_index = 50;
     }
   }
+  const int thermal_perc = m_thermal_tx_power_perc;
+  if (thermal_perc < 100) {
+    m_console->debug("Thermal protection, TX power at {}%", thermal_perc);
+    pwr_mw =
+        std::max<uint32_t>(pwr_mw > 0 ? 1 : 0, pwr_mw * thermal_perc / 100);
+    // The power index is in ~0.5dB steps
+    const int index_delta = static_cast<int>(
+        std::lround(20.0 * std::log10(std::max(thermal_perc, 1) / 100.0)));
+    pwr_index = std::max(0, static_cast<int>(pwr_index) + index_delta);
+  }
   openhd::wb::set_tx_power_for_all_cards(pwr_mw, pwr_index, m_broadcast_cards);
   m_curr_tx_power_mw = pwr_mw;
   m_curr_tx_power_idx = pwr_index;
@@ -817,6 +989,8 @@ std::vector<openhd::Setting> WBLink::get_all_settings() {
 #pragma clang diagnostic pop
 
 void WBLink::loop_do_work() {
+  openhd::thread::set_current_thread(
+      "wb_work", openhd::thread::ThreadClass::NORMAL);
   while (m_work_thread_run) {
     // Perform any queued up work if it exists
     {
@@ -841,9 +1015,11 @@ void WBLink::loop_do_work() {
     wt_perform_mcs_via_rc_channel_if_enabled();
     // wt_perform_bw_via_rc_channel_if_enabled();
     wt_gnd_perform_channel_management();
+    wt_persist_switched_channel();
     // air_perform_reset_frequency();
     // Perform thermal protection level calculation before rate adjustment !
     wt_perform_update_thermal_protection();
+    wt_perform_update_fec_policy();
     wt_perform_rate_adjustment();
     //  After we've applied the rate, we update the tx header mcs index if
     //  necessary
@@ -889,6 +1065,13 @@ void WBLink::wt_update_statistics() {
     for (int i = 0; i < m_wb_video_tx_list.size(); i++) {
       auto& wb_tx = *m_wb_video_tx_list.at(i);
       // auto& air_video=i==0 ? stats.air_video0 : stats.air_video1;
+      const auto queue_stats = m_video_tx_queue_list.at(i)->get_stats();
+      if (queue_stats.n_dropped_total() != m_video_tx_queue_n_dropped.at(i)) {
+        m_video_tx_queue_n_dropped.at(i) = queue_stats.n_dropped_total();
+        m_console->debug(
+            "Video {} {}", i,
+            openhd::wb::video_tx_queue_stats_to_string(queue_stats));
+      }
       const auto curr_tx_stats = wb_tx.get_latest_stats();
       // optimization - only send for active video links
       if (curr_tx_stats.n_injected_packets == 0) continue;
@@ -911,8 +1094,21 @@ void WBLink::wt_update_statistics() {
                  : m_secondary_total_dropped_frames.load();
       // const int tx_dropped_frames = curr_tx_stats.n_dropped_frames;
       air_video.curr_dropped_frames = tx_dropped_frames;
-      air_video.dummy0 =
-          (int8_t)m_thermal_protection_level.load(std::memory_order_relaxed);
+      openhd::LinkActionHandler::VideoTxFeedback feedback{};
+      feedback.measured_encoder_bitrate_kbits =
+          (int)(curr_tx_stats.current_provided_bits_per_second / 1000);
+      feedback.tx_queue_fill_perc =
+          i == 0 ? m_primary_tx_queue_fill_max_perc.exchange(0)
+                 : m_secondary_tx_queue_fill_max_perc.exchange(0);
+      feedback.n_dropped_frames_total = tx_dropped_frames;
+      openhd::LinkActionHandler::instance().set_video_tx_feedback(i, feedback);
+      air_video.thermal_protection_level =
+          m_thermal_protection_level.load(std::memory_order_relaxed);
+      air_video.thermal_hottest_temp_c =
+          (int16_t)m_thermal_hottest_temp_c.load();
+      air_video.thermal_tx_power_perc =
+          (uint8_t)m_thermal_tx_power_perc.load();
+      air_video.thermal_bitrate_perc = (uint8_t)m_thermal_bitrate_perc.load();
       const auto curr_tx_fec_stats = wb_tx.get_latest_fec_stats();
       air_fec.curr_fec_encode_time_avg_us =
           openhd::util::get_micros(curr_tx_fec_stats.curr_fec_encode_time.avg);
@@ -929,8 +1125,9 @@ void WBLink::wt_update_statistics() {
       air_fec.curr_tx_delay_min_us = curr_tx_stats.curr_block_until_tx_min_us;
       air_fec.curr_tx_delay_max_us = curr_tx_stats.curr_block_until_tx_max_us;
       air_fec.curr_tx_delay_avg_us = curr_tx_stats.curr_block_until_tx_avg_us;
-      air_video.curr_fec_percentage =
-          m_settings->unsafe_get_settings().wb_video_fec_percentage;
+      // Average FEC overhead actually used (varies per frame)
+      air_video.curr_fec_percentage = (int)std::lround(
+          m_video_fec_policy_list.at(i)->get_stats().avg_overhead_perc);
       stats.stats_wb_video_air.push_back(air_video);
       if (i == 0) stats.air_fec_performance = air_fec;
     }
@@ -1029,12 +1226,7 @@ void WBLink::wt_update_statistics() {
     card_stats.NON_MAVLINK_CARD_ACTIVE = true;
     auto rxStatsCard = m_wb_txrx->get_rx_stats_for_card(i);
     auto rf_rx_stats = m_wb_txrx->get_rx_rf_stats_for_card(i);
-    if (m_broadcast_cards[i].type == WiFiCardType::OPENHD_RTL_88X2AU ||
-        m_broadcast_cards[i].type == WiFiCardType::OPENHD_RTL_88X2BU ||
-        m_broadcast_cards[i].type == WiFiCardType::OPENHD_RTL_88X2CU ||
-        m_broadcast_cards[i].type == WiFiCardType::OPENHD_RTL_88X2EU ||
-        m_broadcast_cards[i].type == WiFiCardType::OPENHD_RTL_8852BU) {
-      // Value per adapter is shit, use the max of antenna(s) instead
+    if (use_max_antenna_rssi(card.type)) {
       rf_rx_stats.adapter.rssi_dbm = std::max(rf_rx_stats.antenna1.rssi_dbm,
                                               rf_rx_stats.antenna2.rssi_dbm);
     }
@@ -1100,18 +1292,22 @@ void WBLink::wt_perform_rate_adjustment() {
           settings.wb_video_rate_for_mcs_adjustment_percent, false);
   m_max_total_rate_for_current_wifi_config_kbits =
       max_rate_for_current_wifi_config;
-  // Subtract the FEC overhead from (video) bitrate
+  // Subtract the FEC overhead from (video) bitrate - the budget of the FEC
+  // policy, or more if the link loss requires it
+  const int fec_overhead_perc =
+      m_video_fec_policy_list.at(0)->get_overhead_for_rate_control_perc();
   const int max_video_rate_for_current_wifi_fec_config =
       openhd::wb::deduce_fec_overhead(max_rate_for_current_wifi_config,
-                                      settings.wb_video_fec_percentage);
+                                      fec_overhead_perc);
   // const auto stats=m_wb_txrx->get_rx_stats();
   // m_foreign_p_helper.update(stats.count_p_any,stats.count_p_valid);
   // m_console->debug("N foreign packets per second
   // :{}",m_foreign_p_helper.get_foreign_packets_per_second());
+  const bool frequency_changed =
+      m_rate_adjustment_frequency_changed.exchange(false);
   if (m_max_video_rate_for_current_wifi_fec_config !=
           max_video_rate_for_current_wifi_fec_config ||
-      m_rate_adjustment_frequency_changed) {
-    m_rate_adjustment_frequency_changed = false;
+      frequency_changed) {
     // Apply the default for this configuration, then return - we will start the
     // auto-adjustment depending on tx error(s) next time the rate adjustment is
     // called
@@ -1141,32 +1337,32 @@ void WBLink::wt_perform_rate_adjustment() {
   // m_console->debug("Dropped since last check:{}",dropped_since_last_check);
   if (dropping_many_frames) {
     // We are dropping frames / too many tx error hint(s), we need to reduce
-    // bitrate. Reduce video bitrate by 1MBit/s
-    m_recommended_video_bitrate_kbits -= 1000;
-    m_curr_n_rate_adjustments++;
-    // Safety, in case we fall below a certain threshold the encoder won't be
-    // able to produce an image at some point anyways.
-    static constexpr auto MIN_BITRATE_KBITS = 1000 * 2;
-    if (m_recommended_video_bitrate_kbits < MIN_BITRATE_KBITS) {
-      m_console->warn("Reached minimum bitrate {}",
-                      openhd::kbits_per_second_to_string(MIN_BITRATE_KBITS));
-      m_recommended_video_bitrate_kbits = MIN_BITRATE_KBITS;
-      m_curr_n_rate_adjustments--;
+    // bitrate.
+    const int reduced =
+        reduce_bitrate_on_tx_errors(m_recommended_video_bitrate_kbits);
+    if (reduced != m_recommended_video_bitrate_kbits - 1000) {
+      m_console->warn(
+          "Reached minimum bitrate {}",
+          openhd::kbits_per_second_to_string(MIN_VIDEO_BITRATE_KBITS));
+    } else {
+      m_curr_n_rate_adjustments++;
     }
+    m_recommended_video_bitrate_kbits = reduced;
     m_console->warn("TX errors, reducing video bitrate to {}",
                     m_recommended_video_bitrate_kbits);
   }
-  // Extra x20 - thermal protection
+  // Thermal protection - use less of what the current MCS could do
+  const int thermal_perc = m_thermal_bitrate_perc;
+  // Extra x20
   if (OHDPlatform::instance().is_x20()) {
     const int factor = !m_is_armed ? 50 : 100;
-    const int x20_rate =
-        m_thermal_protection_level > 0
-            ? m_recommended_video_bitrate_kbits * 30 / 100 * factor / 100
-            : m_recommended_video_bitrate_kbits * 70 / 100 * factor / 100;
+    const int x20_rate = m_recommended_video_bitrate_kbits * 70 / 100 *
+                         factor / 100 * thermal_perc / 100;
     recommend_bitrate_to_encoder(x20_rate);
     return;
   }
-  recommend_bitrate_to_encoder(m_recommended_video_bitrate_kbits);
+  recommend_bitrate_to_encoder(m_recommended_video_bitrate_kbits *
+                               thermal_perc / 100);
 }
 
 void WBLink::recommend_bitrate_to_encoder(int recommended_video_bitrate_kbits) {
@@ -1178,6 +1374,29 @@ void WBLink::recommend_bitrate_to_encoder(int recommended_video_bitrate_kbits) {
       m_console->debug("No action handler,cannot recommend bitrate to camera");
       return;
   }*/
+  if (m_video_ultra_secure_encryption) {
+    if (!m_max_encrypted_video_rate_kbits.has_value()) {
+      // The wifibroadcast encryption (ChaCha20-Poly1305, one call per packet)
+      // is what limits the bitrate. Measured once it is actually needed.
+      const auto wb_cipher = openhd::wb::benchmark_cipher_median(
+          openhd::wb::CipherType::CHACHA20_POLY1305,
+          VIDEO_FRAGMENT_SIZE_ESTIMATE, ENCRYPTION_BENCHMARK_N_RUNS,
+          ENCRYPTION_BENCHMARK_RUN_DURATION);
+      m_max_encrypted_video_rate_kbits =
+          openhd::wb::max_encrypted_bitrate_kbits(wb_cipher,
+                                                  ENCRYPTION_MAX_CPU_SHARE);
+      m_console->info("Encryption: {}, max {}Mbit/s encrypted video",
+                      openhd::wb::cipher_benchmark_to_string(wb_cipher),
+                      m_max_encrypted_video_rate_kbits.value() / 1000);
+    }
+    if (m_max_encrypted_video_rate_kbits.value() > 0 &&
+        recommended_video_bitrate_kbits >
+            m_max_encrypted_video_rate_kbits.value()) {
+      // More than we can encrypt in time
+      recommended_video_bitrate_kbits =
+          m_max_encrypted_video_rate_kbits.value();
+    }
+  }
   openhd::LinkActionHandler::LinkBitrateInformation lb{};
   lb.recommended_encoder_bitrate_kbits = recommended_video_bitrate_kbits;
   openhd::LinkActionHandler::instance().action_request_bitrate_change_handle(
@@ -1219,68 +1438,108 @@ void WBLink::transmit_video_data(
     int stream_index,
     const openhd::FragmentedVideoFrame& fragmented_video_frame) {
   assert(m_profile.is_air);
-  if (stream_index < 0 || stream_index > m_wb_video_tx_list.size()) {
+  if (stream_index < 0 || stream_index >= m_video_tx_queue_list.size()) {
     m_console->debug("Invalid camera stream_index {}", stream_index);
     return;
   }
-  if (m_air_close_video_in.load(std::memory_order_relaxed)) {
-    m_console->debug("Video TX temporarily disabled");
-    return;
-  }
   if (m_thermal_protection_level.load(std::memory_order_relaxed) >=
       THERMAL_PROTECTION_VIDEO_DISABLED) {
     // Thermal protection disable video active, don't transmit video
     return;
   }
   // m_console->debug("Got {}",fragmented_video_frame.rtp_fragments.size());
+  auto& metrics = get_video_tx_metrics(stream_index);
+  metrics.frames.add();
+  metrics.fragments.add(fragmented_video_frame.dirty_frame != nullptr
+                            ? 1
+                            : fragmented_video_frame.rtp_fragments.size());
+  // Doesn't block, the frame is handed to the wb tx from the queue thread
+  m_video_tx_queue_list[stream_index]->enqueue(fragmented_video_frame);
+}
+
+bool WBLink::send_video_frame(
+    int stream_index,
+    const openhd::FragmentedVideoFrame& fragmented_video_frame) {
   auto& tx = *m_wb_video_tx_list[stream_index];
+  auto& queue = *m_video_tx_queue_list[stream_index];
+  const int available = tx.get_tx_queue_available_size_approximate();
+  {
+    // Frames waiting in total (wb tx queue and video tx queue)
+    const int n_waiting =
+        VIDEO_TX_BLOCK_QUEUE_SIZE - available + queue.get_n_queued();
+    const int fill_perc = std::clamp(
+        n_waiting * 100 / VIDEO_TX_QUEUE_FILL_REF_FRAMES, 0, 100);
+    auto& fill_max = stream_index == 0 ? m_primary_tx_queue_fill_max_perc
+                                       : m_secondary_tx_queue_fill_max_perc;
+    if (fill_perc > fill_max.load(std::memory_order_relaxed)) {
+      fill_max.store(fill_perc, std::memory_order_relaxed);
+    }
+    get_video_tx_metrics(stream_index).queue_fill_perc.set(fill_perc);
+  }
+  if (available <= 0) {
+    // Try again later, unless the frame is too old by then
+    return false;
+  }
   tx.set_encryption(fragmented_video_frame.enable_ultra_secure_encryption);
+  m_video_ultra_secure_encryption.store(
+      fragmented_video_frame.enable_ultra_secure_encryption,
+      std::memory_order_relaxed);
   const int max_fec_block_size = get_max_fec_block_size();
-  const int fec_perc = m_settings->get_settings().wb_video_fec_percentage;
-  int n_dropped_frames = 0;
+  auto& fec_policy = *m_video_fec_policy_list[stream_index];
+  fec_policy.set_budget_perc(
+      m_settings->get_settings().wb_video_fec_percentage);
+  int frame_size_bytes = 0;
+  int n_fragments = 0;
   if (fragmented_video_frame.dirty_frame != nullptr) {
-    // non rtp
-    const auto res = tx.try_enqueue_frame(fragmented_video_frame.dirty_frame,
-                                          max_fec_block_size, fec_perc,
-                                          fragmented_video_frame.creation_time);
-    if (!res) {
-      // We dropped this frame
-      n_dropped_frames = 1;
-    }
+    frame_size_bytes = (int)fragmented_video_frame.dirty_frame->size();
+    n_fragments = (frame_size_bytes + VIDEO_FRAGMENT_SIZE_ESTIMATE - 1) /
+                  VIDEO_FRAGMENT_SIZE_ESTIMATE;
   } else {
-    // Pushes out previous enqueued frames if there is not enough space in the
-    // queue
-    const bool use_dropping_enqueue = fragmented_video_frame.is_intra_stream ||
-                                      fragmented_video_frame.is_idr_frame;
-
-    if (use_dropping_enqueue) {
-      const auto count_removed = tx.enqueue_block_dropping(
-          fragmented_video_frame.rtp_fragments, max_fec_block_size, fec_perc,
-          fragmented_video_frame.creation_time);
-      if (count_removed != 0) {
-        openhd::log::get_default()->debug(
-            "Cleared {} frames to make space for frame {}", count_removed,
-            fragmented_video_frame.to_string());
-        n_dropped_frames = count_removed;
-      }
-    } else {
-      const auto res = tx.try_enqueue_block(
-          fragmented_video_frame.rtp_fragments, max_fec_block_size, fec_perc,
-          fragmented_video_frame.creation_time);
-      if (!res) {
-        n_dropped_frames = 1;
-        m_console->debug("TX enqueue video frame failed, queue size:{}",
-                         tx.get_tx_queue_available_size_approximate());
-      }
+    for (const auto& fragment : fragmented_video_frame.rtp_fragments) {
+      frame_size_bytes += (int)fragment->size();
     }
+    n_fragments = (int)fragmented_video_frame.rtp_fragments.size();
   }
-  if (n_dropped_frames != 0) {
-    m_frame_drop_helper.notify_dropped_frame(n_dropped_frames);
-    if (stream_index == 0) {
-      m_primary_total_dropped_frames += n_dropped_frames;
-    } else {
-      m_secondary_total_dropped_frames += n_dropped_frames;
-    }
+  const int fec_perc = fec_policy.get_fec_percentage(
+      openhd::wb::classify_frame_for_fec(fragmented_video_frame),
+      frame_size_bytes, n_fragments, max_fec_block_size);
+  bool res;
+  if (fragmented_video_frame.dirty_frame != nullptr) {
+    // non rtp
+    res = tx.try_enqueue_frame(fragmented_video_frame.dirty_frame,
+                               max_fec_block_size, fec_perc,
+                               fragmented_video_frame.creation_time);
+  } else {
+    res = tx.try_enqueue_block(fragmented_video_frame.rtp_fragments,
+                               max_fec_block_size, fec_perc,
+                               fragmented_video_frame.creation_time);
+  }
+  if (res) {
+    get_video_tx_metrics(stream_index)
+        .frame_age_us.record(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() -
+                fragmented_video_frame.creation_time)
+                .count());
+  }
+  return res;
+}
+
+void WBLink::on_video_frame_dropped(int stream_index,
+                                    openhd::wb::VideoDropReason reason) {
+  auto& metrics = get_video_tx_metrics(stream_index);
+  metrics.dropped_frames.add();
+  metrics.dropped_frames_by_reason[(int)reason]->add();
+  // Only these mean the link can't keep up with the encoder - the others are
+  // a consequence of them (or of a new key frame) and would count twice
+  if (reason == openhd::wb::VideoDropReason::TOO_OLD ||
+      reason == openhd::wb::VideoDropReason::QUEUE_FULL) {
+    m_frame_drop_helper.notify_dropped_frame(1);
+  }
+  if (stream_index == 0) {
+    m_primary_total_dropped_frames++;
+  } else {
+    m_secondary_total_dropped_frames++;
   }
 }
 
@@ -1564,6 +1823,9 @@ void WBLink::wt_gnd_perform_channel_management() {
     // management always on 20Mhz) And switch "up" to 40Mhz if needed
     // AND react to (announced) frequency changes (right now without any
     // recovery protocol)
+    if (m_management_gnd->is_channel_switch_in_progress()) {
+      return;
+    }
     const int air_reported_channel_width =
         m_management_gnd->m_air_reported_curr_channel_width;
     const int air_reported_frequency =
@@ -1578,8 +1840,6 @@ void WBLink::wt_gnd_perform_channel_management() {
         m_console->debug("air_reported_frequency: {}", air_reported_frequency);
         m_console->debug("air_reported_channel_width: {}",
                          air_reported_channel_width);
-        m_gnd_curr_rx_frequency = air_reported_frequency;
-        m_gnd_curr_rx_channel_width = air_reported_channel_width;
         m_settings->unsafe_get_settings().wb_frequency = air_reported_frequency;
         m_settings->persist(false);
         apply_frequency_and_channel_width(air_reported_frequency,
@@ -1589,6 +1849,17 @@ void WBLink::wt_gnd_perform_channel_management() {
   }
 }
 
+void WBLink::wt_persist_switched_channel() {
+  const int frequency = m_persist_switched_frequency.exchange(-1);
+  if (frequency <= 0) return;
+  m_settings->unsafe_get_settings().wb_frequency = frequency;
+  const int channel_width = m_persist_switched_channel_width.exchange(-1);
+  if (m_profile.is_air && channel_width > 0) {
+    m_settings->unsafe_get_settings().wb_air_tx_channel_width = channel_width;
+  }
+  m_settings->persist(false);
+}
+
 void WBLink::re_enable_injection_unless_user_passive_mode_enabled() {
   bool enable_passive_mode = false;
   if (m_profile.is_ground() &&
@@ -1634,54 +1905,90 @@ void WBLink::on_wifi_card_fatal_error() {
   m_wifi_card_error_has_been_handled = true;
 }
 
-void WBLink::wt_perform_update_thermal_protection() {
-  m_console->debug("thermal_protection, function started");
-  if (!OHDPlatform::instance().is_x20()) {
-    // Only works on x20
+void WBLink::setup_thermal_protection(const openhd::Config& config) {
+  const bool enable = config.GEN_THERMAL_GOVERNOR_ENABLE < 0
+                          ? OHDPlatform::instance().is_x20()
+                          : config.GEN_THERMAL_GOVERNOR_ENABLE > 0;
+  if (!enable) {
+    m_console->info("Thermal protection disabled");
     return;
   }
+  m_thermal_sensors = openhd::thermal::discover_sensors();
+  if (OHDPlatform::instance().is_x20()) {
+    // The rtl8812au of the X20 reports its temperature via hwmon0
+    const std::string x20_card_sensor = "/sys/class/hwmon/hwmon0/temp1_input";
+    auto it = std::find_if(m_thermal_sensors.begin(), m_thermal_sensors.end(),
+                           [&x20_card_sensor](const auto& sensor) {
+                             return sensor.temp_path == x20_card_sensor;
+                           });
+    if (it == m_thermal_sensors.end()) {
+      m_thermal_sensors.push_back(openhd::thermal::Sensor{
+          "x20_rtl8812au", x20_card_sensor,
+          openhd::thermal::SensorType::WIFI_CARD});
+    } else {
+      it->type = openhd::thermal::SensorType::WIFI_CARD;
+    }
+  }
+  m_console->debug("Thermal sensors: {}",
+                   openhd::thermal::sensors_to_string(m_thermal_sensors));
+  openhd::thermal::GovernorConfig governor_config{};
+  governor_config.setpoint_soc_c = config.GEN_THERMAL_SETPOINT_SOC_C;
+  governor_config.setpoint_wifi_card_c =
+      config.GEN_THERMAL_SETPOINT_WIFI_CARD_C;
+  m_thermal_governor =
+      std::make_unique<openhd::thermal::Governor>(governor_config);
+}
+
+void WBLink::wt_perform_update_fec_policy() {
+  if (!m_profile.is_air) return;
+  // We only know the loss of the ground -> air direction, but it is the same
+  // channel
+  const int loss_perc = m_wb_txrx->get_rx_stats().curr_lowest_packet_loss;
+  for (auto& fec_policy : m_video_fec_policy_list) {
+    fec_policy->set_link_loss_perc(loss_perc);
+  }
+}
+
+void WBLink::wt_perform_update_thermal_protection() {
+  if (!m_thermal_governor) return;
   if (OHDFilesystemUtil::exists(std::string(getConfigBasePath()) +
                                 "disable_thermal_limits.txt")) {
     m_thermal_protection_level = THERMAL_PROTECTION_NONE;
+    m_thermal_bitrate_perc = 100;
+    if (m_thermal_tx_power_perc != 100) {
+      m_thermal_tx_power_perc = 100;
+      m_request_apply_tx_power = true;
+    }
     return;
   }
-  auto temp = openhd::x20_read_rtl8812au_thermal_sensor_degree();
-  if (temp <= 0) {
-    m_thermal_protection_level = THERMAL_PROTECTION_NONE;
+  // Temperature changes slowly, once per second is plenty
+  const auto now = std::chrono::steady_clock::now();
+  if (now - m_thermal_last_update < std::chrono::seconds(1)) {
     return;
   }
-  static auto THERMAL_LIMIT_VIDEO_REDUCED = 85;
-  static auto THERMAL_LIMIT_VIDEO_OFF = 95;
-  uint8_t new_thermal_protection_level;
-  if (temp >= THERMAL_LIMIT_VIDEO_OFF) {
-    // >=X degree, disable video
+  m_thermal_last_update = now;
+  const auto state = m_thermal_governor->update(
+      openhd::thermal::read_sensors(m_thermal_sensors));
+  m_thermal_hottest_temp_c = state.hottest_temp_c;
+  m_thermal_bitrate_perc =
+      static_cast<int>(std::lround(state.bitrate_factor * 100));
+  // Changing the tx power takes a while, only do it in 5% steps
+  const int tx_power_perc =
+      static_cast<int>(std::lround(state.tx_power_factor * 20)) * 5;
+  if (tx_power_perc != m_thermal_tx_power_perc) {
+    m_thermal_tx_power_perc = tx_power_perc;
+    m_request_apply_tx_power = true;
+  }
+  uint8_t new_thermal_protection_level = THERMAL_PROTECTION_NONE;
+  if (state.video_disabled) {
     new_thermal_protection_level = THERMAL_PROTECTION_VIDEO_DISABLED;
-  } else if (temp >= THERMAL_LIMIT_VIDEO_REDUCED) {
-    //  >=X degree, throttle video
+  } else if (m_thermal_bitrate_perc < 100 || tx_power_perc < 100) {
     new_thermal_protection_level = THERMAL_PROTECTION_RATE_REDUCED;
-  } else {  // no thermal protection
-    new_thermal_protection_level = THERMAL_PROTECTION_NONE;
   }
-  if (new_thermal_protection_level > m_thermal_protection_level) {
-    // apply immediately
+  if (new_thermal_protection_level != m_thermal_protection_level) {
+    m_console->warn("Thermal protection level {}: {}",
+                    new_thermal_protection_level,
+                    openhd::thermal::governor_state_to_string(state));
     m_thermal_protection_level = new_thermal_protection_level;
-    m_thermal_protection_enable_tp = std::chrono::steady_clock::now();
-  } else if (new_thermal_protection_level < m_thermal_protection_level) {
-    const auto elapsed_since_thermal_protection_enabled =
-        std::chrono::steady_clock::now() - m_thermal_protection_enable_tp;
-    // Every time some type of thermal protection is activated, it stays active
-    // for at least X seconds to avoid oscillating
-    if (elapsed_since_thermal_protection_enabled < std::chrono::seconds(10)) {
-      return;
-    }
-    if (m_thermal_protection_level == THERMAL_PROTECTION_VIDEO_DISABLED) {
-      // When video streaming is disabled, we only re-enable it once we have
-      // cooled down significantly
-      if (temp <= 70) {
-        m_thermal_protection_level = new_thermal_protection_level;
-      }
-    } else {
-      m_thermal_protection_level = new_thermal_protection_level;
-    }
   }
 }
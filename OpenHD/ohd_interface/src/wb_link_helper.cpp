@@ -475,3 +475,7 @@ std::optional<uint8_t> openhd::wb::RCChannelHelper::get_bw_from_rc_channel(
   if (bw_channel_value_pwm > 1500) return 40;
   return 20;
 }
+
+int openhd::wb::reduce_bitrate_on_tx_errors(int curr_bitrate_kbits) {
+  return std::max(curr_bitrate_kbits - 1000, MIN_VIDEO_BITRATE_KBITS);
+}
@@ -28,11 +28,14 @@
 
 #include "openhd_global_constants.hpp"
 #include "openhd_spdlog.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 #include "openhd_util_time.h"
 
 static constexpr uint8_t MNGMNT_PACKET_ID_CHANNEL_WIDTH = 0;
 static constexpr uint8_t MNGMNT_PACKET_ID_SENSITVITY_STATUS = 1;
+static constexpr uint8_t MNGMNT_PACKET_ID_CHANNEL_SWITCH_ANNOUNCE = 2;
+static constexpr uint8_t MNGMNT_PACKET_ID_CHANNEL_SWITCH_ACK = 3;
 struct DataManagementTxBandwidth {
   uint32_t center_frequency_mhz;
   uint8_t bandwidth_mhz;
@@ -41,21 +44,41 @@ struct DataManagementSensitivityStatus {
   uint16_t dummy_0;
   uint16_t dummy_1;
 } __attribute__((packed));
-static std::vector<uint8_t> pack_management_frame(
-    const DataManagementTxBandwidth &data) {
+template <typename T>
+static std::vector<uint8_t> pack_management_frame(uint8_t packet_id,
+                                                  const T &data) {
   std::vector<uint8_t> ret;
   ret.resize(1 + sizeof(data));
-  ret[0] = MNGMNT_PACKET_ID_CHANNEL_WIDTH;
-  std::memcpy(&ret[1], (void *)&data, sizeof(DataManagementTxBandwidth));
+  ret[0] = packet_id;
+  std::memcpy(&ret[1], (void *)&data, sizeof(T));
   return ret;
 }
+static std::vector<uint8_t> pack_management_frame(
+    const DataManagementTxBandwidth &data) {
+  return pack_management_frame(MNGMNT_PACKET_ID_CHANNEL_WIDTH, data);
+}
 static std::vector<uint8_t> pack_management_frame(
     const DataManagementSensitivityStatus &data) {
-  std::vector<uint8_t> ret;
-  ret.resize(1 + sizeof(data));
-  ret[0] = MNGMNT_PACKET_ID_SENSITVITY_STATUS;
-  std::memcpy(&ret[1], (void *)&data, sizeof(DataManagementSensitivityStatus));
-  return ret;
+  return pack_management_frame(MNGMNT_PACKET_ID_SENSITVITY_STATUS, data);
+}
+static std::vector<uint8_t> pack_management_frame(
+    const openhd::wb::ChannelSwitchAnnounce &data) {
+  return pack_management_frame(MNGMNT_PACKET_ID_CHANNEL_SWITCH_ANNOUNCE, data);
+}
+static std::vector<uint8_t> pack_management_frame(
+    const openhd::wb::ChannelSwitchAck &data) {
+  return pack_management_frame(MNGMNT_PACKET_ID_CHANNEL_SWITCH_ACK, data);
+}
+template <typename T>
+static std::optional<T> unpack_management_frame(uint8_t packet_id,
+                                                 const uint8_t *data,
+                                                 int data_len) {
+  if (data_len != sizeof(T) + 1 || data[0] != packet_id) {
+    return std::nullopt;
+  }
+  T packet{};
+  std::memcpy(&packet, &data[1], sizeof(T));
+  return packet;
 }
 
 static std::string management_frame_to_string(
@@ -65,12 +88,22 @@ static std::string management_frame_to_string(
 }
 
 ManagementAir::ManagementAir(std::shared_ptr<WBTxRx> wb_tx_rx,
-                             int initial_freq_mhz, int inital_channel_width_mhz)
+                             int initial_freq_mhz, int inital_channel_width_mhz,
+                             openhd::wb::RETUNE_CB retune_cb)
     : m_wb_txrx(std::move(wb_tx_rx)),
       m_curr_frequency_mhz(initial_freq_mhz),
       m_curr_channel_width_mhz(inital_channel_width_mhz),
       m_last_change_timestamp_ms{openhd::util::steady_clock_time_epoch_ms()} {
   m_console = openhd::log::create_or_get("wb_mngmt_air");
+  // Report the new channel only once we actually switched
+  auto cb_retune = [this, retune_cb](const openhd::wb::WBChannel &channel,
+                                     bool is_fallback) {
+    retune_cb(channel, is_fallback);
+    m_curr_frequency_mhz = channel.frequency_mhz;
+    m_curr_channel_width_mhz = channel.channel_width_mhz;
+    m_last_change_timestamp_ms = openhd::util::steady_clock_time_epoch_ms();
+  };
+  m_channel_switch = std::make_unique<openhd::wb::ChannelSwitchAir>(cb_retune);
   auto cb_packet = [this](uint64_t nonce, int wlan_index, const uint8_t *data,
                           const int data_len) {
     this->on_new_management_packet(data, data_len);
@@ -83,14 +116,25 @@ ManagementAir::ManagementAir(std::shared_ptr<WBTxRx> wb_tx_rx,
 int ManagementAir::get_last_received_packet_ts_ms() {
   return m_last_received_packet_timestamp_ms;
 }
-void ManagementAir::set_frequency(int frequency) {
-  m_curr_frequency_mhz = frequency;
+
+bool ManagementAir::schedule_channel_switch(int frequency, int channel_width) {
+  const openhd::wb::WBChannel current{(int)m_curr_frequency_mhz.load(),
+                                      (int)m_curr_channel_width_mhz.load()};
+  const openhd::wb::WBChannel target{frequency, channel_width};
+  const int last_received_ts_ms = m_last_received_packet_timestamp_ms;
+  const bool ground_connected =
+      last_received_ts_ms != 0 && openhd::util::steady_clock_time_epoch_ms() -
+                                          last_received_ts_ms <
+                                      3 * 1000;
   m_last_change_timestamp_ms = openhd::util::steady_clock_time_epoch_ms();
+  const bool ret = m_channel_switch->request_switch(
+      current, target, ground_connected, std::chrono::steady_clock::now());
+  wakeup();
+  return ret;
 }
 
-void ManagementAir::set_channel_width(uint8_t bw) {
-  m_curr_channel_width_mhz = bw;
-  m_last_change_timestamp_ms = openhd::util::steady_clock_time_epoch_ms();
+bool ManagementAir::is_channel_switch_in_progress() {
+  return m_channel_switch->is_in_progress();
 }
 
 void ManagementAir::start() {
@@ -101,12 +145,32 @@ void ManagementAir::start() {
 ManagementAir::~ManagementAir() {
   m_wb_txrx->rx_unregister_stream_handler(openhd::MANAGEMENT_RADIO_PORT_GND_TX);
   m_tx_thread_run = false;
+  wakeup();
   m_tx_thread->join();
   m_tx_thread = nullptr;
 }
 
+void ManagementAir::wakeup() {
+  {
+    std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup = true;
+  }
+  m_wakeup_cv.notify_one();
+}
+
+void ManagementAir::inject_management_frame(const std::vector<uint8_t> &data) {
+  auto radiotap_header = m_tx_header->thread_safe_get();
+  m_wb_txrx->tx_inject_packet(openhd::MANAGEMENT_RADIO_PORT_AIR_TX, data.data(),
+                              data.size(), radiotap_header, true);
+}
+
 void ManagementAir::loop() {
+  openhd::thread::set_current_thread(
+      "wb_management", openhd::thread::ThreadClass::NORMAL);
   while (m_tx_thread_run) {
+    // Performs the (scheduled) retune if due
+    const auto announce =
+        m_channel_switch->update(std::chrono::steady_clock::now());
     // Air: Continuously broadcast channel width
     // Calculate the interval in which we broadcast the channel width management
     // frame
@@ -114,42 +178,64 @@ void ManagementAir::loop() {
         std::chrono::milliseconds(500);  // default 2Hz
     const auto elapsed_since_last_change_ms =
         openhd::util::steady_clock_time_epoch_ms() - m_last_change_timestamp_ms;
-    if (elapsed_since_last_change_ms < 2 * 1000) {
+    if (elapsed_since_last_change_ms < 2 * 1000 ||
+        m_channel_switch->is_in_progress()) {
       // If the last change is recent, send in higher interval
       management_frame_interval = std::chrono::milliseconds(20);
     }
-    const auto elapsed_since_last_management_frame =
-        std::chrono::steady_clock::now() - m_air_last_management_frame;
-    if (elapsed_since_last_management_frame < management_frame_interval) {
-      continue;
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_air_last_management_frame >= management_frame_interval ||
+        announce.has_value()) {
+      DataManagementTxBandwidth managementFrame{
+          m_curr_frequency_mhz.load(), m_curr_channel_width_mhz.load()};
+      inject_management_frame(pack_management_frame(managementFrame));
+      if (announce.has_value()) {
+        inject_management_frame(pack_management_frame(announce.value()));
+      }
+      m_air_last_management_frame = now;
     }
-    DataManagementTxBandwidth managementFrame{m_curr_frequency_mhz.load(),
-                                              m_curr_channel_width_mhz.load()};
-    auto data = pack_management_frame(managementFrame);
-    auto radiotap_header = m_tx_header->thread_safe_get();
-    m_wb_txrx->tx_inject_packet(openhd::MANAGEMENT_RADIO_PORT_AIR_TX,
-                                data.data(), data.size(), radiotap_header,
-                                true);
-    std::this_thread::sleep_for(management_frame_interval);
-    // std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Wake up for the next frame, or earlier if the switch is due
+    const auto wakeup_tp =
+        std::min(m_air_last_management_frame + management_frame_interval,
+                 m_channel_switch->get_next_deadline());
+    std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup_cv.wait_until(lock, wakeup_tp, [this] { return m_wakeup; });
+    m_wakeup = false;
   }
 }
 
 void ManagementAir::on_new_management_packet(const uint8_t *data,
                                              int data_len) {
-  if (data_len == sizeof(DataManagementSensitivityStatus) + 1 &&
-      data[0] == MNGMNT_PACKET_ID_SENSITVITY_STATUS) {
+  const auto now = std::chrono::steady_clock::now();
+  if (unpack_management_frame<DataManagementSensitivityStatus>(
+          MNGMNT_PACKET_ID_SENSITVITY_STATUS, data, data_len)
+          .has_value()) {
     m_last_received_packet_timestamp_ms =
         openhd::util::steady_clock_time_epoch_ms();
-    DataManagementSensitivityStatus packet{};
-    std::memcpy(&packet, &data[1], data_len - 1);
+    m_channel_switch->on_packet_from_ground(now);
     // TODO
+  } else if (const auto ack =
+                 unpack_management_frame<openhd::wb::ChannelSwitchAck>(
+                     MNGMNT_PACKET_ID_CHANNEL_SWITCH_ACK, data, data_len)) {
+    m_last_received_packet_timestamp_ms =
+        openhd::util::steady_clock_time_epoch_ms();
+    m_channel_switch->on_ack(ack.value(), now);
   }
 }
 
-ManagementGround::ManagementGround(std::shared_ptr<WBTxRx> wb_tx_rx)
+ManagementGround::ManagementGround(std::shared_ptr<WBTxRx> wb_tx_rx,
+                                   openhd::wb::RETUNE_CB retune_cb)
     : m_wb_txrx(std::move(wb_tx_rx)) {
   m_console = openhd::log::create_or_get("wb_mngmt_gnd");
+  // After the switch, the air reports the channel we switched to
+  auto cb_retune = [this, retune_cb](const openhd::wb::WBChannel &channel,
+                                     bool is_fallback) {
+    m_air_reported_curr_frequency = channel.frequency_mhz;
+    m_air_reported_curr_channel_width = channel.channel_width_mhz;
+    retune_cb(channel, is_fallback);
+  };
+  m_channel_switch =
+      std::make_unique<openhd::wb::ChannelSwitchGround>(cb_retune);
   auto cb_packet = [this](uint64_t nonce, int wlan_index, const uint8_t *data,
                           const int data_len) {
     this->on_new_management_packet(data, data_len);
@@ -162,6 +248,7 @@ ManagementGround::ManagementGround(std::shared_ptr<WBTxRx> wb_tx_rx)
 ManagementGround::~ManagementGround() {
   m_wb_txrx->rx_unregister_stream_handler(openhd::MANAGEMENT_RADIO_PORT_AIR_TX);
   m_tx_thread_run = false;
+  wakeup();
   m_tx_thread->join();
   m_tx_thread = nullptr;
 }
@@ -173,32 +260,83 @@ void ManagementGround::start() {
 
 void ManagementGround::on_new_management_packet(const uint8_t *data,
                                                 int data_len) {
-  if (data_len == sizeof(DataManagementTxBandwidth) + 1 &&
-      data[0] == MNGMNT_PACKET_ID_CHANNEL_WIDTH) {
-    DataManagementTxBandwidth packet{};
-    std::memcpy(&packet, &data[1], data_len - 1);
-    if (packet.bandwidth_mhz == 20 || packet.bandwidth_mhz == 40) {
-      m_air_reported_curr_channel_width = packet.bandwidth_mhz;
-      m_air_reported_curr_frequency = packet.center_frequency_mhz;
+  const auto now = std::chrono::steady_clock::now();
+  if (const auto packet = unpack_management_frame<DataManagementTxBandwidth>(
+          MNGMNT_PACKET_ID_CHANNEL_WIDTH, data, data_len)) {
+    m_last_received_packet_timestamp_ms =
+        openhd::util::steady_clock_time_epoch_ms();
+    m_channel_switch->on_packet_from_air(now);
+    if (m_channel_switch->is_in_progress()) {
+      // Might still be in flight from the previous channel
+      return;
+    }
+    if (packet->bandwidth_mhz == 20 || packet->bandwidth_mhz == 40) {
+      m_air_reported_curr_channel_width = packet->bandwidth_mhz;
+      m_air_reported_curr_frequency = packet->center_frequency_mhz;
     } else {
-      m_console->warn("Air reports invalid bandwidth {}", packet.bandwidth_mhz);
+      m_console->warn("Air reports invalid bandwidth {}",
+                      packet->bandwidth_mhz);
     }
+  } else if (const auto announce =
+                 unpack_management_frame<openhd::wb::ChannelSwitchAnnounce>(
+                     MNGMNT_PACKET_ID_CHANNEL_SWITCH_ANNOUNCE, data,
+                     data_len)) {
+    m_last_received_packet_timestamp_ms =
+        openhd::util::steady_clock_time_epoch_ms();
+    m_channel_switch->on_announce(announce.value(), now);
+    // Acknowledge right away
+    wakeup();
   }
 }
 
+void ManagementGround::wakeup() {
+  {
+    std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup = true;
+  }
+  m_wakeup_cv.notify_one();
+}
+
+void ManagementGround::inject_management_frame(
+    const std::vector<uint8_t> &data) {
+  auto radiotap_header = m_tx_header->thread_safe_get();
+  m_wb_txrx->tx_inject_packet(openhd::MANAGEMENT_RADIO_PORT_GND_TX, data.data(),
+                              data.size(), radiotap_header, true);
+}
+
 void ManagementGround::loop() {
+  openhd::thread::set_current_thread(
+      "wb_management", openhd::thread::ThreadClass::NORMAL);
+  auto last_sensitivity_frame = std::chrono::steady_clock::time_point{};
   while (m_tx_thread_run) {
-    auto tmp = DataManagementSensitivityStatus{0, 0};
-    auto data = pack_management_frame(tmp);
-    auto radiotap_header = m_tx_header->thread_safe_get();
-    m_wb_txrx->tx_inject_packet(openhd::MANAGEMENT_RADIO_PORT_GND_TX,
-                                data.data(), data.size(), radiotap_header,
-                                true);
-    // m_console->debug("Sent sensitivity management frame");
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // Performs the (scheduled) retune if due
+    const auto ack = m_channel_switch->update(std::chrono::steady_clock::now());
+    if (ack.has_value()) {
+      inject_management_frame(pack_management_frame(ack.value()));
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_sensitivity_frame >= std::chrono::milliseconds(100)) {
+      auto tmp = DataManagementSensitivityStatus{0, 0};
+      inject_management_frame(pack_management_frame(tmp));
+      // m_console->debug("Sent sensitivity management frame");
+      last_sensitivity_frame = now;
+    }
+    // While verifying a switch, the ack is sent at a higher rate
+    auto wakeup_tp = last_sensitivity_frame + std::chrono::milliseconds(100);
+    if (m_channel_switch->is_in_progress()) {
+      wakeup_tp = std::min(wakeup_tp, now + std::chrono::milliseconds(20));
+    }
+    wakeup_tp = std::min(wakeup_tp, m_channel_switch->get_next_deadline());
+    std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup_cv.wait_until(lock, wakeup_tp, [this] { return m_wakeup; });
+    m_wakeup = false;
   }
 }
 
 int ManagementGround::get_last_received_packet_ts_ms() {
   return m_last_received_packet_timestamp_ms;
 }
+
+bool ManagementGround::is_channel_switch_in_progress() {
+  return m_channel_switch->is_in_progress();
+}
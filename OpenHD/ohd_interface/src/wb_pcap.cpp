@@ -0,0 +1,551 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_pcap.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "openhd_memory.h"
+#include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
+#include "openhd_util_filesystem.h"
+
+#ifndef ARPHRD_IEEE80211_RADIOTAP
+#define ARPHRD_IEEE80211_RADIOTAP 803
+#endif
+
+namespace openhd::wb::pcap {
+
+static constexpr uint32_t BLOCK_TYPE_SHB = 0x0A0D0D0A;
+static constexpr uint32_t BLOCK_TYPE_IDB = 0x00000001;
+static constexpr uint32_t BLOCK_TYPE_EPB = 0x00000006;
+static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static constexpr uint16_t OPT_ENDOFOPT = 0;
+static constexpr uint16_t OPT_IF_NAME = 2;
+static constexpr uint16_t OPT_IF_TSRESOL = 9;
+static constexpr uint16_t OPT_EPB_FLAGS = 2;
+// Max size of a (radiotap + 802.11) frame we record
+static constexpr int MAX_FRAME_SIZE = 4096;
+
+namespace {
+
+template <typename T>
+void append(std::vector<uint8_t>& buff, T value) {
+  const auto* p = reinterpret_cast<const uint8_t*>(&value);
+  buff.insert(buff.end(), p, p + sizeof(T));
+}
+
+void append_padded(std::vector<uint8_t>& buff, const uint8_t* data, int len) {
+  buff.insert(buff.end(), data, data + len);
+  buff.resize(buff.size() + ((4 - len % 4) % 4), 0);
+}
+
+void append_option(std::vector<uint8_t>& buff, uint16_t code,
+                   const uint8_t* data, int len) {
+  append<uint16_t>(buff, code);
+  append<uint16_t>(buff, len);
+  append_padded(buff, data, len);
+}
+
+template <typename T>
+T read_at(const uint8_t* p) {
+  T ret;
+  std::memcpy(&ret, p, sizeof(T));
+  return ret;
+}
+
+}  // namespace
+
+PcapngWriter::PcapngWriter(const std::string& filename,
+                           const std::vector<CaptureInterface>& interfaces) {
+  m_file = fopen(filename.c_str(), "wb");
+  if (m_file == nullptr) {
+    openhd::log::get_default()->warn("Cannot open {}: {}", filename,
+                                     strerror(errno));
+    return;
+  }
+  // We write a lot of small blocks
+  setvbuf(m_file, nullptr, _IOFBF,
+          openhd::memory::get_budget().pcap_file_buffer_bytes);
+  std::vector<uint8_t> shb;
+  append<uint32_t>(shb, BYTE_ORDER_MAGIC);
+  append<uint16_t>(shb, 1);  // major
+  append<uint16_t>(shb, 0);  // minor
+  append<int64_t>(shb, -1);  // section length unknown
+  append<uint16_t>(shb, OPT_ENDOFOPT);
+  append<uint16_t>(shb, 0);
+  write_block(BLOCK_TYPE_SHB, shb);
+  for (const auto& interface : interfaces) {
+    std::vector<uint8_t> idb;
+    append<uint16_t>(idb, interface.link_type);
+    append<uint16_t>(idb, 0);  // reserved
+    append<uint32_t>(idb, 0);  // snaplen, unlimited
+    append_option(idb, OPT_IF_NAME,
+                  reinterpret_cast<const uint8_t*>(interface.name.data()),
+                  (int)interface.name.size());
+    const uint8_t tsresol_ns = 9;
+    append_option(idb, OPT_IF_TSRESOL, &tsresol_ns, 1);
+    append<uint16_t>(idb, OPT_ENDOFOPT);
+    append<uint16_t>(idb, 0);
+    write_block(BLOCK_TYPE_IDB, idb);
+  }
+}
+
+PcapngWriter::~PcapngWriter() {
+  if (m_file != nullptr) fclose(m_file);
+}
+
+void PcapngWriter::write_block(uint32_t type,
+                               const std::vector<uint8_t>& body) {
+  if (m_file == nullptr) return;
+  const uint32_t total_len = 12 + body.size();
+  fwrite(&type, 4, 1, m_file);
+  fwrite(&total_len, 4, 1, m_file);
+  fwrite(body.data(), 1, body.size(), m_file);
+  fwrite(&total_len, 4, 1, m_file);
+  m_n_bytes_written += total_len;
+}
+
+void PcapngWriter::write(const CapturedFrame& frame) {
+  std::vector<uint8_t> epb;
+  epb.reserve(frame.data.size() + 40);
+  append<uint32_t>(epb, frame.interface_idx);
+  append<uint32_t>(epb, (uint64_t)frame.timestamp_ns >> 32);
+  append<uint32_t>(epb, (uint64_t)frame.timestamp_ns & 0xFFFFFFFF);
+  append<uint32_t>(epb, frame.data.size());
+  append<uint32_t>(epb, frame.data.size());
+  append_padded(epb, frame.data.data(), (int)frame.data.size());
+  // Direction: 1 = inbound, 2 = outbound
+  const uint32_t flags = frame.outbound ? 2 : 1;
+  append_option(epb, OPT_EPB_FLAGS, reinterpret_cast<const uint8_t*>(&flags),
+                4);
+  append<uint16_t>(epb, OPT_ENDOFOPT);
+  append<uint16_t>(epb, 0);
+  write_block(BLOCK_TYPE_EPB, epb);
+}
+
+void PcapngWriter::flush() {
+  if (m_file != nullptr) fflush(m_file);
+}
+
+static std::string ring_filename(const PcapngRingWriter::Options& options,
+                                 int idx) {
+  char buff[32];
+  snprintf(buff, sizeof(buff), "_%06d.pcapng", idx);
+  return options.directory + "/" + options.prefix + buff;
+}
+
+std::vector<std::string> get_ring_files(const std::string& directory,
+                                        const std::string& prefix) {
+  std::vector<std::string> ret;
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) return ret;
+  while (auto* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    // prefix_NNNNNN.pcapng
+    if (name.size() == prefix.size() + 14 && name.rfind(prefix + "_", 0) == 0 &&
+        name.substr(name.size() - 7) == ".pcapng") {
+      ret.push_back(directory + "/" + name);
+    }
+  }
+  closedir(dir);
+  // Zero padded index, lexicographic order is the write order
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+PcapngRingWriter::PcapngRingWriter(Options options,
+                                   std::vector<CaptureInterface> interfaces)
+    : m_options(std::move(options)), m_interfaces(std::move(interfaces)) {
+  OHDFilesystemUtil::create_directories(m_options.directory);
+  // Continue after the files of a previous run (e.g. reboot during a flight)
+  const auto existing = get_ring_files(m_options.directory, m_options.prefix);
+  if (!existing.empty()) {
+    const auto& last = existing.back();
+    m_curr_file_idx =
+        std::atoi(last.substr(last.size() - 13, 6).c_str()) + 1;
+  }
+  open_next_file();
+}
+
+void PcapngRingWriter::open_next_file() {
+  m_writer = std::make_unique<PcapngWriter>(
+      ring_filename(m_options, m_curr_file_idx % 1000000), m_interfaces);
+  m_curr_file_idx++;
+  auto files = get_ring_files(m_options.directory, m_options.prefix);
+  while ((int)files.size() > m_options.max_n_files) {
+    OHDFilesystemUtil::remove_if_existing(files.front());
+    files.erase(files.begin());
+  }
+}
+
+void PcapngRingWriter::write(const CapturedFrame& frame) {
+  if (m_writer->get_n_bytes_written() >= m_options.max_file_size_bytes) {
+    open_next_file();
+  }
+  m_writer->write(frame);
+}
+
+void PcapngRingWriter::flush() { m_writer->flush(); }
+
+std::vector<std::string> PcapngRingWriter::get_files() const {
+  return get_ring_files(m_options.directory, m_options.prefix);
+}
+
+std::optional<Capture> read_pcapng(const std::string& filename) {
+  const auto content = OHDFilesystemUtil::opt_read_file(filename, false);
+  if (!content.has_value()) return std::nullopt;
+  const auto* data = reinterpret_cast<const uint8_t*>(content->data());
+  const std::size_t size = content->size();
+  if (size < 28 || read_at<uint32_t>(data) != BLOCK_TYPE_SHB ||
+      read_at<uint32_t>(data + 8) != BYTE_ORDER_MAGIC) {
+    return std::nullopt;
+  }
+  Capture ret{};
+  // Per interface (of the current section) timestamp resolution, as
+  // multiplier to ns (default us) and index in the merged interfaces
+  std::vector<int64_t> ts_to_ns;
+  std::vector<int> merged_idx;
+  std::size_t offset = 0;
+  while (offset + 12 <= size) {
+    const auto type = read_at<uint32_t>(data + offset);
+    const auto total_len = read_at<uint32_t>(data + offset + 4);
+    if (total_len < 12 || total_len % 4 != 0 || offset + total_len > size) {
+      break;  // Truncated
+    }
+    const uint8_t* body = data + offset + 8;
+    const uint32_t body_len = total_len - 12;
+    if (type == BLOCK_TYPE_SHB) {
+      // A new section, interface ids start again at 0 (we merge them by name)
+      ts_to_ns.clear();
+      merged_idx.clear();
+    } else if (type == BLOCK_TYPE_IDB && body_len >= 8) {
+      CaptureInterface interface{};
+      interface.link_type = read_at<uint16_t>(body);
+      int64_t multiplier = 1000;
+      for (uint32_t opt = 8; opt + 4 <= body_len;) {
+        const auto code = read_at<uint16_t>(body + opt);
+        const auto len = read_at<uint16_t>(body + opt + 2);
+        if (code == OPT_ENDOFOPT || opt + 4 + len > body_len) break;
+        if (code == OPT_IF_NAME) {
+          interface.name.assign((const char*)body + opt + 4, len);
+          while (!interface.name.empty() && interface.name.back() == '\0') {
+            interface.name.pop_back();
+          }
+        } else if (code == OPT_IF_TSRESOL && len == 1) {
+          const uint8_t resol = body[opt + 4];
+          // Only powers of 10 with a resolution of at most ns
+          if (!(resol & 0x80) && resol <= 9) {
+            multiplier = 1;
+            for (int i = resol; i < 9; i++) multiplier *= 10;
+          }
+        }
+        opt += 4 + len + ((4 - len % 4) % 4);
+      }
+      ts_to_ns.push_back(multiplier);
+      auto it = std::find_if(
+          ret.interfaces.begin(), ret.interfaces.end(),
+          [&interface](const auto& i) { return i.name == interface.name; });
+      merged_idx.push_back(it - ret.interfaces.begin());
+      if (it == ret.interfaces.end()) ret.interfaces.push_back(interface);
+    } else if (type == BLOCK_TYPE_EPB && body_len >= 20) {
+      const auto interface_id = read_at<uint32_t>(body);
+      const auto caplen = read_at<uint32_t>(body + 12);
+      if (interface_id >= ts_to_ns.size() || 20 + caplen > body_len) {
+        offset += total_len;
+        continue;
+      }
+      CapturedFrame frame{};
+      const uint64_t ts = ((uint64_t)read_at<uint32_t>(body + 4) << 32) |
+                          read_at<uint32_t>(body + 8);
+      frame.timestamp_ns = (int64_t)ts * ts_to_ns[interface_id];
+      frame.interface_idx = merged_idx[interface_id];
+      frame.data.assign(body + 20, body + 20 + caplen);
+      const uint32_t opt_begin = 20 + caplen + ((4 - caplen % 4) % 4);
+      for (uint32_t opt = opt_begin; opt + 4 <= body_len;) {
+        const auto code = read_at<uint16_t>(body + opt);
+        const auto len = read_at<uint16_t>(body + opt + 2);
+        if (code == OPT_ENDOFOPT || opt + 4 + len > body_len) break;
+        if (code == OPT_EPB_FLAGS && len == 4) {
+          frame.outbound = (read_at<uint32_t>(body + opt + 4) & 0x3) == 2;
+        }
+        opt += 4 + len + ((4 - len % 4) % 4);
+      }
+      ret.frames.push_back(std::move(frame));
+    }
+    offset += total_len;
+  }
+  return ret;
+}
+
+std::optional<Capture> read_pcapng_ring(const std::string& directory,
+                                        const std::string& prefix) {
+  const auto files = get_ring_files(directory, prefix);
+  if (files.empty()) return std::nullopt;
+  Capture ret{};
+  for (const auto& file : files) {
+    auto capture = read_pcapng(file);
+    if (!capture.has_value()) continue;
+    // All files of a ring have the same interfaces
+    if (ret.interfaces.empty()) ret.interfaces = capture->interfaces;
+    std::move(capture->frames.begin(), capture->frames.end(),
+              std::back_inserter(ret.frames));
+  }
+  std::stable_sort(ret.frames.begin(), ret.frames.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.timestamp_ns < b.timestamp_ns;
+                   });
+  return ret;
+}
+
+std::optional<RadiotapInfo> parse_radiotap(const uint8_t* data,
+                                           int data_len) {
+  if (data_len < 8 || data[0] != 0) return std::nullopt;
+  RadiotapInfo ret{};
+  ret.header_len = read_at<uint16_t>(data + 2);
+  if (ret.header_len < 8 || ret.header_len > data_len) return std::nullopt;
+  // (alignment, size) of the fields of the radiotap namespace, by bit index
+  static constexpr std::pair<int, int> FIELDS[] = {
+      {8, 8}, {1, 1}, {1, 1}, {2, 4}, {2, 2}, {1, 1}, {1, 1}, {2, 2},
+      {2, 2}, {2, 2}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {2, 2}, {2, 2},
+      {1, 1}, {1, 1}, {4, 8}, {1, 3}, {4, 8}, {2, 12}, {8, 12}, {2, 12},
+      {2, 12}, {2, 6}, {1, 1}, {2, 4}};
+  static constexpr int N_FIELDS = sizeof(FIELDS) / sizeof(FIELDS[0]);
+  // Present bitmaps, the msb of each one indicates another one follows
+  std::vector<uint32_t> present;
+  int offset = 4;
+  while (true) {
+    if (offset + 4 > ret.header_len) return std::nullopt;
+    present.push_back(read_at<uint32_t>(data + offset));
+    offset += 4;
+    if (!(present.back() & 0x80000000)) break;
+  }
+  bool radiotap_namespace = true;
+  for (std::size_t word = 0; word < present.size(); word++) {
+    const uint32_t bits = present[word];
+    if (radiotap_namespace) {
+      for (int bit = 0; bit < N_FIELDS; bit++) {
+        if (!(bits & (1u << bit))) continue;
+        const auto [align, size] = FIELDS[bit];
+        offset = (offset + align - 1) / align * align;
+        if (offset + size > ret.header_len) return ret;
+        const uint8_t* field = data + offset;
+        switch (bit) {
+          case 1:
+            if (word == 0) ret.flags = field[0];
+            break;
+          case 2:
+            if (word == 0) ret.rate_500kbps = field[0];
+            break;
+          case 3:
+            if (word == 0) ret.frequency_mhz = read_at<uint16_t>(field);
+            break;
+          case 5:
+            if (word == 0) {
+              ret.rssi_dbm = (int8_t)field[0];
+            } else {
+              ret.antenna_rssi_dbm.push_back((int8_t)field[0]);
+            }
+            break;
+          case 6:
+            if (word == 0) ret.noise_dbm = (int8_t)field[0];
+            break;
+          case 19:
+            // known, flags, mcs - only valid if the mcs index is known
+            if (field[0] & 0x02) ret.mcs_index = field[2];
+            break;
+          default:
+            break;
+        }
+        offset += size;
+      }
+      // Bit 28 (TLVs) has a variable size and is always the last one - stop
+      // here
+      if (bits & 0x1FFFFFFF & ~((1u << N_FIELDS) - 1)) return ret;
+    } else {
+      // Vendor namespace, we cannot parse further
+      return ret;
+    }
+    // Bit 29: radiotap namespace next, bit 30: vendor namespace next
+    if (bits & (1u << 30)) radiotap_namespace = false;
+    if (bits & (1u << 29)) radiotap_namespace = true;
+  }
+  return ret;
+}
+
+static std::optional<std::pair<int, uint16_t>> open_packet_socket(
+    const std::string& interface_name,
+    const std::shared_ptr<spdlog::logger>& console) {
+  const int fd =
+      socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_ALL));
+  if (fd < 0) {
+    console->warn("Cannot create packet socket: {}", strerror(errno));
+    return std::nullopt;
+  }
+  ifreq ifr{};
+  std::strncpy(ifr.ifr_name, interface_name.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+    console->warn("Unknown interface {}", interface_name);
+    close(fd);
+    return std::nullopt;
+  }
+  sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifr.ifr_ifindex;
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    console->warn("Cannot bind to {}: {}", interface_name, strerror(errno));
+    close(fd);
+    return std::nullopt;
+  }
+  uint16_t link_type = LINKTYPE_IEEE802_11_RADIOTAP;
+  if (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0 &&
+      ifr.ifr_hwaddr.sa_family != ARPHRD_IEEE80211_RADIOTAP) {
+    // Not in monitor mode (or not a wifi card at all)
+    console->warn("{} is not in monitor mode, recording as ethernet",
+                  interface_name);
+    link_type = LINKTYPE_ETHERNET;
+  }
+  const int rcvbuf = openhd::memory::get_budget().pcap_socket_rcvbuf_bytes;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+  return std::make_pair(fd, link_type);
+}
+
+WBPcapRecorder::WBPcapRecorder(const std::vector<std::string>& interface_names,
+                               PcapngRingWriter::Options options) {
+  m_console = openhd::log::create_or_get("wb_pcap");
+  std::vector<CaptureInterface> interfaces;
+  for (const auto& name : interface_names) {
+    const auto opened = open_packet_socket(name, m_console);
+    if (!opened.has_value()) continue;
+    m_sockets.push_back(opened->first);
+    interfaces.push_back(CaptureInterface{name, opened->second});
+  }
+  m_console->info("Recording {} interface(s) to {}", interfaces.size(),
+                  options.directory);
+  m_writer = std::make_unique<PcapngRingWriter>(std::move(options),
+                                                std::move(interfaces));
+  m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  m_thread = std::make_unique<std::thread>(&WBPcapRecorder::loop, this);
+}
+
+WBPcapRecorder::~WBPcapRecorder() {
+  m_keep_running = false;
+  const uint64_t one = 1;
+  (void)write(m_wakeup_fd, &one, sizeof(one));
+  m_thread->join();
+  m_writer->flush();
+  for (const int fd : m_sockets) close(fd);
+  close(m_wakeup_fd);
+}
+
+WBPcapRecorder::Stats WBPcapRecorder::get_stats() const {
+  return Stats{m_n_frames_inbound, m_n_frames_outbound, m_n_frames_dropped};
+}
+
+void WBPcapRecorder::loop() {
+  openhd::thread::set_current_thread("wb_pcap",
+                                     openhd::thread::ThreadClass::NORMAL);
+  std::vector<pollfd> fds;
+  fds.push_back(pollfd{m_wakeup_fd, POLLIN, 0});
+  for (const int fd : m_sockets) fds.push_back(pollfd{fd, POLLIN, 0});
+  CapturedFrame frame{};
+  frame.data.resize(MAX_FRAME_SIZE);
+  auto last_flush = std::chrono::steady_clock::now();
+  while (m_keep_running) {
+    // Flush at least once per second, such that not much is lost on a crash
+    const int ret = poll(fds.data(), fds.size(), 1000);
+    if (ret < 0 && errno != EINTR) break;
+    for (std::size_t i = 1; i < fds.size(); i++) {
+      if (!(fds[i].revents & POLLIN)) continue;
+      // Drain the socket
+      while (true) {
+        frame.data.resize(MAX_FRAME_SIZE);
+        sockaddr_ll from{};
+        iovec iov{frame.data.data(), frame.data.size()};
+        char control[CMSG_SPACE(sizeof(timespec))];
+        msghdr msg{};
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        const auto len = recvmsg(fds[i].fd, &msg, 0);
+        if (len <= 0) break;
+        frame.data.resize(len);
+        frame.interface_idx = (int)i - 1;
+        frame.outbound = from.sll_pkttype == PACKET_OUTGOING;
+        frame.timestamp_ns = 0;
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+          if (cmsg->cmsg_level == SOL_SOCKET &&
+              cmsg->cmsg_type == SO_TIMESTAMPNS) {
+            timespec ts{};
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            frame.timestamp_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+          }
+        }
+        if (frame.timestamp_ns == 0) {
+          frame.timestamp_ns =
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count();
+        }
+        m_writer->write(frame);
+        (frame.outbound ? m_n_frames_outbound : m_n_frames_inbound)++;
+      }
+    }
+    if (std::chrono::steady_clock::now() - last_flush >=
+        std::chrono::seconds(1)) {
+      last_flush = std::chrono::steady_clock::now();
+      m_writer->flush();
+      for (const int fd : m_sockets) {
+        tpacket_stats stats{};
+        socklen_t stats_len = sizeof(stats);
+        if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &stats,
+                       &stats_len) == 0) {
+          m_n_frames_dropped += stats.tp_drops;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace openhd::wb::pcap
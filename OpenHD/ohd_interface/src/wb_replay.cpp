@@ -0,0 +1,232 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_replay.h"
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <deque>
+#include <thread>
+
+#include "openhd_spdlog_include.h"
+#include "wb_link_helper.h"
+
+namespace openhd::wb::replay {
+
+static bool matches(const CapturedFrame& frame, const ReplayOptions& options) {
+  if (options.interface_idx >= 0 &&
+      frame.interface_idx != options.interface_idx) {
+    return false;
+  }
+  switch (options.direction) {
+    case ReplayOptions::Direction::INBOUND:
+      return !frame.outbound;
+    case ReplayOptions::Direction::OUTBOUND:
+      return frame.outbound;
+    default:
+      return true;
+  }
+}
+
+int replay(const Capture& capture, const ReplayOptions& options,
+           const FRAME_CB& cb) {
+  int n_delivered = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  const int64_t first_ts_ns =
+      capture.frames.empty() ? 0 : capture.frames.front().timestamp_ns;
+  for (const auto& frame : capture.frames) {
+    if (!matches(frame, options)) continue;
+    if (options.speed > 0) {
+      const auto offset = std::chrono::nanoseconds(static_cast<int64_t>(
+          (double)(frame.timestamp_ns - first_ts_ns) / options.speed));
+      std::this_thread::sleep_until(begin + offset);
+    }
+    cb(frame);
+    n_delivered++;
+  }
+  return n_delivered;
+}
+
+std::vector<uint8_t> make_injectable(const CapturedFrame& frame) {
+  const auto radiotap =
+      pcap::parse_radiotap(frame.data.data(), (int)frame.data.size());
+  if (!radiotap.has_value()) return {};
+  const int payload_len = (int)frame.data.size() - radiotap->header_len -
+                          (radiotap->has_fcs() ? 4 : 0);
+  if (payload_len <= 0) return {};
+  // version, pad, len (10), present (tx flags), tx flags (no ack)
+  std::vector<uint8_t> ret{0, 0, 10, 0, 0x00, 0x80, 0x00, 0x00, 0x08, 0x00};
+  const auto* payload = frame.data.data() + radiotap->header_len;
+  ret.insert(ret.end(), payload, payload + payload_len);
+  return ret;
+}
+
+MonitorInjector::MonitorInjector(const std::string& interface_name) {
+  m_fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+  if (m_fd < 0) {
+    openhd::log::get_default()->warn("Cannot create packet socket: {}",
+                                     strerror(errno));
+    return;
+  }
+  ifreq ifr{};
+  std::strncpy(ifr.ifr_name, interface_name.c_str(), IFNAMSIZ - 1);
+  const bool has_index = ioctl(m_fd, SIOCGIFINDEX, &ifr) == 0;
+  sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifr.ifr_ifindex;
+  if (!has_index || bind(m_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    openhd::log::get_default()->warn("Cannot inject on {}: {}", interface_name,
+                                     strerror(errno));
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+MonitorInjector::~MonitorInjector() {
+  if (m_fd >= 0) close(m_fd);
+}
+
+bool MonitorInjector::inject(const std::vector<uint8_t>& frame) {
+  if (m_fd < 0 || frame.empty()) return false;
+  return send(m_fd, frame.data(), frame.size(), 0) == (ssize_t)frame.size();
+}
+
+std::vector<int> throughput_kbits_per_second(
+    const Capture& capture, ReplayOptions::Direction direction) {
+  std::vector<int64_t> bytes;
+  ReplayOptions options{};
+  options.direction = direction;
+  if (capture.frames.empty()) return {};
+  const int64_t first_ts_ns = capture.frames.front().timestamp_ns;
+  for (const auto& frame : capture.frames) {
+    if (!matches(frame, options)) continue;
+    const auto second =
+        (std::size_t)((frame.timestamp_ns - first_ts_ns) / 1000000000LL);
+    if (bytes.size() <= second) bytes.resize(second + 1, 0);
+    bytes[second] += frame.data.size();
+  }
+  std::vector<int> ret;
+  ret.reserve(bytes.size());
+  for (const auto b : bytes) ret.push_back((int)(b * 8 / 1000));
+  return ret;
+}
+
+TxQueueSimulation::Result TxQueueSimulation::run(
+    const Options& options, const LINK_RATE_KBITS_CB& link_rate) {
+  using namespace std::chrono;
+  Result result{};
+  FrameDropsHelper drops_helper{};
+  drops_helper.set_console(openhd::log::create_or_get("wb_replay"));
+  // Virtual clock, starting at the (arbitrary) epoch of the steady clock
+  const steady_clock::time_point t0{};
+  drops_helper.delay_for(options.startup_delay, t0);
+  int bitrate_kbits = options.encoder_bitrate_kbits;
+  struct QueuedFrame {
+    int64_t enqueue_us;
+    double remaining_bytes;
+  };
+  std::deque<QueuedFrame> queue;
+  // Same as the wb link (work thread)
+  static constexpr int64_t RATE_CHECK_INTERVAL_US = 100 * 1000;
+  const int64_t duration_us = duration_cast<microseconds>(options.duration).count();
+  int64_t now_us = 0;
+  int64_t next_frame_us = 0;
+  int64_t next_check_us = 0;
+  int64_t frame_idx = 0;
+  while (true) {
+    const int64_t next_us = std::min(next_frame_us, next_check_us);
+    if (next_us >= duration_us) break;
+    // Drain the queue until the next event, at the capacity at the beginning
+    // of the interval (the callback is usually per second or coarser)
+    const double bytes_per_us =
+        link_rate(duration_cast<milliseconds>(microseconds(now_us))) * 1000.0 /
+        8.0 / 1000000.0;
+    double t_us = (double)now_us;
+    while (!queue.empty() && bytes_per_us > 0) {
+      auto& front = queue.front();
+      const double finish_us = t_us + front.remaining_bytes / bytes_per_us;
+      if (finish_us > (double)next_us) {
+        front.remaining_bytes -= ((double)next_us - t_us) * bytes_per_us;
+        break;
+      }
+      t_us = finish_us;
+      result.max_queue_delay = std::max(
+          result.max_queue_delay,
+          microseconds((int64_t)finish_us - front.enqueue_us));
+      queue.pop_front();
+    }
+    now_us = next_us;
+    if (now_us == next_frame_us) {
+      const bool key_frame = frame_idx % options.gop_size == 0;
+      // Such that the average matches the bitrate
+      const double avg_bytes = bitrate_kbits * 1000.0 / 8.0 / options.fps;
+      const double non_key_bytes =
+          avg_bytes * options.gop_size /
+          (options.gop_size - 1 + options.key_frame_factor);
+      const double bytes =
+          key_frame ? non_key_bytes * options.key_frame_factor : non_key_bytes;
+      if (key_frame) {
+        // Like the wb link, key frames push out older frames
+        while ((int)queue.size() >= options.queue_size_frames) {
+          queue.pop_back();
+          drops_helper.notify_dropped_frame();
+          result.n_dropped_frames++;
+        }
+      }
+      if ((int)queue.size() < options.queue_size_frames) {
+        queue.push_back(QueuedFrame{now_us, bytes});
+      } else {
+        drops_helper.notify_dropped_frame();
+        result.n_dropped_frames++;
+      }
+      result.n_frames++;
+      frame_idx++;
+      // No accumulated rounding error
+      next_frame_us = frame_idx * 1000 * 1000 / options.fps;
+    }
+    if (now_us == next_check_us) {
+      if (drops_helper.needs_bitrate_reduction(t0 + microseconds(now_us)) &&
+          options.adapt_bitrate) {
+        const int reduced = reduce_bitrate_on_tx_errors(bitrate_kbits);
+        if (reduced != bitrate_kbits) {
+          bitrate_kbits = reduced;
+          result.bitrate_changes.emplace_back(
+              duration_cast<milliseconds>(microseconds(now_us)), bitrate_kbits);
+        }
+      }
+      next_check_us += RATE_CHECK_INTERVAL_US;
+    }
+  }
+  result.final_bitrate_kbits = bitrate_kbits;
+  return result;
+}
+
+}  // namespace openhd::wb::replay
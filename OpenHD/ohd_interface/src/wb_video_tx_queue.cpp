@@ -0,0 +1,250 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "wb_video_tx_queue.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "openhd_thread_policy.h"
+
+namespace {
+bool is_key_frame(const openhd::FragmentedVideoFrame& frame) {
+  return frame.dirty_frame == nullptr &&
+         (frame.is_idr_frame || frame.has_codec_config);
+}
+// Other frames depend on it
+bool is_reference_frame(const openhd::FragmentedVideoFrame& frame) {
+  return frame.dirty_frame == nullptr && !frame.is_non_reference_frame;
+}
+}  // namespace
+
+std::string openhd::wb::video_drop_reason_to_string(VideoDropReason reason) {
+  switch (reason) {
+    case VideoDropReason::TOO_OLD:
+      return "too_old";
+    case VideoDropReason::QUEUE_FULL:
+      return "queue_full";
+    case VideoDropReason::NON_REFERENCE:
+      return "non_reference";
+    case VideoDropReason::SUPERSEDED:
+      return "superseded";
+    case VideoDropReason::BROKEN_REFERENCE:
+      return "broken_reference";
+  }
+  return "unknown";
+}
+
+uint64_t openhd::wb::VideoTxQueueStats::n_dropped_total() const {
+  uint64_t ret = 0;
+  for (const auto n : n_dropped) ret += n;
+  return ret;
+}
+
+std::string openhd::wb::video_tx_queue_stats_to_string(
+    const VideoTxQueueStats& stats) {
+  std::stringstream ss;
+  ss << "VideoTxQueue[in:" << stats.n_enqueued << " sent:" << stats.n_sent
+     << " queued:" << stats.curr_n_queued << " dropped:";
+  for (int i = 0; i < N_VIDEO_DROP_REASONS; i++) {
+    if (i != 0) ss << "/";
+    ss << video_drop_reason_to_string((VideoDropReason)i) << "="
+       << stats.n_dropped[i];
+  }
+  ss << " age_us min:" << stats.age_min_us << " avg:" << stats.age_avg_us
+     << " max:" << stats.age_max_us << "]";
+  return ss.str();
+}
+
+openhd::wb::VideoTxQueue::VideoTxQueue(VideoTxQueueConfig config,
+                                       TRY_SEND_CB try_send_cb,
+                                       ON_DROP_CB on_drop_cb,
+                                       std::string thread_name)
+    : m_config(config),
+      m_try_send_cb(std::move(try_send_cb)),
+      m_on_drop_cb(std::move(on_drop_cb)),
+      m_thread_name(std::move(thread_name)),
+      m_max_frame_age_us(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              config.max_frame_age)
+              .count()) {
+  m_thread = std::make_unique<std::thread>([this] { loop(); });
+}
+
+openhd::wb::VideoTxQueue::~VideoTxQueue() {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_run = false;
+  }
+  m_cv.notify_all();
+  m_thread->join();
+}
+
+void openhd::wb::VideoTxQueue::set_max_frame_age(
+    std::chrono::milliseconds max_frame_age) {
+  m_max_frame_age_us.store(
+      std::chrono::duration_cast<std::chrono::microseconds>(max_frame_age)
+          .count(),
+      std::memory_order_relaxed);
+}
+
+void openhd::wb::VideoTxQueue::drop(VideoDropReason reason,
+                                    bool is_reference) {
+  m_stats.n_dropped[(int)reason]++;
+  if (is_reference && m_config.drop_broken_references && m_seen_key_frame) {
+    m_broken_reference = true;
+  }
+  if (m_on_drop_cb) m_on_drop_cb(reason);
+}
+
+void openhd::wb::VideoTxQueue::enqueue(openhd::FragmentedVideoFrame frame) {
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_stats.n_enqueued++;
+    if (is_key_frame(frame)) {
+      // Everything before a key frame is not needed anymore
+      for (size_t i = 0; i < m_queue.size(); i++) {
+        drop(VideoDropReason::SUPERSEDED, false);
+      }
+      m_queue.clear();
+      m_in_flight_superseded = true;
+      m_broken_reference = false;
+      m_seen_key_frame = true;
+    } else if (m_broken_reference && !frame.is_intra_stream &&
+               frame.dirty_frame == nullptr) {
+      drop(VideoDropReason::BROKEN_REFERENCE, false);
+      return;
+    } else if ((int)m_queue.size() >= m_config.capacity_frames) {
+      // Prefer dropping the oldest non-reference frame
+      auto non_reference =
+          std::find_if(m_queue.begin(), m_queue.end(),
+                       [](const openhd::FragmentedVideoFrame& queued) {
+                         return queued.is_non_reference_frame;
+                       });
+      if (non_reference != m_queue.end()) {
+        m_queue.erase(non_reference);
+        drop(VideoDropReason::NON_REFERENCE, false);
+      } else if (frame.is_non_reference_frame) {
+        drop(VideoDropReason::NON_REFERENCE, false);
+        return;
+      } else if (frame.is_intra_stream || frame.dirty_frame != nullptr) {
+        // No key frames to wait for - newest wins
+        m_queue.pop_front();
+        drop(VideoDropReason::QUEUE_FULL, false);
+      } else {
+        drop(VideoDropReason::QUEUE_FULL, true);
+        return;
+      }
+    }
+    m_queue.push_back(std::move(frame));
+  }
+  m_cv.notify_one();
+}
+
+openhd::wb::VideoTxQueueStats openhd::wb::VideoTxQueue::get_stats() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  auto ret = m_stats;
+  ret.curr_n_queued = (int)m_queue.size();
+  if (m_age_count > 0) ret.age_avg_us = (int)(m_age_sum_us / m_age_count);
+  m_stats.age_min_us = -1;
+  m_stats.age_max_us = -1;
+  m_age_sum_us = 0;
+  m_age_count = 0;
+  return ret;
+}
+
+int openhd::wb::VideoTxQueue::get_n_queued() {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return (int)m_queue.size();
+}
+
+void openhd::wb::VideoTxQueue::loop() {
+  openhd::thread::set_current_thread(
+      m_thread_name, openhd::thread::ThreadClass::REALTIME_VIDEO_TX);
+  while (true) {
+    openhd::FragmentedVideoFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return !m_run || !m_queue.empty(); });
+      if (!m_run) return;
+      frame = std::move(m_queue.front());
+      m_queue.pop_front();
+      m_in_flight_superseded = false;
+    }
+    const bool is_reference =
+        is_reference_frame(frame) && !frame.is_intra_stream;
+    auto poll_interval = m_config.min_poll_interval;
+    while (true) {
+      const auto age_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - frame.creation_time)
+              .count();
+      const auto max_age_us =
+          m_max_frame_age_us.load(std::memory_order_relaxed);
+      if (frame.is_non_reference_frame &&
+          age_us > max_age_us * m_config.non_reference_max_age_perc / 100) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        drop(VideoDropReason::NON_REFERENCE, false);
+        break;
+      }
+      if (age_us > max_age_us) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        // A key frame that came in meanwhile ends the broken chain
+        drop(VideoDropReason::TOO_OLD,
+             is_reference && !m_in_flight_superseded);
+        break;
+      }
+      if (m_try_send_cb(frame)) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stats.n_sent++;
+        const int age = (int)age_us;
+        m_stats.age_min_us =
+            m_stats.age_min_us < 0 ? age : std::min(m_stats.age_min_us, age);
+        m_stats.age_max_us = std::max(m_stats.age_max_us, age);
+        m_age_sum_us += age;
+        m_age_count++;
+        break;
+      }
+      // Wait (woken up early if the frame is superseded / on shutdown), but
+      // not past the time the frame has to be dropped
+      const auto deadline_us =
+          frame.is_non_reference_frame
+              ? max_age_us * m_config.non_reference_max_age_perc / 100
+              : max_age_us;
+      const auto wait = std::clamp(
+          std::chrono::microseconds(deadline_us - age_us + 1),
+          std::chrono::microseconds(0), poll_interval);
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_for(lock, wait,
+                      [this] { return !m_run || m_in_flight_superseded; });
+        if (!m_run) return;
+        if (m_in_flight_superseded) {
+          drop(VideoDropReason::SUPERSEDED, false);
+          break;
+        }
+      }
+      poll_interval = std::min(poll_interval * 2, m_config.max_poll_interval);
+    }
+  }
+}
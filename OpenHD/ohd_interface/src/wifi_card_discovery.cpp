@@ -29,6 +29,7 @@
 #include <thread>
 
 #include "config_paths.h"
+#include "openhd_hotplug.h"
 #include "openhd_spdlog.h"
 #include "openhd_util.h"
 #include "openhd_util_filesystem.h"
@@ -339,14 +340,17 @@ DWifiCards::ProcessedWifiCards DWifiCards::process_and_evaluate_cards(
 }
 
 static WiFiCard wait_for_card(const std::string& interface_name) {
-  while (true) {
-    auto card = DWifiCards::process_card(interface_name);
-    if (card) {
-      return card.value();
-    }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+  std::optional<WiFiCard> card = std::nullopt;
+  auto has_card = [&card, &interface_name]() {
+    card = DWifiCards::process_card(interface_name);
+    return card.has_value();
+  };
+  // Re-checked whenever a network interface appears / changes
+  while (!openhd::HotplugMonitor::instance().wait_for(
+      has_card, std::chrono::seconds(3))) {
     openhd::log::get_default()->debug("Waiting for {}", interface_name);
   }
+  return card.value();
 }
 
 DWifiCards::ProcessedWifiCards DWifiCards::find_cards_from_manual_file(
@@ -384,7 +388,6 @@ void DWifiCards::main_discover_an_process_wifi_cards(
   const std::string blue = "\033[34m";
   const std::string reset = "\033[0m";
   std::cout << blue << "Waiting for wifi card(s)..." << reset << std::endl;
-  const bool debug = false;
   if (config.WIFI_MONITOR_CARD_EMULATE) {
     m_monitor_mode_cards.push_back(DWifiCards::create_card_monitor_emulate());
     m_opt_hotspot_card = std::nullopt;
@@ -421,41 +424,36 @@ void DWifiCards::main_discover_an_process_wifi_cards(
   // mode unless a (developer) has specified the option to do otherwise (which
   // can be usefully for testing, but is not a behaviour we want when running on
   // a user image)
-  const auto begin = std::chrono::steady_clock::now();
-  while (true) {
+  // Re-scan whenever a network interface appears / changes instead of once
+  // per second
+  bool first_scan = true;
+  auto has_enough_cards = [&connected_cards, &m_profile, &first_scan]() {
+    if (!first_scan) {
+      connected_cards = DWifiCards::discover_connected_wifi_cards();
+    }
+    first_scan = false;
     const auto n_openhd_supported_cards =
         DWifiCards::n_cards_openhd_wifibroadcast_supported(connected_cards);
     // On the air unit, we stop the discovery as soon as we have one wb capable
     // card
     if (m_profile.is_air && n_openhd_supported_cards >= 1) {
-      break;
+      return true;
     }
     // On the ground unit, we stop the discovery as soon as we have 2 or more wb
     // capable card(s), or timeout
     if (m_profile.is_ground() && n_openhd_supported_cards >= 2) {
-      break;
-    }
-    const auto elapsed = std::chrono::steady_clock::now() - begin;
-    if (debug) {
-      const auto message = fmt::format("Waiting for supported WiFi, Found:{}",
-                                       n_openhd_supported_cards);
-      if (elapsed > std::chrono::seconds(3)) {
-        m_console->warn(message);
-      } else {
-        m_console->debug(message);
-      }
+      return true;
     }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    connected_cards = DWifiCards::discover_connected_wifi_cards();
-    // after 10 seconds, we stop - if we didn't find a openhd wifibroadcast
-    // supported card, we are not functional
-    if (elapsed > std::chrono::seconds(10)) {
-      if (DWifiCards::n_cards_openhd_wifibroadcast_supported(connected_cards) <=
-          0) {
-        m_console->warn("No openhd wifibroadcast card found");
-        m_console->warn("Link not functional");
-      }
-      break;
+    return false;
+  };
+  // after 10 seconds, we stop - if we didn't find a openhd wifibroadcast
+  // supported card, we are not functional
+  if (!openhd::HotplugMonitor::instance().wait_for(has_enough_cards,
+                                                   std::chrono::seconds(10))) {
+    if (DWifiCards::n_cards_openhd_wifibroadcast_supported(connected_cards) <=
+        0) {
+      m_console->warn("No openhd wifibroadcast card found");
+      m_console->warn("Link not functional");
     }
   }
   // now decide what to use the card(s) for
@@ -35,8 +35,9 @@ static std::string create_command_wifi_client(const std::string ssid,
                      pw);
 }
 
-static std::shared_ptr<spdlog::logger> get_console() {
-  return openhd::log::create_or_get("WiFiClient");
+static const std::shared_ptr<spdlog::logger>& get_console() {
+  static const auto console = openhd::log::create_or_get("WiFiClient");
+  return console;
 }
 
 bool WiFiClient::create_if_enabled() {
@@ -32,8 +32,9 @@
 #include "openhd_util_filesystem.h"
 #include "wifi_channel.h"
 
-static std::shared_ptr<spdlog::logger> get_logger() {
-  return openhd::log::create_or_get("w_helper");
+static const std::shared_ptr<spdlog::logger>& get_logger() {
+  static const auto console = openhd::log::create_or_get("w_helper");
+  return console;
 }
 
 bool wifi::commandhelper::rfkill_unblock_all() {
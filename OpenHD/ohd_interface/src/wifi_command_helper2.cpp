@@ -38,8 +38,9 @@
 #include <net/if.h>
 #include <sys/ioctl.h>
 
-static std::shared_ptr<spdlog::logger> get_logger() {
-  return openhd::log::create_or_get("w_helper2");
+static const std::shared_ptr<spdlog::logger>& get_logger() {
+  static const auto console = openhd::log::create_or_get("w_helper2");
+  return console;
 }
 
 static int error_handler(struct sockaddr_nl *nla, struct nlmsgerr *err,
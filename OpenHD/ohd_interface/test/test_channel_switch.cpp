@@ -0,0 +1,380 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Coordinated channel switch test: the air and ground protocol
+// (wb_channel_switch.h) with the timing of the wb management threads, over
+// emulated cards - each side is tuned to a channel and a packet is only
+// received if the receiver is on the channel of the sender and not retuning
+// (with an impaired channel in between). The air streams "video" all the time,
+// and the video interruption seen by the ground during the switch is measured.
+// Covers a clean switch, a switch with packet loss, a ground that doesn't get
+// the announce, a one way link on the new channel and no ground at all.
+//
+// Example:
+// test_channel_switch --loss 10 --retune-ms 20
+//
+
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "emulated_link.h"
+#include "wb_channel_switch.h"
+
+using namespace openhd::wb;
+using Clock = std::chrono::steady_clock;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+struct Params {
+  double loss_perc = 10;
+  // Time the card needs for the retune, including the tx drain
+  int retune_ms = 20;
+  int max_interruption_ms = 100;
+};
+
+static constexpr WBChannel CHANNEL_OLD{5745, 20};
+static constexpr WBChannel CHANNEL_NEW{5825, 40};
+
+enum PacketType : uint8_t { VIDEO = 0, BEACON, ANNOUNCE, ACK, STATUS };
+
+// Card of the air / ground unit. While retuning, nothing is sent or received.
+class EmulatedCard {
+ public:
+  explicit EmulatedCard(int retune_ms) : m_retune_time(retune_ms) {}
+  void retune(const WBChannel& channel) {
+    m_retuning = true;
+    std::this_thread::sleep_for(m_retune_time);
+    m_frequency_mhz = channel.frequency_mhz;
+    m_channel_width_mhz = channel.channel_width_mhz;
+    m_retuning = false;
+  }
+  WBChannel get_channel() const {
+    return {m_frequency_mhz.load(), m_channel_width_mhz.load()};
+  }
+  // -1 while retuning
+  int get_frequency() const {
+    return m_retuning ? -1 : m_frequency_mhz.load();
+  }
+
+ private:
+  const std::chrono::milliseconds m_retune_time;
+  std::atomic<int> m_frequency_mhz = CHANNEL_OLD.frequency_mhz;
+  std::atomic<int> m_channel_width_mhz = CHANNEL_OLD.channel_width_mhz;
+  std::atomic<bool> m_retuning = false;
+};
+
+// Return true to drop the packet (e.g. a one way link)
+using DROP_FILTER = std::function<bool(uint8_t type, int sender_frequency)>;
+
+struct Scenario {
+  std::string name;
+  bool ground_connected = true;
+  double loss_perc = 0;
+  DROP_FILTER drop_air_to_ground = nullptr;
+  DROP_FILTER drop_ground_to_air = nullptr;
+};
+
+struct Result {
+  WBChannel air_channel{};
+  WBChannel ground_channel{};
+  ChannelSwitchStats air_stats;
+  ChannelSwitchStats ground_stats;
+  int max_video_gap_ms = 0;
+  // Video received in the last 100ms of the run
+  bool video_flowing = false;
+};
+
+static void send(openhd::emulation::ImpairedChannel& channel,
+                 const EmulatedCard& card, const DROP_FILTER& drop_filter,
+                 uint8_t type, const void* payload, int payload_len) {
+  const int frequency = card.get_frequency();
+  if (frequency < 0) return;
+  if (drop_filter && drop_filter(type, frequency)) return;
+  std::vector<uint8_t> packet(1 + 4 + payload_len);
+  packet[0] = type;
+  std::memcpy(&packet[1], &frequency, 4);
+  if (payload_len > 0) std::memcpy(&packet[5], payload, payload_len);
+  channel.send(packet.data(), packet.size());
+}
+
+// Returns the packet type, or -1 if the card can't receive it
+static int receive(const EmulatedCard& card, const uint8_t* data,
+                   int data_len) {
+  if (data_len < 5) return -1;
+  int frequency;
+  std::memcpy(&frequency, &data[1], 4);
+  if (card.get_frequency() != frequency) return -1;
+  return data[0];
+}
+
+static Result run_scenario(const Params& params, const Scenario& scenario) {
+  EmulatedCard air_card(params.retune_ms);
+  EmulatedCard ground_card(params.retune_ms);
+  ChannelSwitchAir air_switch([&air_card](const WBChannel& channel, bool) {
+    air_card.retune(channel);
+  });
+  ChannelSwitchGround ground_switch(
+      [&ground_card](const WBChannel& channel, bool) {
+        ground_card.retune(channel);
+      });
+  std::mutex ground_wakeup_mutex;
+  std::condition_variable ground_wakeup_cv;
+  bool ground_wakeup = false;
+  std::mutex video_mutex;
+  std::vector<Clock::time_point> video_rx;
+
+  openhd::emulation::ImpairmentParams impairment{};
+  impairment.loss_perc = scenario.loss_perc;
+  impairment.delay = std::chrono::microseconds(1000);
+  openhd::emulation::ImpairedChannel air_to_ground(
+      impairment, [&](const uint8_t* data, int data_len) {
+        const auto now = Clock::now();
+        const int type = receive(ground_card, data, data_len);
+        if (type == VIDEO) {
+          std::lock_guard<std::mutex> lock(video_mutex);
+          video_rx.push_back(now);
+        } else if (type == BEACON) {
+          ground_switch.on_packet_from_air(now);
+        } else if (type == ANNOUNCE &&
+                   data_len == 5 + sizeof(ChannelSwitchAnnounce)) {
+          ChannelSwitchAnnounce announce{};
+          std::memcpy(&announce, &data[5], sizeof(announce));
+          ground_switch.on_announce(announce, now);
+          {
+            std::lock_guard<std::mutex> lock(ground_wakeup_mutex);
+            ground_wakeup = true;
+          }
+          ground_wakeup_cv.notify_one();
+        }
+      });
+  impairment.seed = 2;
+  openhd::emulation::ImpairedChannel ground_to_air(
+      impairment, [&](const uint8_t* data, int data_len) {
+        const auto now = Clock::now();
+        const int type = receive(air_card, data, data_len);
+        if (type == STATUS) {
+          air_switch.on_packet_from_ground(now);
+        } else if (type == ACK && data_len == 5 + sizeof(ChannelSwitchAck)) {
+          ChannelSwitchAck ack{};
+          std::memcpy(&ack, &data[5], sizeof(ack));
+          air_switch.on_ack(ack, now);
+        }
+      });
+
+  std::atomic<bool> keep_running = true;
+  // ~500 packets per second of video
+  std::thread air_video([&] {
+    while (keep_running) {
+      send(air_to_ground, air_card, scenario.drop_air_to_ground, VIDEO,
+           nullptr, 0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+  });
+  // Like ManagementAir::loop (during a change)
+  std::thread air_management([&] {
+    while (keep_running) {
+      const auto announce = air_switch.update(Clock::now());
+      send(air_to_ground, air_card, scenario.drop_air_to_ground, BEACON,
+           nullptr, 0);
+      if (announce.has_value()) {
+        send(air_to_ground, air_card, scenario.drop_air_to_ground, ANNOUNCE,
+             &announce.value(), sizeof(ChannelSwitchAnnounce));
+      }
+      std::this_thread::sleep_until(
+          std::min(Clock::now() + std::chrono::milliseconds(20),
+                   air_switch.get_next_deadline()));
+    }
+  });
+  // Like ManagementGround::loop
+  std::thread ground_management([&] {
+    auto last_status = Clock::time_point{};
+    while (keep_running) {
+      const auto ack = ground_switch.update(Clock::now());
+      if (ack.has_value()) {
+        send(ground_to_air, ground_card, scenario.drop_ground_to_air, ACK,
+             &ack.value(), sizeof(ChannelSwitchAck));
+      }
+      const auto now = Clock::now();
+      if (now - last_status >= std::chrono::milliseconds(100)) {
+        send(ground_to_air, ground_card, scenario.drop_ground_to_air, STATUS,
+             nullptr, 0);
+        last_status = now;
+      }
+      auto wakeup_tp = last_status + std::chrono::milliseconds(100);
+      if (ground_switch.is_in_progress()) {
+        wakeup_tp = std::min(wakeup_tp, now + std::chrono::milliseconds(20));
+      }
+      wakeup_tp = std::min(wakeup_tp, ground_switch.get_next_deadline());
+      std::unique_lock<std::mutex> lock(ground_wakeup_mutex);
+      ground_wakeup_cv.wait_until(lock, wakeup_tp,
+                                  [&] { return ground_wakeup; });
+      ground_wakeup = false;
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  const auto switch_requested = Clock::now();
+  // Called from the wb_link worker thread in OpenHD
+  check(air_switch.request_switch(CHANNEL_OLD, CHANNEL_NEW,
+                                  scenario.ground_connected, Clock::now()),
+        "request switch");
+  if (scenario.ground_connected) {
+    check(!air_switch.request_switch(CHANNEL_OLD, CHANNEL_NEW, true,
+                                     Clock::now()),
+          "reject second switch");
+  }
+  while ((air_switch.is_in_progress() || ground_switch.is_in_progress()) &&
+         Clock::now() - switch_requested < std::chrono::seconds(10)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  keep_running = false;
+  air_video.join();
+  air_management.join();
+  {
+    std::lock_guard<std::mutex> lock(ground_wakeup_mutex);
+    ground_wakeup = true;
+  }
+  ground_wakeup_cv.notify_one();
+  ground_management.join();
+
+  Result result{};
+  result.air_channel = air_card.get_channel();
+  result.ground_channel = ground_card.get_channel();
+  result.air_stats = air_switch.get_stats();
+  result.ground_stats = ground_switch.get_stats();
+  std::lock_guard<std::mutex> lock(video_mutex);
+  auto last = switch_requested;
+  for (const auto& tp : video_rx) {
+    if (tp < switch_requested) continue;
+    const auto gap =
+        std::chrono::duration_cast<std::chrono::milliseconds>(tp - last);
+    result.max_video_gap_ms =
+        std::max(result.max_video_gap_ms, static_cast<int>(gap.count()));
+    last = tp;
+  }
+  result.video_flowing =
+      !video_rx.empty() &&
+      Clock::now() - video_rx.back() < std::chrono::milliseconds(100);
+  std::cout << scenario.name << ": air " << result.air_channel.frequency_mhz
+            << "Mhz ground " << result.ground_channel.frequency_mhz
+            << "Mhz, max video gap " << result.max_video_gap_ms << "ms\n"
+            << "  air    " << channel_switch_stats_as_string(result.air_stats)
+            << "\n  ground "
+            << channel_switch_stats_as_string(result.ground_stats) << "\n";
+  return result;
+}
+
+static void test_clean_switch(const Params& params, double loss_perc) {
+  Scenario scenario{};
+  scenario.name = loss_perc > 0 ? "Switch with loss" : "Clean switch";
+  scenario.loss_perc = loss_perc;
+  const auto result = run_scenario(params, scenario);
+  check(result.air_channel == CHANNEL_NEW, "air on new channel");
+  check(result.ground_channel == CHANNEL_NEW, "ground on new channel");
+  check(result.air_stats.n_switches == 1 && result.air_stats.n_fallbacks == 0,
+        "air switched");
+  check(result.ground_stats.n_switches == 1 &&
+            result.ground_stats.n_fallbacks == 0,
+        "ground switched");
+  check(result.video_flowing, "video after switch");
+#ifdef NDEBUG
+  check(result.max_video_gap_ms < params.max_interruption_ms,
+        "video interruption " + std::to_string(result.max_video_gap_ms) +
+            "ms");
+#endif
+}
+
+static void test_announce_lost(const Params& params) {
+  Scenario scenario{};
+  scenario.name = "Announce lost";
+  scenario.drop_air_to_ground = [](uint8_t type, int) {
+    return type == ANNOUNCE;
+  };
+  const auto result = run_scenario(params, scenario);
+  // Air postpones, switches anyways, doesn't hear the ground and falls back
+  check(result.air_channel == CHANNEL_OLD, "air back on old channel");
+  check(result.ground_channel == CHANNEL_OLD, "ground stayed on old channel");
+  check(result.air_stats.n_postponed ==
+            ChannelSwitchConfig{}.max_announce_attempts - 1,
+        "air postponed");
+  check(result.air_stats.n_fallbacks == 1, "air fell back");
+  check(result.video_flowing, "video after fallback");
+}
+
+static void test_one_way_link(const Params& params) {
+  Scenario scenario{};
+  scenario.name = "One way link on new channel";
+  scenario.drop_ground_to_air = [](uint8_t, int sender_frequency) {
+    return sender_frequency == CHANNEL_NEW.frequency_mhz;
+  };
+  const auto result = run_scenario(params, scenario);
+  // Air doesn't hear the ground on the new channel and falls back, then the
+  // ground doesn't hear the air anymore and falls back, too.
+  check(result.air_channel == CHANNEL_OLD, "air back on old channel");
+  check(result.ground_channel == CHANNEL_OLD, "ground back on old channel");
+  check(result.air_stats.n_fallbacks == 1, "air fell back");
+  check(result.ground_stats.n_fallbacks == 1, "ground fell back");
+  check(result.video_flowing, "video after fallback");
+}
+
+static void test_no_ground(const Params& params) {
+  Scenario scenario{};
+  scenario.name = "No ground";
+  scenario.ground_connected = false;
+  const auto result = run_scenario(params, scenario);
+  check(result.air_channel == CHANNEL_NEW, "air on new channel");
+  check(result.air_stats.n_uncoordinated == 1, "air switched right away");
+  check(result.ground_channel == CHANNEL_OLD, "ground didn't switch");
+}
+
+int main(int argc, char* argv[]) {
+  Params params{};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const std::string value = argv[i + 1];
+    if (arg == "--loss") {
+      params.loss_perc = std::stod(value);
+    } else if (arg == "--retune-ms") {
+      params.retune_ms = std::stoi(value);
+    } else if (arg == "--max-interruption-ms") {
+      params.max_interruption_ms = std::stoi(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n";
+      return 1;
+    }
+  }
+  test_clean_switch(params, 0);
+  test_clean_switch(params, params.loss_perc);
+  test_announce_lost(params);
+  test_one_way_link(params);
+  test_no_ground(params);
+  std::cout << "Done\n";
+  return 0;
+}
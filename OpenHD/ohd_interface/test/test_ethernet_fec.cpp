@@ -0,0 +1,344 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the ethernet link FEC: the erasure code itself, encoder + decoder with
+// simulated loss and reordering and finally over loopback UDP with a shim that
+// drops packets.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+
+#include "ethernet_fec.h"
+#include "openhd_udp.h"
+
+using namespace openhd::ethernet;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static std::mt19937 rng(1234);
+
+// Fragment with a small header we can identify it with
+static std::shared_ptr<std::vector<uint8_t>> create_fragment(uint32_t frame_idx,
+                                                             uint16_t idx,
+                                                             int size) {
+  auto ret = std::make_shared<std::vector<uint8_t>>(std::max(size, 8));
+  std::memcpy(ret->data(), &frame_idx, 4);
+  std::memcpy(ret->data() + 4, &idx, 2);
+  for (int i = 8; i < size; i++) (*ret)[i] = (uint8_t)(rng() & 0xFF);
+  return ret;
+}
+
+static std::vector<std::shared_ptr<std::vector<uint8_t>>> create_frame(
+    uint32_t frame_idx, int n_fragments) {
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> ret;
+  for (int i = 0; i < n_fragments; i++) {
+    // Last fragment of a frame is usually smaller
+    const int size = i == n_fragments - 1 ? 100 + rng() % 1300 : 1400;
+    ret.push_back(create_fragment(frame_idx, i, size));
+  }
+  return ret;
+}
+
+static void test_code() {
+  for (int run = 0; run < 200; run++) {
+    const int k = 1 + rng() % 100;
+    const int m = 1 + rng() % 30;
+    const std::size_t size = 1 + rng() % 1500;
+    std::vector<std::vector<uint8_t>> data(k + m, std::vector<uint8_t>(size));
+    for (int i = 0; i < k; i++) {
+      for (auto& b : data[i]) b = rng() & 0xFF;
+    }
+    std::vector<const uint8_t*> primaries;
+    for (int i = 0; i < k; i++) primaries.push_back(data[i].data());
+    std::vector<uint8_t*> secondaries;
+    for (int i = 0; i < m; i++) secondaries.push_back(data[k + i].data());
+    FECCode::encode(primaries, secondaries, size);
+    // Drop up to m random fragments
+    auto received = data;
+    std::vector<uint8_t*> fragments;
+    for (auto& fragment : received) fragments.push_back(fragment.data());
+    std::vector<int> indices(k + m);
+    for (int i = 0; i < k + m; i++) indices[i] = i;
+    std::shuffle(indices.begin(), indices.end(), rng);
+    const int n_lost = rng() % (m + 1);
+    for (int i = 0; i < n_lost; i++) fragments[indices[i]] = nullptr;
+    check(FECCode::decode(fragments, k, size), "decode");
+    for (int i = 0; i < k; i++) {
+      check(std::memcmp(fragments[i], data[i].data(), size) == 0, "recovered");
+    }
+    // One too many lost
+    if (k + m > m + 1) {
+      for (auto& fragment : received) fragment = {};
+      std::vector<uint8_t*> too_few(k + m, nullptr);
+      int n_valid = 0;
+      for (int i = 0; i < k + m && n_valid < k - 1; i++) {
+        received[indices[i]] = data[indices[i]];
+        too_few[indices[i]] = received[indices[i]].data();
+        n_valid++;
+      }
+      const bool any_primary_missing =
+          std::any_of(too_few.begin(), too_few.begin() + k,
+                      [](uint8_t* p) { return p == nullptr; });
+      if (any_primary_missing) {
+        check(!FECCode::decode(too_few, k, size), "not enough fragments");
+      }
+    }
+  }
+  std::cout << "Code OK" << std::endl;
+}
+
+struct Result {
+  int n_frames = 0;
+  int n_frames_complete = 0;
+  FECDecoder::Stats stats;
+};
+
+// Runs n_frames through encoder -> (loss, reorder) -> decoder
+static Result simulate(int fec_percentage, double loss, bool reorder,
+                       int n_frames) {
+  FECEncoder encoder(fec_percentage);
+  std::map<uint32_t, std::set<uint16_t>> received;
+  std::map<uint32_t, std::map<uint16_t, std::vector<uint8_t>>> sent;
+  FECDecoder decoder([&](const uint8_t* data, int data_len) {
+    uint32_t frame_idx;
+    uint16_t idx;
+    std::memcpy(&frame_idx, data, 4);
+    std::memcpy(&idx, data + 4, 2);
+    if (frame_idx >= (uint32_t)n_frames) return;  // flush
+    const auto& original = sent[frame_idx][idx];
+    check(original.size() == (std::size_t)data_len &&
+              std::memcmp(original.data(), data, data_len) == 0,
+          "content");
+    check(received[frame_idx].insert(idx).second, "no duplicates");
+  });
+  std::bernoulli_distribution lost(loss);
+  Result result{};
+  std::vector<int> frame_sizes(n_frames);
+  for (int frame = 0; frame < n_frames; frame++) {
+    // Every 30th frame is big (key frame)
+    const int n_fragments = frame % 30 == 0 ? 150 : 2 + rng() % 20;
+    frame_sizes[frame] = n_fragments;
+    const auto fragments = create_frame(frame, n_fragments);
+    for (int i = 0; i < n_fragments; i++) sent[frame][i] = *fragments[i];
+    auto packets = encoder.encode_frame(fragments);
+    if (reorder) {
+      // Swap some neighbours
+      for (std::size_t i = 1; i < packets.size(); i++) {
+        if (rng() % 10 == 0) std::swap(packets[i - 1], packets[i]);
+      }
+    }
+    for (const auto& packet : packets) {
+      if (lost(rng)) continue;
+      decoder.process_packet(packet->data(), packet->size());
+    }
+  }
+  // Flush the last blocks
+  for (int i = 0; i < 20; i++) {
+    const auto packets = encoder.encode_frame(create_frame(n_frames, 1));
+    for (const auto& packet : packets) {
+      decoder.process_packet(packet->data(), packet->size());
+    }
+  }
+  for (int frame = 0; frame < n_frames; frame++) {
+    result.n_frames++;
+    if ((int)received[frame].size() == frame_sizes[frame]) {
+      result.n_frames_complete++;
+    }
+  }
+  result.stats = decoder.get_stats();
+  return result;
+}
+
+static void test_simulated_loss() {
+  // No loss, no fec - everything needs to arrive
+  {
+    const auto result = simulate(0, 0, false, 300);
+    check(result.n_frames_complete == result.n_frames, "lossless");
+    check(result.stats.count_blocks_lost == 0, "lossless blocks");
+  }
+  // Reordering only
+  {
+    const auto result = simulate(20, 0, true, 300);
+    check(result.n_frames_complete == result.n_frames, "reorder");
+  }
+  std::cout << "Loss  FEC  frames complete  blocks total/lost/recovered"
+            << std::endl;
+  for (const double loss : {0.01, 0.02, 0.05}) {
+    for (const int fec : {0, 20, 50}) {
+      const auto result = simulate(fec, loss, true, 1000);
+      std::cout << loss * 100 << "%    " << fec << "%   "
+                << result.n_frames_complete << "/" << result.n_frames << "  "
+                << result.stats.count_blocks_total << "/"
+                << result.stats.count_blocks_lost << "/"
+                << result.stats.count_blocks_recovered << std::endl;
+      if (fec == 50) {
+        check(result.n_frames_complete >= result.n_frames * 0.97,
+              "fec 50% recovers");
+      }
+      if (fec > 0) {
+        check(result.stats.count_blocks_recovered > 0, "recovered blocks");
+      }
+    }
+  }
+}
+
+// The TX restarts (block index back to 0) while the receiver is still at a
+// low block index - everything after the restart has to arrive
+static void test_restart() {
+  std::set<uint32_t> received;
+  FECDecoder decoder([&](const uint8_t* data, int data_len) {
+    uint32_t frame_idx;
+    std::memcpy(&frame_idx, data, 4);
+    received.insert(frame_idx);
+  });
+  auto send = [&decoder](FECEncoder& encoder, uint32_t frame_idx) {
+    const auto packets = encoder.encode_frame(create_frame(frame_idx, 1));
+    for (const auto& packet : packets) {
+      decoder.process_packet(packet->data(), packet->size());
+    }
+  };
+  {
+    FECEncoder before(20);
+    for (uint32_t frame = 0; frame < 500; frame++) send(before, frame);
+  }
+  FECEncoder after(20);
+  for (uint32_t frame = 1000; frame < 1050; frame++) send(after, frame);
+  const auto n_after = std::count_if(received.begin(), received.end(),
+                                     [](uint32_t idx) { return idx >= 1000; });
+  check(n_after == 50, "frames after restart");
+  std::cout << "Restart OK" << std::endl;
+}
+
+// Sender -> shim (drops packets) -> receiver, all on localhost
+static void test_loopback(double loss, int fec_percentage) {
+  static int port_offset = 0;
+  const int shim_port = 17100 + port_offset;
+  const int rx_port = 17101 + port_offset;
+  port_offset += 2;
+  std::bernoulli_distribution lost(loss);
+  std::mt19937 shim_rng(5678);
+  openhd::UDPForwarder shim_out(openhd::ADDRESS_LOCALHOST, rx_port);
+  openhd::UDPReceiver shim(openhd::ADDRESS_LOCALHOST, shim_port,
+                           [&](const uint8_t* data, std::size_t len) {
+                             if (lost(shim_rng)) return;
+                             shim_out.forwardPacketViaUDP(data, len);
+                           });
+  std::mutex mutex;
+  std::map<uint32_t, std::set<uint16_t>> received;
+  FECDecoder decoder([&](const uint8_t* data, int data_len) {
+    uint32_t frame_idx;
+    uint16_t idx;
+    std::memcpy(&frame_idx, data, 4);
+    std::memcpy(&idx, data + 4, 2);
+    std::lock_guard<std::mutex> lock(mutex);
+    received[frame_idx].insert(idx);
+  });
+  openhd::UDPReceiver rx(openhd::ADDRESS_LOCALHOST, rx_port,
+                         [&](const uint8_t* data, std::size_t len) {
+                           decoder.process_packet(data, len);
+                         });
+  shim.runInBackground();
+  rx.runInBackground();
+  openhd::UDPForwarder tx(openhd::ADDRESS_LOCALHOST, shim_port);
+  FECEncoder encoder(fec_percentage);
+  static constexpr int N_FRAMES = 500;
+  static constexpr int N_FRAGMENTS = 10;
+  for (int frame = 0; frame < N_FRAMES + 20; frame++) {
+    tx.forwardPacketsViaUDP(
+        encoder.encode_frame(create_frame(frame, N_FRAGMENTS)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  rx.stopBackground();
+  shim.stopBackground();
+  int n_complete = 0;
+  for (int frame = 0; frame < N_FRAMES; frame++) {
+    if ((int)received[frame].size() == N_FRAGMENTS) n_complete++;
+  }
+  const auto stats = decoder.get_stats();
+  std::cout << "Loopback loss:" << loss * 100 << "% FEC:" << fec_percentage
+            << "% frames complete:" << n_complete << "/" << N_FRAMES
+            << " blocks recovered:" << stats.count_blocks_recovered
+            << " lost:" << stats.count_blocks_lost << std::endl;
+  if (loss == 0) {
+    check(n_complete == N_FRAMES, "loopback lossless");
+  } else if (fec_percentage >= 50) {
+    check(n_complete >= N_FRAMES * 0.95, "loopback fec");
+  }
+}
+
+// sendto per packet vs one sendmmsg per frame
+static void benchmark_send() {
+  openhd::UDPReceiver sink(openhd::ADDRESS_LOCALHOST, 17199,
+                           [](const uint8_t*, std::size_t) {});
+  sink.runInBackground();
+  openhd::UDPForwarder tx(openhd::ADDRESS_LOCALHOST, 17199);
+  const auto frame = create_frame(0, 20);
+  static constexpr int N_FRAMES = 5000;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_FRAMES; i++) {
+    for (const auto& fragment : frame) {
+      tx.forwardPacketViaUDP(fragment->data(), fragment->size());
+    }
+  }
+  const auto sendto_duration = std::chrono::steady_clock::now() - begin;
+  begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < N_FRAMES; i++) {
+    tx.forwardPacketsViaUDP(frame);
+  }
+  const auto sendmmsg_duration = std::chrono::steady_clock::now() - begin;
+  sink.stopBackground();
+  std::cout << "Per frame (20 fragments): sendto "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   sendto_duration)
+                       .count() /
+                   N_FRAMES / 1000.0
+            << "us, sendmmsg "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   sendmmsg_duration)
+                       .count() /
+                   N_FRAMES / 1000.0
+            << "us" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  test_code();
+  test_simulated_loss();
+  test_restart();
+  test_loopback(0, 0);
+  test_loopback(0.05, 0);
+  test_loopback(0.05, 50);
+  benchmark_send();
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,313 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Unequal error protection test: the FEC policy (wb_fec_policy.h) against the
+// same FEC percentage for every frame, at the same total airtime.
+// Simulates a 30fps stream (key frame every 15 frames, P-frames with varying
+// size, some scene changes) in virtual time over random and Gilbert-Elliott
+// (bursts of loss, as with interference / fading) loss traces, with the
+// packets of each frame sent back to back. A frame can be recovered if not
+// more packets are lost than there are FEC packets. Without intra refresh, a
+// lost frame freezes the video until the next key frame is received - the
+// time the video is frozen is compared.
+//
+// Example:
+// test_fec_policy --budget 20 --seconds 600
+//
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "wb_fec_policy.h"
+
+using namespace openhd::wb;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+struct Params {
+  int budget_perc = 20;
+  int n_seconds = 600;
+};
+
+static constexpr int FPS = 30;
+static constexpr int GOP_SIZE = 15;
+static constexpr int PACKET_SIZE = 1024;
+// Airtime of one packet is 0.2ms (~40MBit/s), 166 packets per frame interval
+static constexpr int SLOTS_PER_FRAME = 5000 / FPS;
+
+struct Frame {
+  bool is_key_frame;
+  int n_packets;
+};
+
+static std::vector<Frame> create_stream(int n_frames, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::lognormal_distribution<double> delta_size(std::log(8.0), 0.35);
+  std::uniform_int_distribution<int> scene_change(0, 99);
+  std::vector<Frame> ret;
+  for (int i = 0; i < n_frames; i++) {
+    if (i % GOP_SIZE == 0) {
+      ret.push_back({true, 40});
+    } else if (scene_change(rng) == 0) {
+      ret.push_back({false, 30});
+    } else {
+      ret.push_back({false, std::max(1, (int)std::lround(delta_size(rng)))});
+    }
+  }
+  return ret;
+}
+
+// Gilbert-Elliott channel
+struct LossTrace {
+  std::string name;
+  // Probability (per packet airtime) of going good -> bad / bad -> good
+  double p_good_to_bad;
+  double p_bad_to_good;
+  // Packet loss in good / bad state
+  double loss_good;
+  double loss_bad;
+};
+
+// The channel state / loss is evaluated once per packet airtime slot, with the
+// same random numbers for each policy such that both see the same channel.
+// The packets of a frame are sent back to back at link rate, starting at the
+// frame's time point (or once the previous frame is out).
+class Channel {
+ public:
+  Channel(const LossTrace& trace, int n_frames, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    bool bad = false;
+    // Enough for the stream at full link usage
+    const int n_slots = (n_frames + 1) * SLOTS_PER_FRAME;
+    m_slot_lost.reserve(n_slots);
+    for (int i = 0; i < n_slots; i++) {
+      const double p = bad ? trace.p_bad_to_good : trace.p_good_to_bad;
+      if (uniform(rng) < p) bad = !bad;
+      const double loss = bad ? trace.loss_bad : trace.loss_good;
+      m_slot_lost.push_back(uniform(rng) < loss);
+    }
+  }
+  // Returns the number of lost packets
+  int send_frame(int frame_idx, int n_packets) {
+    m_next_slot = std::max(m_next_slot, frame_idx * SLOTS_PER_FRAME);
+    int n_lost = 0;
+    for (int i = 0; i < n_packets; i++) {
+      if (m_slot_lost[m_next_slot % m_slot_lost.size()]) n_lost++;
+      m_next_slot++;
+    }
+    return n_lost;
+  }
+
+ private:
+  std::vector<bool> m_slot_lost;
+  int m_next_slot = 0;
+};
+
+struct Result {
+  int n_packets_sent = 0;
+  int n_frozen_frames = 0;
+  int n_lost_key_frames = 0;
+  int n_lost_delta_frames = 0;
+};
+
+// fec_policy == nullptr: same budget_perc for all frames
+static Result simulate(const std::vector<Frame>& stream, Channel& channel,
+                       int budget_perc, FecPolicy* fec_policy) {
+  Result result{};
+  bool frozen = false;
+  int n_sent_last_second = 0;
+  int n_lost_last_second = 0;
+  for (int i = 0; i < (int)stream.size(); i++) {
+    const auto& frame = stream[i];
+    int perc = budget_perc;
+    if (fec_policy) {
+      perc = fec_policy->get_fec_percentage(
+          frame.is_key_frame ? FecFrameType::KEY_FRAME
+                             : FecFrameType::DELTA_FRAME,
+          frame.n_packets * PACKET_SIZE, frame.n_packets);
+    }
+    const int n_secondary = (frame.n_packets * perc + 99) / 100;
+    const int n_total = frame.n_packets + n_secondary;
+    const int n_lost = channel.send_frame(i, n_total);
+    result.n_packets_sent += n_total;
+    n_sent_last_second += n_total;
+    n_lost_last_second += n_lost;
+    const bool recovered = n_lost <= n_secondary;
+    if (!recovered) {
+      if (frame.is_key_frame) {
+        result.n_lost_key_frames++;
+      } else {
+        result.n_lost_delta_frames++;
+      }
+      frozen = true;
+    } else if (frame.is_key_frame) {
+      frozen = false;
+    }
+    if (frozen) result.n_frozen_frames++;
+    if ((i + 1) % FPS == 0) {
+      // Like on the air unit, the link loss is known once per second
+      if (fec_policy) {
+        fec_policy->set_link_loss_perc(n_lost_last_second * 100 /
+                                       std::max(n_sent_last_second, 1));
+      }
+      n_sent_last_second = 0;
+      n_lost_last_second = 0;
+    }
+  }
+  return result;
+}
+
+static void test_budget_split() {
+  // Key frames the same size as P-frames, to see the effect of the frame type
+  // and GOP position alone
+  FecPolicy policy(20);
+  policy.set_link_loss_perc(5);
+  int sum_perc_first = 0;
+  int sum_perc_last = 0;
+  for (int i = 0; i < 3000; i++) {
+    const int gop_position = i % GOP_SIZE;
+    const int perc = policy.get_fec_percentage(
+        gop_position == 0 ? FecFrameType::KEY_FRAME : FecFrameType::DELTA_FRAME,
+        20 * PACKET_SIZE, 20);
+    if (i < 1500) continue;
+    if (gop_position == 1) sum_perc_first += perc;
+    if (gop_position == GOP_SIZE - 1) sum_perc_last += perc;
+  }
+  const auto stats = policy.get_stats();
+  std::cout << fec_policy_stats_as_string(stats) << "\n";
+  check(std::abs(stats.avg_gop_size - GOP_SIZE) < 1, "gop size");
+  check(std::abs(stats.avg_overhead_perc - 20) <= 1.5, "budget kept");
+  check(stats.key_frame_fec_perc > stats.delta_frame_fec_perc,
+        "key frames get more");
+  check(sum_perc_first > sum_perc_last, "early P-frames get more");
+  check(policy.get_overhead_for_rate_control_perc() == 20,
+        "rate control uses the budget");
+  // High loss - frames need more than the budget allows
+  policy.set_link_loss_perc(20);
+  for (int i = 0; i < 600; i++) {
+    policy.get_fec_percentage(FecFrameType::DELTA_FRAME, 8 * PACKET_SIZE, 8);
+  }
+  std::cout << fec_policy_stats_as_string(policy.get_stats()) << "\n";
+  check(policy.get_stats().delta_frame_fec_perc >= 30,
+        "P-frames follow the loss");
+  const int rate_control_perc = policy.get_overhead_for_rate_control_perc();
+  check(rate_control_perc >= 30 && rate_control_perc % 5 == 0,
+        "rate control sees the higher overhead");
+}
+
+static void test_classify() {
+  openhd::FragmentedVideoFrame frame{};
+  check(classify_frame_for_fec(frame) == FecFrameType::DELTA_FRAME, "P-frame");
+  frame.is_idr_frame = true;
+  check(classify_frame_for_fec(frame) == FecFrameType::KEY_FRAME, "IDR");
+  frame.is_idr_frame = false;
+  frame.has_codec_config = true;
+  check(classify_frame_for_fec(frame) == FecFrameType::KEY_FRAME, "config");
+}
+
+static void test_loss_traces(const Params& params) {
+  const int n_frames = params.n_seconds * FPS;
+  const auto stream = create_stream(n_frames, 1);
+  const std::vector<LossTrace> traces = {
+      {"random 2%", 0, 1, 0.02, 0.02},
+      {"random 5%", 0, 1, 0.05, 0.05},
+      // ~1ms bursts, 0.5% of the time
+      {"short bursts", 0.001, 0.2, 0.002, 0.9},
+      // ~5ms bursts, 0.5% of the time
+      {"long bursts", 0.0002, 0.04, 0.002, 0.9},
+      // ~50ms of 20% loss, 5% of the time
+      {"fading", 0.0002, 0.004, 0.002, 0.2},
+  };
+  int total_frozen_uniform = 0;
+  int total_frozen_policy = 0;
+  std::cout << std::fixed << std::setprecision(1);
+  for (int i = 0; i < (int)traces.size(); i++) {
+    const auto& trace = traces[i];
+    Channel uniform_channel(trace, n_frames, 100 + i);
+    const auto uniform =
+        simulate(stream, uniform_channel, params.budget_perc, nullptr);
+    // With n_secondary rounded up, the same percentage for all frames uses
+    // more than the budget - give the policy the same airtime
+    const int n_primary = std::accumulate(
+        stream.begin(), stream.end(), 0,
+        [](int sum, const Frame& frame) { return sum + frame.n_packets; });
+    const int same_airtime_perc =
+        (uniform.n_packets_sent - n_primary) * 100 / n_primary;
+    FecPolicy policy(same_airtime_perc);
+    Channel policy_channel(trace, n_frames, 100 + i);
+    const auto unequal = simulate(stream, policy_channel, 0, &policy);
+    std::cout << trace.name << ": uniform " << params.budget_perc
+              << "% frozen:" << (float)uniform.n_frozen_frames / FPS
+              << "s lost key/P:" << uniform.n_lost_key_frames << "/"
+              << uniform.n_lost_delta_frames
+              << " packets:" << uniform.n_packets_sent
+              << " | policy frozen:" << (float)unequal.n_frozen_frames / FPS
+              << "s lost key/P:" << unequal.n_lost_key_frames << "/"
+              << unequal.n_lost_delta_frames
+              << " packets:" << unequal.n_packets_sent << "\n";
+    std::cout << "  " << fec_policy_stats_as_string(policy.get_stats())
+              << "\n";
+    total_frozen_uniform += uniform.n_frozen_frames;
+    total_frozen_policy += unequal.n_frozen_frames;
+    // The loss floor may spend more than the budget, but not with low loss
+    if (trace.loss_good < 0.05) {
+      check(std::abs(unequal.n_packets_sent - uniform.n_packets_sent) <=
+                uniform.n_packets_sent * 3 / 100,
+            trace.name + " same airtime");
+    }
+  }
+  std::cout << "Frozen video uniform:" << (float)total_frozen_uniform / FPS
+            << "s policy:" << (float)total_frozen_policy / FPS << "s\n";
+  check(total_frozen_policy < total_frozen_uniform,
+        "less frozen video with unequal error protection");
+}
+
+int main(int argc, char* argv[]) {
+  Params params{};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const std::string value = argv[i + 1];
+    if (arg == "--budget") {
+      params.budget_perc = std::stoi(value);
+    } else if (arg == "--seconds") {
+      params.n_seconds = std::stoi(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n";
+      return 1;
+    }
+  }
+  test_classify();
+  test_budget_split();
+  test_loss_traces(params);
+  std::cout << "Done\n";
+  return 0;
+}
@@ -0,0 +1,413 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// End to end link benchmark: runs an air and a ground link in one process,
+// feeds synthetic frames (configurable bitrate / fps / GOP) into the air link
+// and measures what comes out on the ground.
+// Output: one JSON object per configuration (frame latency p50/p99, frame
+// loss, cpu time per Mbit), such that it can be tracked per commit.
+//
+// Backends:
+// emulated (default): EmulatedLink, packets go through an impaired channel
+//   (loss / reorder / delay / jitter, rate limit derived from the MCS index).
+// wb: Two WBLink instances with the emulated wifi card - runs the real
+//   wifibroadcast stack (FEC, encryption), impairment options don't apply.
+//
+// Example:
+// test_link_benchmark --mcs 1,3,5 --fec 0,20,50 --loss 2 --duration 3
+//   --out bench.jsonl
+//
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "emulated_link.h"
+#include "openhd_spdlog_include.h"
+#include "wb_link.h"
+#include "wifi_card_discovery.h"
+
+using namespace openhd::emulation;
+
+struct BenchmarkParams {
+  std::string backend = "emulated";
+  std::vector<int> mcs_indices = {1, 3, 5};
+  std::vector<int> fec_percentages = {0, 20, 50};
+  int bitrate_kbits = 8000;
+  int fps = 60;
+  int gop = 30;
+  // I-frame size relative to a P-frame
+  int idr_size_factor = 5;
+  double loss_perc = 2;
+  double reorder_perc = 1;
+  double delay_ms = 2;
+  double jitter_ms = 1;
+  double duration_s = 2;
+  std::string out_file;
+};
+
+struct BenchmarkResult {
+  int mcs = 0;
+  int fec = 0;
+  int frames_sent = 0;
+  int frames_complete = 0;
+  double latency_p50_ms = 0;
+  double latency_p99_ms = 0;
+  double latency_max_ms = 0;
+  double delivered_mbit = 0;
+  double cpu_ms_per_mbit = 0;
+  uint32_t fec_blocks_recovered = 0;
+  uint32_t fec_blocks_lost = 0;
+};
+
+// Prefixed to each fragment, such that the ground can reassemble the frames
+struct BenchFragmentHeader {
+  uint32_t magic;
+  uint32_t frame_idx;
+  uint16_t fragment_idx;
+  uint16_t n_fragments;
+  int64_t creation_ns;
+} __attribute__((packed));
+static constexpr uint32_t BENCH_MAGIC = 0x0BE4C400;
+static constexpr int FRAGMENT_SIZE = 1440;
+
+// ~ usable rate of 802.11n 20MHz long GI, single stream
+static int mcs_to_rate_kbits(int mcs) {
+  static const int PHY_RATES_KBITS[] = {6500,  13000, 19500, 26000,
+                                        39000, 52000, 58500, 65000};
+  return PHY_RATES_KBITS[std::clamp(mcs, 0, 7)] * 7 / 10;
+}
+
+class SyntheticEncoder {
+ public:
+  explicit SyntheticEncoder(const BenchmarkParams& params) : m_params(params) {
+    // Keep the average bitrate: (gop-1) P + 1 I frames per GOP
+    const double bytes_per_gop =
+        (double)params.bitrate_kbits * 1000 / 8 * params.gop / params.fps;
+    m_p_frame_size =
+        (int)(bytes_per_gop / (params.gop - 1 + params.idr_size_factor));
+  }
+  openhd::FragmentedVideoFrame create_next_frame() {
+    const bool is_idr = m_frame_idx % m_params.gop == 0;
+    const int frame_size =
+        is_idr ? m_p_frame_size * m_params.idr_size_factor : m_p_frame_size;
+    const int n_fragments =
+        std::max(1, (frame_size + FRAGMENT_SIZE - 1) / FRAGMENT_SIZE);
+    openhd::FragmentedVideoFrame frame{};
+    frame.is_idr_frame = is_idr;
+    frame.creation_time = std::chrono::steady_clock::now();
+    const int64_t creation_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            frame.creation_time.time_since_epoch())
+            .count();
+    int remaining = frame_size;
+    for (int i = 0; i < n_fragments; i++) {
+      const int size = std::max((int)sizeof(BenchFragmentHeader),
+                                std::min(remaining, FRAGMENT_SIZE));
+      remaining -= size;
+      auto fragment = std::make_shared<std::vector<uint8_t>>(size, 0xAB);
+      BenchFragmentHeader header{BENCH_MAGIC, m_frame_idx, (uint16_t)i,
+                                 (uint16_t)n_fragments, creation_ns};
+      std::memcpy(fragment->data(), &header, sizeof(header));
+      frame.rtp_fragments.push_back(fragment);
+    }
+    m_frame_idx++;
+    return frame;
+  }
+  int get_n_frames() const { return (int)m_frame_idx; }
+
+ private:
+  const BenchmarkParams m_params;
+  int m_p_frame_size;
+  uint32_t m_frame_idx = 0;
+};
+
+class FrameCollector {
+ public:
+  void on_fragment(const uint8_t* data, int data_len) {
+    if (data_len < (int)sizeof(BenchFragmentHeader)) return;
+    BenchFragmentHeader header{};
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != BENCH_MAGIC) return;
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_n_bytes += data_len;
+    auto& frame = m_frames[header.frame_idx];
+    frame.n_fragments = header.n_fragments;
+    frame.n_received++;
+    if (frame.n_received == frame.n_fragments) {
+      const auto creation =
+          std::chrono::steady_clock::time_point(std::chrono::nanoseconds(
+              header.creation_ns));
+      m_latencies_ms.push_back(
+          std::chrono::duration_cast<std::chrono::microseconds>(now - creation)
+              .count() /
+          1000.0);
+    }
+  }
+  int get_n_complete(int n_frames) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int ret = 0;
+    for (const auto& [idx, frame] : m_frames) {
+      if ((int)idx < n_frames && frame.n_received >= frame.n_fragments) ret++;
+    }
+    return ret;
+  }
+  std::vector<double> get_latencies() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_latencies_ms;
+  }
+  uint64_t get_n_bytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_n_bytes;
+  }
+
+ private:
+  struct Frame {
+    int n_fragments = 0;
+    int n_received = 0;
+  };
+  std::mutex m_mutex;
+  std::map<uint32_t, Frame> m_frames;
+  std::vector<double> m_latencies_ms;
+  uint64_t m_n_bytes = 0;
+};
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0;
+  const auto n = (std::size_t)(p / 100.0 * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static std::chrono::microseconds get_cpu_time() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         std::chrono::microseconds(usage.ru_utime.tv_usec +
+                                   usage.ru_stime.tv_usec);
+}
+
+static bool change_int_setting(std::vector<openhd::Setting> settings,
+                               const std::string& id, int value) {
+  for (auto& setting : settings) {
+    if (setting.id != id) continue;
+    if (auto* int_setting = std::get_if<openhd::IntSetting>(&setting.setting)) {
+      return int_setting->change_callback(id, value);
+    }
+  }
+  return false;
+}
+
+// Creates air and ground link, the returned cleanup function returns the fec
+// stats (if available)
+struct LinkPair {
+  std::shared_ptr<OHDLink> air;
+  std::shared_ptr<OHDLink> ground;
+  std::function<openhd::ethernet::FECDecoder::Stats()> get_fec_stats;
+};
+
+static LinkPair create_links(const BenchmarkParams& params, int mcs, int fec) {
+  LinkPair ret;
+  if (params.backend == "wb") {
+    const auto card = DWifiCards::create_card_monitor_emulate();
+    auto air = std::make_shared<WBLink>(OHDProfile(true, "0"),
+                                        std::vector<WiFiCard>{card});
+    auto ground = std::make_shared<WBLink>(OHDProfile(false, "0"),
+                                           std::vector<WiFiCard>{card});
+    change_int_setting(air->get_all_settings(), openhd::WB_MCS_INDEX, mcs);
+    change_int_setting(air->get_all_settings(), openhd::WB_VIDEO_FEC_PERCENTAGE,
+                       fec);
+    ret.air = air;
+    ret.ground = ground;
+    ret.get_fec_stats = [] { return openhd::ethernet::FECDecoder::Stats{}; };
+    return ret;
+  }
+  EmulatedLink::Options options{};
+  options.air_to_ground.loss_perc = params.loss_perc;
+  options.air_to_ground.reorder_perc = params.reorder_perc;
+  options.air_to_ground.delay =
+      std::chrono::microseconds((int64_t)(params.delay_ms * 1000));
+  options.air_to_ground.jitter =
+      std::chrono::microseconds((int64_t)(params.jitter_ms * 1000));
+  options.air_to_ground.rate_kbits = mcs_to_rate_kbits(mcs);
+  options.video_fec_percentage = fec;
+  auto [air, ground] = EmulatedLink::create_pair(options);
+  ret.air = air;
+  ret.ground = ground;
+  std::weak_ptr<EmulatedLink> weak_ground = ground;
+  ret.get_fec_stats = [weak_ground] {
+    auto ground = weak_ground.lock();
+    return ground ? ground->get_video_fec_rx_stats(0)
+                  : openhd::ethernet::FECDecoder::Stats{};
+  };
+  return ret;
+}
+
+static BenchmarkResult run_benchmark(const BenchmarkParams& params, int mcs,
+                                     int fec) {
+  auto links = create_links(params, mcs, fec);
+  FrameCollector collector;
+  links.ground->register_on_receive_video_data_cb(
+      [&collector](int stream_index, const uint8_t* data, int data_len) {
+        if (stream_index == 0) collector.on_fragment(data, data_len);
+      });
+  SyntheticEncoder encoder(params);
+  const auto cpu_begin = get_cpu_time();
+  const auto frame_interval = std::chrono::nanoseconds(1000000000 / params.fps);
+  const auto begin = std::chrono::steady_clock::now();
+  const auto end =
+      begin + std::chrono::milliseconds((int64_t)(params.duration_s * 1000));
+  auto next_frame = begin;
+  while (next_frame < end) {
+    std::this_thread::sleep_until(next_frame);
+    links.air->transmit_video_data(0, encoder.create_next_frame());
+    next_frame += frame_interval;
+  }
+  // Let the last frames arrive (queue + delay + fec)
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  const auto cpu_time = get_cpu_time() - cpu_begin;
+  BenchmarkResult result{};
+  result.mcs = mcs;
+  result.fec = fec;
+  result.frames_sent = encoder.get_n_frames();
+  result.frames_complete = collector.get_n_complete(result.frames_sent);
+  const auto latencies = collector.get_latencies();
+  result.latency_p50_ms = percentile(latencies, 50);
+  result.latency_p99_ms = percentile(latencies, 99);
+  result.latency_max_ms =
+      latencies.empty() ? 0 : *std::max_element(latencies.begin(),
+                                                latencies.end());
+  result.delivered_mbit = collector.get_n_bytes() * 8 / 1000.0 / 1000.0;
+  if (result.delivered_mbit > 0) {
+    result.cpu_ms_per_mbit = cpu_time.count() / 1000.0 / result.delivered_mbit;
+  }
+  const auto fec_stats = links.get_fec_stats();
+  result.fec_blocks_recovered = fec_stats.count_blocks_recovered;
+  result.fec_blocks_lost = fec_stats.count_blocks_lost;
+  links.ground->register_on_receive_video_data_cb(nullptr);
+  return result;
+}
+
+static std::string to_json(const BenchmarkParams& params,
+                           const BenchmarkResult& result) {
+  const double frame_loss_perc =
+      result.frames_sent == 0
+          ? 0
+          : 100.0 * (result.frames_sent - result.frames_complete) /
+                result.frames_sent;
+  std::stringstream ss;
+  ss << "{\"backend\":\"" << params.backend << "\""
+     << ",\"mcs\":" << result.mcs << ",\"fec_perc\":" << result.fec
+     << ",\"bitrate_kbits\":" << params.bitrate_kbits
+     << ",\"fps\":" << params.fps << ",\"gop\":" << params.gop
+     << ",\"loss_perc\":" << params.loss_perc
+     << ",\"reorder_perc\":" << params.reorder_perc
+     << ",\"delay_ms\":" << params.delay_ms
+     << ",\"jitter_ms\":" << params.jitter_ms
+     << ",\"frames_sent\":" << result.frames_sent
+     << ",\"frames_complete\":" << result.frames_complete
+     << ",\"frame_loss_perc\":" << frame_loss_perc
+     << ",\"latency_p50_ms\":" << result.latency_p50_ms
+     << ",\"latency_p99_ms\":" << result.latency_p99_ms
+     << ",\"latency_max_ms\":" << result.latency_max_ms
+     << ",\"delivered_mbit\":" << result.delivered_mbit
+     << ",\"cpu_ms_per_mbit\":" << result.cpu_ms_per_mbit
+     << ",\"fec_blocks_recovered\":" << result.fec_blocks_recovered
+     << ",\"fec_blocks_lost\":" << result.fec_blocks_lost << "}";
+  return ss.str();
+}
+
+static std::vector<int> parse_int_list(const std::string& value) {
+  std::vector<int> ret;
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) ret.push_back(std::stoi(item));
+  return ret;
+}
+
+static BenchmarkParams parse_args(int argc, char* argv[]) {
+  BenchmarkParams params{};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string key = argv[i];
+    const std::string value = argv[i + 1];
+    if (key == "--backend") {
+      params.backend = value;
+    } else if (key == "--mcs") {
+      params.mcs_indices = parse_int_list(value);
+    } else if (key == "--fec") {
+      params.fec_percentages = parse_int_list(value);
+    } else if (key == "--bitrate") {
+      params.bitrate_kbits = std::stoi(value);
+    } else if (key == "--fps") {
+      params.fps = std::stoi(value);
+    } else if (key == "--gop") {
+      params.gop = std::max(2, std::stoi(value));
+    } else if (key == "--loss") {
+      params.loss_perc = std::stod(value);
+    } else if (key == "--reorder") {
+      params.reorder_perc = std::stod(value);
+    } else if (key == "--delay") {
+      params.delay_ms = std::stod(value);
+    } else if (key == "--jitter") {
+      params.jitter_ms = std::stod(value);
+    } else if (key == "--duration") {
+      params.duration_s = std::stod(value);
+    } else if (key == "--out") {
+      params.out_file = value;
+    } else {
+      std::cerr << "Unknown option " << key << std::endl;
+    }
+  }
+  return params;
+}
+
+int main(int argc, char* argv[]) {
+  const auto params = parse_args(argc, argv);
+  // The links log quite a lot on debug
+  openhd::log::get_default()->set_level(spdlog::level::warn);
+  std::ofstream out_file;
+  if (!params.out_file.empty()) out_file.open(params.out_file);
+  bool any_frames = false;
+  for (const int mcs : params.mcs_indices) {
+    for (const int fec : params.fec_percentages) {
+      const auto result = run_benchmark(params, mcs, fec);
+      const auto json = to_json(params, result);
+      std::cout << json << std::endl;
+      if (out_file.is_open()) out_file << json << std::endl;
+      if (result.frames_complete > 0) any_frames = true;
+    }
+  }
+  if (!any_frames) {
+    std::cerr << "No frame made it through the link" << std::endl;
+    return 1;
+  }
+  return 0;
+}
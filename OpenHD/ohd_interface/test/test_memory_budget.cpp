@@ -0,0 +1,260 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Memory budget test: checks the sizes derived from the budget, the buffer
+// pool and the receive buffers, then runs the synthetic end-to-end pipeline
+// (air EmulatedLink -> impaired channel -> ground, with video FEC) with the
+// budget of a 512MB board and fails if the peak rss goes above the limit.
+// In debug builds the allocations per subsystem are printed, too.
+//
+// Example:
+// test_memory_budget --budget-mb 32 --limit-mb 32 --duration 5 --bitrate 8000
+//
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "emulated_link.h"
+#include "openhd_global_constants.hpp"
+#include "openhd_memory.h"
+#include "openhd_udp.h"
+
+using namespace openhd::memory;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+struct Params {
+  int budget_mb = 32;
+  int limit_mb = 32;
+  double duration_s = 5;
+  int bitrate_kbits = 8000;
+  int fps = 30;
+  int fec_perc = 20;
+  double loss_perc = 2;
+};
+
+static void test_budget() {
+  const auto low = create_budget(LOW_BUDGET_MB);
+  const auto full = create_budget(FULL_BUDGET_MB);
+  check(create_budget(1).udp_rx_buffer_bytes == low.udp_rx_buffer_bytes,
+        "clamped low");
+  check(create_budget(4096).wb_tele_queue_packets ==
+            full.wb_tele_queue_packets,
+        "clamped full");
+  // The full budget matches what we used before the budget existed
+  check(full.udp_rx_buffer_bytes == 65507, "full udp");
+  check(full.wb_tele_queue_packets == 32, "full tele queue");
+  check(full.wb_audio_queue_packets == 16, "full audio queue");
+  check(full.eth_fec_max_blocks_in_flight == 8, "full fec");
+  check(low.udp_rx_buffer_bytes >= 1500, "low udp fits MTU");
+  const auto mid = create_budget((LOW_BUDGET_MB + FULL_BUDGET_MB) / 2);
+  check(low.fragment_pool_n_buffers < mid.fragment_pool_n_buffers &&
+            mid.fragment_pool_n_buffers < full.fragment_pool_n_buffers,
+        "monotonic");
+  check(budget_mb_for_ram(512LL * 1024 * 1024) == 32, "512MB board");
+  check(budget_mb_for_ram(64LL * 1024 * 1024) == LOW_BUDGET_MB, "tiny board");
+  check(budget_mb_for_ram(8LL * 1024 * 1024 * 1024) == 512, "desktop");
+  std::cout << "Budget ok, using " << get_budget().to_string() << std::endl;
+}
+
+static void test_buffer_pool() {
+  auto pool = BufferPool::create(2);
+  const uint8_t data[4] = {1, 2, 3, 4};
+  {
+    auto b1 = pool->acquire(data, 4);
+    auto b2 = pool->acquire(data, 2);
+    auto b3 = pool->acquire(data, 3);
+    check(b1->size() == 4 && b2->size() == 2 && b3->size() == 3, "sizes");
+    check(std::memcmp(b1->data(), data, 4) == 0, "data");
+    check(pool->get_n_free_buffers() == 0, "all in use");
+  }
+  // Only max_n_buffers are kept
+  check(pool->get_n_free_buffers() == 2, "returned");
+  auto b4 = pool->acquire(data, 1);
+  check(pool->get_n_reused() == 1 && pool->get_n_free_buffers() == 1, "reuse");
+  if (is_tracking_enabled()) {
+    // Neither the buffer nor a shared_ptr control block is allocated (once the
+    // buffers have grown to the size needed)
+    pool->acquire(data, 4);
+    const auto n_allocations = [] {
+      for (const auto& usage : get_subsystem_usage()) {
+        if (usage.name == "test_buffer_pool") return usage.n_allocations;
+      }
+      return (uint64_t)0;
+    };
+    const uint64_t n_allocations_before = n_allocations();
+    {
+      ScopedSubsystem subsystem{"test_buffer_pool"};
+      for (int i = 0; i < 10; i++) pool->acquire(data, 4);
+    }
+    check(n_allocations() == n_allocations_before, "reuse doesn't allocate");
+  }
+  // Buffers can outlive the pool
+  pool = nullptr;
+  check(b4->size() == 1, "outlives pool");
+  std::cout << "Buffer pool ok" << std::endl;
+}
+
+static void test_tracking() {
+  if (!is_tracking_enabled()) {
+    std::cout << "Tracking disabled (release build)" << std::endl;
+    return;
+  }
+  auto find = [](const std::string& name) {
+    for (const auto& usage : get_subsystem_usage()) {
+      if (usage.name == name) return usage;
+    }
+    return SubsystemUsage{name, 0, 0, 0};
+  };
+  std::unique_ptr<std::vector<uint8_t>> buffer;
+  {
+    ScopedSubsystem subsystem{"test_tracking"};
+    buffer = std::make_unique<std::vector<uint8_t>>(1024 * 1024);
+  }
+  // Accounted to the subsystem it was allocated in
+  check(find("test_tracking").current_bytes >= 1024 * 1024, "tracked");
+  buffer = nullptr;
+  const auto usage = find("test_tracking");
+  check(usage.current_bytes < 1024 && usage.peak_bytes >= 1024 * 1024,
+        "freed");
+  std::cout << "Tracking ok" << std::endl;
+}
+
+static void test_udp_rx_buffer() {
+  const int buffer_size = get_budget().udp_rx_buffer_bytes;
+  std::atomic<int> n_received{0};
+  std::atomic<int> last_size{0};
+  openhd::UDPReceiver rx(openhd::ADDRESS_LOCALHOST, 17210,
+                         [&](const uint8_t* payload, std::size_t size) {
+                           last_size = (int)size;
+                           n_received++;
+                         });
+  rx.runInBackground();
+  openhd::UDPForwarder tx(openhd::ADDRESS_LOCALHOST, 17210);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  if (buffer_size < 65507) {
+    // Doesn't fit, needs to be dropped instead of forwarded truncated
+    const std::vector<uint8_t> too_big(buffer_size + 1);
+    tx.forwardPacketViaUDP(too_big.data(), too_big.size());
+  }
+  const std::vector<uint8_t> fits(buffer_size);
+  tx.forwardPacketViaUDP(fits.data(), fits.size());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  rx.stopBackground();
+  check(n_received == 1 && last_size == buffer_size, "udp rx buffer");
+  std::cout << "UDP rx buffer (" << buffer_size << " bytes) ok" << std::endl;
+}
+
+// Synthetic video through the emulated link, fragments come from a pool like
+// in RTPHelper
+static void test_pipeline_peak_rss(const Params& params) {
+  const bool can_reset_peak = reset_peak_rss();
+  using namespace openhd::emulation;
+  EmulatedLink::Options options{};
+  options.air_to_ground.loss_perc = params.loss_perc;
+  options.air_to_ground.delay = std::chrono::milliseconds(2);
+  options.video_fec_percentage = params.fec_perc;
+  auto [air, ground] = EmulatedLink::create_pair(options);
+  std::atomic<int64_t> n_bytes_received{0};
+  ground->register_on_receive_video_data_cb(
+      [&n_bytes_received](int stream_index, const uint8_t* data,
+                          int data_len) { n_bytes_received += data_len; });
+  static constexpr int FRAGMENT_SIZE = 1024;
+  auto pool = BufferPool::create(get_budget().fragment_pool_n_buffers);
+  const std::vector<uint8_t> payload(FRAGMENT_SIZE, 0xAB);
+  const int frame_size = params.bitrate_kbits * 1000 / 8 / params.fps;
+  const int n_fragments = std::max(1, frame_size / FRAGMENT_SIZE);
+  const auto frame_interval = std::chrono::nanoseconds(1000000000 / params.fps);
+  const auto begin = std::chrono::steady_clock::now();
+  const auto end =
+      begin + std::chrono::milliseconds((int64_t)(params.duration_s * 1000));
+  int64_t n_bytes_sent = 0;
+  auto next_frame = begin;
+  while (next_frame < end) {
+    std::this_thread::sleep_until(next_frame);
+    openhd::FragmentedVideoFrame frame{};
+    frame.creation_time = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_fragments; i++) {
+      frame.rtp_fragments.push_back(
+          pool->acquire(payload.data(), (int)payload.size()));
+    }
+    n_bytes_sent += n_fragments * FRAGMENT_SIZE;
+    air->transmit_video_data(0, frame);
+    next_frame += frame_interval;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  ground->register_on_receive_video_data_cb(nullptr);
+  const auto process = get_process_memory();
+  std::cout << create_report() << std::endl;
+  std::cout << "Pipeline: sent " << n_bytes_sent / 1024 << "kB received "
+            << n_bytes_received / 1024 << "kB, fragment pool re-used "
+            << pool->get_n_reused() << "x, peak rss "
+            << process.peak_rss_kb / 1024 << "MB (limit " << params.limit_mb
+            << "MB" << (can_reset_peak ? "" : ", not reset") << ")"
+            << std::endl;
+  // FEC should recover almost all of the (uniform) loss
+  check(n_bytes_received >= n_bytes_sent * 0.9, "delivered");
+  check(pool->get_n_reused() > 0, "fragments re-used");
+  check(process.peak_rss_kb > 0 &&
+            process.peak_rss_kb <= (int64_t)params.limit_mb * 1024,
+        "peak rss below limit");
+}
+
+int main(int argc, char* argv[]) {
+  Params params{};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const char* value = argv[i + 1];
+    if (arg == "--budget-mb") {
+      params.budget_mb = std::stoi(value);
+    } else if (arg == "--limit-mb") {
+      params.limit_mb = std::stoi(value);
+    } else if (arg == "--duration") {
+      params.duration_s = std::stod(value);
+    } else if (arg == "--bitrate") {
+      params.bitrate_kbits = std::stoi(value);
+    } else if (arg == "--fec") {
+      params.fec_perc = std::stoi(value);
+    } else if (arg == "--loss") {
+      params.loss_perc = std::stod(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << std::endl;
+      return 1;
+    }
+  }
+  // Before anything uses the budget
+  set_budget_mb(params.budget_mb);
+  test_budget();
+  test_buffer_pool();
+  test_tracking();
+  test_udp_rx_buffer();
+  test_pipeline_peak_rss(params);
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,312 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the microhard AT client against a fake telnet modem on localhost.
+//
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "microhard_at_client.h"
+
+using namespace openhd::microhard;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+// Behaves (roughly) like the telnet server of a microhard pMDDL modem
+class FakeModem {
+ public:
+  explicit FakeModem(std::string password) : m_password(std::move(password)) {
+    m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(m_listen_fd, (sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(m_listen_fd, (sockaddr*)&addr, &len);
+    m_port = ntohs(addr.sin_port);
+    listen(m_listen_fd, 4);
+    m_thread = std::thread(&FakeModem::loop, this);
+  }
+  ~FakeModem() {
+    m_keep_running = false;
+    shutdown(m_listen_fd, SHUT_RDWR);
+    drop_connection();
+    m_thread.join();
+    close(m_listen_fd);
+  }
+  int get_port() const { return m_port; }
+  // Simulates the modem rebooting / the link going down
+  void drop_connection() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_client_fd >= 0) shutdown(m_client_fd, SHUT_RDWR);
+  }
+  std::atomic<int> n_accepted = 0;
+  std::atomic<int> n_login_failed = 0;
+  std::atomic<int> n_commands = 0;
+  std::atomic<int> n_rssi_commands = 0;
+  std::atomic<int> n_slow_commands = 0;
+
+ private:
+  const std::string m_password;
+  int m_listen_fd;
+  int m_port;
+  std::mutex m_mutex;
+  int m_client_fd = -1;
+  std::atomic<bool> m_keep_running = true;
+  std::thread m_thread;
+  void loop() {
+    while (m_keep_running) {
+      const int fd = accept(m_listen_fd, nullptr, nullptr);
+      if (fd < 0) break;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_client_fd = fd;
+      }
+      n_accepted++;
+      handle_session(fd);
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_client_fd = -1;
+      }
+      close(fd);
+    }
+  }
+  static void write_all(int fd, const std::string& data) {
+    (void)::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+  }
+  // Returns false if the connection was closed
+  static bool read_line(int fd, std::string& buffer, std::string& line) {
+    while (true) {
+      const auto pos = buffer.find('\n');
+      if (pos != std::string::npos) {
+        line = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+      }
+      char buff[512];
+      const ssize_t ret = recv(fd, buff, sizeof(buff), 0);
+      if (ret <= 0) return false;
+      for (ssize_t i = 0; i < ret; i++) {
+        // Drop the telnet negotiation replies of the client
+        if ((uint8_t)buff[i] == 255 && i + 2 < ret) {
+          i += 2;
+          continue;
+        }
+        buffer.push_back(buff[i]);
+      }
+    }
+  }
+  static std::string get_response(const std::string& command) {
+    if (command == "AT+MWRSSI") return "-52 dBm";
+    if (command == "AT+MWSNR") return "28 dB";
+    if (command == "AT+MWNOISEFLOOR") return "Noise Floor: -95 dBm";
+    if (command == "AT+MWFREQ2400") return "Current Frequency: 2437 MHz";
+    if (command == "AT+MWBAND") return "Channel-bandwidth: 20 MHz";
+    if (command == "AT+MWTXPOWER") return "30 dBm (1000 mW)";
+    if (command == "AT+MWVRATE") return "Rate Mode: 2";
+    return "";
+  }
+  void handle_session(int fd) {
+    std::string buffer;
+    std::string line;
+    // IAC DO ECHO, split over two writes to exercise partial sequences
+    write_all(fd, std::string{(char)255, (char)253});
+    write_all(fd, std::string{(char)1} + "\r\nUserDevice login: ");
+    if (!read_line(fd, buffer, line)) return;
+    write_all(fd, "Password: ");
+    if (!read_line(fd, buffer, line)) return;
+    if (line != m_password) {
+      n_login_failed++;
+      write_all(fd, "\r\nLogin incorrect\r\nUserDevice login: ");
+      return;
+    }
+    write_all(fd, "\r\nEntering character mode\r\nUserDevice> ");
+    while (m_keep_running && read_line(fd, buffer, line)) {
+      n_commands++;
+      if (line == "AT+MWRSSI") n_rssi_commands++;
+      if (line == "AT+MWTXPOWER") n_slow_commands++;
+      const auto response = get_response(line);
+      write_all(fd, line + "\r\n");
+      if (response.empty()) {
+        write_all(fd, "ERROR\r\nUserDevice> ");
+      } else {
+        write_all(fd, response + "\r\nOK\r\nUserDevice> ");
+      }
+    }
+  }
+};
+
+static void test_parsers() {
+  check(ATClient::parse_value_with_unit("AT+MWRSSI\r\n-52 dBm\r\nOK", "dBm") ==
+            -52,
+        "rssi");
+  check(ATClient::parse_value_with_unit("28 dB\r\nOK", "dB") == 28, "snr");
+  // dB must not match dBm
+  check(!ATClient::parse_value_with_unit("-52 dBm", "dB").has_value(),
+        "dB vs dBm");
+  check(ATClient::parse_value_with_unit("Freq: 2437mhz", "MHz") == 2437,
+        "case");
+  check(!ATClient::parse_value_with_unit("no value", "dBm").has_value(),
+        "no value");
+  check(ATClient::parse_first_value("AT+MWVRATE\r\nRate Mode: 2\r\nOK") == 2,
+        "first value");
+  check(!ATClient::parse_first_value("AT+MWVRATE\r\nOK").has_value(),
+        "first value none");
+  std::cout << "Parsers OK" << std::endl;
+}
+
+static bool wait_until(const std::function<bool()>& condition,
+                       std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (condition()) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return condition();
+}
+
+static ATClient::Options create_options(int port) {
+  ATClient::Options options{};
+  options.ip = "127.0.0.1";
+  options.port = port;
+  options.password = "qwertz1";
+  options.poll_interval = std::chrono::milliseconds(50);
+  options.slow_query_divider = 5;
+  options.timeout = std::chrono::milliseconds(1000);
+  options.max_reconnect_backoff = std::chrono::milliseconds(400);
+  return options;
+}
+
+static void test_session() {
+  FakeModem modem("qwertz1");
+  std::atomic<int> n_callbacks = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point first_stats;
+  ATClient client(create_options(modem.get_port()),
+                  [&](const ModemStats& stats) {
+                    if (n_callbacks++ == 0) {
+                      first_stats = std::chrono::steady_clock::now();
+                    }
+                  });
+  check(wait_until([&] { return n_callbacks >= 1; },
+                   std::chrono::milliseconds(2000)),
+        "first stats");
+  std::cout << "Login + first poll cycle took "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   first_stats - begin)
+                       .count() /
+                   1000.0
+            << "ms" << std::endl;
+  const auto stats = client.get_last_stats();
+  check(stats.rssi_dbm == -52, "rssi_dbm");
+  check(stats.snr_db == 28, "snr_db");
+  check(stats.noise_floor_dbm == -95, "noise_floor_dbm");
+  check(stats.frequency_mhz == 2437, "frequency_mhz");
+  check(stats.bandwidth_mhz == 20, "bandwidth_mhz");
+  check(stats.tx_power_dbm == 30, "tx_power_dbm");
+  check(stats.rate_mode == 2, "rate_mode");
+  // Poll rate
+  const int n_before = n_callbacks;
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  const int n_per_second = n_callbacks - n_before;
+  std::cout << "Poll cycles/s:" << n_per_second << std::endl;
+  check(n_per_second >= 15 && n_per_second <= 21, "poll rate 50ms");
+  // Slow queries only every n-th cycle
+  check(modem.n_slow_commands * 3 < modem.n_rssi_commands, "slow queries");
+  // One session for all of that
+  check(client.get_counters().n_connects == 1, "single session");
+  check(modem.n_accepted == 1, "single accept");
+  check(client.get_counters().n_parse_errors == 0, "no parse errors");
+  // Changing the rate at run time
+  client.set_poll_interval(std::chrono::milliseconds(200));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  const int n_before2 = n_callbacks;
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  const int n_per_second2 = n_callbacks - n_before2;
+  std::cout << "Poll cycles/s after change:" << n_per_second2 << std::endl;
+  check(n_per_second2 >= 4 && n_per_second2 <= 6, "poll rate 200ms");
+  // Reconnect if the modem goes away
+  client.set_poll_interval(std::chrono::milliseconds(50));
+  modem.drop_connection();
+  check(wait_until([&] { return client.get_counters().n_connects == 2; },
+                   std::chrono::milliseconds(2000)),
+        "reconnect");
+  const int n_before3 = n_callbacks;
+  check(wait_until([&] { return n_callbacks > n_before3 + 2; },
+                   std::chrono::milliseconds(2000)),
+        "stats after reconnect");
+  std::cout << "Session OK " << client.get_counters().n_poll_cycles
+            << " cycles" << std::endl;
+}
+
+static void test_wrong_password() {
+  FakeModem modem("other");
+  ATClient client(create_options(modem.get_port()), nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+  const auto counters = client.get_counters();
+  std::cout << "Wrong password: " << counters.n_connects << " connects, "
+            << modem.n_login_failed << " failed logins" << std::endl;
+  check(counters.n_poll_cycles == 0, "no stats");
+  check(modem.n_login_failed >= 2, "retries");
+  // Backoff: 250, 400, 400, ... -> not more than ~5 attempts in 1.5s
+  check(counters.n_connects <= 6, "backoff");
+  check(client.get_state() != ATClient::State::READY, "not ready");
+}
+
+static void test_unreachable() {
+  // Nothing listening on port 1
+  ATClient client(create_options(1), nullptr);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  const auto counters = client.get_counters();
+  check(counters.n_connects == 0, "unreachable no connect");
+  check(counters.n_disconnects >= 2 && counters.n_disconnects <= 6,
+        "unreachable backoff");
+  std::cout << "Unreachable OK" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  test_parsers();
+  test_session();
+  test_wrong_password();
+  test_unreachable();
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,375 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Video tx queue (wb_video_tx_queue.h) test.
+// First, the drop decisions are checked with a blocked link (non-reference
+// frames are dropped first, a key frame supersedes everything before it, frames
+// that depend on a dropped frame are dropped until the next key frame, frames
+// that are too old are not sent).
+// Then, a 60fps stream (key frame every 30 frames, every second frame is a
+// non-reference frame) is sent over an emulated link with bursty interference:
+// periods where a frame takes longer to send than the frame interval, and
+// complete stalls. The previous behaviour (wb tx queue of 2 frames, incoming
+// frame dropped if full) is compared against the video tx queue in front of a
+// wb tx queue of 1 frame - the end-to-end latency (frame creation until sent)
+// must stay bounded.
+//
+// Example:
+// test_video_tx_queue --seconds 4
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "wb_video_tx_queue.h"
+
+using namespace openhd::wb;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static openhd::FragmentedVideoFrame create_frame(int id, bool is_key_frame,
+                                                 bool is_non_reference) {
+  openhd::FragmentedVideoFrame frame{};
+  auto fragment = std::make_shared<std::vector<uint8_t>>(sizeof(int));
+  std::memcpy(fragment->data(), &id, sizeof(int));
+  frame.rtp_fragments.push_back(fragment);
+  frame.creation_time = std::chrono::steady_clock::now();
+  frame.is_idr_frame = is_key_frame;
+  frame.is_non_reference_frame = is_non_reference;
+  return frame;
+}
+
+static int get_id(const openhd::FragmentedVideoFrame& frame) {
+  int id;
+  std::memcpy(&id, frame.rtp_fragments.at(0)->data(), sizeof(int));
+  return id;
+}
+
+// Link that doesn't take frames until unblocked
+struct BlockedLink {
+  std::atomic<bool> blocked = true;
+  std::mutex mutex;
+  std::vector<int> sent;
+  bool try_send(const openhd::FragmentedVideoFrame& frame) {
+    if (blocked) return false;
+    std::lock_guard<std::mutex> guard(mutex);
+    sent.push_back(get_id(frame));
+    return true;
+  }
+  std::vector<int> get_sent() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return sent;
+  }
+};
+
+static void wait_a_bit() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+static uint64_t n_dropped(const VideoTxQueueStats& stats,
+                          VideoDropReason reason) {
+  return stats.n_dropped[(int)reason];
+}
+
+static void test_drop_decisions() {
+  BlockedLink link;
+  VideoTxQueueConfig config{};
+  config.capacity_frames = 3;
+  config.max_frame_age = std::chrono::seconds(10);
+  VideoTxQueue queue(config, [&link](const openhd::FragmentedVideoFrame& f) {
+    return link.try_send(f);
+  });
+  // 1 is taken by the tx thread (in flight), 2,3,4 are queued
+  queue.enqueue(create_frame(1, true, false));
+  wait_a_bit();
+  queue.enqueue(create_frame(2, false, false));
+  queue.enqueue(create_frame(3, false, true));
+  queue.enqueue(create_frame(4, false, false));
+  // Full - the queued non-reference frame 3 is dropped
+  queue.enqueue(create_frame(5, false, false));
+  auto stats = queue.get_stats();
+  check(n_dropped(stats, VideoDropReason::NON_REFERENCE) == 1,
+        "queued non-reference frame dropped");
+  check(stats.curr_n_queued == 3, "3 frames queued");
+  // Full, no non-reference frame queued - incoming non-reference frame dropped
+  queue.enqueue(create_frame(6, false, true));
+  stats = queue.get_stats();
+  check(n_dropped(stats, VideoDropReason::NON_REFERENCE) == 2,
+        "incoming non-reference frame dropped");
+  // Full, incoming reference frame dropped - the following frames depend on it
+  queue.enqueue(create_frame(7, false, false));
+  queue.enqueue(create_frame(8, false, true));
+  stats = queue.get_stats();
+  check(n_dropped(stats, VideoDropReason::QUEUE_FULL) == 1, "queue full");
+  check(n_dropped(stats, VideoDropReason::BROKEN_REFERENCE) == 1,
+        "broken reference");
+  // Key frame supersedes the queued frames and the one in flight
+  queue.enqueue(create_frame(9, true, false));
+  wait_a_bit();
+  stats = queue.get_stats();
+  check(n_dropped(stats, VideoDropReason::SUPERSEDED) == 4, "superseded");
+  queue.enqueue(create_frame(10, false, false));
+  link.blocked = false;
+  wait_a_bit();
+  stats = queue.get_stats();
+  check(link.get_sent() == std::vector<int>{9, 10}, "sent after key frame");
+  check(stats.n_enqueued == 10 && stats.n_sent == 2, "enqueued / sent");
+  check(stats.n_dropped_total() == 8, "dropped total");
+  std::cout << video_tx_queue_stats_to_string(stats) << "\n";
+}
+
+static void test_max_frame_age() {
+  BlockedLink link;
+  link.blocked = false;
+  VideoTxQueueConfig config{};
+  config.max_frame_age = std::chrono::milliseconds(30);
+  VideoTxQueue queue(config, [&link](const openhd::FragmentedVideoFrame& f) {
+    return link.try_send(f);
+  });
+  queue.enqueue(create_frame(1, true, false));
+  wait_a_bit();
+  link.blocked = true;
+  queue.enqueue(create_frame(2, false, false));
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  link.blocked = false;
+  // 2 was dropped, 3 depends on it
+  queue.enqueue(create_frame(3, false, false));
+  queue.enqueue(create_frame(4, true, false));
+  wait_a_bit();
+  const auto stats = queue.get_stats();
+  check(n_dropped(stats, VideoDropReason::TOO_OLD) == 1, "too old");
+  check(n_dropped(stats, VideoDropReason::BROKEN_REFERENCE) == 1,
+        "broken reference after too old");
+  check(link.get_sent() == std::vector<int>{1, 4}, "sent");
+  check(stats.age_max_us >= 0 && stats.age_max_us < 30 * 1000, "age stats");
+}
+
+// Emulated wb tx instance: a queue of frames, sent one after another by its
+// own thread. Under interference, a frame takes longer to send than the frame
+// interval (the link can't keep up) - or nothing is sent at all for a while.
+class EmulatedLink {
+ public:
+  explicit EmulatedLink(int queue_size) : m_queue_size(queue_size) {
+    m_begin = std::chrono::steady_clock::now();
+    m_thread = std::thread([this] { loop(); });
+  }
+  ~EmulatedLink() {
+    m_run = false;
+    m_thread.join();
+  }
+  // Previous wb tx queue behaviour: drop the incoming frame if full
+  bool try_enqueue(const openhd::FragmentedVideoFrame& frame) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if ((int)m_queue.size() >= m_queue_size) return false;
+    m_queue.push_back(frame);
+    return true;
+  }
+  // End-to-end latency of each sent frame (ms), and the frame ids
+  std::vector<std::pair<int, double>> get_sent() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_sent;
+  }
+  static constexpr auto FRAME_INTERVAL = std::chrono::microseconds(16667);
+  // Every 1s: 250ms where each frame needs 1.5 frame intervals, later a
+  // 200ms stall
+  static bool is_stalled(std::chrono::milliseconds t) {
+    const auto phase = t.count() % 1000;
+    return phase >= 600 && phase < 800;
+  }
+  static std::chrono::microseconds airtime(std::chrono::milliseconds t) {
+    const auto phase = t.count() % 1000;
+    if (phase >= 100 && phase < 350) return FRAME_INTERVAL * 3 / 2;
+    return FRAME_INTERVAL / 2;
+  }
+
+ private:
+  void loop() {
+    while (m_run) {
+      std::optional<openhd::FragmentedVideoFrame> frame;
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (!m_queue.empty()) {
+          frame = m_queue.front();
+          m_queue.pop_front();
+        }
+      }
+      if (!frame.has_value()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      std::this_thread::sleep_for(airtime(elapsed()));
+      while (m_run && is_stalled(elapsed())) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      const double latency_ms =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - frame->creation_time)
+              .count() /
+          1000.0;
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_sent.emplace_back(get_id(*frame), latency_ms);
+    }
+  }
+  std::chrono::milliseconds elapsed() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_begin);
+  }
+  const int m_queue_size;
+  std::chrono::steady_clock::time_point m_begin;
+  std::mutex m_mutex;
+  std::deque<openhd::FragmentedVideoFrame> m_queue;
+  std::vector<std::pair<int, double>> m_sent;
+  std::atomic<bool> m_run = true;
+  std::thread m_thread;
+};
+
+static constexpr int GOP_SIZE = 30;
+
+static bool is_key_frame(int id) { return id % GOP_SIZE == 0; }
+// Every second frame is a non-reference frame, each reference frame depends
+// on the previous one
+static bool is_non_reference(int id) { return id % 2 == 1; }
+
+struct Result {
+  int n_frames = 0;
+  int n_sent = 0;
+  // Can be decoded (all frames it depends on were sent)
+  int n_decodable = 0;
+  double latency_avg_ms = 0;
+  double latency_max_ms = 0;
+  // Decodable frames sent later than the given threshold
+  int n_late = 0;
+};
+
+static Result evaluate(const std::vector<std::pair<int, double>>& sent,
+                       int n_frames, double late_threshold_ms) {
+  Result ret{};
+  ret.n_frames = n_frames;
+  ret.n_sent = (int)sent.size();
+  std::set<int> decodable;
+  for (const auto& [id, latency_ms] : sent) {
+    bool ok;
+    if (is_key_frame(id)) {
+      ok = true;
+    } else if (is_non_reference(id)) {
+      ok = decodable.count(id - 1) > 0;
+    } else {
+      ok = decodable.count(id - 2) > 0;
+    }
+    if (!ok) continue;
+    decodable.insert(id);
+    ret.n_decodable++;
+    ret.latency_avg_ms += latency_ms;
+    ret.latency_max_ms = std::max(ret.latency_max_ms, latency_ms);
+    if (latency_ms > late_threshold_ms) ret.n_late++;
+  }
+  if (ret.n_decodable > 0) ret.latency_avg_ms /= ret.n_decodable;
+  return ret;
+}
+
+static void print_result(const std::string& name, const Result& result) {
+  std::cout << name << ": frames:" << result.n_frames
+            << " sent:" << result.n_sent
+            << " decodable:" << result.n_decodable
+            << " latency avg:" << result.latency_avg_ms
+            << "ms max:" << result.latency_max_ms
+            << "ms late:" << result.n_late << "\n";
+}
+
+// Produce frames at the frame interval, hand them to the given cb
+static void run_stream(
+    int n_frames,
+    const std::function<void(openhd::FragmentedVideoFrame)>& on_frame) {
+  auto next = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_frames; i++) {
+    on_frame(create_frame(i, is_key_frame(i), is_non_reference(i)));
+    next += EmulatedLink::FRAME_INTERVAL;
+    std::this_thread::sleep_until(next);
+  }
+  // Let the link finish
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+int main(int argc, char* argv[]) {
+  int n_seconds = 4;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--seconds" && i + 1 < argc) n_seconds = std::stoi(argv[++i]);
+  }
+  test_drop_decisions();
+  test_max_frame_age();
+  std::cout << "Drop decisions OK\n";
+
+  const int n_frames = n_seconds * 60;
+  static constexpr int MAX_FRAME_AGE_MS = 50;
+  // The frame handed over at max age might have to wait for the frame in
+  // flight, plus its own airtime (1.5 frame intervals each during
+  // interference)
+  const double late_threshold_ms = MAX_FRAME_AGE_MS + 3 * 16.667 + 5;
+  Result legacy;
+  {
+    EmulatedLink link(2);
+    run_stream(n_frames, [&link](openhd::FragmentedVideoFrame frame) {
+      link.try_enqueue(frame);
+    });
+    legacy = evaluate(link.get_sent(), n_frames, late_threshold_ms);
+  }
+  Result with_queue;
+  VideoTxQueueStats queue_stats;
+  {
+    EmulatedLink link(1);
+    VideoTxQueueConfig config{};
+    config.max_frame_age = std::chrono::milliseconds(MAX_FRAME_AGE_MS);
+    VideoTxQueue queue(config,
+                       [&link](const openhd::FragmentedVideoFrame& frame) {
+                         return link.try_enqueue(frame);
+                       });
+    run_stream(n_frames, [&queue](openhd::FragmentedVideoFrame frame) {
+      queue.enqueue(std::move(frame));
+    });
+    with_queue = evaluate(link.get_sent(), n_frames, late_threshold_ms);
+    queue_stats = queue.get_stats();
+  }
+  print_result("wb queue 2 frames (previous)", legacy);
+  print_result("video tx queue", with_queue);
+  std::cout << video_tx_queue_stats_to_string(queue_stats) << "\n";
+  // Only the frame(s) already handed to the link when a stall begins are late
+  check(with_queue.n_late <= 2 * n_seconds, "bounded latency");
+  check(with_queue.n_late < legacy.n_late, "fewer late frames");
+  check(with_queue.latency_avg_ms < legacy.latency_avg_ms, "lower latency");
+  check(with_queue.n_decodable > legacy.n_decodable, "more decodable frames");
+  std::cout << "Test video tx queue OK\n";
+  return 0;
+}
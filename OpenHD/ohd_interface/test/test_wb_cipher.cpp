@@ -0,0 +1,95 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Cipher micro-benchmark (wb_cipher.h): MB/s and us per packet for the
+// typical packet sizes, encrypted one packet per call like wifibroadcast does,
+// and the video bitrate that can be encrypted using half of one core - to see
+// which bitrates are sustainable with (ultra secure) encryption on.
+//
+// Example:
+// test_wb_cipher --duration 500
+//
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "wb_cipher.h"
+
+using namespace openhd::wb;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static void test_median() {
+  const auto single = benchmark_cipher(CipherType::CHACHA20_POLY1305, 1440,
+                                       std::chrono::milliseconds(5));
+  check(single.mb_per_s > 0 && single.us_per_packet > 0, "single run");
+  const auto median = benchmark_cipher_median(
+      CipherType::CHACHA20_POLY1305, 1440, 5, std::chrono::milliseconds(5));
+  check(median.type == CipherType::CHACHA20_POLY1305 &&
+            median.packet_size == 1440 && median.mb_per_s > 0,
+        "median");
+  // MB/s and us per packet of the same run
+  check(std::abs(median.mb_per_s * median.us_per_packet - 1440) < 1,
+        "consistent median");
+}
+
+static void benchmark(std::chrono::milliseconds duration) {
+  std::cout << std::fixed << std::setprecision(2);
+  for (const auto type :
+       {CipherType::CHACHA20_POLY1305, CipherType::AES256_GCM}) {
+    if (!is_cipher_available(type)) {
+      std::cout << cipher_type_to_string(type) << " not available\n";
+      continue;
+    }
+    for (const int packet_size : {256, 1024, 1440}) {
+      const auto result = benchmark_cipher_median(type, packet_size, 5,
+                                                  duration / 5);
+      std::cout << cipher_benchmark_to_string(result) << " -> "
+                << max_encrypted_bitrate_kbits(result, 0.5f) / 1000
+                << "Mbit/s at 50% of a core\n";
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int duration_ms = 200;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    const std::string value = argv[i + 1];
+    if (arg == "--duration") {
+      duration_ms = std::stoi(value);
+    } else {
+      std::cerr << "Unknown argument " << arg << "\n";
+      return 1;
+    }
+  }
+  test_median();
+  benchmark(std::chrono::milliseconds(duration_ms));
+  std::cout << "Done\n";
+  return 0;
+}
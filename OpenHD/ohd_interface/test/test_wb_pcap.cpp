@@ -0,0 +1,496 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Test the pcapng recording (ring, radiotap parsing, live capture on the
+// loopback interface if permitted), the replay driver and the tx queue / rate
+// logic simulation.
+// Also the tool to work with captures of a real flight (see
+// WIFI_PCAP_RECORD_DIRECTORY in hardware.config), no radio hardware needed:
+// Per second summary (frames, throughput, rssi, mcs):
+//   test_wb_pcap --replay /home/openhd/pcap --prefix ground
+// Replay into a (e.g. mac80211_hwsim) monitor interface at 2x speed:
+//   test_wb_pcap --replay /home/openhd/pcap --prefix ground --speed 2
+//     --inject wlan1
+// Run the air rate logic against the link capacity seen in the capture:
+//   test_wb_pcap --replay /home/openhd/pcap --prefix ground --simulate 12000
+//
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "openhd_util_filesystem.h"
+#include "wb_pcap.h"
+#include "wb_replay.h"
+
+using namespace openhd::wb;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static const std::string TEST_DIR = "/tmp/test_wb_pcap";
+
+// Radiotap header like the one of a received frame (rtl8812au style, with
+// per antenna signal) followed by a fake 802.11 frame containing the index
+static std::vector<uint8_t> create_frame(uint32_t idx, int payload_size,
+                                         bool with_fcs = false) {
+  std::vector<uint8_t> ret(38, 0);
+  ret[2] = 38;
+  // TSFT, flags, rate, channel, antsignal, mcs, radiotap ns next, ext
+  const uint32_t word0 = (1 << 0) | (1 << 1) | (1 << 2) | (1 << 3) | (1 << 5) |
+                         (1 << 19) | (1u << 29) | (1u << 31);
+  // antsignal, antenna, radiotap ns next, ext
+  const uint32_t word1 = (1 << 5) | (1 << 11) | (1u << 29) | (1u << 31);
+  const uint32_t word2 = (1 << 5) | (1 << 11);
+  std::memcpy(&ret[4], &word0, 4);
+  std::memcpy(&ret[8], &word1, 4);
+  std::memcpy(&ret[12], &word2, 4);
+  ret[24] = with_fcs ? 0x10 : 0x00;  // flags
+  ret[25] = 12;                      // rate
+  const uint16_t freq = 5745;
+  std::memcpy(&ret[26], &freq, 2);
+  ret[30] = (uint8_t)-40;  // antsignal
+  ret[31] = 0x02;          // mcs known
+  ret[33] = 3;             // mcs index
+  ret[34] = (uint8_t)-42;  // antenna 0
+  ret[36] = (uint8_t)-45;  // antenna 1
+  ret[37] = 1;
+  for (int i = 0; i < payload_size; i++) ret.push_back(i & 0xFF);
+  std::memcpy(&ret[38], &idx, 4);
+  if (with_fcs) ret.insert(ret.end(), {0xDE, 0xAD, 0xBE, 0xEF});
+  return ret;
+}
+
+static uint32_t get_idx(const pcap::CapturedFrame& frame) {
+  uint32_t idx;
+  std::memcpy(&idx, &frame.data[38], 4);
+  return idx;
+}
+
+static void test_radiotap() {
+  const auto frame = create_frame(7, 100, true);
+  const auto info = pcap::parse_radiotap(frame.data(), (int)frame.size());
+  check(info.has_value(), "valid radiotap");
+  check(info->header_len == 38, "header len");
+  check(info->frequency_mhz == 5745, "frequency");
+  check(info->rssi_dbm == -40, "rssi");
+  check(info->antenna_rssi_dbm == std::vector<int8_t>{-42, -45}, "antennas");
+  check(info->mcs_index == 3, "mcs");
+  check(info->rate_500kbps == 12, "rate");
+  check(info->has_fcs() && !info->bad_fcs(), "fcs");
+  check(!pcap::parse_radiotap(frame.data(), 20).has_value(), "truncated");
+  const auto injectable = replay::make_injectable(
+      pcap::CapturedFrame{0, 0, false, frame});
+  check(injectable.size() == 10 + 100, "injectable size");
+  check(std::memcmp(&injectable[10], &frame[38], 100) == 0, "injectable data");
+}
+
+static void test_ring() {
+  OHDFilesystemUtil::safe_delete_directory(TEST_DIR);
+  pcap::PcapngRingWriter::Options options{};
+  options.directory = TEST_DIR;
+  options.prefix = "ring";
+  options.max_file_size_bytes = 64 * 1024;
+  options.max_n_files = 3;
+  static constexpr int N_FRAMES = 2000;
+  {
+    pcap::PcapngRingWriter writer(
+        options, {{"wlan0", pcap::LINKTYPE_IEEE802_11_RADIOTAP},
+                  {"wlan1", pcap::LINKTYPE_IEEE802_11_RADIOTAP}});
+    for (uint32_t i = 0; i < N_FRAMES; i++) {
+      pcap::CapturedFrame frame{};
+      frame.timestamp_ns = 1700000000123456789LL + i * 1000000LL;
+      frame.interface_idx = i % 2;
+      frame.outbound = i % 3 == 0;
+      frame.data = create_frame(i, 150 + i % 50);
+      writer.write(frame);
+    }
+    check(writer.get_files().size() == 3, "n files");
+  }
+  const auto capture = pcap::read_pcapng_ring(TEST_DIR, "ring");
+  check(capture.has_value(), "read ring");
+  check(capture->interfaces.size() == 2 &&
+            capture->interfaces[1].name == "wlan1",
+        "interfaces");
+  check(!capture->frames.empty() && capture->frames.size() < N_FRAMES,
+        "oldest frames deleted");
+  // The most recent frames are all there, in order
+  const uint32_t first = get_idx(capture->frames.front());
+  for (std::size_t i = 0; i < capture->frames.size(); i++) {
+    const auto& frame = capture->frames[i];
+    const uint32_t idx = get_idx(frame);
+    check(idx == first + i, "consecutive");
+    check(frame.timestamp_ns == 1700000000123456789LL + idx * 1000000LL,
+          "timestamp");
+    check(frame.interface_idx == (int)(idx % 2), "interface");
+    check(frame.outbound == (idx % 3 == 0), "direction");
+    check(frame.data == create_frame(idx, 150 + idx % 50), "data");
+  }
+  check(get_idx(capture->frames.back()) == N_FRAMES - 1, "last frame");
+  // Continues after the existing files (e.g. reboot)
+  {
+    const auto previous = pcap::get_ring_files(TEST_DIR, "ring");
+    pcap::PcapngRingWriter writer(options, {{"wlan0"}});
+    const auto files = writer.get_files();
+    check(files.size() == 3 && files.back() > previous.back() &&
+              files[1] == previous.back(),
+          "continue index");
+  }
+  // Power loss - truncated last block is ignored
+  const auto files = pcap::get_ring_files(TEST_DIR, "ring");
+  const auto content = OHDFilesystemUtil::read_file(files[files.size() - 2]);
+  OHDFilesystemUtil::write_file(TEST_DIR + "/truncated.pcapng",
+                                content.substr(0, content.size() - 100));
+  const auto truncated = pcap::read_pcapng(TEST_DIR + "/truncated.pcapng");
+  check(truncated.has_value() && !truncated->frames.empty(), "truncated");
+  std::cout << "Ring: " << capture->frames.size() << " frames in 3 files\n";
+}
+
+static void test_replay() {
+  pcap::Capture capture{};
+  capture.interfaces.push_back({"wlan0"});
+  for (int i = 0; i < 100; i++) {
+    capture.frames.push_back(pcap::CapturedFrame{
+        1000000000LL + i * 10000000LL, 0, i % 4 == 0, create_frame(i, 100)});
+  }
+  replay::ReplayOptions options{};
+  options.speed = 10;
+  int n_delivered = 0;
+  uint32_t last_idx = 0;
+  const auto begin = std::chrono::steady_clock::now();
+  const int ret = replay::replay(capture, options,
+                                 [&](const pcap::CapturedFrame& frame) {
+                                   check(!frame.outbound, "inbound only");
+                                   last_idx = get_idx(frame);
+                                   n_delivered++;
+                                 });
+  const auto elapsed = std::chrono::steady_clock::now() - begin;
+  check(ret == 75 && n_delivered == 75 && last_idx == 99, "inbound frames");
+  // 990ms of capture at 10x
+  check(elapsed >= std::chrono::milliseconds(95) &&
+            elapsed < std::chrono::milliseconds(300),
+        "replay timing");
+  options.speed = 0;
+  options.direction = replay::ReplayOptions::Direction::ALL;
+  const auto begin_fast = std::chrono::steady_clock::now();
+  check(replay::replay(capture, options, [](const auto&) {}) == 100, "all");
+  check(std::chrono::steady_clock::now() - begin_fast <
+            std::chrono::milliseconds(50),
+        "as fast as possible");
+  const auto throughput = replay::throughput_kbits_per_second(
+      capture, replay::ReplayOptions::Direction::ALL);
+  check(throughput.size() == 1 && throughput[0] == 100 * 138 * 8 / 1000,
+        "throughput");
+}
+
+// Needs CAP_NET_RAW, skipped otherwise
+static void test_recorder_loopback() {
+  const std::string dir = TEST_DIR + "/live";
+  pcap::PcapngRingWriter::Options options{};
+  options.directory = dir;
+  options.prefix = "lo";
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(5987);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  pcap::WBPcapRecorder::Stats stats{};
+  {
+    pcap::WBPcapRecorder recorder({"lo"}, options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const std::string payload = "openhd_pcap_test";
+    for (int i = 0; i < 50; i++) {
+      sendto(fd, payload.data(), payload.size(), 0, (sockaddr*)&addr,
+             sizeof(addr));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    stats = recorder.get_stats();
+  }
+  close(fd);
+  const auto capture = pcap::read_pcapng_ring(dir, "lo");
+  if (stats.n_frames_inbound + stats.n_frames_outbound == 0) {
+    std::cout << "Live capture not permitted, skipped\n";
+    return;
+  }
+  check(capture.has_value() && capture->interfaces.size() == 1 &&
+            capture->interfaces[0].link_type == pcap::LINKTYPE_ETHERNET,
+        "live interfaces");
+  int n_found_out = 0, n_found_in = 0;
+  for (const auto& frame : capture->frames) {
+    const std::string data(frame.data.begin(), frame.data.end());
+    if (data.find("openhd_pcap_test") == std::string::npos) continue;
+    (frame.outbound ? n_found_out : n_found_in)++;
+  }
+  // On lo, we see each packet as outgoing and incoming (some kernels deliver
+  // them more than once)
+  check(n_found_out >= 50 && n_found_in >= 50, "live frames");
+  std::cout << "Live: " << capture->frames.size() << " frames\n";
+}
+
+// Inject like WBTxRx does (raw frames on a packet socket) and count how
+// often the given payload was recorded as outbound. Needs CAP_NET_RAW,
+// std::nullopt otherwise.
+static std::optional<int> record_injected(bool qdisc_bypass,
+                                          const std::string& payload) {
+  const int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (fd < 0) return std::nullopt;
+  ifreq ifr{};
+  std::strncpy(ifr.ifr_name, "lo", IFNAMSIZ - 1);
+  ioctl(fd, SIOCGIFINDEX, &ifr);
+  sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = ifr.ifr_ifindex;
+  const int bypass = qdisc_bypass ? 1 : 0;
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+      setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass,
+                 sizeof(bypass)) < 0) {
+    close(fd);
+    return std::nullopt;
+  }
+  // Ethernet header (lo), local experimental ether type
+  std::vector<uint8_t> frame(14, 0);
+  frame[12] = 0x88;
+  frame[13] = 0xB5;
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  const std::string dir = TEST_DIR + "/inject";
+  OHDFilesystemUtil::safe_delete_directory(dir);
+  pcap::PcapngRingWriter::Options options{};
+  options.directory = dir;
+  options.prefix = "lo";
+  {
+    pcap::WBPcapRecorder recorder({"lo"}, options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 0; i < 20; i++) {
+      send(fd, frame.data(), frame.size(), 0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  close(fd);
+  const auto capture = pcap::read_pcapng_ring(dir, "lo");
+  check(capture.has_value(), "injected capture");
+  int n_found_out = 0;
+  for (const auto& recorded : capture->frames) {
+    const std::string data(recorded.data.begin(), recorded.data.end());
+    if (recorded.outbound && data.find(payload) != std::string::npos) {
+      n_found_out++;
+    }
+  }
+  return n_found_out;
+}
+
+// WBLink disables qdisc bypass while recording, otherwise the injected frames
+// would be missing
+static void test_recorder_injected() {
+  const auto n_found = record_injected(false, "openhd_pcap_inject");
+  if (!n_found.has_value()) {
+    std::cout << "Injection not permitted, skipped\n";
+    return;
+  }
+  check(*n_found >= 20, "injected frames recorded as outbound");
+  const auto n_found_bypass =
+      record_injected(true, "openhd_pcap_inject_bypass");
+  check(n_found_bypass.has_value() && *n_found_bypass == 0,
+        "qdisc bypass hides injected frames");
+}
+
+static void test_tx_queue_simulation() {
+  using namespace std::chrono;
+  replay::TxQueueSimulation::Options options{};
+  options.encoder_bitrate_kbits = 10000;
+  options.duration = seconds(60);
+  // Enough capacity
+  const auto good = replay::TxQueueSimulation::run(
+      options, [](milliseconds) { return 20000; });
+  check(good.n_frames == 60 * 60, "n frames");
+  check(good.n_dropped_frames == 0 && good.bitrate_changes.empty(),
+        "no drops");
+  // Interference burst, capacity drops from 20 to 5 MBit/s for 20s
+  auto burst = [](milliseconds t) {
+    return t >= seconds(20) && t < seconds(40) ? 5000 : 20000;
+  };
+  const auto result = replay::TxQueueSimulation::run(options, burst);
+  check(result.n_dropped_frames > 0, "burst drops");
+  check(!result.bitrate_changes.empty() &&
+            result.bitrate_changes.front().first >= seconds(20),
+        "reduction after the burst started");
+  check(result.final_bitrate_kbits < options.encoder_bitrate_kbits,
+        "reduced");
+  // Deterministic
+  const auto again = replay::TxQueueSimulation::run(options, burst);
+  check(again.bitrate_changes == result.bitrate_changes &&
+            again.n_dropped_frames == result.n_dropped_frames,
+        "deterministic");
+  // Drops during the startup delay don't count
+  const auto startup = replay::TxQueueSimulation::run(
+      options, [](milliseconds t) { return t < seconds(4) ? 1000 : 20000; });
+  check(startup.n_dropped_frames > 0 && startup.bitrate_changes.empty(),
+        "startup delay");
+  std::cout << "Burst: dropped " << result.n_dropped_frames << " of "
+            << result.n_frames << ", " << result.bitrate_changes.size()
+            << " reductions, final " << result.final_bitrate_kbits
+            << "kbit/s, max queue delay "
+            << duration_cast<milliseconds>(result.max_queue_delay).count()
+            << "ms\n";
+}
+
+static void print_summary(const pcap::Capture& capture,
+                          const replay::ReplayOptions& options) {
+  struct Second {
+    int n_frames = 0;
+    int64_t n_bytes = 0;
+    int64_t rssi_sum = 0;
+    int n_rssi = 0;
+    std::map<int, int> mcs;
+  };
+  std::vector<Second> seconds;
+  const int64_t first_ts_ns =
+      capture.frames.empty() ? 0 : capture.frames.front().timestamp_ns;
+  replay::ReplayOptions fast = options;
+  fast.speed = 0;
+  replay::replay(capture, fast, [&](const pcap::CapturedFrame& frame) {
+    const auto idx =
+        (std::size_t)((frame.timestamp_ns - first_ts_ns) / 1000000000LL);
+    if (seconds.size() <= idx) seconds.resize(idx + 1);
+    auto& second = seconds[idx];
+    second.n_frames++;
+    second.n_bytes += frame.data.size();
+    const auto radiotap =
+        pcap::parse_radiotap(frame.data.data(), (int)frame.data.size());
+    if (!radiotap.has_value()) return;
+    if (radiotap->rssi_dbm.has_value()) {
+      second.rssi_sum += *radiotap->rssi_dbm;
+      second.n_rssi++;
+    }
+    if (radiotap->mcs_index.has_value()) second.mcs[*radiotap->mcs_index]++;
+  });
+  for (std::size_t i = 0; i < seconds.size(); i++) {
+    const auto& second = seconds[i];
+    std::stringstream ss;
+    ss << i << "s: " << second.n_frames << " frames "
+       << second.n_bytes * 8 / 1000 << "kbit/s";
+    if (second.n_rssi > 0) ss << " rssi:" << second.rssi_sum / second.n_rssi;
+    for (const auto& [mcs, count] : second.mcs) {
+      ss << " mcs" << mcs << ":" << count;
+    }
+    std::cout << ss.str() << "\n";
+  }
+}
+
+static int run_tool(int argc, char* argv[]) {
+  std::string path, prefix = "ground", inject;
+  replay::ReplayOptions options{};
+  options.speed = 0;
+  int simulate_bitrate_kbits = 0;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const std::string key = argv[i];
+    const std::string value = argv[i + 1];
+    if (key == "--replay") {
+      path = value;
+    } else if (key == "--prefix") {
+      prefix = value;
+    } else if (key == "--speed") {
+      options.speed = std::stod(value);
+    } else if (key == "--inject") {
+      inject = value;
+      if (options.speed == 0) options.speed = 1;
+    } else if (key == "--direction") {
+      options.direction =
+          value == "out" ? replay::ReplayOptions::Direction::OUTBOUND
+          : value == "all" ? replay::ReplayOptions::Direction::ALL
+                           : replay::ReplayOptions::Direction::INBOUND;
+    } else if (key == "--simulate") {
+      simulate_bitrate_kbits = std::stoi(value);
+    } else {
+      std::cerr << "Unknown option " << key << "\n";
+      return 1;
+    }
+  }
+  const auto capture = OHDFilesystemUtil::exists(path + "/") ||
+                               !OHDFilesystemUtil::exists(path)
+                           ? pcap::read_pcapng_ring(path, prefix)
+                           : pcap::read_pcapng(path);
+  if (!capture.has_value()) {
+    std::cerr << "Cannot read " << path << "\n";
+    return 1;
+  }
+  std::cout << capture->frames.size() << " frames\n";
+  if (!inject.empty()) {
+    replay::MonitorInjector injector(inject);
+    if (!injector.is_open()) return 1;
+    int n_injected = 0;
+    replay::replay(*capture, options, [&](const pcap::CapturedFrame& frame) {
+      if (injector.inject(replay::make_injectable(frame))) n_injected++;
+    });
+    std::cout << "Injected " << n_injected << " frames\n";
+  } else if (simulate_bitrate_kbits > 0) {
+    const auto throughput =
+        replay::throughput_kbits_per_second(*capture, options.direction);
+    replay::TxQueueSimulation::Options sim_options{};
+    sim_options.encoder_bitrate_kbits = simulate_bitrate_kbits;
+    sim_options.duration = std::chrono::seconds(throughput.size());
+    const auto result = replay::TxQueueSimulation::run(
+        sim_options, [&throughput](std::chrono::milliseconds t) {
+          const auto idx = (std::size_t)(t.count() / 1000);
+          return idx < throughput.size() ? throughput[idx] : 0;
+        });
+    std::cout << "Dropped " << result.n_dropped_frames << " of "
+              << result.n_frames << " frames, final bitrate "
+              << result.final_bitrate_kbits << "kbit/s\n";
+    for (const auto& [t, bitrate] : result.bitrate_changes) {
+      std::cout << t.count() << "ms: " << bitrate << "kbit/s\n";
+    }
+  } else {
+    print_summary(*capture, options);
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    return run_tool(argc, argv);
+  }
+  test_radiotap();
+  test_ring();
+  test_replay();
+  test_recorder_loopback();
+  test_recorder_injected();
+  test_tx_queue_simulation();
+  std::cout << "PASSED\n";
+  return 0;
+}
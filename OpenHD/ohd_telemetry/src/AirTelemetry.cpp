@@ -44,6 +44,9 @@ AirTelemetry::AirTelemetry() : MavlinkSystem(OHD_SYS_ID_AIR) {
   if (OHDPlatform::instance().is_rpi()) {
     m_opt_gpio_control =
         std::make_unique<openhd::telemetry::rpi::GPIOControl>();
+    m_ohd_main_component->set_relay_cb([this](int instance, bool on) {
+      return m_opt_gpio_control->set_relay(instance, on);
+    });
   }
   // NOTE: We don't call set ready yet, since we have to wait until other
   // modules have provided all their paramters.
@@ -62,7 +65,10 @@ AirTelemetry::AirTelemetry() : MavlinkSystem(OHD_SYS_ID_AIR) {
   m_console->debug("Created AirTelemetry");
 }
 
-AirTelemetry::~AirTelemetry() {}
+AirTelemetry::~AirTelemetry() {
+  // The relay cb references the gpio control
+  m_ohd_main_component->set_relay_cb(nullptr);
+}
 
 void AirTelemetry::send_messages_fc(std::vector<MavlinkMessage>& messages) {
   auto [generic, local_only] =
@@ -105,8 +105,10 @@ void GroundTelemetry::on_messages_air_unit(
     const std::vector<MavlinkMessage>& messages) {
   // All messages we get from the Air pi (they might come from the AirPi itself
   // or the FC connected to the air pi) get forwarded straight to all the
-  // client(s) connected to the ground station.
-  send_messages_ground_station_clients(messages);
+  // client(s) connected to the ground station. Compact stats are expanded
+  // into the regular stats messages first.
+  send_messages_ground_station_clients(
+      m_ohd_main_component->expand_compact_stats(messages));
   // Note: No OpenHD component ever talks to another OpenHD component or the FC,
   // so we do not need to do anything else here. tracker serial out - we are
   // only interested in message(s) coming from the FC
@@ -35,6 +35,7 @@
 
 #include "openhd_platform.h"
 #include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 #include "openhd_util_filesystem.h"
 
@@ -246,6 +247,8 @@ int SerialEndpoint::setup_port(const SerialEndpoint::HWOptions& options,
 }
 
 void SerialEndpoint::connect_and_read_loop() {
+  openhd::thread::set_current_thread(
+      "fc_serial", openhd::thread::ThreadClass::REALTIME_RC);
   while (!_stop_requested) {
     if (!OHDFilesystemUtil::exists(m_options.linux_filename)) {
       if (!uart_log_warning_once) {
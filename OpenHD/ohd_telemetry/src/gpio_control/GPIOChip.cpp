@@ -0,0 +1,160 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "GPIOChip.h"
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "openhd_spdlog.h"
+#include "openhd_util_filesystem.h"
+
+namespace openhd::telemetry::rpi {
+
+GPIOLines::GPIOLines(int fd, std::vector<int> offsets)
+    : m_fd(fd), m_offsets(std::move(offsets)) {}
+
+GPIOLines::~GPIOLines() { close(m_fd); }
+
+bool GPIOLines::set_values(uint64_t mask, uint64_t values) {
+  gpio_v2_line_values tmp{};
+  tmp.mask = mask;
+  tmp.bits = values;
+  return ioctl(m_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &tmp) == 0;
+}
+
+bool GPIOLines::set_value(int index, bool high) {
+  return set_values(1ULL << index, high ? 1ULL << index : 0);
+}
+
+std::optional<uint64_t> GPIOLines::get_values(uint64_t mask) {
+  gpio_v2_line_values tmp{};
+  tmp.mask = mask;
+  if (ioctl(m_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &tmp) != 0) {
+    return std::nullopt;
+  }
+  return tmp.bits;
+}
+
+std::vector<GPIOLines::EdgeEvent> GPIOLines::read_edge_events(
+    std::chrono::milliseconds timeout) {
+  std::vector<EdgeEvent> ret;
+  pollfd pfd{m_fd, POLLIN, 0};
+  if (poll(&pfd, 1, (int)timeout.count()) <= 0) return ret;
+  gpio_v2_line_event events[16];
+  const ssize_t n_read = read(m_fd, events, sizeof(events));
+  if (n_read <= 0) return ret;
+  for (int i = 0; i < n_read / (ssize_t)sizeof(gpio_v2_line_event); i++) {
+    ret.push_back(EdgeEvent{(int)events[i].offset,
+                            events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE,
+                            events[i].timestamp_ns, events[i].seqno});
+  }
+  return ret;
+}
+
+std::unique_ptr<GPIOChip> GPIOChip::open(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    openhd::log::get_default()->debug("Cannot open {} {}", path,
+                                      strerror(errno));
+    return nullptr;
+  }
+  gpiochip_info info{};
+  if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  return std::make_unique<GPIOChip>(fd, std::string(info.label), info.lines);
+}
+
+std::optional<std::string> GPIOChip::find_by_label(
+    const std::string& label_prefix) {
+  for (const auto& filename :
+       OHDFilesystemUtil::getAllEntriesFilenameOnlyInDirectory("/dev")) {
+    if (filename.rfind("gpiochip", 0) != 0) continue;
+    const auto path = "/dev/" + filename;
+    auto chip = GPIOChip::open(path);
+    if (chip && chip->get_label().rfind(label_prefix, 0) == 0) {
+      return path;
+    }
+  }
+  return std::nullopt;
+}
+
+GPIOChip::GPIOChip(int fd, std::string label, int n_lines)
+    : m_fd(fd), m_label(std::move(label)), m_n_lines(n_lines) {}
+
+GPIOChip::~GPIOChip() { close(m_fd); }
+
+static std::unique_ptr<GPIOLines> request_lines(
+    int chip_fd, const std::vector<int>& offsets, uint64_t flags,
+    std::optional<uint64_t> output_values, const std::string& consumer) {
+  if (offsets.empty() || offsets.size() > GPIO_V2_LINES_MAX) return nullptr;
+  gpio_v2_line_request request{};
+  for (int i = 0; i < offsets.size(); i++) {
+    request.offsets[i] = offsets[i];
+  }
+  request.num_lines = offsets.size();
+  strncpy(request.consumer, consumer.c_str(), sizeof(request.consumer) - 1);
+  request.config.flags = flags;
+  if (output_values.has_value()) {
+    auto& attr = request.config.attrs[0];
+    attr.attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    attr.attr.values = output_values.value();
+    attr.mask = offsets.size() == 64 ? ~0ULL : (1ULL << offsets.size()) - 1;
+    request.config.num_attrs = 1;
+  }
+  if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) != 0) {
+    openhd::log::get_default()->warn("Cannot request gpio line(s) {}",
+                                     strerror(errno));
+    return nullptr;
+  }
+  return std::make_unique<GPIOLines>(request.fd, offsets);
+}
+
+std::unique_ptr<GPIOLines> GPIOChip::request_outputs(
+    const std::vector<int>& offsets, uint64_t initial_values,
+    const std::string& consumer) {
+  return request_lines(m_fd, offsets, GPIO_V2_LINE_FLAG_OUTPUT, initial_values,
+                       consumer);
+}
+
+std::unique_ptr<GPIOLines> GPIOChip::request_inputs(
+    const std::vector<int>& offsets, Edge edge, const std::string& consumer) {
+  uint64_t flags = GPIO_V2_LINE_FLAG_INPUT;
+  if (edge == Edge::RISING || edge == Edge::BOTH) {
+    flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+  }
+  if (edge == Edge::FALLING || edge == Edge::BOTH) {
+    flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  }
+  return request_lines(m_fd, offsets, flags, std::nullopt, consumer);
+}
+
+}  // namespace openhd::telemetry::rpi
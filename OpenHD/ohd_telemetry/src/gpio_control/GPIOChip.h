@@ -0,0 +1,103 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_GPIO_CONTROLL_GPIOCHIP_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_GPIO_CONTROLL_GPIOCHIP_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace openhd::telemetry::rpi {
+
+/**
+ * GPIO lines requested from a gpio character device (/dev/gpiochipN), via the
+ * v2 uapi. The request (and with it the line state) is held until this is
+ * destroyed. Setting values is a single ioctl for all lines of the request -
+ * no process spawn, a few us.
+ */
+class GPIOLines {
+ public:
+  explicit GPIOLines(int fd, std::vector<int> offsets);
+  GPIOLines(const GPIOLines&) = delete;
+  GPIOLines(const GPIOLines&&) = delete;
+  ~GPIOLines();
+  // Bit i of mask / values refers to the i-th requested line
+  bool set_values(uint64_t mask, uint64_t values);
+  bool set_value(int index, bool high);
+  std::optional<uint64_t> get_values(uint64_t mask = ~0ULL);
+  struct EdgeEvent {
+    // chip line offset
+    int offset;
+    bool rising;
+    // CLOCK_MONOTONIC, taken by the kernel in the irq handler
+    uint64_t timestamp_ns;
+    uint32_t seqno;
+  };
+  // Waits up to timeout for edge events (only if requested as input with
+  // edge detection)
+  std::vector<EdgeEvent> read_edge_events(std::chrono::milliseconds timeout);
+  const std::vector<int>& get_offsets() const { return m_offsets; }
+
+ private:
+  const int m_fd;
+  const std::vector<int> m_offsets;
+};
+
+class GPIOChip {
+ public:
+  // Returns nullptr if the chip cannot be opened
+  static std::unique_ptr<GPIOChip> open(const std::string& path);
+  // Path (/dev/gpiochipN) of the first chip whose label starts with the given
+  // prefix
+  static std::optional<std::string> find_by_label(
+      const std::string& label_prefix);
+  explicit GPIOChip(int fd, std::string label, int n_lines);
+  GPIOChip(const GPIOChip&) = delete;
+  GPIOChip(const GPIOChip&&) = delete;
+  ~GPIOChip();
+  const std::string& get_label() const { return m_label; }
+  int get_n_lines() const { return m_n_lines; }
+  // Request the given lines as outputs, with the given initial values (bit i
+  // - i-th line). Returns nullptr on failure (e.g. line is used by someone
+  // else).
+  std::unique_ptr<GPIOLines> request_outputs(
+      const std::vector<int>& offsets, uint64_t initial_values,
+      const std::string& consumer = "openhd");
+  enum class Edge { NONE, RISING, FALLING, BOTH };
+  std::unique_ptr<GPIOLines> request_inputs(
+      const std::vector<int>& offsets, Edge edge = Edge::NONE,
+      const std::string& consumer = "openhd");
+
+ private:
+  const int m_fd;
+  const std::string m_label;
+  const int m_n_lines;
+};
+
+}  // namespace openhd::telemetry::rpi
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_GPIO_CONTROLL_GPIOCHIP_H_
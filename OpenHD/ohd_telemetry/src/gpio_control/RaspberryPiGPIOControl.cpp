@@ -23,10 +23,18 @@
 
 #include "RaspberryPiGPIOControl.h"
 
+#include "openhd_action_handler.h"
 #include "openhd_util.h"
 
 namespace openhd::telemetry::rpi {
 
+// The gpio(s) that can be controlled, also the relay instance(s) for
+// MAV_CMD_DO_SET_RELAY
+static constexpr std::array<int, 2> CONTROLLABLE_GPIOS = {2, 26};
+static constexpr auto RC_CHANNELS_TAG = "rpi_gpio_control";
+// Label of the gpio chip of the rpi header (bcm2835 / bcm2711 / rp1)
+static constexpr auto RPI_GPIO_CHIP_LABEL_PREFIX = "pinctrl-";
+
 static void configure_gpio_as_output(int gpio_number) {
   OHDUtil::run_command("raspi-gpio",
                        {"set", std::to_string(gpio_number), "op"});
@@ -37,51 +45,165 @@ static void configure_gpio_low_high(int gpio_number, bool low) {
   OHDUtil::run_command("raspi-gpio", {"set", std::to_string(gpio_number), tmp});
 }
 
-static void configure_gpio(int gpio_number, int gpio_value) {
-  if (gpio_value == GPIO_LEAVE_UNTOUCHED) {
-    return;
-  }
-  const bool low = gpio_value == GPIO_LOW;
-  configure_gpio_as_output(gpio_number);
-  configure_gpio_low_high(gpio_number, low);
-}
-
 static bool validate_gpio_setting_int(int value) {
   return value == 0 || value == 1 || value == 2;
 }
 
+static bool validate_rc_channel(int value) { return value >= 0 && value <= 18; }
+
 GPIOControl::GPIOControl() {
+  m_console = openhd::log::create_or_get("gpio_control");
   m_settings = std::make_unique<GPIOControlSettingsHolder>();
-  const auto& tmp = m_settings->get_settings();
-  configure_gpio(2, tmp.gpio_2);
-  configure_gpio(2, tmp.gpio_26);
+  const auto chip_path = GPIOChip::find_by_label(RPI_GPIO_CHIP_LABEL_PREFIX);
+  if (chip_path.has_value()) {
+    m_chip = GPIOChip::open(chip_path.value());
+  }
+  if (m_chip) {
+    m_console->debug("Using {} ({})", chip_path.value(), m_chip->get_label());
+  } else {
+    m_console->warn("No gpio chip, using raspi-gpio");
+  }
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (const int gpio : CONTROLLABLE_GPIOS) {
+      update_from_settings(gpio);
+    }
+    apply();
+  }
+  openhd::FCRcChannelsHelper::instance().register_listener(
+      RC_CHANNELS_TAG, [this](const std::array<int, 18>& rc_channels) {
+        on_rc_channels(rc_channels);
+      });
+}
+
+GPIOControl::~GPIOControl() {
+  openhd::FCRcChannelsHelper::instance().unregister_listener(RC_CHANNELS_TAG);
 }
 
 std::vector<openhd::Setting> GPIOControl::get_all_settings() {
   std::vector<openhd::Setting> ret;
-  auto cb_gpio2 = [this](std::string, int value) {
-    if (!validate_gpio_setting_int(value)) return false;
-    m_settings->unsafe_get_settings().gpio_2 = value;
-    m_settings->persist();
-    configure_gpio(2, value);
-    return true;
-  };
-  ret.push_back(openhd::Setting{
-      "GPIO_2",
-      openhd::IntSetting{static_cast<int>(m_settings->get_settings().gpio_2),
-                         cb_gpio2}});
-  auto cb_gpio26 = [this](std::string, int value) {
-    if (!validate_gpio_setting_int(value)) return false;
-    m_settings->unsafe_get_settings().gpio_2 = value;
-    m_settings->persist();
-    configure_gpio(26, value);
-    return true;
-  };
-  ret.push_back(openhd::Setting{
-      "GPIO_26",
-      openhd::IntSetting{static_cast<int>(m_settings->get_settings().gpio_26),
-                         cb_gpio26}});
+  for (const int gpio : CONTROLLABLE_GPIOS) {
+    auto cb_mode = [this, gpio](std::string, int value) {
+      if (!validate_gpio_setting_int(value)) return false;
+      std::lock_guard<std::mutex> guard(m_mutex);
+      mode_setting(gpio) = value;
+      m_settings->persist();
+      update_from_settings(gpio);
+      apply();
+      return true;
+    };
+    auto cb_rc_channel = [this, gpio](std::string, int value) {
+      if (!validate_rc_channel(value)) return false;
+      std::lock_guard<std::mutex> guard(m_mutex);
+      rc_channel_setting(gpio) = value;
+      m_settings->persist();
+      update_from_settings(gpio);
+      apply();
+      return true;
+    };
+    std::lock_guard<std::mutex> guard(m_mutex);
+    const auto name = "GPIO_" + std::to_string(gpio);
+    ret.push_back(openhd::Setting{
+        name, openhd::IntSetting{mode_setting(gpio), cb_mode}});
+    ret.push_back(openhd::Setting{
+        name + "_RC",
+        openhd::IntSetting{rc_channel_setting(gpio), cb_rc_channel}});
+  }
   return ret;
 }
 
+bool GPIOControl::set_relay(int instance, bool on) {
+  if (instance < 0 || instance >= CONTROLLABLE_GPIOS.size()) return false;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  m_outputs[CONTROLLABLE_GPIOS[instance]] = on;
+  apply();
+  return true;
+}
+
+void GPIOControl::on_rc_channels(const std::array<int, 18>& rc_channels) {
+  std::lock_guard<std::mutex> guard(m_mutex);
+  bool changed = false;
+  for (const int gpio : CONTROLLABLE_GPIOS) {
+    const int channel = rc_channel_setting(gpio);
+    if (channel <= 0 || channel > rc_channels.size()) continue;
+    const int value = rc_channels[channel - 1];
+    bool high;
+    if (value > 1700) {
+      high = true;
+    } else if (value > 0 && value < 1300) {
+      high = false;
+    } else {
+      // Unused channel / in between
+      continue;
+    }
+    auto output = m_outputs.find(gpio);
+    if (output == m_outputs.end() || output->second != high) {
+      m_outputs[gpio] = high;
+      changed = true;
+    }
+  }
+  if (changed) apply();
+}
+
+void GPIOControl::update_from_settings(int gpio) {
+  const int mode = mode_setting(gpio);
+  if (mode == GPIO_HIGH || mode == GPIO_LOW) {
+    m_outputs[gpio] = mode == GPIO_HIGH;
+  } else if (rc_channel_setting(gpio) > 0) {
+    // Driven once the rc channel is valid
+    m_outputs.emplace(gpio, false);
+  } else {
+    m_outputs.erase(gpio);
+  }
+}
+
+int& GPIOControl::mode_setting(int gpio) {
+  auto& settings = m_settings->unsafe_get_settings();
+  return gpio == 2 ? settings.gpio_2 : settings.gpio_26;
+}
+
+int& GPIOControl::rc_channel_setting(int gpio) {
+  auto& settings = m_settings->unsafe_get_settings();
+  return gpio == 2 ? settings.gpio_2_rc_channel : settings.gpio_26_rc_channel;
+}
+
+void GPIOControl::apply() {
+  if (!m_chip) {
+    for (const auto& [gpio, high] : m_outputs) {
+      auto applied = m_applied_outputs.find(gpio);
+      if (applied != m_applied_outputs.end() && applied->second == high) {
+        continue;
+      }
+      configure_gpio_as_output(gpio);
+      configure_gpio_low_high(gpio, !high);
+    }
+    m_applied_outputs = m_outputs;
+    return;
+  }
+  std::vector<int> offsets;
+  uint64_t values = 0;
+  for (const auto& [gpio, high] : m_outputs) {
+    if (high) values |= 1ULL << offsets.size();
+    offsets.push_back(gpio);
+  }
+  if (offsets.empty()) {
+    m_lines = nullptr;
+    return;
+  }
+  if (m_lines && m_lines->get_offsets() == offsets) {
+    // All in one go
+    if (!m_lines->set_values((1ULL << offsets.size()) - 1, values)) {
+      m_console->warn("Cannot set gpio values");
+    }
+    return;
+  }
+  // The set of driven gpios changed, request them again (the previous request
+  // needs to be released first)
+  m_lines = nullptr;
+  m_lines = m_chip->request_outputs(offsets, values);
+  if (!m_lines) {
+    m_console->warn("Cannot drive {} gpio(s)", offsets.size());
+  }
+}
+
 }  // namespace openhd::telemetry::rpi
@@ -24,24 +24,55 @@
 #ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_GPIO_CONTROLL_RASPBERRYPIGPIOCONTROL_H_
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_GPIO_CONTROLL_RASPBERRYPIGPIOCONTROL_H_
 
+#include <array>
+#include <map>
 #include <memory>
+#include <mutex>
 
+#include "GPIOChip.h"
 #include "RaspberryPiGPIOControlSettings.h"
 #include "openhd_settings_imp.h"
+#include "openhd_spdlog.h"
 
 namespace openhd::telemetry::rpi {
 
 // This class exposes the following feature on rpi:
 // Control GPIO pins (set them to low / high to - for example - control a
-// landing gear) via the openhd mavlink settings (mavlink extended parameters'
-// protocol)
+// landing gear) via
+// - the openhd mavlink settings (mavlink extended parameters' protocol)
+// - MAV_CMD_DO_SET_RELAY (relay instance 0: GPIO 2, 1: GPIO 26)
+// - an FC rc channel (high above 1700, low below 1300)
+// The pins are driven via the gpio character device, with the line(s) held
+// open - a change is a single ioctl (falls back to raspi-gpio if there is no
+// usable gpio chip).
 class GPIOControl {
  public:
   GPIOControl();
+  ~GPIOControl();
+  GPIOControl(const GPIOControl&) = delete;
+  GPIOControl(const GPIOControl&&) = delete;
   std::vector<openhd::Setting> get_all_settings();
+  // Returns false if there is no such relay
+  bool set_relay(int instance, bool on);
+  void on_rc_channels(const std::array<int, 18>& rc_channels);
 
  private:
+  // Drives the pins as given by m_outputs
+  void apply();
+  // Updates the output(s) from the mode / rc channel setting of the given gpio
+  void update_from_settings(int gpio);
+  int& mode_setting(int gpio);
+  int& rc_channel_setting(int gpio);
+  std::shared_ptr<spdlog::logger> m_console;
+  std::mutex m_mutex;
   std::unique_ptr<openhd::telemetry::rpi::GPIOControlSettingsHolder> m_settings;
+  std::unique_ptr<GPIOChip> m_chip;
+  // All the currently driven gpios, requested at once
+  std::unique_ptr<GPIOLines> m_lines;
+  // Driven gpio(s) and their value (high)
+  std::map<int, bool> m_outputs;
+  // Last applied, for the raspi-gpio fallback
+  std::map<int, bool> m_applied_outputs;
 };
 
 }  // namespace openhd::telemetry::rpi
@@ -26,7 +26,21 @@
 #include "include_json.hpp"
 
 namespace openhd::telemetry::rpi {
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(GPIOControlSettings, gpio_2);
+// Written by hand, such that files from older versions (only gpio_2) can
+// still be read
+static void to_json(nlohmann::json &j, const GPIOControlSettings &data) {
+  j = nlohmann::json{{"gpio_2", data.gpio_2},
+                     {"gpio_26", data.gpio_26},
+                     {"gpio_2_rc_channel", data.gpio_2_rc_channel},
+                     {"gpio_26_rc_channel", data.gpio_26_rc_channel}};
+}
+
+static void from_json(const nlohmann::json &j, GPIOControlSettings &data) {
+  j.at("gpio_2").get_to(data.gpio_2);
+  data.gpio_26 = j.value("gpio_26", GPIO_LEAVE_UNTOUCHED);
+  data.gpio_2_rc_channel = j.value("gpio_2_rc_channel", 0);
+  data.gpio_26_rc_channel = j.value("gpio_26_rc_channel", 0);
+}
 
 std::optional<GPIOControlSettings> GPIOControlSettingsHolder::impl_deserialize(
     const std::string &file_as_string) const {
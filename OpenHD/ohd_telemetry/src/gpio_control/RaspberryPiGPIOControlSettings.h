@@ -40,6 +40,9 @@ static constexpr int GPIO_LOW = 2;
 struct GPIOControlSettings {
   int gpio_2 = GPIO_LEAVE_UNTOUCHED;
   int gpio_26 = GPIO_LEAVE_UNTOUCHED;
+  // Drive the gpio from this (1-based) FC rc channel, 0 = disabled
+  int gpio_2_rc_channel = 0;
+  int gpio_26_rc_channel = 0;
 };
 
 static const std::string SETTINGS_DIRECTORY =
@@ -24,10 +24,14 @@
 #ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_OHDLINKSTATISTICSHELPER_H_
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_OHDLINKSTATISTICSHELPER_H_
 
+#include <chrono>
+#include <cstring>
+
 #include "../mav_include.h"
 #include "openhd_action_handler.h"
 #include "openhd_external_device.h"
 #include "openhd_link_statistics.hpp"
+#include "openhd_link_statistics_codec.h"
 
 namespace openhd::LinkStatisticsHelper {
 
@@ -124,9 +128,11 @@ static MavlinkMessage pack_vid_air(
   tmp.curr_injected_pps = stats.curr_injected_pps;
   tmp.curr_dropped_frames = stats.curr_dropped_frames;
   tmp.curr_fec_percentage = stats.curr_fec_percentage;
-  tmp.dummy0 = stats.dummy0;
-  tmp.dummy1 = stats.dummy1;
-  tmp.dummy2 = stats.dummy2;
+  // See Xmavlink_openhd_stats_wb_video_air_t
+  tmp.dummy0 = (int8_t)stats.thermal_protection_level;
+  tmp.dummy1 = stats.thermal_hottest_temp_c;
+  tmp.dummy2 =
+      (stats.thermal_tx_power_perc << 8) | stats.thermal_bitrate_perc;
   mavlink_msg_openhd_stats_wb_video_air_encode(system_id, component_id, &msg.m,
                                                &tmp);
   return msg;
@@ -209,6 +215,31 @@ static MavlinkMessage pack_camera_stats(
                                               &tmp);
   return msg;
 }
+// There is no openhd message for audio (yet) - use the generic NAMED_VALUE_INT
+static std::vector<MavlinkMessage> pack_audio_playout_stats(
+    const uint8_t system_id, const uint8_t component_id,
+    const openhd::LinkActionHandler::AudioPlayoutStats& stats) {
+  const auto time_boot_ms = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+  std::vector<MavlinkMessage> ret;
+  auto pack = [&](const char* name, int32_t value) {
+    MavlinkMessage msg;
+    mavlink_named_value_int_t tmp{};
+    tmp.time_boot_ms = time_boot_ms;
+    tmp.value = value;
+    // Not null terminated if the name has 10 chars
+    std::strncpy(tmp.name, name, sizeof(tmp.name));
+    mavlink_msg_named_value_int_encode(system_id, component_id, &msg.m, &tmp);
+    ret.push_back(msg);
+  };
+  pack("AUD_LOSS", stats.loss_perc);
+  pack("AUD_M2E", stats.mouth_to_ear_avg_us);
+  pack("AUD_M2EMAX", stats.mouth_to_ear_max_us);
+  pack("AUD_MARGIN", stats.target_margin_us);
+  return ret;
+}
 static MavlinkMessage pack_mavlink_openhd_wifbroadcast_gnd_operating_mode(
     const uint8_t system_id, const uint8_t component_id,
     const openhd::link_statistics::
@@ -285,5 +316,62 @@ static MavlinkMessage generate_sys_status1(
   return msg;
 }
 
+// The regular stats messages of the air unit (cards, link, telemetry, video)
+static std::vector<MavlinkMessage> pack_stats_air(
+    const uint8_t system_id, const uint8_t component_id,
+    const openhd::link_statistics::StatsAirGround& stats) {
+  std::vector<MavlinkMessage> ret;
+  int card_index = 0;
+  for (const auto& card_stats : stats.cards) {
+    if (!card_stats.NON_MAVLINK_CARD_ACTIVE) {
+      // skip non active cards
+      continue;
+    }
+    ret.push_back(pack_card(system_id, component_id, card_index, card_stats));
+    card_index++;
+  }
+  ret.push_back(
+      pack_link_general(system_id, component_id, stats.monitor_mode_link));
+  ret.push_back(pack_tele(system_id, component_id, stats.telemetry));
+  for (const auto& video : stats.stats_wb_video_air) {
+    ret.push_back(pack_vid_air(system_id, component_id, video));
+  }
+  ret.push_back(pack_vid_air_fec_performance(system_id, component_id,
+                                             stats.air_fec_performance));
+  return ret;
+}
+
+// Compact air stats (see openhd_link_statistics_codec.h) are sent as
+// V2_EXTENSION, message type is from the range reserved for local use.
+// Payload: [length][data]
+static constexpr uint16_t COMPACT_STATS_MESSAGE_TYPE = 32769;
+
+static MavlinkMessage pack_compact_stats(const uint8_t system_id,
+                                         const uint8_t component_id,
+                                         const std::vector<uint8_t>& data) {
+  MavlinkMessage msg;
+  mavlink_v2_extension_t tmp{};
+  tmp.message_type = COMPACT_STATS_MESSAGE_TYPE;
+  static_assert(sizeof(tmp.payload) >
+                openhd::link_statistics::COMPACT_STATS_MAX_PAYLOAD);
+  tmp.payload[0] = (uint8_t)data.size();
+  memcpy(tmp.payload + 1, data.data(), data.size());
+  mavlink_msg_v2_extension_encode(system_id, component_id, &msg.m, &tmp);
+  return msg;
+}
+
+static std::optional<std::vector<uint8_t>> unpack_compact_stats(
+    const MavlinkMessage& msg) {
+  if (msg.m.msgid != MAVLINK_MSG_ID_V2_EXTENSION) return std::nullopt;
+  mavlink_v2_extension_t tmp;
+  mavlink_msg_v2_extension_decode(&msg.m, &tmp);
+  if (tmp.message_type != COMPACT_STATS_MESSAGE_TYPE) return std::nullopt;
+  const int len = tmp.payload[0];
+  if (len > openhd::link_statistics::COMPACT_STATS_MAX_PAYLOAD) {
+    return std::nullopt;
+  }
+  return std::vector<uint8_t>(tmp.payload + 1, tmp.payload + 1 + len);
+}
+
 }  // namespace openhd::LinkStatisticsHelper
 #endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_INTERNAL_OHDLINKSTATISTICSHELPER_H_
@@ -23,6 +23,7 @@
 
 #include "OHDMainComponent.h"
 
+#include <algorithm>
 #include <iostream>
 #include <openhd_global_constants.hpp>
 #include <utility>
@@ -52,6 +53,11 @@ OHDMainComponent::OHDMainComponent(uint8_t parent_sys_id, bool runsOnAir)
   if (!RUNS_ON_AIR && config.GEN_ENABLE_LAST_KNOWN_POSITION) {
     m_last_known_position = std::make_unique<LastKnowPosition>();
   }
+  if (RUNS_ON_AIR && config.GEN_STATS_COMPACT) {
+    m_stats_encoder =
+        std::make_unique<openhd::link_statistics::StatsEncoder>();
+    m_telemetry_downlink_bps = config.GEN_TELEMETRY_DOWNLINK_KBITS * 1000;
+  }
 }
 
 OHDMainComponent::~OHDMainComponent() {}
@@ -130,6 +136,10 @@ std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats() {
     m_console->warn("Mismatch air/ground");
     return ret;
   }
+  if (RUNS_ON_AIR) {
+    return openhd::LinkStatisticsHelper::pack_stats_air(m_sys_id, m_comp_id,
+                                                        latest_stats);
+  }
   // stats for all the wifi card(s)
   int card_index = 0;
   for (const auto& card_stats : latest_stats.cards) {
@@ -146,45 +156,82 @@ std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats() {
       m_sys_id, m_comp_id, latest_stats.monitor_mode_link));
   ret.push_back(openhd::LinkStatisticsHelper::pack_tele(
       m_sys_id, m_comp_id, latest_stats.telemetry));
-  if (RUNS_ON_AIR) {
-    for (const auto& stats : latest_stats.stats_wb_video_air) {
-      ret.push_back(openhd::LinkStatisticsHelper::pack_vid_air(
-          m_sys_id, m_comp_id, stats));
-    }
-    ret.push_back(openhd::LinkStatisticsHelper::pack_vid_air_fec_performance(
-        m_sys_id, m_comp_id, latest_stats.air_fec_performance));
-  } else {
-    for (const auto& ground_video : latest_stats.stats_wb_video_ground) {
-      ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd(
-          m_sys_id, m_comp_id, ground_video));
-    }
-    ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd_fec_performance(
-        m_sys_id, m_comp_id, latest_stats.gnd_fec_performance));
+  for (const auto& ground_video : latest_stats.stats_wb_video_ground) {
+    ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd(
+        m_sys_id, m_comp_id, ground_video));
+  }
+  ret.push_back(openhd::LinkStatisticsHelper::pack_vid_gnd_fec_performance(
+      m_sys_id, m_comp_id, latest_stats.gnd_fec_performance));
+  ret.push_back(
+      openhd::LinkStatisticsHelper::
+          pack_mavlink_openhd_wifbroadcast_gnd_operating_mode(
+              m_sys_id, m_comp_id, latest_stats.gnd_operating_mode));
+  if (openhd::LinkActionHandler::instance().wb_get_supported_channels !=
+      nullptr) {
+    auto channels =
+        openhd::LinkActionHandler::instance().wb_get_supported_channels();
+    ret.push_back(openhd::LinkStatisticsHelper::
+                      generate_msg_openhd_wifibroadcast_supported_channels(
+                          m_sys_id, m_comp_id, channels));
+  }
+  auto progress_x = openhd::LinkActionHandler::instance().get_analyze_results();
+  for (auto& progress : progress_x) {
+    ret.push_back(
+        openhd::LinkStatisticsHelper::generate_msg_analyze_channels_progress(
+            m_sys_id, m_comp_id, progress));
+  }
+  auto progress_y =
+      openhd::LinkActionHandler::instance().get_scan_channels_progress();
+  for (auto& progress : progress_y) {
     ret.push_back(
-        openhd::LinkStatisticsHelper::
-            pack_mavlink_openhd_wifbroadcast_gnd_operating_mode(
-                m_sys_id, m_comp_id, latest_stats.gnd_operating_mode));
-    if (openhd::LinkActionHandler::instance().wb_get_supported_channels !=
-        nullptr) {
-      auto channels =
-          openhd::LinkActionHandler::instance().wb_get_supported_channels();
-      ret.push_back(openhd::LinkStatisticsHelper::
-                        generate_msg_openhd_wifibroadcast_supported_channels(
-                            m_sys_id, m_comp_id, channels));
+        openhd::LinkStatisticsHelper::generate_msg_scan_channels_progress(
+            m_sys_id, m_comp_id, progress));
+  }
+  return ret;
+}
+
+std::vector<MavlinkMessage> OHDMainComponent::generate_mav_wb_stats_compact() {
+  const auto latest_stats =
+      openhd::LinkActionHandler::instance().get_link_stats();
+  if (!latest_stats.ready || !latest_stats.is_air) {
+    return {};
+  }
+  // The stats get half of what the other telemetry leaves
+  const int other_telemetry_bps =
+      std::max(0, latest_stats.telemetry.curr_tx_bps -
+                      m_stats_encoder->get_curr_bps());
+  const int available_bps =
+      std::max(1000, (m_telemetry_downlink_bps - other_telemetry_bps) / 2);
+  m_stats_encoder->set_available_bps(available_bps);
+  std::vector<MavlinkMessage> ret;
+  for (const auto& data : m_stats_encoder->encode(latest_stats)) {
+    auto msg = openhd::LinkStatisticsHelper::pack_compact_stats(
+        m_sys_id, m_comp_id, data);
+    if (openhd::link_statistics::is_keyframe(data)) {
+      // All the following deltas depend on it
+      msg.recommended_n_injections = 2;
     }
-    auto progress_x =
-        openhd::LinkActionHandler::instance().get_analyze_results();
-    for (auto& progress : progress_x) {
-      ret.push_back(
-          openhd::LinkStatisticsHelper::generate_msg_analyze_channels_progress(
-              m_sys_id, m_comp_id, progress));
+    ret.push_back(msg);
+  }
+  return ret;
+}
+
+std::vector<MavlinkMessage> OHDMainComponent::expand_compact_stats(
+    const std::vector<MavlinkMessage>& messages) {
+  std::vector<MavlinkMessage> ret;
+  ret.reserve(messages.size());
+  for (const auto& msg : messages) {
+    const auto data = openhd::LinkStatisticsHelper::unpack_compact_stats(msg);
+    if (!data.has_value()) {
+      ret.push_back(msg);
+      continue;
     }
-    auto progress_y =
-        openhd::LinkActionHandler::instance().get_scan_channels_progress();
-    for (auto& progress : progress_y) {
-      ret.push_back(
-          openhd::LinkStatisticsHelper::generate_msg_scan_channels_progress(
-              m_sys_id, m_comp_id, progress));
+    const auto stats =
+        m_stats_decoder.decode(data.value().data(), data.value().size());
+    if (stats.has_value()) {
+      // Same sys / comp id as if they were sent by the air unit
+      OHDUtil::vec_append(ret, openhd::LinkStatisticsHelper::pack_stats_air(
+                                   msg.m.sysid, msg.m.compid, stats.value()));
     }
   }
   return ret;
@@ -346,10 +393,16 @@ OHDMainComponent::create_broadcast_stats_if_needed() {
       ret.push_back(generate_ohd_version());
     }
   }
+  if (m_stats_encoder) {
+    // The encoder decides itself when (and what) to send
+    OHDUtil::vec_append(ret, generate_mav_wb_stats_compact());
+  }
   const auto elapsed_wb = now - m_last_wb_stats;
   if (elapsed_wb > m_wb_stats_interval) {
     m_last_wb_stats = now;
-    OHDUtil::vec_append(ret, generate_mav_wb_stats());
+    if (!m_stats_encoder) {
+      OHDUtil::vec_append(ret, generate_mav_wb_stats());
+    }
     if (RUNS_ON_AIR) {
       auto cam_stats1 = openhd::LinkActionHandler::instance().get_cam_info(0);
       auto cam_stats2 = openhd::LinkActionHandler::instance().get_cam_info(1);
@@ -364,6 +417,14 @@ OHDMainComponent::create_broadcast_stats_if_needed() {
         ret.push_back(openhd::LinkStatisticsHelper::pack_camera_stats(
             m_sys_id, MAV_COMP_ID_CAMERA2, cam_stats2));
       }
+    } else {
+      const auto audio_stats =
+          openhd::LinkActionHandler::instance().get_audio_playout_stats();
+      if (audio_stats.active) {
+        OHDUtil::vec_append(
+            ret, openhd::LinkStatisticsHelper::pack_audio_playout_stats(
+                     m_sys_id, m_comp_id, audio_stats));
+      }
     }
   }
   return ret;
@@ -461,11 +522,33 @@ void OHDMainComponent::process_command_self(
       message_buffer.push_back(
           ack_command(source_sys_id, source_comp_id, command.command, success));
     }
+  } else if (command.command == MAV_CMD_DO_SET_RELAY) {
+    // https://mavlink.io/en/messages/common.html#MAV_CMD_DO_SET_RELAY
+    if (!RUNS_ON_AIR) {
+      m_console->debug("Set relay is only a feature for air unit");
+      return;
+    }
+    const int instance = static_cast<int>(command.param1);
+    const bool on = command.param2 >= 1.0f;
+    bool success = false;
+    {
+      std::lock_guard<std::mutex> guard(m_set_relay_cb_mutex);
+      if (m_set_relay_cb) success = m_set_relay_cb(instance, on);
+    }
+    m_console->debug("MAV_CMD_DO_SET_RELAY {} {} result: {}", instance, on,
+                     success);
+    message_buffer.push_back(
+        ack_command(source_sys_id, source_comp_id, command.command, success));
   } else {
     m_console->debug("Unknown command {}", command.command);
   }
 }
 
+void OHDMainComponent::set_relay_cb(OHDMainComponent::SET_RELAY_CB cb) {
+  std::lock_guard<std::mutex> guard(m_set_relay_cb_mutex);
+  m_set_relay_cb = std::move(cb);
+}
+
 std::vector<MavlinkMessage> OHDMainComponent::perform_time_synchronisation() {
   if (RUNS_ON_AIR) {
     // We only ever ask the air for a timesync
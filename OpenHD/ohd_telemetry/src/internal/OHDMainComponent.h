@@ -25,6 +25,7 @@
 #define XMAVLINKSERVICE_INTERNALTELEMETRY_H
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <mutex>
 #include <optional>
@@ -36,6 +37,7 @@
 #include "last_known_position/LastKnowPosition.h"
 #include "openhd_action_handler.h"
 #include "openhd_link_statistics.hpp"
+#include "openhd_link_statistics_codec.h"
 #include "openhd_platform.h"
 #include "openhd_spdlog.h"
 #include "routing/MavlinkComponent.hpp"
@@ -72,6 +74,14 @@ class OHDMainComponent : public MavlinkComponent {
       const std::vector<MavlinkMessage>& messages);
   std::optional<MavlinkMessage> handle_timesync_message(
       const MavlinkMessage& message);
+  // Ground only: replaces the compact stats message(s) from the air unit with
+  // the regular stats messages (which is what QOpenHD understands)
+  std::vector<MavlinkMessage> expand_compact_stats(
+      const std::vector<MavlinkMessage>& messages);
+  // Air only: MAV_CMD_DO_SET_RELAY is forwarded to this cb (relay instance,
+  // on / off). Returns true on success.
+  typedef std::function<bool(int instance, bool on)> SET_RELAY_CB;
+  void set_relay_cb(SET_RELAY_CB cb);
 
  private:
   const bool RUNS_ON_AIR;
@@ -95,6 +105,12 @@ class OHDMainComponent : public MavlinkComponent {
       std::chrono::steady_clock::now();
   std::vector<MavlinkMessage> create_broadcast_stats_if_needed();
   [[nodiscard]] std::vector<MavlinkMessage> generate_mav_wb_stats();
+  // Air only, if enabled: sends the stats as compact message(s) instead, at
+  // an interval depending on the telemetry bandwidth left.
+  std::unique_ptr<openhd::link_statistics::StatsEncoder> m_stats_encoder;
+  int m_telemetry_downlink_bps = 0;
+  [[nodiscard]] std::vector<MavlinkMessage> generate_mav_wb_stats_compact();
+  openhd::link_statistics::StatsDecoder m_stats_decoder;
   [[nodiscard]] MavlinkMessage generate_ohd_version() const;
   // pack all the buffered log messages
   std::vector<MavlinkMessage> generateLogMessages();
@@ -107,6 +123,8 @@ class OHDMainComponent : public MavlinkComponent {
   // Only set / used on air, where we have a uart connection to the FC and
   // therefore can be 100% sure about the FC sys id
   std::atomic_int16_t m_air_fc_sys_id = -1;
+  std::mutex m_set_relay_cb_mutex;
+  SET_RELAY_CB m_set_relay_cb = nullptr;
 
  private:
   std::vector<MavlinkMessage> perform_time_synchronisation();
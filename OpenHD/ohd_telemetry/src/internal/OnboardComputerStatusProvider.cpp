@@ -26,6 +26,7 @@
 #include "onboard_computer_status.hpp"
 #include "onboard_computer_status_rpi.hpp"
 #include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util_filesystem.h"
 
 // INA219 stuff
@@ -119,6 +120,8 @@ OnboardComputerStatusProvider::get_current_status() {
 }
 
 void OnboardComputerStatusProvider::calculate_cpu_usage_until_terminate() {
+  openhd::thread::set_current_thread(
+      "status_cpu", openhd::thread::ThreadClass::BACKGROUND);
   while (!terminate) {
     const auto before = std::chrono::steady_clock::now();
     const auto value = openhd::onboard::read_cpuload_once_blocking();
@@ -139,6 +142,8 @@ void OnboardComputerStatusProvider::calculate_cpu_usage_until_terminate() {
 }
 
 void OnboardComputerStatusProvider::calculate_other_until_terminate() {
+  openhd::thread::set_current_thread(
+      "status_other", openhd::thread::ThreadClass::BACKGROUND);
   while (!terminate) {
     // We always sleep for 1 second
     // just to make sure to not hog too much cpu here.
@@ -24,22 +24,26 @@
 #ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_LASTKNOWPOSITION_H_
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_LASTKNOWPOSITION_H_
 
+#include <atomic>
 #include <chrono>
-#include <list>
 #include <memory>
 #include <mutex>
-#include <optional>
 #include <string>
 #include <thread>
+#include <vector>
+
+#include "PositionJournal.h"
 
 /**
  * This class exposes the following simple functionality:
- * Have a file on the disc that contains the X last known positions of the UAV
+ * Have a file on the disc that contains the last known positions of the UAV
  * Needs to be updated by listening for MAVLINK_MSG_ID_GLOBAL_POSITION_INT
- * messages Writing to the disk happens max. 1 time per second and is decoupled
- * in an extra thread - this way, we reduce the file writes AND are guaranteed
- * data is written after a specific amount of time even if the "on_new_position"
- * is not called anymore by the telemetry parsing thread.
+ * messages. The positions are appended to a journal (see PositionJournal.h),
+ * which survives a power cut. Writing to the disk is decoupled in an extra
+ * thread, and the data is synced at least once per second - this way, we
+ * reduce the file writes AND are guaranteed data is written after a specific
+ * amount of time even if the "on_new_position" is not called anymore by the
+ * telemetry parsing thread.
  */
 class LastKnowPosition {
  public:
@@ -49,24 +53,18 @@ class LastKnowPosition {
 
  private:
   const std::string m_this_flight_filename;
-  struct Position {
-    // When the position was received
-    std::chrono::steady_clock::time_point recv;
-    double latitude;
-    double longitude;
-    double altitude_m;
-  };
+  std::unique_ptr<openhd::telemetry::PositionJournalWriter> m_journal;
   std::unique_ptr<std::thread> m_write_thread;
-  bool m_write_run = true;
+  std::atomic<bool> m_write_run = true;
   void write_position_loop();
+  void append_new_positions();
   std::mutex m_position_mutex;
-  std::list<Position> m_positions;
-  bool m_positions_updated = false;
-  static constexpr auto MAX_N_BUFFERED_POSITIONS = 20;
-  // Gets the last X position values or std::nullopt if there was no update
-  std::optional<std::list<Position>> threadsafe_get_positions_if_updated();
-  void threadsafe_update_position(Position position);
-  static std::string positions_to_file(const std::list<Position>& positions);
+  // Received, but not yet handed to the journal
+  std::vector<openhd::telemetry::JournalPosition> m_positions;
+  // If the write thread cannot keep up, the oldest ones are dropped
+  static constexpr auto MAX_N_BUFFERED_POSITIONS = 100;
+  std::vector<openhd::telemetry::JournalPosition>
+  threadsafe_get_new_positions();
 };
 
 #endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_LASTKNOWPOSITION_H_
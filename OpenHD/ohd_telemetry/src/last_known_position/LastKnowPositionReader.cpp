@@ -0,0 +1,83 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Recovers the last known position from the position journal(s), e.g. after
+// a crash / power loss. Usage:
+// openhd_last_known_position [journal file or directory]
+// (default: all journals in /home/openhd/LastKnownPosition/)
+
+#include <iostream>
+#include <optional>
+
+#include "PositionJournal.h"
+#include "openhd_util_filesystem.h"
+
+using namespace openhd::telemetry;
+
+static constexpr auto LAST_KNOWN_POSITION_DIRECTORY =
+    "/home/openhd/LastKnownPosition/";
+
+static bool ends_with(const std::string& value, const std::string& suffix) {
+  return value.size() >= suffix.size() &&
+         value.compare(value.size() - suffix.size(), suffix.size(), suffix) ==
+             0;
+}
+
+int main(int argc, char* argv[]) {
+  const std::string path =
+      argc > 1 ? argv[1] : std::string(LAST_KNOWN_POSITION_DIRECTORY);
+  std::vector<std::string> files;
+  if (ends_with(path, ".journal")) {
+    files.push_back(path);
+  } else {
+    for (const auto& file :
+         OHDFilesystemUtil::getAllEntriesFullPathInDirectory(path)) {
+      if (ends_with(file, ".journal")) files.push_back(file);
+    }
+  }
+  std::optional<JournalPosition> last;
+  std::string last_file;
+  for (const auto& file : files) {
+    const auto content = read_position_journal(file);
+    if (!content.has_value()) {
+      std::cerr << "Cannot read " << file << "\n";
+      continue;
+    }
+    std::cout << file << ": " << content->n_valid_records << " valid, "
+              << content->n_invalid_records << " invalid records, "
+              << content->n_trailing_bytes << " trailing bytes\n";
+    if (!content->last_valid.has_value()) continue;
+    if (!last.has_value() ||
+        content->last_valid->timestamp_ms > last->timestamp_ms) {
+      last = content->last_valid;
+      last_file = file;
+    }
+  }
+  if (!last.has_value()) {
+    std::cerr << "No valid position found in " << path << "\n";
+    return 1;
+  }
+  std::cout << "Last known position (" << last_file << "):\n"
+            << journal_position_to_string(last.value()) << "\n";
+  return 0;
+}
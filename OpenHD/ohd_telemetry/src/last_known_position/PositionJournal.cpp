@@ -0,0 +1,222 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "PositionJournal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "openhd_spdlog.h"
+#include "openhd_spdlog_include.h"
+
+namespace openhd::telemetry {
+
+// "OHDP"
+static constexpr uint32_t RECORD_MAGIC = 0x5044484F;
+
+static uint32_t crc32(const uint8_t* data, int data_len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (int i = 0; i < data_len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static void write_le(uint8_t* dst, uint64_t value, int n_bytes) {
+  for (int i = 0; i < n_bytes; i++) dst[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t read_le(const uint8_t* src, int n_bytes) {
+  uint64_t ret = 0;
+  for (int i = 0; i < n_bytes; i++) ret |= (uint64_t)src[i] << (8 * i);
+  return ret;
+}
+
+std::vector<uint8_t> serialize_position_record(
+    const JournalPosition& position) {
+  std::vector<uint8_t> ret(POSITION_JOURNAL_RECORD_SIZE);
+  uint8_t* p = ret.data();
+  write_le(p, RECORD_MAGIC, 4);
+  write_le(p + 4, position.sequence, 4);
+  write_le(p + 8, position.timestamp_ms, 8);
+  write_le(p + 16, (uint32_t)(int32_t)std::lround(position.latitude * 1e7), 4);
+  write_le(p + 20, (uint32_t)(int32_t)std::lround(position.longitude * 1e7),
+           4);
+  write_le(p + 24, (uint32_t)(int32_t)std::lround(position.altitude_m * 1e3),
+           4);
+  write_le(p + 28, crc32(p, 28), 4);
+  return ret;
+}
+
+std::optional<JournalPosition> parse_position_record(const uint8_t* data) {
+  if (read_le(data, 4) != RECORD_MAGIC) return std::nullopt;
+  if (read_le(data + 28, 4) != crc32(data, 28)) return std::nullopt;
+  JournalPosition ret;
+  ret.sequence = (uint32_t)read_le(data + 4, 4);
+  ret.timestamp_ms = read_le(data + 8, 8);
+  ret.latitude = (int32_t)read_le(data + 16, 4) / 1e7;
+  ret.longitude = (int32_t)read_le(data + 20, 4) / 1e7;
+  ret.altitude_m = (int32_t)read_le(data + 24, 4) / 1e3;
+  return ret;
+}
+
+std::string journal_position_to_string(const JournalPosition& position) {
+  return fmt::format("#{} t:{}ms Lat:{:.7f},Lon:{:.7f},Alt:{:.3f}",
+                     position.sequence, position.timestamp_ms,
+                     position.latitude, position.longitude,
+                     position.altitude_m);
+}
+
+std::optional<PositionJournalContent> read_position_journal(
+    const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) return std::nullopt;
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+  PositionJournalContent ret{};
+  const int64_t n_records = (int64_t)data.size() / POSITION_JOURNAL_RECORD_SIZE;
+  for (int64_t i = 0; i < n_records; i++) {
+    const auto record =
+        parse_position_record(data.data() + i * POSITION_JOURNAL_RECORD_SIZE);
+    if (!record.has_value()) {
+      ret.n_invalid_records++;
+      continue;
+    }
+    ret.last_valid = record;
+    ret.n_valid_records++;
+    ret.valid_bytes = (i + 1) * POSITION_JOURNAL_RECORD_SIZE;
+  }
+  ret.n_trailing_bytes = (int)(data.size() % POSITION_JOURNAL_RECORD_SIZE);
+  return ret;
+}
+
+PositionJournalWriter::PositionJournalWriter(
+    std::string filename, std::chrono::milliseconds sync_interval,
+    int n_preallocated_records)
+    : m_filename(std::move(filename)), m_sync_interval(sync_interval) {
+  auto console = openhd::log::get_default();
+  const auto existing = read_position_journal(m_filename);
+  m_fd = open(m_filename.c_str(),
+              O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    console->warn("Cannot open position journal [{}] {}", m_filename,
+                  strerror(errno));
+    return;
+  }
+  if (existing.has_value()) {
+    // Records are only valid at a multiple of the record size - drop
+    // anything torn at the end before appending again
+    if (ftruncate(m_fd, existing->valid_bytes) != 0) {
+      console->warn("Cannot truncate position journal [{}] {}", m_filename,
+                    strerror(errno));
+    }
+    if (existing->last_valid.has_value()) {
+      m_next_sequence = existing->last_valid->sequence + 1;
+    }
+  }
+  // Reserve the blocks up front, without changing the file size (the reader
+  // only sees what has been appended)
+  if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0,
+                (off_t)n_preallocated_records *
+                    POSITION_JOURNAL_RECORD_SIZE) != 0) {
+    console->debug("Cannot preallocate position journal {}", strerror(errno));
+  }
+  fdatasync(m_fd);
+  // Make the file itself durable
+  const auto last_slash = m_filename.find_last_of('/');
+  const std::string directory = last_slash == std::string::npos
+                                    ? "."
+                                    : m_filename.substr(0, last_slash + 1);
+  const int dir_fd =
+      open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  m_last_sync = std::chrono::steady_clock::now();
+}
+
+PositionJournalWriter::~PositionJournalWriter() {
+  if (m_fd < 0) return;
+  flush(true);
+  close(m_fd);
+}
+
+void PositionJournalWriter::append(double latitude, double longitude,
+                                   double altitude_m, uint64_t timestamp_ms) {
+  JournalPosition position{m_next_sequence++, timestamp_ms, latitude,
+                           longitude, altitude_m};
+  const auto record = serialize_position_record(position);
+  m_pending.insert(m_pending.end(), record.begin(), record.end());
+}
+
+bool PositionJournalWriter::flush(bool force_sync) {
+  if (m_fd < 0) {
+    m_pending.clear();
+    return false;
+  }
+  bool success = true;
+  size_t written = 0;
+  while (written < m_pending.size()) {
+    const ssize_t ret =
+        write(m_fd, m_pending.data() + written, m_pending.size() - written);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      openhd::log::get_default()->warn("Cannot write position journal {}",
+                                       strerror(errno));
+      success = false;
+      break;
+    }
+    written += ret;
+  }
+  if (written > 0) m_needs_sync = true;
+  m_pending.clear();
+  const auto now = std::chrono::steady_clock::now();
+  if (m_needs_sync && (force_sync || now - m_last_sync >= m_sync_interval)) {
+    if (fdatasync(m_fd) != 0) {
+      openhd::log::get_default()->warn("Cannot sync position journal {}",
+                                       strerror(errno));
+      success = false;
+    }
+    m_needs_sync = false;
+    m_last_sync = now;
+  }
+  return success;
+}
+
+bool PositionJournalWriter::is_open() const { return m_fd >= 0; }
+
+uint32_t PositionJournalWriter::get_n_records() const {
+  return m_next_sequence;
+}
+
+}  // namespace openhd::telemetry
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_POSITIONJOURNAL_H_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_POSITIONJOURNAL_H_
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Crash safe journal of position fixes, for finding a crashed UAV.
+ * Each fix is a fixed size binary record with its own crc, appended to the
+ * file (O_APPEND, space is preallocated) - O(1) per position, the already
+ * written data is never touched again. fdatasync is done at most every
+ * sync_interval. On a power cut, only the record(s) after the last sync (at
+ * the end of the file) can be lost / torn, the reader skips those and recovers
+ * the last valid fix.
+ * Record (32 bytes, little endian): magic u32, sequence u32, unix time ms u64,
+ * latitude * 1e7 i32, longitude * 1e7 i32, altitude mm i32, crc32 u32 (of the
+ * 28 bytes before).
+ */
+namespace openhd::telemetry {
+
+static constexpr int POSITION_JOURNAL_RECORD_SIZE = 32;
+
+struct JournalPosition {
+  uint32_t sequence = 0;
+  // unix time (system clock)
+  uint64_t timestamp_ms = 0;
+  double latitude = 0;
+  double longitude = 0;
+  double altitude_m = 0;
+};
+std::string journal_position_to_string(const JournalPosition& position);
+
+class PositionJournalWriter {
+ public:
+  // Creates the file, or continues an existing one (after dropping a torn
+  // record at its end).
+  explicit PositionJournalWriter(
+      std::string filename,
+      std::chrono::milliseconds sync_interval = std::chrono::seconds(1),
+      int n_preallocated_records = 36000);
+  PositionJournalWriter(const PositionJournalWriter&) = delete;
+  PositionJournalWriter(const PositionJournalWriter&&) = delete;
+  // Writes and syncs whatever is pending
+  ~PositionJournalWriter();
+  // O(1), only buffered until the next flush()
+  void append(double latitude, double longitude, double altitude_m,
+              uint64_t timestamp_ms);
+  // Writes the buffered record(s) with a single write, and syncs if the sync
+  // interval has elapsed (or if force_sync is set).
+  // Returns false on error (the records are dropped).
+  bool flush(bool force_sync = false);
+  bool is_open() const;
+  uint32_t get_n_records() const;
+
+ private:
+  const std::string m_filename;
+  const std::chrono::milliseconds m_sync_interval;
+  int m_fd = -1;
+  uint32_t m_next_sequence = 0;
+  std::vector<uint8_t> m_pending;
+  bool m_needs_sync = false;
+  std::chrono::steady_clock::time_point m_last_sync{};
+};
+
+struct PositionJournalContent {
+  // The last record with a valid crc
+  std::optional<JournalPosition> last_valid;
+  int n_valid_records = 0;
+  // Torn / corrupted records, skipped
+  int n_invalid_records = 0;
+  // Size of the file up to (including) the last valid record
+  int64_t valid_bytes = 0;
+  // Partial record at the end of the file
+  int n_trailing_bytes = 0;
+};
+// Returns std::nullopt if the file cannot be read
+std::optional<PositionJournalContent> read_position_journal(
+    const std::string& filename);
+
+// Exposed for testing
+std::vector<uint8_t> serialize_position_record(const JournalPosition& position);
+std::optional<JournalPosition> parse_position_record(const uint8_t* data);
+
+}  // namespace openhd::telemetry
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_LAST_KNOWN_POSITION_POSITIONJOURNAL_H_
@@ -32,6 +32,7 @@
 #include <sstream>
 
 #include "openhd_spdlog_include.h"
+#include "openhd_thread_policy.h"
 
 static constexpr auto JOYSTICK_N = 0;
 /*static constexpr auto JOY_DEV="/sys/class/input/js0";
@@ -48,7 +49,7 @@ static uint16_t remap_sdl_to_mavlink(int16_t value) {
   return (int16_t)(((((double)value) + 32768.0) / 65.536) + 1000);
 }
 
-JoystickReader::JoystickReader() {
+JoystickReader::JoystickReader(NEW_VALUES_CB cb) : m_cb(std::move(cb)) {
   m_console = openhd::log::create_or_get("joystick_reader");
   assert(m_console);
   // WARNING: Joystick logging is a bit different than the rest regarding log
@@ -67,6 +68,8 @@ JoystickReader::~JoystickReader() {
 }
 
 void JoystickReader::loop() {
+  openhd::thread::set_current_thread(
+      "rc_joystick", openhd::thread::ThreadClass::REALTIME_RC);
   while (!terminate) {
     connect_once_and_read_until_error();
     // Error / no joystick found, try again later
@@ -117,22 +120,20 @@ void JoystickReader::connect_once_and_read_until_error() {
   // Populate the data once by querying everything (after that, we just get the
   // events from SDL)
   {
-    // make a copy
-    auto copy = m_curr_values;
     for (int i = 0; i < SDL_JoystickNumAxes(js); i++) {
       const auto curr = SDL_JoystickGetAxis(js, i);
-      write_matching_axis(copy.values, i, curr);
+      write_matching_axis(m_working_values, i, curr);
     }
     for (int i = 0; i < SDL_JoystickNumButtons(js); i++) {
       const auto curr = SDL_JoystickGetButton(js, i);
-      write_matching_button(copy.values, i, curr == 0);
+      write_matching_button(m_working_values, i, curr == 0);
+    }
+    {
+      std::lock_guard<std::mutex> guard(m_joystick_name_mutex);
+      m_joystick_name = name;
     }
     // write out the results
-    std::lock_guard<std::mutex> guard(m_curr_values_mutex);
-    m_curr_values = copy;
-    m_curr_values.considered_connected = true;
-    m_curr_values.last_update = std::chrono::steady_clock::now();
-    m_curr_values.joystick_name = name;
+    publish(Channels{m_working_values, std::chrono::steady_clock::now(), true});
   }
   // We constantly check for a disconnected joystick, in which case we set the
   // joystick state to disconnected and return.
@@ -162,7 +163,7 @@ void JoystickReader::connect_once_and_read_until_error() {
 }
 
 void JoystickReader::wait_for_events(const int timeout_ms) {
-  auto current = m_curr_values.values;
+  auto& current = m_working_values;
   int n_polled_events = 0;
   SDL_Event event;
   bool any_new_data = false;
@@ -171,6 +172,7 @@ void JoystickReader::wait_for_events(const int timeout_ms) {
     // m_console->debug("Got no event after 100ms");
     return;
   }
+  const auto first_event_tp = std::chrono::steady_clock::now();
   // process this event
   auto ret = process_event(&event, current);
   if (ret == 2 || ret == 5 || ret == 4) {
@@ -196,12 +198,14 @@ void JoystickReader::wait_for_events(const int timeout_ms) {
   }
   // m_console->debug("N polled events:{}",n_polled_events);
   if (any_new_data) {
-    std::lock_guard<std::mutex> guard(m_curr_values_mutex);
-    for (int i = 0; i < m_curr_values.values.size(); i++) {
-      m_curr_values.values[i] = current[i];
-    }
-    m_curr_values.last_update = std::chrono::steady_clock::now();
-    m_curr_values.considered_connected = true;
+    publish(Channels{current, first_event_tp, true});
+  }
+}
+
+void JoystickReader::publish(const JoystickReader::Channels& channels) {
+  m_curr_channels.store(channels);
+  if (m_cb) {
+    m_cb(channels);
   }
 }
 
@@ -211,7 +215,7 @@ int JoystickReader::process_event(void* event1,
   int ret = 0;
   switch (event->type) {
     case SDL_JOYAXISMOTION:
-      m_console->debug("Joystick {}, Axis {} moved to {}", event->jaxis.which,
+      m_console->trace("Joystick {}, Axis {} moved to {}", event->jaxis.which,
                        event->jaxis.axis, event->jaxis.value);
       write_matching_axis(current, event->jaxis.axis, event->jaxis.value);
       ret = 2;
@@ -241,17 +245,30 @@ int JoystickReader::process_event(void* event1,
 }
 
 JoystickReader::CurrChannelValues JoystickReader::get_current_state() {
-  std::lock_guard<std::mutex> guard(m_curr_values_mutex);
-  return m_curr_values;
+  const auto channels = m_curr_channels.load();
+  CurrChannelValues ret;
+  ret.values = channels.values;
+  ret.last_update = channels.last_update;
+  ret.considered_connected = channels.considered_connected;
+  std::lock_guard<std::mutex> guard(m_joystick_name_mutex);
+  ret.joystick_name = m_joystick_name;
+  return ret;
+}
+
+JoystickReader::Channels JoystickReader::get_current_channels() {
+  return m_curr_channels.load();
 }
 
 void JoystickReader::reset_curr_values() {
-  std::lock_guard<std::mutex> guard(m_curr_values_mutex);
-  m_curr_values.considered_connected = false;
-  for (auto& el : m_curr_values.values) {
+  for (auto& el : m_working_values) {
     el = DEFAULT_RC_CHANNELS_VALUE;
   }
-  m_curr_values.joystick_name = "unknown";
+  {
+    std::lock_guard<std::mutex> guard(m_joystick_name_mutex);
+    m_joystick_name = "unknown";
+  }
+  m_curr_channels.store(
+      Channels{m_working_values, std::chrono::steady_clock::now(), false});
 }
 
 std::string JoystickReader::curr_state_to_string(
@@ -26,12 +26,15 @@
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_JOYSTICKREADER_H_
 
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <mutex>
 #include <optional>
 #include <sstream>
 #include <thread>
 
+#include "SeqLock.hpp"
 #include "openhd_spdlog.h"
 #include "openhd_util.h"
 
@@ -42,10 +45,10 @@
  * control, try to open the joystick and read data, re-connect if anything goes
  * wrong during run time. This class does all the connecting and handles
  * disconnecting and reading values in its own thread - you can query a "state"
- * from any thread at any time though. Theoretically, we could just use this
- * thread also for sending the RC data via mavlink - but this is a bit
- * dangerous, since I don't completely trust SDL yet (in regards to
- * disconnecting joysticks).
+ * from any thread at any time though. The channel values are handed over
+ * without a lock, and (optionally) the new values are pushed to a cb right
+ * from the joystick thread, such that they can be sent without waiting for
+ * another thread.
  */
 class JoystickReader {
  public:
@@ -68,10 +71,22 @@ class JoystickReader {
     // the name of the joystick
     std::string joystick_name = "unknown";
   };
-  explicit JoystickReader();
+  // The part of the state that changes with each joystick event
+  struct Channels {
+    std::array<uint16_t, N_CHANNELS> values;
+    // Time point when the (first) joystick event of this update was read
+    std::chrono::steady_clock::time_point last_update;
+    bool considered_connected;
+  };
+  // Called from the joystick thread each time the channel value(s) changed -
+  // keep it short.
+  typedef std::function<void(const Channels& channels)> NEW_VALUES_CB;
+  explicit JoystickReader(NEW_VALUES_CB cb = nullptr);
   ~JoystickReader();
   // Get the current "state", thread-safe
   CurrChannelValues get_current_state();
+  // Get the current channel values, thread-safe and lock-free
+  Channels get_current_channels();
   // For debugging
   static std::string curr_state_to_string(
       const CurrChannelValues& curr_channel_values);
@@ -84,10 +99,16 @@ class JoystickReader {
   void wait_for_events(int timeout_ms);
   int process_event(void* event, std::array<uint16_t, N_CHANNELS>& values);
   void reset_curr_values();
+  void publish(const Channels& channels);
   std::unique_ptr<std::thread> m_read_joystick_thread;
-  bool terminate = false;
-  std::mutex m_curr_values_mutex;
-  CurrChannelValues m_curr_values;
+  std::atomic<bool> terminate = false;
+  const NEW_VALUES_CB m_cb;
+  // Written by the joystick thread only
+  openhd::SeqLock<Channels> m_curr_channels;
+  // Only used by the joystick thread
+  std::array<uint16_t, N_CHANNELS> m_working_values{};
+  std::mutex m_joystick_name_mutex;
+  std::string m_joystick_name = "unknown";
   std::shared_ptr<spdlog::logger> m_console;
 
  private:
@@ -24,56 +24,152 @@
 #ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
 #include "RcJoystickSender.h"
 
+#include <algorithm>
+#include <sstream>
 #include <utility>
 
+#include "openhd_thread_policy.h"
+
+// Changes that are held back by the max rate are sent at the latest after
+// 1000/MAX_RATE_HZ ms
+static constexpr auto MAX_RATE_HZ = 100;
+// In rc units (us) - don't send a (tiny) stick jitter right away
+static constexpr auto DEADBAND = 3;
+
 RcJoystickSender::RcJoystickSender(SEND_MESSAGE_CB cb, int update_rate_hz,
                                    openhd::CHAN_MAP chan_map)
     : m_cb(std::move(cb)),
-      m_delay_in_milliseconds(1000 / update_rate_hz),
+      m_send_policy(openhd::RcSendPolicy::Config{update_rate_hz, MAX_RATE_HZ,
+                                                 DEADBAND}),
       m_chan_map(chan_map) {
   if (!openhd::validate_channel_mapping(chan_map)) {
     openhd::log::get_default()->warn("Invalid channel mapping");
     m_chan_map = openhd::get_default_channel_mapping();
   }
-  m_joystick_reader = std::make_unique<JoystickReader>();
+  m_joystick_reader = std::make_unique<JoystickReader>(
+      [this](const JoystickReader::Channels& channels) {
+        on_new_joystick_values(channels);
+      });
   m_send_data_thread =
       std::make_unique<std::thread>([this] { send_data_until_terminate(); });
 }
 
+void RcJoystickSender::on_new_joystick_values(
+    const JoystickReader::Channels& channels) {
+  const auto next = send_if_needed(channels);
+  if (next > std::chrono::steady_clock::now()) {
+    // Held back, the send thread needs to send it in time
+    wakeup();
+  }
+}
+
+std::chrono::steady_clock::time_point RcJoystickSender::send_if_needed(
+    const JoystickReader::Channels& channels) {
+  // We only send data if the joystick is in the connected state
+  // Otherwise, we just stop sending data, which should result in a failsafe
+  // at the FC.
+  if (!channels.considered_connected) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+  }
+  // map all the channels before we send them out
+  // mapping might change at any time, and the compute overhead - well, we
+  // are not on a microcontroller ;)
+  const auto mapped_channels =
+      openhd::remap_channels(channels.values, get_current_channel_mapping());
+  std::lock_guard<std::mutex> guard(m_send_mutex);
+  const auto now = std::chrono::steady_clock::now();
+  if (!m_send_policy.should_send(mapped_channels, now)) {
+    return m_send_policy.next_send_time(mapped_channels);
+  }
+  m_cb(mapped_channels);
+  const auto after_send = std::chrono::steady_clock::now();
+  m_send_policy.on_sent(mapped_channels, after_send);
+  if (channels.last_update > m_last_sent_update) {
+    // this one carries new stick input
+    m_last_sent_update = channels.last_update;
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        after_send - channels.last_update);
+    if (m_latency_samples.size() < N_LATENCY_SAMPLES) {
+      m_latency_samples.push_back(latency);
+    } else {
+      m_latency_samples[m_latency_samples_index] = latency;
+      m_latency_samples_index =
+          (m_latency_samples_index + 1) % N_LATENCY_SAMPLES;
+    }
+  }
+  return m_send_policy.next_send_time(mapped_channels);
+}
+
 void RcJoystickSender::send_data_until_terminate() {
+  openhd::thread::set_current_thread(
+      "rc_sender", openhd::thread::ThreadClass::REALTIME_RC);
   while (!terminate) {
-    const auto curr = m_joystick_reader->get_current_state();
-    // We only send data if the joystick is in the connected state
-    // Otherwise, we just stop sending data, which should result in a failsafe
-    // at the FC.
-    if (curr.considered_connected) {
-      // map all the channels before we send them out
-      // mapping might change at any time, and the compute overhead - well, we
-      // are not on a microcontroller ;)
-      auto curr_mapping = get_current_channel_mapping();
-      auto mapped_channels = openhd::remap_channels(curr.values, curr_mapping);
-      m_cb(mapped_channels);
+    const auto next =
+        send_if_needed(m_joystick_reader->get_current_channels());
+    if (std::chrono::steady_clock::now() - m_last_latency_log >
+        std::chrono::seconds(10)) {
+      m_last_latency_log = std::chrono::steady_clock::now();
+      openhd::log::get_default()->debug(
+          "RC latency {}", latency_stats_to_string(get_latency_stats()));
     }
-    std::this_thread::sleep_for(
-        std::chrono::milliseconds(m_delay_in_milliseconds));
+    std::unique_lock<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup_cv.wait_until(lock, next,
+                           [this] { return m_wakeup || terminate; });
+    m_wakeup = false;
   }
 }
 
+void RcJoystickSender::wakeup() {
+  {
+    std::lock_guard<std::mutex> lock(m_wakeup_mutex);
+    m_wakeup = true;
+  }
+  m_wakeup_cv.notify_one();
+}
+
 RcJoystickSender::~RcJoystickSender() {
   terminate = true;
+  wakeup();
   m_send_data_thread->join();
   m_send_data_thread.reset();
+  // Calls into us until it is stopped
   m_joystick_reader.reset();
 }
 
 void RcJoystickSender::change_update_rate(int update_rate_hz) {
-  const int val = (1000 / update_rate_hz);
-  if (val >= 0) {
-    m_delay_in_milliseconds = val;
+  if (update_rate_hz > 0) {
+    std::lock_guard<std::mutex> guard(m_send_mutex);
+    m_send_policy.set_min_rate_hz(update_rate_hz);
   } else {
     openhd::log::get_default()->warn("Invalid update rate hz {}",
                                      update_rate_hz);
   }
+  wakeup();
+}
+
+RcJoystickSender::LatencyStats RcJoystickSender::get_latency_stats() {
+  std::vector<std::chrono::microseconds> samples;
+  {
+    std::lock_guard<std::mutex> guard(m_send_mutex);
+    samples = m_latency_samples;
+  }
+  LatencyStats ret;
+  if (samples.empty()) return ret;
+  std::sort(samples.begin(), samples.end());
+  ret.n_samples = samples.size();
+  ret.p50 = samples[samples.size() / 2];
+  ret.p99 = samples[samples.size() * 99 / 100];
+  ret.max = samples.back();
+  return ret;
+}
+
+std::string RcJoystickSender::latency_stats_to_string(
+    const RcJoystickSender::LatencyStats& stats) {
+  std::stringstream ss;
+  ss << "n:" << stats.n_samples << " p50:" << stats.p50.count()
+     << "us p99:" << stats.p99.count() << "us max:" << stats.max.count()
+     << "us";
+  return ss.str();
 }
 
 void RcJoystickSender::update_channel_mapping(
@@ -26,15 +26,19 @@
 #define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_RCJOYSTICKSENDER_H_
 
 #include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <vector>
 
 #include "../mav_helper.h"
 #include "ChannelMappingUtil.hpp"
 #include "JoystickReader.h"
+#include "RcSendPolicy.hpp"
 
-// Really simple, have a thread that send out telemetry RC data at a fixed rate
-// (we cannot just use the thread that fetches data from the joystick, at least
-// not for now)
+// Sends out the RC data: A change of the sticks is sent right away from the
+// joystick thread (see RcSendPolicy for the deadband / max rate), and a
+// thread sends the current values at the update rate when nothing changes
+// (and the changes that were held back by the max rate).
 class RcJoystickSender {
  public:
   // This callback is called in regular intervalls with valid rc channel data as
@@ -46,22 +50,48 @@ class RcJoystickSender {
   RcJoystickSender(SEND_MESSAGE_CB cb, int update_rate_hz,
                    openhd::CHAN_MAP chan_map);
   ~RcJoystickSender();
-  // atomic, can be called from any thread.
+  // thread-safe
   void change_update_rate(int update_rate_hz);
   // update the channel mapping, thread-safe
   void update_channel_mapping(const openhd::CHAN_MAP& new_chan_map);
+  // Time from reading the joystick event until the channels were handed to
+  // the send cb, over the last (up to) N_LATENCY_SAMPLES changes
+  struct LatencyStats {
+    int n_samples = 0;
+    std::chrono::microseconds p50{0};
+    std::chrono::microseconds p99{0};
+    std::chrono::microseconds max{0};
+  };
+  LatencyStats get_latency_stats();
+  static std::string latency_stats_to_string(const LatencyStats& stats);
 
  private:
   // get the current channel mapping, thread-safe
   openhd::CHAN_MAP get_current_channel_mapping();
+  // From the joystick thread
+  void on_new_joystick_values(const JoystickReader::Channels& channels);
+  // Sends the channels if needed, returns the time point at which they need
+  // to be sent (again) at the latest.
+  std::chrono::steady_clock::time_point send_if_needed(
+      const JoystickReader::Channels& channels);
   void send_data_until_terminate();
+  void wakeup();
   std::unique_ptr<JoystickReader> m_joystick_reader;
   std::unique_ptr<std::thread> m_send_data_thread;
   const SEND_MESSAGE_CB m_cb;
-  // Controls the update rate how often we send the rc packets to the air unit.
-  // We can just use std::atomic for thread safety here
-  std::atomic<int> m_delay_in_milliseconds;
-  bool terminate = false;
+  std::atomic<bool> terminate = false;
+  std::mutex m_wakeup_mutex;
+  std::condition_variable m_wakeup_cv;
+  bool m_wakeup = false;
+  // Sending is done from 2 threads
+  std::mutex m_send_mutex;
+  openhd::RcSendPolicy m_send_policy;
+  std::chrono::steady_clock::time_point m_last_sent_update;
+  static constexpr int N_LATENCY_SAMPLES = 1000;
+  std::vector<std::chrono::microseconds> m_latency_samples;
+  int m_latency_samples_index = 0;
+  std::chrono::steady_clock::time_point m_last_latency_log =
+      std::chrono::steady_clock::now();
 
  private:
   std::mutex m_chan_map_mutex;
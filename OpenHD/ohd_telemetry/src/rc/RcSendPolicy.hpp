@@ -0,0 +1,97 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_RCSENDPOLICY_HPP_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_RCSENDPOLICY_HPP_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace openhd {
+
+/**
+ * Decides when the rc channels are sent out: As soon as at least one channel
+ * moved more than the deadband since the last send (but not more often than
+ * max rate), and in any case at min rate (such that the FC doesn't go into
+ * failsafe while the sticks are not moved).
+ * Not thread-safe.
+ */
+class RcSendPolicy {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Channels = std::array<uint16_t, 18>;
+  struct Config {
+    int min_rate_hz = 30;
+    int max_rate_hz = 100;
+    // in rc units (us), a change of more than that is sent right away
+    int deadband = 3;
+  };
+  explicit RcSendPolicy(Config config) : m_config(config) {}
+  void set_min_rate_hz(int min_rate_hz) { m_config.min_rate_hz = min_rate_hz; }
+  // The time point at which the given channel values should be sent at the
+  // latest (might be in the past)
+  [[nodiscard]] Clock::time_point next_send_time(
+      const Channels& channels) const {
+    if (!m_has_sent) return Clock::time_point::min();
+    if (changed_beyond_deadband(channels)) {
+      return m_last_send + interval(get_max_rate_hz());
+    }
+    return m_last_send + interval(m_config.min_rate_hz);
+  }
+  [[nodiscard]] bool should_send(const Channels& channels,
+                                 Clock::time_point now) const {
+    return now >= next_send_time(channels);
+  }
+  void on_sent(const Channels& channels, Clock::time_point now) {
+    m_last_sent_channels = channels;
+    m_last_send = now;
+    m_has_sent = true;
+  }
+
+ private:
+  static std::chrono::microseconds interval(int rate_hz) {
+    return std::chrono::microseconds(1000 * 1000 / std::max(rate_hz, 1));
+  }
+  // Sending at a higher min rate than max rate doesn't make sense
+  [[nodiscard]] int get_max_rate_hz() const {
+    return std::max(m_config.max_rate_hz, m_config.min_rate_hz);
+  }
+  [[nodiscard]] bool changed_beyond_deadband(const Channels& channels) const {
+    for (int i = 0; i < channels.size(); i++) {
+      const int diff = (int)channels[i] - (int)m_last_sent_channels[i];
+      if (std::abs(diff) > m_config.deadband) return true;
+    }
+    return false;
+  }
+  Config m_config;
+  bool m_has_sent = false;
+  Clock::time_point m_last_send;
+  Channels m_last_sent_channels{};
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_RCSENDPOLICY_HPP_
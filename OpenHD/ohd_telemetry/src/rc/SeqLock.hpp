@@ -0,0 +1,91 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_SEQLOCK_HPP_
+#define OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_SEQLOCK_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace openhd {
+
+/**
+ * Single writer, multiple reader handoff of a (small, trivially copyable)
+ * value without a lock: The writer never blocks, a reader retries if the
+ * value was written while it was reading. Used to hand the rc channel values
+ * from the joystick thread to whoever sends them.
+ * The value is stored as atomic words, such that a torn read is not UB (it is
+ * detected via the sequence number and retried).
+ */
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock needs a trivially copyable type");
+
+ public:
+  explicit SeqLock(const T& initial = T{}) { store(initial); }
+  // Only ever call from one thread at a time
+  void store(const T& value) {
+    uint64_t tmp[N_WORDS]{};
+    std::memcpy(tmp, &value, sizeof(T));
+    const auto seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < N_WORDS; i++) {
+      m_data[i].store(tmp[i], std::memory_order_relaxed);
+    }
+    m_seq.store(seq + 2, std::memory_order_release);
+  }
+  // Can be called from any thread
+  T load() const {
+    uint64_t tmp[N_WORDS];
+    uint64_t seq_before, seq_after;
+    do {
+      seq_before = m_seq.load(std::memory_order_acquire);
+      for (int i = 0; i < N_WORDS; i++) {
+        tmp[i] = m_data[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq_after = m_seq.load(std::memory_order_relaxed);
+    } while ((seq_before & 1) != 0 || seq_before != seq_after);
+    T ret;
+    std::memcpy(&ret, tmp, sizeof(T));
+    return ret;
+  }
+  // Incremented by 2 on each store
+  uint64_t get_sequence() const {
+    return m_seq.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr int N_WORDS = (sizeof(T) + 7) / 8;
+  std::atomic<uint64_t> m_seq{0};
+  std::array<std::atomic<uint64_t>, N_WORDS> m_data{};
+};
+
+}  // namespace openhd
+
+#endif  // OPENHD_OPENHD_OHD_TELEMETRY_SRC_RC_SEQLOCK_HPP_
@@ -0,0 +1,187 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// GPIO character device test, against the gpio-sim kernel module (simulated
+// chip, configured via configfs). Needs root. Checks that a batched write of
+// several lines ends up on the (simulated) pins, how long a single write
+// takes (one ioctl) and that edge events on an input line are reported, with
+// a kernel timestamp. Skipped if gpio-sim is not available.
+//
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "gpio_control/GPIOChip.h"
+
+using namespace openhd::telemetry::rpi;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static const std::string SIM_DIR = "/sys/kernel/config/gpio-sim/openhd_test";
+static constexpr int N_LINES = 8;
+
+static bool write_file(const std::string& filename, const std::string& value) {
+  std::ofstream file(filename);
+  file << value;
+  file.flush();
+  return file.good();
+}
+
+static std::string read_file(const std::string& filename) {
+  std::ifstream file(filename);
+  std::string ret;
+  file >> ret;
+  return ret;
+}
+
+static uint64_t now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Simulated chip, removed again on destruction
+struct SimChip {
+  std::string dev_path;
+  // sysfs dir of the simulated chip, has sim_gpioN/{value,pull}
+  std::string sysfs_dir;
+  ~SimChip() {
+    write_file(SIM_DIR + "/live", "0");
+    rmdir((SIM_DIR + "/bank0").c_str());
+    rmdir(SIM_DIR.c_str());
+  }
+  int sim_value(int line) const {
+    return std::stoi(read_file(sysfs_dir + "/sim_gpio" + std::to_string(line) +
+                               "/value"));
+  }
+  void set_pull(int line, bool up) const {
+    write_file(sysfs_dir + "/sim_gpio" + std::to_string(line) + "/pull",
+               up ? "pull-up" : "pull-down");
+  }
+};
+
+static std::unique_ptr<SimChip> create_sim_chip() {
+  struct stat st {};
+  if (stat("/sys/kernel/config/gpio-sim", &st) != 0) {
+    std::system("modprobe gpio-sim > /dev/null 2>&1");
+    if (stat("/sys/kernel/config/gpio-sim", &st) != 0) return nullptr;
+  }
+  if (mkdir(SIM_DIR.c_str(), 0755) != 0 && errno != EEXIST) return nullptr;
+  auto ret = std::make_unique<SimChip>();
+  mkdir((SIM_DIR + "/bank0").c_str(), 0755);
+  if (!write_file(SIM_DIR + "/bank0/num_lines", std::to_string(N_LINES)) ||
+      !write_file(SIM_DIR + "/live", "1")) {
+    return nullptr;
+  }
+  const auto chip_name = read_file(SIM_DIR + "/bank0/chip_name");
+  const auto dev_name = read_file(SIM_DIR + "/dev_name");
+  ret->dev_path = "/dev/" + chip_name;
+  ret->sysfs_dir = "/sys/devices/platform/" + dev_name + "/" + chip_name;
+  return ret;
+}
+
+static void test_outputs(GPIOChip& chip, const SimChip& sim) {
+  const std::vector<int> offsets{1, 2, 5, 6};
+  auto lines = chip.request_outputs(offsets, 0b0101);
+  check(lines != nullptr, "request outputs");
+  check(sim.sim_value(1) == 1 && sim.sim_value(2) == 0 &&
+            sim.sim_value(5) == 1 && sim.sim_value(6) == 0,
+        "initial values");
+  // All 4 lines at once
+  check(lines->set_values(0b1111, 0b1010), "set values");
+  check(sim.sim_value(1) == 0 && sim.sim_value(2) == 1 &&
+            sim.sim_value(5) == 0 && sim.sim_value(6) == 1,
+        "batched write");
+  // Only the masked ones
+  check(lines->set_values(0b0001, 0b1111), "set values masked");
+  check(sim.sim_value(1) == 1 && sim.sim_value(2) == 1 &&
+            sim.sim_value(5) == 0 && sim.sim_value(6) == 1,
+        "masked write");
+  check(lines->set_value(3, false), "set value");
+  check(sim.sim_value(6) == 0, "single write");
+  const auto values = lines->get_values();
+  check(values.has_value() && values.value() == 0b0011, "read back");
+  // Latency of a write (one ioctl)
+  std::vector<uint64_t> durations;
+  for (int i = 0; i < 10000; i++) {
+    const auto before = now_ns();
+    lines->set_values(0b1111, i % 2 == 0 ? 0b1111 : 0);
+    durations.push_back(now_ns() - before);
+  }
+  std::sort(durations.begin(), durations.end());
+  std::cout << "Write median:" << durations[durations.size() / 2] / 1000.0
+            << "us 99%:" << durations[durations.size() * 99 / 100] / 1000.0
+            << "us" << std::endl;
+  check(durations[durations.size() * 99 / 100] < 1000 * 1000,
+        "write latency < 1ms");
+}
+
+static void test_edge_events(GPIOChip& chip, const SimChip& sim) {
+  sim.set_pull(3, false);
+  auto lines = chip.request_inputs({3}, GPIOChip::Edge::BOTH);
+  check(lines != nullptr, "request input");
+  check(lines->read_edge_events(std::chrono::milliseconds(50)).empty(),
+        "no event without edge");
+  int n_events = 0;
+  for (int i = 0; i < 10; i++) {
+    const bool rising = i % 2 == 0;
+    const auto before = now_ns();
+    sim.set_pull(3, rising);
+    const auto events = lines->read_edge_events(std::chrono::seconds(1));
+    check(events.size() == 1, "one event per edge");
+    const auto& event = events[0];
+    check(event.offset == 3, "event offset");
+    check(event.rising == rising, "event direction");
+    check(event.timestamp_ns >= before && event.timestamp_ns <= now_ns(),
+          "kernel timestamp");
+    n_events++;
+    check(event.seqno == n_events, "event seqno");
+  }
+}
+
+int main(int argc, char* argv[]) {
+  auto sim = create_sim_chip();
+  if (sim == nullptr) {
+    std::cout << "gpio-sim not available (needs root and CONFIG_GPIO_SIM), "
+                 "skipping"
+              << std::endl;
+    return 0;
+  }
+  auto chip = GPIOChip::open(sim->dev_path);
+  check(chip != nullptr, "open " + sim->dev_path);
+  check(chip->get_n_lines() == N_LINES, "number of lines");
+  test_outputs(*chip, *sim);
+  test_edge_events(*chip, *sim);
+  std::cout << "Done" << std::endl;
+  return 0;
+}
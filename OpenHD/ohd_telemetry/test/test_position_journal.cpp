@@ -0,0 +1,217 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// Position journal test: record round trip, then simulated power cuts - the
+// file is cut at a random point after the last sync, with the unsynced tail
+// partially written / zero filled / garbage (as it can happen with a page
+// written only partially). The reader must always recover a position that was
+// actually written, and never an older one than the last synced. Reopening
+// such a journal must drop the torn tail and continue. Last, appending is
+// checked to be O(1) (no dependency on the history length).
+//
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+#include "last_known_position/PositionJournal.h"
+
+using namespace openhd::telemetry;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static const std::string TEST_FILE = "/tmp/test_position_journal.journal";
+static const std::string TEST_FILE_CUT =
+    "/tmp/test_position_journal_cut.journal";
+
+static std::vector<uint8_t> read_all(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+static void write_all(const std::string& filename,
+                      const std::vector<uint8_t>& data) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write((const char*)data.data(), data.size());
+}
+
+// A position along a flight path
+static JournalPosition position_at(uint32_t sequence) {
+  JournalPosition ret;
+  ret.sequence = sequence;
+  ret.timestamp_ms = 1700000000000ULL + sequence * 100ULL;
+  ret.latitude = 47.3769 + sequence * 1e-6;
+  ret.longitude = 8.5417 - sequence * 2e-6;
+  ret.altitude_m = 100.0 + (sequence % 500) * 0.1;
+  return ret;
+}
+
+static bool same(const JournalPosition& a, const JournalPosition& b) {
+  return a.sequence == b.sequence && a.timestamp_ms == b.timestamp_ms &&
+         std::abs(a.latitude - b.latitude) < 1e-7 &&
+         std::abs(a.longitude - b.longitude) < 1e-7 &&
+         std::abs(a.altitude_m - b.altitude_m) < 1e-3;
+}
+
+static void append(PositionJournalWriter& writer, uint32_t sequence) {
+  const auto position = position_at(sequence);
+  writer.append(position.latitude, position.longitude, position.altitude_m,
+                position.timestamp_ms);
+}
+
+static void test_record() {
+  JournalPosition position{42, 1700000000123ULL, -33.8688197, 151.2092955,
+                           -12.345};
+  auto record = serialize_position_record(position);
+  check(record.size() == POSITION_JOURNAL_RECORD_SIZE, "record size");
+  auto parsed = parse_position_record(record.data());
+  check(parsed.has_value() && same(parsed.value(), position), "round trip");
+  for (int i = 0; i < POSITION_JOURNAL_RECORD_SIZE; i++) {
+    auto corrupted = record;
+    corrupted[i] ^= 0x10;
+    check(!parse_position_record(corrupted.data()).has_value(),
+          "corruption detected");
+  }
+}
+
+static void test_power_cut() {
+  std::mt19937 random{1};
+  int n_torn = 0;
+  for (int run = 0; run < 1000; run++) {
+    unlink(TEST_FILE.c_str());
+    const int n_synced = 1 + random() % 200;
+    const int n_unsynced = random() % 20;
+    std::vector<uint8_t> synced;
+    {
+      PositionJournalWriter writer(TEST_FILE);
+      check(writer.is_open(), "open");
+      for (int i = 0; i < n_synced; i++) append(writer, i);
+      writer.flush(true);
+      synced = read_all(TEST_FILE);
+      for (int i = n_synced; i < n_synced + n_unsynced; i++) {
+        append(writer, i);
+        if (random() % 4 == 0) writer.flush();
+      }
+    }
+    const auto written = read_all(TEST_FILE);
+    check(synced.size() == n_synced * POSITION_JOURNAL_RECORD_SIZE,
+          "synced size");
+    check(written.size() ==
+              (n_synced + n_unsynced) * POSITION_JOURNAL_RECORD_SIZE,
+          "written size");
+    // What survives the power cut: everything synced, some of the rest
+    auto on_disk = synced;
+    const int n_survived = random() % (written.size() - synced.size() + 1);
+    on_disk.insert(on_disk.end(), written.begin() + synced.size(),
+                   written.begin() + synced.size() + n_survived);
+    switch (random() % 3) {
+      case 0:
+        // Only some bytes of the last page made it
+        for (int i = synced.size(); i < on_disk.size(); i++) {
+          if (random() % 8 == 0) on_disk[i] = random();
+        }
+        break;
+      case 1:
+        // File size updated, data not
+        on_disk.resize(on_disk.size() + random() % 64, 0);
+        break;
+      default:
+        break;
+    }
+    write_all(TEST_FILE_CUT, on_disk);
+    const auto content = read_position_journal(TEST_FILE_CUT);
+    check(content.has_value(), "read");
+    check(content->last_valid.has_value(), "position recovered");
+    const auto& last = content->last_valid.value();
+    check(last.sequence >= n_synced - 1, "not older than last sync");
+    check(last.sequence < n_synced + n_unsynced, "was written");
+    check(same(last, position_at(last.sequence)), "recovered correctly");
+    if (content->n_invalid_records > 0 || content->n_trailing_bytes > 0) {
+      n_torn++;
+    }
+    // Continue after the cut
+    {
+      PositionJournalWriter writer(TEST_FILE_CUT);
+      writer.append(1, 2, 3, 4);
+    }
+    const auto continued = read_position_journal(TEST_FILE_CUT);
+    check(continued->n_trailing_bytes == 0, "aligned after reopen");
+    check(continued->last_valid->sequence == last.sequence + 1,
+          "sequence continues");
+    check(continued->last_valid->timestamp_ms == 4, "appended after cut");
+  }
+  std::cout << "1000 power cuts, " << n_torn
+            << " with a torn tail, last synced position always recovered\n";
+  unlink(TEST_FILE.c_str());
+  unlink(TEST_FILE_CUT.c_str());
+}
+
+static void test_append_cost() {
+  unlink(TEST_FILE.c_str());
+  PositionJournalWriter writer(TEST_FILE, std::chrono::seconds(1));
+  const int n_batches = 200;
+  const int batch_size = 50;
+  std::vector<double> batch_us;
+  for (int batch = 0; batch < n_batches; batch++) {
+    const auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < batch_size; i++) {
+      append(writer, batch * batch_size + i);
+    }
+    writer.flush();
+    batch_us.push_back(std::chrono::duration<double, std::micro>(
+                           std::chrono::steady_clock::now() - begin)
+                           .count());
+  }
+  auto median = [](std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+  };
+  const double first = median({batch_us.begin(), batch_us.begin() + 50});
+  const double last = median({batch_us.end() - 50, batch_us.end()});
+  std::cout << "Append " << batch_size << " positions + write: " << first
+            << "us (first 2500) vs " << last << "us (last 2500), "
+            << POSITION_JOURNAL_RECORD_SIZE << " bytes per position\n";
+  check(last < first * 3 + 50, "independent of the history length");
+  const auto content = read_position_journal(TEST_FILE);
+  check(content->n_valid_records == n_batches * batch_size, "all written");
+  unlink(TEST_FILE.c_str());
+}
+
+int main() {
+  test_record();
+  test_power_cut();
+  test_append_cost();
+  std::cout << "All tests passed\n";
+  return 0;
+}
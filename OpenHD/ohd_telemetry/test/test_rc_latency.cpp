@@ -0,0 +1,202 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+// RC joystick path test: First the send policy (deadband, min / max rate) and
+// the lock-free channel handoff. Then, if SDL is available, a virtual SDL
+// joystick is moved and the time until the new value arrives at the send cb
+// is measured (stick to packet latency) - p99 has to be at or below one
+// (60fps) frame interval.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "rc/RcSendPolicy.hpp"
+#include "rc/SeqLock.hpp"
+
+#ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
+#include <SDL2/SDL.h>
+
+#include "rc/RcJoystickSender.h"
+#endif
+
+using namespace std::chrono;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+static constexpr auto FRAME_INTERVAL = microseconds(1000 * 1000 / 60);
+
+static void test_send_policy() {
+  openhd::RcSendPolicy policy(openhd::RcSendPolicy::Config{30, 100, 3});
+  openhd::RcSendPolicy::Channels channels{};
+  channels.fill(1500);
+  const auto t0 = steady_clock::now();
+  check(policy.should_send(channels, t0), "first send right away");
+  policy.on_sent(channels, t0);
+  check(!policy.should_send(channels, t0 + milliseconds(20)),
+        "no change - wait for min rate");
+  check(policy.should_send(channels, t0 + milliseconds(34)),
+        "no change - min rate");
+  auto jitter = channels;
+  jitter[0] += 3;
+  check(!policy.should_send(jitter, t0 + milliseconds(20)), "deadband");
+  auto moved = channels;
+  moved[3] -= 4;
+  check(!policy.should_send(moved, t0 + milliseconds(5)), "max rate");
+  check(policy.should_send(moved, t0 + milliseconds(10)),
+        "change beyond deadband");
+  check(policy.next_send_time(moved) == t0 + milliseconds(10),
+        "next send time");
+  // min rate above max rate
+  policy.set_min_rate_hz(150);
+  check(policy.should_send(channels, t0 + milliseconds(7)), "min rate > max");
+}
+
+// One writer, several readers - a reader must never see a mix of 2 writes
+static void test_seq_lock() {
+  struct Data {
+    std::array<uint16_t, 18> values;
+    uint64_t counter;
+  };
+  openhd::SeqLock<Data> seq_lock{};
+  std::atomic<bool> run = true;
+  std::thread writer([&] {
+    uint64_t counter = 0;
+    while (run) {
+      counter++;
+      Data data{};
+      data.values.fill((uint16_t)counter);
+      data.counter = counter;
+      seq_lock.store(data);
+    }
+  });
+  std::atomic<int> n_reads = 0;
+  std::atomic<bool> torn = false;
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&] {
+      uint64_t last_counter = 0;
+      while (run) {
+        const auto data = seq_lock.load();
+        for (const auto value : data.values) {
+          if (value != (uint16_t)data.counter) torn = true;
+        }
+        if (data.counter < last_counter) torn = true;
+        last_counter = data.counter;
+        n_reads++;
+      }
+    });
+  }
+  std::this_thread::sleep_for(milliseconds(300));
+  run = false;
+  writer.join();
+  for (auto& reader : readers) reader.join();
+  check(!torn, "consistent reads");
+  std::cout << "SeqLock reads:" << n_reads << std::endl;
+}
+
+#ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+static void test_virtual_joystick_latency() {
+  check(SDL_InitSubSystem(SDL_INIT_JOYSTICK) == 0, "SDL init");
+  const int index =
+      SDL_JoystickAttachVirtual(SDL_JOYSTICK_TYPE_GAMECONTROLLER, 4, 8, 0);
+  check(index >= 0, "attach virtual joystick");
+  SDL_Joystick* virtual_joystick = SDL_JoystickOpen(index);
+  check(virtual_joystick != nullptr, "open virtual joystick");
+  std::atomic<int> last_channel_0 = 0;
+  std::atomic<int64_t> last_channel_0_change_ns = 0;
+  auto cb = [&](std::array<uint16_t, 18> channels) {
+    if (channels[0] != last_channel_0) {
+      last_channel_0_change_ns =
+          duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+              .count();
+      last_channel_0 = channels[0];
+    }
+  };
+  auto sender = std::make_unique<RcJoystickSender>(
+      cb, 30, openhd::get_default_channel_mapping());
+  // Wait for the reader to pick up the joystick
+  const auto wait_begin = steady_clock::now();
+  while (last_channel_0 == 0) {
+    check(steady_clock::now() - wait_begin < seconds(5), "joystick connected");
+    std::this_thread::sleep_for(milliseconds(10));
+  }
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> pause_ms(2, 20);
+  std::vector<microseconds> latencies;
+  for (int i = 0; i < 500; i++) {
+    const bool high = i % 2 == 0;
+    const auto set_tp = steady_clock::now();
+    SDL_JoystickSetVirtualAxis(virtual_joystick, 0, high ? 32767 : -32768);
+    while (high ? last_channel_0 < 1900 : last_channel_0 > 1100) {
+      check(steady_clock::now() - set_tp < seconds(1), "value arrives");
+      std::this_thread::yield();
+    }
+    const auto arrived_tp = steady_clock::time_point(
+        nanoseconds(last_channel_0_change_ns.load()));
+    latencies.push_back(duration_cast<microseconds>(arrived_tp - set_tp));
+    std::this_thread::sleep_for(milliseconds(pause_ms(rng)));
+  }
+  std::sort(latencies.begin(), latencies.end());
+  const auto p50 = latencies[latencies.size() / 2];
+  const auto p99 = latencies[latencies.size() * 99 / 100];
+  std::cout << "Stick to packet p50:" << p50.count()
+            << "us p99:" << p99.count()
+            << "us max:" << latencies.back().count() << "us" << std::endl;
+  std::cout << "Sender: "
+            << RcJoystickSender::latency_stats_to_string(
+                   sender->get_latency_stats())
+            << std::endl;
+  check(p99 <= FRAME_INTERVAL, "p99 latency <= 1 frame");
+  sender.reset();
+  SDL_JoystickClose(virtual_joystick);
+  SDL_JoystickDetachVirtual(index);
+}
+#endif
+#endif
+
+int main(int argc, char* argv[]) {
+  test_send_policy();
+  test_seq_lock();
+#ifdef OPENHD_TELEMETRY_SDL_FOR_JOYSTICK_FOUND
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+  test_virtual_joystick_latency();
+#else
+  std::cout << "SDL too old for a virtual joystick, skipping" << std::endl;
+#endif
+#else
+  std::cout << "No SDL, skipping joystick latency test" << std::endl;
+#endif
+  std::cout << "Done" << std::endl;
+  return 0;
+}
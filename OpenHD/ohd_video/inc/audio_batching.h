@@ -0,0 +1,115 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_AUDIO_BATCHING_H
+#define OPENHD_AUDIO_BATCHING_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "openhd_video_frame.h"
+
+/**
+ * Low latency audio (opus) produces tiny rtp packets (2.5ms .. 10ms of audio,
+ * often less than 50 bytes each). Injecting each of them as its own wb packet
+ * wastes a lot of airtime on the 802.11 / radiotap / wb overhead - therefore,
+ * on the air unit we batch a couple of consecutive rtp packets into one wb
+ * audio packet, and the ground unit splits them up again.
+ *
+ * The batch also carries the (air unit) capture timestamp of the first
+ * packet, which allows the ground to run an adaptive playout buffer and
+ * to measure the audio latency.
+ *
+ * Legacy (PCMA) audio is not batched - a batch can be told apart from a plain
+ * rtp packet by its first byte (rtp version 2 always has the 2 MSBs set to
+ * 0b10).
+ */
+namespace openhd::audio {
+
+struct AudioBatchHeader {
+  uint8_t magic;
+  uint8_t n_packets;
+  // Duration of one (opus) frame, in us
+  uint16_t frame_duration_us;
+  // Capture time of the first packet in this batch, air unit steady clock
+  uint64_t capture_ts_us;
+} __attribute__((packed));
+static_assert(sizeof(AudioBatchHeader) == 12);
+
+static constexpr uint8_t AUDIO_BATCH_MAGIC = 0x0A;
+// Keep well below the max wb payload size
+static constexpr int AUDIO_BATCH_MAX_BYTES = 1024;
+static constexpr int AUDIO_BATCH_MAX_N_PACKETS = 16;
+
+// Returns true if the given data (received on the audio stream) is a batch
+// and needs to be unpacked, false if it is a plain rtp packet.
+bool is_audio_batch(const uint8_t* data, int data_len);
+
+struct UnpackedAudioPacket {
+  std::shared_ptr<std::vector<uint8_t>> rtp_packet;
+  // Capture time of this packet, air unit steady clock
+  uint64_t capture_ts_us;
+};
+// Returns std::nullopt if the batch is malformed
+std::optional<std::vector<UnpackedAudioPacket>> unpack_audio_batch(
+    const uint8_t* data, int data_len);
+
+/**
+ * Air unit: Collects rtp audio packets until either the batch window is
+ * filled or the batch would exceed the max size, then forwards the batch.
+ * Not thread-safe, meant to be called from the audio stream thread only.
+ */
+class AudioBatcher {
+ public:
+  /**
+   * @param frame_duration_us duration of one encoded audio frame
+   * @param batch_window_us how much audio we batch at most into one packet -
+   * this directly adds to the latency, so keep it small.
+   * @param cb called with each completed batch
+   */
+  explicit AudioBatcher(int frame_duration_us, int batch_window_us,
+                        openhd::ON_AUDIO_TX_DATA_PACKET cb);
+  void on_rtp_packet(std::shared_ptr<std::vector<uint8_t>> rtp_packet,
+                     std::chrono::steady_clock::time_point capture_time);
+  // Forward whatever is currently buffered (if anything)
+  void flush();
+  [[nodiscard]] int get_n_packets_per_batch() const {
+    return m_n_packets_per_batch;
+  }
+
+ private:
+  const int m_frame_duration_us;
+  const int m_n_packets_per_batch;
+  const openhd::ON_AUDIO_TX_DATA_PACKET m_cb;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> m_packets;
+  int m_n_bytes = 0;
+  std::chrono::steady_clock::time_point m_first_capture_time;
+};
+
+}  // namespace openhd::audio
+
+#endif  // OPENHD_AUDIO_BATCHING_H
@@ -0,0 +1,141 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_AUDIO_PLAYOUT_BUFFER_H
+#define OPENHD_AUDIO_PLAYOUT_BUFFER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openhd_spdlog.h"
+
+/**
+ * Ground unit: Jitter aware playout buffer for (batched) low latency audio.
+ * Incoming rtp packets are re-ordered by their rtp sequence number and
+ * released at capture time + a target delay. The target delay adapts to the
+ * currently observed jitter - the lowest transit time (arrival - capture) of
+ * the last couple of seconds is used as the base, and a high percentile of
+ * the transit time variation on top of it as safety margin.
+ * Since only the difference between transit times is used, this works without
+ * the air and ground clocks being synchronized.
+ * Packets that arrive after their playout deadline are dropped (the decoder
+ * conceals them, or with 10ms opus frames recovers them via in-band FEC with
+ * the next packet).
+ */
+class AudioPlayoutBuffer {
+ public:
+  struct Options {
+    // Lower / upper bound for the adaptive jitter margin
+    std::chrono::microseconds min_margin = std::chrono::milliseconds(2);
+    std::chrono::microseconds max_margin = std::chrono::milliseconds(60);
+    // Window the base transit time / jitter percentile is calculated over
+    std::chrono::milliseconds window = std::chrono::seconds(2);
+    // Percentile of the transit time variation we want to absorb
+    int jitter_percentile = 95;
+    // Offset to convert an air unit capture timestamp to the local clock,
+    // only needed for the mouth to ear latency stat (see
+    // openhd::util::get_air_unit_time_offset_us)
+    std::function<int64_t()> get_air_time_offset_us = nullptr;
+  };
+  struct Stats {
+    uint64_t n_packets_in = 0;
+    uint64_t n_packets_out = 0;
+    // Gaps in the rtp sequence at playout time
+    uint64_t n_packets_lost = 0;
+    // Arrived after their playout deadline (moved from lost to late then, such
+    // that each packet is only counted once)
+    uint64_t n_packets_late = 0;
+    // Including copies of packets that have been released already
+    uint64_t n_packets_duplicate = 0;
+    int curr_target_margin_us = 0;
+    // capture on air to release on ground, includes the playout delay
+    int curr_mouth_to_ear_us_avg = 0;
+    int curr_mouth_to_ear_us_max = 0;
+    // lost + late since the last get_stats() call, in percent
+    int curr_loss_perc = 0;
+    [[nodiscard]] int loss_percentage() const;
+    [[nodiscard]] std::string to_string() const;
+  };
+  typedef std::function<void(const uint8_t* data, int data_len)> OUTPUT_CB;
+  explicit AudioPlayoutBuffer(OUTPUT_CB cb, Options options);
+  AudioPlayoutBuffer(const AudioPlayoutBuffer&) = delete;
+  AudioPlayoutBuffer(const AudioPlayoutBuffer&&) = delete;
+  ~AudioPlayoutBuffer();
+  // Thread-safe, called from the link rx thread
+  void push(std::shared_ptr<std::vector<uint8_t>> rtp_packet,
+            uint64_t capture_ts_us);
+  Stats get_stats();
+
+ private:
+  struct Entry {
+    std::shared_ptr<std::vector<uint8_t>> rtp_packet;
+    uint64_t capture_ts_us;
+    std::chrono::steady_clock::time_point playout_time;
+  };
+  struct TransitSample {
+    std::chrono::steady_clock::time_point arrival;
+    int64_t transit_us;
+  };
+  void loop_playout();
+  void recalculate_target_margin(std::chrono::steady_clock::time_point now);
+  // Unwraps the 16 bit rtp sequence number
+  int64_t extended_seq_nr(uint16_t seq_nr);
+  void on_release(const Entry& entry);
+  const OUTPUT_CB m_cb;
+  const Options m_options;
+  std::shared_ptr<spdlog::logger> m_console;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  // Ordered by (extended) rtp sequence number
+  std::map<int64_t, Entry> m_entries;
+  std::deque<TransitSample> m_transit_samples;
+  std::chrono::steady_clock::time_point m_last_margin_recalculation{};
+  int64_t m_base_transit_us = 0;
+  int64_t m_target_margin_us = 0;
+  int64_t m_last_released_seq = -1;
+  int64_t m_highest_seq = -1;
+  // Recent gaps at playout time (counted as lost), to tell a late packet from
+  // a duplicate of a released one. Only the last MAX_SKIPPED_SEQS_AGE
+  // sequence numbers are tracked, a packet that late counts as duplicate.
+  std::set<int64_t> m_skipped_seqs;
+  static constexpr int64_t MAX_SKIPPED_SEQS_AGE = 1024;
+  Stats m_stats{};
+  int64_t m_mouth_to_ear_sum_us = 0;
+  int m_mouth_to_ear_count = 0;
+  int m_mouth_to_ear_max_us = 0;
+  // For the curr_ stats
+  Stats m_stats_last_get{};
+  bool m_keep_running = true;
+  std::unique_ptr<std::thread> m_thread;
+};
+
+#endif  // OPENHD_AUDIO_PLAYOUT_BUFFER_H
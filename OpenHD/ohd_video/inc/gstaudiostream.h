@@ -26,12 +26,15 @@
 
 #include <gst/gst.h>
 
+#include "audio_batching.h"
 #include "openhd_link.hpp"
 
 /**
  * Similar to gstreamerstream
  * only for audio ;)
  * provides rtp audio data from autoaudiosrc
+ * Either legacy PCMA (one rtp packet per wb packet) or low latency opus, in
+ * which case the tiny rtp packets are batched (see audio_batching.h)
  */
 class GstAudioStream {
  public:
@@ -41,6 +44,10 @@ class GstAudioStream {
   void start_looping();
   void stop_looping();
   bool openhd_enable_audio_test = false;
+  // Needs to be set before start_looping()
+  bool use_opus = false;
+  // 2500, 5000 or 10000 (opusenc frame-size)
+  int opus_frame_duration_us = 10000;
 
  private:
   void loop_infinite();
@@ -51,6 +58,8 @@ class GstAudioStream {
   std::atomic_bool m_keep_looping = false;
   std::unique_ptr<std::thread> m_loop_thread = nullptr;
   openhd::ON_AUDIO_TX_DATA_PACKET m_cb = nullptr;
+  // Only used with opus
+  std::unique_ptr<openhd::audio::AudioBatcher> m_batcher = nullptr;
 
  private:
   // points to a running gst pipeline instance
@@ -55,18 +55,43 @@ class GStreamerStream : public CameraStream {
   ~GStreamerStream();
   void start_looping() override;
   void terminate_looping() override;
+  // Enabled by default, but only has an effect if the camera supports it (see
+  // supports_hitless_reconfiguration()). Mostly for testing.
+  void set_enable_hitless_reconfiguration(bool enable) {
+    m_enable_hitless_reconfiguration = enable;
+  }
 
  private:
+  // Everything that belongs to one gstreamer pipeline instance. While a
+  // (hitless) reconfiguration is in progress, there are two of them - the
+  // active one and the pre-warmed standby one.
+  struct PipelineInstance {
+    // points to a running gst pipeline instance
+    GstElement* gst_pipeline = nullptr;
+    // pull samples (fragments) out of the gstreamer pipeline
+    GstElement* app_sink_element = nullptr;
+    // not supported by all camera(s).
+    // for dynamically changing the bitrate
+    std::optional<GstBitrateControlElement> bitrate_ctrl_element = std::nullopt;
+    // If a pipeline is started with air recording enabled, the file name the
+    // recording is written to is stored here otherwise, it is set to
+    // std::nullopt
+    std::optional<std::string> opt_recording_filename = std::nullopt;
+    std::shared_ptr<openhd::RTPHelper> rtp_helper;
+    // Settings this pipeline was created with
+    CameraSettings settings;
+  };
   // Creates a valid gstreamer pipeline for the given camera,
   // including the source and encoder, not including appsink
   std::string create_source_encode_pipeline(const CameraHolder& cam_holder);
-  void setup();
+  // Returns false if the pipeline could not be created
+  bool setup(PipelineInstance& instance, bool is_standby);
   // Set gst state to PLAYING
-  void start();
+  void start(PipelineInstance& instance);
   // Set gst state to PAUSED
-  void stop();
+  void stop(PipelineInstance& instance);
   // Set gst state to GST_STATE_NULL and properly cleanup the pipeline.
-  void cleanup_pipe();
+  void cleanup_pipe(PipelineInstance& instance);
   void handle_change_bitrate_request(
       openhd::LinkActionHandler::LinkBitrateInformation lb) override;
   // this is called when the FC reports itself as armed / disarmed
@@ -78,16 +103,33 @@ class GStreamerStream : public CameraStream {
   void request_restart();
 
  private:
-  // points to a running gst pipeline instance
-  GstElement* m_gst_pipeline = nullptr;
-  // pull samples (fragments) out of the gstreamer pipeline
-  GstElement* m_app_sink_element = nullptr;
-  // not supported by all camera(s).
-  // for dynamically changing the bitrate
-  std::optional<GstBitrateControlElement> m_bitrate_ctrl_element = std::nullopt;
-  // If a pipeline is started with air recording enabled, the file name the
-  // recording is written to is stored here otherwise, it is set to std::nullopt
-  std::optional<std::string> m_opt_curr_recording_filename = std::nullopt;
+  // Hitless reconfiguration: Instead of tearing down the active pipeline and
+  // then building the new one (multiple seconds of no video), the new pipeline
+  // is built and started while the active one keeps streaming. As soon as the
+  // new pipeline produces a key frame, we switch over.
+  // Only possible if the source and encoder can be opened twice at the same
+  // time, which is not the case for real cameras.
+  [[nodiscard]] bool supports_hitless_reconfiguration() const;
+  // Returns false if the standby pipeline could not be created
+  bool begin_standby_pipeline();
+  void discard_standby_pipeline();
+  // Pulls all available data from the standby pipeline, buffering it from the
+  // first key frame on.
+  void pull_standby_pipeline();
+  // Makes the (synced) standby pipeline the active one, the previous active
+  // pipeline is cleaned up in the background
+  void switch_to_standby_pipeline();
+  // Stall detection - no frame for (a multiple of) the frame interval
+  [[nodiscard]] std::chrono::milliseconds get_stall_timeout() const;
+  void join_cleanup_thread();
+  std::unique_ptr<PipelineInstance> m_pipeline = nullptr;
+  std::unique_ptr<PipelineInstance> m_standby_pipeline = nullptr;
+  std::chrono::steady_clock::time_point m_standby_begin{};
+  // Set once the standby pipeline produced the start of a key frame
+  bool m_standby_synced = false;
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> m_standby_fragments;
+  std::unique_ptr<std::thread> m_cleanup_thread = nullptr;
+  bool m_enable_hitless_reconfiguration = true;
   std::shared_ptr<spdlog::logger> m_console;
   // Set to true if armed, used for auto record on arm
   bool m_armed_enable_air_recording = false;
@@ -109,12 +151,11 @@ class GStreamerStream : public CameraStream {
   void x_on_new_rtp_fragmented_frame(
       std::vector<std::shared_ptr<std::vector<uint8_t>>> frame_fragments);
   bool m_last_fu_s_idr = false;
+  bool m_frame_has_codec_config = false;
+  bool m_frame_is_non_reference = false;
   bool dirty_use_raw = false;
   std::chrono::steady_clock::time_point m_last_log_streaming_disabled =
       std::chrono::steady_clock::now();
-
- private:
-  std::shared_ptr<openhd::RTPHelper> m_rtp_helper;
 };
 
 #endif
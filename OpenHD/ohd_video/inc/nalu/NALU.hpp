@@ -63,6 +63,13 @@ static bool is_idr_frame(int value, bool is_h265) {
   }
   return extracted == NALUnitType::H264::NAL_UNIT_TYPE_CODED_SLICE_IDR;
 }
+// h264 only (value is the full nal header byte): nal_ref_idc == 0 means no
+// other frame references this one. The spec requires nal_ref_idc to be the
+// same for all slices of a picture. Always false for h265.
+static bool is_non_reference_frame(int value, bool is_h265) {
+  if (is_h265 || value <= 0) return false;
+  return ((value >> 5) & 0x03) == 0;
+}
 
 /**
  * NOTE: NALU only takes a c-style data pointer - it does not do any memory
@@ -33,6 +33,7 @@
 #include "openhd_platform.h"
 #include "openhd_spdlog.h"
 #include "openhd_udp.h"
+#include "video_bandwidth_arbiter.h"
 
 class GstAudioStream;
 /**
@@ -60,6 +61,9 @@ class OHDVideoAir {
   OHDVideoAir(const OHDVideoAir&) = delete;
   OHDVideoAir(const OHDVideoAir&&) = delete;
   static std::vector<XCamera> discover_cameras();
+  // Initialize gstreamer (loads the plugin registry, which can take a while) -
+  // independent of the camera discovery, so it can run concurrently.
+  static void preload_gstreamer();
   /**
    * In ohd-telemetry, we create a mavlink settings component for each of the
    * camera(s),instead of using one generic settings component like for the rest
@@ -105,6 +109,17 @@ class OHDVideoAir {
   // Optimization for 0 overhead on air when not enabled
   std::atomic_bool m_has_localhost_forwarding_enabled = false;
   bool x_set_camera_type(bool primary, int cam_type);
+  // Dual camera only - periodically re-distributes the bandwidth between
+  // primary and secondary camera
+  void loop_bandwidth_arbitration();
+  // Applies the current arbiter allocation to the camera streams, if it
+  // changed enough (or @param force)
+  void apply_bandwidth_allocation(bool force);
+  std::mutex m_bandwidth_arbiter_mutex;
+  std::unique_ptr<VideoBandwidthArbiter> m_bandwidth_arbiter;
+  std::array<int, 2> m_applied_bitrate_kbits{};
+  std::unique_ptr<std::thread> m_bandwidth_arbiter_thread;
+  std::atomic_bool m_bandwidth_arbiter_run = false;
 };
 
 #endif  // OPENHD_VIDEO_OHDVIDEO_H
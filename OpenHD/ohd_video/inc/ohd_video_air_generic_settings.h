@@ -32,6 +32,8 @@
 
 static int OPENHD_AUDIO_DISABLE = 1;
 static int OPENHD_AUDIO_TEST = 100;
+static int OPENHD_AUDIO_CODEC_PCMA = 0;
+static int OPENHD_AUDIO_CODEC_OPUS = 1;
 
 struct AirCameraGenericSettings {
   // Make primary camera secondary camera and other way around (aka if they are
@@ -41,14 +43,27 @@ struct AirCameraGenericSettings {
   // we need to split that up into bitrate for primary and secondary video
   int dualcam_primary_video_allocated_bandwidth_perc =
       60;  // Default X%:Y split
+  // Instead of the fixed split, re-distribute the bandwidth depending on what
+  // each camera currently needs (the split above is then used as priority
+  // weight), see VideoBandwidthArbiter
+  int dualcam_dynamic_bandwidth = 1;
   // Default camera type(s) depend on platform - see below
   int primary_camera_type = 0;
   int secondary_camera_type = 0;
   // Audio can be enabled, in which case gstreamer hopefully picks up the right
   // audio source via autoaudiosrc
   int enable_audio = OPENHD_AUDIO_DISABLE;
+  // PCMA (legacy, what QOpenHD expects) or low latency opus
+  int audio_codec = OPENHD_AUDIO_CODEC_PCMA;
+  // opus only, 2500, 5000 or 10000
+  int audio_opus_frame_duration_us = 10000;
 };
 
+static bool is_valid_audio_opus_frame_duration_us(int frame_duration_us) {
+  return frame_duration_us == 2500 || frame_duration_us == 5000 ||
+         frame_duration_us == 10000;
+}
+
 static bool is_valid_dualcam_primary_video_allocated_bandwidth(
     int dualcam_primary_video_allocated_bandwidth_perc) {
   return dualcam_primary_video_allocated_bandwidth_perc >= 10 &&
@@ -24,6 +24,7 @@
 #ifndef OPENHD_OPENHD_OHD_VIDEO_INC_OHD_VIDEO_GROUND_H_
 #define OPENHD_OPENHD_OHD_VIDEO_INC_OHD_VIDEO_GROUND_H_
 
+#include "audio_playout_buffer.h"
 #include "openhd_external_device.h"
 #include "openhd_link.hpp"
 #include "openhd_udp.h"
@@ -56,6 +57,9 @@ class OHDVideoGround {
   std::unique_ptr<openhd::UDPMultiForwarder> m_primary_video_forwarder;
   std::unique_ptr<openhd::UDPMultiForwarder> m_secondary_video_forwarder;
   std::unique_ptr<openhd::UDPMultiForwarder> m_audio_forwarder;
+  // Created once we receive the first batched audio packet
+  std::unique_ptr<AudioPlayoutBuffer> m_audio_playout_buffer;
+  std::chrono::steady_clock::time_point m_last_audio_stats_update{};
   /**
    * Forward video to all device(s) consuming video.
    * Called by the ohd link handle (aka only wb right now)
@@ -66,6 +70,8 @@ class OHDVideoGround {
 
   /**
    * Forward audio. We only have up to 1 audio stream
+   * Batched (low latency opus) audio is split up and goes through the
+   * playout buffer, legacy audio is forwarded as-is.
    */
   void on_audio_data(const uint8_t* data, int data_len);
 
@@ -26,6 +26,7 @@
 
 #include "nalu/CodecConfigFinder.hpp"
 #include "openhd_link.hpp"
+#include "openhd_memory.h"
 #include "openhd_spdlog.h"
 #include "rtp-payload-internal.h"
 
@@ -63,6 +64,8 @@ class RTPHelper {
   // public due to c/c++ mix (callbacks)
   void on_new_rtp_fragment(const uint8_t* nalu, int bytes, uint32_t timestamp,
                            int last);
+  // Buffer the rtp encoder writes the next packet into
+  uint8_t* get_rtp_packet_buffer(int bytes);
 
  private:
   void on_new_split_nalu(const uint8_t* data, int data_len);
@@ -73,6 +76,9 @@ class RTPHelper {
   void* encoder;
   std::shared_ptr<spdlog::logger> m_console;
   std::vector<std::shared_ptr<std::vector<uint8_t>>> m_frame_fragments;
+  // Grows to the largest rtp packet (~MTU)
+  std::vector<uint8_t> m_rtp_packet_buffer;
+  std::shared_ptr<openhd::memory::BufferPool> m_fragment_pool;
   CodecConfigFinder m_config_finder;
   std::chrono::steady_clock::time_point m_last_codec_config_send_ts =
       std::chrono::steady_clock::now();
@@ -96,6 +102,8 @@ class RTPFragmentBuffer {
  private:
   std::shared_ptr<spdlog::logger> m_console;
   bool m_last_fu_s_idr = false;
+  bool m_frame_has_codec_config = false;
+  bool m_frame_is_non_reference = false;
   std::vector<std::shared_ptr<std::vector<uint8_t>>> m_frame_fragments;
 };
 
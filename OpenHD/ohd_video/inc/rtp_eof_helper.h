@@ -43,6 +43,18 @@ struct RTPFragmentInfo {
 RTPFragmentInfo h264_more_info(const uint8_t *payload, std::size_t payloadSize);
 RTPFragmentInfo h265_more_info(const uint8_t *payload, std::size_t payloadSize);
 
+// Returns true if this rtp packet is the beginning of a key frame - either
+// codec config data (SPS / VPS, possibly aggregated), which is sent right in
+// front of each key frame, or an IDR / CRA (its first fragment, or the whole
+// NAL unit if it fits into one packet)
+bool is_keyframe_start(const uint8_t *payload, std::size_t payloadSize,
+                       bool is_h265);
+
+// Returns true if this rtp packet contains codec config data (SPS / PPS / VPS,
+// possibly aggregated)
+bool is_codec_config(const uint8_t *payload, std::size_t payloadSize,
+                     bool is_h265);
+
 }  // namespace openhd::rtp_eof_helper
 
 #endif  // OPENHD_OPENHD_OHD_VIDEO_INC_RTP_EOF_HELPER_H_
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#ifndef OPENHD_VIDEO_BANDWIDTH_ARBITER_H
+#define OPENHD_VIDEO_BANDWIDTH_ARBITER_H
+
+#include <array>
+#include <string>
+
+/**
+ * Dual camera: Splits the total video bitrate the link recommends between the
+ * primary and secondary camera stream.
+ * A fixed percentage split wastes bandwidth as soon as one of the cameras
+ * doesn't need its share (e.g. a static thermal / down-facing cam where the
+ * encoder undershoots its target), while the other one (e.g. the primary cam
+ * during high motion) is starving.
+ * Every update, each stream gets a demand estimate from its measured encoder
+ * output, its tx queue fill level and its tx frame drops:
+ * - A stream that uses (close to) all of its allocation, or backs up / drops
+ * in tx, is starving and asks for more.
+ * - A stream that undershoots only asks for what it uses (plus headroom).
+ * Then, each stream first gets its minimum guarantee, and the rest is shared
+ * by weighted water-filling (the primary weight is the user-set split). Left
+ * over bandwidth (no stream wants more) is again shared by weight.
+ * Changes are smoothed to not make the encoders oscillate.
+ * Pure logic, not thread-safe.
+ */
+class VideoBandwidthArbiter {
+ public:
+  static constexpr int N_STREAMS = 2;
+  struct Options {
+    // Each stream always gets at least this much of the total
+    int min_guarantee_perc = 15;
+    // Weight of the primary stream (secondary weight is 100 - this), same as
+    // the fixed split setting
+    int primary_weight_perc = 60;
+    // Utilization above which a stream is considered starving
+    int saturation_perc = 90;
+    // Tx queue fill level above which a stream is considered starving
+    int queue_fill_saturation_perc = 50;
+    // How much more a starving stream asks for each update
+    int grow_perc = 25;
+    // Headroom on top of the measured bitrate for a non-starving stream
+    int headroom_perc = 20;
+    // 0..100, how much of the difference to the new target is applied each
+    // update
+    int smoothing_perc = 50;
+  };
+  struct StreamFeedback {
+    int measured_encoder_bitrate_kbits = 0;
+    int tx_queue_fill_perc = 0;
+    int n_dropped_frames_total = 0;
+  };
+  explicit VideoBandwidthArbiter(Options options);
+  // Rescales the current split immediately (no smoothing), since the link
+  // might not be able to handle the previous total anymore.
+  void set_total_bitrate_kbits(int total_bitrate_kbits);
+  void set_primary_weight_perc(int primary_weight_perc);
+  // Returns the new allocation, call in regular intervals
+  std::array<int, N_STREAMS> update(
+      const std::array<StreamFeedback, N_STREAMS>& feedback);
+  [[nodiscard]] std::array<int, N_STREAMS> get_allocation() const {
+    return m_allocation_kbits;
+  }
+  [[nodiscard]] int get_total_bitrate_kbits() const {
+    return m_total_bitrate_kbits;
+  }
+  [[nodiscard]] std::string to_string() const;
+
+ private:
+  [[nodiscard]] std::array<int, N_STREAMS> get_weights() const;
+  [[nodiscard]] std::array<int, N_STREAMS> calculate_weighted_split() const;
+  Options m_options;
+  int m_total_bitrate_kbits = 0;
+  std::array<int, N_STREAMS> m_allocation_kbits{};
+  std::array<int, N_STREAMS> m_last_demand_kbits{};
+  std::array<int, N_STREAMS> m_last_n_dropped_frames{};
+};
+
+#endif  // OPENHD_VIDEO_BANDWIDTH_ARBITER_H
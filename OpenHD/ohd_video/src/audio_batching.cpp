@@ -0,0 +1,121 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "audio_batching.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+static uint64_t steady_clock_us(std::chrono::steady_clock::time_point tp) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             tp.time_since_epoch())
+      .count();
+}
+
+bool openhd::audio::is_audio_batch(const uint8_t* data, int data_len) {
+  if (data_len < (int)sizeof(AudioBatchHeader)) return false;
+  return data[0] == AUDIO_BATCH_MAGIC;
+}
+
+std::optional<std::vector<openhd::audio::UnpackedAudioPacket>>
+openhd::audio::unpack_audio_batch(const uint8_t* data, int data_len) {
+  if (!is_audio_batch(data, data_len)) return std::nullopt;
+  AudioBatchHeader header{};
+  std::memcpy(&header, data, sizeof(AudioBatchHeader));
+  if (header.n_packets == 0 || header.n_packets > AUDIO_BATCH_MAX_N_PACKETS) {
+    return std::nullopt;
+  }
+  std::vector<UnpackedAudioPacket> ret;
+  ret.reserve(header.n_packets);
+  int offset = sizeof(AudioBatchHeader);
+  for (int i = 0; i < header.n_packets; i++) {
+    if (offset + 2 > data_len) return std::nullopt;
+    uint16_t packet_len;
+    std::memcpy(&packet_len, data + offset, 2);
+    offset += 2;
+    if (packet_len == 0 || offset + packet_len > data_len) return std::nullopt;
+    auto packet = std::make_shared<std::vector<uint8_t>>(
+        data + offset, data + offset + packet_len);
+    offset += packet_len;
+    const uint64_t capture_ts_us =
+        header.capture_ts_us + (uint64_t)i * header.frame_duration_us;
+    ret.push_back(UnpackedAudioPacket{std::move(packet), capture_ts_us});
+  }
+  return ret;
+}
+
+openhd::audio::AudioBatcher::AudioBatcher(int frame_duration_us,
+                                          int batch_window_us,
+                                          openhd::ON_AUDIO_TX_DATA_PACKET cb)
+    : m_frame_duration_us(frame_duration_us),
+      m_n_packets_per_batch(std::max(
+          1, std::min(AUDIO_BATCH_MAX_N_PACKETS,
+                      batch_window_us / std::max(1, frame_duration_us)))),
+      m_cb(std::move(cb)) {}
+
+void openhd::audio::AudioBatcher::on_rtp_packet(
+    std::shared_ptr<std::vector<uint8_t>> rtp_packet,
+    std::chrono::steady_clock::time_point capture_time) {
+  const int packet_size_with_len = (int)rtp_packet->size() + 2;
+  if (!m_packets.empty() &&
+      (int)sizeof(AudioBatchHeader) + m_n_bytes + packet_size_with_len >
+          AUDIO_BATCH_MAX_BYTES) {
+    flush();
+  }
+  if (m_packets.empty()) {
+    m_first_capture_time = capture_time;
+  }
+  m_packets.push_back(std::move(rtp_packet));
+  m_n_bytes += packet_size_with_len;
+  if ((int)m_packets.size() >= m_n_packets_per_batch) {
+    flush();
+  }
+}
+
+void openhd::audio::AudioBatcher::flush() {
+  if (m_packets.empty()) return;
+  auto batch = std::make_shared<std::vector<uint8_t>>(
+      sizeof(AudioBatchHeader) + m_n_bytes);
+  AudioBatchHeader header{};
+  header.magic = AUDIO_BATCH_MAGIC;
+  header.n_packets = static_cast<uint8_t>(m_packets.size());
+  header.frame_duration_us = static_cast<uint16_t>(m_frame_duration_us);
+  header.capture_ts_us = steady_clock_us(m_first_capture_time);
+  std::memcpy(batch->data(), &header, sizeof(AudioBatchHeader));
+  int offset = sizeof(AudioBatchHeader);
+  for (const auto& packet : m_packets) {
+    const auto packet_len = static_cast<uint16_t>(packet->size());
+    std::memcpy(batch->data() + offset, &packet_len, 2);
+    offset += 2;
+    std::memcpy(batch->data() + offset, packet->data(), packet->size());
+    offset += (int)packet->size();
+  }
+  m_packets.clear();
+  m_n_bytes = 0;
+  if (m_cb) {
+    openhd::AudioPacket audio_packet;
+    audio_packet.data = batch;
+    m_cb(audio_packet);
+  }
+}
@@ -0,0 +1,244 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "audio_playout_buffer.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+static int64_t steady_clock_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int AudioPlayoutBuffer::Stats::loss_percentage() const {
+  const uint64_t total = n_packets_out + n_packets_lost + n_packets_late;
+  if (total == 0) return 0;
+  return static_cast<int>((n_packets_lost + n_packets_late) * 100 / total);
+}
+
+std::string AudioPlayoutBuffer::Stats::to_string() const {
+  std::stringstream ss;
+  ss << "AudioPlayout{in:" << n_packets_in << " out:" << n_packets_out
+     << " lost:" << n_packets_lost << " late:" << n_packets_late
+     << " dup:" << n_packets_duplicate << " loss:" << loss_percentage() << "%"
+     << " curr_loss:" << curr_loss_perc << "%"
+     << " margin:" << curr_target_margin_us << "us"
+     << " m2e_avg:" << curr_mouth_to_ear_us_avg << "us"
+     << " m2e_max:" << curr_mouth_to_ear_us_max << "us}";
+  return ss.str();
+}
+
+AudioPlayoutBuffer::AudioPlayoutBuffer(OUTPUT_CB cb, Options options)
+    : m_cb(std::move(cb)), m_options(std::move(options)) {
+  m_console = openhd::log::create_or_get("audio_playout");
+  m_target_margin_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          m_options.min_margin)
+          .count();
+  m_thread =
+      std::make_unique<std::thread>(&AudioPlayoutBuffer::loop_playout, this);
+}
+
+AudioPlayoutBuffer::~AudioPlayoutBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keep_running = false;
+  }
+  m_cv.notify_all();
+  if (m_thread) {
+    m_thread->join();
+    m_thread = nullptr;
+  }
+}
+
+int64_t AudioPlayoutBuffer::extended_seq_nr(uint16_t seq_nr) {
+  if (m_highest_seq < 0) {
+    m_highest_seq = seq_nr;
+    return seq_nr;
+  }
+  int64_t candidate = (m_highest_seq & ~int64_t{0xFFFF}) | seq_nr;
+  if (candidate < m_highest_seq - 0x8000) {
+    candidate += 0x10000;
+  } else if (candidate > m_highest_seq + 0x8000) {
+    candidate -= 0x10000;
+  }
+  m_highest_seq = std::max(m_highest_seq, candidate);
+  return candidate;
+}
+
+void AudioPlayoutBuffer::push(std::shared_ptr<std::vector<uint8_t>> rtp_packet,
+                              uint64_t capture_ts_us) {
+  // Fixed rtp header is 12 bytes, sequence number is at offset 2
+  if (rtp_packet->size() < 12) return;
+  const uint16_t seq_nr =
+      (uint16_t)((rtp_packet->at(2) << 8) | rtp_packet->at(3));
+  const auto now = std::chrono::steady_clock::now();
+  const int64_t arrival_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          now.time_since_epoch())
+          .count();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.n_packets_in++;
+  const int64_t transit_us = arrival_us - (int64_t)capture_ts_us;
+  m_transit_samples.push_back(TransitSample{now, transit_us});
+  if (m_transit_samples.size() == 1 ||
+      now - m_last_margin_recalculation > std::chrono::milliseconds(100)) {
+    recalculate_target_margin(now);
+  } else if (transit_us < m_base_transit_us) {
+    // Don't wait for the next recalculation to lower the base
+    m_base_transit_us = transit_us;
+  }
+  const int64_t seq = extended_seq_nr(seq_nr);
+  if (seq <= m_last_released_seq) {
+    if (m_skipped_seqs.erase(seq) > 0) {
+      // Already counted as lost when its slot was skipped
+      m_stats.n_packets_lost--;
+      m_stats.n_packets_late++;
+    } else {
+      m_stats.n_packets_duplicate++;
+    }
+    return;
+  }
+  if (m_entries.find(seq) != m_entries.end()) {
+    m_stats.n_packets_duplicate++;
+    return;
+  }
+  const int64_t playout_us =
+      (int64_t)capture_ts_us + m_base_transit_us + m_target_margin_us;
+  const auto playout_time = std::chrono::steady_clock::time_point(
+      std::chrono::microseconds(playout_us));
+  m_entries[seq] = Entry{std::move(rtp_packet), capture_ts_us, playout_time};
+  m_cv.notify_one();
+}
+
+void AudioPlayoutBuffer::recalculate_target_margin(
+    std::chrono::steady_clock::time_point now) {
+  m_last_margin_recalculation = now;
+  while (!m_transit_samples.empty() &&
+         now - m_transit_samples.front().arrival > m_options.window) {
+    m_transit_samples.pop_front();
+  }
+  if (m_transit_samples.empty()) return;
+  int64_t base = m_transit_samples.front().transit_us;
+  for (const auto& sample : m_transit_samples) {
+    base = std::min(base, sample.transit_us);
+  }
+  std::vector<int64_t> variation;
+  variation.reserve(m_transit_samples.size());
+  for (const auto& sample : m_transit_samples) {
+    variation.push_back(sample.transit_us - base);
+  }
+  const size_t idx = std::min(
+      variation.size() - 1,
+      variation.size() * (size_t)m_options.jitter_percentile / 100);
+  std::nth_element(variation.begin(), variation.begin() + idx,
+                   variation.end());
+  const int64_t min_margin_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          m_options.min_margin)
+          .count();
+  const int64_t max_margin_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          m_options.max_margin)
+          .count();
+  m_base_transit_us = base;
+  m_target_margin_us =
+      std::clamp(variation[idx], min_margin_us, max_margin_us);
+  m_stats.curr_target_margin_us = static_cast<int>(m_target_margin_us);
+}
+
+void AudioPlayoutBuffer::on_release(const Entry& entry) {
+  m_stats.n_packets_out++;
+  const int64_t air_offset_us =
+      m_options.get_air_time_offset_us ? m_options.get_air_time_offset_us()
+                                       : 0;
+  const int64_t mouth_to_ear_us =
+      steady_clock_now_us() - ((int64_t)entry.capture_ts_us + air_offset_us);
+  m_mouth_to_ear_sum_us += mouth_to_ear_us;
+  m_mouth_to_ear_count++;
+  m_mouth_to_ear_max_us =
+      std::max(m_mouth_to_ear_max_us, static_cast<int>(mouth_to_ear_us));
+}
+
+void AudioPlayoutBuffer::loop_playout() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_keep_running) {
+    if (m_entries.empty()) {
+      m_cv.wait(lock);
+      continue;
+    }
+    auto it = m_entries.begin();
+    const auto playout_time = it->second.playout_time;
+    if (std::chrono::steady_clock::now() < playout_time) {
+      // Might return early if a packet with a lower sequence number arrives
+      m_cv.wait_until(lock, playout_time);
+      continue;
+    }
+    const int64_t seq = it->first;
+    Entry entry = std::move(it->second);
+    m_entries.erase(it);
+    if (m_last_released_seq >= 0 && seq > m_last_released_seq + 1) {
+      m_stats.n_packets_lost += seq - m_last_released_seq - 1;
+      for (int64_t skipped = std::max(m_last_released_seq + 1,
+                                      seq - MAX_SKIPPED_SEQS_AGE);
+           skipped < seq; skipped++) {
+        m_skipped_seqs.insert(skipped);
+      }
+    }
+    m_last_released_seq = seq;
+    m_skipped_seqs.erase(
+        m_skipped_seqs.begin(),
+        m_skipped_seqs.lower_bound(seq - MAX_SKIPPED_SEQS_AGE));
+    on_release(entry);
+    lock.unlock();
+    if (m_cb) {
+      m_cb(entry.rtp_packet->data(), (int)entry.rtp_packet->size());
+    }
+    lock.lock();
+  }
+}
+
+AudioPlayoutBuffer::Stats AudioPlayoutBuffer::get_stats() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Stats ret = m_stats;
+  ret.curr_mouth_to_ear_us_avg =
+      m_mouth_to_ear_count > 0
+          ? static_cast<int>(m_mouth_to_ear_sum_us / m_mouth_to_ear_count)
+          : 0;
+  ret.curr_mouth_to_ear_us_max = m_mouth_to_ear_max_us;
+  const uint64_t n_lost = (m_stats.n_packets_lost + m_stats.n_packets_late) -
+                          (m_stats_last_get.n_packets_lost +
+                           m_stats_last_get.n_packets_late);
+  const uint64_t n_total =
+      n_lost + (m_stats.n_packets_out - m_stats_last_get.n_packets_out);
+  ret.curr_loss_perc =
+      n_total > 0 ? static_cast<int>(n_lost * 100 / n_total) : 0;
+  m_stats_last_get = m_stats;
+  m_mouth_to_ear_sum_us = 0;
+  m_mouth_to_ear_count = 0;
+  m_mouth_to_ear_max_us = 0;
+  return ret;
+}
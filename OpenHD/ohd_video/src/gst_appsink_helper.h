@@ -29,12 +29,16 @@
 
 #include <optional>
 
+#include "openhd_memory.h"
 #include "openhd_spdlog.h"
 
 namespace openhd {
 
 static std::shared_ptr<std::vector<uint8_t>> gst_copy_buffer(
     GstBuffer* buffer) {
+  // Re-use the fragment buffers instead of allocating one for each
+  static const auto pool = openhd::memory::BufferPool::create(
+      openhd::memory::get_budget().fragment_pool_n_buffers);
   assert(buffer);
   const auto buff_size = gst_buffer_get_size(buffer);
   // openhd::log::get_default()->debug("Got buffer size {}", buff_size);
@@ -43,8 +47,7 @@ static std::shared_ptr<std::vector<uint8_t>> gst_copy_buffer(
   gst_buffer_map(buffer, &map, GST_MAP_READ);
   assert(map.size == buff_size);
   // std::memcpy(ret->data(), map.data, buff_size);
-  auto ret =
-      std::make_shared<std::vector<uint8_t>>(map.data, map.data + buff_size);
+  auto ret = pool->acquire(map.data, (int)buff_size);
   gst_buffer_unmap(buffer, &map);
   return ret;
 }
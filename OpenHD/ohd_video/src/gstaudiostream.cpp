@@ -98,6 +98,41 @@ static std::string rpi_detect_alsasrc_device() {
   return DEFAULT_ALSASRC_DEVICE;
 }
 
+static constexpr int OPUS_SAMPLE_RATE = 48000;
+// How much audio we put into one wb packet at most, see AudioBatcher
+static constexpr int OPUS_BATCH_WINDOW_US = 10000;
+
+// Low latency opus:
+// In-band FEC (the decoder recovers a lost packet from the next one) is only
+// carried by the SILK layer, which needs frames of at least 10ms. With 10ms
+// frames we let opus pick SILK / hybrid for voice, and tell it the expected
+// loss such that it actually spends bits on FEC. Shorter frames are CELT only
+// (restricted-lowdelay) - there, a lost packet can only be concealed.
+static void append_opus_encoder(std::stringstream& ss, int frame_duration_us) {
+  std::string frame_size;
+  if (frame_duration_us == 2500) {
+    frame_size = "2.5";
+  } else if (frame_duration_us == 5000) {
+    frame_size = "5";
+  } else {
+    frame_size = "10";
+  }
+  ss << "queue max-size-buffers=2 leaky=downstream ! ";
+  ss << "audioconvert ! ";
+  ss << "audioresample ! ";
+  ss << "audio/x-raw,format=S16LE,rate=" << OPUS_SAMPLE_RATE
+     << ",channels=1 ! ";
+  if (frame_duration_us >= 10000) {
+    // Hybrid mode stays in use up to ~32kbit/s mono
+    ss << "opusenc bitrate=32000 audio-type=voice frame-size=" << frame_size
+       << " inband-fec=true packet-loss-percentage=10 ! ";
+  } else {
+    ss << "opusenc bitrate=64000 audio-type=restricted-lowdelay frame-size="
+       << frame_size << " ! ";
+  }
+  ss << "rtpopuspay ! ";
+}
+
 // 2.0 pipeline tx:
 // gst-launch-1.0 alsasrc device=plughw:1,0 name=mic provide-clock=true
 // do-timestamp=true buffer-time=20000 ! alawenc ! rtppcmapay max-ptime=20000000
@@ -115,7 +150,14 @@ std::string GstAudioStream::create_pipeline() {
   if (OHDFilesystemUtil::exists(std::string(getConfigBasePath()) +
                                 "test_audio.txt") ||
       openhd_enable_audio_test) {
-    ss << "audiotestsrc" << " ! ";
+    if (use_opus) {
+      // Live, so we get one buffer per frame duration like with a real mic
+      ss << "audiotestsrc is-live=true samplesperbuffer="
+         << (OPUS_SAMPLE_RATE / 1000) * opus_frame_duration_us / 1000
+         << " ! ";
+    } else {
+      ss << "audiotestsrc" << " ! ";
+    }
   } else if (opt_manual_audio_source.has_value()) {
     // File, for development
     ss << opt_manual_audio_source.value() << " ! ";
@@ -123,7 +165,13 @@ std::string GstAudioStream::create_pipeline() {
     if (OHDPlatform::instance().is_rpi()) {
       // RPI is weird. autoaudiosrc doesn't work, and
       // the device(s) depend on fkms / kms or are in general weird.
-      ss << "alsasrc device=" << rpi_detect_alsasrc_device() << " ! ";
+      ss << "alsasrc device=" << rpi_detect_alsasrc_device();
+      if (use_opus) {
+        // The default alsa buffer (200ms) would dominate the latency
+        ss << " buffer-time=" << opus_frame_duration_us * 4
+           << " latency-time=" << opus_frame_duration_us;
+      }
+      ss << " ! ";
     } else {
       ss << "autoaudiosrc" << " ! ";
     }
@@ -131,6 +179,11 @@ std::string GstAudioStream::create_pipeline() {
   /*ss << "autoaudiosrc ! ";
   ss << "audioconvert ! ";
   ss << "rtpL16pay ! ";*/
+  if (use_opus) {
+    append_opus_encoder(ss, opus_frame_duration_us);
+    ss << OHDGstHelper::createOutputAppSink();
+    return ss.str();
+  }
   ss << "queue ! ";
   // audioconvert might or might not be needed ...
   // alawenc needs S16LE
@@ -165,6 +218,16 @@ void GstAudioStream::stream_once() {
           .count();
   std::chrono::steady_clock::time_point m_last_audio_packet =
       std::chrono::steady_clock::now();
+  if (use_opus) {
+    auto cb = [this](const openhd::AudioPacket& audio_packet) {
+      if (m_cb) m_cb(audio_packet);
+    };
+    m_batcher = std::make_unique<openhd::audio::AudioBatcher>(
+        opus_frame_duration_us, OPUS_BATCH_WINDOW_US, cb);
+    m_console->debug("Opus {}us frames, {} frames per batch",
+                     opus_frame_duration_us,
+                     m_batcher->get_n_packets_per_batch());
+  }
   // Streaming
   while (true) {
     // Quickly terminate if openhd wants to terminate
@@ -186,6 +249,10 @@ void GstAudioStream::stream_once() {
     }
   }
   // cleanup
+  if (m_batcher) {
+    m_batcher->flush();
+    m_batcher = nullptr;
+  }
   openhd::unref_appsink_element(m_app_sink_element);
   openhd::gst_element_set_set_state_and_log_result(m_gst_pipeline,
                                                    GST_STATE_NULL);
@@ -196,6 +263,11 @@ void GstAudioStream::stream_once() {
 void GstAudioStream::on_audio_packet(
     std::shared_ptr<std::vector<uint8_t>> packet) {
   // m_console->debug("Got audio packet {}", packet->size());
+  if (m_batcher) {
+    m_batcher->on_rtp_packet(std::move(packet),
+                             std::chrono::steady_clock::now());
+    return;
+  }
   if (m_cb) {
     openhd::AudioPacket audioPacket;
     audioPacket.data = packet;
@@ -25,6 +25,7 @@
 
 #include <gst/gst.h>
 
+#include <algorithm>
 #include <iostream>
 #include <utility>
 #include <vector>
@@ -39,6 +40,7 @@
 #include "nalu/fragment_helper.h"
 #include "nalu/nalu_helper.h"
 #include "openhd_rtp.h"
+#include "openhd_thread_policy.h"
 #include "openhd_util.h"
 #include "rpi_hdmi_to_csi_v4l2_helper.h"
 #include "rtp_eof_helper.h"
@@ -206,12 +208,13 @@ std::string GStreamerStream::create_source_encode_pipeline(
   return pipeline.str();
 }
 
-void GStreamerStream::setup() {
+bool GStreamerStream::setup(PipelineInstance& instance, bool is_standby) {
   m_console->debug("GStreamerStream::setup() begin");
   const auto& camera = m_camera_holder->get_camera();
-  const auto& setting = m_camera_holder->get_settings();
+  const auto setting = m_camera_holder->get_settings();
+  instance.settings = setting;
   std::stringstream pipeline_content;
-  m_bitrate_ctrl_element = std::nullopt;
+  instance.bitrate_ctrl_element = std::nullopt;
   pipeline_content << create_source_encode_pipeline(*m_camera_holder);
   // quick check,here the pipeline should end with a "! ";
   if (!OHDUtil::endsWith(pipeline_content.str(), "! ")) {
@@ -259,18 +262,20 @@ void GStreamerStream::setup() {
     m_console->debug("Using [{}] for recording", recording_filename);
     pipeline_content << OHDGstHelper::createRecordingForVideoCodec(
         setting.streamed_video_format.videoCodec, recording_filename);
-    m_opt_curr_recording_filename = recording_filename;
+    instance.opt_recording_filename = recording_filename;
   } else {
-    m_opt_curr_recording_filename = std::nullopt;
+    instance.opt_recording_filename = std::nullopt;
   }
   {
     const auto index = m_camera_holder->get_camera().index;
     const uint8_t cam_type = (uint8_t)m_camera_holder->get_camera().camera_type;
+    // While pre-warming the standby pipeline, the active one keeps streaming
     auto cam_info = openhd::LinkActionHandler::CamInfo{
         true,
         (uint8_t)index,
         cam_type,
-        CAM_STATUS_RESTARTING,
+        is_standby ? (uint8_t)CAM_STATUS_STREAMING
+                   : (uint8_t)CAM_STATUS_RESTARTING,
         ADD_RECORDING_TO_PIPELINE,
         (uint8_t)video_codec_to_int(setting.streamed_video_format.videoCodec),
         (uint16_t)setting.h26x_bitrate_kbits,
@@ -282,60 +287,69 @@ void GStreamerStream::setup() {
   }
   m_console->warn("Starting pipeline:[{}]", pipeline_content.str());
   // Protect against unwanted use - stop and free the pipeline first
-  assert(m_gst_pipeline == nullptr);
+  assert(instance.gst_pipeline == nullptr);
   // Now start the (as a string) built pipeline
   GError* error = nullptr;
-  m_gst_pipeline = gst_parse_launch(pipeline_content.str().c_str(), &error);
+  instance.gst_pipeline =
+      gst_parse_launch(pipeline_content.str().c_str(), &error);
   m_console->debug("GStreamerStream::setup() end");
   if (error) {
     m_console->error("Failed to create pipeline: {}", error->message);
-    return;
+    g_error_free(error);
+    if (instance.gst_pipeline) {
+      gst_object_unref(instance.gst_pipeline);
+      instance.gst_pipeline = nullptr;
+    }
+    return false;
   }
-  m_bitrate_ctrl_element = get_dynamic_bitrate_control_element_in_pipeline(
-      m_gst_pipeline, *m_camera_holder);
+  instance.bitrate_ctrl_element =
+      get_dynamic_bitrate_control_element_in_pipeline(instance.gst_pipeline,
+                                                       *m_camera_holder);
   // we pull data out of the gst pipeline as cpu memory buffer(s) using the
   // gstreamer "appsink" element
-  m_app_sink_element =
-      gst_bin_get_by_name(GST_BIN(m_gst_pipeline), "out_appsink");
-  assert(m_app_sink_element);
+  instance.app_sink_element =
+      gst_bin_get_by_name(GST_BIN(instance.gst_pipeline), "out_appsink");
+  assert(instance.app_sink_element);
   // m_console->debug("Cam encoding format: {}",(int)cam_info.encoding_format);
   auto lol_cb =
       [this](
           std::vector<std::shared_ptr<std::vector<uint8_t>>> frame_fragments) {
         x_on_new_rtp_fragmented_frame(frame_fragments);
       };
-  m_rtp_helper = std::make_shared<openhd::RTPHelper>(
+  instance.rtp_helper = std::make_shared<openhd::RTPHelper>(
       setting.streamed_video_format.videoCodec == VideoCodec::H265);
-  m_rtp_helper->set_out_cb(lol_cb);
+  instance.rtp_helper->set_out_cb(lol_cb);
+  return true;
 }
 
-void GStreamerStream::start() {
+void GStreamerStream::start(PipelineInstance& instance) {
   m_console->debug("GStreamerStream::start()");
-  assert(m_gst_pipeline != nullptr);
-  openhd::register_message_cb(m_gst_pipeline);
-  const auto ret = gst_element_set_state(m_gst_pipeline, GST_STATE_PLAYING);
+  assert(instance.gst_pipeline != nullptr);
+  openhd::register_message_cb(instance.gst_pipeline);
+  const auto ret =
+      gst_element_set_state(instance.gst_pipeline, GST_STATE_PLAYING);
   m_console->debug("State change ret:{}",
                    openhd::gst_state_change_return_to_string(ret));
 }
 
-void GStreamerStream::stop() {
+void GStreamerStream::stop(PipelineInstance& instance) {
   m_console->debug("GStreamerStream::stop()");
-  assert(m_gst_pipeline != nullptr);
-  openhd::gst_element_set_set_state_and_log_result(m_gst_pipeline,
+  assert(instance.gst_pipeline != nullptr);
+  openhd::gst_element_set_set_state_and_log_result(instance.gst_pipeline,
                                                    GST_STATE_PAUSED);
   m_console->debug(
-      openhd::gst_element_get_current_state_as_string(m_gst_pipeline));
+      openhd::gst_element_get_current_state_as_string(instance.gst_pipeline));
 }
 
-void GStreamerStream::cleanup_pipe() {
+void GStreamerStream::cleanup_pipe(PipelineInstance& instance) {
   m_console->debug("GStreamerStream::cleanup_pipe() begin");
-  assert(m_gst_pipeline != nullptr);
+  assert(instance.gst_pipeline != nullptr);
   // Drop the reference to the bitrate control element (if it exists)
-  if (m_bitrate_ctrl_element.has_value()) {
-    unref_bitrate_element(m_bitrate_ctrl_element.value());
+  if (instance.bitrate_ctrl_element.has_value()) {
+    unref_bitrate_element(instance.bitrate_ctrl_element.value());
   }
   // As well as the appsink (always exists)
-  openhd::unref_appsink_element(m_app_sink_element);
+  openhd::unref_appsink_element(instance.app_sink_element);
   // Jan 22: Confirmed this hangs quite a lot of pipeline(s) - removed for that
   // reason
   /*m_console->debug("send EOS begin");
@@ -345,14 +359,14 @@ void GStreamerStream::cleanup_pipe() {
   means }else{ m_console->info("success gst_element_send_event eos");
   }*/
   // TODO do we need to wait until the pipeline is actually in state NULL ?
-  openhd::gst_element_set_set_state_and_log_result(m_gst_pipeline,
+  openhd::gst_element_set_set_state_and_log_result(instance.gst_pipeline,
                                                    GST_STATE_NULL);
-  gst_object_unref(m_gst_pipeline);
-  m_gst_pipeline = nullptr;
-  if (m_opt_curr_recording_filename) {
+  gst_object_unref(instance.gst_pipeline);
+  instance.gst_pipeline = nullptr;
+  if (instance.opt_recording_filename) {
     // make file read / writeable by everybody
     OHDFilesystemUtil::make_file_read_write_everyone(
-        m_opt_curr_recording_filename.value());
+        instance.opt_recording_filename.value());
     // we do not want empty files - this can happen rarely in case the file is
     // created, but no video data is actually written to it actually, looks like
     // it is possible the file might be empty until the gst pipeline is actually
@@ -363,7 +377,7 @@ void GStreamerStream::cleanup_pipe() {
     empty",m_opt_curr_recording_filename.value());
       OHDFilesystemUtil::remove_if_existing(m_opt_curr_recording_filename.value());
     }*/
-    m_opt_curr_recording_filename = std::nullopt;
+    instance.opt_recording_filename = std::nullopt;
   }
   // start demuxing of (all) .mkv files unless the FC is currently armed ( we
   // are in flight) this will of course also de-mux the new ground recording (if
@@ -423,6 +437,8 @@ void GStreamerStream::handle_update_arming_state(bool armed) {
 }
 
 void GStreamerStream::loop_infinite() {
+  openhd::thread::set_current_thread(
+      "gst_stream", openhd::thread::ThreadClass::REALTIME_VIDEO_TX);
   while (m_keep_looping) {
     try {
       stream_once();
@@ -450,17 +466,23 @@ void GStreamerStream::stream_once() {
   // First, we (try) starting the pipeline using the current settings
   openhd::LinkActionHandler::instance().set_cam_info_status(
       m_camera_holder->get_camera().index, CAM_STATUS_RESTARTING);
-  setup();
+  m_pipeline = std::make_unique<PipelineInstance>();
+  if (!setup(*m_pipeline, false)) {
+    m_pipeline = nullptr;
+    // Sleep a bit and hope it works next time
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    return;
+  }
   if (OHDPlatform::instance().is_x20()) {
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
   }
-  start();
+  start(*m_pipeline);
   // Check if we were able to successfully start the pipeline. If - for example
   // - the camera doesn't exist or the resolution set is not supported by the
   // camera, we won't get further than this.
   bool succesfully_streaming = false;
   m_console->debug(openhd::gst_element_get_current_state_as_string(
-      m_gst_pipeline, &succesfully_streaming));
+      m_pipeline->gst_pipeline, &succesfully_streaming));
   /*if(m_camera_holder->get_camera().rpi_csi_mmal_is_csi_to_hdmi ||
   m_camera_holder->get_camera().type==CameraType::ALLWINNER_CSI){
     m_console->warn("Not checking gst state after calling play (bugged)");
@@ -470,8 +492,9 @@ void GStreamerStream::stream_once() {
   if (!succesfully_streaming) {
     m_console->warn("Cannot start streaming. Valid resolution ?",
                     m_camera_holder->get_camera().index);
-    stop();
-    cleanup_pipe();
+    stop(*m_pipeline);
+    cleanup_pipe(*m_pipeline);
+    m_pipeline = nullptr;
     // Sleep a bit and hope it works next time
     std::this_thread::sleep_for(std::chrono::seconds(1));
     return;
@@ -480,13 +503,12 @@ void GStreamerStream::stream_once() {
   // Here we begin the loop where the camera only
   // 1) Constantly produces data
   // 2) reacts to bitrate change(s) from wb link
-  // 3) breaks out of if a restart is requested (changed settings) or no data is
-  // generated
-  //    for X seconds.
+  // 3) on changed settings, either switches to a pre-warmed standby pipeline
+  //    (if supported) or breaks out for a full restart
+  // 4) breaks out if no data is generated for a couple of frame intervals
   //
   // Bitrate is the only value we (NEED) to support changing without a restart
-  int currently_applied_bitrate =
-      m_camera_holder->get_settings().h26x_bitrate_kbits;
+  int currently_applied_bitrate = m_pipeline->settings.h26x_bitrate_kbits;
   m_curr_dynamic_bitrate_kbits = currently_applied_bitrate;
   // Now we should have a running pipeline and are able to pull samples from it
   // We use a timeout of 40ms to not unnecessarily wake up the thread on up to
@@ -496,6 +518,11 @@ void GStreamerStream::stream_once() {
       std::chrono::duration_cast<std::chrono::nanoseconds>(
           std::chrono::milliseconds(40))
           .count();
+  // While a standby pipeline is warming up, we need to poll it frequently, too
+  const uint64_t timeout_standby_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::milliseconds(5))
+          .count();
   // For 'bugged camera restart' fix
   std::chrono::steady_clock::time_point m_last_camera_frame =
       std::chrono::steady_clock::now();
@@ -510,18 +537,27 @@ void GStreamerStream::stream_once() {
     // Quickly terminate if openhd wants to terminate
     if (!m_keep_looping) break;
     // ANNOYING BUGGED CAMERAS FIX - we restart the pipeline if we don't get a
-    // frame from the camera for more than X seconds
-    if (std::chrono::steady_clock::now() - m_last_camera_frame >
-        std::chrono::seconds(5)) {
+    // frame from the camera for more than X seconds (starting up), or a couple
+    // of frame intervals (once streaming)
+    const auto elapsed_since_last_frame =
+        std::chrono::steady_clock::now() - m_last_camera_frame;
+    if (!has_first_frame && elapsed_since_last_frame > std::chrono::seconds(5)) {
       m_console->warn("Restarting camera due to no frame after 5 seconds");
-      m_request_restart = true;
+      break;
+    }
+    if (has_first_frame && elapsed_since_last_frame > get_stall_timeout()) {
+      m_console->warn("Restarting camera due to stall (no frame for {}ms)",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(
+                          elapsed_since_last_frame)
+                          .count());
+      break;
     }
     // Check if we need to set a new bitrate
     if (currently_applied_bitrate != m_curr_dynamic_bitrate_kbits) {
       const int new_bitrate = m_curr_dynamic_bitrate_kbits;
       m_console->debug("Bitrate change, old:{} new:{}",
                        currently_applied_bitrate, new_bitrate);
-      if (m_bitrate_ctrl_element != std::nullopt) {
+      if (m_pipeline->bitrate_ctrl_element != std::nullopt) {
         // apply the new bitrate
         // Don't forget, the rpi csi hdmi needs the 'half bitrate' hack
         auto hacked_bitrate_kbits = new_bitrate;
@@ -531,7 +567,7 @@ void GStreamerStream::stream_once() {
               "bitrate");
           hacked_bitrate_kbits = hacked_bitrate_kbits / 2;
         }
-        auto bitrate_ctrl_element = m_bitrate_ctrl_element.value();
+        auto bitrate_ctrl_element = m_pipeline->bitrate_ctrl_element.value();
         if (change_bitrate(bitrate_ctrl_element, hacked_bitrate_kbits)) {
           currently_applied_bitrate = new_bitrate;
           openhd::LinkActionHandler::instance().set_cam_info_bitrate(
@@ -550,8 +586,34 @@ void GStreamerStream::stream_once() {
     bool tmp_true = true;
     if (m_request_restart.compare_exchange_strong(tmp_true, false)) {
       // Something that requires a whole restart of the pipeline happened
-      m_console->debug("Restart requested, restarting");
-      break;
+      if (supports_hitless_reconfiguration() && has_first_frame) {
+        // Settings might have changed again while pre-warming
+        discard_standby_pipeline();
+        if (!begin_standby_pipeline()) {
+          m_console->warn("Cannot create standby pipeline, restarting");
+          break;
+        }
+        m_console->debug("Restart requested, pre-warming standby pipeline");
+      } else {
+        m_console->debug("Restart requested, restarting");
+        break;
+      }
+    }
+    if (m_standby_pipeline) {
+      if (std::chrono::steady_clock::now() - m_standby_begin >
+          std::chrono::seconds(5)) {
+        m_console->warn("No key frame from standby pipeline, restarting");
+        discard_standby_pipeline();
+        break;
+      }
+      pull_standby_pipeline();
+      // Switch in between two frames of the active pipeline
+      if (m_standby_synced && m_frame_fragments.empty()) {
+        switch_to_standby_pipeline();
+        currently_applied_bitrate = m_pipeline->settings.h26x_bitrate_kbits;
+        m_last_camera_frame = std::chrono::steady_clock::now();
+        continue;
+      }
     }
     const auto elapsed_remaining_space =
         std::chrono::steady_clock::now() -
@@ -563,7 +625,8 @@ void GStreamerStream::stream_once() {
     }
     // try get a new frame fragment from gst
     GstSample* sample = gst_app_sink_try_pull_sample(
-        GST_APP_SINK(m_app_sink_element), timeout_ns);
+        GST_APP_SINK(m_pipeline->app_sink_element),
+        m_standby_pipeline ? timeout_standby_ns : timeout_ns);
     if (sample) {
       if (!has_first_frame) {
         has_first_frame = true;
@@ -586,8 +649,8 @@ void GStreamerStream::stream_once() {
       if (fragment_data && !fragment_data->empty()) {
         // If we got a new sample, aggregate then forward
         if (dirty_use_raw) {
-          m_rtp_helper->feed_multiple_nalu(fragment_data->data(),
-                                           fragment_data->size());
+          m_pipeline->rtp_helper->feed_multiple_nalu(fragment_data->data(),
+                                                     fragment_data->size());
         } else {
           on_new_rtp_frame_fragment(std::move(fragment_data), buffer_dts);
         }
@@ -597,8 +660,11 @@ void GStreamerStream::stream_once() {
   }
   // If we land here, we need to clean up the pipe and (re) start
   const auto terminate_begin = std::chrono::steady_clock::now();
-  stop();
-  cleanup_pipe();
+  discard_standby_pipeline();
+  stop(*m_pipeline);
+  cleanup_pipe(*m_pipeline);
+  m_pipeline = nullptr;
+  join_cleanup_thread();
   m_frame_fragments.resize(0);
   m_console->debug("Terminating pipeline took {}ms",
                    std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -606,6 +672,126 @@ void GStreamerStream::stream_once() {
                        .count());
 }
 
+bool GStreamerStream::supports_hitless_reconfiguration() const {
+  if (!m_enable_hitless_reconfiguration || dirty_use_raw) return false;
+  const auto& camera = m_camera_holder->get_camera();
+  if (camera.camera_type == X_CAM_TYPE_DEVELOPMENT_FILESRC) return true;
+  if (camera.camera_type == X_CAM_TYPE_DUMMY_SW) {
+    // HW encoders might be limited to one instance
+    const auto& platform = OHDPlatform::instance();
+    return m_camera_holder->get_settings().force_sw_encode ||
+           !(platform.is_rpi() || platform.is_rock());
+  }
+  // Real cameras cannot be opened twice, external (udp) sources cannot bind
+  // their port twice
+  return false;
+}
+
+bool GStreamerStream::begin_standby_pipeline() {
+  auto standby = std::make_unique<PipelineInstance>();
+  if (!setup(*standby, true)) {
+    return false;
+  }
+  start(*standby);
+  m_standby_begin = std::chrono::steady_clock::now();
+  m_standby_synced = false;
+  m_standby_fragments.resize(0);
+  m_standby_pipeline = std::move(standby);
+  return true;
+}
+
+void GStreamerStream::discard_standby_pipeline() {
+  if (!m_standby_pipeline) return;
+  stop(*m_standby_pipeline);
+  cleanup_pipe(*m_standby_pipeline);
+  m_standby_pipeline = nullptr;
+  m_standby_synced = false;
+  m_standby_fragments.resize(0);
+}
+
+void GStreamerStream::pull_standby_pipeline() {
+  const bool is_h265 = m_standby_pipeline->settings.streamed_video_format
+                           .videoCodec == VideoCodec::H265;
+  while (true) {
+    GstSample* sample = gst_app_sink_try_pull_sample(
+        GST_APP_SINK(m_standby_pipeline->app_sink_element), 0);
+    if (!sample) return;
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    std::shared_ptr<std::vector<uint8_t>> fragment_data = nullptr;
+    if (buffer && gst_buffer_get_size(buffer) > 0) {
+      fragment_data = openhd::gst_copy_buffer(buffer);
+    }
+    gst_sample_unref(sample);
+    if (!fragment_data || fragment_data->empty()) continue;
+    if (!m_standby_synced) {
+      // Everything before the first key frame cannot be decoded anyways
+      if (!openhd::rtp_eof_helper::is_keyframe_start(
+              fragment_data->data(), fragment_data->size(), is_h265)) {
+        continue;
+      }
+      m_standby_synced = true;
+      m_console->debug("Standby pipeline key frame after {}ms",
+                       std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - m_standby_begin)
+                           .count());
+    }
+    m_standby_fragments.push_back(std::move(fragment_data));
+  }
+}
+
+void GStreamerStream::switch_to_standby_pipeline() {
+  const auto switch_begin = std::chrono::steady_clock::now();
+  auto previous = std::move(m_pipeline);
+  m_pipeline = std::move(m_standby_pipeline);
+  // Setting a gst pipeline to NULL can take quite a while - don't block
+  // streaming on it
+  join_cleanup_thread();
+  std::shared_ptr<PipelineInstance> tmp = std::move(previous);
+  m_cleanup_thread = std::make_unique<std::thread>([this, tmp]() {
+    stop(*tmp);
+    cleanup_pipe(*tmp);
+  });
+  // Forward what we already got from the (now active) pipeline, starting with
+  // the key frame
+  m_last_fu_s_idr = false;
+  auto buffered = std::move(m_standby_fragments);
+  m_standby_fragments.resize(0);
+  m_standby_synced = false;
+  for (auto& fragment : buffered) {
+    on_new_rtp_frame_fragment(std::move(fragment), 0);
+  }
+  openhd::LinkActionHandler::instance().set_cam_info_status(
+      m_camera_holder->get_camera().index, CAM_STATUS_STREAMING);
+  m_console->debug(
+      "Switched to standby pipeline after {}ms, switch took {}ms",
+      std::chrono::duration_cast<std::chrono::milliseconds>(switch_begin -
+                                                            m_standby_begin)
+          .count(),
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - switch_begin)
+          .count());
+}
+
+std::chrono::milliseconds GStreamerStream::get_stall_timeout() const {
+  const auto& camera = m_camera_holder->get_camera();
+  // External sources might pause for a while without being stalled
+  if (camera.camera_type == X_CAM_TYPE_EXTERNAL ||
+      camera.camera_type == X_CAM_TYPE_EXTERNAL_IP) {
+    return std::chrono::seconds(5);
+  }
+  const int fps =
+      std::max(m_pipeline->settings.streamed_video_format.framerate, 1);
+  // 10 frame intervals, but don't go too low for high fps
+  return std::chrono::milliseconds(std::max(10 * 1000 / fps, 100));
+}
+
+void GStreamerStream::join_cleanup_thread() {
+  if (m_cleanup_thread) {
+    m_cleanup_thread->join();
+    m_cleanup_thread = nullptr;
+  }
+}
+
 void GStreamerStream::on_new_rtp_frame_fragment(
     std::shared_ptr<std::vector<uint8_t>> fragment, uint64_t dts) {
   m_frame_fragments.push_back(fragment);
@@ -626,6 +812,11 @@ void GStreamerStream::on_new_rtp_frame_fragment(
     } else {
       m_last_fu_s_idr = false;
     }
+    m_frame_is_non_reference =
+        is_non_reference_frame(info.nal_unit_type, is_h265);
+  } else if (openhd::rtp_eof_helper::is_codec_config(
+                 fragment->data(), fragment->size(), is_h265)) {
+    m_frame_has_codec_config = true;
   }
   // m_console->debug("Fragment {} start:{} end:{}
   // type:{}",m_frame_fragments.size(),
@@ -642,6 +833,8 @@ void GStreamerStream::on_new_rtp_frame_fragment(
     on_new_rtp_fragmented_frame();
     m_frame_fragments.resize(0);
     m_last_fu_s_idr = false;
+    m_frame_has_codec_config = false;
+    m_frame_is_non_reference = false;
   }
 }
 
@@ -659,7 +852,9 @@ void GStreamerStream::on_new_rtp_fragmented_frame() {
                                               enable_ultra_secure_encryption,
                                               nullptr,
                                               is_intra_enabled,
-                                              is_intra_frame};
+                                              is_intra_frame,
+                                              m_frame_has_codec_config,
+                                              m_frame_is_non_reference};
     // m_console->debug("{}",frame.to_string());
     m_output_cb(stream_index, frame);
   } else {
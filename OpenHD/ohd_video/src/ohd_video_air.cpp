@@ -25,11 +25,14 @@
 
 #include <utility>
 
+#include "audio_batching.h"
 #include "camera_discovery.h"
+#include "gst_helper.hpp"
 #include "gstaudiostream.h"
 #include "gstreamerstream.h"
 #include "nalu/fragment_helper.h"
 #include "openhd_config.h"
+#include "openhd_hotplug.h"
 #include "openhd_reboot_util.h"
 
 OHDVideoAir::OHDVideoAir(std::vector<XCamera> cameras,
@@ -81,8 +84,22 @@ OHDVideoAir::OHDVideoAir(std::vector<XCamera> cameras,
     } else {
       m_audio_stream->openhd_enable_audio_test = false;
     }
+    m_audio_stream->use_opus = m_generic_settings->get_settings().audio_codec ==
+                               OPENHD_AUDIO_CODEC_OPUS;
+    m_audio_stream->opus_frame_duration_us =
+        m_generic_settings->get_settings().audio_opus_frame_duration_us;
     m_audio_stream->start_looping();
   }
+  if (m_camera_streams.size() == 2) {
+    VideoBandwidthArbiter::Options options{};
+    options.primary_weight_perc =
+        m_generic_settings->get_settings()
+            .dualcam_primary_video_allocated_bandwidth_perc;
+    m_bandwidth_arbiter = std::make_unique<VideoBandwidthArbiter>(options);
+    m_bandwidth_arbiter_run = true;
+    m_bandwidth_arbiter_thread = std::make_unique<std::thread>(
+        &OHDVideoAir::loop_bandwidth_arbitration, this);
+  }
   openhd::LinkActionHandler::instance().action_request_bitrate_change_register(
       [this](openhd::LinkActionHandler::LinkBitrateInformation lb) {
         this->handle_change_bitrate_request(lb);
@@ -105,6 +122,11 @@ OHDVideoAir::~OHDVideoAir() {
   openhd::ArmingStateHelper::instance().unregister_listener("ohd_video_air");
   openhd::LinkActionHandler::instance().action_request_bitrate_change_register(
       nullptr);
+  m_bandwidth_arbiter_run = false;
+  if (m_bandwidth_arbiter_thread) {
+    m_bandwidth_arbiter_thread->join();
+    m_bandwidth_arbiter_thread = nullptr;
+  }
   // Stop all the camera stream(s)
   m_camera_streams.resize(0);
   // stop audio if running
@@ -198,6 +220,18 @@ std::vector<openhd::Setting> OHDVideoAir::get_generic_settings() {
         openhd::IntSetting{m_generic_settings->get_settings()
                                .dualcam_primary_video_allocated_bandwidth_perc,
                            cb}});
+    auto cb_dynamic = [this](std::string, int value) {
+      if (!(value == 0 || value == 1)) return false;
+      m_generic_settings->unsafe_get_settings().dualcam_dynamic_bandwidth =
+          value;
+      m_generic_settings->persist();
+      return true;
+    };
+    ret.push_back(openhd::Setting{
+        "V_DYN_BW",
+        openhd::IntSetting{
+            m_generic_settings->get_settings().dualcam_dynamic_bandwidth,
+            cb_dynamic}});
   }
   if (!OHDPlatform::instance().is_x20()) {
     auto cb_audio = [this](std::string, int value) {
@@ -211,6 +245,33 @@ std::vector<openhd::Setting> OHDVideoAir::get_generic_settings() {
         "AUDIO_ENABLE",
         openhd::IntSetting{m_generic_settings->get_settings().enable_audio,
                            cb_audio}});
+    auto cb_audio_codec = [this](std::string, int value) {
+      if (value != OPENHD_AUDIO_CODEC_PCMA && value != OPENHD_AUDIO_CODEC_OPUS)
+        return false;
+      m_generic_settings->unsafe_get_settings().audio_codec = value;
+      m_generic_settings->persist();
+      openhd::TerminateHelper::instance().terminate_after(
+          "Audio", std::chrono::seconds(1));
+      return true;
+    };
+    ret.push_back(openhd::Setting{
+        "AUDIO_CODEC",
+        openhd::IntSetting{m_generic_settings->get_settings().audio_codec,
+                           cb_audio_codec}});
+    auto cb_audio_frame = [this](std::string, int value) {
+      if (!is_valid_audio_opus_frame_duration_us(value)) return false;
+      m_generic_settings->unsafe_get_settings().audio_opus_frame_duration_us =
+          value;
+      m_generic_settings->persist();
+      openhd::TerminateHelper::instance().terminate_after(
+          "Audio", std::chrono::seconds(1));
+      return true;
+    };
+    ret.push_back(openhd::Setting{
+        "AUDIO_FRAME_US",
+        openhd::IntSetting{
+            m_generic_settings->get_settings().audio_opus_frame_duration_us,
+            cb_audio_frame}});
   }
   return ret;
 }
@@ -221,6 +282,15 @@ void OHDVideoAir::handle_change_bitrate_request(
     m_camera_streams[0]->handle_change_bitrate_request(lb);
     return;
   }
+  if (m_camera_streams.size() == 2 &&
+      m_generic_settings->get_settings().dualcam_dynamic_bandwidth) {
+    // Keep the current split, the arbiter adjusts it from there
+    std::lock_guard<std::mutex> lock(m_bandwidth_arbiter_mutex);
+    m_bandwidth_arbiter->set_total_bitrate_kbits(
+        lb.recommended_encoder_bitrate_kbits);
+    apply_bandwidth_allocation(true);
+    return;
+  }
   if (m_camera_streams.size() == 2) {
     // Just split the available bitrate between primary and secondary cam,
     // according to the user's preferences
@@ -242,6 +312,48 @@ void OHDVideoAir::handle_change_bitrate_request(
   m_console->warn("openhd should always have either 1 or 2 cameras");
 }
 
+void OHDVideoAir::apply_bandwidth_allocation(bool force) {
+  const auto allocation = m_bandwidth_arbiter->get_allocation();
+  bool changed = force;
+  for (int i = 0; i < 2; i++) {
+    // Don't bother the encoder with changes < 5%
+    const int diff = std::abs(allocation[i] - m_applied_bitrate_kbits[i]);
+    if (diff * 100 > m_applied_bitrate_kbits[i] * 5) changed = true;
+  }
+  if (!changed) return;
+  for (int i = 0; i < 2; i++) {
+    openhd::LinkActionHandler::LinkBitrateInformation lb{allocation[i]};
+    m_camera_streams[i]->handle_change_bitrate_request(lb);
+  }
+  m_applied_bitrate_kbits = allocation;
+  m_console->debug("{}", m_bandwidth_arbiter->to_string());
+}
+
+void OHDVideoAir::loop_bandwidth_arbitration() {
+  while (m_bandwidth_arbiter_run) {
+    // Matches the wb link stats interval the feedback is updated at
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    const auto& settings = m_generic_settings->get_settings();
+    if (!settings.dualcam_dynamic_bandwidth) continue;
+    std::array<VideoBandwidthArbiter::StreamFeedback, 2> feedback{};
+    for (int i = 0; i < 2; i++) {
+      const auto tmp =
+          openhd::LinkActionHandler::instance().get_video_tx_feedback(i);
+      feedback[i].measured_encoder_bitrate_kbits =
+          tmp.measured_encoder_bitrate_kbits;
+      feedback[i].tx_queue_fill_perc = tmp.tx_queue_fill_perc;
+      feedback[i].n_dropped_frames_total = tmp.n_dropped_frames_total;
+    }
+    std::lock_guard<std::mutex> lock(m_bandwidth_arbiter_mutex);
+    // Nothing to distribute until the link recommended a bitrate
+    if (m_bandwidth_arbiter->get_total_bitrate_kbits() <= 0) continue;
+    m_bandwidth_arbiter->set_primary_weight_perc(
+        settings.dualcam_primary_video_allocated_bandwidth_perc);
+    m_bandwidth_arbiter->update(feedback);
+    apply_bandwidth_allocation(false);
+  }
+}
+
 void OHDVideoAir::start_stop_forwarding_external_device(
     openhd::ExternalDevice external_device, bool connected) {
   const std::string client_addr = external_device.external_device_ip;
@@ -294,8 +406,19 @@ void OHDVideoAir::on_audio_data(const openhd::AudioPacket& audio_packet) {
     m_link_handle->transmit_audio_data(audio_packet);
   }
   if (m_has_localhost_forwarding_enabled) {
-    m_audio_forwarder->forwardPacketViaUDP(audio_packet.data->data(),
-                                           audio_packet.data->size());
+    const auto& data = *audio_packet.data;
+    if (openhd::audio::is_audio_batch(data.data(), data.size())) {
+      // Local consumers expect plain rtp
+      auto packets = openhd::audio::unpack_audio_batch(data.data(), data.size());
+      if (packets.has_value()) {
+        for (const auto& packet : packets.value()) {
+          m_audio_forwarder->forwardPacketViaUDP(packet.rtp_packet->data(),
+                                                 packet.rtp_packet->size());
+        }
+      }
+      return;
+    }
+    m_audio_forwarder->forwardPacketViaUDP(data.data(), data.size());
   }
 }
 
@@ -312,17 +435,20 @@ static std::vector<int> x_discover_usb_cameras(int num_usb_cameras) {
   const auto discovery_begin = std::chrono::steady_clock::now();
   console->debug("Waiting for usb camera(s)");
   std::vector<DCameras::DiscoveredUSBCamera> usb_cameras;
-  while (true) {
-    usb_cameras = DCameras::detect_usb_cameras(console, false);
-    if (usb_cameras.size() >= num_usb_cameras) {
-      break;
-    }
-    if (std::chrono::steady_clock::now() - discovery_begin >
-        std::chrono::seconds(10)) {
-      console->warn("Cannot find usb camera(s)");
-      break;
-    }
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+  // Re-checked on each video4linux hotplug event
+  const bool found = openhd::HotplugMonitor::instance().wait_for(
+      [&usb_cameras, &console, num_usb_cameras]() {
+        usb_cameras = DCameras::detect_usb_cameras(console, false);
+        return usb_cameras.size() >= num_usb_cameras;
+      },
+      std::chrono::seconds(10));
+  if (!found) {
+    console->warn("Cannot find usb camera(s)");
+  } else {
+    console->debug("Found usb camera(s) after {}ms",
+                   std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - discovery_begin)
+                       .count());
   }
   std::vector<int> ret;
   for (int i = 0; i < num_usb_cameras; i++) {
@@ -349,6 +475,10 @@ static int get_num_usb_cameras(const int primary_camera_type,
   return num_usb_cameras;
 }
 #endif
+void OHDVideoAir::preload_gstreamer() {
+  OHDGstHelper::initGstreamerOrThrow();
+}
+
 std::vector<XCamera> OHDVideoAir::discover_cameras() {
   auto platform = OHDPlatform::instance();
   auto global_settings_holder =
@@ -35,8 +35,9 @@ extern AirCameraGenericSettings g_airCameraGenericSettings;
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(
     AirCameraGenericSettings, switch_primary_and_secondary,
-    dualcam_primary_video_allocated_bandwidth_perc, primary_camera_type,
-    secondary_camera_type, enable_audio);
+    dualcam_primary_video_allocated_bandwidth_perc, dualcam_dynamic_bandwidth,
+    primary_camera_type, secondary_camera_type, enable_audio, audio_codec,
+    audio_opus_frame_duration_us);
 
 std::optional<AirCameraGenericSettings>
 AirCameraGenericSettingsHolder::impl_deserialize(
@@ -25,8 +25,11 @@
 
 #include <utility>
 
+#include "audio_batching.h"
+#include "openhd_action_handler.h"
 #include "openhd_config.h"
 #include "openhd_util.h"
+#include "openhd_util_time.h"
 
 OHDVideoGround::OHDVideoGround(std::shared_ptr<OHDLink> link_handle)
     : m_link_handle(std::move(link_handle)) {
@@ -71,6 +74,8 @@ OHDVideoGround::~OHDVideoGround() {
     m_link_handle->register_on_receive_video_data_cb(nullptr);
     m_link_handle->m_audio_data_rx_cb = nullptr;
   }
+  m_audio_playout_buffer = nullptr;
+  openhd::LinkActionHandler::instance().set_audio_playout_stats({});
 }
 
 void OHDVideoGround::addForwarder(const std::string& client_addr) {
@@ -127,5 +132,40 @@ void OHDVideoGround::start_stop_forwarding_external_device(
 }
 
 void OHDVideoGround::on_audio_data(const uint8_t* data, int data_len) {
-  m_audio_forwarder->forwardPacketViaUDP(data, data_len);
+  if (!openhd::audio::is_audio_batch(data, data_len)) {
+    m_audio_forwarder->forwardPacketViaUDP(data, data_len);
+    return;
+  }
+  auto packets = openhd::audio::unpack_audio_batch(data, data_len);
+  if (!packets.has_value()) {
+    m_console->debug("Invalid audio batch {}", data_len);
+    return;
+  }
+  if (m_audio_playout_buffer == nullptr) {
+    auto cb = [this](const uint8_t* packet, int packet_len) {
+      m_audio_forwarder->forwardPacketViaUDP(packet, packet_len);
+    };
+    AudioPlayoutBuffer::Options options{};
+    options.get_air_time_offset_us = []() {
+      return openhd::util::get_air_unit_time_offset_us();
+    };
+    m_audio_playout_buffer = std::make_unique<AudioPlayoutBuffer>(cb, options);
+  }
+  for (auto& packet : packets.value()) {
+    m_audio_playout_buffer->push(std::move(packet.rtp_packet),
+                                 packet.capture_ts_us);
+  }
+  const auto now = std::chrono::steady_clock::now();
+  if (now - m_last_audio_stats_update > std::chrono::seconds(1)) {
+    m_last_audio_stats_update = now;
+    const auto stats = m_audio_playout_buffer->get_stats();
+    m_console->debug("{}", stats.to_string());
+    openhd::LinkActionHandler::AudioPlayoutStats published{};
+    published.active = true;
+    published.loss_perc = stats.curr_loss_perc;
+    published.mouth_to_ear_avg_us = stats.curr_mouth_to_ear_us_avg;
+    published.mouth_to_ear_max_us = stats.curr_mouth_to_ear_us_max;
+    published.target_margin_us = stats.curr_target_margin_us;
+    openhd::LinkActionHandler::instance().set_audio_playout_stats(published);
+  }
 }
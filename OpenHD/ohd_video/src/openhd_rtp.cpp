@@ -32,15 +32,9 @@
 #include "rtp-profile.h"
 #include "rtp_eof_helper.h"
 
-static void* rtp_alloc(void* /*param*/, int bytes) {
-  static uint8_t buffer[2 * 1024 * 1024 + 4] = {
-      0,
-      0,
-      0,
-      1,
-  };
-  assert(bytes <= sizeof(buffer) - 4);
-  return buffer + 4;
+static void* rtp_alloc(void* param, int bytes) {
+  auto self = (openhd::RTPHelper*)param;
+  return self->get_rtp_packet_buffer(bytes);
 }
 
 static void rtp_free(void* /*param*/, void* /*packet*/) {}
@@ -57,6 +51,8 @@ static int rtp_encode_packet(void* param, const void* packet, int bytes,
 
 openhd::RTPHelper::RTPHelper(bool is_h265) : m_is_h265(is_h265) {
   m_console = openhd::log::create_or_get("RTPHelp");
+  m_fragment_pool = openhd::memory::BufferPool::create(
+      openhd::memory::get_budget().fragment_pool_n_buffers);
 
   m_handler.alloc = rtp_alloc;
   m_handler.free = rtp_free;
@@ -104,8 +100,14 @@ void openhd::RTPHelper::on_new_rtp_fragment(const uint8_t* data, int data_len,
   // m_console->debug("on_new_rtp_fragment {} ts:{} last:{}", data_len,
   // timestamp,
   //                  last);
-  auto shared = std::make_shared<std::vector<uint8_t>>(data, data + data_len);
-  m_frame_fragments.emplace_back(shared);
+  m_frame_fragments.emplace_back(m_fragment_pool->acquire(data, data_len));
+}
+
+uint8_t* openhd::RTPHelper::get_rtp_packet_buffer(int bytes) {
+  if ((int)m_rtp_packet_buffer.size() < bytes) {
+    m_rtp_packet_buffer.resize(bytes);
+  }
+  return m_rtp_packet_buffer.data();
 }
 
 void openhd::RTPHelper::set_out_cb(openhd::RTPHelper::OUT_CB cb) {
@@ -172,6 +174,11 @@ void openhd::RTPFragmentBuffer::buffer_and_forward(
     } else {
       m_last_fu_s_idr = false;
     }
+    m_frame_is_non_reference =
+        is_non_reference_frame(info.nal_unit_type, m_is_h265);
+  } else if (openhd::rtp_eof_helper::is_codec_config(
+                 fragment->data(), fragment->size(), m_is_h265)) {
+    m_frame_has_codec_config = true;
   }
   // m_console->debug("Fragment {} start:{} end:{}
   // type:{}",m_frame_fragments.size(),
@@ -188,6 +195,8 @@ void openhd::RTPFragmentBuffer::buffer_and_forward(
     on_new_rtp_fragmented_frame();
     m_frame_fragments.resize(0);
     m_last_fu_s_idr = false;
+    m_frame_has_codec_config = false;
+    m_frame_is_non_reference = false;
   }
 }
 
@@ -198,6 +207,8 @@ void openhd::RTPFragmentBuffer::on_new_rtp_fragmented_frame() {
                                             m_enable_ultra_secure_encryption,
                                             nullptr,
                                             m_uses_intra_refresh,
-                                            is_intra_frame};
+                                            is_intra_frame,
+                                            m_frame_has_codec_config,
+                                            m_frame_is_non_reference};
   // m_console->debug("{}",frame.to_string());
 }
@@ -145,3 +145,73 @@ openhd::rtp_eof_helper::RTPFragmentInfo openhd::rtp_eof_helper::h265_more_info(
    }*/
   return ret;
 }
+
+bool openhd::rtp_eof_helper::is_keyframe_start(const uint8_t *payload,
+                                               std::size_t payloadSize,
+                                               bool is_h265) {
+  if (is_h265) {
+    if (payloadSize < RTP_HEADER_SIZE + sizeof(H265::nal_unit_header_h265_t)) {
+      return false;
+    }
+    // IDR_W_RADL, IDR_N_LP, CRA_NUT
+    auto is_irap = [](uint8_t type) {
+      return type == 19 || type == 20 || type == 21;
+    };
+    const uint8_t type = (payload[RTP_HEADER_SIZE] >> 1) & 0x3F;
+    // VPS or aggregation packet (VPS/SPS/PPS)
+    if (type == 32 || type == 48) return true;
+    // Single NAL unit packet (small key frame, e.g. a static scene)
+    if (is_irap(type)) return true;
+    if (type == 49) {
+      if (payloadSize < RTP_HEADER_SIZE +
+                            sizeof(H265::nal_unit_header_h265_t) +
+                            sizeof(H265::fu_header_h265_t)) {
+        return false;
+      }
+      const H265::fu_header_h265_t &fuHeader =
+          *(H265::fu_header_h265_t *)&payload[RTP_HEADER_SIZE +
+                                              sizeof(
+                                                  H265::nal_unit_header_h265_t)];
+      return fuHeader.s && is_irap(fuHeader.fuType);
+    }
+    return false;
+  }
+  if (payloadSize < RTP_HEADER_SIZE + sizeof(H264::nalu_header_t)) {
+    return false;
+  }
+  const uint8_t type = payload[RTP_HEADER_SIZE] & 0x1F;
+  // SPS or STAP-A (SPS/PPS)
+  if (type == 7 || type == 24) return true;
+  // Single NAL unit packet (small key frame, e.g. a static scene)
+  if (type == 5) return true;
+  if (type == 28) {
+    if (payloadSize < RTP_HEADER_SIZE + sizeof(H264::nalu_header_t) +
+                          sizeof(H264::fu_header_t)) {
+      return false;
+    }
+    const H264::fu_header_t &fuHeader =
+        *(H264::fu_header_t
+              *)&payload[RTP_HEADER_SIZE + sizeof(H264::nalu_header_t)];
+    return fuHeader.s && fuHeader.type == 5;
+  }
+  return false;
+}
+
+bool openhd::rtp_eof_helper::is_codec_config(const uint8_t *payload,
+                                             std::size_t payloadSize,
+                                             bool is_h265) {
+  if (is_h265) {
+    if (payloadSize < RTP_HEADER_SIZE + sizeof(H265::nal_unit_header_h265_t)) {
+      return false;
+    }
+    const uint8_t type = (payload[RTP_HEADER_SIZE] >> 1) & 0x3F;
+    // VPS, SPS, PPS or aggregation packet
+    return type == 32 || type == 33 || type == 34 || type == 48;
+  }
+  if (payloadSize < RTP_HEADER_SIZE + sizeof(H264::nalu_header_t)) {
+    return false;
+  }
+  const uint8_t type = payload[RTP_HEADER_SIZE] & 0x1F;
+  // SPS, PPS or STAP-A
+  return type == 7 || type == 8 || type == 24;
+}
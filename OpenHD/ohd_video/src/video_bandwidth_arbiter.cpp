@@ -0,0 +1,144 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include "video_bandwidth_arbiter.h"
+
+#include <algorithm>
+#include <sstream>
+
+VideoBandwidthArbiter::VideoBandwidthArbiter(Options options)
+    : m_options(options) {}
+
+std::array<int, VideoBandwidthArbiter::N_STREAMS>
+VideoBandwidthArbiter::get_weights() const {
+  const int primary = std::clamp(m_options.primary_weight_perc, 1, 99);
+  return {primary, 100 - primary};
+}
+
+std::array<int, VideoBandwidthArbiter::N_STREAMS>
+VideoBandwidthArbiter::calculate_weighted_split() const {
+  const auto weights = get_weights();
+  std::array<int, N_STREAMS> ret{};
+  ret[0] = m_total_bitrate_kbits * weights[0] / 100;
+  ret[1] = m_total_bitrate_kbits - ret[0];
+  return ret;
+}
+
+void VideoBandwidthArbiter::set_total_bitrate_kbits(int total_bitrate_kbits) {
+  total_bitrate_kbits = std::max(total_bitrate_kbits, 0);
+  const int prev_total = m_total_bitrate_kbits;
+  m_total_bitrate_kbits = total_bitrate_kbits;
+  if (prev_total <= 0) {
+    m_allocation_kbits = calculate_weighted_split();
+    return;
+  }
+  // Keep the current ratio
+  const int64_t primary =
+      (int64_t)m_allocation_kbits[0] * total_bitrate_kbits / prev_total;
+  m_allocation_kbits[0] = (int)primary;
+  m_allocation_kbits[1] = total_bitrate_kbits - m_allocation_kbits[0];
+}
+
+void VideoBandwidthArbiter::set_primary_weight_perc(int primary_weight_perc) {
+  m_options.primary_weight_perc = primary_weight_perc;
+}
+
+std::array<int, VideoBandwidthArbiter::N_STREAMS> VideoBandwidthArbiter::update(
+    const std::array<StreamFeedback, N_STREAMS>& feedback) {
+  const int total = m_total_bitrate_kbits;
+  if (total <= 0) return m_allocation_kbits;
+  const auto weights = get_weights();
+  const int guarantee = total * std::clamp(m_options.min_guarantee_perc, 0,
+                                           100 / N_STREAMS) /
+                        100;
+  std::array<int, N_STREAMS> demand{};
+  for (int i = 0; i < N_STREAMS; i++) {
+    const auto& fb = feedback[i];
+    const int allocated = std::max(m_allocation_kbits[i], 1);
+    // Counter is reset when the link is re-created
+    const int n_new_drops =
+        std::max(fb.n_dropped_frames_total - m_last_n_dropped_frames[i], 0);
+    m_last_n_dropped_frames[i] = fb.n_dropped_frames_total;
+    const bool saturated = fb.measured_encoder_bitrate_kbits * 100 >=
+                           allocated * m_options.saturation_perc;
+    const bool congested =
+        fb.tx_queue_fill_perc >= m_options.queue_fill_saturation_perc ||
+        n_new_drops > 0;
+    if (saturated || congested) {
+      demand[i] = allocated * (100 + m_options.grow_perc) / 100;
+    } else {
+      demand[i] = fb.measured_encoder_bitrate_kbits *
+                  (100 + m_options.headroom_perc) / 100;
+    }
+    demand[i] = std::clamp(demand[i], guarantee, total);
+  }
+  m_last_demand_kbits = demand;
+  // Weighted water-filling on top of the guarantee
+  std::array<int, N_STREAMS> target{};
+  target.fill(guarantee);
+  int remaining = total - guarantee * N_STREAMS;
+  while (remaining > 0) {
+    int total_weight = 0;
+    for (int i = 0; i < N_STREAMS; i++) {
+      if (target[i] < demand[i]) total_weight += weights[i];
+    }
+    if (total_weight == 0) break;
+    int given = 0;
+    for (int i = 0; i < N_STREAMS; i++) {
+      if (target[i] >= demand[i]) continue;
+      const int share =
+          std::max(remaining * weights[i] / total_weight, 1);
+      const int give = std::min(share, demand[i] - target[i]);
+      target[i] += give;
+      given += give;
+    }
+    remaining -= given;
+    if (given == 0) break;
+  }
+  // Nobody wants more - share the rest by weight, it is headroom for whoever
+  // needs it first
+  if (remaining > 0) {
+    const int primary_extra = remaining * weights[0] / 100;
+    target[0] += primary_extra;
+    target[1] += remaining - primary_extra;
+  }
+  // Both the previous allocation and the target sum up to the total, so does
+  // the smoothed result
+  const int smoothing = std::clamp(m_options.smoothing_perc, 1, 100);
+  m_allocation_kbits[0] +=
+      (target[0] - m_allocation_kbits[0]) * smoothing / 100;
+  m_allocation_kbits[0] =
+      std::clamp(m_allocation_kbits[0], guarantee, total - guarantee);
+  m_allocation_kbits[1] = total - m_allocation_kbits[0];
+  return m_allocation_kbits;
+}
+
+std::string VideoBandwidthArbiter::to_string() const {
+  std::stringstream ss;
+  ss << "BwArbiter{total:" << m_total_bitrate_kbits
+     << "kBit/s primary:" << m_allocation_kbits[0]
+     << " (demand:" << m_last_demand_kbits[0]
+     << ") secondary:" << m_allocation_kbits[1]
+     << " (demand:" << m_last_demand_kbits[1] << ")}";
+  return ss.str();
+}
@@ -30,4 +30,9 @@
 
 gst-launch-1.0 udpsrc port=5610 caps="application/x-rtp, media=(string)audio, \
  clock-rate=(int)8000, encoding-name=(string)PCMA" ! rtppcmadepay ! \
- audio/x-alaw, rate=8000, channels=1 ! alawdec ! autoaudiosink sync=false
\ No newline at end of file
+ audio/x-alaw, rate=8000, channels=1 ! alawdec ! autoaudiosink sync=false
+
+# Low latency opus (AUDIO_CODEC=1):
+#gst-launch-1.0 udpsrc port=5610 caps="application/x-rtp, media=(string)audio, \
+# clock-rate=(int)48000, encoding-name=(string)OPUS" ! rtpopusdepay ! \
+# opusdec use-inband-fec=true plc=true ! autoaudiosink sync=false
@@ -0,0 +1,178 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "audio_batching.h"
+#include "audio_playout_buffer.h"
+#include "gstaudiostream.h"
+#include "ohd_video_air_generic_settings.h"
+#include "openhd_bitrate.h"
+#include "openhd_udp.h"
+#include "openhd_util.h"
+
+extern AirCameraGenericSettings g_airCameraGenericSettings;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+// Generous - frame duration + batch window + max jitter margin + opus lookahead
+// add up to ~80ms worst case on localhost
+static constexpr int MAX_MOUTH_TO_EAR_AVG_US = 100000;
+// Random loss over a couple of seconds of packets
+static constexpr int MAX_LOSS_DEVIATION_PERC = 5;
+
+static std::shared_ptr<std::vector<uint8_t>> create_rtp(uint16_t seq_nr) {
+  auto ret = std::make_shared<std::vector<uint8_t>>(12 + 10, 0);
+  (*ret)[2] = seq_nr >> 8;
+  (*ret)[3] = seq_nr & 0xFF;
+  return ret;
+}
+
+// A packet that misses its deadline is counted as late, not as lost and late
+static void test_late_counted_once() {
+  AudioPlayoutBuffer playout_buffer(nullptr, AudioPlayoutBuffer::Options{});
+  auto now_us = []() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  };
+  for (const uint16_t seq_nr : {0, 1, 3}) {
+    playout_buffer.push(create_rtp(seq_nr), now_us());
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto stats = playout_buffer.get_stats();
+  check(stats.n_packets_out == 3 && stats.n_packets_lost == 1, "gap lost");
+  // 2 arrives after 3 has been played out, 1 a second time
+  playout_buffer.push(create_rtp(2), now_us());
+  playout_buffer.push(create_rtp(1), now_us());
+  stats = playout_buffer.get_stats();
+  check(stats.n_packets_lost == 0 && stats.n_packets_late == 1,
+        "late packet counted once");
+  check(stats.n_packets_duplicate == 1, "late duplicate");
+}
+
+//
+// Loopback test for the low latency (opus) audio path, no link needed.
+// audiotestsrc -> opus -> batching -> UDP localhost (with optional random
+// loss) -> unbatching -> playout buffer -> 127.0.0.1:5610
+// Prints the mouth to ear latency and loss stats every second, and fails if
+// the measured loss doesn't match the injected loss or the latency is too high.
+// Listen with debug_audio.sh (opus variant) to check the audio itself.
+// Usage: test_audio_opus_loopback [frame duration us] [loss perc] [n seconds]
+//
+int main(int argc, char* argv[]) {
+  int frame_duration_us = 2500;
+  int loss_perc = 0;
+  int n_seconds = 10;
+  if (argc > 1) frame_duration_us = std::atoi(argv[1]);
+  if (argc > 2) loss_perc = std::atoi(argv[2]);
+  if (argc > 3) n_seconds = std::atoi(argv[3]);
+  if (!is_valid_audio_opus_frame_duration_us(frame_duration_us)) {
+    std::cerr << "Invalid frame duration " << frame_duration_us << "\n";
+    return 1;
+  }
+  if (n_seconds < 2) {
+    std::cerr << "Need at least 2 seconds\n";
+    return 1;
+  }
+  test_late_counted_once();
+  // GstAudioStream only pulls data if audio is not disabled
+  g_airCameraGenericSettings.enable_audio = OPENHD_AUDIO_TEST;
+
+  auto output_forwarder = openhd::UDPForwarder("127.0.0.1", 5610);
+  AudioPlayoutBuffer::Options options{};
+  // Same clock on both ends
+  options.get_air_time_offset_us = []() { return 0; };
+  AudioPlayoutBuffer playout_buffer(
+      [&output_forwarder](const uint8_t* data, int data_len) {
+        output_forwarder.forwardPacketViaUDP(data, data_len);
+      },
+      options);
+  openhd::BitrateDebugger bitrate_debugger{"Batched", true};
+  // "Ground"
+  auto receiver = std::make_unique<openhd::UDPReceiver>(
+      "127.0.0.1", 5620,
+      [&playout_buffer](const uint8_t* payload, const std::size_t payloadSize) {
+        auto packets =
+            openhd::audio::unpack_audio_batch(payload, (int)payloadSize);
+        if (!packets.has_value()) {
+          std::cerr << "Invalid batch\n";
+          return;
+        }
+        for (auto& packet : packets.value()) {
+          playout_buffer.push(packet.rtp_packet, packet.capture_ts_us);
+        }
+      });
+  receiver->runInBackground();
+  // "Air"
+  auto link_forwarder = openhd::UDPForwarder("127.0.0.1", 5620);
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<int> dist(0, 99);
+  auto cb = [&](const openhd::AudioPacket& audioPacket) {
+    bitrate_debugger.on_packet(audioPacket.data->size());
+    if (dist(gen) < loss_perc) return;
+    link_forwarder.forwardPacketViaUDP(audioPacket.data->data(),
+                                       audioPacket.data->size());
+  };
+  auto audiostream = std::make_unique<GstAudioStream>();
+  audiostream->openhd_enable_audio_test = true;
+  audiostream->use_opus = true;
+  audiostream->opus_frame_duration_us = frame_duration_us;
+  audiostream->set_link_cb(cb);
+  audiostream->start_looping();
+  int mouth_to_ear_avg_us_max = 0;
+  for (int i = 0; i < n_seconds; i++) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const auto curr = playout_buffer.get_stats();
+    std::cout << curr.to_string() << "\n";
+    // The first second includes the pipeline startup
+    if (i > 0) {
+      mouth_to_ear_avg_us_max =
+          std::max(mouth_to_ear_avg_us_max, curr.curr_mouth_to_ear_us_avg);
+    }
+  }
+  audiostream->stop_looping();
+  receiver->stopBackground();
+  const auto stats = playout_buffer.get_stats();
+  std::cout << "Done, frame:" << frame_duration_us << "us injected loss:"
+            << loss_perc << "% measured loss:" << stats.loss_percentage()
+            << "% mouth to ear avg (max):" << mouth_to_ear_avg_us_max
+            << "us\n";
+  check(stats.n_packets_out > 0, "audio played out");
+  check(std::abs(stats.loss_percentage() - loss_perc) <=
+            MAX_LOSS_DEVIATION_PERC,
+        "measured loss matches injected loss");
+  check(mouth_to_ear_avg_us_max > 0 &&
+            mouth_to_ear_avg_us_max < MAX_MOUTH_TO_EAR_AVG_US,
+        "mouth to ear latency");
+  return 0;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include <functional>
+#include <iostream>
+#include <random>
+
+#include "video_bandwidth_arbiter.h"
+
+//
+// Simulation for the dual camera bandwidth arbitration, no camera / link
+// needed. Two synthetic encoders with a (changing) bitrate they'd need for
+// good quality - the encoder output is capped by the allocated bitrate, and
+// bitrate overshoot results in a backed up tx queue / dropped frames.
+// Compares the dynamic arbitration against the fixed percentage split.
+//
+struct SimEncoder {
+  // What the scene needs at time t (seconds)
+  std::function<int(double)> needed_kbits;
+};
+
+struct SimResult {
+  // Integral of (needed - allocated) over time for each stream, kbit
+  double starved_kbits[2]{};
+  double wasted_kbits = 0;
+  bool guarantee_violated = false;
+  bool total_exceeded = false;
+};
+
+static int total_at(double t) {
+  // Link degrades for a short time
+  if (t >= 50 && t < 55) return 6000;
+  return 10000;
+}
+
+static SimResult run(const std::array<SimEncoder, 2>& encoders, bool dynamic,
+                     bool verbose) {
+  static constexpr double STEP_S = 0.5;
+  static constexpr int N_STEPS = 120;
+  VideoBandwidthArbiter::Options options{};
+  VideoBandwidthArbiter arbiter(options);
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> noise(0.95, 1.05);
+  std::array<VideoBandwidthArbiter::StreamFeedback, 2> feedback{};
+  SimResult result{};
+  for (int step = 0; step < N_STEPS; step++) {
+    const double t = step * STEP_S;
+    const int total = total_at(t);
+    if (total != arbiter.get_total_bitrate_kbits()) {
+      arbiter.set_total_bitrate_kbits(total);
+    }
+    std::array<int, 2> alloc{};
+    if (dynamic) {
+      alloc = arbiter.update(feedback);
+    } else {
+      alloc[0] = total * options.primary_weight_perc / 100;
+      alloc[1] = total - alloc[0];
+    }
+    if (alloc[0] + alloc[1] > total) result.total_exceeded = true;
+    const int guarantee = total * options.min_guarantee_perc / 100;
+    if (dynamic && (alloc[0] < guarantee || alloc[1] < guarantee)) {
+      result.guarantee_violated = true;
+    }
+    for (int i = 0; i < 2; i++) {
+      const int needed = encoders[i].needed_kbits(t);
+      const int output =
+          (int)(std::min(needed, alloc[i]) * noise(gen));
+      feedback[i].measured_encoder_bitrate_kbits = output;
+      feedback[i].tx_queue_fill_perc = output > alloc[i] ? 100 : 0;
+      if (output > alloc[i] * 103 / 100) feedback[i].n_dropped_frames_total++;
+      result.starved_kbits[i] += std::max(needed - alloc[i], 0) * STEP_S;
+      result.wasted_kbits += std::max(alloc[i] - needed, 0) * STEP_S;
+    }
+    if (verbose && step % 10 == 0) {
+      std::cout << "t:" << t << "s need:" << encoders[0].needed_kbits(t) << "/"
+                << encoders[1].needed_kbits(t) << " alloc:" << alloc[0] << "/"
+                << alloc[1] << "\n";
+    }
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  std::array<SimEncoder, 2> encoders{};
+  // Primary: calm, then high motion, then medium
+  encoders[0].needed_kbits = [](double t) {
+    if (t < 10) return 4000;
+    if (t < 30) return 12000;
+    return 6000;
+  };
+  // Secondary: static thermal cam, short period of motion
+  encoders[1].needed_kbits = [](double t) {
+    if (t >= 40 && t < 50) return 5000;
+    return 1200;
+  };
+  const auto fixed = run(encoders, false, false);
+  const auto dynamic = run(encoders, true, true);
+  std::cout << "Fixed split:   starved primary:" << fixed.starved_kbits[0]
+            << " secondary:" << fixed.starved_kbits[1]
+            << " wasted:" << fixed.wasted_kbits << " kbit\n";
+  std::cout << "Dynamic split: starved primary:" << dynamic.starved_kbits[0]
+            << " secondary:" << dynamic.starved_kbits[1]
+            << " wasted:" << dynamic.wasted_kbits << " kbit\n";
+  bool ok = true;
+  if (dynamic.total_exceeded) {
+    std::cerr << "Allocation exceeded the total\n";
+    ok = false;
+  }
+  if (dynamic.guarantee_violated) {
+    std::cerr << "Minimum guarantee violated\n";
+    ok = false;
+  }
+  if (dynamic.starved_kbits[0] + dynamic.starved_kbits[1] >=
+      fixed.starved_kbits[0] + fixed.starved_kbits[1]) {
+    std::cerr << "Dynamic split doesn't reduce starvation\n";
+    ok = false;
+  }
+  std::cout << (ok ? "PASSED" : "FAILED") << "\n";
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+/******************************************************************************
+ * OpenHD
+ *
+ * Licensed under the GNU General Public License (GPL) Version 3.
+ *
+ * This software is provided "as-is," without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose, and non-infringement. For details, see the
+ * full license in the LICENSE file provided with this source code.
+ *
+ * Non-Military Use Only:
+ * This software and its associated components are explicitly intended for
+ * civilian and non-military purposes. Use in any military or defense
+ * applications is strictly prohibited unless explicitly and individually
+ * licensed otherwise by the OpenHD Team.
+ *
+ * Contributors:
+ * A full list of contributors can be found at the OpenHD GitHub repository:
+ * https://github.com/OpenHD
+ *
+ * © OpenHD, All Rights Reserved.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera_holder.h"
+#include "gstreamerstream.h"
+#include "openhd_util.h"
+#include "rtp_eof_helper.h"
+
+//
+// Measures the video blackout (longest gap between two frames) caused by the
+// different kinds of pipeline reconfiguration, with and without the hitless
+// (pre-warmed standby pipeline) reconfiguration. Uses the dummy (videotestsrc,
+// sw encode) camera, so no camera needed.
+//
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    throw std::runtime_error("Failed: " + what);
+  }
+}
+
+// rtp header + the given NAL unit header / FU header bytes
+static std::vector<uint8_t> create_rtp(std::vector<uint8_t> nal) {
+  std::vector<uint8_t> ret(12, 0);
+  ret.insert(ret.end(), nal.begin(), nal.end());
+  ret.resize(ret.size() + 100, 0);
+  return ret;
+}
+
+// The standby pipeline is synced at the first key frame start
+static void test_keyframe_start() {
+  auto is_start = [](const std::vector<uint8_t>& packet, bool is_h265) {
+    return openhd::rtp_eof_helper::is_keyframe_start(packet.data(),
+                                                     packet.size(), is_h265);
+  };
+  // H264: SPS, STAP-A, single NAL IDR, FU-A IDR start
+  check(is_start(create_rtp({0x67}), false), "h264 sps");
+  check(is_start(create_rtp({0x78}), false), "h264 stap-a");
+  check(is_start(create_rtp({0x65}), false), "h264 single nal idr");
+  check(is_start(create_rtp({0x7C, 0x85}), false), "h264 fu-a idr start");
+  check(!is_start(create_rtp({0x7C, 0x05}), false), "h264 fu-a idr middle");
+  check(!is_start(create_rtp({0x7C, 0x81}), false), "h264 fu-a non idr");
+  check(!is_start(create_rtp({0x41}), false), "h264 single nal non idr");
+  // H265: VPS, single NAL IDR_W_RADL / CRA, FU IDR start
+  check(is_start(create_rtp({32 << 1, 1}), true), "h265 vps");
+  check(is_start(create_rtp({19 << 1, 1}), true), "h265 single nal idr");
+  check(is_start(create_rtp({21 << 1, 1}), true), "h265 single nal cra");
+  check(is_start(create_rtp({49 << 1, 1, 0x80 | 19}), true),
+        "h265 fu idr start");
+  check(!is_start(create_rtp({49 << 1, 1, 19}), true), "h265 fu idr middle");
+  check(!is_start(create_rtp({1 << 1, 1}), true), "h265 single nal non idr");
+  std::cout << "Key frame start detection OK\n";
+}
+
+struct FrameTimes {
+  std::mutex mutex;
+  std::vector<std::chrono::steady_clock::time_point> times;
+  void add() {
+    std::lock_guard<std::mutex> lock(mutex);
+    times.push_back(std::chrono::steady_clock::now());
+  }
+  // Longest gap between 2 frames after @param begin, including the gap
+  // spanning @param begin
+  std::chrono::milliseconds longest_gap_after(
+      std::chrono::steady_clock::time_point begin) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::chrono::steady_clock::duration longest{0};
+    for (size_t i = 1; i < times.size(); i++) {
+      if (times[i] < begin) continue;
+      longest = std::max(longest, times[i] - times[i - 1]);
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(longest);
+  }
+  int count_after(std::chrono::steady_clock::time_point begin) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)std::count_if(times.begin(), times.end(),
+                              [begin](auto tp) { return tp >= begin; });
+  }
+};
+
+struct Change {
+  std::string name;
+  std::function<void(CameraHolder&)> apply;
+};
+
+int main(int argc, char* argv[]) {
+  test_keyframe_start();
+  // We need root to read / write camera settings.
+  OHDUtil::terminate_if_not_root();
+  std::vector<Change> changes = {
+      {"resolution",
+       [](CameraHolder& holder) {
+         holder.set_video_width_height_framerate(1280, 720, 30);
+       }},
+      {"framerate",
+       [](CameraHolder& holder) {
+         holder.set_video_width_height_framerate(1280, 720, 60);
+       }},
+      {"keyframe interval",
+       [](CameraHolder& holder) { holder.set_keyframe_interval(10); }},
+      {"codec h265",
+       [](CameraHolder& holder) {
+         holder.set_video_codec(video_codec_to_int(VideoCodec::H265));
+       }},
+      {"codec h264",
+       [](CameraHolder& holder) {
+         holder.set_video_codec(video_codec_to_int(VideoCodec::H264));
+       }},
+  };
+  // Per change: blackout with a full restart / hitless
+  std::map<std::string, std::chrono::milliseconds> blackout_full_restart;
+  std::map<std::string, std::chrono::milliseconds> blackout_hitless;
+  for (const bool hitless : {false, true}) {
+    XCamera camera{};
+    camera.camera_type = X_CAM_TYPE_DUMMY_SW;
+    camera.index = 0;
+    auto holder = std::make_shared<CameraHolder>(camera);
+    holder->unsafe_get_settings().force_sw_encode = true;
+    holder->set_video_width_height_framerate(640, 480, 30);
+    holder->set_video_codec(video_codec_to_int(VideoCodec::H264));
+    holder->set_keyframe_interval(5);
+    FrameTimes frame_times;
+    auto cb = [&frame_times](int, const openhd::FragmentedVideoFrame&) {
+      frame_times.add();
+    };
+    GStreamerStream stream(holder, cb);
+    stream.set_enable_hitless_reconfiguration(hitless);
+    stream.start_looping();
+    // Give the first pipeline time to start up
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+    std::cout << (hitless ? "Hitless" : "Full restart") << ":\n";
+    for (const auto& change : changes) {
+      const auto begin = std::chrono::steady_clock::now();
+      change.apply(*holder);
+      std::this_thread::sleep_for(std::chrono::seconds(8));
+      const auto blackout = frame_times.longest_gap_after(begin);
+      const int n_frames = frame_times.count_after(begin);
+      std::cout << "  " << change.name << ": blackout " << blackout.count()
+                << "ms, " << n_frames << " frames\n";
+      // 8 seconds of video at >= 30fps, allowing for the blackout
+      check(n_frames >= 30, change.name + ": video after the change");
+      (hitless ? blackout_hitless : blackout_full_restart)[change.name] =
+          blackout;
+    }
+    stream.terminate_looping();
+  }
+  for (const auto& change : changes) {
+    const auto hitless = blackout_hitless.at(change.name);
+    const auto full_restart = blackout_full_restart.at(change.name);
+    check(hitless < full_restart, change.name + ": hitless is shorter");
+    // A full restart takes seconds, the switch to the standby pipeline should
+    // at most wait for the next key frame
+    check(hitless < std::chrono::milliseconds(1000),
+          change.name + ": hitless blackout below 1s");
+  }
+  std::cout << "PASSED\n";
+  return 0;
+}
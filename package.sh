@@ -84,7 +84,7 @@ build_package() {
     if [[ "${CUSTOM}" == "standard" ]]; then
       package_name="openhd"
       packages+=(
-        libpoco-dev libcamera-openhd gst-openhd-plugins iw nmap aircrack-ng
+        libcamera-openhd gst-openhd-plugins iw nmap aircrack-ng
         i2c-tools libv4l-dev libusb-1.0-0 libpcap-dev libnl-3-dev libnl-genl-3-dev
         libsdl2-2.0-0 libsodium-dev gstreamer1.0-plugins-{base,good,bad,ugly}
         gstreamer1.0-{tools,alsa,pulseaudio}
@@ -92,14 +92,14 @@ build_package() {
     else
       package_name="openhd-x20"
       packages+=(
-        libpoco-dev iw i2c-tools libv4l-dev libusb-1.0-0 libpcap-dev
+        iw i2c-tools libv4l-dev libusb-1.0-0 libpcap-dev
         libnl-3-dev libnl-genl-3-dev libsdl2-2.0-0 libsodium-dev
         gstreamer1.0-plugins-{base,good,bad} gstreamer1.0-tools
       )
     fi
   elif [[ "${PACKAGE_ARCH}" == "x86_64" ]]; then
     packages+=(
-      libpoco-dev dkms qopenhd git iw nmap aircrack-ng i2c-tools libv4l-dev
+      dkms qopenhd git iw nmap aircrack-ng i2c-tools libv4l-dev
       libusb-1.0-0 libpcap-dev libnl-3-dev libnl-genl-3-dev libsdl2-2.0-0
       libsodium-dev gstreamer1.0-plugins-{base,good,bad,ugly,libav}
       gstreamer1.0-{tools,alsa,pulseaudio}